@@ -112,7 +112,6 @@ HEADERS += src/activemasternode.h \
            src/valuto-config.h \
            src/db.h \
            src/eccryptoverify.h \
-           src/ecwrapper.h \
            src/hash.h \
            src/init.h \
            src/swifttx.h \
@@ -403,7 +402,6 @@ SOURCES += src/activemasternode.cpp \
            src/valuto.cpp \
            src/db.cpp \
            src/eccryptoverify.cpp \
-           src/ecwrapper.cpp \
            src/editaddressdialog.cpp \
            src/hash.cpp \
            src/init.cpp \
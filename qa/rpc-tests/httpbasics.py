@@ -10,6 +10,8 @@
 from test_framework import BitcoinTestFramework
 from util import *
 import base64
+import json
+import socket
 
 try:
     import http.client as httplib
@@ -98,5 +100,52 @@ class HTTPBasicsTest (BitcoinTestFramework):
         assert_equal('"error":null' in out1, True)
         assert_equal(conn.sock!=None, True) #connection must be closed because bitcoind should use keep-alive by default
         
+        #idle keep-alive connections must not hold the rpc threads: keep more of them open than there are threads
+        conns = []
+        for i in range(8):
+            c = httplib.HTTPConnection(urlNode2.hostname, urlNode2.port)
+            c.connect()
+            conns.append(c)
+        for i in range(2):
+            for c in conns:
+                c.request('POST', '/', '{"method": "getblockcount"}', headers)
+                assert_equal('"error":null' in c.getresponse().read(), True)
+        for c in conns:
+            c.close()
+        
+        #pipelined requests are answered in order on the same connection
+        sock = socket.create_connection((urlNode2.hostname, urlNode2.port))
+        request = ''
+        for method in ['getbestblockhash', 'getblockcount']:
+            body = '{"method": "%s", "id": "%s"}' % (method, method)
+            request += 'POST / HTTP/1.1\r\nAuthorization: %s\r\nContent-Length: %d\r\n\r\n%s' % (headers['Authorization'], len(body), body)
+        sock.sendall(request)
+        reply = ''
+        while reply.count('"id":') < 2:
+            data = sock.recv(4096)
+            assert(data)
+            reply += data
+        assert(reply.index('"id":"getbestblockhash"') < reply.index('"id":"getblockcount"'))
+        sock.close()
+        
+        #headers that don't fit in the read buffer are turned away
+        conn = httplib.HTTPConnection(urlNode2.hostname, urlNode2.port)
+        conn.connect()
+        conn.request('POST', '/', '{"method": "getbestblockhash"}', dict(headers, **{'X-Padding': 'x' * 10000}))
+        assert_equal(conn.getresponse().status, 431)
+        conn.close()
+        
+        #results written out as they are produced read back the same, over HTTP/1.1 and HTTP/1.0
+        besthash = self.nodes[2].getbestblockhash()
+        block = self.nodes[2].getblock(besthash, 2)
+        assert_equal([tx['txid'] for tx in block['tx']], self.nodes[2].getblock(besthash)['tx'])
+        assert_equal(len(self.nodes[2].getblock(besthash, 0)), 2 * block['size'])
+        conn = httplib.HTTPConnection(urlNode2.hostname, urlNode2.port)
+        conn._http_vsn = 10
+        conn._http_vsn_str = 'HTTP/1.0'
+        conn.request('POST', '/', '{"method": "getrawmempool", "params": [true], "id": 1}', headers)
+        assert_equal(json.loads(conn.getresponse().read()), {"result": {}, "error": None, "id": 1})
+        conn.close()
+        
 if __name__ == '__main__':
     HTTPBasicsTest ().main ()
@@ -20,9 +20,9 @@ try:
 except ImportError:
     import urlparse
 
-def http_get_call(host, port, path, response_object = 0):
+def http_get_call(host, port, path, response_object = 0, headers = {}):
     conn = httplib.HTTPConnection(host, port)
-    conn.request('GET', path)
+    conn.request('GET', path, None, headers)
     
     if response_object:
         return conn.getresponse()
@@ -82,6 +82,66 @@ class RESTTest (BitcoinTestFramework):
         json_obj = json.loads(json_string)
         for tx in txs:
             assert_equal(tx in json_obj['tx'], True)
+        
+        # headers along the active chain, from the given block on
+        json_string = http_get_call(url.hostname, url.port, '/rest/headers/5/'+bb_hash+self.FORMAT_SEPARATOR+'json')
+        json_obj = json.loads(json_string)
+        assert_equal(len(json_obj), 2) #bb_hash and the block mined above
+        assert_equal(json_obj[0]['hash'], bb_hash)
+        assert_equal(json_obj[1]['hash'], newblockhash[0])
+        assert_equal(json_obj[1]['previousblockhash'], bb_hash)
+        response = http_get_call(url.hostname, url.port, '/rest/headers/1/'+bb_hash+self.FORMAT_SEPARATOR+'bin', True)
+        assert_equal(response.status, 200)
+        response = http_get_call(url.hostname, url.port, '/rest/headers/0/'+bb_hash+self.FORMAT_SEPARATOR+'json', True)
+        assert_equal(response.status, 400)
+        
+        # the outputs of the mined transactions are unspent, one that does not exist is not
+        tx_json = self.nodes[0].getrawtransaction(txs[0], 1)
+        n = [vout['n'] for vout in tx_json['vout'] if vout['value'] == 11][0]
+        json_string = http_get_call(url.hostname, url.port, '/rest/getutxos/'+txs[0]+'-'+str(n)+'/'+txs[0]+'-99'+self.FORMAT_SEPARATOR+'json')
+        json_obj = json.loads(json_string)
+        assert_equal(json_obj['chaintipHash'], newblockhash[0])
+        assert_equal(json_obj['bitmap'], "10")
+        assert_equal(len(json_obj['utxos']), 1)
+        assert_equal(json_obj['utxos'][0]['value'], 11)
+        
+        # an output only in the mempool counts with checkmempool
+        txid = self.nodes[0].sendtoaddress(self.nodes[2].getnewaddress(), 1)
+        self.sync_all()
+        n = [vout['n'] for vout in self.nodes[0].getrawtransaction(txid, 1)['vout'] if vout['value'] == 1][0]
+        json_obj = json.loads(http_get_call(url.hostname, url.port, '/rest/getutxos/'+txid+'-'+str(n)+self.FORMAT_SEPARATOR+'json'))
+        assert_equal(json_obj['bitmap'], "0")
+        json_obj = json.loads(http_get_call(url.hostname, url.port, '/rest/getutxos/checkmempool/'+txid+'-'+str(n)+self.FORMAT_SEPARATOR+'json'))
+        assert_equal(json_obj['bitmap'], "1")
+        response = http_get_call(url.hostname, url.port, '/rest/getutxos/'+'/'.join([txid+'-0'] * 16)+self.FORMAT_SEPARATOR+'json', True)
+        assert_equal(response.status, 400)
+        
+        # chain and mempool info, mempool contents
+        json_obj = json.loads(http_get_call(url.hostname, url.port, '/rest/chaininfo.json'))
+        assert_equal(json_obj['bestblockhash'], newblockhash[0])
+        json_obj = json.loads(http_get_call(url.hostname, url.port, '/rest/mempool/info.json'))
+        assert_equal(json_obj['size'], 1)
+        json_obj = json.loads(http_get_call(url.hostname, url.port, '/rest/mempool/contents.json'))
+        assert_equal(json_obj.keys(), [txid])
+        response = http_get_call(url.hostname, url.port, '/rest/masternodes.json', True)
+        assert_equal(response.status, 200)
+        
+        # a reply the client holds is not sent again while it has not changed
+        response = http_get_call(url.hostname, url.port, '/rest/block/'+bb_hash+self.FORMAT_SEPARATOR+'hex', True)
+        assert_equal(response.status, 200)
+        assert('max-age' in response.getheader('cache-control'))
+        etag = response.getheader('etag')
+        response = http_get_call(url.hostname, url.port, '/rest/block/'+bb_hash+self.FORMAT_SEPARATOR+'hex', True, {'If-None-Match': etag})
+        assert_equal(response.status, 304)
+        response = http_get_call(url.hostname, url.port, '/rest/mempool/info.json', True)
+        etag = response.getheader('etag')
+        assert_equal(response.getheader('cache-control'), 'no-cache')
+        response = http_get_call(url.hostname, url.port, '/rest/mempool/info.json', True, {'If-None-Match': etag})
+        assert_equal(response.status, 304)
+        self.nodes[1].setgenerate(True, 1)
+        self.sync_all()
+        response = http_get_call(url.hostname, url.port, '/rest/mempool/info.json', True, {'If-None-Match': etag})
+        assert_equal(response.status, 200)
                 
         
 
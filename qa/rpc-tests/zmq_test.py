@@ -11,6 +11,7 @@ from test_framework.test_framework import BitcoinTestFramework
 from test_framework.util import *
 import zmq
 import binascii
+import struct
 
 try:
     import http.client as httplib
@@ -31,8 +32,12 @@ class ZMQTest (BitcoinTestFramework):
         self.zmqSubSocket.setsockopt(zmq.SUBSCRIBE, b"hashblock")
         self.zmqSubSocket.setsockopt(zmq.SUBSCRIBE, b"hashtx")
         self.zmqSubSocket.connect("tcp://127.0.0.1:%i" % self.port)
+        self.zmqRemovedSocket = self.zmqContext.socket(zmq.SUB)
+        self.zmqRemovedSocket.setsockopt(zmq.SUBSCRIBE, b"hashtxremoved")
+        self.zmqRemovedSocket.connect("tcp://127.0.0.1:%i" % self.port)
         return start_nodes(4, self.options.tmpdir, extra_args=[
-            ['-zmqpubhashtx=tcp://127.0.0.1:'+str(self.port), '-zmqpubhashblock=tcp://127.0.0.1:'+str(self.port)],
+            ['-zmqpubhashtx=tcp://127.0.0.1:'+str(self.port), '-zmqpubhashblock=tcp://127.0.0.1:'+str(self.port),
+             '-zmqpubhashtxremoved=tcp://127.0.0.1:'+str(self.port)],
             [],
             [],
             []
@@ -55,21 +60,25 @@ class ZMQTest (BitcoinTestFramework):
         blkhash = bytes_to_hex_str(body)
 
         assert_equal(genhashes[0], blkhash) #blockhash from generate must be equal to the hash received over zmq
+        assert_equal(struct.unpack('<I', msg[2])[-1], 0) #every topic counts its messages from 0
 
         n = 10
         genhashes = self.nodes[1].generate(n)
         self.sync_all()
 
         zmqHashes = []
+        zmqSequences = []
         for x in range(0,n*2):
             msg = self.zmqSubSocket.recv_multipart()
             topic = msg[0]
             body = msg[1]
             if topic == b"hashblock":
                 zmqHashes.append(bytes_to_hex_str(body))
+                zmqSequences.append(struct.unpack('<I', msg[2])[-1])
 
         for x in range(0,n):
             assert_equal(genhashes[x], zmqHashes[x]) #blockhash from generate must be equal to the hash received over zmq
+            assert_equal(zmqSequences[x], x + 1) #the sequence of a topic counts up without gaps
 
         #test tx from a second node
         hashRPC = self.nodes[1].sendtoaddress(self.nodes[0].getnewaddress(), 1.0)
@@ -85,6 +94,15 @@ class ZMQTest (BitcoinTestFramework):
 
         assert_equal(hashRPC, hashZMQ) #blockhash from generate must be equal to the hash received over zmq
 
+        # mining the tx removes it from the mempool
+        self.nodes[1].generate(1)
+        self.sync_all()
+
+        msg = self.zmqRemovedSocket.recv_multipart()
+        assert_equal(msg[0], b"hashtxremoved")
+        assert_equal(bytes_to_hex_str(msg[1]), hashRPC)
+        assert_equal(struct.unpack('<I', msg[2])[-1], 0)
+
 
 if __name__ == '__main__':
     ZMQTest ().main ()
@@ -0,0 +1,252 @@
+// Copyright (c) 2017-2020 The VALUTO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "addressindex.h"
+
+#include "chain.h"
+#include "coins.h"
+#include "main.h"
+#include "script/standard.h"
+#include "txdb.h"
+#include "undo.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <boost/thread.hpp>
+
+using namespace std;
+
+bool GetAddressIndexKey(const CScript& script, uint160& hashBytes, unsigned char& type)
+{
+    CTxDestination dest;
+    if (!ExtractDestination(script, dest))
+        return false;
+    if (const CKeyID* keyID = boost::get<CKeyID>(&dest)) {
+        hashBytes = *keyID;
+        type = ADDRESS_TYPE_PUBKEYHASH;
+        return true;
+    }
+    if (const CScriptID* scriptID = boost::get<CScriptID>(&dest)) {
+        hashBytes = *scriptID;
+        type = ADDRESS_TYPE_SCRIPTHASH;
+        return true;
+    }
+    return false;
+}
+
+void ConnectAddressIndexes(const CBlock& block, const CBlockUndo& blockundo, int nHeight, CAddressIndexUpdate& update)
+{
+    for (unsigned int i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = block.vtx[i];
+        const uint256 txhash = tx.GetHash();
+        uint160 hashBytes;
+        unsigned char type;
+
+        if (!tx.IsCoinBase()) {
+            const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+            for (unsigned int j = 0; j < tx.vin.size(); j++) {
+                const COutPoint& prevout = tx.vin[j].prevout;
+                const CTxOut& txout = txundo.vprevout[j].txout;
+                bool fKey = GetAddressIndexKey(txout.scriptPubKey, hashBytes, type);
+                if (!fKey) {
+                    hashBytes.SetNull();
+                    type = ADDRESS_TYPE_NONE;
+                }
+
+                if (fAddressIndex && fKey) {
+                    update.vAddressIndex.push_back(make_pair(CAddressIndexKey(type, hashBytes, nHeight, i, txhash, j, true), -txout.nValue));
+                    update.vAddressUnspentErase.push_back(CAddressUnspentKey(type, hashBytes, prevout.hash, prevout.n));
+                }
+                if (fSpentIndex)
+                    update.vSpentIndex.push_back(make_pair(CSpentIndexKey(prevout.hash, prevout.n), CSpentIndexValue(txhash, j, nHeight, txout.nValue, type, hashBytes)));
+            }
+        }
+
+        if (!fAddressIndex)
+            continue;
+        for (unsigned int k = 0; k < tx.vout.size(); k++) {
+            const CTxOut& out = tx.vout[k];
+            if (!GetAddressIndexKey(out.scriptPubKey, hashBytes, type))
+                continue;
+            update.vAddressIndex.push_back(make_pair(CAddressIndexKey(type, hashBytes, nHeight, i, txhash, k, false), out.nValue));
+            update.vAddressUnspent.push_back(make_pair(CAddressUnspentKey(type, hashBytes, txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, nHeight)));
+        }
+    }
+}
+
+/** The height at which outpoint, paid to (type, hashBytes), was created below nHeightMax, from its entry in the address index */
+static int GetIndexedOutputHeight(unsigned char type, const uint160& hashBytes, const COutPoint& outpoint, int nHeightMax)
+{
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vEntries;
+    if (!pblocktree->ReadAddressIndex(hashBytes, type, vEntries, 0, nHeightMax))
+        return 0;
+    for (const std::pair<CAddressIndexKey, CAmount>& entry : vEntries) {
+        if (!entry.first.spending && entry.first.txhash == outpoint.hash && entry.first.index == outpoint.n)
+            return entry.first.blockHeight;
+    }
+    return 0;
+}
+
+void DisconnectAddressIndexes(const CBlock& block, const CBlockUndo& blockundo, int nHeight, const CCoinsViewCache* pview, CAddressIndexUpdate& update)
+{
+    // Only the last spent output of a transaction carries its height in the undo data; it
+    // is the height of the other outputs of that transaction the block spends too.
+    std::map<uint256, int> mapPrevHeight;
+    for (unsigned int i = 1; i < block.vtx.size(); i++) {
+        const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+        for (unsigned int j = 0; j < block.vtx[i].vin.size(); j++) {
+            if (txundo.vprevout[j].nHeight != 0)
+                mapPrevHeight[block.vtx[i].vin[j].prevout.hash] = txundo.vprevout[j].nHeight;
+        }
+    }
+
+    for (unsigned int i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = block.vtx[i];
+        const uint256 txhash = tx.GetHash();
+        uint160 hashBytes;
+        unsigned char type;
+
+        if (fAddressIndex) {
+            for (unsigned int k = 0; k < tx.vout.size(); k++) {
+                if (!GetAddressIndexKey(tx.vout[k].scriptPubKey, hashBytes, type))
+                    continue;
+                update.vAddressIndexErase.push_back(CAddressIndexKey(type, hashBytes, nHeight, i, txhash, k, false));
+                update.vAddressUnspentErase.push_back(CAddressUnspentKey(type, hashBytes, txhash, k));
+            }
+        }
+
+        if (tx.IsCoinBase())
+            continue;
+        const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+        for (unsigned int j = 0; j < tx.vin.size(); j++) {
+            const COutPoint& prevout = tx.vin[j].prevout;
+            const CTxInUndo& undo = txundo.vprevout[j];
+            if (fSpentIndex)
+                update.vSpentIndexErase.push_back(CSpentIndexKey(prevout.hash, prevout.n));
+            if (!fAddressIndex || !GetAddressIndexKey(undo.txout.scriptPubKey, hashBytes, type))
+                continue;
+
+            // A transaction that keeps unspent outputs after the block has its height in the
+            // chainstate the block is disconnected from, or else in the address index.
+            int nPrevHeight = 0;
+            std::map<uint256, int>::const_iterator it = mapPrevHeight.find(prevout.hash);
+            if (it != mapPrevHeight.end()) {
+                nPrevHeight = it->second;
+            } else if (pview) {
+                const CCoins* coins = pview->AccessCoins(prevout.hash);
+                if (coins)
+                    nPrevHeight = coins->nHeight;
+            } else {
+                nPrevHeight = GetIndexedOutputHeight(type, hashBytes, prevout, nHeight);
+            }
+            update.vAddressIndexErase.push_back(CAddressIndexKey(type, hashBytes, nHeight, i, txhash, j, true));
+            update.vAddressUnspent.push_back(make_pair(CAddressUnspentKey(type, hashBytes, prevout.hash, prevout.n), CAddressUnspentValue(undo.txout.nValue, undo.txout.scriptPubKey, nPrevHeight)));
+        }
+    }
+}
+
+bool InitAddressIndexes()
+{
+    bool fStoredAddressIndex = false;
+    bool fStoredSpentIndex = false;
+    pblocktree->ReadFlag("addressindex", fStoredAddressIndex);
+    pblocktree->ReadFlag("spentindex", fStoredSpentIndex);
+
+    if (fStoredAddressIndex != fAddressIndex || fStoredSpentIndex != fSpentIndex) {
+        LogPrintf("Address index configuration changed (addressindex %d->%d, spentindex %d->%d), wiping indexes\n",
+            fStoredAddressIndex, fAddressIndex, fStoredSpentIndex, fSpentIndex);
+        if (!pblocktree->WipeAddressIndexes())
+            return error("%s : failed to wipe address indexes", __func__);
+        if (!pblocktree->WriteFlag("addressindex", fAddressIndex) || !pblocktree->WriteFlag("spentindex", fSpentIndex))
+            return error("%s : failed to write index flags", __func__);
+    }
+
+    // ThreadAddressIndexBuild catches up with the chain before ConnectBlock takes over
+    fAddressIndexSynced = false;
+    return true;
+}
+
+void ThreadAddressIndexBuild()
+{
+    if (!fAddressIndex && !fSpentIndex)
+        return;
+
+    int64_t nStart = GetTimeMillis();
+    int nBlocks = 0;
+    LogPrintf("Building address indexes in the background...\n");
+
+    while (true) {
+        boost::this_thread::interruption_point();
+
+        CBlockIndex* pindex = NULL;
+        bool fConnect = true;
+        {
+            LOCK(cs_main);
+            uint256 hashBest;
+            pblocktree->ReadAddressIndexBestBlock(hashBest);
+            CBlockIndex* pindexBest = NULL;
+            if (hashBest != 0) {
+                BlockMap::iterator mi = mapBlockIndex.find(hashBest);
+                if (mi == mapBlockIndex.end()) {
+                    LogPrintf("%s : indexed block %s is unknown, rebuilding\n", __func__, hashBest.ToString());
+                    if (!pblocktree->WipeAddressIndexes()) {
+                        LogPrintf("%s : failed to wipe address indexes, stopping\n", __func__);
+                        return;
+                    }
+                } else {
+                    pindexBest = mi->second;
+                }
+            }
+
+            if (pindexBest && !chainActive.Contains(pindexBest)) {
+                // the indexes follow a block that was reorganized away: walk back first
+                pindex = pindexBest;
+                fConnect = false;
+            } else {
+                pindex = pindexBest ? chainActive.Next(pindexBest) : chainActive.Genesis();
+                if (!pindex) {
+                    // Caught up with the tip: from now on ConnectBlock and DisconnectBlock keep the indexes current.
+                    fAddressIndexSynced = true;
+                    break;
+                }
+            }
+        }
+
+        CBlock block;
+        CBlockUndo blockundo;
+        if (!ReadBlockFromDisk(block, pindex)) {
+            LogPrintf("%s : failed to read block %s, stopping\n", __func__, pindex->GetBlockHash().ToString());
+            return;
+        }
+        if (pindex->pprev && !blockundo.ReadFromDisk(pindex->GetUndoPos(), pindex->pprev->GetBlockHash())) {
+            LogPrintf("%s : failed to read undo data of block %s, stopping\n", __func__, pindex->GetBlockHash().ToString());
+            return;
+        }
+
+        {
+            LOCK(cs_main);
+            CAddressIndexUpdate update;
+            bool fWritten;
+            if (fConnect) {
+                // the genesis outputs are not spendable, only advance the marker
+                if (pindex->pprev)
+                    ConnectAddressIndexes(block, blockundo, pindex->nHeight, update);
+                fWritten = pblocktree->WriteAddressIndexUpdate(update, pindex->GetBlockHash());
+            } else {
+                // the chainstate is on another chain, the heights come from the undo data and the address index
+                DisconnectAddressIndexes(block, blockundo, pindex->nHeight, NULL, update);
+                fWritten = pblocktree->WriteAddressIndexUpdate(update, pindex->pprev->GetBlockHash());
+            }
+            if (!fWritten) {
+                LogPrintf("%s : failed to write address indexes, stopping\n", __func__);
+                return;
+            }
+        }
+
+        if (++nBlocks % 10000 == 0)
+            LogPrintf("Address indexes: height %d\n", pindex->nHeight);
+    }
+
+    LogPrintf("Address indexes synced: %d blocks in %dms\n", nBlocks, GetTimeMillis() - nStart);
+}
@@ -0,0 +1,269 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Copyright (c) 2017-2020 The VALUTO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_ADDRESSINDEX_H
+#define BITCOIN_ADDRESSINDEX_H
+
+#include "amount.h"
+#include "crypto/common.h"
+#include "script/script.h"
+#include "serialize.h"
+#include "spentindex.h"
+#include "uint256.h"
+
+#include <utility>
+#include <vector>
+
+class CBlock;
+class CBlockIndex;
+class CBlockUndo;
+class CCoinsViewCache;
+
+/** -addressindex default */
+static const bool DEFAULT_ADDRESSINDEX = false;
+/** -spentindex default */
+static const bool DEFAULT_SPENTINDEX = false;
+
+/** Address types used as the first byte of every address index key */
+enum AddressIndexType {
+    ADDRESS_TYPE_NONE = 0,
+    ADDRESS_TYPE_PUBKEYHASH = 1,
+    ADDRESS_TYPE_SCRIPTHASH = 2,
+};
+
+/**
+ * Heights are stored big-endian so that LevelDB iterates the entries of an
+ * address in chain order.
+ */
+template <typename Stream>
+inline void SerializeHeightBE(Stream& s, int nHeight)
+{
+    unsigned char buf[4];
+    WriteBE32(buf, (uint32_t)nHeight);
+    s.write((char*)buf, sizeof(buf));
+}
+
+template <typename Stream>
+inline int UnserializeHeightBE(Stream& s)
+{
+    unsigned char buf[4];
+    s.read((char*)buf, sizeof(buf));
+    return (int)ReadBE32(buf);
+}
+
+/** One credit or debit of an address: ('a', key) -> amount */
+struct CAddressIndexKey {
+    unsigned char type;
+    uint160 hashBytes;
+    int blockHeight;
+    unsigned int txindex;
+    uint256 txhash;
+    unsigned int index;
+    bool spending;
+
+    CAddressIndexKey(unsigned char addressType, const uint160& addressHash, int height, unsigned int blockindex,
+                     const uint256& txid, unsigned int indexValue, bool isSpending) : type(addressType), hashBytes(addressHash), blockHeight(height),
+                                                                                      txindex(blockindex), txhash(txid), index(indexValue), spending(isSpending) {}
+
+    CAddressIndexKey()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        type = ADDRESS_TYPE_NONE;
+        hashBytes.SetNull();
+        blockHeight = 0;
+        txindex = 0;
+        txhash.SetNull();
+        index = 0;
+        spending = false;
+    }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 1 + 20 + 4 + 4 + 32 + 4 + 1;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        ::Serialize(s, type, nType, nVersion);
+        hashBytes.Serialize(s, nType, nVersion);
+        SerializeHeightBE(s, blockHeight);
+        SerializeHeightBE(s, txindex);
+        txhash.Serialize(s, nType, nVersion);
+        ::Serialize(s, index, nType, nVersion);
+        ::Serialize(s, spending, nType, nVersion);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        ::Unserialize(s, type, nType, nVersion);
+        hashBytes.Unserialize(s, nType, nVersion);
+        blockHeight = UnserializeHeightBE(s);
+        txindex = UnserializeHeightBE(s);
+        txhash.Unserialize(s, nType, nVersion);
+        ::Unserialize(s, index, nType, nVersion);
+        ::Unserialize(s, spending, nType, nVersion);
+    }
+};
+
+/** Seek key for all entries of an address, optionally starting at a height */
+struct CAddressIndexIteratorKey {
+    unsigned char type;
+    uint160 hashBytes;
+    int blockHeight;
+    bool fHeight;
+
+    CAddressIndexIteratorKey(unsigned char addressType, const uint160& addressHash) : type(addressType), hashBytes(addressHash), blockHeight(0), fHeight(false) {}
+    CAddressIndexIteratorKey(unsigned char addressType, const uint160& addressHash, int height) : type(addressType), hashBytes(addressHash), blockHeight(height), fHeight(true) {}
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 1 + 20 + (fHeight ? 4 : 0);
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        ::Serialize(s, type, nType, nVersion);
+        hashBytes.Serialize(s, nType, nVersion);
+        if (fHeight)
+            SerializeHeightBE(s, blockHeight);
+    }
+};
+
+/** An unspent output of an address: ('u', key) -> value */
+struct CAddressUnspentKey {
+    unsigned char type;
+    uint160 hashBytes;
+    uint256 txhash;
+    unsigned int index;
+
+    CAddressUnspentKey(unsigned char addressType, const uint160& addressHash, const uint256& txid, unsigned int indexValue) : type(addressType), hashBytes(addressHash), txhash(txid), index(indexValue) {}
+
+    CAddressUnspentKey()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        type = ADDRESS_TYPE_NONE;
+        hashBytes.SetNull();
+        txhash.SetNull();
+        index = 0;
+    }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 1 + 20 + 32 + 4;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        ::Serialize(s, type, nType, nVersion);
+        hashBytes.Serialize(s, nType, nVersion);
+        txhash.Serialize(s, nType, nVersion);
+        ::Serialize(s, index, nType, nVersion);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        ::Unserialize(s, type, nType, nVersion);
+        hashBytes.Unserialize(s, nType, nVersion);
+        txhash.Unserialize(s, nType, nVersion);
+        ::Unserialize(s, index, nType, nVersion);
+    }
+};
+
+/** Seek key for the unspent outputs of an address */
+struct CAddressUnspentIteratorKey {
+    unsigned char type;
+    uint160 hashBytes;
+
+    CAddressUnspentIteratorKey(unsigned char addressType, const uint160& addressHash) : type(addressType), hashBytes(addressHash) {}
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 1 + 20;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        ::Serialize(s, type, nType, nVersion);
+        hashBytes.Serialize(s, nType, nVersion);
+    }
+};
+
+struct CAddressUnspentValue {
+    CAmount satoshis;
+    CScript script;
+    int blockHeight;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(satoshis);
+        READWRITE(script);
+        READWRITE(blockHeight);
+    }
+
+    CAddressUnspentValue(CAmount sats, const CScript& scriptPubKey, int height) : satoshis(sats), script(scriptPubKey), blockHeight(height) {}
+
+    CAddressUnspentValue()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        satoshis = -1;
+        script.clear();
+        blockHeight = 0;
+    }
+
+    bool IsNull() const
+    {
+        return satoshis == -1;
+    }
+};
+
+/** All index writes caused by connecting or disconnecting one block, applied in a single batch */
+struct CAddressIndexUpdate {
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vAddressIndex;
+    std::vector<CAddressIndexKey> vAddressIndexErase;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vAddressUnspent;
+    std::vector<CAddressUnspentKey> vAddressUnspentErase;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > vSpentIndex;
+    std::vector<CSpentIndexKey> vSpentIndexErase;
+};
+
+/** Map a scriptPubKey to the (type, hash) pair used as address index key; P2PK maps to its key hash */
+bool GetAddressIndexKey(const CScript& script, uint160& hashBytes, unsigned char& type);
+
+/** Collect the index entries created by connecting block, using the spent outputs recorded in blockundo */
+void ConnectAddressIndexes(const CBlock& block, const CBlockUndo& blockundo, int nHeight, CAddressIndexUpdate& update);
+/**
+ * Collect the index changes that revert ConnectAddressIndexes. The heights of restored outputs come from
+ * blockundo, and where it lacks them from pview, the chainstate the block is disconnected from, if given
+ */
+void DisconnectAddressIndexes(const CBlock& block, const CBlockUndo& blockundo, int nHeight, const CCoinsViewCache* pview, CAddressIndexUpdate& update);
+
+/** Compare the stored index configuration with -addressindex/-spentindex and wipe the indexes when it changed */
+bool InitAddressIndexes();
+
+/** Background builder: apply the blocks of chainActive that are not covered by the indexes yet */
+void ThreadAddressIndexBuild();
+
+#endif // BITCOIN_ADDRESSINDEX_H
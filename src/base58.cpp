@@ -288,6 +288,22 @@ bool CBitcoinAddress::GetKeyID(CKeyID& keyID) const
     return true;
 }
 
+bool CBitcoinAddress::GetIndexKey(uint160& hashBytes, int& type) const
+{
+    if (!IsValid())
+        return false;
+    memcpy(&hashBytes, &vchData[0], 20);
+    if (vchVersion == Params().Base58Prefix(CChainParams::PUBKEY_ADDRESS)) {
+        type = 1;
+        return true;
+    }
+    if (vchVersion == Params().Base58Prefix(CChainParams::SCRIPT_ADDRESS)) {
+        type = 2;
+        return true;
+    }
+    return false;
+}
+
 bool CBitcoinAddress::IsScript() const
 {
     return IsValid() && vchVersion == Params().Base58Prefix(CChainParams::SCRIPT_ADDRESS);
@@ -122,6 +122,8 @@ public:
 
     CTxDestination Get() const;
     bool GetKeyID(CKeyID& keyID) const;
+    //! hash and AddressIndexType of this address as used by the address index
+    bool GetIndexKey(uint160& hashBytes, int& type) const;
     bool IsScript() const;
 };
 
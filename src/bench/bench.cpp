@@ -0,0 +1,65 @@
+// Copyright (c) 2017-2020 The VALUTO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "utiltime.h"
+
+#include <iostream>
+
+benchmark::BenchRunner::BenchmarkMap& benchmark::BenchRunner::benchmarks()
+{
+    static BenchmarkMap benchmarks_map;
+    return benchmarks_map;
+}
+
+benchmark::BenchRunner::BenchRunner(const std::string& name, benchmark::BenchFunction func)
+{
+    benchmarks().insert(std::make_pair(name, func));
+}
+
+void benchmark::BenchRunner::RunAll(double elapsedTimeForOne)
+{
+    std::cout << "#Benchmark" << "," << "count" << "," << "min" << "," << "max" << "," << "average" << "," << "per_second" << "\n";
+
+    for (BenchmarkMap::const_iterator it = benchmarks().begin(); it != benchmarks().end(); ++it) {
+        State state(it->first, elapsedTimeForOne);
+        it->second(state);
+    }
+}
+
+bool benchmark::State::KeepRunning()
+{
+    int64_t nNow;
+    if (nIterations & nCountMask) {
+        ++nIterations;
+        return true;
+    }
+    nNow = GetTimeMicros();
+    if (nIterations == 0) {
+        nBeginTime = nLastTime = nNow;
+    } else {
+        // the clock is only read every nCountMask + 1 iterations, for fast benchmarks
+        double elapsed = (nNow - nLastTime) * 1e-6;
+        double elapsedOne = elapsed / (nCountMask + 1);
+        if (elapsedOne < minTime || minTime == 0)
+            minTime = elapsedOne;
+        if (elapsedOne > maxTime)
+            maxTime = elapsedOne;
+        if (elapsed * 128 < maxElapsed) {
+            // read the clock less often if one batch takes less than a 128th of the run
+            nCountMask = (nCountMask << 1) | 1;
+        }
+    }
+    nLastTime = nNow;
+    ++nIterations;
+
+    if ((nNow - nBeginTime) * 1e-6 < maxElapsed)
+        return true;
+
+    --nIterations;
+    double average = (nNow - nBeginTime) * 1e-6 / nIterations;
+    std::cout << name << "," << nIterations << "," << minTime << "," << maxTime << "," << average << "," << (average > 0 ? 1 / average : 0) << "\n";
+    return false;
+}
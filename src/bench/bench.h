@@ -0,0 +1,67 @@
+// Copyright (c) 2017-2020 The VALUTO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BENCH_BENCH_H
+#define BITCOIN_BENCH_BENCH_H
+
+#include <map>
+#include <stdint.h>
+#include <string>
+
+#include <boost/preprocessor/cat.hpp>
+#include <boost/preprocessor/stringize.hpp>
+
+/**
+ * A minimal benchmark harness. A benchmark is a function that runs its code
+ * in a loop while state.KeepRunning() is true:
+ *
+ *     static void CodeToTime(benchmark::State& state)
+ *     {
+ *         ... setup ...
+ *         while (state.KeepRunning()) {
+ *             ... code to time ...
+ *         }
+ *     }
+ *     BENCHMARK(CodeToTime);
+ *
+ * The loop runs for about a second, after which the time per iteration and
+ * the iterations per second are printed.
+ */
+namespace benchmark
+{
+class State
+{
+    std::string name;
+    double maxElapsed;
+    int64_t nBeginTime;
+    int64_t nLastTime;
+    uint64_t nIterations;
+    uint64_t nCountMask;
+    double minTime;
+    double maxTime;
+
+public:
+    State(const std::string& nameIn, double maxElapsedIn) : name(nameIn), maxElapsed(maxElapsedIn), nBeginTime(0), nLastTime(0), nIterations(0), nCountMask(1), minTime(0), maxTime(0) {}
+    bool KeepRunning();
+};
+
+typedef void (*BenchFunction)(State&);
+
+class BenchRunner
+{
+    typedef std::map<std::string, BenchFunction> BenchmarkMap;
+    static BenchmarkMap& benchmarks();
+
+public:
+    BenchRunner(const std::string& name, BenchFunction func);
+
+    static void RunAll(double elapsedTimeForOne = 1.0);
+};
+} // namespace benchmark
+
+// BENCHMARK(foo) expands to: benchmark::BenchRunner bench_11foo("foo", foo);
+#define BENCHMARK(n) \
+    benchmark::BenchRunner BOOST_PP_CAT(bench_, BOOST_PP_CAT(__LINE__, n))(BOOST_PP_STRINGIZE(n), n);
+
+#endif // BITCOIN_BENCH_BENCH_H
@@ -0,0 +1,94 @@
+// Copyright (c) 2017-2020 The VALUTO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "amount.h"
+#include "wallet/coinselection.h"
+
+#include <assert.h>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace
+{
+const unsigned int WALLET_COINS = 20000;
+
+/**
+ * The coins of a large synthetic wallet: mostly staking rewards and change of
+ * every size, with a run of identical payouts. Selection only looks at the
+ * values, so the coins carry an output index and no transaction.
+ */
+std::vector<CInputCoin> CreateWalletCoins()
+{
+    std::vector<CInputCoin> vCoins;
+    vCoins.reserve(WALLET_COINS);
+    for (unsigned int i = 0; i < WALLET_COINS; i++) {
+        CAmount nValue;
+        if (i % 10 == 0)
+            nValue = 5 * COIN;
+        else
+            nValue = CENT + (CAmount)(i * 7919 % 100000) * 1000;
+        vCoins.push_back(CInputCoin(NULL, i, nValue, 100, true, false, false));
+    }
+    return vCoins;
+}
+
+std::vector<const CInputCoin*> GetPoolCoins(const CCoinPool& pool)
+{
+    std::vector<const CInputCoin*> vCoins;
+    for (const CInputCoin& coin : pool.GetCoins())
+        vCoins.push_back(&coin);
+    return vCoins;
+}
+} // namespace
+
+/** Bucket the coins of the wallet, as every transaction the wallet creates does once. */
+static void CoinPoolTest(benchmark::State& state)
+{
+    const std::vector<CInputCoin> vWalletCoins = CreateWalletCoins();
+    while (state.KeepRunning()) {
+        std::vector<CInputCoin> vCoins(vWalletCoins);
+        CCoinPool pool(vCoins);
+        assert(pool.size() == WALLET_COINS);
+    }
+}
+
+/** Look for a changeless selection among the coins of the wallet. */
+static void CoinSelectionBnBTest(benchmark::State& state)
+{
+    std::vector<CInputCoin> vWalletCoins = CreateWalletCoins();
+    const CCoinPool pool(vWalletCoins);
+    const std::vector<const CInputCoin*> vCoins = GetPoolCoins(pool);
+
+    std::set<std::pair<const CWalletTx*, unsigned int> > setCoinsRet;
+    CAmount nValueRet;
+    CAmount nTarget = 12 * COIN;
+    while (state.KeepRunning()) {
+        SelectCoinsBnB(vCoins, nTarget, 2000, setCoinsRet, nValueRet);
+        nTarget += 12345;
+    }
+}
+
+/** Fall back on the knapsack solver with the coins of the wallet. */
+static void CoinSelectionKnapsackTest(benchmark::State& state)
+{
+    std::vector<CInputCoin> vWalletCoins = CreateWalletCoins();
+    const CCoinPool pool(vWalletCoins);
+    const std::vector<const CInputCoin*> vCoins = GetPoolCoins(pool);
+
+    std::set<std::pair<const CWalletTx*, unsigned int> > setCoinsRet;
+    CAmount nValueRet;
+    CAmount nTarget = 12 * COIN;
+    while (state.KeepRunning()) {
+        bool fSelected = SelectCoinsKnapsack(vCoins, nTarget, setCoinsRet, nValueRet);
+        assert(fSelected && nValueRet >= nTarget);
+        nTarget += 12345;
+    }
+}
+
+BENCHMARK(CoinPoolTest);
+BENCHMARK(CoinSelectionBnBTest);
+BENCHMARK(CoinSelectionKnapsackTest);
@@ -0,0 +1,99 @@
+// Copyright (c) 2017-2020 The VALUTO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "primitives/block.h"
+#include "primitives/transaction.h"
+#include "script/script.h"
+#include "streams.h"
+#include "version.h"
+
+#include <assert.h>
+#include <vector>
+
+namespace
+{
+const unsigned int BLOCK_TRANSACTIONS = 1000;
+
+/** A pay-to-pubkey-hash output script. */
+CScript DummyPayment(unsigned char n)
+{
+    return CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, n) << OP_EQUALVERIFY << OP_CHECKSIG;
+}
+
+/** A spend of a pay-to-pubkey-hash output: a 72-byte signature and a compressed key. */
+CTxIn DummySpend(unsigned int n)
+{
+    CTxIn txin(COutPoint(uint256(n + 1), n % 3));
+    txin.scriptSig = CScript() << std::vector<unsigned char>(72, (unsigned char)n) << std::vector<unsigned char>(33, 0x02);
+    return txin;
+}
+
+/**
+ * A proof-of-stake block the shape of a busy one on the network: the
+ * coinbase, the coinstake paying to a compressed key, and payments with one
+ * or two pay-to-pubkey-hash inputs and a payment and change output each.
+ */
+CBlock CreateBlock()
+{
+    CBlock block;
+    block.nVersion = 4;
+    block.nTime = 1500000000;
+
+    CMutableTransaction coinbase;
+    coinbase.vin.push_back(CTxIn(COutPoint(), CScript() << 1000000 << OP_0));
+    coinbase.vout.push_back(CTxOut(0, CScript()));
+    block.vtx.push_back(coinbase);
+
+    CMutableTransaction coinstake;
+    coinstake.vin.push_back(DummySpend(0));
+    coinstake.vout.push_back(CTxOut(0, CScript()));
+    CScript scriptStake = CScript() << std::vector<unsigned char>(33, 0x03) << OP_CHECKSIG;
+    coinstake.vout.push_back(CTxOut(1000 * COIN, scriptStake));
+    coinstake.vout.push_back(CTxOut(5 * COIN, DummyPayment(0)));
+    block.vtx.push_back(coinstake);
+
+    for (unsigned int i = 2; i < BLOCK_TRANSACTIONS; i++) {
+        CMutableTransaction tx;
+        for (unsigned int j = 0; j < 1 + i % 2; j++)
+            tx.vin.push_back(DummySpend(i + j));
+        tx.vout.push_back(CTxOut(i * CENT, DummyPayment(i)));
+        tx.vout.push_back(CTxOut(COIN, DummyPayment(i + 1)));
+        block.vtx.push_back(tx);
+    }
+    block.vchBlockSig.assign(72, 0x30);
+    return block;
+}
+} // namespace
+
+/** Deserialize a block the way ProcessMessage does, hashing every transaction on the way. */
+static void DeserializeBlockTest(benchmark::State& state)
+{
+    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+    ssBlock << CreateBlock();
+    while (state.KeepRunning()) {
+        CDataStream stream(ssBlock);
+        CBlock block;
+        stream >> block;
+        assert(block.vtx.size() == BLOCK_TRANSACTIONS);
+    }
+}
+
+/** Turn the transactions of a block into CTransactions, the way the miner and the wallet build them. */
+static void MutableToTransactionTest(benchmark::State& state)
+{
+    CBlock block = CreateBlock();
+    std::vector<CMutableTransaction> vmtx(block.vtx.begin(), block.vtx.end());
+    while (state.KeepRunning()) {
+        std::vector<CMutableTransaction> vmtxCopy(vmtx);
+        std::vector<CTransaction> vtx;
+        vtx.reserve(vmtxCopy.size());
+        for (CMutableTransaction& mtx : vmtxCopy)
+            vtx.push_back(CTransaction(std::move(mtx)));
+    }
+}
+
+BENCHMARK(DeserializeBlockTest);
+BENCHMARK(MutableToTransactionTest);
@@ -0,0 +1,54 @@
+// Copyright (c) 2017-2020 The VALUTO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "heap_count.h"
+
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+
+namespace
+{
+std::atomic<size_t> nHeapLive(0);
+std::atomic<size_t> nHeapPeak(0);
+//! Each allocation keeps its size in front of it, aligned for any type
+const size_t ALLOC_HEADER = 16;
+} // namespace
+
+size_t benchmark::GetHeapLive()
+{
+    return nHeapLive;
+}
+
+void benchmark::ResetHeapPeak()
+{
+    nHeapPeak = nHeapLive.load();
+}
+
+size_t benchmark::GetHeapPeak(size_t nBase)
+{
+    return nHeapPeak - nBase;
+}
+
+void* operator new(size_t n)
+{
+    void* p = malloc(n + ALLOC_HEADER);
+    if (!p)
+        throw std::bad_alloc();
+    *(size_t*)p = n;
+    size_t nLive = nHeapLive += n;
+    size_t nPeak = nHeapPeak;
+    while (nLive > nPeak && !nHeapPeak.compare_exchange_weak(nPeak, nLive)) {
+    }
+    return (char*)p + ALLOC_HEADER;
+}
+
+void operator delete(void* p) noexcept
+{
+    if (!p)
+        return;
+    char* pAlloc = (char*)p - ALLOC_HEADER;
+    nHeapLive -= *(size_t*)pAlloc;
+    free(pAlloc);
+}
@@ -0,0 +1,24 @@
+// Copyright (c) 2017-2020 The VALUTO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BENCH_HEAP_COUNT_H
+#define BITCOIN_BENCH_HEAP_COUNT_H
+
+#include <stddef.h>
+
+/**
+ * The heap in use, counted by the operator new of heap_count.cpp. Only
+ * bench_valuto_heap links it, so the counting does not slow down the
+ * benchmarks of bench_valuto.
+ */
+namespace benchmark
+{
+size_t GetHeapLive();
+//! Start counting the peak again from what is live now
+void ResetHeapPeak();
+//! The most that was live at once since ResetHeapPeak, above nBase
+size_t GetHeapPeak(size_t nBase);
+} // namespace benchmark
+
+#endif // BITCOIN_BENCH_HEAP_COUNT_H
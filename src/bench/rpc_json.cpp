@@ -0,0 +1,106 @@
+// Copyright (c) 2017-2020 The VALUTO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "heap_count.h"
+
+#include "core_io.h"
+#include "primitives/block.h"
+#include "primitives/transaction.h"
+#include "rpc/jsonwriter.h"
+#include "script/script.h"
+
+#include <assert.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/bind.hpp>
+
+#include <univalue.h>
+
+namespace
+{
+const unsigned int BLOCK_TRANSACTIONS = 4000;
+//! The chunk size the RPC server sends replies in
+const size_t REPLY_CHUNK_SIZE = 256 * 1024;
+
+/** A block of payments with two inputs and two pay-to-pubkey-hash outputs each. */
+CBlock CreateBlock()
+{
+    CBlock block;
+    block.nVersion = 4;
+    block.nTime = 1500000000;
+    for (unsigned int i = 0; i < BLOCK_TRANSACTIONS; i++) {
+        CMutableTransaction tx;
+        for (unsigned int j = 0; j < 2; j++) {
+            CTxIn txin(COutPoint(uint256(i + j + 1), j));
+            txin.scriptSig = CScript() << std::vector<unsigned char>(72, (unsigned char)i) << std::vector<unsigned char>(33, 0x02);
+            tx.vin.push_back(txin);
+        }
+        for (unsigned int j = 0; j < 2; j++)
+            tx.vout.push_back(CTxOut((i + j) * CENT, CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, (unsigned char)j) << OP_EQUALVERIFY << OP_CHECKSIG));
+        block.vtx.push_back(tx);
+    }
+    return block;
+}
+
+/** What getblock with transaction details writes, less the fields from the block index. */
+void WriteBlock(const CBlock& block, CJSONWriter& writer)
+{
+    writer.BeginObject();
+    writer.KeyValue("hash", block.GetHash().GetHex());
+    writer.KeyValue("version", block.nVersion);
+    writer.KeyValue("merkleroot", block.hashMerkleRoot.GetHex());
+    writer.Key("tx");
+    writer.BeginArray();
+    for (const CTransaction& tx : block.vtx) {
+        UniValue objTx(UniValue::VOBJ);
+        TxToUniv(tx, uint256(0), objTx);
+        writer.Value(objTx);
+    }
+    writer.EndArray();
+    writer.KeyValue("time", block.GetBlockTime());
+    writer.EndObject();
+}
+
+void DiscardChunk(size_t& nSent, const std::string& strChunk)
+{
+    nSent += strChunk.size();
+}
+} // namespace
+
+/** Build the reply to getblock as one UniValue tree and write it into one string, as replies used to be. */
+static void RPCJSONTreeTest(benchmark::State& state)
+{
+    const CBlock block = CreateBlock();
+    size_t nBase = benchmark::GetHeapLive();
+    benchmark::ResetHeapPeak();
+    while (state.KeepRunning()) {
+        CJSONValueWriter writer;
+        WriteBlock(block, writer);
+        std::string strReply = writer.GetValue().write();
+        assert(!strReply.empty());
+    }
+    std::cout << "#RPCJSONTreeTest peak heap bytes," << benchmark::GetHeapPeak(nBase) << "\n";
+}
+
+/** Write the reply to getblock as it is produced, handing it over in chunks as the RPC server sends it. */
+static void RPCJSONStreamTest(benchmark::State& state)
+{
+    const CBlock block = CreateBlock();
+    size_t nBase = benchmark::GetHeapLive();
+    benchmark::ResetHeapPeak();
+    while (state.KeepRunning()) {
+        size_t nSent = 0;
+        CJSONStreamWriter writer;
+        writer.SetSink(REPLY_CHUNK_SIZE, boost::bind(&DiscardChunk, boost::ref(nSent), _1));
+        WriteBlock(block, writer);
+        assert(nSent + writer.GetBuffer().size() > REPLY_CHUNK_SIZE);
+    }
+    std::cout << "#RPCJSONStreamTest peak heap bytes," << benchmark::GetHeapPeak(nBase) << "\n";
+}
+
+BENCHMARK(RPCJSONTreeTest);
+BENCHMARK(RPCJSONStreamTest);
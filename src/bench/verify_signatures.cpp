@@ -0,0 +1,161 @@
+// Copyright (c) 2017-2020 The VALUTO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "key.h"
+#include "primitives/block.h"
+#include "primitives/transaction.h"
+#include "script/interpreter.h"
+#include "script/sigcache.h"
+#include "script/standard.h"
+#include "streams.h"
+#include "version.h"
+
+#include <assert.h>
+#include <map>
+#include <vector>
+
+namespace
+{
+const unsigned int BLOCK_TRANSACTIONS = 500;
+//! Keys sign several inputs of a block each, as a pool or an exchange paying out does
+const unsigned int BLOCK_KEYS = 100;
+//! The batch size of the script check queue, which is what a worker verifies as one batch
+const unsigned int CHECK_BATCH_SIZE = 128;
+
+/** An input of the block, with the output script it spends */
+struct BlockInput {
+    unsigned int nTx;
+    unsigned int nIn;
+    CScript scriptPubKey;
+};
+
+/** Sign input nIn of mtx, which spends scriptPubKey of key, pay-to-pubkey-hash or pay-to-pubkey. */
+void SignInput(CMutableTransaction& mtx, unsigned int nIn, const CScript& scriptPubKey, const CKey& key, bool fPayToPubKeyHash)
+{
+    uint256 hash = SignatureHash(scriptPubKey, CTransaction(mtx), nIn, SIGHASH_ALL);
+    std::vector<unsigned char> vchSig;
+    bool fSigned = key.Sign(hash, vchSig);
+    assert(fSigned);
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    mtx.vin[nIn].scriptSig = CScript() << vchSig;
+    if (fPayToPubKeyHash)
+        mtx.vin[nIn].scriptSig << ToByteVector(key.GetPubKey());
+}
+
+/**
+ * A proof-of-stake block with every signature made for real: the coinbase, a
+ * coinstake spending a pay-to-pubkey output, and payments spending one or two
+ * pay-to-pubkey-hash outputs. mapPrevScripts gets the scripts the inputs
+ * spend, which validation would take from the UTXO set.
+ */
+CBlock CreateSignedBlock(std::map<COutPoint, CScript>& mapPrevScripts)
+{
+    std::vector<CKey> vKeys(BLOCK_KEYS);
+    for (CKey& key : vKeys)
+        key.MakeNewKey(true);
+
+    CBlock block;
+    block.nVersion = 4;
+    block.nTime = 1500000000;
+
+    CMutableTransaction coinbase;
+    coinbase.vin.push_back(CTxIn(COutPoint(), CScript() << 1000000 << OP_0));
+    coinbase.vout.push_back(CTxOut(0, CScript()));
+    block.vtx.push_back(coinbase);
+
+    CMutableTransaction coinstake;
+    CScript scriptStake = CScript() << ToByteVector(vKeys[0].GetPubKey()) << OP_CHECKSIG;
+    coinstake.vin.push_back(CTxIn(COutPoint(uint256(1), 0)));
+    coinstake.vout.push_back(CTxOut(0, CScript()));
+    coinstake.vout.push_back(CTxOut(1000 * COIN, scriptStake));
+    mapPrevScripts[coinstake.vin[0].prevout] = scriptStake;
+    SignInput(coinstake, 0, scriptStake, vKeys[0], false);
+    block.vtx.push_back(coinstake);
+
+    for (unsigned int i = 2; i < BLOCK_TRANSACTIONS; i++) {
+        CMutableTransaction tx;
+        for (unsigned int j = 0; j < 1 + i % 2; j++)
+            tx.vin.push_back(CTxIn(COutPoint(uint256(2 * i + j), j)));
+        tx.vout.push_back(CTxOut(i * CENT, GetScriptForDestination(vKeys[i % BLOCK_KEYS].GetPubKey().GetID())));
+        tx.vout.push_back(CTxOut(COIN, GetScriptForDestination(vKeys[(i + 1) % BLOCK_KEYS].GetPubKey().GetID())));
+        for (unsigned int j = 0; j < tx.vin.size(); j++) {
+            const CKey& key = vKeys[(i + j) % BLOCK_KEYS];
+            CScript scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+            mapPrevScripts[tx.vin[j].prevout] = scriptPubKey;
+            SignInput(tx, j, scriptPubKey, key, true);
+        }
+        block.vtx.push_back(tx);
+    }
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+/** The signed block as it is read off the network, and its inputs to verify. */
+struct SignedBlock {
+    CBlock block;
+    std::vector<PrecomputedTransactionData> vTxData;
+    std::vector<BlockInput> vInputs;
+
+    SignedBlock()
+    {
+        std::map<COutPoint, CScript> mapPrevScripts;
+        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+        ssBlock << CreateSignedBlock(mapPrevScripts);
+        ssBlock >> block;
+
+        vTxData.reserve(block.vtx.size());
+        for (unsigned int i = 0; i < block.vtx.size(); i++) {
+            const CTransaction& tx = block.vtx[i];
+            vTxData.push_back(PrecomputedTransactionData(tx));
+            if (tx.IsCoinBase())
+                continue;
+            for (unsigned int n = 0; n < tx.vin.size(); n++) {
+                BlockInput input = {i, n, mapPrevScripts[tx.vin[n].prevout]};
+                vInputs.push_back(input);
+            }
+        }
+    }
+};
+} // namespace
+
+/** Verify the signatures of a block one input at a time, each with its own CPubKey::Verify. */
+static void VerifySignaturesPerInputTest(benchmark::State& state)
+{
+    const SignedBlock signedBlock;
+    while (state.KeepRunning()) {
+        for (const BlockInput& input : signedBlock.vInputs) {
+            const CTransaction& tx = signedBlock.block.vtx[input.nTx];
+            bool fValid = VerifyScript(tx.vin[input.nIn].scriptSig, input.scriptPubKey, MANDATORY_SCRIPT_VERIFY_FLAGS,
+                TransactionSignatureChecker(&tx, input.nIn, &signedBlock.vTxData[input.nTx]));
+            assert(fValid);
+        }
+    }
+}
+
+/** Verify the signatures of a block through CSignatureBatch, a script check queue batch at a time. */
+static void VerifySignaturesBatchTest(benchmark::State& state)
+{
+    const SignedBlock signedBlock;
+    while (state.KeepRunning()) {
+        CSignatureBatch batch;
+        for (unsigned int i = 0; i < signedBlock.vInputs.size(); i++) {
+            const BlockInput& input = signedBlock.vInputs[i];
+            const CTransaction& tx = signedBlock.block.vtx[input.nTx];
+            // nothing goes into the signature cache, or every run after the first would only look them up
+            bool fValid = VerifyScript(tx.vin[input.nIn].scriptSig, input.scriptPubKey, MANDATORY_SCRIPT_VERIFY_FLAGS,
+                BatchingTransactionSignatureChecker(&tx, input.nIn, batch, false, &signedBlock.vTxData[input.nTx]));
+            assert(fValid);
+            if (batch.size() == CHECK_BATCH_SIZE || i + 1 == signedBlock.vInputs.size()) {
+                fValid = batch.Verify();
+                assert(fValid);
+                batch.clear();
+            }
+        }
+    }
+}
+
+BENCHMARK(VerifySignaturesPerInputTest);
+BENCHMARK(VerifySignaturesBatchTest);
@@ -0,0 +1,130 @@
+// Copyright (c) 2017-2020 The VALUTO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilemap.h"
+
+#include "clientversion.h"
+#include "crypto/common.h"
+#include "main.h"
+#include "streams.h"
+#include "util.h"
+
+#ifndef WIN32
+#include <sys/mman.h>
+#endif
+
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+
+using namespace std;
+
+CBlockFileMap* pblockfilemap = NULL;
+
+CBlockFileMap::CBlockFileMap(unsigned int nMaxFilesIn) : nMaxFiles(nMaxFilesIn)
+{
+}
+
+boost::shared_ptr<boost::interprocess::mapped_region> CBlockFileMap::Map(int nFile, bool fFinalized, uint64_t nMinSize)
+{
+    boost::shared_ptr<boost::interprocess::mapped_region> pregion;
+    boost::filesystem::path path = GetBlockPosFilename(CDiskBlockPos(nFile, 0), "blk");
+    try {
+        uint64_t nSize = boost::filesystem::file_size(path);
+        if (nSize < nMinSize)
+            return pregion;
+        boost::interprocess::file_mapping mapping(path.string().c_str(), boost::interprocess::read_only);
+        pregion.reset(new boost::interprocess::mapped_region(mapping, boost::interprocess::read_only, 0, nSize));
+    } catch (const std::exception& e) {
+        LogPrint("db", "%s : unable to map %s - %s\n", __func__, path.string(), e.what());
+        pregion.reset();
+        return pregion;
+    }
+
+#ifndef WIN32
+    // finalized files don't change anymore: let the kernel read ahead for the neighbouring blocks
+    if (fFinalized)
+        madvise(pregion->get_address(), pregion->get_size(), MADV_WILLNEED);
+#endif
+    return pregion;
+}
+
+boost::shared_ptr<boost::interprocess::mapped_region> CBlockFileMap::GetRegion(int nFile, bool fFinalized, uint64_t nMinSize, bool fRemap)
+{
+    LOCK(cs);
+    boost::shared_ptr<boost::interprocess::mapped_region> pregion;
+    list<CMappedFile>::iterator it = listFiles.begin();
+    while (it != listFiles.end() && it->nFile != nFile)
+        ++it;
+    if (it != listFiles.end()) {
+        // a file that was still written to when it was mapped is mapped again once finalized
+        if (!fRemap && it->fFinalized == fFinalized && nMinSize <= it->pregion->get_size())
+            pregion = it->pregion;
+        listFiles.erase(it);
+    }
+    if (!pregion) {
+        pregion = Map(nFile, fFinalized, nMinSize);
+        if (!pregion)
+            return pregion;
+    }
+
+    CMappedFile file;
+    file.nFile = nFile;
+    file.fFinalized = fFinalized;
+    file.pregion = pregion;
+    listFiles.push_front(file);
+    while (listFiles.size() > nMaxFiles)
+        listFiles.pop_back();
+    return pregion;
+}
+
+bool CBlockFileMap::ReadBlock(CBlock& block, const CDiskBlockPos& pos, bool fFinalized)
+{
+    // the serialized size is stored in the 4 bytes in front of the block
+    if (pos.nPos < 8)
+        return false;
+
+    // Readers that still hold a region keep it mapped after it dropped out of the LRU.
+    boost::shared_ptr<boost::interprocess::mapped_region> pregion;
+    const char* pbegin = NULL;
+    uint32_t nSize = 0;
+    for (int nTry = 0; nTry < 2; nTry++) {
+        pregion = GetRegion(pos.nFile, fFinalized, pos.nPos, nTry > 0);
+        if (!pregion)
+            return false;
+        pbegin = static_cast<const char*>(pregion->get_address());
+        nSize = ReadLE32((const unsigned char*)pbegin + pos.nPos - 4);
+        if (nSize < 80 || nSize > MAX_BLOCKFILE_SIZE)
+            return false;
+        if (pos.nPos + (uint64_t)nSize <= pregion->get_size())
+            break;
+        // the file being written to may have grown past the end of the mapping
+        if (fFinalized || nTry > 0)
+            return false;
+    }
+
+    try {
+        CMemoryReader reader(pbegin + pos.nPos, pbegin + pos.nPos + nSize, SER_DISK, CLIENT_VERSION);
+        reader >> block;
+    } catch (const std::exception& e) {
+        return error("%s : Deserialize error - %s", __func__, e.what());
+    }
+    return true;
+}
+
+void CBlockFileMap::Forget(int nFile)
+{
+    LOCK(cs);
+    for (list<CMappedFile>::iterator it = listFiles.begin(); it != listFiles.end(); ++it) {
+        if (it->nFile == nFile) {
+            listFiles.erase(it);
+            return;
+        }
+    }
+}
+
+void CBlockFileMap::Clear()
+{
+    LOCK(cs);
+    listFiles.clear();
+}
@@ -0,0 +1,69 @@
+// Copyright (c) 2017-2020 The VALUTO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILEMAP_H
+#define BITCOIN_BLOCKFILEMAP_H
+
+#include "sync.h"
+
+#include <stdint.h>
+
+#include <list>
+
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/shared_ptr.hpp>
+
+class CBlock;
+struct CDiskBlockPos;
+
+/** -blockfilemaps default: number of block files kept mapped (none on 32-bit, the address space is too small) */
+static const unsigned int DEFAULT_BLOCKFILE_MAPS = sizeof(void*) > 4 ? 8 : 0;
+
+/**
+ * Read-only, memory-mapped access to the blk?????.dat files.
+ *
+ * Block reads for rescans, RPC, REST and peers are served from a small LRU of
+ * mapped files instead of an fopen/fseek/fread per block. A block is
+ * deserialized straight out of the mapping.
+ *
+ * Files that are no longer appended to (finalized) are mapped whole and get
+ * madvise(MADV_WILLNEED), as read-only traffic tends to walk neighbouring
+ * blocks. The file that is still being written is mapped up to its current
+ * size and mapped again once a read goes past the end of the mapping.
+ */
+class CBlockFileMap
+{
+private:
+    struct CMappedFile {
+        int nFile;
+        bool fFinalized;
+        boost::shared_ptr<boost::interprocess::mapped_region> pregion;
+    };
+
+    CCriticalSection cs;
+    //! most recently used first
+    std::list<CMappedFile> listFiles;
+    unsigned int nMaxFiles;
+
+    boost::shared_ptr<boost::interprocess::mapped_region> Map(int nFile, bool fFinalized, uint64_t nMinSize);
+    boost::shared_ptr<boost::interprocess::mapped_region> GetRegion(int nFile, bool fFinalized, uint64_t nMinSize, bool fRemap);
+
+public:
+    explicit CBlockFileMap(unsigned int nMaxFilesIn);
+
+    /**
+     * Deserialize the block stored at pos. False if the file can't be mapped or the
+     * block doesn't fit in it; the caller then falls back to reading the file.
+     */
+    bool ReadBlock(CBlock& block, const CDiskBlockPos& pos, bool fFinalized);
+
+    /** Drop the mapping of a file, e.g. before it's pruned */
+    void Forget(int nFile);
+    void Clear();
+};
+
+/** Global variable that points to the block file map (NULL when -blockfilemaps=0) */
+extern CBlockFileMap* pblockfilemap;
+
+#endif // BITCOIN_BLOCKFILEMAP_H
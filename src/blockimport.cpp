@@ -0,0 +1,203 @@
+// Copyright (c) 2017-2020 The VALUTO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockimport.h"
+
+#include "chainparams.h"
+#include "clientversion.h"
+#include "streams.h"
+#include "tinyformat.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <algorithm>
+
+#include <boost/bind.hpp>
+
+using namespace std;
+
+int nImportCheckThreads = 0;
+
+static double BlocksPerSecond(uint64_t nBlocks, int64_t nMicros)
+{
+    return nMicros > 0 ? nBlocks * 1000000.0 / nMicros : 0.0;
+}
+
+CImportStats& CImportStats::operator+=(const CImportStats& other)
+{
+    nRead += other.nRead;
+    nReadTime += other.nReadTime;
+    nChecked += other.nChecked;
+    nCheckTime += other.nCheckTime;
+    nConnected += other.nConnected;
+    nConnectTime += other.nConnectTime;
+    nWallTime += other.nWallTime;
+    return *this;
+}
+
+std::string CImportStats::ToString() const
+{
+    return strprintf("read %u blocks (%.1f blocks/s), checked %u (%.1f blocks/s per thread), connected %u (%.1f blocks/s), overall %.1f blocks/s in %.2fs",
+        nRead, BlocksPerSecond(nRead, nReadTime),
+        nChecked, BlocksPerSecond(nChecked, nCheckTime),
+        nConnected, BlocksPerSecond(nConnected, nConnectTime),
+        BlocksPerSecond(nConnected, nWallTime), nWallTime * 0.000001);
+}
+
+CBlockImportPipeline::CBlockImportPipeline(FILE* fileInIn, const CDiskBlockPos* dbp, int nThreads) : nClaimed(0), fEof(false), fStop(false), fileIn(fileInIn)
+{
+    if (dbp)
+        posFile = *dbp;
+    nStart = GetTimeMicros();
+    threadGroup.create_thread(boost::bind(&CBlockImportPipeline::ThreadRead, this));
+    for (int i = 0; i < std::max(nThreads, 1); i++)
+        threadGroup.create_thread(boost::bind(&CBlockImportPipeline::ThreadCheck, this));
+}
+
+CBlockImportPipeline::~CBlockImportPipeline()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fStop = true;
+    }
+    cond.notify_all();
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+void CBlockImportPipeline::ThreadRead()
+{
+    RenameThread("valuto-impread");
+    try {
+        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
+        CBufferedFile blkdat(fileIn, 2 * MAX_BLOCKFILE_SIZE, MAX_BLOCKFILE_SIZE + 8, SER_DISK, CLIENT_VERSION);
+        uint64_t nRewind = blkdat.GetPos();
+        while (!blkdat.eof()) {
+            boost::this_thread::interruption_point();
+            int64_t nTimeStart = GetTimeMicros();
+
+            blkdat.SetPos(nRewind);
+            nRewind++;         // start one byte further next time, in case of failure
+            blkdat.SetLimit(); // remove former limit
+            unsigned int nSize = 0;
+            try {
+                // locate a header
+                unsigned char buf[MESSAGE_START_SIZE];
+                blkdat.FindByte(Params().MessageStart()[0]);
+                nRewind = blkdat.GetPos() + 1;
+                blkdat >> FLATDATA(buf);
+                if (memcmp(buf, Params().MessageStart(), MESSAGE_START_SIZE))
+                    continue;
+                // read size
+                blkdat >> nSize;
+                if (nSize < 80 || nSize > MAX_BLOCKFILE_SIZE)
+                    continue;
+            } catch (const std::exception&) {
+                // no valid block header found; don't complain
+                break;
+            }
+            try {
+                // read block
+                uint64_t nBlockPos = blkdat.GetPos();
+                blkdat.SetLimit(nBlockPos + nSize);
+                blkdat.SetPos(nBlockPos);
+                CBlock block;
+                blkdat >> block;
+                nRewind = blkdat.GetPos();
+                int64_t nTime = GetTimeMicros() - nTimeStart;
+
+                // wait for the connecting thread to catch up
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (!fStop && queue.size() >= IMPORT_QUEUE_SIZE)
+                    cond.wait(lock);
+                if (fStop)
+                    return;
+                queue.push_back(CImportItem());
+                queue.back().block = std::move(block);
+                queue.back().pos = CDiskBlockPos(posFile.nFile, nBlockPos);
+                stats.nRead++;
+                stats.nReadTime += nTime;
+                cond.notify_all();
+            } catch (const std::exception& e) {
+                LogPrintf("%s : Deserialize or I/O error - %s", __func__, e.what());
+            }
+        }
+    } catch (const std::runtime_error& e) {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        strError = e.what();
+    }
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+    fEof = true;
+    cond.notify_all();
+}
+
+void CBlockImportPipeline::ThreadCheck()
+{
+    RenameThread("valuto-impcheck");
+    while (true) {
+        CImportItem* pitem = NULL;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (!fStop && nClaimed == queue.size()) {
+                if (fEof)
+                    return;
+                cond.wait(lock);
+            }
+            if (fStop)
+                return;
+            // claims are handed out in file order, so the claimed items are always a prefix of the queue
+            pitem = &queue[nClaimed++];
+        }
+
+        int64_t nTimeStart = GetTimeMicros();
+        CValidationState state;
+        const CBlock& block = pitem->block;
+        block.fChecked = CheckBlockContextFree(block, state) && block.CheckBlockSignature();
+        int64_t nTime = GetTimeMicros() - nTimeStart;
+
+        boost::unique_lock<boost::mutex> lock(mutex);
+        pitem->fDone = true;
+        stats.nChecked++;
+        stats.nCheckTime += nTime;
+        cond.notify_all();
+    }
+}
+
+bool CBlockImportPipeline::Next(CBlock& block, CDiskBlockPos& pos)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (queue.empty() || !queue.front().fDone) {
+        if (queue.empty() && fEof)
+            return false;
+        cond.wait(lock);
+    }
+    block = std::move(queue.front().block);
+    pos = queue.front().pos;
+    queue.pop_front();
+    nClaimed--;
+    cond.notify_all();
+    return true;
+}
+
+std::string CBlockImportPipeline::GetError()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return strError;
+}
+
+void CBlockImportPipeline::AddConnected(int64_t nMicros)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    stats.nConnected++;
+    stats.nConnectTime += nMicros;
+}
+
+CImportStats CBlockImportPipeline::GetStats()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    CImportStats result = stats;
+    result.nWallTime = GetTimeMicros() - nStart;
+    return result;
+}
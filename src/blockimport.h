@@ -0,0 +1,124 @@
+// Copyright (c) 2017-2020 The VALUTO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKIMPORT_H
+#define BITCOIN_BLOCKIMPORT_H
+
+#include "main.h"
+#include "primitives/block.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <deque>
+#include <string>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+/** Maximum number of block check threads used by the import pipeline */
+static const int MAX_IMPORT_THREADS = 16;
+/** -importthreads default (0 = one per core) */
+static const int DEFAULT_IMPORT_THREADS = 0;
+/** Number of blocks the reader may run ahead of block connection */
+static const unsigned int IMPORT_QUEUE_SIZE = 256;
+
+/** Number of block check threads, set from -importthreads */
+extern int nImportCheckThreads;
+
+/** Time spent and blocks handled by each stage of a block import */
+struct CImportStats {
+    uint64_t nRead;
+    int64_t nReadTime;
+    uint64_t nChecked;
+    int64_t nCheckTime;
+    uint64_t nConnected;
+    int64_t nConnectTime;
+    int64_t nWallTime;
+
+    CImportStats()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        nRead = 0;
+        nReadTime = 0;
+        nChecked = 0;
+        nCheckTime = 0;
+        nConnected = 0;
+        nConnectTime = 0;
+        nWallTime = 0;
+    }
+
+    CImportStats& operator+=(const CImportStats& other);
+
+    /** One line with the blocks/sec of every stage, for the "bench" log category */
+    std::string ToString() const;
+};
+
+/**
+ * Staged reader for -reindex, -loadblock and bootstrap.dat.
+ *
+ * A reader thread scans the file for block headers and deserializes the blocks,
+ * a pool of check threads runs CheckBlockContextFree and the proof-of-stake
+ * signature check on them, and the importing thread takes the blocks back out
+ * in file order through Next() to connect them. Blocks that pass are marked
+ * fChecked, so ProcessNewBlock only repeats the contextual checks; blocks that
+ * fail are handed out unmarked and rejected by ProcessNewBlock as before.
+ *
+ * The reader stays at most IMPORT_QUEUE_SIZE blocks ahead of connection.
+ */
+class CBlockImportPipeline
+{
+private:
+    struct CImportItem {
+        CBlock block;
+        CDiskBlockPos pos;
+        bool fDone;
+
+        CImportItem() : fDone(false) {}
+    };
+
+    boost::mutex mutex;
+    //! Signalled when a block is read, checked or taken out, or on shutdown
+    boost::condition_variable cond;
+    //! Blocks in file order; the front is the next one handed to Next()
+    std::deque<CImportItem> queue;
+    //! Number of items at the front of queue that are claimed by check threads
+    size_t nClaimed;
+    bool fEof;
+    bool fStop;
+    std::string strError;
+
+    FILE* fileIn;
+    CDiskBlockPos posFile;
+    CImportStats stats;
+    int64_t nStart;
+    boost::thread_group threadGroup;
+
+    void ThreadRead();
+    void ThreadCheck();
+
+public:
+    /** Takes over fileIn and closes it. dbp, if given, is the position of the file in the block store */
+    CBlockImportPipeline(FILE* fileIn, const CDiskBlockPos* dbp, int nThreads);
+    ~CBlockImportPipeline();
+
+    /** Wait for the next block in file order; false at the end of the file. Interruptible */
+    bool Next(CBlock& block, CDiskBlockPos& pos);
+
+    /** Non-empty when the reader stopped on an I/O error */
+    std::string GetError();
+
+    /** Account one block handed to ProcessNewBlock by the importing thread */
+    void AddConnected(int64_t nMicros);
+
+    /** Statistics of all stages so far */
+    CImportStats GetStats();
+};
+
+#endif // BITCOIN_BLOCKIMPORT_H
@@ -48,6 +48,8 @@ public:
     };
 
     using SubsidySwitchPoints = std::map<int64_t, CAmount>;
+    //! UTXO snapshots trusted for -loadsnapshot: height -> (block hash, snapshot hash)
+    using AssumeUtxoMap = std::map<int, std::pair<uint256, uint256> >;
 
     const uint256& HashGenesisBlock() const { return hashGenesisBlock; }
     const MessageStartChars& MessageStart() const { return pchMessageStart; }
@@ -99,6 +101,7 @@ public:
     const std::vector<unsigned char>& Base58Prefix(Base58Type type) const { return base58Prefixes[type]; }
     const std::vector<CAddress>& FixedSeeds() const { return vFixedSeeds; }
     virtual const Checkpoints::CCheckpointData& Checkpoints() const = 0;
+    const AssumeUtxoMap& AssumeUtxo() const { return mapAssumeUtxo; }
     int PoolMaxTransactions() const { return nPoolMaxTransactions; }
     std::string SporkKey() const { return strSporkKey; }
     std::string ObfuscationPoolDummyAddress() const { return strObfuscationPoolDummyAddress; }
@@ -152,6 +155,7 @@ protected:
     std::string strNetworkID;
     CBlock genesis;
     std::vector<CAddress> vFixedSeeds;
+    AssumeUtxoMap mapAssumeUtxo;
     bool fRequireRPCPassword;
     bool fMiningRequiresPeers;
     bool fDefaultConsistencyChecks;
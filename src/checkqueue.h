@@ -6,6 +6,8 @@
 #define BITCOIN_CHECKQUEUE_H
 
 #include <algorithm>
+#include <atomic>
+#include <deque>
 #include <vector>
 
 #include <boost/foreach.hpp>
@@ -16,21 +18,55 @@
 template <typename T>
 class CCheckQueueControl;
 
-/** 
+/**
+ * Run a worker's batch of checks. Check types that can share work between
+ * the checks of one batch provide a non-template overload of this, found
+ * by argument-dependent lookup.
+ */
+template <typename T>
+bool RunBatch(std::vector<T>& vChecks)
+{
+    for (T& check : vChecks)
+        if (!check())
+            return false;
+    return true;
+}
+
+/**
  * Queue for verifications that have to be performed.
-  * The verifications are represented by a type T, which must provide an
-  * operator(), returning a bool.
-  *
-  * One thread (the master) is assumed to push batches of verifications
-  * onto the queue, where they are processed by N-1 worker threads. When
-  * the master is done adding work, it temporarily joins the worker pool
-  * as an N'th worker, until all jobs are done.
-  */
+ * The verifications are represented by a type T, which must provide an
+ * operator(), returning a bool, and a swap().
+ *
+ * One thread (the master) is assumed to push batches of verifications
+ * onto the queue, where they are processed by N-1 worker threads. When
+ * the master is done adding work, it temporarily joins the worker pool
+ * as an N'th worker, until all jobs are done.
+ *
+ * Every thread has its own deque of checks. Add() hands each batch to the
+ * next deque in turn; a thread takes work from the back of its own deque
+ * and, once that is empty, steals half of another thread's deque from the
+ * front. Threads only share the bookkeeping counters, so adding more of
+ * them doesn't make them fight over a single queue lock.
+ */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
+    struct WorkerQueue {
+        boost::mutex mutex;
+        std::deque<T> checks;
+    };
+
+    //! One deque per thread. Slot 0 is the master's.
+    std::vector<WorkerQueue> vQueues;
+
+    //! Number of slots handed out to threads, including the master.
+    std::atomic<unsigned int> nSlots;
+
+    //! The slot Add() fills next.
+    unsigned int nNextSlot;
+
+    //! Mutex for sleeping and waking up threads
     boost::mutex mutex;
 
     //! Worker threads block on this when out of work
@@ -39,25 +75,18 @@ private:
     //! Master thread blocks on this when out of work
     boost::condition_variable condMaster;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
-
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
-
-    //! The total number of workers (including the master).
-    int nTotal;
-
     //! The temporary evaluation result.
-    bool fAllOk;
+    std::atomic<bool> fAllOk;
 
     /**
      * Number of verifications that haven't completed yet.
-     * This includes elements that are not anymore in queue, but still in
-     * worker's own batches.
+     * This includes elements that are not anymore in a deque, but still in
+     * a thread's own batch.
      */
-    unsigned int nTodo;
+    std::atomic<unsigned int> nTodo;
+
+    //! Number of verifications still sitting in the deques.
+    std::atomic<unsigned int> nQueued;
 
     //! Whether we're shutting down.
     bool fQuit;
@@ -65,95 +94,117 @@ private:
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    /**
+     * Move up to nBatchSize checks into vChecks: half of what is in slot
+     * nSlot, or else half of what is in the first other slot that has
+     * work. Taking half leaves the rest for threads that run dry later,
+     * so the batches shrink as a block's work runs out.
+     */
+    bool Take(unsigned int nSlot, std::vector<T>& vChecks)
+    {
+        unsigned int nSlotsNow = nSlots;
+        for (unsigned int i = 0; i < nSlotsNow; i++) {
+            unsigned int nVictim = (nSlot + i) % nSlotsNow;
+            WorkerQueue& q = vQueues[nVictim];
+            boost::unique_lock<boost::mutex> lock(q.mutex);
+            if (q.checks.empty())
+                continue;
+            unsigned int nNow = std::max<size_t>(1, std::min<size_t>(nBatchSize, (q.checks.size() + 1) / 2));
+            vChecks.resize(nNow);
+            for (unsigned int j = 0; j < nNow; j++) {
+                // the owner works from the back, thieves from the front
+                if (i == 0) {
+                    vChecks[j].swap(q.checks.back());
+                    q.checks.pop_back();
+                } else {
+                    vChecks[j].swap(q.checks.front());
+                    q.checks.pop_front();
+                }
+            }
+            nQueued -= nNow;
+            return true;
+        }
+        return false;
+    }
+
     /** Internal function that does bulk of the verification work. */
-    bool Loop(bool fMaster = false)
+    bool Loop(unsigned int nSlot, bool fMaster = false)
     {
         boost::condition_variable& cond = fMaster ? condMaster : condWorker;
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
         do {
-            {
+            if (!Take(nSlot, vChecks)) {
                 boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master he can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
+                if ((fMaster || fQuit) && nTodo == 0) {
+                    bool fRet = fAllOk;
+                    // reset the status for new work later
+                    if (fMaster)
+                        fAllOk = true;
+                    // return the current status
+                    return fRet;
                 }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if ((fMaster || fQuit) && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
-                    nIdle++;
+                // Sleep unless some check got queued in the meantime. The
+                // master also wakes up when the last check completes.
+                if (nQueued == 0)
                     cond.wait(lock); // wait
-                    nIdle--;
-                }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
-                }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+                continue;
             }
-            // execute work
-            for (T& check : vChecks)
-                if (fOk)
-                    fOk = check();
+            // execute work; once some check has failed, the rest are only drained
+            if (fAllOk && !RunBatch(vChecks))
+                fAllOk = false;
+            unsigned int nNow = vChecks.size();
             vChecks.clear();
+            if ((nTodo -= nNow) == 0) {
+                // We processed the last element; inform the master he can exit and return the result
+                boost::unique_lock<boost::mutex> lock(mutex);
+                condMaster.notify_one();
+            }
         } while (true);
     }
 
 public:
-    //! Create a new check queue
-    CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
+    //! Create a new check queue for up to nMaxThreads threads, including the master
+    CCheckQueue(unsigned int nBatchSizeIn, unsigned int nMaxThreads = 64) : vQueues(nMaxThreads), nSlots(1), nNextSlot(0), fAllOk(true), nTodo(0), nQueued(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
 
     //! Worker thread
     void Thread()
     {
-        Loop();
+        unsigned int nSlot = nSlots++;
+        assert(nSlot < vQueues.size());
+        Loop(nSlot);
     }
 
     //! Wait until execution finishes, and return whether all evaluations where successful.
     bool Wait()
     {
-        return Loop(true);
+        return Loop(0, true);
     }
 
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        for (T& check : vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
+        if (vChecks.empty())
+            return;
+        // The counters go up before the checks can be taken, or a thread that took and ran
+        // them would take them off first and wrap the counters around.
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            nTodo += vChecks.size();
+            nQueued += vChecks.size();
+        }
+        {
+            WorkerQueue& q = vQueues[nNextSlot];
+            boost::unique_lock<boost::mutex> lock(q.mutex);
+            for (T& check : vChecks) {
+                q.checks.push_back(T());
+                check.swap(q.checks.back());
+            }
         }
-        nTodo += vChecks.size();
+        nNextSlot = (nNextSlot + 1) % nSlots;
         if (vChecks.size() == 1)
             condWorker.notify_one();
-        else if (vChecks.size() > 1)
+        else
             condWorker.notify_all();
     }
 
@@ -161,10 +212,10 @@ public:
     {
     }
 
+    //! Whether all checks are done. Workers may still be on their way to sleep; they'll find nothing to do.
     bool IsIdle()
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        return (nTotal == nIdle && nTodo == 0 && fAllOk == true);
+        return (nTodo == 0 && fAllOk == true);
     }
 };
 
@@ -16,6 +16,7 @@
 #include <stdint.h>
 
 #include <boost/foreach.hpp>
+#include <boost/function.hpp>
 #include <boost/unordered_map.hpp>
 
 /**
@@ -331,6 +332,16 @@ struct CCoinsStats {
 };
 
 
+/** The coins of a view as they were when the cursor was made; reading them needs no lock. */
+class CCoinsViewCursor
+{
+public:
+    //! Call fn with every transaction's unspent outputs, in database order, until it returns false
+    virtual bool ForEach(const boost::function<bool(const uint256&, const CCoins&)>& fn) = 0;
+
+    virtual ~CCoinsViewCursor() {}
+};
+
 /** Abstract view on the open txout dataset. */
 class CCoinsView
 {
@@ -352,6 +363,12 @@ public:
     //! Calculate statistics about the unspent transaction output set
     virtual bool GetStats(CCoinsStats& stats) const;
 
+    //! Call fn with every transaction's unspent outputs, in database order, until it returns false
+    virtual bool ForEachCoins(const boost::function<bool(const uint256&, const CCoins&)>& fn) const;
+
+    //! A cursor over the unspent outputs as they are now, or NULL if the view can't make one
+    virtual CCoinsViewCursor* Cursor() const;
+
     //! As we use CCoinsViews polymorphically, have a virtual destructor
     virtual ~CCoinsView() {}
 };
@@ -371,6 +388,8 @@ public:
     void SetBackend(CCoinsView& viewIn);
     bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
     bool GetStats(CCoinsStats& stats) const;
+    bool ForEachCoins(const boost::function<bool(const uint256&, const CCoins&)>& fn) const;
+    CCoinsViewCursor* Cursor() const;
 };
 
 class CCoinsViewCache;
@@ -0,0 +1,32 @@
+// Copyright (c) 2017-2020 The VALUTO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_CPUID_H
+#define BITCOIN_CRYPTO_CPUID_H
+
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+#define HAVE_X86_CPUID 1
+
+/** Runtime CPU feature detection, used to pick the hashing backends. */
+void static inline CPUID(uint32_t leaf, uint32_t subleaf, uint32_t& a, uint32_t& b, uint32_t& c, uint32_t& d)
+{
+    __asm__("cpuid"
+            : "=a"(a), "=b"(b), "=c"(c), "=d"(d)
+            : "0"(leaf), "2"(subleaf));
+}
+
+/** The register state the OS saves on context switches (XCR0). Only valid when CPUID reports OSXSAVE. */
+uint64_t static inline XGETBV()
+{
+    uint32_t a, d;
+    __asm__("xgetbv"
+            : "=a"(a), "=d"(d)
+            : "c"(0));
+    return ((uint64_t)d << 32) | a;
+}
+#endif
+
+#endif // BITCOIN_CRYPTO_CPUID_H
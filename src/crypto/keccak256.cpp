@@ -0,0 +1,248 @@
+// Copyright (c) 2017-2020 The VALUTO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#if defined(HAVE_CONFIG_H)
+#include "config/valuto-config.h"
+#endif
+
+#include "crypto/keccak256.h"
+
+#include "crypto/common.h"
+#include "crypto/cpuid.h"
+
+#include <string.h>
+
+#ifdef HAVE_X86_CPUID
+#if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+namespace keccak_avx2
+{
+void Header_4way(unsigned char* out, const uint64_t* st, uint32_t nNonce);
+}
+#endif
+
+#if defined(ENABLE_AVX512) && !defined(BUILD_BITCOIN_INTERNAL)
+namespace keccak_avx512
+{
+void Header_8way(unsigned char* out, const uint64_t* st, uint32_t nNonce);
+}
+#endif
+#endif
+
+namespace
+{
+const uint64_t RC[24] = {
+    0x0000000000000001ull, 0x0000000000008082ull, 0x800000000000808aull, 0x8000000080008000ull,
+    0x000000000000808bull, 0x0000000080000001ull, 0x8000000080008081ull, 0x8000000000008009ull,
+    0x000000000000008aull, 0x0000000000000088ull, 0x0000000080008009ull, 0x000000008000000aull,
+    0x000000008000808bull, 0x800000000000008bull, 0x8000000000008089ull, 0x8000000000008003ull,
+    0x8000000000008002ull, 0x8000000000000080ull, 0x000000000000800aull, 0x800000008000000aull,
+    0x8000000080008081ull, 0x8000000000008080ull, 0x0000000080000001ull, 0x8000000080008008ull};
+
+typedef void (*HeaderType)(unsigned char*, const uint64_t*, uint32_t);
+
+// The implementations selected by KeccakHeaderAutoDetect.
+HeaderType Header_4way = NULL;
+HeaderType Header_8way = NULL;
+
+uint64_t inline Rotl(uint64_t x, int n) { return (x << n) | (x >> (64 - n)); }
+
+/**
+ * Keccak-f[1600] on st. C holds the column parities of st for the theta
+ * step of the first round, which the midstate partly precomputes.
+ */
+void Permute(uint64_t* st, const uint64_t* C)
+{
+    uint64_t a00 = st[0], a01 = st[1], a02 = st[2], a03 = st[3], a04 = st[4];
+    uint64_t a05 = st[5], a06 = st[6], a07 = st[7], a08 = st[8], a09 = st[9];
+    uint64_t a10 = st[10], a11 = st[11], a12 = st[12], a13 = st[13], a14 = st[14];
+    uint64_t a15 = st[15], a16 = st[16], a17 = st[17], a18 = st[18], a19 = st[19];
+    uint64_t a20 = st[20], a21 = st[21], a22 = st[22], a23 = st[23], a24 = st[24];
+    uint64_t c0 = C[0], c1 = C[1], c2 = C[2], c3 = C[3], c4 = C[4];
+    for (int r = 0; r < 24; r++) {
+        if (r > 0) {
+            c0 = a00 ^ a05 ^ a10 ^ a15 ^ a20;
+            c1 = a01 ^ a06 ^ a11 ^ a16 ^ a21;
+            c2 = a02 ^ a07 ^ a12 ^ a17 ^ a22;
+            c3 = a03 ^ a08 ^ a13 ^ a18 ^ a23;
+            c4 = a04 ^ a09 ^ a14 ^ a19 ^ a24;
+        }
+        uint64_t d0 = c4 ^ Rotl(c1, 1);
+        uint64_t d1 = c0 ^ Rotl(c2, 1);
+        uint64_t d2 = c1 ^ Rotl(c3, 1);
+        uint64_t d3 = c2 ^ Rotl(c4, 1);
+        uint64_t d4 = c3 ^ Rotl(c0, 1);
+
+        // theta, rho and pi: lane (x, y) moves to (y, 2x + 3y)
+        uint64_t b00 = a00 ^ d0;
+        uint64_t b01 = Rotl(a06 ^ d1, 44);
+        uint64_t b02 = Rotl(a12 ^ d2, 43);
+        uint64_t b03 = Rotl(a18 ^ d3, 21);
+        uint64_t b04 = Rotl(a24 ^ d4, 14);
+        uint64_t b05 = Rotl(a03 ^ d3, 28);
+        uint64_t b06 = Rotl(a09 ^ d4, 20);
+        uint64_t b07 = Rotl(a10 ^ d0, 3);
+        uint64_t b08 = Rotl(a16 ^ d1, 45);
+        uint64_t b09 = Rotl(a22 ^ d2, 61);
+        uint64_t b10 = Rotl(a01 ^ d1, 1);
+        uint64_t b11 = Rotl(a07 ^ d2, 6);
+        uint64_t b12 = Rotl(a13 ^ d3, 25);
+        uint64_t b13 = Rotl(a19 ^ d4, 8);
+        uint64_t b14 = Rotl(a20 ^ d0, 18);
+        uint64_t b15 = Rotl(a04 ^ d4, 27);
+        uint64_t b16 = Rotl(a05 ^ d0, 36);
+        uint64_t b17 = Rotl(a11 ^ d1, 10);
+        uint64_t b18 = Rotl(a17 ^ d2, 15);
+        uint64_t b19 = Rotl(a23 ^ d3, 56);
+        uint64_t b20 = Rotl(a02 ^ d2, 62);
+        uint64_t b21 = Rotl(a08 ^ d3, 55);
+        uint64_t b22 = Rotl(a14 ^ d4, 39);
+        uint64_t b23 = Rotl(a15 ^ d0, 41);
+        uint64_t b24 = Rotl(a21 ^ d1, 2);
+
+        // chi and iota
+        a00 = b00 ^ (~b01 & b02);
+        a01 = b01 ^ (~b02 & b03);
+        a02 = b02 ^ (~b03 & b04);
+        a03 = b03 ^ (~b04 & b00);
+        a04 = b04 ^ (~b00 & b01);
+        a05 = b05 ^ (~b06 & b07);
+        a06 = b06 ^ (~b07 & b08);
+        a07 = b07 ^ (~b08 & b09);
+        a08 = b08 ^ (~b09 & b05);
+        a09 = b09 ^ (~b05 & b06);
+        a10 = b10 ^ (~b11 & b12);
+        a11 = b11 ^ (~b12 & b13);
+        a12 = b12 ^ (~b13 & b14);
+        a13 = b13 ^ (~b14 & b10);
+        a14 = b14 ^ (~b10 & b11);
+        a15 = b15 ^ (~b16 & b17);
+        a16 = b16 ^ (~b17 & b18);
+        a17 = b17 ^ (~b18 & b19);
+        a18 = b18 ^ (~b19 & b15);
+        a19 = b19 ^ (~b15 & b16);
+        a20 = b20 ^ (~b21 & b22);
+        a21 = b21 ^ (~b22 & b23);
+        a22 = b22 ^ (~b23 & b24);
+        a23 = b23 ^ (~b24 & b20);
+        a24 = b24 ^ (~b20 & b21);
+        a00 ^= RC[r];
+    }
+    st[0] = a00; st[1] = a01; st[2] = a02; st[3] = a03; st[4] = a04;
+    st[5] = a05; st[6] = a06; st[7] = a07; st[8] = a08; st[9] = a09;
+    st[10] = a10; st[11] = a11; st[12] = a12; st[13] = a13; st[14] = a14;
+    st[15] = a15; st[16] = a16; st[17] = a17; st[18] = a18; st[19] = a19;
+    st[20] = a20; st[21] = a21; st[22] = a22; st[23] = a23; st[24] = a24;
+}
+
+/** Absorb an 80-byte header, with the padding, into a fresh state. */
+void Absorb(uint64_t* st, const unsigned char* header)
+{
+    for (int i = 0; i < 10; i++)
+        st[i] = ReadLE64(header + 8 * i);
+    for (int i = 10; i < 25; i++)
+        st[i] = 0;
+    // the padding goes into the bytes right after the header and the last byte of the 136-byte rate
+    st[10] ^= 0x01;
+    st[16] ^= 0x8000000000000000ull;
+}
+
+void Squeeze(unsigned char* output, const uint64_t* st)
+{
+    for (int i = 0; i < 4; i++)
+        WriteLE64(output + 8 * i, st[i]);
+}
+} // namespace
+
+void KeccakHeader(unsigned char* output, const unsigned char* header)
+{
+    uint64_t st[25];
+    Absorb(st, header);
+    uint64_t C[5];
+    for (int x = 0; x < 5; x++)
+        C[x] = st[x] ^ st[x + 5] ^ st[x + 10] ^ st[x + 15] ^ st[x + 20];
+    Permute(st, C);
+    Squeeze(output, st);
+}
+
+CKeccakHeaderMidstate::CKeccakHeaderMidstate(const unsigned char* header)
+{
+    Absorb(st, header);
+    // the nonce is the upper half of lane 9
+    st[9] &= 0xffffffffull;
+    for (int x = 0; x < 5; x++)
+        C[x] = st[x] ^ st[x + 5] ^ st[x + 10] ^ st[x + 15] ^ st[x + 20];
+}
+
+void CKeccakHeaderMidstate::Hash(unsigned char* output, uint32_t nNonce, size_t count) const
+{
+    if (Header_8way) {
+        while (count >= 8) {
+            Header_8way(output, st, nNonce);
+            output += 256;
+            nNonce += 8;
+            count -= 8;
+        }
+    }
+    if (Header_4way) {
+        while (count >= 4) {
+            Header_4way(output, st, nNonce);
+            output += 128;
+            nNonce += 4;
+            count -= 4;
+        }
+    }
+    while (count) {
+        uint64_t s[25];
+        memcpy(s, st, sizeof(s));
+        uint64_t n = (uint64_t)nNonce << 32;
+        s[9] ^= n;
+        // only the parity of column 4 changes with the nonce
+        uint64_t Cn[5] = {C[0], C[1], C[2], C[3], C[4] ^ n};
+        Permute(s, Cn);
+        Squeeze(output, s);
+        output += 32;
+        nNonce++;
+        count--;
+    }
+}
+
+std::string KeccakHeaderAutoDetect()
+{
+    std::string ret = "standard";
+#ifdef HAVE_X86_CPUID
+    uint32_t eax, ebx, ecx, edx;
+    CPUID(0, 0, eax, ebx, ecx, edx);
+    uint32_t nMaxLeaf = eax;
+    CPUID(1, 0, eax, ebx, ecx, edx);
+    bool have_xsave = ((ecx >> 27) & 1) && ((ecx >> 26) & 1);
+    uint64_t xcr0 = have_xsave ? XGETBV() : 0;
+    bool have_avx = have_xsave && ((ecx >> 28) & 1) && (xcr0 & 6) == 6;
+    // AVX-512 also needs the opmask and the upper ZMM registers saved
+    bool have_avx512_os = have_avx && (xcr0 & 0xe6) == 0xe6;
+    bool have_avx2 = false;
+    bool have_avx512 = false;
+    if (nMaxLeaf >= 7) {
+        CPUID(7, 0, eax, ebx, ecx, edx);
+        have_avx2 = have_avx && ((ebx >> 5) & 1);
+        have_avx512 = have_avx512_os && ((ebx >> 16) & 1);
+    }
+    (void)have_avx2;
+    (void)have_avx512;
+
+#if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+    if (have_avx2) {
+        Header_4way = keccak_avx2::Header_4way;
+        ret = "avx2(4way)";
+    }
+#endif
+
+#if defined(ENABLE_AVX512) && !defined(BUILD_BITCOIN_INTERNAL)
+    if (have_avx512) {
+        Header_8way = keccak_avx512::Header_8way;
+        ret = (Header_4way ? ret + "," : "") + "avx512(8way)";
+    }
+#endif
+#endif
+    return ret;
+}
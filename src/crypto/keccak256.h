@@ -0,0 +1,49 @@
+// Copyright (c) 2017-2020 The VALUTO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_KECCAK256_H
+#define BITCOIN_CRYPTO_KECCAK256_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+
+/**
+ * Keccak-256 of 80-byte block headers, with the original Keccak padding
+ * (the output of sph_keccak256).
+ *
+ * A header is shorter than the 136-byte rate, so it is absorbed into a
+ * single Keccak-f[1600] permutation without any buffering.
+ */
+
+static const size_t KECCAK_HEADER_SIZE = 80;
+
+/** Hash one 80-byte header into a 32-byte output. */
+void KeccakHeader(unsigned char* output, const unsigned char* header);
+
+/**
+ * A header with the nonce (its last 4 bytes) left open, for scanning nonces.
+ *
+ * The fixed bytes and the padding are absorbed once, and so are the column
+ * parities of the first theta step that the nonce doesn't touch.
+ */
+class CKeccakHeaderMidstate
+{
+private:
+    //! the state before the first permutation, nonce bits clear
+    uint64_t st[25];
+    //! column parities of st
+    uint64_t C[5];
+
+public:
+    explicit CKeccakHeaderMidstate(const unsigned char* header);
+
+    /** Hash the header with the nonces nNonce .. nNonce+count-1 into output, 32 bytes each. */
+    void Hash(unsigned char* output, uint32_t nNonce, size_t count) const;
+};
+
+/** Select the multi-lane backends for this CPU. Returns their name. */
+std::string KeccakHeaderAutoDetect();
+
+#endif // BITCOIN_CRYPTO_KECCAK256_H
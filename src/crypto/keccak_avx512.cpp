@@ -0,0 +1,135 @@
+// Copyright (c) 2017-2020 The VALUTO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// This is a 8-way Keccak-256 of 80-byte headers that differ only in the nonce, one header per 64-bit lane.
+
+#ifdef ENABLE_AVX512
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#include "crypto/common.h"
+
+namespace keccak_avx512
+{
+namespace
+{
+const uint64_t RC[24] = {
+    0x0000000000000001ull, 0x0000000000008082ull, 0x800000000000808aull, 0x8000000080008000ull,
+    0x000000000000808bull, 0x0000000080000001ull, 0x8000000080008081ull, 0x8000000000008009ull,
+    0x000000000000008aull, 0x0000000000000088ull, 0x0000000080008009ull, 0x000000008000000aull,
+    0x000000008000808bull, 0x800000000000008bull, 0x8000000000008089ull, 0x8000000000008003ull,
+    0x8000000000008002ull, 0x8000000000000080ull, 0x000000000000800aull, 0x800000008000000aull,
+    0x8000000080008081ull, 0x8000000000008080ull, 0x0000000080000001ull, 0x8000000080008008ull};
+
+__m512i inline Set1(uint64_t x) { return _mm512_set1_epi64(x); }
+__m512i inline Xor(__m512i x, __m512i y) { return _mm512_xor_si512(x, y); }
+//! the rotate instruction only takes an immediate count
+#define Rotl(x, n) _mm512_rol_epi64((x), (n))
+//! x ^ (~y & z) in a single ternary logic instruction
+__m512i inline Chi(__m512i x, __m512i y, __m512i z) { return _mm512_ternarylogic_epi64(x, y, z, 0xd2); }
+
+void inline Permute(__m512i* st)
+{
+    __m512i a00 = st[0], a01 = st[1], a02 = st[2], a03 = st[3], a04 = st[4];
+    __m512i a05 = st[5], a06 = st[6], a07 = st[7], a08 = st[8], a09 = st[9];
+    __m512i a10 = st[10], a11 = st[11], a12 = st[12], a13 = st[13], a14 = st[14];
+    __m512i a15 = st[15], a16 = st[16], a17 = st[17], a18 = st[18], a19 = st[19];
+    __m512i a20 = st[20], a21 = st[21], a22 = st[22], a23 = st[23], a24 = st[24];
+    for (int r = 0; r < 24; r++) {
+        __m512i c0 = Xor(Xor(Xor(Xor(a00, a05), a10), a15), a20);
+        __m512i c1 = Xor(Xor(Xor(Xor(a01, a06), a11), a16), a21);
+        __m512i c2 = Xor(Xor(Xor(Xor(a02, a07), a12), a17), a22);
+        __m512i c3 = Xor(Xor(Xor(Xor(a03, a08), a13), a18), a23);
+        __m512i c4 = Xor(Xor(Xor(Xor(a04, a09), a14), a19), a24);
+        __m512i d0 = Xor(c4, Rotl(c1, 1));
+        __m512i d1 = Xor(c0, Rotl(c2, 1));
+        __m512i d2 = Xor(c1, Rotl(c3, 1));
+        __m512i d3 = Xor(c2, Rotl(c4, 1));
+        __m512i d4 = Xor(c3, Rotl(c0, 1));
+
+        // theta, rho and pi: lane (x, y) moves to (y, 2x + 3y)
+        __m512i b00 = Xor(a00, d0);
+        __m512i b01 = Rotl(Xor(a06, d1), 44);
+        __m512i b02 = Rotl(Xor(a12, d2), 43);
+        __m512i b03 = Rotl(Xor(a18, d3), 21);
+        __m512i b04 = Rotl(Xor(a24, d4), 14);
+        __m512i b05 = Rotl(Xor(a03, d3), 28);
+        __m512i b06 = Rotl(Xor(a09, d4), 20);
+        __m512i b07 = Rotl(Xor(a10, d0), 3);
+        __m512i b08 = Rotl(Xor(a16, d1), 45);
+        __m512i b09 = Rotl(Xor(a22, d2), 61);
+        __m512i b10 = Rotl(Xor(a01, d1), 1);
+        __m512i b11 = Rotl(Xor(a07, d2), 6);
+        __m512i b12 = Rotl(Xor(a13, d3), 25);
+        __m512i b13 = Rotl(Xor(a19, d4), 8);
+        __m512i b14 = Rotl(Xor(a20, d0), 18);
+        __m512i b15 = Rotl(Xor(a04, d4), 27);
+        __m512i b16 = Rotl(Xor(a05, d0), 36);
+        __m512i b17 = Rotl(Xor(a11, d1), 10);
+        __m512i b18 = Rotl(Xor(a17, d2), 15);
+        __m512i b19 = Rotl(Xor(a23, d3), 56);
+        __m512i b20 = Rotl(Xor(a02, d2), 62);
+        __m512i b21 = Rotl(Xor(a08, d3), 55);
+        __m512i b22 = Rotl(Xor(a14, d4), 39);
+        __m512i b23 = Rotl(Xor(a15, d0), 41);
+        __m512i b24 = Rotl(Xor(a21, d1), 2);
+
+        // chi and iota
+        a00 = Chi(b00, b01, b02);
+        a01 = Chi(b01, b02, b03);
+        a02 = Chi(b02, b03, b04);
+        a03 = Chi(b03, b04, b00);
+        a04 = Chi(b04, b00, b01);
+        a05 = Chi(b05, b06, b07);
+        a06 = Chi(b06, b07, b08);
+        a07 = Chi(b07, b08, b09);
+        a08 = Chi(b08, b09, b05);
+        a09 = Chi(b09, b05, b06);
+        a10 = Chi(b10, b11, b12);
+        a11 = Chi(b11, b12, b13);
+        a12 = Chi(b12, b13, b14);
+        a13 = Chi(b13, b14, b10);
+        a14 = Chi(b14, b10, b11);
+        a15 = Chi(b15, b16, b17);
+        a16 = Chi(b16, b17, b18);
+        a17 = Chi(b17, b18, b19);
+        a18 = Chi(b18, b19, b15);
+        a19 = Chi(b19, b15, b16);
+        a20 = Chi(b20, b21, b22);
+        a21 = Chi(b21, b22, b23);
+        a22 = Chi(b22, b23, b24);
+        a23 = Chi(b23, b24, b20);
+        a24 = Chi(b24, b20, b21);
+        a00 = Xor(a00, Set1(RC[r]));
+    }
+    st[0] = a00; st[1] = a01; st[2] = a02; st[3] = a03; st[4] = a04;
+    st[5] = a05; st[6] = a06; st[7] = a07; st[8] = a08; st[9] = a09;
+    st[10] = a10; st[11] = a11; st[12] = a12; st[13] = a13; st[14] = a14;
+    st[15] = a15; st[16] = a16; st[17] = a17; st[18] = a18; st[19] = a19;
+    st[20] = a20; st[21] = a21; st[22] = a22; st[23] = a23; st[24] = a24;
+}
+} // namespace
+
+void Header_8way(unsigned char* out, const uint64_t* st, uint32_t nNonce)
+{
+    __m512i s[25];
+    for (int i = 0; i < 25; i++)
+        s[i] = Set1(st[i]);
+    // the nonce is the upper half of lane 9
+    s[9] = _mm512_or_si512(Set1(st[9]), _mm512_slli_epi64(_mm512_set_epi64(
+        (uint32_t)(nNonce + 7), (uint32_t)(nNonce + 6), (uint32_t)(nNonce + 5), (uint32_t)(nNonce + 4),
+        (uint32_t)(nNonce + 3), (uint32_t)(nNonce + 2), (uint32_t)(nNonce + 1), nNonce), 32));
+    Permute(s);
+
+    uint64_t lanes[8];
+    for (int i = 0; i < 4; i++) {
+        _mm512_storeu_si512((void*)lanes, s[i]);
+        for (int j = 0; j < 8; j++)
+            WriteLE64(out + 32 * j + 8 * i, lanes[j]);
+    }
+}
+} // namespace keccak_avx512
+
+#endif
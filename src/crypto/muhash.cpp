@@ -0,0 +1,197 @@
+// Copyright (c) 2017-2020 The VALUTO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "crypto/muhash.h"
+
+#include "crypto/common.h"
+#include "crypto/sha256.h"
+
+#include <string.h>
+
+namespace
+{
+typedef Num3072::limb_t limb_t;
+typedef Num3072::double_limb_t double_limb_t;
+const int LIMB_SIZE = Num3072::LIMB_SIZE;
+const int LIMBS = Num3072::LIMBS;
+
+//! 2^3072 minus the prime
+const limb_t MAX_PRIME_DIFF = 1103717;
+
+limb_t ReadLimb(const unsigned char* ptr)
+{
+    return sizeof(limb_t) == 8 ? (limb_t)ReadLE64(ptr) : (limb_t)ReadLE32(ptr);
+}
+
+void WriteLimb(unsigned char* ptr, limb_t x)
+{
+    if (sizeof(limb_t) == 8)
+        WriteLE64(ptr, (uint64_t)x);
+    else
+        WriteLE32(ptr, (uint32_t)x);
+}
+
+/** Map an element to a number: SHA256 of it, stretched to 384 bytes by SHA256 in counter mode. */
+Num3072 ToNum3072(const unsigned char* data, size_t len)
+{
+    unsigned char seed[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(data, len).Finalize(seed);
+    unsigned char bytes[Num3072::BYTE_SIZE];
+    unsigned char counter[4];
+    for (uint32_t i = 0; i < Num3072::BYTE_SIZE / CSHA256::OUTPUT_SIZE; i++) {
+        WriteLE32(counter, i);
+        CSHA256().Write(seed, sizeof(seed)).Write(counter, sizeof(counter)).Finalize(bytes + i * CSHA256::OUTPUT_SIZE);
+    }
+    return Num3072(bytes);
+}
+} // namespace
+
+Num3072::Num3072(const unsigned char* data)
+{
+    for (int i = 0; i < LIMBS; i++)
+        limbs[i] = ReadLimb(data + i * sizeof(limb_t));
+    if (IsOverflow())
+        FullReduce();
+}
+
+void Num3072::SetToOne()
+{
+    limbs[0] = 1;
+    for (int i = 1; i < LIMBS; i++)
+        limbs[i] = 0;
+}
+
+bool Num3072::IsOne() const
+{
+    if (limbs[0] != 1)
+        return false;
+    for (int i = 1; i < LIMBS; i++) {
+        if (limbs[i] != 0)
+            return false;
+    }
+    return true;
+}
+
+/** Whether the value is at least the prime: all limbs at their maximum but for the lowest. */
+bool Num3072::IsOverflow() const
+{
+    if (limbs[0] <= (limb_t)(-1) - MAX_PRIME_DIFF)
+        return false;
+    for (int i = 1; i < LIMBS; i++) {
+        if (limbs[i] != (limb_t)(-1))
+            return false;
+    }
+    return true;
+}
+
+/** Subtract the prime, i.e. add the difference modulo 2^3072. */
+void Num3072::FullReduce()
+{
+    double_limb_t c = MAX_PRIME_DIFF;
+    for (int i = 0; i < LIMBS; i++) {
+        c += limbs[i];
+        limbs[i] = (limb_t)c;
+        c >>= LIMB_SIZE;
+    }
+}
+
+void Num3072::Multiply(const Num3072& a)
+{
+    // the full 6144-bit product
+    limb_t tmp[2 * LIMBS];
+    memset(tmp, 0, sizeof(tmp));
+    for (int i = 0; i < LIMBS; i++) {
+        double_limb_t c = 0;
+        for (int j = 0; j < LIMBS; j++) {
+            c += (double_limb_t)limbs[i] * a.limbs[j] + tmp[i + j];
+            tmp[i + j] = (limb_t)c;
+            c >>= LIMB_SIZE;
+        }
+        tmp[i + LIMBS] = (limb_t)c;
+    }
+
+    // 2^3072 is MAX_PRIME_DIFF modulo the prime: fold the high half into the low one
+    double_limb_t c = 0;
+    for (int i = 0; i < LIMBS; i++) {
+        c += (double_limb_t)tmp[i + LIMBS] * MAX_PRIME_DIFF + tmp[i];
+        limbs[i] = (limb_t)c;
+        c >>= LIMB_SIZE;
+    }
+    // and the carry out of that, which is at most MAX_PRIME_DIFF
+    while (c) {
+        c *= MAX_PRIME_DIFF;
+        for (int i = 0; i < LIMBS && c; i++) {
+            c += limbs[i];
+            limbs[i] = (limb_t)c;
+            c >>= LIMB_SIZE;
+        }
+    }
+    if (IsOverflow())
+        FullReduce();
+}
+
+Num3072 Num3072::GetInverse() const
+{
+    // Fermat: a^(p - 2), with p - 2 = 2^3072 - 1103719 scanned from the top bit
+    const limb_t low = (limb_t)0 - MAX_PRIME_DIFF - 2;
+    Num3072 r;
+    for (int i = LIMBS - 1; i >= 0; i--) {
+        limb_t e = i == 0 ? low : (limb_t)(-1);
+        for (int bit = LIMB_SIZE - 1; bit >= 0; bit--) {
+            r.Multiply(r);
+            if ((e >> bit) & 1)
+                r.Multiply(*this);
+        }
+    }
+    return r;
+}
+
+void Num3072::Divide(const Num3072& a)
+{
+    Multiply(a.GetInverse());
+}
+
+void Num3072::ToBytes(unsigned char* out) const
+{
+    for (int i = 0; i < LIMBS; i++)
+        WriteLimb(out + i * sizeof(limb_t), limbs[i]);
+}
+
+MuHash3072& MuHash3072::Insert(const unsigned char* data, size_t len)
+{
+    numerator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::Remove(const unsigned char* data, size_t len)
+{
+    denominator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator*=(const MuHash3072& mul)
+{
+    numerator.Multiply(mul.numerator);
+    denominator.Multiply(mul.denominator);
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator/=(const MuHash3072& div)
+{
+    numerator.Multiply(div.denominator);
+    denominator.Multiply(div.numerator);
+    return *this;
+}
+
+void MuHash3072::Finalize(unsigned char hash[OUTPUT_SIZE])
+{
+    // a set finalized before, with nothing removed since, needs no inverse
+    if (!denominator.IsOne()) {
+        numerator.Divide(denominator);
+        denominator.SetToOne();
+    }
+    unsigned char data[Num3072::BYTE_SIZE];
+    numerator.ToBytes(data);
+    CSHA256().Write(data, sizeof(data)).Finalize(hash);
+}
@@ -0,0 +1,99 @@
+// Copyright (c) 2017-2020 The VALUTO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_MUHASH_H
+#define BITCOIN_CRYPTO_MUHASH_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/** An integer modulo the prime 2^3072 - 1103717. */
+class Num3072
+{
+public:
+#ifdef __SIZEOF_INT128__
+    typedef uint64_t limb_t;
+    typedef unsigned __int128 double_limb_t;
+#else
+    typedef uint32_t limb_t;
+    typedef uint64_t double_limb_t;
+#endif
+    static const int LIMB_SIZE = 8 * sizeof(limb_t);
+    static const int LIMBS = 3072 / LIMB_SIZE;
+    static const size_t BYTE_SIZE = 384;
+
+    limb_t limbs[LIMBS];
+
+    Num3072() { SetToOne(); }
+    //! from 384 little-endian bytes, reduced modulo the prime
+    explicit Num3072(const unsigned char* data);
+
+    void SetToOne();
+    bool IsOne() const;
+    void Multiply(const Num3072& a);
+    void Divide(const Num3072& a);
+    Num3072 GetInverse() const;
+    void ToBytes(unsigned char* out) const;
+
+private:
+    bool IsOverflow() const;
+    void FullReduce();
+};
+
+/**
+ * A hash of a multiset of byte strings that elements can be added to and
+ * removed from in any order: each element is mapped to a number modulo a
+ * 3072-bit prime, and the multiset hashes to the SHA256 of their product.
+ *
+ * Removals are collected in a separate denominator, so that adding and
+ * removing stay one multiplication each and only Finalize needs the costly
+ * modular inverse.
+ */
+class MuHash3072
+{
+private:
+    Num3072 numerator;
+    Num3072 denominator;
+
+public:
+    static const size_t OUTPUT_SIZE = 32;
+    static const size_t SERIALIZED_SIZE = 2 * Num3072::BYTE_SIZE;
+
+    //! the empty set
+    MuHash3072() {}
+
+    MuHash3072& Insert(const unsigned char* data, size_t len);
+    MuHash3072& Remove(const unsigned char* data, size_t len);
+
+    //! the union with (or, for /=, the difference from) another set
+    MuHash3072& operator*=(const MuHash3072& mul);
+    MuHash3072& operator/=(const MuHash3072& div);
+
+    void Finalize(unsigned char hash[OUTPUT_SIZE]);
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return SERIALIZED_SIZE;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        unsigned char data[SERIALIZED_SIZE];
+        numerator.ToBytes(data);
+        denominator.ToBytes(data + Num3072::BYTE_SIZE);
+        s.write((const char*)data, sizeof(data));
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        unsigned char data[SERIALIZED_SIZE];
+        s.read((char*)data, sizeof(data));
+        numerator = Num3072(data);
+        denominator = Num3072(data + Num3072::BYTE_SIZE);
+    }
+};
+
+#endif // BITCOIN_CRYPTO_MUHASH_H
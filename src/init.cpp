@@ -13,10 +13,15 @@
 #include "init.h"
 
 #include "activemasternode.h"
+#include "addressindex.h"
 #include "addrman.h"
 #include "amount.h"
+#include "blockfilemap.h"
+#include "blockimport.h"
 #include "checkpoints.h"
 #include "compat/sanity.h"
+#include "crypto/keccak256.h"
+#include "crypto/sha256.h"
 #include "key.h"
 #include "main.h"
 #include "masternode-payments.h"
@@ -29,10 +34,13 @@
 #include "spork.h"
 #include "sporkdb.h"
 #include "txdb.h"
+#include "txposindex.h"
 #include "torcontrol.h"
 #include "ui_interface.h"
 #include "util.h"
 #include "utilmoneystr.h"
+#include "utxosnapshot.h"
+#include "utxostats.h"
 #include "validationinterface.h"
 
 #ifdef ENABLE_WALLET
@@ -186,7 +194,7 @@ void PrepareShutdown()
     mempool.AddTransactionsUpdated(1);
     StopRPCThreads();
 #ifdef ENABLE_WALLET
-    if (pwalletMain)
+    if (!vpwallets.empty())
         bitdb.Flush(false);
     GenerateBitcoins(false, NULL, 0);
 #endif
@@ -227,9 +235,13 @@ void PrepareShutdown()
         pblocktree = NULL;
         delete pSporkDB;
         pSporkDB = NULL;
+        delete pTxPosIndex;
+        pTxPosIndex = NULL;
+        delete pblockfilemap;
+        pblockfilemap = NULL;
     }
 #ifdef ENABLE_WALLET
-    if (pwalletMain)
+    if (!vpwallets.empty())
         bitdb.Flush(true);
 #endif
 
@@ -267,10 +279,12 @@ void Shutdown()
         PrepareShutdown();
     }
 
-    // Shutdown part 2: Stop TOR thread and delete wallet instance
+    // Shutdown part 2: Stop TOR thread and delete wallet instances
     StopTorControl();
 #ifdef ENABLE_WALLET
-    delete pwalletMain;
+    BOOST_FOREACH (CWallet* pwallet, vpwallets)
+        delete pwallet;
+    vpwallets.clear();
     pwalletMain = NULL;
 #endif
     LogPrintf("%s: done\n", __func__);
@@ -323,6 +337,8 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-version", _("Print version and exit"));
     strUsage += HelpMessageOpt("-alertnotify=<cmd>", _("Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)"));
     strUsage += HelpMessageOpt("-alerts", strprintf(_("Receive and display P2P network alerts (default: %u)"), DEFAULT_ALERTS));
+    strUsage += HelpMessageOpt("-assumeutxo=<hash>", _("Also trust the UTXO snapshot with this hash for -loadsnapshot"));
+    strUsage += HelpMessageOpt("-blockfilemaps=<n>", strprintf(_("Serve block reads from up to <n> memory-mapped block files, 0 to disable (default: %u)"), DEFAULT_BLOCKFILE_MAPS));
     strUsage += HelpMessageOpt("-blocknotify=<cmd>", _("Execute command when the best block changes (%s in cmd is replaced by block hash)"));
     strUsage += HelpMessageOpt("-checkblocks=<n>", strprintf(_("How many blocks to check at startup (default: %u, 0 = all)"), 500));
     strUsage += HelpMessageOpt("-conf=<file>", strprintf(_("Specify configuration file (default: %s)"), "valuto.conf"));
@@ -333,20 +349,29 @@ std::string HelpMessage(HelpMessageMode mode)
     }
     strUsage += HelpMessageOpt("-datadir=<dir>", _("Specify data directory"));
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
+    strUsage += HelpMessageOpt("-importthreads=<n>", strprintf(_("Set the number of block check threads used by -reindex and -loadblock (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"), -(int)boost::thread::hardware_concurrency(), MAX_IMPORT_THREADS, DEFAULT_IMPORT_THREADS));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file") + " " + _("on startup"));
+    strUsage += HelpMessageOpt("-loadsnapshot=<file>", _("Start a new node from a UTXO snapshot written by dumptxoutset and validate the blocks below it in the background (requires -prune and -txindex=0)"));
     strUsage += HelpMessageOpt("-maxreorg=<n>", strprintf(_("Set the Maximum reorg depth (default: %u)"), Params(CBaseChainParams::MAIN).MaxReorganizationDepth()));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"), -(int)boost::thread::hardware_concurrency(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), "valutod.pid"));
 #endif
+    strUsage += HelpMessageOpt("-prune=<n>", strprintf(_("Reduce storage requirements by pruning (deleting) old blocks. This mode disables wallet rescans and is incompatible with -addressindex, -spentindex and -txposindex. "
+            "Warning: Reverting this setting requires re-downloading the entire blockchain. "
+            "(default: 0 = disable pruning blocks, >%u = target size in MiB to use for block files)"), MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
     strUsage += HelpMessageOpt("-reindex", _("Rebuild block chain index from current blk000??.dat files") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-reindexmoneysupply", _("Reindex the VALUTO  money supply statistics") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-resync", _("Delete blockchain folders and resync from scratch") + " " + _("on startup"));
 #if !defined(WIN32)
     strUsage += HelpMessageOpt("-sysperms", _("Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)"));
 #endif
+    strUsage += HelpMessageOpt("-addressindex", strprintf(_("Maintain an index of outputs and balances by address, used by the getaddress* rpc calls and built in the background (default: %u)"), DEFAULT_ADDRESSINDEX));
+    strUsage += HelpMessageOpt("-spentindex", strprintf(_("Maintain an index of the inputs spending each output, used by the getspentinfo rpc call and built in the background (default: %u)"), DEFAULT_SPENTINDEX));
     strUsage += HelpMessageOpt("-txindex", strprintf(_("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)"), 0));
+    strUsage += HelpMessageOpt("-txposindex", strprintf(_("Maintain a memory-mapped transaction position index, built in the background without a reindex (default: %u)"), DEFAULT_TXPOSINDEX));
+    strUsage += HelpMessageOpt("-txposcache=<n>", strprintf(_("Number of recently used transaction positions kept in memory (default: %u)"), DEFAULT_TXPOSCACHE));
     strUsage += HelpMessageOpt("-forcestart", _("Attempt to force blockchain corruption recovery") + " " + _("on startup"));
 
     strUsage += HelpMessageGroup(_("Connection options:"));
@@ -392,7 +417,8 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageGroup(_("Wallet options:"));
     strUsage += HelpMessageOpt("-createwalletbackups=<n>", _("Number of automatic wallet backups (default: 10)"));
     strUsage += HelpMessageOpt("-disablewallet", _("Do not load the wallet and disable wallet RPC calls"));
-    strUsage += HelpMessageOpt("-keypool=<n>", strprintf(_("Set key pool size to <n> (default: %u)"), 100));
+    strUsage += HelpMessageOpt("-keypool=<n>", strprintf(_("Set key pool size to <n> (default: %u)"), DEFAULT_KEYPOOL_SIZE));
+    strUsage += HelpMessageOpt("-keypoolmin=<n>", strprintf(_("Refill the key pool in the background once fewer than <n> keys are left (default: %u)"), DEFAULT_KEYPOOL_MIN));
     if (GetBoolArg("-help-debug", false))
         strUsage += HelpMessageOpt("-mintxfee=<amt>", strprintf(_("Fees (in VALUTO/Kb) smaller than this are considered zero fee for transaction creation (default: %s)"),
             FormatMoney(CWallet::minTxFee.GetFeePerK())));
@@ -406,7 +432,8 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-maxtxfee=<amt>", strprintf(_("Maximum total fees to use in a single wallet transaction, setting too low may abort large transactions (default: %s)"),
         FormatMoney(maxTxFee)));
     strUsage += HelpMessageOpt("-upgradewallet", _("Upgrade wallet to latest format") + " " + _("on startup"));
-    strUsage += HelpMessageOpt("-wallet=<file>", _("Specify wallet file (within data directory)") + " " + strprintf(_("(default: %s)"), "wallet.dat"));
+    strUsage += HelpMessageOpt("-wallet=<file>", _("Specify wallet file (within data directory)") + " " + strprintf(_("(default: %s)"), "wallet.dat") + " " +
+                                                 _("Can be specified multiple times to load multiple wallets; RPC calls are sent to one of them through the /wallet/<file> endpoint"));
     strUsage += HelpMessageOpt("-walletnotify=<cmd>", _("Execute command when a wallet transaction changes (%s in cmd is replaced by TxID)"));
     if (mode == HMM_BITCOIN_QT)
         strUsage += HelpMessageOpt("-windowtitle=<name>", _("Wallet window title"));
@@ -419,9 +446,12 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-zmqpubhashblock=<address>", _("Enable publish hash block in <address>"));
     strUsage += HelpMessageOpt("-zmqpubhashtx=<address>", _("Enable publish hash transaction in <address>"));
     strUsage += HelpMessageOpt("-zmqpubhashtxlock=<address>", _("Enable publish hash transaction (locked via SwiftX) in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubhashtxremoved=<address>", _("Enable publish hash of transactions removed from the mempool in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawblock=<address>", _("Enable publish raw block in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawtx=<address>", _("Enable publish raw transaction in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawtxlock=<address>", _("Enable publish raw transaction (locked via SwiftX) in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubrawmnwinner=<address>", _("Enable publish raw masternode payment winner in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubrawspork=<address>", _("Enable publish raw spork in <address>"));
 #endif
 
     strUsage += HelpMessageGroup(_("Debugging/Testing options:"));
@@ -440,7 +470,7 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-stopafterblockimport", strprintf(_("Stop running after importing blocks from disk (default: %u)"), 0));
         strUsage += HelpMessageOpt("-sporkkey=<privkey>", _("Enable spork administration functionality with the appropriate private key."));
     }
-    string debugCategories = "addrman, alert, bench, coindb, db, lock, rand, rpc, selectcoins, tor, mempool, net, proxy, valuto, (obfuscation, swiftx, masternode, mnpayments)"; // Don't translate these and qt below
+    string debugCategories = "addrman, alert, bench, coindb, db, lock, prune, rand, rpc, selectcoins, tor, mempool, net, proxy, valuto, (obfuscation, swiftx, masternode, mnpayments)"; // Don't translate these and qt below
     if (mode == HMM_BITCOIN_QT)
         debugCategories += ", qt";
     strUsage += HelpMessageOpt("-debug=<category>", strprintf(_("Output debugging information (default: %u, supplying <category> is optional)"), 0) + ". " +
@@ -458,6 +488,7 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-limitfreerelay=<n>", strprintf(_("Continuously rate-limit free transactions to <n>*1000 bytes per minute (default:%u)"), 15));
         strUsage += HelpMessageOpt("-relaypriority", strprintf(_("Require high priority for relaying free or low-fee transactions (default:%u)"), 1));
         strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf(_("Limit size of signature cache to <n> entries (default: %u)"), 50000));
+        strUsage += HelpMessageOpt("-sigbatch", strprintf(_("Verify the signatures of each script verification batch together (default: %u)"), DEFAULT_SIGNATURE_BATCH));
     }
     strUsage += HelpMessageOpt("-maxtipage=<n>", strprintf("Maximum tip age in seconds to consider node in initial block download (default: %u)", DEFAULT_MAX_TIP_AGE));
     strUsage += HelpMessageOpt("-minrelaytxfee=<amt>", strprintf(_("Fees (in VALUTO/Kb) smaller than this are considered zero fee for relaying (default: %s)"), FormatMoney(::minRelayTxFee.GetFeePerK())));
@@ -514,7 +545,9 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-rpcpassword=<pw>", _("Password for JSON-RPC connections"));
     strUsage += HelpMessageOpt("-rpcport=<port>", strprintf(_("Listen for JSON-RPC connections on <port> (default: %u or testnet: %u)"), 1944, 11944));
     strUsage += HelpMessageOpt("-rpcallowip=<ip>", _("Allow JSON-RPC connections from specified source. Valid for <ip> are a single IP (e.g. 1.2.3.4), a network/netmask (e.g. 1.2.3.4/255.255.255.0) or a network/CIDR (e.g. 1.2.3.4/24). This option can be specified multiple times"));
-    strUsage += HelpMessageOpt("-rpcthreads=<n>", strprintf(_("Set the number of threads to service RPC calls (default: %d)"), 4));
+    strUsage += HelpMessageOpt("-rpcthreads=<n>", strprintf(_("Set the number of threads to service RPC calls (default: %d)"), DEFAULT_RPC_THREADS));
+    strUsage += HelpMessageOpt("-rpcworkqueue=<n>", strprintf(_("Set the depth of the work queue to service RPC calls (default: %d)"), DEFAULT_RPC_WORKQUEUE));
+    strUsage += HelpMessageOpt("-rpcservertimeout=<n>", strprintf(_("Timeout in seconds for idle RPC connections (default: %d)"), DEFAULT_RPC_SERVER_TIMEOUT));
     strUsage += HelpMessageOpt("-rpckeepalive", strprintf(_("RPC support for HTTP persistent connections (default: %d)"), 1));
 
     strUsage += HelpMessageGroup(_("RPC SSL options: (see the Bitcoin Wiki for SSL setup instructions)"));
@@ -573,6 +606,7 @@ void ThreadImport(std::vector<boost::filesystem::path> vImportFiles)
     // -reindex
     if (fReindex) {
         CImportingNow imp;
+        CImportStats stats;
         int nFile = 0;
         while (true) {
             CDiskBlockPos pos(nFile, 0);
@@ -582,12 +616,12 @@ void ThreadImport(std::vector<boost::filesystem::path> vImportFiles)
             if (!file)
                 break; // This error is logged in OpenBlockFile
             LogPrintf("Reindexing block file blk%05u.dat...\n", (unsigned int)nFile);
-            LoadExternalBlockFile(file, &pos);
+            LoadExternalBlockFile(file, &pos, &stats);
             nFile++;
         }
         pblocktree->WriteReindexing(false);
         fReindex = false;
-        LogPrintf("Reindexing finished\n");
+        LogPrintf("Reindexing finished: %s\n", stats.ToString());
         // To avoid ending up in a situation without genesis block, re-try initializing (no-op if reindexing worked):
         InitBlockIndex();
     }
@@ -642,6 +676,153 @@ bool InitSanityCheck(void)
 }
 
 
+#ifdef ENABLE_WALLET
+/**
+ * Load the wallet kept in strWalletFile, create it on first run, bring it up
+ * to the tip of the chain and subscribe it to validation events. Returns NULL
+ * when the node can't go on; lesser problems are added to strErrors.
+ */
+static CWallet* LoadWalletFromFile(const std::string& strWalletFile, std::ostringstream& strErrors)
+{
+    // needed to restore wallet transaction meta data after -zapwallettxes
+    std::vector<CWalletTx> vWtx;
+
+    if (GetBoolArg("-zapwallettxes", false)) {
+        uiInterface.InitMessage(_("Zapping all transactions from wallet..."));
+
+        CWallet* pwalletZap = new CWallet(strWalletFile);
+        DBErrors nZapWalletRet = pwalletZap->ZapWalletTx(vWtx);
+        delete pwalletZap;
+        if (nZapWalletRet != DB_LOAD_OK) {
+            uiInterface.InitMessage(strprintf(_("Error loading %s: Wallet corrupted"), strWalletFile));
+            return NULL;
+        }
+    }
+
+    int64_t nStart = GetTimeMillis();
+    bool fFirstRun = true;
+    CWallet* pwallet = new CWallet(strWalletFile);
+    DBErrors nLoadWalletRet = pwallet->LoadWallet(fFirstRun);
+    if (nLoadWalletRet != DB_LOAD_OK) {
+        if (nLoadWalletRet == DB_CORRUPT)
+            strErrors << strprintf(_("Error loading %s: Wallet corrupted"), strWalletFile) << "\n";
+        else if (nLoadWalletRet == DB_NONCRITICAL_ERROR) {
+            string msg(strprintf(_("Warning: error reading %s! All keys read correctly, but transaction data"
+                                   " or address book entries might be missing or incorrect."), strWalletFile));
+            InitWarning(msg);
+        } else if (nLoadWalletRet == DB_TOO_NEW)
+            strErrors << strprintf(_("Error loading %s: Wallet requires newer version of VALUTO Core"), strWalletFile) << "\n";
+        else if (nLoadWalletRet == DB_NEED_REWRITE) {
+            strErrors << _("Wallet needed to be rewritten: restart VALUTO Core to complete") << "\n";
+            LogPrintf("%s", strErrors.str());
+            InitError(strErrors.str());
+            delete pwallet;
+            return NULL;
+        } else
+            strErrors << strprintf(_("Error loading %s"), strWalletFile) << "\n";
+    }
+
+    if (GetBoolArg("-upgradewallet", fFirstRun)) {
+        int nMaxVersion = GetArg("-upgradewallet", 0);
+        if (nMaxVersion == 0) // the -upgradewallet without argument case
+        {
+            LogPrintf("Performing wallet upgrade to %i\n", FEATURE_LATEST);
+            nMaxVersion = CLIENT_VERSION;
+            pwallet->SetMinVersion(FEATURE_LATEST); // permanently upgrade the wallet immediately
+        } else
+            LogPrintf("Allowing wallet upgrade up to %i\n", nMaxVersion);
+        if (nMaxVersion < pwallet->GetVersion())
+            strErrors << _("Cannot downgrade wallet") << "\n";
+        pwallet->SetMaxVersion(nMaxVersion);
+    }
+
+    if (fFirstRun) {
+        // Create new keyUser and set as default key
+        RandAddSeedPerfmon();
+
+        CPubKey newDefaultKey;
+        if (pwallet->GetKeyFromPool(newDefaultKey)) {
+            pwallet->SetDefaultKey(newDefaultKey);
+            if (!pwallet->SetAddressBook(pwallet->vchDefaultKey.GetID(), "", "receive"))
+                strErrors << _("Cannot write default address") << "\n";
+        }
+
+        pwallet->SetBestChain(chainActive.GetLocator());
+    }
+
+    LogPrintf("%s", strErrors.str());
+    LogPrintf(" wallet      %15dms (%s)\n", GetTimeMillis() - nStart, strWalletFile);
+
+    RegisterValidationInterface(pwallet);
+
+    CBlockIndex* pindexRescan = chainActive.Tip();
+    if (GetBoolArg("-rescan", false))
+        pindexRescan = chainActive.Genesis();
+    else {
+        CWalletDB walletdb(strWalletFile);
+        CBlockLocator locator;
+        if (walletdb.ReadBestBlock(locator))
+            pindexRescan = FindForkInGlobalIndex(chainActive, locator);
+        else
+            pindexRescan = chainActive.Genesis();
+
+        // finish a rescan that was cut short by shutdown or abortrescan
+        if (walletdb.ReadRescanBlock(locator)) {
+            CBlockIndex* pindexResume = FindForkInGlobalIndex(chainActive, locator);
+            if (pindexResume && (!pindexRescan || pindexResume->nHeight < pindexRescan->nHeight))
+                pindexRescan = pindexResume;
+        }
+    }
+    if (chainActive.Tip() && chainActive.Tip() != pindexRescan) {
+        //We can't rescan beyond non-pruned blocks, stop and throw an error
+        //this might happen if a user uses a old wallet within a pruned node
+        // or if he ran -disablewallet for a longer time, then decided to re-enable
+        if (fPruneMode) {
+            CBlockIndex* block = chainActive.Tip();
+            while (block && block->pprev && (block->pprev->nStatus & BLOCK_HAVE_DATA) && block->pprev->nTx > 0 && pindexRescan != block)
+                block = block->pprev;
+
+            if (pindexRescan != block) {
+                InitError(_("Prune: last wallet synchronisation goes beyond pruned data. You need to -reindex (download the whole blockchain again in case of pruned node)"));
+                UnregisterValidationInterface(pwallet);
+                delete pwallet;
+                return NULL;
+            }
+        }
+
+        uiInterface.InitMessage(_("Rescanning..."));
+        LogPrintf("Rescanning last %i blocks (from block %i)...\n", chainActive.Height() - pindexRescan->nHeight, pindexRescan->nHeight);
+        nStart = GetTimeMillis();
+        pwallet->ScanForWalletTransactions(pindexRescan, true);
+        LogPrintf(" rescan      %15dms\n", GetTimeMillis() - nStart);
+        pwallet->SetBestChain(chainActive.GetLocator());
+        nWalletDBUpdated++;
+
+        // Restore wallet transaction metadata after -zapwallettxes=1
+        if (GetBoolArg("-zapwallettxes", false) && GetArg("-zapwallettxes", "1") != "2") {
+            for (const CWalletTx& wtxOld : vWtx) {
+                uint256 hash = wtxOld.GetHash();
+                std::map<uint256, CWalletTx>::iterator mi = pwallet->mapWallet.find(hash);
+                if (mi != pwallet->mapWallet.end()) {
+                    const CWalletTx* copyFrom = &wtxOld;
+                    CWalletTx* copyTo = &mi->second;
+                    copyTo->mapValue = copyFrom->mapValue;
+                    copyTo->vOrderForm = copyFrom->vOrderForm;
+                    copyTo->nTimeReceived = copyFrom->nTimeReceived;
+                    copyTo->nTimeSmart = copyFrom->nTimeSmart;
+                    copyTo->fFromMe = copyFrom->fFromMe;
+                    copyTo->strFromAccount = copyFrom->strFromAccount;
+                    copyTo->nOrderPos = copyFrom->nOrderPos;
+                    copyTo->WriteToDisk();
+                }
+            }
+        }
+    }
+
+    return pwallet;
+}
+#endif // ENABLE_WALLET
+
 /** Initialize VALUTO.
  *  @pre Parameters should be parsed and config file should be read.
  */
@@ -772,6 +953,24 @@ bool AppInit2()
             LogPrintf("AppInit2 : parameter interaction: -zapwallettxes=<mode> -> setting -rescan=1\n");
     }
 
+    // the indexes built from the full block history cannot be combined with pruning
+    if (GetArg("-prune", 0)) {
+        if (GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX) || GetBoolArg("-spentindex", DEFAULT_SPENTINDEX))
+            return InitError(_("Prune mode is incompatible with -addressindex and -spentindex."));
+        if (GetBoolArg("-txposindex", DEFAULT_TXPOSINDEX))
+            return InitError(_("Prune mode is incompatible with -txposindex."));
+#ifdef ENABLE_WALLET
+        if (GetBoolArg("-rescan", false))
+            return InitError(_("Rescans are not possible in pruned mode. You will need to use -reindex which will download the whole blockchain again."));
+#endif
+    }
+
+    // a node started from a UTXO snapshot has no block files below it
+    if (mapArgs.count("-loadsnapshot") && !GetArg("-prune", 0))
+        return InitError(_("-loadsnapshot requires -prune."));
+    if (mapArgs.count("-loadsnapshot") && GetBoolArg("-txindex", true))
+        return InitError(_("-loadsnapshot can't build a transaction index for the blocks below the snapshot. Start with -txindex=0; a -reindex adds it later."));
+
     if (!GetBoolArg("-enableswifttx", fEnableSwiftTX)) {
         if (SoftSetArg("-swifttxdepth", 0))
             LogPrintf("AppInit2 : parameter interaction: -enableswifttx=false -> setting -nSwiftTXDepth=0\n");
@@ -822,6 +1021,7 @@ bool AppInit2()
     mempool.setSanityCheck(GetBoolArg("-checkmempool", Params().DefaultConsistencyChecks()));
     fCheckBlockIndex = GetBoolArg("-checkblockindex", Params().DefaultConsistencyChecks());
     Checkpoints::fEnabled = GetBoolArg("-checkpoints", true);
+    fSignatureBatch = GetBoolArg("-sigbatch", DEFAULT_SIGNATURE_BATCH);
 
     // -par=0 means autodetect, but nScriptCheckThreads==0 means no concurrency
     nScriptCheckThreads = GetArg("-par", DEFAULT_SCRIPTCHECK_THREADS);
@@ -832,6 +1032,15 @@ bool AppInit2()
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
 
+    // the import pipeline always has at least one check thread next to the reader
+    nImportCheckThreads = GetArg("-importthreads", DEFAULT_IMPORT_THREADS);
+    if (nImportCheckThreads <= 0)
+        nImportCheckThreads += boost::thread::hardware_concurrency();
+    if (nImportCheckThreads < 1)
+        nImportCheckThreads = 1;
+    else if (nImportCheckThreads > MAX_IMPORT_THREADS)
+        nImportCheckThreads = MAX_IMPORT_THREADS;
+
     fServer = GetBoolArg("-server", false);
     setvbuf(stdout, NULL, _IOLBF, 0); /// ***TODO*** do we still need this after -printtoconsole is gone?
 
@@ -901,7 +1110,11 @@ bool AppInit2()
     bdisableSystemnotifications = GetBoolArg("-disablesystemnotifications", false);
     fSendFreeTransactions = GetBoolArg("-sendfreetransactions", false);
 
-    std::string strWalletFile = GetArg("-wallet", "wallet.dat");
+    std::vector<std::string> vWalletFiles;
+    if (mapArgs.count("-wallet"))
+        vWalletFiles = mapMultiArgs["-wallet"];
+    else
+        vWalletFiles.push_back("wallet.dat");
 #endif // ENABLE_WALLET
 
     fIsBareMultisigStd = GetBoolArg("-permitbaremultisig", true) != 0;
@@ -913,17 +1126,38 @@ bool AppInit2()
     if (GetBoolArg("-peerbloomfilters", DEFAULT_PEERBLOOMFILTERS))
         nLocalServices |= NODE_BLOOM;
 
+    // block pruning; get the amount of disk space (in MiB) to allot for block & undo files
+    int64_t nSignedPruneTarget = GetArg("-prune", 0) * 1024 * 1024;
+    if (nSignedPruneTarget < 0)
+        return InitError(_("Prune cannot be configured with a negative value."));
+    nPruneTarget = (uint64_t)nSignedPruneTarget;
+    if (nPruneTarget) {
+        if (nPruneTarget < MIN_DISK_SPACE_FOR_BLOCK_FILES)
+            return InitError(strprintf(_("Prune configured below the minimum of %d MiB.  Please use a higher number."), MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
+        LogPrintf("Prune configured to target %uMiB on disk for block and undo files.\n", nPruneTarget / 1024 / 1024);
+        fPruneMode = true;
+    }
+
     // ********************************************************* Step 4: application initialization: dir lock, daemonize, pidfile, debug log
 
+    // Pick the fastest SHA256 and Keccak implementations before anything is hashed
+    std::string strSHA256Impl = SHA256AutoDetect();
+    std::string strKeccakImpl = KeccakHeaderAutoDetect();
+
     // Sanity check
     if (!InitSanityCheck())
         return InitError(_("Initialization sanity check failed. VALUTO Core is shutting down."));
 
     std::string strDataDir = GetDataDir().string();
 #ifdef ENABLE_WALLET
-    // Wallet file must be a plain filename without a directory
-    if (strWalletFile != boost::filesystem::basename(strWalletFile) + boost::filesystem::extension(strWalletFile))
-        return InitError(strprintf(_("Wallet %s resides outside data directory %s"), strWalletFile, strDataDir));
+    std::set<std::string> setWalletFiles;
+    BOOST_FOREACH (const std::string& strWalletFile, vWalletFiles) {
+        // Wallet file must be a plain filename without a directory
+        if (strWalletFile != boost::filesystem::basename(strWalletFile) + boost::filesystem::extension(strWalletFile))
+            return InitError(strprintf(_("Wallet %s resides outside data directory %s"), strWalletFile, strDataDir));
+        if (!setWalletFiles.insert(strWalletFile).second)
+            return InitError(strprintf(_("Error loading wallet %s. Duplicate -wallet filename specified."), strWalletFile));
+    }
 #endif
     // Make sure only a single VALUTO process is using the data directory.
     boost::filesystem::path pathLockFile = GetDataDir() / ".lock";
@@ -943,6 +1177,8 @@ bool AppInit2()
     LogPrintf("\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n");
     LogPrintf("VALUTO version %s (%s)\n", FormatFullVersion(), CLIENT_DATE);
     LogPrintf("Using OpenSSL version %s\n", SSLeay_version(SSLEAY_VERSION));
+    LogPrintf("Using the '%s' SHA256 implementation\n", strSHA256Impl);
+    LogPrintf("Using the '%s' Keccak header implementation\n", strKeccakImpl);
 #ifdef ENABLE_WALLET
     LogPrintf("Using BerkeleyDB version %s\n", DbEnv::version(0, 0, 0));
 #endif
@@ -990,59 +1226,61 @@ bool AppInit2()
         nWalletBackups = std::max(0, std::min(10, nWalletBackups));
         if (nWalletBackups > 0) {
             if (filesystem::exists(backupDir)) {
-                // Create backup of the wallet
-                std::string dateTimeStr = DateTimeStrFormat(".%Y-%m-%d-%H-%M", GetTime());
-                std::string backupPathStr = backupDir.string();
-                backupPathStr += "/" + strWalletFile;
-                std::string sourcePathStr = GetDataDir().string();
-                sourcePathStr += "/" + strWalletFile;
-                boost::filesystem::path sourceFile = sourcePathStr;
-                boost::filesystem::path backupFile = backupPathStr + dateTimeStr;
-                sourceFile.make_preferred();
-                backupFile.make_preferred();
-                if (boost::filesystem::exists(sourceFile)) {
-#if BOOST_VERSION >= 158000
-                    try {
-                        boost::filesystem::copy_file(sourceFile, backupFile);
-                        LogPrintf("Creating backup of %s -> %s\n", sourceFile, backupFile);
-                    } catch (boost::filesystem::filesystem_error& error) {
-                        LogPrintf("Failed to create backup %s\n", error.what());
+                // Create backup of each wallet
+                BOOST_FOREACH (const std::string& strWalletFile, vWalletFiles) {
+                    std::string dateTimeStr = DateTimeStrFormat(".%Y-%m-%d-%H-%M", GetTime());
+                    std::string backupPathStr = backupDir.string();
+                    backupPathStr += "/" + strWalletFile;
+                    std::string sourcePathStr = GetDataDir().string();
+                    sourcePathStr += "/" + strWalletFile;
+                    boost::filesystem::path sourceFile = sourcePathStr;
+                    boost::filesystem::path backupFile = backupPathStr + dateTimeStr;
+                    sourceFile.make_preferred();
+                    backupFile.make_preferred();
+                    if (boost::filesystem::exists(sourceFile)) {
+    #if BOOST_VERSION >= 158000
+                        try {
+                            boost::filesystem::copy_file(sourceFile, backupFile);
+                            LogPrintf("Creating backup of %s -> %s\n", sourceFile, backupFile);
+                        } catch (boost::filesystem::filesystem_error& error) {
+                            LogPrintf("Failed to create backup %s\n", error.what());
+                        }
+    #else
+                        std::ifstream src(sourceFile.string(), std::ios::binary);
+                        std::ofstream dst(backupFile.string(), std::ios::binary);
+                        dst << src.rdbuf();
+    #endif
                     }
-#else
-                    std::ifstream src(sourceFile.string(), std::ios::binary);
-                    std::ofstream dst(backupFile.string(), std::ios::binary);
-                    dst << src.rdbuf();
-#endif
-                }
-                // Keep only the last 10 backups, including the new one of course
-                typedef std::multimap<std::time_t, boost::filesystem::path> folder_set_t;
-                folder_set_t folder_set;
-                boost::filesystem::directory_iterator end_iter;
-                boost::filesystem::path backupFolder = backupDir.string();
-                backupFolder.make_preferred();
-                // Build map of backup files for current(!) wallet sorted by last write time
-                boost::filesystem::path currentFile;
-                for (boost::filesystem::directory_iterator dir_iter(backupFolder); dir_iter != end_iter; ++dir_iter) {
-                    // Only check regular files
-                    if (boost::filesystem::is_regular_file(dir_iter->status())) {
-                        currentFile = dir_iter->path().filename();
-                        // Only add the backups for the current wallet, e.g. wallet.dat.*
-                        if (dir_iter->path().stem().string() == strWalletFile) {
-                            folder_set.insert(folder_set_t::value_type(boost::filesystem::last_write_time(dir_iter->path()), *dir_iter));
+                    // Keep only the last 10 backups, including the new one of course
+                    typedef std::multimap<std::time_t, boost::filesystem::path> folder_set_t;
+                    folder_set_t folder_set;
+                    boost::filesystem::directory_iterator end_iter;
+                    boost::filesystem::path backupFolder = backupDir.string();
+                    backupFolder.make_preferred();
+                    // Build map of backup files for current(!) wallet sorted by last write time
+                    boost::filesystem::path currentFile;
+                    for (boost::filesystem::directory_iterator dir_iter(backupFolder); dir_iter != end_iter; ++dir_iter) {
+                        // Only check regular files
+                        if (boost::filesystem::is_regular_file(dir_iter->status())) {
+                            currentFile = dir_iter->path().filename();
+                            // Only add the backups for the current wallet, e.g. wallet.dat.*
+                            if (dir_iter->path().stem().string() == strWalletFile) {
+                                folder_set.insert(folder_set_t::value_type(boost::filesystem::last_write_time(dir_iter->path()), *dir_iter));
+                            }
                         }
                     }
-                }
-                // Loop backward through backup files and keep the N newest ones (1 <= N <= 10)
-                int counter = 0;
-                BOOST_REVERSE_FOREACH (PAIRTYPE(const std::time_t, boost::filesystem::path) file, folder_set) {
-                    counter++;
-                    if (counter > nWalletBackups) {
-                        // More than nWalletBackups backups: delete oldest one(s)
-                        try {
-                            boost::filesystem::remove(file.second);
-                            LogPrintf("Old backup deleted: %s\n", file.second);
-                        } catch (boost::filesystem::filesystem_error& error) {
-                            LogPrintf("Failed to delete backup %s\n", error.what());
+                    // Loop backward through backup files and keep the N newest ones (1 <= N <= 10)
+                    int counter = 0;
+                    BOOST_REVERSE_FOREACH (PAIRTYPE(const std::time_t, boost::filesystem::path) file, folder_set) {
+                        counter++;
+                        if (counter > nWalletBackups) {
+                            // More than nWalletBackups backups: delete oldest one(s)
+                            try {
+                                boost::filesystem::remove(file.second);
+                                LogPrintf("Old backup deleted: %s\n", file.second);
+                            } catch (boost::filesystem::filesystem_error& error) {
+                                LogPrintf("Failed to delete backup %s\n", error.what());
+                            }
                         }
                     }
                 }
@@ -1080,7 +1318,8 @@ bool AppInit2()
             }
         }
 
-        LogPrintf("Using wallet %s\n", strWalletFile);
+        BOOST_FOREACH (const std::string& strWalletFile, vWalletFiles)
+            LogPrintf("Using wallet %s\n", strWalletFile);
         uiInterface.InitMessage(_("Verifying wallet..."));
 
         if (!bitdb.Open(GetDataDir())) {
@@ -1102,24 +1341,26 @@ bool AppInit2()
             }
         }
 
-        if (GetBoolArg("-salvagewallet", false)) {
-            // Recover readable keypairs:
-            if (!CWalletDB::Recover(bitdb, strWalletFile, true))
-                return false;
-        }
+        BOOST_FOREACH (const std::string& strWalletFile, vWalletFiles) {
+            if (GetBoolArg("-salvagewallet", false)) {
+                // Recover readable keypairs:
+                if (!CWalletDB::Recover(bitdb, strWalletFile, true))
+                    return false;
+            }
 
-        if (filesystem::exists(GetDataDir() / strWalletFile)) {
-            CDBEnv::VerifyResult r = bitdb.Verify(strWalletFile, CWalletDB::Recover);
-            if (r == CDBEnv::RECOVER_OK) {
-                string msg = strprintf(_("Warning: wallet.dat corrupt, data salvaged!"
-                                         " Original wallet.dat saved as wallet.{timestamp}.bak in %s; if"
-                                         " your balance or transactions are incorrect you should"
-                                         " restore from a backup."),
-                    strDataDir);
-                InitWarning(msg);
+            if (filesystem::exists(GetDataDir() / strWalletFile)) {
+                CDBEnv::VerifyResult r = bitdb.Verify(strWalletFile, CWalletDB::Recover);
+                if (r == CDBEnv::RECOVER_OK) {
+                    string msg = strprintf(_("Warning: %s corrupt, data salvaged!"
+                                             " Original %s saved as %s.{timestamp}.bak in %s; if"
+                                             " your balance or transactions are incorrect you should"
+                                             " restore from a backup."),
+                        strWalletFile, strWalletFile, strWalletFile, strDataDir);
+                    InitWarning(msg);
+                }
+                if (r == CDBEnv::RECOVER_FAIL)
+                    return InitError(strprintf(_("%s corrupt, salvage failed"), strWalletFile));
             }
-            if (r == CDBEnv::RECOVER_FAIL)
-                return InitError(_("wallet.dat corrupt, salvage failed"));
         }
 
     }  // (!fDisableWallet)
@@ -1322,16 +1563,29 @@ bool AppInit2()
                 delete pcoinscatcher;
                 delete pblocktree;
                 delete pSporkDB;
+                delete pTxPosIndex;
+                pTxPosIndex = NULL;
+                delete pblockfilemap;
+                pblockfilemap = NULL;
 
                 pSporkDB = new CSporkDB(0, false, false);
                 pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex);
                 pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex);
                 pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
                 pcoinsTip = new CCoinsViewCache(pcoinscatcher);
+                if (GetArg("-blockfilemaps", DEFAULT_BLOCKFILE_MAPS) > 0)
+                    pblockfilemap = new CBlockFileMap(GetArg("-blockfilemaps", DEFAULT_BLOCKFILE_MAPS));
 
                 if (fReindex)
                     pblocktree->WriteReindexing(true);
 
+                // A new node may start from a UTXO snapshot instead of the genesis block
+                if (!fReindex && mapArgs.count("-loadsnapshot")) {
+                    uiInterface.InitMessage(_("Loading UTXO snapshot..."));
+                    if (!LoadUTXOSnapshot(GetArg("-loadsnapshot", ""), strLoadError))
+                        break;
+                }
+
                 // MERGE: load previous sessions sporks if we have them.
                 uiInterface.InitMessage(_("Loading sporks..."));
                 LoadSporksFromDB();
@@ -1343,6 +1597,7 @@ bool AppInit2()
                     strLoadError = strprintf("%s : %s", strLoadError, strBlockIndexError);
                     break;
                 }
+                LoadUTXOStats();
 
                 // If the loaded chain has a wrong genesis, bail out immediately
                 // (we're likely using a testnet datadir, or the other way around).
@@ -1361,6 +1616,30 @@ bool AppInit2()
                     break;
                 }
 
+                // Check for changed -prune state.  What we are concerned about is a user who has pruned blocks
+                // in the past, but is now trying to run unpruned.
+                if (fHavePruned && !fPruneMode) {
+                    strLoadError = _("You need to rebuild the database using -reindex to go back to unpruned mode.  This will redownload the entire blockchain");
+                    break;
+                }
+
+                // The address indexes are built in the background as well; a changed setting only wipes them
+                fAddressIndex = GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
+                fSpentIndex = GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
+                if (!InitAddressIndexes()) {
+                    strLoadError = _("Error initializing address indexes");
+                    break;
+                }
+
+                // The tx position index is built in the background, so it can be turned on at any time
+                if (GetBoolArg("-txposindex", DEFAULT_TXPOSINDEX)) {
+                    pTxPosIndex = new CTxPosIndex(GetDataDir() / "blocks" / "txpos.dat", GetArg("-txposcache", DEFAULT_TXPOSCACHE));
+                    if (!pTxPosIndex->Open(fReindex)) {
+                        strLoadError = _("Error opening transaction position index");
+                        break;
+                    }
+                }
+
                 if (!fReindex) {
                     uiInterface.InitMessage(_("Verifying blocks..."));
 
@@ -1432,125 +1711,33 @@ bool AppInit2()
         pwalletMain = NULL;
         LogPrintf("Wallet disabled!\n");
     } else {
-        // needed to restore wallet transaction meta data after -zapwallettxes
-        std::vector<CWalletTx> vWtx;
-
-        if (GetBoolArg("-zapwallettxes", false)) {
-            uiInterface.InitMessage(_("Zapping all transactions from wallet..."));
-
-            pwalletMain = new CWallet(strWalletFile);
-            DBErrors nZapWalletRet = pwalletMain->ZapWalletTx(vWtx);
-            if (nZapWalletRet != DB_LOAD_OK) {
-                uiInterface.InitMessage(_("Error loading wallet.dat: Wallet corrupted"));
-                return false;
-            }
-
-            delete pwalletMain;
-            pwalletMain = NULL;
-        }
-
         uiInterface.InitMessage(_("Loading wallet..."));
         fVerifyingBlocks = true;
 
-        nStart = GetTimeMillis();
-        bool fFirstRun = true;
-        pwalletMain = new CWallet(strWalletFile);
-        DBErrors nLoadWalletRet = pwalletMain->LoadWallet(fFirstRun);
-        if (nLoadWalletRet != DB_LOAD_OK) {
-            if (nLoadWalletRet == DB_CORRUPT)
-                strErrors << _("Error loading wallet.dat: Wallet corrupted") << "\n";
-            else if (nLoadWalletRet == DB_NONCRITICAL_ERROR) {
-                string msg(_("Warning: error reading wallet.dat! All keys read correctly, but transaction data"
-                             " or address book entries might be missing or incorrect."));
-                InitWarning(msg);
-            } else if (nLoadWalletRet == DB_TOO_NEW)
-                strErrors << _("Error loading wallet.dat: Wallet requires newer version of VALUTO Core") << "\n";
-            else if (nLoadWalletRet == DB_NEED_REWRITE) {
-                strErrors << _("Wallet needed to be rewritten: restart VALUTO Core to complete") << "\n";
-                LogPrintf("%s", strErrors.str());
-                return InitError(strErrors.str());
-            } else
-                strErrors << _("Error loading wallet.dat") << "\n";
-        }
-
-        if (GetBoolArg("-upgradewallet", fFirstRun)) {
-            int nMaxVersion = GetArg("-upgradewallet", 0);
-            if (nMaxVersion == 0) // the -upgradewallet without argument case
-            {
-                LogPrintf("Performing wallet upgrade to %i\n", FEATURE_LATEST);
-                nMaxVersion = CLIENT_VERSION;
-                pwalletMain->SetMinVersion(FEATURE_LATEST); // permanently upgrade the wallet immediately
-            } else
-                LogPrintf("Allowing wallet upgrade up to %i\n", nMaxVersion);
-            if (nMaxVersion < pwalletMain->GetVersion())
-                strErrors << _("Cannot downgrade wallet") << "\n";
-            pwalletMain->SetMaxVersion(nMaxVersion);
-        }
-
-        if (fFirstRun) {
-            // Create new keyUser and set as default key
-            RandAddSeedPerfmon();
-
-            CPubKey newDefaultKey;
-            if (pwalletMain->GetKeyFromPool(newDefaultKey)) {
-                pwalletMain->SetDefaultKey(newDefaultKey);
-                if (!pwalletMain->SetAddressBook(pwalletMain->vchDefaultKey.GetID(), "", "receive"))
-                    strErrors << _("Cannot write default address") << "\n";
-            }
-
-            pwalletMain->SetBestChain(chainActive.GetLocator());
-        }
-
-        LogPrintf("%s", strErrors.str());
-        LogPrintf(" wallet      %15dms\n", GetTimeMillis() - nStart);
-
-        RegisterValidationInterface(pwalletMain);
-
-        CBlockIndex* pindexRescan = chainActive.Tip();
-        if (GetBoolArg("-rescan", false))
-            pindexRescan = chainActive.Genesis();
-        else {
-            CWalletDB walletdb(strWalletFile);
-            CBlockLocator locator;
-            if (walletdb.ReadBestBlock(locator))
-                pindexRescan = FindForkInGlobalIndex(chainActive, locator);
-            else
-                pindexRescan = chainActive.Genesis();
-        }
-        if (chainActive.Tip() && chainActive.Tip() != pindexRescan) {
-            uiInterface.InitMessage(_("Rescanning..."));
-            LogPrintf("Rescanning last %i blocks (from block %i)...\n", chainActive.Height() - pindexRescan->nHeight, pindexRescan->nHeight);
-            nStart = GetTimeMillis();
-            pwalletMain->ScanForWalletTransactions(pindexRescan, true);
-            LogPrintf(" rescan      %15dms\n", GetTimeMillis() - nStart);
-            pwalletMain->SetBestChain(chainActive.GetLocator());
-            nWalletDBUpdated++;
-
-            // Restore wallet transaction metadata after -zapwallettxes=1
-            if (GetBoolArg("-zapwallettxes", false) && GetArg("-zapwallettxes", "1") != "2") {
-                for (const CWalletTx& wtxOld : vWtx) {
-                    uint256 hash = wtxOld.GetHash();
-                    std::map<uint256, CWalletTx>::iterator mi = pwalletMain->mapWallet.find(hash);
-                    if (mi != pwalletMain->mapWallet.end()) {
-                        const CWalletTx* copyFrom = &wtxOld;
-                        CWalletTx* copyTo = &mi->second;
-                        copyTo->mapValue = copyFrom->mapValue;
-                        copyTo->vOrderForm = copyFrom->vOrderForm;
-                        copyTo->nTimeReceived = copyFrom->nTimeReceived;
-                        copyTo->nTimeSmart = copyFrom->nTimeSmart;
-                        copyTo->fFromMe = copyFrom->fFromMe;
-                        copyTo->strFromAccount = copyFrom->strFromAccount;
-                        copyTo->nOrderPos = copyFrom->nOrderPos;
-                        copyTo->WriteToDisk();
-                    }
-                }
-            }
+        BOOST_FOREACH (const std::string& strWalletFile, vWalletFiles) {
+            CWallet* pwallet = LoadWalletFromFile(strWalletFile, strErrors);
+            if (!pwallet)
+                return false;
+            vpwallets.push_back(pwallet);
         }
+        pwalletMain = vpwallets.front();
         fVerifyingBlocks = false;
     }  // (!fDisableWallet)
 #else  // ENABLE_WALLET
     LogPrintf("No wallet compiled in!\n");
 #endif // !ENABLE_WALLET
+
+    // if pruning, unset the service bit and perform the initial blockstore prune
+    // after any wallet rescanning has taken place.
+    if (fPruneMode) {
+        LogPrintf("Unsetting NODE_NETWORK on prune mode\n");
+        nLocalServices &= ~NODE_NETWORK;
+        if (!fReindex) {
+            uiInterface.InitMessage(_("Pruning blockstore..."));
+            PruneAndFlush();
+        }
+    }
+
     // ********************************************************* Step 9: import blocks
 
     if (mapArgs.count("-blocknotify"))
@@ -1567,6 +1754,12 @@ bool AppInit2()
             vImportFiles.push_back(strFile);
     }
     threadGroup.create_thread(boost::bind(&ThreadImport, vImportFiles));
+    if (pTxPosIndex)
+        threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "txposidx", &ThreadTxPosIndexBuild));
+    if (fAddressIndex || fSpentIndex)
+        threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "addridx", &ThreadAddressIndexBuild));
+    if (IsSnapshotValidationPending())
+        threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "snapshot", &ThreadSnapshotValidation));
     if (chainActive.Tip() == NULL) {
         LogPrintf("Waiting for genesis block to be imported...\n");
         while (!fRequestShutdown && chainActive.Tip() == NULL)
@@ -1731,12 +1924,16 @@ bool AppInit2()
     uiInterface.InitMessage(_("Done loading"));
 
 #ifdef ENABLE_WALLET
-    if (pwalletMain) {
+    if (!vpwallets.empty()) {
         // Add wallet transactions that aren't already in a block to mapTransactions
-        pwalletMain->ReacceptWalletTransactions();
+        BOOST_FOREACH (CWallet* pwallet, vpwallets)
+            pwallet->ReacceptWalletTransactions();
+
+        // Run a thread to flush the wallets periodically
+        threadGroup.create_thread(boost::bind(&ThreadFlushWalletDB, vWalletFiles));
 
-        // Run a thread to flush wallet periodically
-        threadGroup.create_thread(boost::bind(&ThreadFlushWalletDB, boost::ref(pwalletMain->strWalletFile)));
+        // Run a thread to keep the key pools filled
+        threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "keypool", &ThreadTopUpKeyPools));
     }
 #endif
 
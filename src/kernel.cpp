@@ -368,7 +368,7 @@ bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTra
 }
 
 // Check kernel hash target and coinstake signature
-bool CheckProofOfStake(const CBlock block, uint256& hashProofOfStake)
+bool CheckProofOfStake(const CBlock block, uint256& hashProofOfStake, const CCoinsViewCache* pview)
 {
     const CTransaction tx = block.vtx[1];
     if (!tx.IsCoinStake())
@@ -380,8 +380,29 @@ bool CheckProofOfStake(const CBlock block, uint256& hashProofOfStake)
     // First try finding the previous transaction in database
     uint256 hashBlock;
     CTransaction txPrev;
-    if (!GetTransaction(txin.prevout.hash, txPrev, hashBlock, true))
-        return error("CheckProofOfStake() : INFO: read txPrev failed");
+    if (pview) {
+        // Validating against another chainstate: only its outputs count
+        const CCoins* coins = pview->AccessCoins(txin.prevout.hash);
+        if (!coins || !coins->IsAvailable(txin.prevout.n) || !chainActive[coins->nHeight])
+            return error("CheckProofOfStake() : INFO: read txPrev failed");
+        hashBlock = chainActive[coins->nHeight]->GetBlockHash();
+        CMutableTransaction txPrevOutputs;
+        txPrevOutputs.vout.resize(txin.prevout.n + 1);
+        txPrevOutputs.vout[txin.prevout.n] = coins->vout[txin.prevout.n];
+        txPrev = CTransaction(txPrevOutputs);
+    } else if (!GetTransaction(txin.prevout.hash, txPrev, hashBlock, true)) {
+        // On a pruned node the transaction may be gone with its block file, but the
+        // kernel only needs the staked output. That is still in the UTXO set, or, for
+        // a fork block staking an output the active chain spent, in the spent outputs
+        // kept for the reorganization window.
+        CTxOut txoutPrev;
+        if (!fHavePruned || !(GetUnspentOutput(txin.prevout, txoutPrev, hashBlock) || GetRecentlySpentOutput(txin.prevout, txoutPrev, hashBlock)))
+            return error("CheckProofOfStake() : INFO: read txPrev failed");
+        CMutableTransaction txPrevOutputs;
+        txPrevOutputs.vout.resize(txin.prevout.n + 1);
+        txPrevOutputs.vout[txin.prevout.n] = txoutPrev;
+        txPrev = CTransaction(txPrevOutputs);
+    }
 
     //verify signature and script
     if (!VerifyScript(txin.scriptSig, txPrev.vout[txin.prevout.n].scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, TransactionSignatureChecker(&tx, 0)))
@@ -394,9 +415,11 @@ bool CheckProofOfStake(const CBlock block, uint256& hashProofOfStake)
     else
         return error("CheckProofOfStake() : read block failed");
 
-    // Read block header
+    // Read block header; the kernel uses no more than the header, which outlives pruning
     CBlock blockprev;
-    if (!ReadBlockFromDisk(blockprev, pindex->GetBlockPos()))
+    if (!(pindex->nStatus & BLOCK_HAVE_DATA))
+        blockprev = CBlock(pindex->GetBlockHeader());
+    else if (!ReadBlockFromDisk(blockprev, pindex->GetBlockPos()))
         return error("CheckProofOfStake(): INFO: failed to find block");
 
     unsigned int nInterval = 0;
@@ -421,8 +444,8 @@ unsigned int GetStakeModifierChecksum(const CBlockIndex* pindex)
     // Hash previous checksum with flags, hashProofOfStake and nStakeModifier
     CDataStream ss(SER_GETHASH, 0);
     if (pindex->pprev)
-        ss << pindex->pprev->nStakeModifierChecksum;
-    ss << pindex->nFlags << pindex->hashProofOfStake << pindex->nStakeModifier;
+        ss << GetBlockIndexExtra(pindex->pprev).nStakeModifierChecksum;
+    ss << pindex->nFlags << GetBlockIndexExtra(pindex).hashProofOfStake << pindex->nStakeModifier;
     uint256 hashChecksum = Hash(ss.begin(), ss.end());
     hashChecksum >>= (256 - 32);
     return hashChecksum.Get64();
@@ -59,6 +59,17 @@ public:
 
         batch.Delete(slKey);
     }
+
+    //! erase a key that is already serialized, as returned by an iterator
+    void EraseRaw(const leveldb::Slice& slKey)
+    {
+        batch.Delete(slKey);
+    }
+
+    void Clear()
+    {
+        batch.Clear();
+    }
 };
 
 class CLevelDBWrapper
@@ -8,8 +8,11 @@
 
 #include "main.h"
 
+#include "addressindex.h"
 #include "addrman.h"
 #include "alert.h"
+#include "blockfilemap.h"
+#include "blockimport.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
@@ -26,9 +29,12 @@
 #include "swifttx.h"
 #include "txdb.h"
 #include "txmempool.h"
+#include "txposindex.h"
 #include "ui_interface.h"
 #include "util.h"
 #include "utilmoneystr.h"
+#include "utxosnapshot.h"
+#include "utxostats.h"
 #include "validationinterface.h"
 
 #include <sstream>
@@ -39,6 +45,7 @@
 #include <boost/thread.hpp>
 #include <boost/foreach.hpp>
 #include <atomic>
+#include <memory>
 #include <queue>
 
 using namespace boost;
@@ -62,7 +69,15 @@ CCriticalSection cs_mapstake;
 BlockMap mapBlockIndex;
 map<uint256, uint256> mapProofOfStake;
 set<pair<COutPoint, unsigned int> > setStakeSeen;
-map<COutPoint, int> mapStakeSpent;
+/** An output spent in the last MaxReorganizationDepth blocks, kept to check fork blocks that stake it */
+struct CStakeSpent {
+    int nHeight;     //! height of the block that spent it
+    int nHeightFrom; //! height of the block that created it
+    CTxOut txout;
+
+    CStakeSpent(int nHeightIn, int nHeightFromIn, const CTxOut& txoutIn) : nHeight(nHeightIn), nHeightFrom(nHeightFromIn), txout(txoutIn) {}
+};
+map<COutPoint, CStakeSpent> mapStakeSpent;
 map<unsigned int, unsigned int> mapHashedBlocks;
 CChain chainActive;
 CBlockIndex* pindexBestHeader = NULL;
@@ -73,8 +88,15 @@ int nScriptCheckThreads = 0;
 bool fImporting = false;
 bool fReindex = false;
 bool fTxIndex = true;
+bool fAddressIndex = DEFAULT_ADDRESSINDEX;
+bool fSpentIndex = DEFAULT_SPENTINDEX;
+bool fAddressIndexSynced = false;
+bool fHavePruned = false;
+bool fPruneMode = false;
+uint64_t nPruneTarget = 0;
 bool fIsBareMultisigStd = true;
 bool fCheckBlockIndex = false;
+bool fSignatureBatch = DEFAULT_SIGNATURE_BATCH;
 bool fVerifyingBlocks = false;
 unsigned int nCoinCacheSize = 5000;
 bool fAlerts = DEFAULT_ALERTS;
@@ -186,6 +208,9 @@ set<CBlockIndex*> setDirtyBlockIndex;
 
 /** Dirty block file entries. */
 set<int> setDirtyFileInfo;
+
+/** Global flag to indicate we should check to see if there are block/undo files that should be deleted. Set on startup or if we allocate more file space when we're in prune mode */
+bool fCheckForPruning = false;
 } // anon namespace
 
 //////////////////////////////////////////////////////////////////////////////
@@ -535,7 +560,7 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
                 // We consider the chain that this peer is on invalid.
                 return;
             }
-            if (pindex->nStatus & BLOCK_HAVE_DATA) {
+            if (pindex->nStatus & BLOCK_HAVE_DATA || chainActive.Contains(pindex)) {
                 if (pindex->nChainTx)
                     state->pindexLastCommonBlock = pindex;
             } else if (mapBlocksInFlight.count(pindex->GetBlockHash()) == 0) {
@@ -1222,7 +1247,8 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
 
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
-        if (!CheckInputs(tx, state, view, true, STANDARD_SCRIPT_VERIFY_FLAGS, true)) {
+        PrecomputedTransactionData txdata(tx);
+        if (!CheckInputs(tx, state, view, true, STANDARD_SCRIPT_VERIFY_FLAGS, true, NULL, &txdata)) {
             return error("AcceptToMemoryPool: : ConnectInputs failed %s", hash.ToString());
         }
 
@@ -1235,7 +1261,7 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
         // There is a similar check in CreateNewBlock() to prevent creating
         // invalid blocks, however allowing such transactions into the mempool
         // can be exploited as a DoS attack.
-        if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true)) {
+        if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true, NULL, &txdata)) {
             return error("AcceptToMemoryPool: : BUG! PLEASE REPORT THIS! ConnectInputs failed against MANDATORY but not STANDARD flags %s", hash.ToString());
         }
 
@@ -1429,33 +1455,124 @@ bool GetOutput(const uint256& hash, unsigned int index, CValidationState& state,
     return true;
 }
 
+/** Read the transaction stored at postx, returning the hash of the block it is part of */
+static bool ReadTransactionFromDisk(const CDiskTxPos& postx, CTransaction& txOut, uint256& hashBlock)
+{
+    CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+        return error("%s: OpenBlockFile failed", __func__);
+    CBlockHeader header;
+    try {
+        file >> header;
+        fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
+        file >> txOut;
+    } catch (std::exception& e) {
+        return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+    }
+    hashBlock = header.GetHash();
+    return true;
+}
+
+bool GetAddressIndex(const uint160& addressHash, int type, std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex, int start, int end)
+{
+    if (!fAddressIndex)
+        return error("%s : address index not enabled", __func__);
+    if (!pblocktree->ReadAddressIndex(addressHash, type, addressIndex, start, end))
+        return error("%s : unable to get txids for address", __func__);
+    return true;
+}
+
+bool GetAddressUnspent(const uint160& addressHash, int type, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& unspentOutputs)
+{
+    if (!fAddressIndex)
+        return error("%s : address index not enabled", __func__);
+    if (!pblocktree->ReadAddressUnspentIndex(addressHash, type, unspentOutputs))
+        return error("%s : unable to get txids for address", __func__);
+    return true;
+}
+
+bool GetSpentIndex(const CSpentIndexKey& key, CSpentIndexValue& value)
+{
+    if (!fSpentIndex)
+        return false;
+
+    // outputs spent by the mempool are not indexed
+    if (!pblocktree->ReadSpentIndex(key, value))
+        return false;
+    return true;
+}
+
+bool GetUnspentOutput(const COutPoint& outpoint, CTxOut& txout, uint256& hashBlock)
+{
+    LOCK(cs_main);
+    const CCoins* coins = pcoinsTip->AccessCoins(outpoint.hash);
+    if (!coins || !coins->IsAvailable(outpoint.n))
+        return false;
+    CBlockIndex* pindex = chainActive[coins->nHeight];
+    if (!pindex)
+        return false;
+    txout = coins->vout[outpoint.n];
+    hashBlock = pindex->GetBlockHash();
+    return true;
+}
+
+bool GetRecentlySpentOutput(const COutPoint& outpoint, CTxOut& txout, uint256& hashBlock)
+{
+    LOCK2(cs_main, cs_mapstake);
+    map<COutPoint, CStakeSpent>::const_iterator it = mapStakeSpent.find(outpoint);
+    if (it == mapStakeSpent.end())
+        return false;
+    CBlockIndex* pindex = chainActive[it->second.nHeightFrom];
+    if (!pindex)
+        return false;
+    txout = it->second.txout;
+    hashBlock = pindex->GetBlockHash();
+    return true;
+}
+
 /** Return transaction in tx, and if it was found inside a block, its hash is placed in hashBlock */
 bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock, bool fAllowSlow, CBlockIndex* blockIndex)
 {
+    // cs_main is only held to find where the transaction is, the reads from disk are done
+    // without it, so that lookups go on next to each other and to validation
     CBlockIndex* pindexSlow = blockIndex;
 
-    LOCK(cs_main);
-
     if (!blockIndex) {
         if (mempool.lookup(hash, txOut)) {
             return true;
         }
 
+        if (pTxPosIndex) {
+            // The position index only stores a txid prefix, and keeps the positions in blocks
+            // that were disconnected since: only a candidate in the active chain is taken.
+            std::vector<CDiskTxPos> vPos;
+            if (pTxPosIndex->Lookup(hash, vPos)) {
+                for (const CDiskTxPos& postx : vPos) {
+                    CTransaction tx;
+                    uint256 hashBlockTx;
+                    if (!ReadTransactionFromDisk(postx, tx, hashBlockTx) || tx.GetHash() != hash)
+                        continue;
+                    bool fActive;
+                    {
+                        LOCK(cs_main);
+                        BlockMap::iterator mi = mapBlockIndex.find(hashBlockTx);
+                        fActive = mi != mapBlockIndex.end() && chainActive.Contains(mi->second);
+                    }
+                    if (fActive) {
+                        txOut = tx;
+                        hashBlock = hashBlockTx;
+                        pTxPosIndex->CacheVerified(hash, postx);
+                        return true;
+                    }
+                }
+            }
+        }
+
         if (fTxIndex) {
             CDiskTxPos postx;
             if (pblocktree->ReadTxIndex(hash, postx)) {
-                CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-                if (file.IsNull())
-                    return error("%s: OpenBlockFile failed", __func__);
-                CBlockHeader header;
-                try {
-                    file >> header;
-                    fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                    file >> txOut;
-                } catch (std::exception& e) {
-                    return error("%s : Deserialize or I/O error - %s", __func__, e.what());
-                }
-                hashBlock = header.GetHash();
+                if (!ReadTransactionFromDisk(postx, txOut, hashBlock))
+                    return false;
                 if (txOut.GetHash() != hash)
                     return error("%s : txid mismatch", __func__);
                 return true;
@@ -1466,25 +1583,29 @@ bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock
         }
 
         if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
-            int nHeight = -1;
-            {
-                CCoinsViewCache& view = *pcoinsTip;
-                const CCoins* coins = view.AccessCoins(hash);
-                if (coins)
-                    nHeight = coins->nHeight;
-            }
-            if (nHeight > 0)
-                pindexSlow = chainActive[nHeight];
+            LOCK(cs_main);
+            const CCoins* coins = pcoinsTip->AccessCoins(hash);
+            if (coins && coins->nHeight > 0)
+                pindexSlow = chainActive[coins->nHeight];
         }
     }
 
     if (pindexSlow) {
+        CDiskBlockPos pos;
+        uint256 hashBlockSlow;
+        {
+            LOCK(cs_main);
+            if (fHavePruned && !(pindexSlow->nStatus & BLOCK_HAVE_DATA))
+                return false;
+            pos = pindexSlow->GetBlockPos();
+            hashBlockSlow = pindexSlow->GetBlockHash();
+        }
         CBlock block;
-        if (ReadBlockFromDisk(block, pindexSlow)) {
+        if (ReadBlockFromDisk(block, pos) && block.GetHash() == hashBlockSlow) {
             for (const CTransaction& tx : block.vtx) {
                 if (tx.GetHash() == hash) {
                     txOut = tx;
-                    hashBlock = pindexSlow->GetBlockHash();
+                    hashBlock = hashBlockSlow;
                     return true;
                 }
             }
@@ -1525,16 +1646,31 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk : OpenBlockFile failed");
+    // Serve the block from a mapped file if possible
+    bool fMapped = false;
+    if (pblockfilemap) {
+        bool fFinalized;
+        {
+            LOCK(cs_LastBlockFile);
+            fFinalized = pos.nFile < nLastBlockFile;
+        }
+        fMapped = pblockfilemap->ReadBlock(block, pos, fFinalized);
+    }
 
-    // Read block
-    try {
-        filein >> block;
-    } catch (std::exception& e) {
-        return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+    if (!fMapped) {
+        block.SetNull();
+
+        // Open history file to read
+        CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("ReadBlockFromDisk : OpenBlockFile failed");
+
+        // Read block
+        try {
+            filein >> block;
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
     }
 
     // Check the header
@@ -1548,6 +1684,8 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
 
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex)
 {
+    if (fHavePruned && !(pindex->nStatus & BLOCK_HAVE_DATA))
+        return error("ReadBlockFromDisk(CBlock&, CBlockIndex*) : block %s has been pruned", pindex->GetBlockHash().ToString());
     if (!ReadBlockFromDisk(block, pindex->GetBlockPos()))
         return false;
     if (block.GetHash() != pindex->GetBlockHash()) {
@@ -1776,13 +1914,55 @@ void UpdateCoins(const CTransaction& tx, CValidationState& state, CCoinsViewCach
 bool CScriptCheck::operator()()
 {
     const CScript& scriptSig = ptxTo->vin[nIn].scriptSig;
-    if (!VerifyScript(scriptSig, scriptPubKey, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, cacheStore), &error)) {
+    if (!VerifyScript(scriptSig, scriptPubKey, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, cacheStore, txdata), &error)) {
         return ::error("CScriptCheck(): %s:%d VerifySignature failed: %s", ptxTo->GetHash().ToString(), nIn, ScriptErrorString(error));
     }
     return true;
 }
 
-bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& inputs, bool fScriptChecks, unsigned int flags, bool cacheStore, std::vector<CScriptCheck>* pvChecks)
+bool CScriptCheck::operator()(CSignatureBatch* pbatch)
+{
+    // Only pay-to-pubkey(-hash) outputs spent by a push-only scriptSig are
+    // deferred: their single CHECKSIG is the last opcode, so the script
+    // passes exactly if it passes with the signature assumed valid and the
+    // signature then verifies.
+    const CScript& scriptSig = ptxTo->vin[nIn].scriptSig;
+    txnouttype whichType;
+    std::vector<std::vector<unsigned char> > vSolutions;
+    if (!scriptSig.IsPushOnly() || !Solver(scriptPubKey, whichType, vSolutions) ||
+        (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH))
+        return (*this)();
+
+    if (!VerifyScript(scriptSig, scriptPubKey, nFlags, BatchingTransactionSignatureChecker(ptxTo, nIn, *pbatch, cacheStore, txdata), &error)) {
+        return ::error("CScriptCheck(): %s:%d VerifySignature failed: %s", ptxTo->GetHash().ToString(), nIn, ScriptErrorString(error));
+    }
+    return true;
+}
+
+bool RunBatch(std::vector<CScriptCheck>& vChecks)
+{
+    if (!fSignatureBatch || vChecks.size() < 2) {
+        for (CScriptCheck& check : vChecks)
+            if (!check())
+                return false;
+        return true;
+    }
+
+    CSignatureBatch batch;
+    for (CScriptCheck& check : vChecks)
+        if (!check(&batch))
+            return false;
+    if (batch.Verify())
+        return true;
+
+    // Some signature is invalid; run the checks one by one to report which.
+    for (CScriptCheck& check : vChecks)
+        if (!check())
+            return false;
+    return true;
+}
+
+bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& inputs, bool fScriptChecks, unsigned int flags, bool cacheStore, std::vector<CScriptCheck>* pvChecks, const PrecomputedTransactionData* txdata)
 {
     if (!tx.IsCoinBase()) {
         if (pvChecks)
@@ -1842,13 +2022,20 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
         // before the last block chain checkpoint. This is safe because block merkle hashes are
         // still computed and checked, and any change will be caught at the next checkpoint.
         if (fScriptChecks) {
+            // Deferred checks can't refer to a cache that lives on this stack frame.
+            assert(txdata || !pvChecks);
+            std::unique_ptr<PrecomputedTransactionData> ptxdataLocal;
+            if (!txdata) {
+                ptxdataLocal.reset(new PrecomputedTransactionData(tx));
+                txdata = ptxdataLocal.get();
+            }
             for (unsigned int i = 0; i < tx.vin.size(); i++) {
                 const COutPoint& prevout = tx.vin[i].prevout;
                 const CCoins* coins = inputs.AccessCoins(prevout.hash);
                 assert(coins);
 
                 // Verify signature
-                CScriptCheck check(*coins, tx, i, flags, cacheStore);
+                CScriptCheck check(*coins, tx, i, flags, cacheStore, txdata);
                 if (pvChecks) {
                     pvChecks->push_back(CScriptCheck());
                     check.swap(pvChecks->back());
@@ -1861,7 +2048,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
                         // avoid splitting the network between upgraded and
                         // non-upgraded nodes.
                         CScriptCheck check(*coins, tx, i,
-                            flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore);
+                            flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore, txdata);
                         if (check())
                             return state.Invalid(false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(check.GetScriptError())));
                     }
@@ -1881,6 +2068,33 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
     return true;
 }
 
+bool ApplyTxInUndo(const CTxInUndo& undo, CCoinsViewCache& view, const COutPoint& out)
+{
+    bool fClean = true;
+
+    CCoinsModifier coins = view.ModifyCoins(out.hash);
+    if (undo.nHeight != 0) {
+        // undo data contains height: this is the last output of the prevout tx being spent
+        if (!coins->IsPruned())
+            fClean = fClean && error("%s : undo data overwriting existing transaction", __func__);
+        coins->Clear();
+        coins->fCoinBase = undo.fCoinBase;
+        coins->fCoinStake = undo.fCoinStake;
+        coins->nHeight = undo.nHeight;
+        coins->nVersion = undo.nVersion;
+    } else {
+        if (coins->IsPruned())
+            fClean = fClean && error("%s : undo data adding output to missing transaction", __func__);
+    }
+    if (coins->IsAvailable(out.n))
+        fClean = fClean && error("%s : undo data overwriting existing output", __func__);
+    if (coins->vout.size() < out.n + 1)
+        coins->vout.resize(out.n + 1);
+    coins->vout[out.n] = undo.txout;
+
+    return fClean;
+}
+
 bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean)
 {
     if (pindex->GetBlockHash() != view.GetBestBlock())
@@ -1902,6 +2116,12 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
     if (blockUndo.vtxundo.size() + 1 != block.vtx.size())
         return error("DisconnectBlock() : block and undo data inconsistent");
 
+    // Like the indexes, the UTXO set statistics are left alone when replaying for verification.
+    bool fUTXOStats = !pfClean && utxostatsTip.hashBlock == pindex->GetBlockHash();
+    CUTXOStats statsNew;
+    if (fUTXOStats)
+        statsNew = utxostatsTip;
+
     // undo transactions in reverse order
     for (int i = block.vtx.size() - 1; i >= 0; i--) {
         const CTransaction& tx = block.vtx[i];
@@ -1927,6 +2147,8 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
                 fClean = fClean && error("DisconnectBlock() : added transaction mismatch? database corrupted");
 
             // remove outputs
+            if (fUTXOStats)
+                statsNew.RemoveCoins(hash, *outs);
             outs->Clear();
         }
 
@@ -1938,28 +2160,16 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
             for (unsigned int j = tx.vin.size(); j-- > 0;) {
                 const COutPoint& out = tx.vin[j].prevout;
                 const CTxInUndo& undo = txundo.vprevout[j];
-                CCoinsModifier coins = view.ModifyCoins(out.hash);
-                if (undo.nHeight != 0) {
-                    // undo data contains height: this is the last output of the prevout tx being spent
-                    if (!coins->IsPruned())
-                        fClean = fClean && error("DisconnectBlock() : undo data overwriting existing transaction");
-                    coins->Clear();
-                    coins->fCoinBase = undo.fCoinBase;
-                    coins->nHeight = undo.nHeight;
-                    coins->nVersion = undo.nVersion;
-                } else {
-                    if (coins->IsPruned())
-                        fClean = fClean && error("DisconnectBlock() : undo data adding output to missing transaction");
+                if (!ApplyTxInUndo(undo, view, out))
+                    fClean = false;
+                if (fUTXOStats)
+                    statsNew.RestoreOutput(out, undo, *view.AccessCoins(out.hash));
+
+                // erase the spent input, unless this is only a rollback in a throwaway view
+                if (!pfClean) {
+                    LOCK(cs_mapstake);
+                    mapStakeSpent.erase(out);
                 }
-                if (coins->IsAvailable(out.n))
-                    fClean = fClean && error("DisconnectBlock() : undo data overwriting existing output");
-                if (coins->vout.size() < out.n + 1)
-                    coins->vout.resize(out.n + 1);
-                coins->vout[out.n] = undo.txout;
-
-                LOCK(cs_mapstake);
-                // erase the spent input
-                mapStakeSpent.erase(out);
             }
         }
     }
@@ -1967,6 +2177,19 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
     // move best block pointer to prevout block
     view.SetBestBlock(pindex->pprev->GetBlockHash());
 
+    if (fUTXOStats && fClean) {
+        statsNew.hashBlock = pindex->pprev->GetBlockHash();
+        utxostatsTip = statsNew;
+    }
+
+    // pfClean is only passed when replaying blocks for verification, which must leave the indexes alone
+    if ((fAddressIndex || fSpentIndex) && fAddressIndexSynced && fClean && !pfClean) {
+        CAddressIndexUpdate update;
+        DisconnectAddressIndexes(block, blockUndo, pindex->nHeight, &view, update);
+        if (!pblocktree->WriteAddressIndexUpdate(update, pindex->pprev->GetBlockHash()))
+            return state.Abort("Failed to write address indexes");
+    }
+
     if (pfClean) {
         *pfClean = fClean;
         return true;
@@ -2000,7 +2223,7 @@ void static FlushBlockFile(bool fFinalize = false)
 
 bool FindUndoPos(CValidationState& state, int nFile, CDiskBlockPos& pos, unsigned int nAddSize);
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+static CCheckQueue<CScriptCheck> scriptcheckqueue(128, MAX_SCRIPTCHECK_THREADS);
 
 void ThreadScriptCheck()
 {
@@ -2014,7 +2237,25 @@ static int64_t nTimeIndex = 0;
 static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
 
-bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool fJustCheck, bool fAlreadyChecked)
+/**
+ * Load the coins spent by block into pcoinsTip, so that connecting it
+ * later doesn't wait for the coins database.
+ */
+static void PrefetchInputs(const CBlock& block)
+{
+    // outputs of the block itself aren't in the database yet
+    std::set<uint256> setCreated;
+    for (const CTransaction& tx : block.vtx) {
+        setCreated.insert(tx.GetHash());
+        if (tx.IsCoinBase())
+            continue;
+        for (const CTxIn& txin : tx.vin)
+            if (!setCreated.count(txin.prevout.hash))
+                pcoinsTip->HaveCoins(txin.prevout.hash);
+    }
+}
+
+bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool fJustCheck, bool fAlreadyChecked, const CBlock* pblockNext)
 {
     AssertLockHeld(cs_main);
     // Check it again in case a previous version let a bad block in
@@ -2030,6 +2271,9 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     // Special case for the genesis block, skipping connection of its transactions
     // (its coinbase is unspendable)
     if (block.GetHash() == Params().HashGenesisBlock()) {
+        // a new chainstate: the UTXO set statistics are kept from here on
+        if (!fJustCheck && utxostatsTip.IsNull())
+            utxostatsTip.hashBlock = pindex->GetBlockHash();
         view.SetBestBlock(pindex->GetBlockHash());
         return true;
     }
@@ -2069,6 +2313,9 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     // DERSIG (BIP66) rules
     flags |= SCRIPT_VERIFY_DERSIG;
 
+    // The queued script checks refer to these, so they are destroyed after control.
+    std::vector<PrecomputedTransactionData> txdata;
+    txdata.reserve(block.vtx.size());
     CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : NULL);
 
     int64_t nTimeStart = GetTimeMicros();
@@ -2082,6 +2329,12 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
     CAmount nValueOut = 0;
     CAmount nValueIn = 0;
+    // The UTXO set statistics follow the tip, so they only change when connecting on top of it.
+    bool fUTXOStats = !fJustCheck && !utxostatsTip.IsNull() && utxostatsTip.hashBlock == hashPrevBlock;
+    CUTXOStats statsNew;
+    if (fUTXOStats)
+        statsNew = utxostatsTip;
+    std::vector<std::pair<COutPoint, CStakeSpent> > vStakeSpent;
     for (unsigned int i = 0; i < block.vtx.size(); i++) {
         const CTransaction& tx = block.vtx[i];
 
@@ -2110,9 +2363,21 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             nValueIn += view.GetValueIn(tx);
 
             std::vector<CScriptCheck> vChecks;
-            if (!CheckInputs(tx, state, view, fScriptChecks, flags, false, nScriptCheckThreads ? &vChecks : NULL))
+            const PrecomputedTransactionData* ptxdata = NULL;
+            if (fScriptChecks) {
+                txdata.emplace_back(tx);
+                ptxdata = &txdata.back();
+            }
+            if (!CheckInputs(tx, state, view, fScriptChecks, flags, false, nScriptCheckThreads ? &vChecks : NULL, ptxdata))
                 return false;
             control.Add(vChecks);
+
+            if (!fJustCheck) {
+                for (const CTxIn& in : tx.vin) {
+                    const CCoins* coins = view.AccessCoins(in.prevout.hash);
+                    vStakeSpent.push_back(std::make_pair(in.prevout, CStakeSpent(pindex->nHeight, coins->nHeight, coins->vout[in.prevout.n])));
+                }
+            }
         }
         nValueOut += tx.GetValueOut();
 
@@ -2120,6 +2385,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         if (i > 0) {
             blockundo.vtxundo.push_back(CTxUndo());
         }
+        if (fUTXOStats) {
+            if (!tx.IsCoinBase())
+                statsNew.SpendInputs(tx, view);
+            statsNew.AddCoins(tx.GetHash(), CCoins(tx, pindex->nHeight));
+        }
         UpdateCoins(tx, state, view, i == 0 ? undoDummy : blockundo.vtxundo.back(), pindex->nHeight);
 
         vPos.push_back(std::make_pair(tx.GetHash(), pos));
@@ -2127,11 +2397,16 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     }
 
     // ppcoin: track money supply and mint amount info
-    CAmount nMoneySupplyPrev = pindex->pprev ? pindex->pprev->nMoneySupply : 0;
-    pindex->nMoneySupply = nMoneySupplyPrev + nValueOut - nValueIn;
-    pindex->nMint = pindex->nMoneySupply - nMoneySupplyPrev + nFees;
-
-    if (!pblocktree->WriteBlockIndex(CDiskBlockIndex(pindex)))
+    // A block that is only checked (TestBlockValidity, VerifyDB) may have an index entry that isn't in
+    // mapBlockIndex; its extra fields are worked out in a local and neither cached nor written.
+    const bool fStoreExtra = !fJustCheck && pindex->phashBlock != NULL;
+    CBlockIndexExtra extraCheck;
+    CBlockIndexExtra& extra = fStoreExtra ? GetBlockIndexExtra(pindex) : extraCheck;
+    CAmount nMoneySupplyPrev = pindex->pprev ? GetBlockIndexExtra(pindex->pprev).nMoneySupply : 0;
+    extra.nMoneySupply = nMoneySupplyPrev + nValueOut - nValueIn;
+    extra.nMint = extra.nMoneySupply - nMoneySupplyPrev + nFees;
+
+    if (fStoreExtra && !pblocktree->WriteBlockIndex(CDiskBlockIndex(pindex, extra)))
         return error("Connect() : WriteBlockIndex for pindex failed");
 
     int64_t nTime1 = GetTimeMicros();
@@ -2144,13 +2419,20 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         nExpectedMint += nFees;
 
     //Check that the block does not overmint
-    if (!IsBlockValueValid(block, nExpectedMint, pindex->nMint)) {
+    if (!IsBlockValueValid(block, nExpectedMint, extra.nMint)) {
         return state.DoS(100,
             error("ConnectBlock() : reward pays too much (actual=%s vs limit=%s)",
-                FormatMoney(pindex->nMint), FormatMoney(nExpectedMint)),
+                FormatMoney(extra.nMint), FormatMoney(nExpectedMint)),
             REJECT_INVALID, "bad-cb-amount");
     }
 
+    // Overlap the input lookups of the next block with the script checks of this one.
+    if (pblockNext && fScriptChecks && nScriptCheckThreads) {
+        int64_t nTimePrefetch = GetTimeMicros();
+        PrefetchInputs(*pblockNext);
+        LogPrint("bench", "      - Prefetch inputs of next block: %.2fms\n", 0.001 * (GetTimeMicros() - nTimePrefetch));
+    }
+
     if (!control.Wait())
         return state.DoS(100, error("%s: CheckQueue failed", __func__), REJECT_INVALID, "block-validation-failed");
     int64_t nTime2 = GetTimeMicros();
@@ -2182,22 +2464,29 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         if (!pblocktree->WriteTxIndex(vPos))
             return state.Abort("Failed to write transaction index");
 
+    if (pTxPosIndex)
+        if (!pTxPosIndex->AddBlock(vPos, pindex))
+            return state.Abort("Failed to write transaction position index");
+
+    if ((fAddressIndex || fSpentIndex) && fAddressIndexSynced) {
+        CAddressIndexUpdate update;
+        ConnectAddressIndexes(block, blockundo, pindex->nHeight, update);
+        if (!pblocktree->WriteAddressIndexUpdate(update, pindex->GetBlockHash()))
+            return state.Abort("Failed to write address indexes");
+    }
+
     {
         LOCK(cs_mapstake);
         // add new entries
-        for (const CTransaction& tx : block.vtx) {
-            if (tx.IsCoinBase())
-                continue;
-            for (const CTxIn& in: tx.vin) {
-                if (fDebug) LogPrintf("mapStakeSpent: Insert %s | %u\n", in.prevout.ToString(), pindex->nHeight);
-                mapStakeSpent.insert(std::make_pair(in.prevout, pindex->nHeight));
-            }
+        for (const std::pair<COutPoint, CStakeSpent>& spent : vStakeSpent) {
+            if (fDebug) LogPrintf("mapStakeSpent: Insert %s | %u\n", spent.first.ToString(), pindex->nHeight);
+            mapStakeSpent.insert(spent);
         }
 
         // delete old entries
         for (auto it = mapStakeSpent.begin(); it != mapStakeSpent.end();) {
-            if (it->second < pindex->nHeight - Params().MaxReorganizationDepth()) {
-                if (fDebug) LogPrintf("mapStakeSpent: Erase %s | %u\n", it->first.ToString(), it->second);
+            if (it->second.nHeight < pindex->nHeight - Params().MaxReorganizationDepth()) {
+                if (fDebug) LogPrintf("mapStakeSpent: Erase %s | %u\n", it->first.ToString(), it->second.nHeight);
                 it = mapStakeSpent.erase(it);
             }
             else {
@@ -2208,6 +2497,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
 
+    if (fUTXOStats) {
+        statsNew.hashBlock = pindex->GetBlockHash();
+        utxostatsTip = statsNew;
+    }
+
     int64_t nTime3 = GetTimeMicros();
     nTimeIndex += nTime3 - nTime2;
     LogPrint("bench", "    - Index writing: %.2fms [%.2fs]\n", 0.001 * (nTime3 - nTime2), nTimeIndex * 0.000001);
@@ -2224,12 +2518,17 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     return true;
 }
 
+void static FindFilesToPrune(std::set<int>& setFilesToPrune);
+void static UnlinkPrunedFiles(std::set<int>& setFilesToPrune);
+
 enum FlushStateMode {
     FLUSH_STATE_IF_NEEDED,
     FLUSH_STATE_PERIODIC,
     FLUSH_STATE_ALWAYS
 };
 
+static void TrimBlockIndexExtra();
+
 /**
  * Update the on-disk chain state.
  * The caches and indexes are flushed if either they're too large, forceWrite is set, or
@@ -2237,10 +2536,23 @@ enum FlushStateMode {
  */
 bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
 {
-    LOCK(cs_main);
+    LOCK2(cs_main, cs_LastBlockFile);
     static int64_t nLastWrite = 0;
+    std::set<int> setFilesToPrune;
+    bool fFlushForPrune = false;
     try {
-        if ((mode == FLUSH_STATE_ALWAYS) ||
+        if (fPruneMode && fCheckForPruning && !fReindex) {
+            FindFilesToPrune(setFilesToPrune);
+            fCheckForPruning = false;
+            if (!setFilesToPrune.empty()) {
+                fFlushForPrune = true;
+                if (!fHavePruned) {
+                    pblocktree->WriteFlag("prunedblockfiles", true);
+                    fHavePruned = true;
+                }
+            }
+        }
+        if ((mode == FLUSH_STATE_ALWAYS) || fFlushForPrune ||
             ((mode == FLUSH_STATE_PERIODIC || mode == FLUSH_STATE_IF_NEEDED) && pcoinsTip->GetCacheSize() > nCoinCacheSize) ||
             (mode == FLUSH_STATE_PERIODIC && GetTimeMicros() > nLastWrite + DATABASE_WRITE_INTERVAL * 1000000)) {
             // Typical CCoins structures on disk are around 100 bytes in size.
@@ -2265,12 +2577,22 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
                 return state.Abort("Failed to write to block index");
             }
             for (set<CBlockIndex*>::iterator it = setDirtyBlockIndex.begin(); it != setDirtyBlockIndex.end();) {
-                if (!pblocktree->WriteBlockIndex(CDiskBlockIndex(*it))) {
+                if (!pblocktree->WriteBlockIndex(CDiskBlockIndex(*it, GetBlockIndexExtra(*it)))) {
                     return state.Abort("Failed to write to block index");
                 }
                 setDirtyBlockIndex.erase(it++);
             }
+            TrimBlockIndexExtra();
+            // The statistics are for the chainstate flushed below; if that doesn't happen they are ignored on startup.
+            if (!utxostatsTip.IsNull() && !pblocktree->WriteUTXOStats(utxostatsTip)) {
+                return state.Abort("Failed to write to block index");
+            }
             pblocktree->Sync();
+            if (pTxPosIndex)
+                pTxPosIndex->Flush();
+            // The block index no longer refers to the pruned files: only now remove them.
+            if (fFlushForPrune)
+                UnlinkPrunedFiles(setFilesToPrune);
             // Finally flush the chainstate (which may refer to block index entries).
             if (!pcoinsTip->Flush())
                 return state.Abort("Failed to write to coin database");
@@ -2292,6 +2614,13 @@ void FlushStateToDisk()
     FlushStateToDisk(state, FLUSH_STATE_ALWAYS);
 }
 
+void PruneAndFlush()
+{
+    CValidationState state;
+    fCheckForPruning = true;
+    FlushStateToDisk(state, FLUSH_STATE_ALWAYS);
+}
+
 /** Update chainActive and related internal data structures. */
 void static UpdateTip(CBlockIndex* pindexNew)
 {
@@ -2347,6 +2676,8 @@ bool static DisconnectTip(CValidationState& state)
             return error("DisconnectTip() : DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
         assert(view.Flush());
     }
+    if (pTxPosIndex)
+        pTxPosIndex->DisconnectBlock(block, pindexDelete);
     LogPrint("bench", "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * 0.001);
     // Write the chain state to disk, if necessary.
     if (!FlushStateToDisk(state, FLUSH_STATE_ALWAYS))
@@ -2379,9 +2710,10 @@ static int64_t nTimePostConnect = 0;
 
 /**
  * Connect a new block to chainActive. pblock is either NULL or a pointer to a CBlock
- * corresponding to pindexNew, to bypass loading it again from disk.
+ * corresponding to pindexNew, to bypass loading it again from disk. pblockNext is
+ * either NULL or the block that will be connected after it.
  */
-bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, CBlock* pblock, bool fAlreadyChecked)
+bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, CBlock* pblock, bool fAlreadyChecked, const CBlock* pblockNext = NULL)
 {
     assert(pindexNew->pprev == chainActive.Tip());
     mempool.check(pcoinsTip);
@@ -2405,7 +2737,7 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, CBlock*
     LogPrint("bench", "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * 0.001, nTimeReadFromDisk * 0.000001);
     {
         CInv inv(MSG_BLOCK, pindexNew->GetBlockHash());
-        bool rv = ConnectBlock(*pblock, state, pindexNew, view, false, fAlreadyChecked);
+        bool rv = ConnectBlock(*pblock, state, pindexNew, view, false, fAlreadyChecked, pblockNext);
         GetMainSignals().BlockChecked(*pblock, state);
         if (!rv) {
             if (state.IsInvalid())
@@ -2439,14 +2771,8 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, CBlock*
     // Update chainActive & related variables.
     UpdateTip(pindexNew);
     // Tell wallet about transactions that went from mempool
-    // to conflicted:
-    for (const CTransaction& tx : txConflicted) {
-        SyncWithWallets(tx, NULL);
-    }
-    // ... and about transactions that got confirmed:
-    for (const CTransaction& tx : pblock->vtx) {
-        SyncWithWallets(tx, pblock);
-    }
+    // to conflicted, and about transactions that got confirmed:
+    GetMainSignals().BlockConnected(*pblock, txConflicted);
 
     int64_t nTime6 = GetTimeMicros();
     nTimePostConnect += nTime6 - nTime5;
@@ -2612,11 +2938,21 @@ static void PruneBlockIndexCandidates()
     assert(!setBlockIndexCandidates.empty());
 }
 
+/** Blocks on the way to the most-work chain, read from disk without holding cs_main. */
+typedef std::map<const CBlockIndex*, CBlock> BlockReadMap;
+
+static CBlock* LookupBlockRead(BlockReadMap& mapBlocksRead, const CBlockIndex* pindex)
+{
+    BlockReadMap::iterator it = mapBlocksRead.find(pindex);
+    return it != mapBlocksRead.end() ? &it->second : NULL;
+}
+
 /**
  * Try to make some progress towards making pindexMostWork the active block.
  * pblock is either NULL or a pointer to a CBlock corresponding to pindexMostWork.
+ * Blocks found in mapBlocksRead are connected without reading them again.
  */
-static bool ActivateBestChainStep(CValidationState& state, CBlockIndex* pindexMostWork, CBlock* pblock, bool fAlreadyChecked)
+static bool ActivateBestChainStep(CValidationState& state, CBlockIndex* pindexMostWork, CBlock* pblock, bool fAlreadyChecked, BlockReadMap& mapBlocksRead)
 {
     AssertLockHeld(cs_main);
     if (pblock == NULL)
@@ -2649,8 +2985,13 @@ static bool ActivateBestChainStep(CValidationState& state, CBlockIndex* pindexMo
         nHeight = nTargetHeight;
 
         // Connect new blocks.
-        BOOST_REVERSE_FOREACH (CBlockIndex* pindexConnect, vpindexToConnect) {
-            if (!ConnectTip(state, pindexConnect, pindexConnect == pindexMostWork ? pblock : NULL, fAlreadyChecked)) {
+        for (std::vector<CBlockIndex*>::reverse_iterator it = vpindexToConnect.rbegin(); it != vpindexToConnect.rend(); ++it) {
+            CBlockIndex* pindexConnect = *it;
+            const CBlockIndex* pindexNext = it + 1 != vpindexToConnect.rend() ? *(it + 1) : NULL;
+            CBlock* pblockConnect = pindexConnect == pindexMostWork && pblock ? pblock : LookupBlockRead(mapBlocksRead, pindexConnect);
+            const CBlock* pblockNext = pindexNext == pindexMostWork && pblock ? pblock : LookupBlockRead(mapBlocksRead, pindexNext);
+            // Only the block handed in by the caller has been checked already.
+            if (!ConnectTip(state, pindexConnect, pblockConnect, pblockConnect == pblock && fAlreadyChecked, pblockNext)) {
                 if (state.IsInvalid()) {
                     // The block violates a consensus rule.
                     if (!state.CorruptionPossible())
@@ -2692,10 +3033,12 @@ bool ActivateBestChain(CValidationState& state, CBlock* pblock, bool fAlreadyChe
 {
     CBlockIndex* pindexNewTip = NULL;
     CBlockIndex* pindexMostWork = NULL;
+    BlockReadMap mapBlocksRead;
     do {
         boost::this_thread::interruption_point();
 
         bool fInitialDownload;
+        std::vector<const CBlockIndex*> vpindexToRead;
         while (true) {
             TRY_LOCK(cs_main, lockMain);
             if (!lockMain) {
@@ -2709,13 +3052,37 @@ bool ActivateBestChain(CValidationState& state, CBlock* pblock, bool fAlreadyChe
             if (pindexMostWork == NULL || pindexMostWork == chainActive.Tip())
                 return true;
 
-            if (!ActivateBestChainStep(state, pindexMostWork, pblock && pblock->GetHash() == pindexMostWork->GetBlockHash() ? pblock : NULL, fAlreadyChecked))
+            CBlock* pblockMostWork = pblock && pblock->GetHash() == pindexMostWork->GetBlockHash() ? pblock : NULL;
+            if (!ActivateBestChainStep(state, pindexMostWork, pblockMostWork, fAlreadyChecked, mapBlocksRead))
                 return false;
 
             pindexNewTip = chainActive.Tip();
             fInitialDownload = IsInitialBlockDownload();
+
+            // Pick the next two blocks towards pindexMostWork: the one to connect next
+            // and the one whose inputs are prefetched while connecting it.
+            for (BlockReadMap::iterator it = mapBlocksRead.begin(); it != mapBlocksRead.end();) {
+                if (it->first->nHeight <= pindexNewTip->nHeight || pindexMostWork->GetAncestor(it->first->nHeight) != it->first)
+                    mapBlocksRead.erase(it++);
+                else
+                    ++it;
+            }
+            if (pindexMostWork->GetAncestor(pindexNewTip->nHeight) == pindexNewTip) {
+                for (int nHeight = pindexNewTip->nHeight + 1; nHeight <= std::min(pindexNewTip->nHeight + 2, pindexMostWork->nHeight); nHeight++) {
+                    const CBlockIndex* pindexRead = pindexMostWork->GetAncestor(nHeight);
+                    if ((pindexRead->nStatus & BLOCK_HAVE_DATA) && !mapBlocksRead.count(pindexRead) && !(pblockMostWork && pindexRead == pindexMostWork))
+                        vpindexToRead.push_back(pindexRead);
+                }
+            }
             break;
         }
+
+        // Read those blocks without holding cs_main. A block that can't be read here
+        // is simply read again by ConnectTip, which reports the failure.
+        for (const CBlockIndex* pindexRead : vpindexToRead) {
+            if (!ReadBlockFromDisk(mapBlocksRead[pindexRead], pindexRead))
+                mapBlocksRead.erase(pindexRead);
+        }
         // When we reach this point, we switched to a new tip (stored in pindexNewTip).
 
         // Notifications/callbacks that can run without cs_main
@@ -2822,6 +3189,92 @@ bool ReconsiderBlock(CValidationState& state, CBlockIndex* pindex)
     return true;
 }
 
+namespace
+{
+/**
+ * Storage for the block index entries. They stay alive as long as mapBlockIndex
+ * and are never freed one by one, so they are handed out of large chunks rather
+ * than allocated separately, which keeps entries loaded together next to each other.
+ */
+class CBlockIndexArena
+{
+private:
+    static const size_t CHUNK_SIZE = 16384;
+
+    std::vector<std::unique_ptr<CBlockIndex[]> > vChunks;
+    //! entries handed out of the last chunk
+    size_t nUsed;
+
+public:
+    CBlockIndexArena() : nUsed(CHUNK_SIZE) {}
+
+    CBlockIndex* Allocate()
+    {
+        if (nUsed == CHUNK_SIZE) {
+            vChunks.emplace_back(new CBlockIndex[CHUNK_SIZE]);
+            nUsed = 0;
+        }
+        return &vChunks.back()[nUsed++];
+    }
+
+    void Clear()
+    {
+        vChunks.clear();
+        nUsed = CHUNK_SIZE;
+    }
+};
+
+CBlockIndexArena blockIndexArena;
+
+/** The extra fields of the entries that were changed or read since the block index was loaded. */
+boost::unordered_map<const CBlockIndex*, CBlockIndexExtra> mapBlockIndexExtra;
+
+//! Entries mapBlockIndexExtra may hold before a flush drops the ones deep in the chain
+const size_t MAX_BLOCK_INDEX_EXTRA = 20000;
+//! Entries this close to the tip are kept: new blocks and reorganizations build on their in-memory only fields
+const int BLOCK_INDEX_EXTRA_KEEP_DEPTH = 1000;
+} // namespace
+
+CBlockIndexExtra& GetBlockIndexExtra(const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    // only entries of mapBlockIndex can be cached and looked up by their hash
+    assert(pindex->phashBlock != NULL);
+    boost::unordered_map<const CBlockIndex*, CBlockIndexExtra>::iterator it = mapBlockIndexExtra.find(pindex);
+    if (it != mapBlockIndexExtra.end())
+        return it->second;
+
+    CBlockIndexExtra& extra = mapBlockIndexExtra[pindex];
+    CDiskBlockIndex diskindex;
+    if (pblocktree->ReadBlockIndex(pindex->GetBlockHash(), diskindex))
+        extra = diskindex;
+    return extra;
+}
+
+void ReleaseBlockIndexExtra(const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    if (!setDirtyBlockIndex.count(const_cast<CBlockIndex*>(pindex)))
+        mapBlockIndexExtra.erase(pindex);
+}
+
+/** Drop the cached extra fields of entries that are written and deep in the chain, once there are too many. */
+static void TrimBlockIndexExtra()
+{
+    AssertLockHeld(cs_main);
+    if (mapBlockIndexExtra.size() <= MAX_BLOCK_INDEX_EXTRA)
+        return;
+
+    const int nKeepHeight = chainActive.Height() - BLOCK_INDEX_EXTRA_KEEP_DEPTH;
+    for (boost::unordered_map<const CBlockIndex*, CBlockIndexExtra>::iterator it = mapBlockIndexExtra.begin(); it != mapBlockIndexExtra.end();) {
+        if (it->first->nHeight < nKeepHeight && !setDirtyBlockIndex.count(const_cast<CBlockIndex*>(it->first)))
+            it = mapBlockIndexExtra.erase(it);
+        else
+            ++it;
+    }
+    LogPrint("bench", "%s: %u block index extra entries cached\n", __func__, mapBlockIndexExtra.size());
+}
+
 CBlockIndex* AddToBlockIndex(const CBlock& block)
 {
     // Check for duplicate
@@ -2831,17 +3284,21 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
         return it->second;
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
-    assert(pindexNew);
+    CBlockIndex* pindexNew = blockIndexArena.Allocate();
+    *pindexNew = CBlockIndex(block);
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
     pindexNew->nSequenceId = 0;
     BlockMap::iterator mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
+    CBlockIndexExtra& extra = mapBlockIndexExtra[pindexNew];
 
     //mark as PoS seen
-    if (pindexNew->IsProofOfStake())
-        setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
+    if (pindexNew->IsProofOfStake()) {
+        extra.prevoutStake = block.vtx[1].vin[0].prevout;
+        extra.nStakeTime = block.nTime;
+        setStakeSeen.insert(make_pair(extra.prevoutStake, extra.nStakeTime));
+    }
 
     pindexNew->phashBlock = &((*mi).first);
     BlockMap::iterator miPrev = mapBlockIndex.find(block.hashPrevBlock);
@@ -2850,12 +3307,6 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
         pindexNew->nHeight = pindexNew->pprev->nHeight + 1;
         pindexNew->BuildSkip();
 
-        //update previous block pointer
-        pindexNew->pprev->pnext = pindexNew;
-
-        // ppcoin: compute chain trust score
-        pindexNew->bnChainTrust = (pindexNew->pprev ? pindexNew->pprev->bnChainTrust : 0) + pindexNew->GetBlockTrust();
-
         // ppcoin: compute stake entropy bit for stake modifier
         if (!pindexNew->SetStakeEntropyBit(pindexNew->GetStakeEntropyBit()))
             LogPrintf("AddToBlockIndex() : SetStakeEntropyBit() failed \n");
@@ -2864,7 +3315,7 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
         if (pindexNew->IsProofOfStake()) {
             if (!mapProofOfStake.count(hash))
                 LogPrintf("AddToBlockIndex() : hashProofOfStake not found in map \n");
-            pindexNew->hashProofOfStake = mapProofOfStake[hash];
+            extra.hashProofOfStake = mapProofOfStake[hash];
         }
 
         // ppcoin: compute stake modifier
@@ -2873,8 +3324,8 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
         if (!ComputeNextStakeModifier(pindexNew->pprev, nStakeModifier, fGeneratedStakeModifier))
             LogPrintf("AddToBlockIndex() : ComputeNextStakeModifier() failed \n");
         pindexNew->SetStakeModifier(nStakeModifier, fGeneratedStakeModifier);
-        pindexNew->nStakeModifierChecksum = GetStakeModifierChecksum(pindexNew);
-        if (!CheckStakeModifierCheckpoints(pindexNew->nHeight, pindexNew->nStakeModifierChecksum))
+        extra.nStakeModifierChecksum = GetStakeModifierChecksum(pindexNew);
+        if (!CheckStakeModifierCheckpoints(pindexNew->nHeight, extra.nStakeModifierChecksum))
             LogPrintf("AddToBlockIndex() : Rejected by stake modifier checkpoint height=%d, modifier=%s \n", pindexNew->nHeight, std::to_string(nStakeModifier));
     }
     pindexNew->nChainWork = (pindexNew->pprev ? pindexNew->pprev->nChainWork : 0) + GetBlockProof(*pindexNew);
@@ -2882,10 +3333,6 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
     if (pindexBestHeader == NULL || pindexBestHeader->nChainWork < pindexNew->nChainWork)
         pindexBestHeader = pindexNew;
 
-    //update previous block pointer
-    if (pindexNew->nHeight)
-        pindexNew->pprev->pnext = pindexNew;
-
     setDirtyBlockIndex.insert(pindexNew);
 
     return pindexNew;
@@ -2972,6 +3419,8 @@ bool FindBlockPos(CValidationState& state, CDiskBlockPos& pos, unsigned int nAdd
         unsigned int nOldChunks = (pos.nPos + BLOCKFILE_CHUNK_SIZE - 1) / BLOCKFILE_CHUNK_SIZE;
         unsigned int nNewChunks = (vinfoBlockFile[nFile].nSize + BLOCKFILE_CHUNK_SIZE - 1) / BLOCKFILE_CHUNK_SIZE;
         if (nNewChunks > nOldChunks) {
+            if (fPruneMode)
+                fCheckForPruning = true;
             if (CheckDiskSpace(nNewChunks * BLOCKFILE_CHUNK_SIZE - pos.nPos)) {
                 FILE* file = OpenBlockFile(pos);
                 if (file) {
@@ -3002,6 +3451,8 @@ bool FindUndoPos(CValidationState& state, int nFile, CDiskBlockPos& pos, unsigne
     unsigned int nOldChunks = (pos.nPos + UNDOFILE_CHUNK_SIZE - 1) / UNDOFILE_CHUNK_SIZE;
     unsigned int nNewChunks = (nNewSize + UNDOFILE_CHUNK_SIZE - 1) / UNDOFILE_CHUNK_SIZE;
     if (nNewChunks > nOldChunks) {
+        if (fPruneMode)
+            fCheckForPruning = true;
         if (CheckDiskSpace(nNewChunks * UNDOFILE_CHUNK_SIZE - pos.nPos)) {
             FILE* file = OpenUndoFile(pos);
             if (file) {
@@ -3026,9 +3477,10 @@ bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool f
     return true;
 }
 
-bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckSig)
+bool CheckBlockContextFree(const CBlock& block, CValidationState& state, bool fCheckPOW, bool fCheckMerkleRoot)
 {
-    // These are checks that are independent of context.
+    // These are checks that are independent of context: they don't touch the chain
+    // state and may run without cs_main, in parallel with block connection.
 
     // Check that the header is valid (particularly PoW).  This is mostly
     // redundant with the call in AcceptBlockHeader.
@@ -3089,7 +3541,31 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
             if (block.vtx[i].IsCoinStake())
                 return state.DoS(100, error("CheckBlock() : more than one coinstake"));
     }
-    else {
+
+    // Check transactions
+    for (const CTransaction& tx : block.vtx)
+        if (!CheckTransaction(tx, state, block.GetBlockTime()))
+            return error("CheckBlock() : CheckTransaction failed");
+
+    unsigned int nSigOps = 0;
+    for (const CTransaction& tx : block.vtx) {
+        nSigOps += GetLegacySigOpCount(tx);
+    }
+
+    unsigned int MAX_BLOCK_SIGOPS = MAX_BLOCK_SIZE / 50;
+    if (nSigOps > MAX_BLOCK_SIGOPS)
+        return state.DoS(100, error("CheckBlock() : out-of-bounds SigOpCount"),
+            REJECT_INVALID, "bad-blk-sigops", true);
+
+    return true;
+}
+
+bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckSig)
+{
+    if (!block.fChecked && !CheckBlockContextFree(block, state, fCheckPOW, fCheckMerkleRoot))
+        return false;
+
+    if (block.IsProofOfWork()) {
             int nHeight = 0;
             CBlockIndex* pindexPrev = chainActive.Tip();
             if (!pindexPrev)
@@ -3174,21 +3650,6 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
         }
     }
 
-    // Check transactions
-    for (const CTransaction& tx : block.vtx)
-        if (!CheckTransaction(tx, state, block.GetBlockTime()))
-            return error("CheckBlock() : CheckTransaction failed");
-
-    unsigned int nSigOps = 0;
-    for (const CTransaction& tx : block.vtx) {
-        nSigOps += GetLegacySigOpCount(tx);
-    }
-
-    unsigned int MAX_BLOCK_SIGOPS = MAX_BLOCK_SIZE / 50;
-    if (nSigOps > MAX_BLOCK_SIGOPS)
-        return state.DoS(100, error("CheckBlock() : out-of-bounds SigOpCount"),
-            REJECT_INVALID, "bad-blk-sigops", true);
-
     return true;
 }
 
@@ -3456,7 +3917,7 @@ bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex** ppindex,
                 if (it == mapStakeSpent.end()) {
                     return false;
                 }
-                if (it->second < pindexPrev->nHeight) {
+                if (it->second.nHeight < pindexPrev->nHeight) {
                     return false;
                 }
             }
@@ -3632,7 +4093,7 @@ bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDis
     int64_t nStartTime = GetTimeMillis();
     bool checked = CheckBlock(*pblock, state);
 
-    if (!pblock->CheckBlockSignature())
+    if (!pblock->fChecked && !pblock->CheckBlockSignature())
         return error("ProcessNewBlock() : bad proof-of-stake block signature");
 
     if (pblock->GetHash() != Params().HashGenesisBlock() && pfrom != NULL) {
@@ -3660,22 +4121,15 @@ bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDis
                 std::pair<COutPoint, unsigned int> ProofOfStake = pblock->GetProofOfStake();
 
                 // the inputs are spent at the chain tip so we should look at the recently spent outputs
+                LOCK(cs_mapstake);
                 auto it = mapStakeSpent.find(ProofOfStake.first);
                 if (it == mapStakeSpent.end())
                     return state.DoS(100, error("%s : stake input missing/spent", __func__));
 
-                // Check for coin age.
-                    // First try finding the previous transaction in database.
-                    CTransaction txPrev;
-                    uint256 hashBlockPrev;
-                    if (!GetTransaction(ProofOfStake.first.hash, txPrev, hashBlockPrev, true))
-                          return state.DoS(100, error("%s : stake failed to find vin transaction", __func__));
-                    // Find block in map.
-                    CBlockIndex* pindex = NULL;
-                    BlockMap::iterator itBlock = mapBlockIndex.find(hashBlockPrev);
-                    if (itBlock != mapBlockIndex.end())
-                          pindex = itBlock->second;
-                    else
+                // Check for coin age. The spent entry records where the stake was created, so
+                // this gives the same answer on a pruned node that no longer has that block file.
+                    CBlockIndex* pindex = chainActive[it->second.nHeightFrom];
+                    if (!pindex)
                           return state.DoS(100, error("%s : stake failed to find block index", __func__));
                     // Check block time vs stake age requirement.
                     if (pindex->GetBlockHeader().nTime + nStakeMinAge > ProofOfStake.second)
@@ -3833,6 +4287,117 @@ boost::filesystem::path GetBlockPosFilename(const CDiskBlockPos& pos, const char
     return GetDataDir() / "blocks" / strprintf("%s%05u.dat", prefix, pos.nFile);
 }
 
+int GetPruneHeightLimit()
+{
+    // Besides a day of blocks, keep every block a reorg may disconnect and every
+    // block whose stake is still maturing.
+    int nKeep = std::max<int>(MIN_BLOCKS_TO_KEEP, Params().MaxReorganizationDepth() + 1);
+    nKeep = std::max<int>(nKeep, nStakeMinAge / Params().TargetSpacing() + 1);
+    return chainActive.Height() - nKeep;
+}
+
+uint64_t CalculateCurrentUsage()
+{
+    uint64_t retval = 0;
+    for (const CBlockFileInfo& file : vinfoBlockFile) {
+        retval += file.nSize + file.nUndoSize;
+    }
+    return retval;
+}
+
+/** Mark the blocks of a block file as pruned; the file itself is removed by UnlinkPrunedFiles */
+void static PruneOneBlockFile(const int fileNumber)
+{
+    for (BlockMap::iterator it = mapBlockIndex.begin(); it != mapBlockIndex.end(); ++it) {
+        CBlockIndex* pindex = it->second;
+        if (pindex->nFile == fileNumber) {
+            pindex->nStatus &= ~BLOCK_HAVE_DATA;
+            pindex->nStatus &= ~BLOCK_HAVE_UNDO;
+            pindex->nFile = 0;
+            pindex->nDataPos = 0;
+            pindex->nUndoPos = 0;
+            setDirtyBlockIndex.insert(pindex);
+
+            // Prune from mapBlocksUnlinked -- any block we prune would have
+            // to be downloaded again in order to consider its chain, at which
+            // point it would be considered as a candidate for
+            // mapBlocksUnlinked or setBlockIndexCandidates.
+            std::pair<std::multimap<CBlockIndex*, CBlockIndex*>::iterator, std::multimap<CBlockIndex*, CBlockIndex*>::iterator> range = mapBlocksUnlinked.equal_range(pindex->pprev);
+            while (range.first != range.second) {
+                std::multimap<CBlockIndex*, CBlockIndex*>::iterator itUnlinked = range.first;
+                range.first++;
+                if (itUnlinked->second == pindex)
+                    mapBlocksUnlinked.erase(itUnlinked);
+            }
+        }
+    }
+
+    vinfoBlockFile[fileNumber].SetNull();
+    setDirtyFileInfo.insert(fileNumber);
+}
+
+void static UnlinkPrunedFiles(std::set<int>& setFilesToPrune)
+{
+    for (std::set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
+        CDiskBlockPos pos(*it, 0);
+        if (pblockfilemap)
+            pblockfilemap->Forget(*it);
+        boost::filesystem::remove(GetBlockPosFilename(pos, "blk"));
+        boost::filesystem::remove(GetBlockPosFilename(pos, "rev"));
+        LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
+    }
+}
+
+/**
+ * Collect the block files to delete so that the block and undo files stay below nPruneTarget.
+ * Files containing a block above GetPruneHeightLimit() are never pruned, and neither is the
+ * file currently being written to.
+ */
+void static FindFilesToPrune(std::set<int>& setFilesToPrune)
+{
+    if (chainActive.Tip() == NULL || nPruneTarget == 0)
+        return;
+
+    int nLastBlockWeCanPrune = GetPruneHeightLimit();
+    if (nLastBlockWeCanPrune <= 0)
+        return;
+
+    uint64_t nCurrentUsage = CalculateCurrentUsage();
+    // We don't check to prune until after we've allocated new space for files,
+    // so we should leave a buffer under our target to account for another allocation
+    // before the next pruning.
+    uint64_t nBuffer = BLOCKFILE_CHUNK_SIZE + UNDOFILE_CHUNK_SIZE;
+    uint64_t nBytesToPrune;
+    int count = 0;
+
+    if (nCurrentUsage + nBuffer >= nPruneTarget) {
+        for (int fileNumber = 0; fileNumber < nLastBlockFile; fileNumber++) {
+            nBytesToPrune = vinfoBlockFile[fileNumber].nSize + vinfoBlockFile[fileNumber].nUndoSize;
+
+            if (vinfoBlockFile[fileNumber].nSize == 0)
+                continue;
+
+            if (nCurrentUsage + nBuffer < nPruneTarget) // are we below our target?
+                break;
+
+            // don't prune files that could have a block within the safety window
+            if ((int)vinfoBlockFile[fileNumber].nHeightLast > nLastBlockWeCanPrune)
+                continue;
+
+            PruneOneBlockFile(fileNumber);
+            // Queue up the files for removal
+            setFilesToPrune.insert(fileNumber);
+            nCurrentUsage -= nBytesToPrune;
+            count++;
+        }
+    }
+
+    LogPrint("prune", "Prune: target=%dMiB actual=%dMiB diff=%dMiB max_prune_height=%d removed %d blk/rev pairs\n",
+        nPruneTarget / 1024 / 1024, nCurrentUsage / 1024 / 1024,
+        ((int64_t)nPruneTarget - (int64_t)nCurrentUsage) / 1024 / 1024,
+        nLastBlockWeCanPrune, count);
+}
+
 CBlockIndex* InsertBlockIndex(uint256 hash)
 {
     if (hash == 0)
@@ -3844,15 +4409,8 @@ CBlockIndex* InsertBlockIndex(uint256 hash)
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
-    if (!pindexNew)
-        throw runtime_error("LoadBlockIndex() : new CBlockIndex failed");
+    CBlockIndex* pindexNew = blockIndexArena.Allocate();
     mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
-
-    //mark as PoS seen
-    if (pindexNew->IsProofOfStake())
-        setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
-
     pindexNew->phashBlock = &((*mi).first);
 
     return pindexNew;
@@ -3876,7 +4434,9 @@ bool static LoadBlockIndexDB(string& strError)
     for (const PAIRTYPE(int, CBlockIndex*) & item : vSortedByHeight) {
         CBlockIndex* pindex = item.second;
         pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
-        if (pindex->nStatus & BLOCK_HAVE_DATA) {
+        // We can link the chain of blocks for which we've received transactions at some point.
+        // Pruned nodes may have deleted the block.
+        if (pindex->nTx > 0) {
             if (pindex->pprev) {
                 if (pindex->pprev->nChainTx) {
                     pindex->nChainTx = pindex->pprev->nChainTx + pindex->nTx;
@@ -3915,6 +4475,11 @@ bool static LoadBlockIndexDB(string& strError)
         }
     }
 
+    // Check whether we have ever pruned block & undo files
+    pblocktree->ReadFlag("prunedblockfiles", fHavePruned);
+    if (fHavePruned)
+        LogPrintf("LoadBlockIndexDB(): Block files have previously been pruned\n");
+
     // Check presence of blk files
     LogPrintf("Checking all blk files are present...\n");
     set<int> setBlkDataFiles;
@@ -3937,7 +4502,8 @@ bool static LoadBlockIndexDB(string& strError)
     LogPrintf("%s: Last shutdown was prepared: %s\n", __func__, fLastShutdownWasPrepared);
 
     //Check for inconsistency with block file info and internal state
-    if (!fLastShutdownWasPrepared && !GetBoolArg("-forcestart", false) && !GetBoolArg("-reindex", false)) {
+    // (Pruned nodes, including ones started from a UTXO snapshot, have no block files to replay from.)
+    if (!fLastShutdownWasPrepared && !fHavePruned && !GetBoolArg("-forcestart", false) && !GetBoolArg("-reindex", false)) {
         unsigned int nHeightLastBlockFile = vinfoBlockFile[nLastBlockFile].nHeightLast + 1;
         if (vSortedByHeight.size() > nHeightLastBlockFile && pcoinsTip->GetBestBlock() != vSortedByHeight[nHeightLastBlockFile].second->GetBlockHash()) {
             //The database is in a state where a block has been accepted and written to disk, but the
@@ -4063,6 +4629,11 @@ bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth
         uiInterface.ShowProgress(_("Verifying blocks..."), std::max(1, std::min(99, (int)(((double)(chainActive.Height() - pindex->nHeight)) / (double)nCheckDepth * (nCheckLevel >= 4 ? 50 : 100)))));
         if (pindex->nHeight < chainActive.Height() - nCheckDepth)
             break;
+        if (fPruneMode && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
+            // If pruning, only go back as far as we have data.
+            LogPrintf("VerifyDB(): block verification stopping at height %d (pruning, no data)\n", pindex->nHeight);
+            break;
+        }
         CBlock block;
         // check level 0: read from disk
         if (!ReadBlockFromDisk(block, pindex))
@@ -4140,10 +4711,9 @@ void UnloadBlockIndex()
     setDirtyFileInfo.clear();
     mapNodeState.clear();
 
-    for (BlockMap::value_type& entry : mapBlockIndex) {
-        delete entry.second;
-    }
     mapBlockIndex.clear();
+    mapBlockIndexExtra.clear();
+    blockIndexArena.Clear();
 }
 
 bool LoadBlockIndex(string& strError)
@@ -4195,101 +4765,86 @@ bool InitBlockIndex()
 }
 
 
-bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp)
+bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp, CImportStats* pstats)
 {
     // Map of disk positions for blocks with unknown parent (only used for reindex)
     static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
     int64_t nStart = GetTimeMillis();
 
     int nLoaded = 0;
-    try {
-        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
-        CBufferedFile blkdat(fileIn, 2 * MAX_BLOCKFILE_SIZE, MAX_BLOCKFILE_SIZE + 8, SER_DISK, CLIENT_VERSION);
-        uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
-            boost::this_thread::interruption_point();
+    // Reading and the context-free block checks run ahead on the pipeline's threads,
+    // blocks are connected here in file order.
+    CBlockImportPipeline pipeline(fileIn, dbp, nImportCheckThreads);
+    CBlock block;
+    CDiskBlockPos pos;
+    while (pipeline.Next(block, pos)) {
+        boost::this_thread::interruption_point();
 
-            blkdat.SetPos(nRewind);
-            nRewind++;         // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
-            try {
-                // locate a header
-                unsigned char buf[MESSAGE_START_SIZE];
-                blkdat.FindByte(Params().MessageStart()[0]);
-                nRewind = blkdat.GetPos() + 1;
-                blkdat >> FLATDATA(buf);
-                if (memcmp(buf, Params().MessageStart(), MESSAGE_START_SIZE))
-                    continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCKFILE_SIZE)
-                    continue;
-            } catch (const std::exception&) {
-                // no valid block header found; don't complain
-                break;
-            }
-            try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
+        try {
+            if (dbp)
+                dbp->nPos = pos.nPos;
+
+            // detect out of order blocks, and store them for later
+            uint256 hash = block.GetHash();
+            if (hash != Params().HashGenesisBlock() && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
+                LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
+                    block.hashPrevBlock.ToString());
                 if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                CBlock block;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
-
-                // detect out of order blocks, and store them for later
-                uint256 hash = block.GetHash();
-                if (hash != Params().HashGenesisBlock() && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
-                    LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
-                        block.hashPrevBlock.ToString());
-                    if (dbp)
-                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
-                    continue;
-                }
+                    mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
+                continue;
+            }
 
-                // process in case the block isn't known yet
-                if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
-                    CValidationState state;
-                    if (ProcessNewBlock(state, NULL, &block, dbp))
-                        nLoaded++;
-                    if (state.IsError())
-                        break;
-                } else if (hash != Params().HashGenesisBlock() && mapBlockIndex[hash]->nHeight % 1000 == 0) {
-                    LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
-                }
+            // process in case the block isn't known yet
+            if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
+                int64_t nTimeStart = GetTimeMicros();
+                CValidationState state;
+                if (ProcessNewBlock(state, NULL, &block, dbp))
+                    nLoaded++;
+                pipeline.AddConnected(GetTimeMicros() - nTimeStart);
+                if (state.IsError())
+                    break;
+            } else if (hash != Params().HashGenesisBlock() && mapBlockIndex[hash]->nHeight % 1000 == 0) {
+                LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
+            }
 
-                // Recursively process earlier encountered successors of this block
-                deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
-                        if (ReadBlockFromDisk(block, it->second)) {
-                            LogPrintf("%s: Processing out of order child %s of %s\n", __func__, block.GetHash().ToString(),
-                                head.ToString());
-                            CValidationState dummy;
-                            if (ProcessNewBlock(dummy, NULL, &block, &it->second)) {
-                                nLoaded++;
-                                queue.push_back(block.GetHash());
-                            }
+            // Recursively process earlier encountered successors of this block
+            deque<uint256> queue;
+            queue.push_back(hash);
+            while (!queue.empty()) {
+                uint256 head = queue.front();
+                queue.pop_front();
+                std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+                while (range.first != range.second) {
+                    std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
+                    if (ReadBlockFromDisk(block, it->second)) {
+                        LogPrintf("%s: Processing out of order child %s of %s\n", __func__, block.GetHash().ToString(),
+                            head.ToString());
+                        int64_t nTimeStart = GetTimeMicros();
+                        CValidationState dummy;
+                        if (ProcessNewBlock(dummy, NULL, &block, &it->second)) {
+                            nLoaded++;
+                            queue.push_back(block.GetHash());
                         }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
+                        pipeline.AddConnected(GetTimeMicros() - nTimeStart);
                     }
+                    range.first++;
+                    mapBlocksUnknownParent.erase(it);
                 }
-            } catch (std::exception& e) {
-                LogPrintf("%s : Deserialize or I/O error - %s", __func__, e.what());
             }
+        } catch (std::exception& e) {
+            LogPrintf("%s : Deserialize or I/O error - %s", __func__, e.what());
         }
-    } catch (std::runtime_error& e) {
-        AbortNode(std::string("System error: ") + e.what());
     }
+
+    std::string strError = pipeline.GetError();
+    if (!strError.empty())
+        AbortNode(std::string("System error: ") + strError);
+
+    CImportStats stats = pipeline.GetStats();
+    LogPrint("bench", "%s: %s\n", __func__, stats.ToString());
+    if (pstats)
+        *pstats += stats;
+
     if (nLoaded > 0)
         LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded, GetTimeMillis() - nStart);
     return nLoaded > 0;
@@ -4331,6 +4886,7 @@ void static CheckBlockIndex()
     int nHeight = 0;
     CBlockIndex* pindexFirstInvalid = NULL;         // Oldest ancestor of pindex which is invalid.
     CBlockIndex* pindexFirstMissing = NULL;         // Oldest ancestor of pindex which does not have BLOCK_HAVE_DATA.
+    CBlockIndex* pindexFirstNeverProcessed = NULL;  // Oldest ancestor of pindex for which nTx == 0.
     CBlockIndex* pindexFirstNotTreeValid = NULL;    // Oldest ancestor of pindex which does not have BLOCK_VALID_TREE (regardless of being valid or not).
     CBlockIndex* pindexFirstNotChainValid = NULL;   // Oldest ancestor of pindex which does not have BLOCK_VALID_CHAIN (regardless of being valid or not).
     CBlockIndex* pindexFirstNotScriptsValid = NULL; // Oldest ancestor of pindex which does not have BLOCK_VALID_SCRIPTS (regardless of being valid or not).
@@ -4338,6 +4894,7 @@ void static CheckBlockIndex()
         nNodes++;
         if (pindexFirstInvalid == NULL && pindex->nStatus & BLOCK_FAILED_VALID) pindexFirstInvalid = pindex;
         if (pindexFirstMissing == NULL && !(pindex->nStatus & BLOCK_HAVE_DATA)) pindexFirstMissing = pindex;
+        if (pindexFirstNeverProcessed == NULL && pindex->nTx == 0) pindexFirstNeverProcessed = pindex;
         if (pindex->pprev != NULL && pindexFirstNotTreeValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_TREE) pindexFirstNotTreeValid = pindex;
         if (pindex->pprev != NULL && pindexFirstNotChainValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_CHAIN) pindexFirstNotChainValid = pindex;
         if (pindex->pprev != NULL && pindexFirstNotScriptsValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_SCRIPTS) pindexFirstNotScriptsValid = pindex;
@@ -4348,12 +4905,18 @@ void static CheckBlockIndex()
             assert(pindex->GetBlockHash() == Params().HashGenesisBlock()); // Genesis block's hash must match.
             assert(pindex == chainActive.Genesis());                       // The current active chain's genesis block must be this block.
         }
-        // HAVE_DATA is equivalent to VALID_TRANSACTIONS and equivalent to nTx > 0 (we stored the number of transactions in the block)
-        assert(!(pindex->nStatus & BLOCK_HAVE_DATA) == (pindex->nTx == 0));
+        // VALID_TRANSACTIONS is equivalent to nTx > 0 (we stored the number of transactions in the block). Unless
+        // block files were pruned (or the node started from a UTXO snapshot), so is HAVE_DATA.
+        if (!fHavePruned) {
+            assert(!(pindex->nStatus & BLOCK_HAVE_DATA) == (pindex->nTx == 0));
+            assert(pindexFirstMissing == pindexFirstNeverProcessed);
+        } else if (pindex->nStatus & BLOCK_HAVE_DATA) {
+            assert(pindex->nTx > 0);
+        }
         assert(((pindex->nStatus & BLOCK_VALID_MASK) >= BLOCK_VALID_TRANSACTIONS) == (pindex->nTx > 0));
         if (pindex->nChainTx == 0) assert(pindex->nSequenceId == 0); // nSequenceId can't be set for blocks that aren't linked
-        // All parents having data is equivalent to all parents being VALID_TRANSACTIONS, which is equivalent to nChainTx being set.
-        assert((pindexFirstMissing != NULL) == (pindex->nChainTx == 0));                                             // nChainTx == 0 is used to signal that all parent block's transaction data is available.
+        // All parents having been processed is equivalent to all parents being VALID_TRANSACTIONS, which is equivalent to nChainTx being set.
+        assert((pindexFirstNeverProcessed != NULL) == (pindex->nChainTx == 0));                                      // nChainTx == 0 is used to signal that all parent block's transactions were processed.
         assert(pindex->nHeight == nHeight);                                                                          // nHeight must be consistent.
         assert(pindex->pprev == NULL || pindex->nChainWork >= pindex->pprev->nChainWork);                            // For every block except the genesis block, the chainwork must be larger than the parent's.
         assert(nHeight < 2 || (pindex->pskip && (pindex->pskip->nHeight < nHeight)));                                // The pskip pointer must point back for all but the first 2 blocks.
@@ -4365,9 +4928,11 @@ void static CheckBlockIndex()
             // Checks for not-invalid blocks.
             assert((pindex->nStatus & BLOCK_FAILED_MASK) == 0); // The failed mask cannot be set for blocks without invalid parents.
         }
-        if (!CBlockIndexWorkComparator()(pindex, chainActive.Tip()) && pindexFirstMissing == NULL) {
+        if (!CBlockIndexWorkComparator()(pindex, chainActive.Tip()) && pindexFirstNeverProcessed == NULL) {
             if (pindexFirstInvalid == NULL) { // If this block sorts at least as good as the current tip and is valid, it must be in setBlockIndexCandidates.
-                assert(setBlockIndexCandidates.count(pindex));
+                // The tip must be there even if some of its parents' data was pruned.
+                if (pindexFirstMissing == NULL || pindex == chainActive.Tip())
+                    assert(setBlockIndexCandidates.count(pindex));
             }
         } else { // If this block sorts worse than the current tip, it cannot be in setBlockIndexCandidates.
             assert(setBlockIndexCandidates.count(pindex) == 0);
@@ -4383,11 +4948,12 @@ void static CheckBlockIndex()
             }
             rangeUnlinked.first++;
         }
-        if (pindex->pprev && pindex->nStatus & BLOCK_HAVE_DATA && pindexFirstMissing != NULL) {
-            if (pindexFirstInvalid == NULL) { // If this block has block data available, some parent doesn't, and has no invalid parents, it must be in mapBlocksUnlinked.
+        if (pindex->pprev && pindex->nStatus & BLOCK_HAVE_DATA && pindexFirstNeverProcessed != NULL) {
+            if (pindexFirstInvalid == NULL) { // If this block has block data available, some parent was never received, and has no invalid parents, it must be in mapBlocksUnlinked.
                 assert(foundInUnlinked);
             }
-        } else { // If this block does not have block data available, or all parents do, it cannot be in mapBlocksUnlinked.
+        }
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA) || pindexFirstMissing == NULL) { // If this block does not have block data available, or all parents do, it cannot be in mapBlocksUnlinked.
             assert(!foundInUnlinked);
         }
         // assert(pindex->GetBlockHash() == pindex->GetBlockHeader().GetHash()); // Perhaps too slow
@@ -4408,6 +4974,7 @@ void static CheckBlockIndex()
             // If pindex was the first with a certain property, unset the corresponding variable.
             if (pindex == pindexFirstInvalid) pindexFirstInvalid = NULL;
             if (pindex == pindexFirstMissing) pindexFirstMissing = NULL;
+            if (pindex == pindexFirstNeverProcessed) pindexFirstNeverProcessed = NULL;
             if (pindex == pindexFirstNotTreeValid) pindexFirstNotTreeValid = NULL;
             if (pindex == pindexFirstNotChainValid) pindexFirstNotChainValid = NULL;
             if (pindex == pindexFirstNotScriptsValid) pindexFirstNotScriptsValid = NULL;
@@ -4571,12 +5138,21 @@ void static ProcessGetData(CNode* pfrom)
                         }
                     }
                 }
-                // Don't send not-validated blocks
-                if (send && (mi->second->nStatus & BLOCK_HAVE_DATA)) {
-                    // Send block from disk
-                    CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second))
+                // Don't send not-validated blocks; pruned blocks are reported as not found
+                CBlock block;
+                if (send && !(mi->second->nStatus & BLOCK_HAVE_DATA)) {
+                    if (fHavePruned)
+                        vNotFound.push_back(inv);
+                    send = false;
+                } else if (send && !ReadBlockFromDisk(block, (*mi).second)) {
+                    if (!fHavePruned)
                         assert(!"cannot load block from disk");
+                    LogPrint("net", "ProcessGetData(): block %s requested by peer=%i is no longer on disk\n", inv.hash.ToString(), pfrom->GetId());
+                    vNotFound.push_back(inv);
+                    send = false;
+                }
+                if (send) {
+                    // Send block from disk
                     if (inv.type == MSG_BLOCK)
                         pfrom->PushMessage("block", block);
                     else // MSG_FILTERED_BLOCK)
@@ -5030,6 +5606,11 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                 LogPrint("net", "  getblocks stopping at %d %s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
                 break;
             }
+            // Don't announce blocks we can no longer serve
+            if (fHavePruned && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
+                LogPrint("net", " getblocks stopping, pruned or too old block at %d %s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
+                break;
+            }
             pfrom->PushInventory(CInv(MSG_BLOCK, pindex->GetBlockHash()));
             if (--nLimit <= 0) {
                 // When this block is requested, we'll send an inv that'll make them
@@ -5325,7 +5906,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                 }
                 //disconnect this node if its old protocol version
                 pfrom->DisconnectOldProtocol(ActiveProtocol(), strCommand);
-            } else {
+            } else if (!ProcessSnapshotBlock(pfrom->GetId(), block)) {
                 LogPrint("net", "%s : Already processed block %s, skipping ProcessNewBlock()\n", __func__, block.GetHash().GetHex());
             }
         }
@@ -5902,6 +6483,10 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
             }
         }
 
+        // Blocks below a UTXO snapshot, for its background validation
+        if (!pto->fDisconnect && !pto->fClient)
+            GetSnapshotBlocksToDownload(pto->GetId(), vGetData);
+
         //
         // Message: getdata (non-blocks)
         //
@@ -5991,10 +6576,9 @@ public:
     ~CMainCleanup()
     {
         // block headers
-        BlockMap::iterator it1 = mapBlockIndex.begin();
-        for (; it1 != mapBlockIndex.end(); it1++)
-            delete (*it1).second;
         mapBlockIndex.clear();
+        mapBlockIndexExtra.clear();
+        blockIndexArena.Clear();
 
         // orphan transactions
         mapOrphanTransactions.clear();
@@ -14,6 +14,7 @@
 #include "sync.h"
 #include "util.h"
 #include "utilmoneystr.h"
+#include "validationinterface.h"
 #include <algorithm>
 #include <boost/filesystem.hpp>
 #include <boost/lexical_cast.hpp>
@@ -586,6 +587,7 @@ bool CMasternodePayments::AddWinningMasternode(CMasternodePaymentWinner& winnerI
     }
 
     mapMasternodeBlocks[winnerIn.nBlockHeight].AddPayee(winnerIn.payeeLevel, winnerIn.payee, winnerIn.payeeVin, 1);
+    GetMainSignals().NotifyMasternodeWinner(winnerIn);
 
     return true;
 }
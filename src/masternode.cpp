@@ -367,10 +367,16 @@ bool CMasternode::IsDepositCoins(const CTxIn& vin, CAmount& vin_val)
     bool vin_valid =  GetTransaction(vin.prevout.hash, prevout_tx, hashBlock, true)
                    && (vin.prevout.n < prevout_tx.vout.size());
 
-    if(!vin_valid)
-        return false;
-
-    CAmount vin_amount = prevout_tx.vout[vin.prevout.n].nValue;
+    CAmount vin_amount;
+    if(vin_valid) {
+        vin_amount = prevout_tx.vout[vin.prevout.n].nValue;
+    } else {
+        // pruned nodes: the collateral is unspent, so the coins view still has it
+        CTxOut txout;
+        if(!fHavePruned || !GetUnspentOutput(vin.prevout, txout, hashBlock))
+            return false;
+        vin_amount = txout.nValue;
+    }
 
     if(!IsDepositCoins(vin_amount))
         return false;
@@ -688,7 +694,10 @@ bool CMasternodeBroadcast::CheckInputsAndAdd(int& nDoS)
     // should be at least not earlier than block when 1000 VALUTO tx got MASTERNODE_MIN_CONFIRMATIONS
     uint256 hashBlock = 0;
     CTransaction tx2;
-    GetTransaction(vin.prevout.hash, tx2, hashBlock, true);
+    if (!GetTransaction(vin.prevout.hash, tx2, hashBlock, true) && fHavePruned) {
+        CTxOut txout;
+        GetUnspentOutput(vin.prevout, txout, hashBlock);
+    }
     BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
     if (mi != mapBlockIndex.end() && (*mi).second) {
         CBlockIndex* pMNIndex = (*mi).second;                                                        // block for 1000 VALUTO tx -> 1 confirmation
@@ -9,6 +9,7 @@
 #include "miner.h"
 
 #include "amount.h"
+#include "crypto/keccak256.h"
 #include "hash.h"
 #include "main.h"
 #include "masternode-sync.h"
@@ -588,10 +589,20 @@ void BitcoinMiner(CWallet* pwallet, bool fProofOfStake)
             unsigned int nHashesDone = 0;
 
             uint256 hash;
+            // nNonce is the only header field that changes in here
+            CKeccakHeaderMidstate midstate((const unsigned char*)BEGIN(pblock->nVersion));
+            unsigned char hashes[MINER_NONCE_BATCH * 32];
             while (true) {
-                hash = pblock->GetHash();
-                if (hash <= hashTarget) {
+                midstate.Hash(hashes, pblock->nNonce, MINER_NONCE_BATCH);
+                int nFound = -1;
+                for (int i = 0; i < MINER_NONCE_BATCH && nFound < 0; i++) {
+                    memcpy(hash.begin(), hashes + 32 * i, 32);
+                    if (hash <= hashTarget)
+                        nFound = i;
+                }
+                if (nFound >= 0) {
                     // Found a solution
+                    pblock->nNonce += nFound;
                     SetThreadPriority(THREAD_PRIORITY_NORMAL);
                     LogPrintf("BitcoinMiner:\n");
                     LogPrintf("proof-of-work found  \n  hash: %s  \ntarget: %s\n", hash.GetHex(), hashTarget.GetHex());
@@ -605,9 +616,9 @@ void BitcoinMiner(CWallet* pwallet, bool fProofOfStake)
 
                     break;
                 }
-                pblock->nNonce += 1;
-                nHashesDone += 1;
-                if ((pblock->nNonce & 0xFF) == 0)
+                pblock->nNonce += MINER_NONCE_BATCH;
+                nHashesDone += MINER_NONCE_BATCH;
+                if ((pblock->nNonce & 0xFF) < MINER_NONCE_BATCH)
                     break;
             }
 
@@ -17,6 +17,9 @@ class CWallet;
 
 struct CBlockTemplate;
 
+/** Nonces the miner hashes per call, a multiple of the widest Keccak lanes that divides 256 */
+static const int MINER_NONCE_BATCH = 8;
+
 /** Run the miner threads */
 void GenerateBitcoins(bool fGenerate, CWallet* pwallet, int nThreads);
 /** Generate a new block, without valid proof-of-work */
@@ -2108,8 +2108,13 @@ bool CObfuScationSigner::IsVinAssociatedWithPubkey(CTxIn& vin, CPubKey& pubkey)
 
     CTransaction txVin;
     uint256 hash;
-    if(!GetTransaction(vin.prevout.hash, txVin, hash, true))
-        return false;
+    if(!GetTransaction(vin.prevout.hash, txVin, hash, true)) {
+        // pruned nodes only know the unspent collateral output itself
+        CTxOut txout;
+        if(!fHavePruned || !GetUnspentOutput(vin.prevout, txout, hash))
+            return false;
+        return CMasternode::IsDepositCoins(txout.nValue) && txout.scriptPubKey == payee2;
+    }
 
     for(CTxOut out : txVin.vout) {
 
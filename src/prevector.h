@@ -0,0 +1,329 @@
+// Copyright (c) 2017-2020 The VALUTO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_PREVECTOR_H
+#define BITCOIN_PREVECTOR_H
+
+#include <algorithm>
+#include <iterator>
+#include <new>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <type_traits>
+
+#pragma pack(push, 1)
+/**
+ * A vector of trivially copyable elements that keeps up to N of them inline,
+ * in the object itself, and only goes to the heap past that. Scripts are
+ * almost all shorter than a few dozen bytes, so a transaction deserializes
+ * without one allocation per script.
+ *
+ * _size holds the element count while the elements are inline, and the
+ * count plus N + 1 once they are on the heap; the inline buffer and the
+ * heap pointer share storage. Elements are moved around with memmove, so
+ * T must not need its constructors or destructor run.
+ */
+template <unsigned int N, typename T, typename Size = uint32_t, typename Diff = int32_t>
+class prevector
+{
+public:
+    typedef Size size_type;
+    typedef Diff difference_type;
+    typedef T value_type;
+    typedef value_type& reference;
+    typedef const value_type& const_reference;
+    typedef value_type* pointer;
+    typedef const value_type* const_pointer;
+    typedef value_type* iterator;
+    typedef const value_type* const_iterator;
+    typedef std::reverse_iterator<iterator> reverse_iterator;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+private:
+    size_type _size;
+    union direct_or_indirect {
+        char direct[sizeof(T) * N];
+        struct {
+            size_type capacity;
+            char* indirect;
+        };
+    } _union = {};
+
+    T* direct_ptr(difference_type pos) { return reinterpret_cast<T*>(_union.direct) + pos; }
+    const T* direct_ptr(difference_type pos) const { return reinterpret_cast<const T*>(_union.direct) + pos; }
+    T* indirect_ptr(difference_type pos) { return reinterpret_cast<T*>(_union.indirect) + pos; }
+    const T* indirect_ptr(difference_type pos) const { return reinterpret_cast<const T*>(_union.indirect) + pos; }
+    bool is_direct() const { return _size <= N; }
+
+    T* item_ptr(difference_type pos) { return is_direct() ? direct_ptr(pos) : indirect_ptr(pos); }
+    const T* item_ptr(difference_type pos) const { return is_direct() ? direct_ptr(pos) : indirect_ptr(pos); }
+
+    void set_size(size_type new_size) { _size = is_direct() ? new_size : new_size + N + 1; }
+
+    void change_capacity(size_type new_capacity)
+    {
+        size_type n = size();
+        if (new_capacity <= N) {
+            if (!is_direct()) {
+                char* indirect = _union.indirect;
+                memcpy(_union.direct, indirect, n * sizeof(T));
+                free(indirect);
+                _size = n;
+            }
+        } else if (!is_direct()) {
+            char* indirect = static_cast<char*>(realloc(_union.indirect, (size_t)new_capacity * sizeof(T)));
+            if (!indirect)
+                throw std::bad_alloc();
+            _union.indirect = indirect;
+            _union.capacity = new_capacity;
+        } else {
+            char* indirect = static_cast<char*>(malloc((size_t)new_capacity * sizeof(T)));
+            if (!indirect)
+                throw std::bad_alloc();
+            memcpy(indirect, _union.direct, n * sizeof(T));
+            _union.indirect = indirect;
+            _union.capacity = new_capacity;
+            _size = n + N + 1;
+        }
+    }
+
+    //! room for n more elements, growing by half the size at a time
+    void grow_for(size_type n)
+    {
+        size_type new_size = size() + n;
+        if (new_size > capacity())
+            change_capacity(new_size > size() + size() / 2 ? new_size : size() + size() / 2);
+    }
+
+    //! open a gap of n elements at p
+    T* open_gap(difference_type p, size_type n)
+    {
+        size_type s = size();
+        grow_for(n);
+        T* ptr = item_ptr(p);
+        memmove(ptr + n, ptr, (s - p) * sizeof(T));
+        set_size(s + n);
+        return ptr;
+    }
+
+    //! take the elements of other, which is left empty; this must hold no heap memory
+    void take(prevector<N, T, Size, Diff>& other)
+    {
+        if (other.is_direct()) {
+            memcpy(_union.direct, other._union.direct, other._size * sizeof(T));
+        } else {
+            _union.capacity = other._union.capacity;
+            _union.indirect = other._union.indirect;
+        }
+        _size = other._size;
+        other._size = 0;
+    }
+
+public:
+    prevector() : _size(0) {}
+
+    explicit prevector(size_type n) : _size(0)
+    {
+        resize(n);
+    }
+
+    prevector(size_type n, const T& val) : _size(0)
+    {
+        assign(n, val);
+    }
+
+    template <typename InputIterator, typename = typename std::enable_if<!std::is_integral<InputIterator>::value>::type>
+    prevector(InputIterator first, InputIterator last) : _size(0)
+    {
+        assign(first, last);
+    }
+
+    prevector(const prevector<N, T, Size, Diff>& other) : _size(0)
+    {
+        assign(other.begin(), other.end());
+    }
+
+    prevector(prevector<N, T, Size, Diff>&& other) noexcept : _size(0)
+    {
+        take(other);
+    }
+
+    ~prevector()
+    {
+        if (!is_direct())
+            free(_union.indirect);
+    }
+
+    prevector& operator=(const prevector<N, T, Size, Diff>& other)
+    {
+        if (&other != this)
+            assign(other.begin(), other.end());
+        return *this;
+    }
+
+    prevector& operator=(prevector<N, T, Size, Diff>&& other) noexcept
+    {
+        if (&other != this) {
+            if (!is_direct())
+                free(_union.indirect);
+            _size = 0;
+            take(other);
+        }
+        return *this;
+    }
+
+    void assign(size_type n, const T& val)
+    {
+        clear();
+        if (capacity() < n)
+            change_capacity(n);
+        T* ptr = item_ptr(0);
+        for (size_type i = 0; i < n; i++)
+            ptr[i] = val;
+        set_size(n);
+    }
+
+    template <typename InputIterator, typename = typename std::enable_if<!std::is_integral<InputIterator>::value>::type>
+    void assign(InputIterator first, InputIterator last)
+    {
+        size_type n = std::distance(first, last);
+        clear();
+        if (capacity() < n)
+            change_capacity(n);
+        T* ptr = item_ptr(0);
+        for (; first != last; ++first)
+            *ptr++ = *first;
+        set_size(n);
+    }
+
+    size_type size() const { return is_direct() ? _size : _size - N - 1; }
+    bool empty() const { return size() == 0; }
+    size_t capacity() const { return is_direct() ? N : _union.capacity; }
+
+    iterator begin() { return item_ptr(0); }
+    const_iterator begin() const { return item_ptr(0); }
+    iterator end() { return item_ptr(size()); }
+    const_iterator end() const { return item_ptr(size()); }
+    reverse_iterator rbegin() { return reverse_iterator(end()); }
+    const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+    reverse_iterator rend() { return reverse_iterator(begin()); }
+    const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+
+    T& operator[](size_type pos) { return *item_ptr(pos); }
+    const T& operator[](size_type pos) const { return *item_ptr(pos); }
+    T& front() { return *item_ptr(0); }
+    const T& front() const { return *item_ptr(0); }
+    T& back() { return *item_ptr(size() - 1); }
+    const T& back() const { return *item_ptr(size() - 1); }
+    T* data() { return item_ptr(0); }
+    const T* data() const { return item_ptr(0); }
+
+    void reserve(size_type new_capacity)
+    {
+        if (new_capacity > capacity())
+            change_capacity(new_capacity);
+    }
+
+    void shrink_to_fit()
+    {
+        change_capacity(size());
+    }
+
+    void resize(size_type new_size, const T& val = T())
+    {
+        size_type s = size();
+        if (new_size > capacity())
+            change_capacity(new_size);
+        T* ptr = item_ptr(0);
+        for (size_type i = s; i < new_size; i++)
+            ptr[i] = val;
+        set_size(new_size);
+    }
+
+    //! like std::vector, keeps the capacity
+    void clear() { set_size(0); }
+
+    iterator insert(iterator pos, const T& value)
+    {
+        T val = value;
+        T* ptr = open_gap(pos - begin(), 1);
+        *ptr = val;
+        return ptr;
+    }
+
+    void insert(iterator pos, size_type count, const T& value)
+    {
+        T val = value;
+        T* ptr = open_gap(pos - begin(), count);
+        for (size_type i = 0; i < count; i++)
+            ptr[i] = val;
+    }
+
+    //! first and last must not point into this vector
+    template <typename InputIterator, typename = typename std::enable_if<!std::is_integral<InputIterator>::value>::type>
+    void insert(iterator pos, InputIterator first, InputIterator last)
+    {
+        T* ptr = open_gap(pos - begin(), std::distance(first, last));
+        for (; first != last; ++first)
+            *ptr++ = *first;
+    }
+
+    iterator erase(iterator pos)
+    {
+        return erase(pos, pos + 1);
+    }
+
+    iterator erase(iterator first, iterator last)
+    {
+        size_type s = size();
+        memmove(first, last, (end() - last) * sizeof(T));
+        set_size(s - (last - first));
+        return first;
+    }
+
+    void push_back(const T& value)
+    {
+        T val = value;
+        grow_for(1);
+        *item_ptr(size()) = val;
+        set_size(size() + 1);
+    }
+
+    void pop_back()
+    {
+        set_size(size() - 1);
+    }
+
+    void swap(prevector<N, T, Size, Diff>& other) noexcept
+    {
+        prevector<N, T, Size, Diff> tmp(std::move(other));
+        other.take(*this);
+        take(tmp);
+    }
+
+    //! heap memory held, for memory accounting
+    size_t allocated_memory() const
+    {
+        return is_direct() ? 0 : (size_t)_union.capacity * sizeof(T);
+    }
+
+    bool operator==(const prevector<N, T, Size, Diff>& other) const
+    {
+        return size() == other.size() && std::equal(begin(), end(), other.begin());
+    }
+
+    bool operator!=(const prevector<N, T, Size, Diff>& other) const
+    {
+        return !(*this == other);
+    }
+
+    bool operator<(const prevector<N, T, Size, Diff>& other) const
+    {
+        return std::lexicographical_compare(begin(), end(), other.begin(), other.end());
+    }
+};
+#pragma pack(pop)
+
+#endif // BITCOIN_PREVECTOR_H
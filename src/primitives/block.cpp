@@ -14,19 +14,21 @@
 #include "../util.h"
 #include "../coins.h"
 #include "../chainparams.h"
+#include "../crypto/keccak256.h"
+#include "../crypto/sha256.h"
 
 uint256 CBlockHeader::GetHash() const
 {
-    uint256 thash;
-
-    thash = HashKeccak256(BEGIN(nVersion), END(nNonce));
-
-    return thash;
+    return GetKeccakHash();
 }
 
 uint256 CBlockHeader::GetKeccakHash() const
 {
-    return HashKeccak256(BEGIN(nVersion), END(nNonce));
+    // the header fields are laid out exactly as serialized, nVersion through nNonce
+    static_assert(sizeof(CBlockHeader) == KECCAK_HEADER_SIZE, "unexpected block header layout");
+    uint256 hash;
+    KeccakHeader(hash.begin(), (const unsigned char*)BEGIN(nVersion));
+    return hash;
 }
 
 uint256 CBlock::BuildMerkleTree(bool* fMutated) const
@@ -74,15 +76,18 @@ uint256 CBlock::BuildMerkleTree(bool* fMutated) const
     bool mutated = false;
     for (int nSize = vtx.size(); nSize > 1; nSize = (nSize + 1) / 2)
     {
-        for (int i = 0; i < nSize; i += 2)
-        {
-            int i2 = std::min(i+1, nSize-1);
-            if (i2 == i + 1 && i2 + 1 == nSize && vMerkleTree[j+i] == vMerkleTree[j+i2]) {
-                // Two identical hashes at the end of the list at a particular level.
-                mutated = true;
-            }
-            vMerkleTree.push_back(Hash(BEGIN(vMerkleTree[j+i]),  END(vMerkleTree[j+i]),
-                                       BEGIN(vMerkleTree[j+i2]), END(vMerkleTree[j+i2])));
+        if (nSize % 2 == 0 && vMerkleTree[j+nSize-2] == vMerkleTree[j+nSize-1]) {
+            // Two identical hashes at the end of the list at a particular level.
+            mutated = true;
+        }
+        // The pairs of a level are adjacent 64-byte blobs: hash them in one batch.
+        int nPairs = nSize / 2;
+        vMerkleTree.resize(j + nSize + (nSize + 1) / 2);
+        SHA256D64(vMerkleTree[j+nSize].begin(), vMerkleTree[j].begin(), nPairs);
+        if (nSize % 2) {
+            // An odd node out is hashed with itself.
+            uint256 pair[2] = {vMerkleTree[j+nSize-1], vMerkleTree[j+nSize-1]};
+            SHA256D64(vMerkleTree[j+nSize+nPairs].begin(), pair[0].begin(), 1);
         }
         j += nSize;
     }
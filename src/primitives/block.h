@@ -89,6 +89,8 @@ public:
     // memory only
     mutable CScript payee;
     mutable std::vector<uint256> vMerkleTree;
+    // set by the import pipeline once the context-free checks and the block signature passed
+    mutable bool fChecked;
 
     CBlock()
     {
@@ -118,6 +120,7 @@ public:
         vMerkleTree.clear();
         payee = CScript();
         vchBlockSig.clear();
+        fChecked = false;
     }
 
     CBlockHeader GetBlockHeader() const
@@ -35,14 +35,14 @@ uint256 COutPoint::GetHash()
 CTxIn::CTxIn(COutPoint prevoutIn, CScript scriptSigIn, uint32_t nSequenceIn)
 {
     prevout = prevoutIn;
-    scriptSig = scriptSigIn;
+    scriptSig = std::move(scriptSigIn);
     nSequence = nSequenceIn;
 }
 
 CTxIn::CTxIn(uint256 hashPrevTx, uint32_t nOut, CScript scriptSigIn, uint32_t nSequenceIn)
 {
     prevout = COutPoint(hashPrevTx, nOut);
-    scriptSig = scriptSigIn;
+    scriptSig = std::move(scriptSigIn);
     nSequence = nSequenceIn;
 }
 
@@ -64,7 +64,7 @@ std::string CTxIn::ToString() const
 CTxOut::CTxOut(const CAmount& nValueIn, CScript scriptPubKeyIn)
 {
     nValue = nValueIn;
-    scriptPubKey = scriptPubKeyIn;
+    scriptPubKey = std::move(scriptPubKeyIn);
     nRounds = -10;
 }
 
@@ -120,6 +120,10 @@ CTransaction::CTransaction(const CMutableTransaction &tx) : nVersion(tx.nVersion
     UpdateHash();
 }
 
+CTransaction::CTransaction(CMutableTransaction &&tx) : nVersion(tx.nVersion), vin(std::move(tx.vin)), vout(std::move(tx.vout)), nLockTime(tx.nLockTime) {
+    UpdateHash();
+}
+
 CTransaction& CTransaction::operator=(const CTransaction &tx) {
     *const_cast<int*>(&nVersion) = tx.nVersion;
     *const_cast<std::vector<CTxIn>*>(&vin) = tx.vin;
@@ -129,6 +133,15 @@ CTransaction& CTransaction::operator=(const CTransaction &tx) {
     return *this;
 }
 
+CTransaction& CTransaction::operator=(CTransaction &&tx) {
+    *const_cast<int*>(&nVersion) = tx.nVersion;
+    vin = std::move(tx.vin);
+    vout = std::move(tx.vout);
+    *const_cast<unsigned int*>(&nLockTime) = tx.nLockTime;
+    *const_cast<uint256*>(&hash) = tx.hash;
+    return *this;
+}
+
 CAmount CTransaction::GetValueOut() const
 {
     CAmount nValueOut = 0;
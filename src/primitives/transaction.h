@@ -217,8 +217,14 @@ public:
 
     /** Convert a CMutableTransaction into a CTransaction. */
     CTransaction(const CMutableTransaction &tx);
+    /** Convert a CMutableTransaction into a CTransaction, taking its inputs and outputs over. */
+    CTransaction(CMutableTransaction &&tx);
+
+    CTransaction(const CTransaction &tx) = default;
+    CTransaction(CTransaction &&tx) = default;
 
     CTransaction& operator=(const CTransaction& tx);
+    CTransaction& operator=(CTransaction&& tx);
 
     ADD_SERIALIZE_METHODS;
 
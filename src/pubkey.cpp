@@ -6,26 +6,150 @@
 
 #include "eccryptoverify.h"
 
-#ifdef USE_SECP256K1
 #include <secp256k1.h>
-#else
-#include "ecwrapper.h"
-#endif
+
+namespace
+{
+/**
+ * Signatures are always verified with libsecp256k1. Its precomputed
+ * multiplication tables are built once, here, and are only read afterwards,
+ * so all script verification threads share them.
+ */
+class CSecp256k1VerifyInit
+{
+public:
+    CSecp256k1VerifyInit()
+    {
+        secp256k1_start(SECP256K1_START_VERIFY);
+    }
+};
+static CSecp256k1VerifyInit instance_of_csecp256k1verifyinit;
+
+/**
+ * Read the length of a DER element at pos, in short or long form, as OpenSSL
+ * did: leading zero bytes of a long form length are skipped.
+ */
+bool ParseDERLength(const unsigned char* input, size_t inputlen, size_t& pos, size_t& len)
+{
+    if (pos == inputlen)
+        return false;
+    size_t lenbyte = input[pos++];
+    if (!(lenbyte & 0x80)) {
+        len = lenbyte;
+        return true;
+    }
+    lenbyte -= 0x80;
+    if (lenbyte > inputlen - pos)
+        return false;
+    while (lenbyte > 0 && input[pos] == 0) {
+        pos++;
+        lenbyte--;
+    }
+    if (lenbyte >= sizeof(size_t))
+        return false;
+    len = 0;
+    while (lenbyte > 0) {
+        len = (len << 8) + input[pos];
+        pos++;
+        lenbyte--;
+    }
+    return true;
+}
+
+/** Read a DER integer at pos, returning where its value starts and how long it is. */
+bool ParseDERInteger(const unsigned char* input, size_t inputlen, size_t& pos, size_t& valpos, size_t& vallen)
+{
+    if (pos == inputlen || input[pos] != 0x02)
+        return false;
+    pos++;
+    if (!ParseDERLength(input, inputlen, pos, vallen))
+        return false;
+    if (vallen > inputlen - pos)
+        return false;
+    valpos = pos;
+    pos += vallen;
+    return true;
+}
+
+/** Append a DER integer holding the unsigned big endian value at p. */
+void AppendDERInteger(std::vector<unsigned char>& vch, const unsigned char* p, size_t len)
+{
+    while (len > 0 && *p == 0) {
+        p++;
+        len--;
+    }
+    bool fPad = len == 0 || (*p & 0x80);
+    vch.push_back(0x02);
+    vch.push_back(len + fPad);
+    if (fPad)
+        vch.push_back(0x00);
+    vch.insert(vch.end(), p, p + len);
+}
+
+/**
+ * Parse a signature as laxly as OpenSSL did and write it back in the strict
+ * DER libsecp256k1 expects. Signatures on the chain, block signatures
+ * included, were checked with OpenSSL before BIP66 and may carry non-minimal
+ * lengths, padded integers or trailing bytes. Returns false if the input is
+ * not a sequence of two integers, or if R or S can't fit a signature at all.
+ * Ported from ecdsa_signature_parse_der_lax in Bitcoin Core.
+ */
+bool NormalizeSignatureDER(const std::vector<unsigned char>& vchSig, std::vector<unsigned char>& vchSigDER)
+{
+    const unsigned char* input = vchSig.empty() ? NULL : &vchSig[0];
+    size_t inputlen = vchSig.size();
+    size_t pos = 0, len, rpos, rlen, spos, slen;
+
+    // Sequence tag and length; the length is not checked against the contents
+    if (pos == inputlen || input[pos] != 0x30)
+        return false;
+    pos++;
+    if (pos == inputlen)
+        return false;
+    len = input[pos++];
+    if (len & 0x80) {
+        len -= 0x80;
+        if (len > inputlen - pos)
+            return false;
+        pos += len;
+    }
+
+    if (!ParseDERInteger(input, inputlen, pos, rpos, rlen) ||
+        !ParseDERInteger(input, inputlen, pos, spos, slen))
+        return false;
+
+    // Leading zeroes are ignored; what is left must fit 32 bytes
+    while (rlen > 0 && input[rpos] == 0) {
+        rpos++;
+        rlen--;
+    }
+    while (slen > 0 && input[spos] == 0) {
+        spos++;
+        slen--;
+    }
+    if (rlen > 32 || slen > 32)
+        return false;
+
+    vchSigDER.clear();
+    vchSigDER.reserve(72);
+    vchSigDER.push_back(0x30);
+    vchSigDER.push_back(0);
+    AppendDERInteger(vchSigDER, input + rpos, rlen);
+    AppendDERInteger(vchSigDER, input + spos, slen);
+    vchSigDER[1] = vchSigDER.size() - 2;
+    return true;
+}
+} // anon namespace
 
 bool CPubKey::Verify(const uint256& hash, const std::vector<unsigned char>& vchSig) const
 {
     if (!IsValid())
         return false;
-#ifdef USE_SECP256K1
-    if (secp256k1_ecdsa_verify((const unsigned char*)&hash, 32, &vchSig[0], vchSig.size(), begin(), size()) != 1)
-        return false;
-#else
-    CECKey key;
-    if (!key.SetPubKey(begin(), size()))
+    std::vector<unsigned char> vchSigDER;
+    if (!NormalizeSignatureDER(vchSig, vchSigDER))
         return false;
-    if (!key.Verify(hash, vchSig))
+    if (secp256k1_ecdsa_verify((const unsigned char*)&hash, 32, &vchSigDER[0], vchSigDER.size(), begin(), size()) != 1)
         return false;
-#endif
     return true;
 }
 
@@ -35,19 +159,10 @@ bool CPubKey::RecoverCompact(const uint256& hash, const std::vector<unsigned cha
         return false;
     int recid = (vchSig[0] - 27) & 3;
     bool fComp = ((vchSig[0] - 27) & 4) != 0;
-#ifdef USE_SECP256K1
     int pubkeylen = 65;
     if (!secp256k1_ecdsa_recover_compact((const unsigned char*)&hash, 32, &vchSig[1], (unsigned char*)begin(), &pubkeylen, fComp, recid))
         return false;
     assert((int)size() == pubkeylen);
-#else
-    CECKey key;
-    if (!key.Recover(hash, &vchSig[1], recid))
-        return false;
-    std::vector<unsigned char> pubkey;
-    key.GetPubKey(pubkey, fComp);
-    Set(pubkey.begin(), pubkey.end());
-#endif
     return true;
 }
 
@@ -55,14 +170,8 @@ bool CPubKey::IsFullyValid() const
 {
     if (!IsValid())
         return false;
-#ifdef USE_SECP256K1
-    if (!secp256k1_ecdsa_pubkey_verify(begin(), size()))
+    if (!secp256k1_ec_pubkey_verify(begin(), size()))
         return false;
-#else
-    CECKey key;
-    if (!key.SetPubKey(begin(), size()))
-        return false;
-#endif
     return true;
 }
 
@@ -70,19 +179,10 @@ bool CPubKey::Decompress()
 {
     if (!IsValid())
         return false;
-#ifdef USE_SECP256K1
     int clen = size();
-    int ret = secp256k1_ecdsa_pubkey_decompress((unsigned char*)begin(), &clen);
-    assert(ret);
+    if (!secp256k1_ec_pubkey_decompress((unsigned char*)begin(), &clen))
+        return false;
     assert(clen == (int)size());
-#else
-    CECKey key;
-    if (!key.SetPubKey(begin(), size()))
-        return false;
-    std::vector<unsigned char> pubkey;
-    key.GetPubKey(pubkey, false);
-    Set(pubkey.begin(), pubkey.end());
-#endif
     return true;
 }
 
@@ -94,18 +194,8 @@ bool CPubKey::Derive(CPubKey& pubkeyChild, unsigned char ccChild[32], unsigned i
     unsigned char out[64];
     BIP32Hash(cc, nChild, *begin(), begin() + 1, out);
     memcpy(ccChild, out + 32, 32);
-#ifdef USE_SECP256K1
     pubkeyChild = *this;
-    bool ret = secp256k1_ecdsa_pubkey_tweak_add((unsigned char*)pubkeyChild.begin(), pubkeyChild.size(), out);
-#else
-    CECKey key;
-    bool ret = key.SetPubKey(begin(), size());
-    ret &= key.TweakPublic(out);
-    std::vector<unsigned char> pubkey;
-    key.GetPubKey(pubkey, true);
-    pubkeyChild.Set(pubkey.begin(), pubkey.end());
-#endif
-    return ret;
+    return secp256k1_ec_pubkey_tweak_add((unsigned char*)pubkeyChild.begin(), pubkeyChild.size(), out);
 }
 
 void CExtPubKey::Encode(unsigned char code[74]) const
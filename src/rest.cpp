@@ -3,12 +3,15 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "coins.h"
 #include "main.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
+#include "rpc/jsonwriter.h"
 #include "rpc/server.h"
 #include "streams.h"
 #include "sync.h"
+#include "txmempool.h"
 #include "utilstrencodings.h"
 #include "version.h"
 
@@ -35,6 +38,13 @@ static const struct {
     {RF_JSON, "json"},
 };
 
+//! Most headers one /rest/headers/ request returns
+static const long MAX_REST_HEADERS_RESULTS = 2000;
+//! Most outputs one /rest/getutxos/ request asks about
+static const size_t MAX_GETUTXOS_OUTPOINTS = 15;
+//! Seconds clients and proxies may keep a reply that never changes, such as the bytes of a block
+static const int REST_CACHE_MAX_AGE = 86400;
+
 class RestErr
 {
 public:
@@ -42,8 +52,27 @@ public:
     string message;
 };
 
+/** An unspent output as /rest/getutxos/ returns it. */
+struct CCoin {
+    uint32_t nTxVer; // Don't call this nVersion, that name has a special meaning inside IMPLEMENT_SERIALIZE
+    uint32_t nHeight;
+    CTxOut out;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(nTxVer);
+        READWRITE(nHeight);
+        READWRITE(out);
+    }
+};
+
 extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry);
-extern UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false);
+extern void ScriptPubKeyToJSON(const CScript& scriptPubKey, UniValue& out, bool fIncludeHex);
+extern void blockToJSON(const CBlock& block, const CBlockIndex* blockindex, CJSONWriter& writer, bool txDetails);
+extern UniValue blockHeaderToJSON(const CBlockHeader& block, const CBlockIndex* blockindex);
 
 static RestErr RESTERR(enum HTTPStatusCode status, string message)
 {
@@ -90,6 +119,57 @@ static bool ParseHashStr(const string& strReq, uint256& v)
     return true;
 }
 
+/**
+ * The caching headers of a reply. A reply that never changes for its URI may
+ * be kept by clients and proxies; the others are to be revalidated with their
+ * ETag, if they have one, each time they are used.
+ */
+static string CacheHeaders(const string& strETag, bool fImmutable)
+{
+    string strHeaders;
+    if (!strETag.empty())
+        strHeaders += "ETag: \"" + strETag + "\"\r\n";
+    if (fImmutable)
+        strHeaders += strprintf("Cache-Control: public, max-age=%d\r\n", REST_CACHE_MAX_AGE);
+    else
+        strHeaders += "Cache-Control: no-cache\r\n";
+    return strHeaders;
+}
+
+/**
+ * Answer with 304 Not Modified if the client already holds the reply tagged
+ * strETag, which spares building it again. Returns whether it did.
+ */
+static bool RESTNotModified(AcceptedConnection* conn, map<string, string>& mapHeaders, bool fRun, const string& strETag, bool fImmutable)
+{
+    map<string, string>::const_iterator it = mapHeaders.find("if-none-match");
+    if (it == mapHeaders.end() || (it->second != "*" && it->second.find("\"" + strETag + "\"") == string::npos))
+        return false;
+
+    conn->stream() << HTTPReplyHeader(HTTP_NOT_MODIFIED, fRun, 0, "text/plain", CacheHeaders(strETag, fImmutable)) << std::flush;
+    return true;
+}
+
+/** Send strBody as a reply in the format rf, with its caching headers. */
+static bool RESTReply(AcceptedConnection* conn, bool fRun, enum RetFormat rf, const string& strBody, const string& strETag, bool fImmutable)
+{
+    const char* contentType = "application/json";
+    if (rf == RF_BINARY)
+        contentType = "application/octet-stream";
+    else if (rf == RF_HEX)
+        contentType = "text/plain";
+
+    conn->stream() << HTTPReplyHeader(HTTP_OK, fRun, strBody.size(), contentType, CacheHeaders(strETag, fImmutable)) << strBody << std::flush;
+    return true;
+}
+
+//! The hash of the tip, for the ETags of replies that depend on the active chain
+static string GetTipETag()
+{
+    LOCK(cs_main);
+    return chainActive.Tip()->GetBlockHash().GetHex();
+}
+
 static bool rest_block(AcceptedConnection* conn,
     string& strReq,
     map<string, string>& mapHeaders,
@@ -106,37 +186,47 @@ static bool rest_block(AcceptedConnection* conn,
 
     CBlock block;
     CBlockIndex* pblockindex = NULL;
+    CDiskBlockPos pos;
+    string strTip;
     {
         LOCK(cs_main);
         if (mapBlockIndex.count(hash) == 0)
             throw RESTERR(HTTP_NOT_FOUND, hashStr + " not found");
 
         pblockindex = mapBlockIndex[hash];
-        if (!ReadBlockFromDisk(block, pblockindex))
-            throw RESTERR(HTTP_NOT_FOUND, hashStr + " not found");
+        if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+            throw RESTERR(HTTP_NOT_FOUND, hashStr + " not available (pruned data)");
+        pos = pblockindex->GetBlockPos();
+        strTip = chainActive.Tip()->GetBlockHash().GetHex();
     }
 
-    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
-    ssBlock << block;
+    // the bytes of a block never change, its JSON tells where it is in the active chain
+    const bool fImmutable = rf != RF_JSON;
+    const string strETag = fImmutable ? hashStr : hashStr + "-" + strTip;
+    if (RESTNotModified(conn, mapHeaders, fRun, strETag, fImmutable))
+        return true;
+
+    // the block is read without cs_main, so that requests go on next to each other and to validation
+    if (!ReadBlockFromDisk(block, pos) || block.GetHash() != hash)
+        throw RESTERR(HTTP_NOT_FOUND, hashStr + " not found");
 
     switch (rf) {
     case RF_BINARY: {
-        string binaryBlock = ssBlock.str();
-        conn->stream() << HTTPReplyHeader(HTTP_OK, fRun, binaryBlock.size(), "application/octet-stream") << binaryBlock << std::flush;
-        return true;
+        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+        ssBlock << block;
+        return RESTReply(conn, fRun, rf, ssBlock.str(), strETag, fImmutable);
     }
 
     case RF_HEX: {
-        string strHex = HexStr(ssBlock.begin(), ssBlock.end()) + "\n";
-        conn->stream() << HTTPReply(HTTP_OK, strHex, fRun, false, "text/plain") << std::flush;
-        return true;
+        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+        ssBlock << block;
+        return RESTReply(conn, fRun, rf, HexStr(ssBlock.begin(), ssBlock.end()) + "\n", strETag, fImmutable);
     }
 
     case RF_JSON: {
-        UniValue objBlock = blockToJSON(block, pblockindex, showTxDetails);
-        string strJSON = objBlock.write() + "\n";
-        conn->stream() << HTTPReply(HTTP_OK, strJSON, fRun) << std::flush;
-        return true;
+        CJSONStreamWriter writer;
+        blockToJSON(block, pblockindex, writer, showTxDetails);
+        return RESTReply(conn, fRun, rf, writer.GetBuffer() + "\n", strETag, fImmutable);
     }
 
     default: {
@@ -177,6 +267,12 @@ static bool rest_tx(AcceptedConnection* conn,
     if (!ParseHashStr(hashStr, hash))
         throw RESTERR(HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
 
+    // the bytes of a transaction never change, its JSON tells its confirmations
+    const bool fImmutable = rf != RF_JSON;
+    const string strETag = fImmutable ? hashStr : hashStr + "-" + GetTipETag();
+    if (RESTNotModified(conn, mapHeaders, fRun, strETag, fImmutable))
+        return true;
+
     CTransaction tx;
     uint256 hashBlock = 0;
     if (!GetTransaction(hash, tx, hashBlock, true))
@@ -187,23 +283,206 @@ static bool rest_tx(AcceptedConnection* conn,
 
     switch (rf) {
     case RF_BINARY: {
-        string binaryTx = ssTx.str();
-        conn->stream() << HTTPReplyHeader(HTTP_OK, fRun, binaryTx.size(), "application/octet-stream") << binaryTx << std::flush;
-        return true;
+        return RESTReply(conn, fRun, rf, ssTx.str(), strETag, fImmutable);
     }
 
     case RF_HEX: {
-        string strHex = HexStr(ssTx.begin(), ssTx.end()) + "\n";
-        conn->stream() << HTTPReply(HTTP_OK, strHex, fRun, false, "text/plain") << std::flush;
-        return true;
+        return RESTReply(conn, fRun, rf, HexStr(ssTx.begin(), ssTx.end()) + "\n", strETag, fImmutable);
     }
 
     case RF_JSON: {
         UniValue objTx(UniValue::VOBJ);
-        TxToJSON(tx, hashBlock, objTx);
-        string strJSON = objTx.write() + "\n";
-        conn->stream() << HTTPReply(HTTP_OK, strJSON, fRun) << std::flush;
+        {
+            LOCK(cs_main);
+            TxToJSON(tx, hashBlock, objTx);
+        }
+        return RESTReply(conn, fRun, rf, objTx.write() + "\n", strETag, fImmutable);
+    }
+
+    default: {
+        throw RESTERR(HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
+static bool rest_headers(AcceptedConnection* conn,
+    string& strReq,
+    map<string, string>& mapHeaders,
+    bool fRun)
+{
+    vector<string> params;
+    enum RetFormat rf = ParseDataFormat(params, strReq);
+    vector<string> path;
+    boost::split(path, params[0], boost::is_any_of("/"));
+
+    if (path.size() != 2)
+        throw RESTERR(HTTP_BAD_REQUEST, "No header count specified. Use /rest/headers/<count>/<hash>.<ext>.");
+
+    long count = strtol(path[0].c_str(), NULL, 10);
+    if (count < 1 || count > MAX_REST_HEADERS_RESULTS)
+        throw RESTERR(HTTP_BAD_REQUEST, strprintf("Header count out of range: %s", path[0]));
+
+    string hashStr = path[1];
+    uint256 hash;
+    if (!ParseHashStr(hashStr, hash))
+        throw RESTERR(HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
+
+    // the headers from hash on along the active chain, none if it is not on it
+    vector<const CBlockIndex*> headers;
+    headers.reserve(count);
+    string strETag;
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator it = mapBlockIndex.find(hash);
+        const CBlockIndex* pindex = (it != mapBlockIndex.end()) ? it->second : NULL;
+        while (pindex != NULL && chainActive.Contains(pindex)) {
+            headers.push_back(pindex);
+            if (headers.size() == (unsigned long)count)
+                break;
+            pindex = chainActive.Next(pindex);
+        }
+        strETag = chainActive.Tip()->GetBlockHash().GetHex();
+    }
+    if (RESTNotModified(conn, mapHeaders, fRun, strETag, false))
         return true;
+
+    CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+    BOOST_FOREACH (const CBlockIndex* pindex, headers)
+        ssHeader << pindex->GetBlockHeader();
+
+    switch (rf) {
+    case RF_BINARY: {
+        return RESTReply(conn, fRun, rf, ssHeader.str(), strETag, false);
+    }
+
+    case RF_HEX: {
+        return RESTReply(conn, fRun, rf, HexStr(ssHeader.begin(), ssHeader.end()) + "\n", strETag, false);
+    }
+
+    case RF_JSON: {
+        UniValue jsonHeaders(UniValue::VARR);
+        BOOST_FOREACH (const CBlockIndex* pindex, headers) {
+            UniValue objHeader(UniValue::VOBJ);
+            objHeader.push_back(Pair("hash", pindex->GetBlockHash().GetHex()));
+            objHeader.push_back(Pair("height", pindex->nHeight));
+            objHeader.pushKVs(blockHeaderToJSON(pindex->GetBlockHeader(), pindex));
+            jsonHeaders.push_back(objHeader);
+        }
+        return RESTReply(conn, fRun, rf, jsonHeaders.write() + "\n", strETag, false);
+    }
+
+    default: {
+        throw RESTERR(HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
+static bool rest_getutxos(AcceptedConnection* conn,
+    string& strReq,
+    map<string, string>& mapHeaders,
+    bool fRun)
+{
+    vector<string> params;
+    enum RetFormat rf = ParseDataFormat(params, strReq);
+    vector<string> uriParts;
+    boost::split(uriParts, params[0], boost::is_any_of("/"));
+
+    // /rest/getutxos/checkmempool/<txid>-<n>/... also looks at the mempool
+    size_t nFirst = 0;
+    bool fCheckMemPool = false;
+    if (uriParts[0] == "checkmempool") {
+        fCheckMemPool = true;
+        nFirst = 1;
+    }
+    if (uriParts.size() <= nFirst || uriParts[nFirst].empty())
+        throw RESTERR(HTTP_BAD_REQUEST, "Error: empty request");
+    if (uriParts.size() - nFirst > MAX_GETUTXOS_OUTPOINTS)
+        throw RESTERR(HTTP_BAD_REQUEST, strprintf("Error: max outpoints exceeded (max: %d, tried: %d)", MAX_GETUTXOS_OUTPOINTS, uriParts.size() - nFirst));
+
+    vector<COutPoint> vOutPoints;
+    for (size_t i = nFirst; i < uriParts.size(); i++) {
+        vector<string> vOutPoint;
+        boost::split(vOutPoint, uriParts[i], boost::is_any_of("-"));
+        uint256 txid;
+        int32_t nOutput;
+        if (vOutPoint.size() != 2 || !ParseHashStr(vOutPoint[0], txid) || !ParseInt32(vOutPoint[1], &nOutput) || nOutput < 0)
+            throw RESTERR(HTTP_BAD_REQUEST, "Parse error: " + uriParts[i]);
+        vOutPoints.push_back(COutPoint(txid, (uint32_t)nOutput));
+    }
+
+    // one bit per outpoint, set if it is unspent, and the unspent outputs in order
+    vector<unsigned char> bitmap((vOutPoints.size() + 7) / 8);
+    string bitmapStringRepresentation;
+    vector<CCoin> outs;
+    int nHeight;
+    uint256 hashTip;
+    {
+        LOCK2(cs_main, mempool.cs);
+        CCoinsViewMemPool viewMemPool(pcoinsTip, mempool);
+        const CCoinsView& view = fCheckMemPool ? (const CCoinsView&)viewMemPool : (const CCoinsView&)*pcoinsTip;
+
+        for (size_t i = 0; i < vOutPoints.size(); i++) {
+            CCoins coins;
+            bool fHit = false;
+            if (view.GetCoins(vOutPoints[i].hash, coins)) {
+                // the outputs the mempool spends are spent already
+                if (fCheckMemPool)
+                    mempool.pruneSpent(vOutPoints[i].hash, coins);
+                if (coins.IsAvailable(vOutPoints[i].n)) {
+                    fHit = true;
+                    CCoin coin;
+                    coin.nTxVer = coins.nVersion;
+                    coin.nHeight = coins.nHeight;
+                    coin.out = coins.vout[vOutPoints[i].n];
+                    outs.push_back(coin);
+                }
+            }
+            bitmapStringRepresentation.append(fHit ? "1" : "0");
+            bitmap[i / 8] |= ((unsigned char)fHit) << (i % 8);
+        }
+        nHeight = chainActive.Height();
+        hashTip = chainActive.Tip()->GetBlockHash();
+    }
+
+    switch (rf) {
+    case RF_BINARY: {
+        CDataStream ssGetUTXOResponse(SER_NETWORK, PROTOCOL_VERSION);
+        ssGetUTXOResponse << nHeight << hashTip << bitmap << outs;
+        return RESTReply(conn, fRun, rf, ssGetUTXOResponse.str(), "", false);
+    }
+
+    case RF_HEX: {
+        CDataStream ssGetUTXOResponse(SER_NETWORK, PROTOCOL_VERSION);
+        ssGetUTXOResponse << nHeight << hashTip << bitmap << outs;
+        return RESTReply(conn, fRun, rf, HexStr(ssGetUTXOResponse.begin(), ssGetUTXOResponse.end()) + "\n", "", false);
+    }
+
+    case RF_JSON: {
+        UniValue objGetUTXOResponse(UniValue::VOBJ);
+        objGetUTXOResponse.push_back(Pair("chainHeight", nHeight));
+        objGetUTXOResponse.push_back(Pair("chaintipHash", hashTip.GetHex()));
+        objGetUTXOResponse.push_back(Pair("bitmap", bitmapStringRepresentation));
+
+        UniValue utxos(UniValue::VARR);
+        BOOST_FOREACH (const CCoin& coin, outs) {
+            UniValue utxo(UniValue::VOBJ);
+            utxo.push_back(Pair("txvers", (int32_t)coin.nTxVer));
+            utxo.push_back(Pair("height", (int32_t)coin.nHeight));
+            utxo.push_back(Pair("value", ValueFromAmount(coin.out.nValue)));
+
+            UniValue o(UniValue::VOBJ);
+            ScriptPubKeyToJSON(coin.out.scriptPubKey, o, true);
+            utxo.push_back(Pair("scriptPubKey", o));
+            utxos.push_back(utxo);
+        }
+        objGetUTXOResponse.push_back(Pair("utxos", utxos));
+        return RESTReply(conn, fRun, rf, objGetUTXOResponse.write() + "\n", "", false);
     }
 
     default: {
@@ -215,6 +494,117 @@ static bool rest_tx(AcceptedConnection* conn,
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+static bool rest_chaininfo(AcceptedConnection* conn,
+    string& strReq,
+    map<string, string>& mapHeaders,
+    bool fRun)
+{
+    vector<string> params;
+    enum RetFormat rf = ParseDataFormat(params, strReq);
+
+    switch (rf) {
+    case RF_JSON: {
+        UniValue rpcParams(UniValue::VARR);
+        UniValue chainInfoObject = getblockchaininfo(rpcParams, false);
+        return RESTReply(conn, fRun, rf, chainInfoObject.write() + "\n", "", false);
+    }
+
+    default: {
+        throw RESTERR(HTTP_NOT_FOUND, "output format not found (available: json)");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
+//! What the mempool replies depend on: the transactions in it, and for their priorities the tip
+static string GetMemPoolETag()
+{
+    return strprintf("%s-%u", GetTipETag(), mempool.GetTransactionsUpdated());
+}
+
+static bool rest_mempool_info(AcceptedConnection* conn,
+    string& strReq,
+    map<string, string>& mapHeaders,
+    bool fRun)
+{
+    vector<string> params;
+    enum RetFormat rf = ParseDataFormat(params, strReq);
+
+    switch (rf) {
+    case RF_JSON: {
+        const string strETag = GetMemPoolETag();
+        if (RESTNotModified(conn, mapHeaders, fRun, strETag, false))
+            return true;
+        UniValue rpcParams(UniValue::VARR);
+        UniValue mempoolInfoObject = getmempoolinfo(rpcParams, false);
+        return RESTReply(conn, fRun, rf, mempoolInfoObject.write() + "\n", strETag, false);
+    }
+
+    default: {
+        throw RESTERR(HTTP_NOT_FOUND, "output format not found (available: json)");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
+static bool rest_mempool_contents(AcceptedConnection* conn,
+    string& strReq,
+    map<string, string>& mapHeaders,
+    bool fRun)
+{
+    vector<string> params;
+    enum RetFormat rf = ParseDataFormat(params, strReq);
+
+    switch (rf) {
+    case RF_JSON: {
+        const string strETag = GetMemPoolETag();
+        if (RESTNotModified(conn, mapHeaders, fRun, strETag, false))
+            return true;
+        UniValue rpcParams(UniValue::VARR);
+        rpcParams.push_back(true);
+        CJSONStreamWriter writer;
+        getrawmempool_stream(rpcParams, false, writer);
+        return RESTReply(conn, fRun, rf, writer.GetBuffer() + "\n", strETag, false);
+    }
+
+    default: {
+        throw RESTERR(HTTP_NOT_FOUND, "output format not found (available: json)");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
+static bool rest_masternodes(AcceptedConnection* conn,
+    string& strReq,
+    map<string, string>& mapHeaders,
+    bool fRun)
+{
+    vector<string> params;
+    enum RetFormat rf = ParseDataFormat(params, strReq);
+
+    switch (rf) {
+    case RF_JSON: {
+        UniValue rpcParams(UniValue::VARR);
+        CJSONStreamWriter writer;
+        listmasternodes_stream(rpcParams, false, writer);
+        return RESTReply(conn, fRun, rf, writer.GetBuffer() + "\n", "", false);
+    }
+
+    default: {
+        throw RESTERR(HTTP_NOT_FOUND, "output format not found (available: json)");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
 static const struct {
     const char* prefix;
     bool (*handler)(AcceptedConnection* conn,
@@ -225,6 +615,12 @@ static const struct {
     {"/rest/tx/", rest_tx},
     {"/rest/block/notxdetails/", rest_block_notxdetails},
     {"/rest/block/", rest_block_extended},
+    {"/rest/headers/", rest_headers},
+    {"/rest/getutxos/", rest_getutxos},
+    {"/rest/chaininfo", rest_chaininfo},
+    {"/rest/mempool/info", rest_mempool_info},
+    {"/rest/mempool/contents", rest_mempool_contents},
+    {"/rest/masternodes", rest_masternodes},
 };
 
 bool HTTPReq_REST(AcceptedConnection* conn,
@@ -7,14 +7,20 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "checkpoints.h"
+#include "core_io.h"
 #include "main.h"
+#include "rpc/jsonwriter.h"
 #include "rpc/server.h"
 #include "sync.h"
 #include "util.h"
+#include "utxosnapshot.h"
+#include "utxostats.h"
 
 #include <stdint.h>
 #include <univalue.h>
 
+#include <boost/filesystem.hpp>
+
 using namespace std;
 
 struct CUpdatedBlock
@@ -26,7 +32,6 @@ static std::mutex cs_blockchange;
 static std::condition_variable cond_blockchange;
 static CUpdatedBlock latestblock;
 
-extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry);
 void ScriptPubKeyToJSON(const CScript& scriptPubKey, UniValue& out, bool fIncludeHex);
 
 double GetDifficulty(const CBlockIndex* blockindex)
@@ -58,45 +63,55 @@ double GetDifficulty(const CBlockIndex* blockindex)
 }
 
 
-UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false)
+/**
+ * Write the fields of a block. Only the chain position is looked up under
+ * cs_main; the transactions are written without it, as they are what takes long.
+ */
+void blockToJSON(const CBlock& block, const CBlockIndex* blockindex, CJSONWriter& writer, bool txDetails)
 {
-    UniValue result(UniValue::VOBJ);
-    result.push_back(Pair("hash", block.GetHash().GetHex()));
     int confirmations = -1;
-    // Only report confirmations if the block is on the main chain
-    if (chainActive.Contains(blockindex))
-        confirmations = chainActive.Height() - blockindex->nHeight + 1;
-    result.push_back(Pair("confirmations", confirmations));
-    result.push_back(Pair("size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION)));
-    result.push_back(Pair("height", blockindex->nHeight));
-    result.push_back(Pair("version", block.nVersion));
-    result.push_back(Pair("merkleroot", block.hashMerkleRoot.GetHex()));
-    UniValue txs(UniValue::VARR);
+    const CBlockIndex* pnext;
+    {
+        LOCK(cs_main);
+        // Only report confirmations if the block is on the main chain
+        if (chainActive.Contains(blockindex))
+            confirmations = chainActive.Height() - blockindex->nHeight + 1;
+        pnext = chainActive.Next(blockindex);
+    }
+
+    writer.BeginObject();
+    writer.KeyValue("hash", block.GetHash().GetHex());
+    writer.KeyValue("confirmations", confirmations);
+    writer.KeyValue("size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION));
+    writer.KeyValue("height", blockindex->nHeight);
+    writer.KeyValue("version", block.nVersion);
+    writer.KeyValue("merkleroot", block.hashMerkleRoot.GetHex());
+    writer.Key("tx");
+    writer.BeginArray();
     for (const CTransaction& tx : block.vtx) {
         if (txDetails) {
             UniValue objTx(UniValue::VOBJ);
-            TxToJSON(tx, uint256(0), objTx);
-            txs.push_back(objTx);
+            TxToUniv(tx, uint256(0), objTx);
+            writer.Value(objTx);
         } else
-            txs.push_back(tx.GetHash().GetHex());
+            writer.Value(tx.GetHash().GetHex());
     }
-    result.push_back(Pair("tx", txs));
-    result.push_back(Pair("time", block.GetBlockTime()));
-    result.push_back(Pair("nonce", (uint64_t)block.nNonce));
-    result.push_back(Pair("bits", strprintf("%08x", block.nBits)));
-    result.push_back(Pair("difficulty", GetDifficulty(blockindex)));
-    result.push_back(Pair("chainwork", blockindex->nChainWork.GetHex()));
+    writer.EndArray();
+    writer.KeyValue("time", block.GetBlockTime());
+    writer.KeyValue("nonce", (uint64_t)block.nNonce);
+    writer.KeyValue("bits", strprintf("%08x", block.nBits));
+    writer.KeyValue("difficulty", GetDifficulty(blockindex));
+    writer.KeyValue("chainwork", blockindex->nChainWork.GetHex());
 
     if (blockindex->pprev)
-        result.push_back(Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex()));
-    CBlockIndex* pnext = chainActive.Next(blockindex);
+        writer.KeyValue("previousblockhash", blockindex->pprev->GetBlockHash().GetHex());
     if (pnext)
-        result.push_back(Pair("nextblockhash", pnext->GetBlockHash().GetHex()));
-    return result;
+        writer.KeyValue("nextblockhash", pnext->GetBlockHash().GetHex());
+    writer.EndObject();
 }
 
 
-UniValue blockHeaderToJSON(const CBlock& block, const CBlockIndex* blockindex)
+UniValue blockHeaderToJSON(const CBlockHeader& block, const CBlockIndex* blockindex)
 {
     UniValue result(UniValue::VOBJ);
     result.push_back(Pair("version", block.nVersion));
@@ -167,7 +182,7 @@ UniValue getdifficulty(const UniValue& params, bool fHelp)
 }
 
 
-UniValue getrawmempool(const UniValue& params, bool fHelp)
+void getrawmempool_stream(const UniValue& params, bool fHelp, CJSONWriter& writer)
 {
     if (fHelp || params.size() > 1)
         throw runtime_error(
@@ -201,47 +216,64 @@ UniValue getrawmempool(const UniValue& params, bool fHelp)
     if (params.size() > 0)
         fVerbose = params[0].get_bool();
 
-    if (fVerbose) {
-        LOCK(mempool.cs);
-        UniValue o(UniValue::VOBJ);
-        for (const PAIRTYPE(uint256, CTxMemPoolEntry) & entry : mempool.mapTx) {
-            const uint256& hash = entry.first;
-            const CTxMemPoolEntry& e = entry.second;
-            UniValue info(UniValue::VOBJ);
-            info.push_back(Pair("size", (int)e.GetTxSize()));
-            info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
-            info.push_back(Pair("time", e.GetTime()));
-            info.push_back(Pair("height", (int)e.GetHeight()));
-            info.push_back(Pair("startingpriority", e.GetPriority(e.GetHeight())));
-            info.push_back(Pair("currentpriority", e.GetPriority(chainActive.Height())));
-            const CTransaction& tx = e.GetTx();
-            set<string> setDepends;
-            for (const CTxIn& txin : tx.vin) {
-                if (mempool.exists(txin.prevout.hash))
-                    setDepends.insert(txin.prevout.hash.ToString());
-            }
+    vector<uint256> vtxid;
+    mempool.queryHashes(vtxid);
 
-            UniValue depends(UniValue::VARR);
-            for (const string& dep : setDepends) {
-                depends.push_back(dep);
+    if (fVerbose) {
+        // the entries are collected a batch at a time under mempool.cs, and written once it is released
+        std::vector<std::pair<std::string, UniValue> > vRows;
+        writer.BeginObject();
+        for (size_t nStart = 0; nStart < vtxid.size(); nStart += RPC_STREAM_BATCH_ROWS) {
+            {
+                LOCK(mempool.cs);
+                size_t nEnd = std::min(vtxid.size(), nStart + RPC_STREAM_BATCH_ROWS);
+                for (size_t i = nStart; i < nEnd; i++) {
+                    std::map<uint256, CTxMemPoolEntry>::const_iterator it = mempool.mapTx.find(vtxid[i]);
+                    // gone from the mempool since the ids were taken
+                    if (it == mempool.mapTx.end())
+                        continue;
+                    const CTxMemPoolEntry& e = it->second;
+                    UniValue info(UniValue::VOBJ);
+                    info.push_back(Pair("size", (int)e.GetTxSize()));
+                    info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
+                    info.push_back(Pair("time", e.GetTime()));
+                    info.push_back(Pair("height", (int)e.GetHeight()));
+                    info.push_back(Pair("startingpriority", e.GetPriority(e.GetHeight())));
+                    info.push_back(Pair("currentpriority", e.GetPriority(chainActive.Height())));
+                    const CTransaction& tx = e.GetTx();
+                    set<string> setDepends;
+                    for (const CTxIn& txin : tx.vin) {
+                        if (mempool.exists(txin.prevout.hash))
+                            setDepends.insert(txin.prevout.hash.ToString());
+                    }
+
+                    UniValue depends(UniValue::VARR);
+                    for (const string& dep : setDepends) {
+                        depends.push_back(dep);
+                    }
+
+                    info.push_back(Pair("depends", depends));
+                    vRows.push_back(std::make_pair(vtxid[i].ToString(), info));
+                }
             }
-
-            info.push_back(Pair("depends", depends));
-            o.push_back(Pair(hash.ToString(), info));
+            for (const std::pair<std::string, UniValue>& row : vRows)
+                writer.KeyValue(row.first, row.second);
+            vRows.clear();
         }
-        return o;
+        writer.EndObject();
     } else {
-        vector<uint256> vtxid;
-        mempool.queryHashes(vtxid);
-
-        UniValue a(UniValue::VARR);
+        writer.BeginArray();
         for (const uint256& hash : vtxid)
-            a.push_back(hash.ToString());
-
-        return a;
+            writer.Value(hash.ToString());
+        writer.EndArray();
     }
 }
 
+UniValue getrawmempool(const UniValue& params, bool fHelp)
+{
+    return RPCStreamToValue(&getrawmempool_stream, params, fHelp);
+}
+
 UniValue getblockhash(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 1)
@@ -265,17 +297,18 @@ UniValue getblockhash(const UniValue& params, bool fHelp)
     return pblockindex->GetBlockHash().GetHex();
 }
 
-UniValue getblock(const UniValue& params, bool fHelp)
+void getblock_stream(const UniValue& params, bool fHelp, CJSONWriter& writer)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
         throw runtime_error(
-            "getblock \"hash\" ( verbose )\n"
-            "\nIf verbose is false, returns a string that is serialized, hex-encoded data for block 'hash'.\n"
-            "If verbose is true, returns an Object with information about block <hash>.\n"
+            "getblock \"hash\" ( verbosity )\n"
+            "\nIf verbosity is 0 or false, returns a string that is serialized, hex-encoded data for block 'hash'.\n"
+            "If verbosity is 1 or true, returns an Object with information about block <hash>.\n"
+            "If verbosity is 2, returns an Object with information about block <hash> and information about each transaction.\n"
             "\nArguments:\n"
             "1. \"hash\"          (string, required) The block hash\n"
-            "2. verbose           (boolean, optional, default=true) true for a json object, false for the hex encoded data\n"
-            "\nResult (for verbose = true):\n"
+            "2. verbosity         (numeric or boolean, optional, default=1) 0 for hex encoded data, 1 for a json object, and 2 for json object with transaction data\n"
+            "\nResult (for verbosity = 1):\n"
             "{\n"
             "  \"hash\" : \"hash\",     (string) the block hash (same as provided)\n"
             "  \"confirmations\" : n,   (numeric) The number of confirmations, or -1 if the block is not on the main chain\n"
@@ -294,36 +327,63 @@ UniValue getblock(const UniValue& params, bool fHelp)
             "  \"previousblockhash\" : \"hash\",  (string) The hash of the previous block\n"
             "  \"nextblockhash\" : \"hash\"       (string) The hash of the next block\n"
             "}\n"
-            "\nResult (for verbose=false):\n"
+            "\nResult (for verbosity = 2):\n"
+            "{\n"
+            "  ...,                   Same output as verbosity = 1, except that\n"
+            "  \"tx\" : [               (array of Objects) The transactions in the format of the getrawtransaction RPC\n"
+            "     ,...\n"
+            "  ],\n"
+            "  ,...\n"
+            "}\n"
+            "\nResult (for verbosity = 0):\n"
             "\"data\"             (string) A string that is serialized, hex-encoded data for block 'hash'.\n"
             "\nExamples:\n" +
             HelpExampleCli("getblock", "\"00000000000fd08c2fb661d2fcb0d49abb3a91e5f27082ce64feed3b4dede2e2\"") + HelpExampleRpc("getblock", "\"00000000000fd08c2fb661d2fcb0d49abb3a91e5f27082ce64feed3b4dede2e2\""));
-    LOCK(cs_main);
 
     std::string strHash = params[0].get_str();
     uint256 hash(strHash);
 
-    bool fVerbose = true;
-    if (params.size() > 1)
-        fVerbose = params[1].get_bool();
-
-    if (mapBlockIndex.count(hash) == 0)
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+    int nVerbosity = 1;
+    if (params.size() > 1) {
+        if (params[1].isNum())
+            nVerbosity = params[1].get_int();
+        else
+            nVerbosity = params[1].get_bool() ? 1 : 0;
+    }
 
     CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
+    CBlockIndex* pblockindex;
+    CDiskBlockPos pos;
+    {
+        LOCK(cs_main);
+        if (mapBlockIndex.count(hash) == 0)
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+
+        pblockindex = mapBlockIndex[hash];
+
+        if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
+        pos = pblockindex->GetBlockPos();
+    }
 
-    if (!ReadBlockFromDisk(block, pblockindex))
+    // the block is read without cs_main, so that block reads go on next to each other and to validation
+    if (!ReadBlockFromDisk(block, pos) || block.GetHash() != hash)
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
 
-    if (!fVerbose) {
+    if (nVerbosity <= 0) {
         CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
         ssBlock << block;
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
-        return strHex;
+        const unsigned char* pbegin = (const unsigned char*)&ssBlock[0];
+        writer.HexValue(pbegin, pbegin + ssBlock.size());
+        return;
     }
 
-    return blockToJSON(block, pblockindex);
+    blockToJSON(block, pblockindex, writer, nVerbosity >= 2);
+}
+
+UniValue getblock(const UniValue& params, bool fHelp)
+{
+    return RPCStreamToValue(&getblock_stream, params, fHelp);
 }
 
 UniValue getblockheader(const UniValue& params, bool fHelp)
@@ -357,13 +417,25 @@ UniValue getblockheader(const UniValue& params, bool fHelp)
     if (params.size() > 1)
         fVerbose = params[1].get_bool();
 
-    if (mapBlockIndex.count(hash) == 0)
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
-
     CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
+    CBlockIndex* pblockindex;
+    bool fHaveData;
+    CDiskBlockPos pos;
+    {
+        LOCK(cs_main);
+        if (mapBlockIndex.count(hash) == 0)
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+
+        pblockindex = mapBlockIndex[hash];
+        fHaveData = pblockindex->nStatus & BLOCK_HAVE_DATA;
+        // the header is kept in the block index after its block file is pruned
+        if (!fHaveData)
+            block = CBlock(pblockindex->GetBlockHeader());
+        else
+            pos = pblockindex->GetBlockPos();
+    }
 
-    if (!ReadBlockFromDisk(block, pblockindex))
+    if (fHaveData && (!ReadBlockFromDisk(block, pos) || block.GetHash() != hash))
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
 
     if (!fVerbose) {
@@ -373,33 +445,56 @@ UniValue getblockheader(const UniValue& params, bool fHelp)
         return strHex;
     }
 
+    LOCK(cs_main);
     return blockHeaderToJSON(block, pblockindex);
 }
 
 UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
 {
-    if (fHelp || params.size() != 0)
+    if (fHelp || params.size() > 1)
         throw runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( \"hash_type\" )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "With hash_type \"legacy\" every call scans the whole set, which takes some time.\n"
+            "With hash_type \"muhash\" they are kept up to date as blocks come in, so only the first call after an upgrade takes some time.\n"
+            "\nArguments:\n"
+            "1. \"hash_type\"    (string, optional, default=\"legacy\") Which hash of the set to return: \"legacy\" or \"muhash\"\n"
             "\nResult:\n"
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
             "  \"bestblock\": \"hex\",   (string) the best block hash hex\n"
             "  \"transactions\": n,      (numeric) The number of transactions\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
-            "  \"bytes_serialized\": n,  (numeric) The serialized size\n"
-            "  \"hash_serialized\": \"hash\",   (string) The serialized hash\n"
+            "  \"muhash\": \"hash\",       (string) The rolling multiset hash of the unspent outputs (muhash only)\n"
+            "  \"bytes_serialized\": n,  (numeric) The serialized size (legacy only)\n"
+            "  \"hash_serialized\": \"hash\",   (string) The serialized hash (legacy only)\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
             "}\n"
             "\nExamples:\n" +
-            HelpExampleCli("gettxoutsetinfo", "") + HelpExampleRpc("gettxoutsetinfo", ""));
+            HelpExampleCli("gettxoutsetinfo", "") + HelpExampleCli("gettxoutsetinfo", "\"muhash\"") + HelpExampleRpc("gettxoutsetinfo", ""));
+
+    std::string strHashType = params.size() > 0 ? params[0].get_str() : "legacy";
+    if (strHashType != "muhash" && strHashType != "legacy")
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown hash_type " + strHashType);
 
     LOCK(cs_main);
 
     UniValue ret(UniValue::VOBJ);
 
+    if (strHashType == "muhash") {
+        CUTXOStats stats;
+        uint256 hashMuHash;
+        if (GetUTXOStats(stats, hashMuHash)) {
+            ret.push_back(Pair("height", (int64_t)mapBlockIndex.find(stats.hashBlock)->second->nHeight));
+            ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
+            ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
+            ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
+            ret.push_back(Pair("muhash", hashMuHash.GetHex()));
+            ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
+        }
+        return ret;
+    }
+
     CCoinsStats stats;
     FlushStateToDisk();
     if (pcoinsTip->GetStats(stats)) {
@@ -414,6 +509,55 @@ UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
     return ret;
 }
 
+UniValue dumptxoutset(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 2)
+        throw runtime_error(
+            "dumptxoutset \"path\" ( height )\n"
+            "\nWrites the unspent transaction output set at a block to a snapshot file, which a new node can start from with -loadsnapshot.\n"
+            "Note this call may take some time.\n"
+            "\nArguments:\n"
+            "1. \"path\"     (string, required) The file to write, relative to the data directory. It must not exist.\n"
+            "2. height     (numeric, optional, default=the tip) The height of the block. The blocks above it must be on disk.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"coins_written\": n,        (numeric) The number of transactions with unspent outputs\n"
+            "  \"base_hash\": \"hash\",       (string) The hash of the block\n"
+            "  \"base_height\": n,          (numeric) The height of the block\n"
+            "  \"snapshot_hash\": \"hash\",   (string) The hash of the snapshot, for -assumeutxo\n"
+            "  \"path\": \"path\"             (string) The absolute path of the snapshot\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("dumptxoutset", "\"utxo.dat\"") + HelpExampleRpc("dumptxoutset", "\"utxo.dat\", 100000"));
+
+    boost::filesystem::path path = boost::filesystem::absolute(params[0].get_str(), GetDataDir());
+    if (boost::filesystem::exists(path))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " already exists");
+
+    int nHeight;
+    {
+        LOCK(cs_main);
+        nHeight = params.size() > 1 ? params[1].get_int() : chainActive.Height();
+        if (nHeight < 1 || nHeight > chainActive.Height())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+    }
+
+    CSnapshotMetadata metadata;
+    uint64_t nCoins;
+    uint256 hashSnapshot;
+    std::string strError;
+    if (!DumpUTXOSnapshot(path, nHeight, metadata, nCoins, hashSnapshot, strError))
+        throw JSONRPCError(RPC_MISC_ERROR, strError);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("coins_written", (int64_t)nCoins));
+    ret.push_back(Pair("base_hash", metadata.hashBlock.GetHex()));
+    ret.push_back(Pair("base_height", metadata.nHeight));
+    ret.push_back(Pair("snapshot_hash", hashSnapshot.GetHex()));
+    ret.push_back(Pair("path", path.string()));
+    return ret;
+}
+
 UniValue gettxout(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 2 || params.size() > 3)
@@ -530,7 +674,9 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
             "  \"bestblockhash\": \"...\", (string) the hash of the currently best block\n"
             "  \"difficulty\": xxxxxx,     (numeric) the current difficulty\n"
             "  \"verificationprogress\": xxxx, (numeric) estimate of verification progress [0..1]\n"
-            "  \"chainwork\": \"xxxx\"     (string) total amount of work in active chain, in hexadecimal\n"
+            "  \"chainwork\": \"xxxx\",    (string) total amount of work in active chain, in hexadecimal\n"
+            "  \"pruned\": xx,             (boolean) if the blocks are subject to pruning\n"
+            "  \"pruneheight\": xxxxxx,    (numeric) lowest-height complete block stored (only present if pruning is enabled)\n"
             "}\n"
             "\nExamples:\n" +
             HelpExampleCli("getblockchaininfo", "") + HelpExampleRpc("getblockchaininfo", ""));
@@ -545,6 +691,14 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
     obj.push_back(Pair("difficulty", (double)GetDifficulty()));
     obj.push_back(Pair("verificationprogress", Checkpoints::GuessVerificationProgress(chainActive.Tip())));
     obj.push_back(Pair("chainwork", chainActive.Tip()->nChainWork.GetHex()));
+    obj.push_back(Pair("pruned", fPruneMode));
+    if (fPruneMode) {
+        CBlockIndex* block = chainActive.Tip();
+        while (block && block->pprev && (block->pprev->nStatus & BLOCK_HAVE_DATA))
+            block = block->pprev;
+
+        obj.push_back(Pair("pruneheight", block->nHeight));
+    }
     return obj;
 }
 
@@ -30,6 +30,11 @@ public:
 static const CRPCConvertParam vRPCConvertParams[] = {
     {"stop", 0},
     {"setmocktime", 0},
+    {"getaddresstxids", 0},
+    {"getaddressdeltas", 0},
+    {"getaddressbalance", 0},
+    {"getaddressutxos", 0},
+    {"getspentinfo", 0},
     {"getaddednodeinfo", 0},
     {"setgenerate", 0},
     {"setgenerate", 1},
@@ -85,6 +90,7 @@ static const CRPCConvertParam vRPCConvertParams[] = {
     {"sendrawtransaction", 2},
     {"gettxout", 1},
     {"gettxout", 2},
+    {"dumptxoutset", 1},
     {"lockunspent", 0},
     {"lockunspent", 1},
     {"importprivkey", 2},
@@ -0,0 +1,145 @@
+// Copyright (c) 2017-2020 The VALUTO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "rpc/jsonwriter.h"
+
+#include "utilstrencodings.h"
+
+#include <assert.h>
+
+void CJSONWriter::HexValue(const unsigned char* pbegin, const unsigned char* pend)
+{
+    Value(HexStr(pbegin, pend));
+}
+
+void CJSONStreamWriter::SetSink(size_t nChunkSizeIn, const boost::function<void(const std::string&)>& sinkIn)
+{
+    nChunkSize = nChunkSizeIn;
+    sink = sinkIn;
+}
+
+void CJSONStreamWriter::BeginValue()
+{
+    if (fAfterKey) {
+        fAfterKey = false;
+        return;
+    }
+    if (!vfEmpty.empty()) {
+        if (!vfEmpty.back())
+            strBuf += ',';
+        vfEmpty.back() = false;
+    }
+}
+
+void CJSONStreamWriter::Flush()
+{
+    if (sink && strBuf.size() >= nChunkSize) {
+        sink(strBuf);
+        strBuf.clear();
+    }
+}
+
+void CJSONStreamWriter::BeginObject()
+{
+    BeginValue();
+    strBuf += '{';
+    vfEmpty.push_back(true);
+}
+
+void CJSONStreamWriter::EndObject()
+{
+    assert(!vfEmpty.empty() && !fAfterKey);
+    vfEmpty.pop_back();
+    strBuf += '}';
+    Flush();
+}
+
+void CJSONStreamWriter::BeginArray()
+{
+    BeginValue();
+    strBuf += '[';
+    vfEmpty.push_back(true);
+}
+
+void CJSONStreamWriter::EndArray()
+{
+    assert(!vfEmpty.empty() && !fAfterKey);
+    vfEmpty.pop_back();
+    strBuf += ']';
+    Flush();
+}
+
+void CJSONStreamWriter::Key(const std::string& strKey)
+{
+    BeginValue();
+    // a string value writes as the quoted and escaped key
+    strBuf += UniValue(strKey).write();
+    strBuf += ':';
+    fAfterKey = true;
+}
+
+void CJSONStreamWriter::Value(const UniValue& value)
+{
+    BeginValue();
+    strBuf += value.write();
+    Flush();
+}
+
+void CJSONStreamWriter::HexValue(const unsigned char* pbegin, const unsigned char* pend)
+{
+    static const char hexmap[16] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'};
+
+    BeginValue();
+    strBuf.reserve(strBuf.size() + (pend - pbegin) * 2 + 2);
+    strBuf += '"';
+    for (const unsigned char* p = pbegin; p != pend; ++p) {
+        strBuf += hexmap[*p >> 4];
+        strBuf += hexmap[*p & 15];
+    }
+    strBuf += '"';
+    Flush();
+}
+
+void CJSONValueWriter::Add(const UniValue& value)
+{
+    if (vStack.empty())
+        result = value;
+    else if (vStack.back().isObject())
+        vStack.back().pushKV(strKey, value);
+    else
+        vStack.back().push_back(value);
+}
+
+void CJSONValueWriter::End()
+{
+    UniValue value = vStack.back();
+    vStack.pop_back();
+    strKey = vKeys.back();
+    vKeys.pop_back();
+    Add(value);
+}
+
+void CJSONValueWriter::BeginObject()
+{
+    vStack.push_back(UniValue(UniValue::VOBJ));
+    vKeys.push_back(strKey);
+}
+
+void CJSONValueWriter::EndObject()
+{
+    assert(!vStack.empty() && vStack.back().isObject());
+    End();
+}
+
+void CJSONValueWriter::BeginArray()
+{
+    vStack.push_back(UniValue(UniValue::VARR));
+    vKeys.push_back(strKey);
+}
+
+void CJSONValueWriter::EndArray()
+{
+    assert(!vStack.empty() && vStack.back().isArray());
+    End();
+}
@@ -0,0 +1,103 @@
+// Copyright (c) 2017-2020 The VALUTO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_RPC_JSONWRITER_H
+#define BITCOIN_RPC_JSONWRITER_H
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include <boost/function.hpp>
+
+#include <univalue.h>
+
+/**
+ * Receives a JSON document one token at a time, so that large results can be
+ * written out as they are produced instead of as one UniValue tree. Values
+ * inside an object must be preceded by their Key; the small parts of a
+ * document are easiest written as a UniValue each.
+ */
+class CJSONWriter
+{
+public:
+    virtual ~CJSONWriter() {}
+
+    virtual void BeginObject() = 0;
+    virtual void EndObject() = 0;
+    virtual void BeginArray() = 0;
+    virtual void EndArray() = 0;
+    //! The key of the next value, inside an object
+    virtual void Key(const std::string& strKey) = 0;
+    virtual void Value(const UniValue& value) = 0;
+    //! A string value holding the hex of [pbegin, pend)
+    virtual void HexValue(const unsigned char* pbegin, const unsigned char* pend);
+
+    void KeyValue(const std::string& strKey, const UniValue& value)
+    {
+        Key(strKey);
+        Value(value);
+    }
+};
+
+/**
+ * Writes the JSON text, with no whitespace, into a buffer. With a sink set,
+ * the buffer is handed to it and emptied whenever it grows past nChunkSize,
+ * so that only about one chunk of the text is held at a time.
+ */
+class CJSONStreamWriter : public CJSONWriter
+{
+private:
+    std::string strBuf;
+    //! For each open object or array, whether nothing has been written into it yet
+    std::vector<bool> vfEmpty;
+    bool fAfterKey;
+    size_t nChunkSize;
+    boost::function<void(const std::string&)> sink;
+
+    void BeginValue();
+    void Flush();
+
+public:
+    CJSONStreamWriter() : fAfterKey(false), nChunkSize(0) {}
+
+    void SetSink(size_t nChunkSizeIn, const boost::function<void(const std::string&)>& sinkIn);
+    //! The text written since the sink last took it
+    std::string& GetBuffer() { return strBuf; }
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+    void Key(const std::string& strKey);
+    void Value(const UniValue& value);
+    void HexValue(const unsigned char* pbegin, const unsigned char* pend);
+};
+
+/** Collects the document into a UniValue, for the callers that want the result as one. */
+class CJSONValueWriter : public CJSONWriter
+{
+private:
+    UniValue result;
+    //! The open objects and arrays, with the key each goes under in its parent
+    std::vector<UniValue> vStack;
+    std::vector<std::string> vKeys;
+    std::string strKey;
+
+    void Add(const UniValue& value);
+    //! Close the innermost object or array and add it to its parent
+    void End();
+
+public:
+    const UniValue& GetValue() const { return result; }
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+    void Key(const std::string& strKeyIn) { strKey = strKeyIn; }
+    void Value(const UniValue& value) { Add(value); }
+};
+
+#endif // BITCOIN_RPC_JSONWRITER_H
@@ -12,6 +12,7 @@
 #include "masternode-payments.h"
 #include "masternodeconfig.h"
 #include "masternodeman.h"
+#include "rpc/jsonwriter.h"
 #include "rpc/server.h"
 #include "utilmoneystr.h"
 
@@ -55,7 +56,7 @@ UniValue getpoolinfo(const UniValue& params, bool fHelp)
     return obj;
 }
 
-UniValue listmasternodes(const UniValue& params, bool fHelp)
+void listmasternodes_stream(const UniValue& params, bool fHelp, CJSONWriter& writer)
 {
     std::string strFilter = "";
 
@@ -88,15 +89,18 @@ UniValue listmasternodes(const UniValue& params, bool fHelp)
             "\nExamples:\n" +
             HelpExampleCli("masternodelist", "") + HelpExampleRpc("masternodelist", ""));
 
-    UniValue ret(UniValue::VARR);
     int nHeight;
     {
         LOCK(cs_main);
         CBlockIndex* pindex = chainActive.Tip();
-        if(!pindex) return 0;
+        if(!pindex) {
+            writer.Value(0);
+            return;
+        }
         nHeight = pindex->nHeight;
     }
     std::vector<pair<int, CMasternode> > vMasternodeRanks = mnodeman.GetMasternodeRanks(nHeight);
+    writer.BeginArray();
     for (PAIRTYPE(int, CMasternode) & s : vMasternodeRanks) {
         UniValue obj(UniValue::VOBJ);
         std::string strVin = s.second.vin.prevout.ToStringShort();
@@ -130,11 +134,15 @@ UniValue listmasternodes(const UniValue& params, bool fHelp)
             obj.push_back(Pair("activetime", (int64_t)(mn->lastPing.sigTime - mn->sigTime)));
             obj.push_back(Pair("lastpaid", (int64_t)mn->GetLastPaid()));
 
-            ret.push_back(obj);
+            writer.Value(obj);
         }
     }
+    writer.EndArray();
+}
 
-    return ret;
+UniValue listmasternodes(const UniValue& params, bool fHelp)
+{
+    return RPCStreamToValue(&listmasternodes_stream, params, fHelp);
 }
 
 UniValue masternodeconnect(const UniValue& params, bool fHelp)
@@ -19,6 +19,7 @@
 #include "timedata.h"
 #include "util.h"
 #ifdef ENABLE_WALLET
+#include "wallet/rpcwallet.h"
 #include "wallet/wallet.h"
 #include "wallet/walletdb.h"
 #endif
@@ -82,11 +83,12 @@ UniValue getinfo(const UniValue& params, bool fHelp)
     obj.push_back(Pair("version", CLIENT_VERSION));
     obj.push_back(Pair("protocolversion", PROTOCOL_VERSION));
 #ifdef ENABLE_WALLET
-    if (pwalletMain) {
-        obj.push_back(Pair("walletversion", pwalletMain->GetVersion()));
-        obj.push_back(Pair("balance", ValueFromAmount(pwalletMain->GetBalance())));
+    CWallet* const pwallet = GetWalletForRPC();
+    if (pwallet) {
+        obj.push_back(Pair("walletversion", pwallet->GetVersion()));
+        obj.push_back(Pair("balance", ValueFromAmount(pwallet->GetBalance())));
         if (!fLiteMode)
-            obj.push_back(Pair("obfuscation_balance", ValueFromAmount(pwalletMain->GetAnonymizedBalance())));
+            obj.push_back(Pair("obfuscation_balance", ValueFromAmount(pwallet->GetAnonymizedBalance())));
     }
 #endif
     obj.push_back(Pair("blocks", (int)chainActive.Height()));
@@ -96,12 +98,12 @@ UniValue getinfo(const UniValue& params, bool fHelp)
     obj.push_back(Pair("difficulty", (double)GetDifficulty()));
     obj.push_back(Pair("testnet", Params().TestnetToBeDeprecatedFieldRPC()));
 #ifdef ENABLE_WALLET
-    if (pwalletMain) {
-        obj.push_back(Pair("keypoololdest", pwalletMain->GetOldestKeyPoolTime()));
-        obj.push_back(Pair("keypoolsize", (int)pwalletMain->GetKeyPoolSize()));
+    if (pwallet) {
+        obj.push_back(Pair("keypoololdest", pwallet->GetOldestKeyPoolTime()));
+        obj.push_back(Pair("keypoolsize", (int)pwallet->GetKeyPoolSize()));
     }
-    if (pwalletMain && pwalletMain->IsCrypted())
-        obj.push_back(Pair("unlocked_until", nWalletUnlockTime));
+    if (pwallet && pwallet->IsCrypted())
+        obj.push_back(Pair("unlocked_until", pwallet->nRelockTime));
     obj.push_back(Pair("paytxfee", ValueFromAmount(payTxFee.GetFeePerK())));
 #endif
     obj.push_back(Pair("relayfee", ValueFromAmount(::minRelayTxFee.GetFeePerK())));
@@ -179,10 +181,11 @@ UniValue mnsync(const UniValue& params, bool fHelp)
 class DescribeAddressVisitor : public boost::static_visitor<UniValue>
 {
 private:
+    const CWallet* pwallet;
     isminetype mine;
 
 public:
-    DescribeAddressVisitor(isminetype mineIn) : mine(mineIn) {}
+    DescribeAddressVisitor(const CWallet* pwalletIn, isminetype mineIn) : pwallet(pwalletIn), mine(mineIn) {}
 
     UniValue operator()(const CNoDestination &dest) const { return UniValue(UniValue::VOBJ); }
 
@@ -191,7 +194,7 @@ public:
         CPubKey vchPubKey;
         obj.push_back(Pair("isscript", false));
         if (mine == ISMINE_SPENDABLE) {
-            pwalletMain->GetPubKey(keyID, vchPubKey);
+            pwallet->GetPubKey(keyID, vchPubKey);
             obj.push_back(Pair("pubkey", HexStr(vchPubKey)));
             obj.push_back(Pair("iscompressed", vchPubKey.IsCompressed()));
         }
@@ -203,7 +206,7 @@ public:
         obj.push_back(Pair("isscript", true));
         if (mine != ISMINE_NO) {
             CScript subscript;
-            pwalletMain->GetCScript(scriptID, subscript);
+            pwallet->GetCScript(scriptID, subscript);
             std::vector<CTxDestination> addresses;
             txnouttype whichType;
             int nRequired;
@@ -296,15 +299,16 @@ UniValue validateaddress(const UniValue& params, bool fHelp)
         string currentAddress = address.ToString();
         ret.push_back(Pair("address", currentAddress));
 #ifdef ENABLE_WALLET
-        isminetype mine = pwalletMain ? IsMine(*pwalletMain, dest) : ISMINE_NO;
+        CWallet* const pwallet = GetWalletForRPC();
+        isminetype mine = pwallet ? IsMine(*pwallet, dest) : ISMINE_NO;
         ret.push_back(Pair("ismine", (mine & ISMINE_SPENDABLE) ? true : false));
         if (mine != ISMINE_NO) {
             ret.push_back(Pair("iswatchonly", (mine & ISMINE_WATCH_ONLY) ? true : false));
-            UniValue detail = boost::apply_visitor(DescribeAddressVisitor(mine), dest);
+            UniValue detail = boost::apply_visitor(DescribeAddressVisitor(pwallet, mine), dest);
             ret.pushKVs(detail);
         }
-        if (pwalletMain && pwalletMain->mapAddressBook.count(dest))
-            ret.push_back(Pair("account", pwalletMain->mapAddressBook[dest].name));
+        if (pwallet && pwallet->mapAddressBook.count(dest))
+            ret.push_back(Pair("account", pwallet->mapAddressBook[dest].name));
 #endif
     }
     return ret;
@@ -328,6 +332,9 @@ CScript _createmultisig_redeemScript(const UniValue& params)
                 keys.size(), nRequired));
     if (keys.size() > 16)
         throw runtime_error("Number of addresses involved in the multisignature address creation > 16\nReduce the number");
+#ifdef ENABLE_WALLET
+    CWallet* const pwallet = GetWalletForRPC();
+#endif
     std::vector<CPubKey> pubkeys;
     pubkeys.resize(keys.size());
     for (unsigned int i = 0; i < keys.size(); i++) {
@@ -335,13 +342,13 @@ CScript _createmultisig_redeemScript(const UniValue& params)
 #ifdef ENABLE_WALLET
         // Case 1: VALUTO address and we have full public key:
         CBitcoinAddress address(ks);
-        if (pwalletMain && address.IsValid()) {
+        if (pwallet && address.IsValid()) {
             CKeyID keyID;
             if (!address.GetKeyID(keyID))
                 throw runtime_error(
                     strprintf("%s does not refer to a key", ks));
             CPubKey vchPubKey;
-            if (!pwalletMain->GetPubKey(keyID, vchPubKey))
+            if (!pwallet->GetPubKey(keyID, vchPubKey))
                 throw runtime_error(
                     strprintf("no full public key for address %s", ks));
             if (!vchPubKey.IsFullyValid())
@@ -458,6 +465,302 @@ UniValue verifymessage(const UniValue& params, bool fHelp)
     return (pubkey.GetID() == keyID);
 }
 
+static bool GetAddressesFromParams(const UniValue& params, std::vector<std::pair<uint160, int> >& addresses)
+{
+    std::vector<UniValue> vAddresses;
+    if (params[0].isStr()) {
+        vAddresses.push_back(params[0]);
+    } else if (params[0].isObject()) {
+        const UniValue& addressValues = find_value(params[0].get_obj(), "addresses");
+        if (!addressValues.isArray())
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Addresses is expected to be an array");
+        vAddresses = addressValues.getValues();
+    } else {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+    }
+
+    for (const UniValue& value : vAddresses) {
+        CBitcoinAddress address(value.get_str());
+        uint160 hashBytes;
+        int type = 0;
+        if (!address.GetIndexKey(hashBytes, type))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+        addresses.push_back(std::make_pair(hashBytes, type));
+    }
+    return true;
+}
+
+static bool GetHeightRangeFromParams(const UniValue& params, int& start, int& end)
+{
+    start = 0;
+    end = 0;
+    if (!params[0].isObject())
+        return false;
+    const UniValue& startValue = find_value(params[0].get_obj(), "start");
+    const UniValue& endValue = find_value(params[0].get_obj(), "end");
+    if (startValue.isNum() && endValue.isNum()) {
+        start = startValue.get_int();
+        end = endValue.get_int();
+        if (start <= 0 || end <= 0 || end < start)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Start and end are expected to be greater than zero, with end not below start");
+        return true;
+    }
+    return false;
+}
+
+static std::string GetAddressString(const uint160& hashBytes, int type)
+{
+    if (type == ADDRESS_TYPE_PUBKEYHASH)
+        return CBitcoinAddress(CKeyID(hashBytes)).ToString();
+    if (type == ADDRESS_TYPE_SCRIPTHASH)
+        return CBitcoinAddress(CScriptID(hashBytes)).ToString();
+    throw JSONRPCError(RPC_INTERNAL_ERROR, "Unknown address type");
+}
+
+static void CheckAddressIndexSynced()
+{
+    if (!fAddressIndexSynced)
+        throw JSONRPCError(RPC_IN_WARMUP, "Address index is still being built");
+}
+
+static const std::string strAddressesHelp =
+    "1. \"address\" or {\"addresses\": [\"address\",...]}  (string or object, required) a base58 address or an object with a list of addresses\n";
+
+UniValue getaddresstxids(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddresstxids \"address\"|{\"addresses\":[...],\"start\":n,\"end\":n}\n"
+            "\nReturns the txids of an address or addresses (requires -addressindex).\n"
+            "\nArguments:\n" +
+            strAddressesHelp +
+            "   \"start\" and \"end\" optionally limit the result to a range of block heights\n"
+            "\nResult:\n"
+            "[\n"
+            "  \"transactionid\"  (string) The transaction id\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"VGwS4Qys3gQMNGBsPqf6DPYr3bSDZMGvzS\"]}'") + HelpExampleRpc("getaddresstxids", "\"VGwS4Qys3gQMNGBsPqf6DPYr3bSDZMGvzS\""));
+
+    CheckAddressIndexSynced();
+    std::vector<std::pair<uint160, int> > addresses;
+    GetAddressesFromParams(params, addresses);
+    int start, end;
+    GetHeightRangeFromParams(params, start, end);
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    for (const std::pair<uint160, int>& address : addresses) {
+        if (!GetAddressIndex(address.first, address.second, addressIndex, start, end))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    }
+
+    // entries come back in (height, position in block) order per address; merge them across addresses
+    std::set<std::pair<int, std::pair<unsigned int, uint256> > > txids;
+    for (const std::pair<CAddressIndexKey, CAmount>& entry : addressIndex)
+        txids.insert(std::make_pair(entry.first.blockHeight, std::make_pair(entry.first.txindex, entry.first.txhash)));
+
+    UniValue result(UniValue::VARR);
+    uint256 hashLast;
+    for (const std::pair<int, std::pair<unsigned int, uint256> >& txid : txids) {
+        if (txid.second.second == hashLast)
+            continue;
+        hashLast = txid.second.second;
+        result.push_back(hashLast.GetHex());
+    }
+    return result;
+}
+
+UniValue getaddressdeltas(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressdeltas \"address\"|{\"addresses\":[...],\"start\":n,\"end\":n}\n"
+            "\nReturns all changes for an address or addresses (requires -addressindex).\n"
+            "\nArguments:\n" +
+            strAddressesHelp +
+            "   \"start\" and \"end\" optionally limit the result to a range of block heights\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"satoshis\": n,     (numeric) The difference of satoshis\n"
+            "    \"txid\": \"hash\",    (string) The related txid\n"
+            "    \"index\": n,        (numeric) The related input or output index\n"
+            "    \"blockindex\": n,   (numeric) The position of the transaction in its block\n"
+            "    \"height\": n,       (numeric) The block height\n"
+            "    \"address\": \"addr\"  (string) The base58 address\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressdeltas", "'{\"addresses\": [\"VGwS4Qys3gQMNGBsPqf6DPYr3bSDZMGvzS\"]}'") + HelpExampleRpc("getaddressdeltas", "\"VGwS4Qys3gQMNGBsPqf6DPYr3bSDZMGvzS\""));
+
+    CheckAddressIndexSynced();
+    std::vector<std::pair<uint160, int> > addresses;
+    GetAddressesFromParams(params, addresses);
+    int start, end;
+    GetHeightRangeFromParams(params, start, end);
+
+    UniValue result(UniValue::VARR);
+    for (const std::pair<uint160, int>& address : addresses) {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+        if (!GetAddressIndex(address.first, address.second, addressIndex, start, end))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+
+        std::string strAddress = GetAddressString(address.first, address.second);
+        for (const std::pair<CAddressIndexKey, CAmount>& entry : addressIndex) {
+            UniValue delta(UniValue::VOBJ);
+            delta.push_back(Pair("satoshis", entry.second));
+            delta.push_back(Pair("txid", entry.first.txhash.GetHex()));
+            delta.push_back(Pair("index", (int)entry.first.index));
+            delta.push_back(Pair("blockindex", (int)entry.first.txindex));
+            delta.push_back(Pair("height", entry.first.blockHeight));
+            delta.push_back(Pair("address", strAddress));
+            result.push_back(delta);
+        }
+    }
+    return result;
+}
+
+UniValue getaddressbalance(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressbalance \"address\"|{\"addresses\":[...]}\n"
+            "\nReturns the balance for an address or addresses (requires -addressindex).\n"
+            "\nArguments:\n" +
+            strAddressesHelp +
+            "\nResult:\n"
+            "{\n"
+            "  \"balance\": n,   (numeric) The current balance in satoshis\n"
+            "  \"received\": n   (numeric) The total number of satoshis received (including change)\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressbalance", "'{\"addresses\": [\"VGwS4Qys3gQMNGBsPqf6DPYr3bSDZMGvzS\"]}'") + HelpExampleRpc("getaddressbalance", "\"VGwS4Qys3gQMNGBsPqf6DPYr3bSDZMGvzS\""));
+
+    CheckAddressIndexSynced();
+    std::vector<std::pair<uint160, int> > addresses;
+    GetAddressesFromParams(params, addresses);
+
+    CAmount nBalance = 0;
+    CAmount nReceived = 0;
+    for (const std::pair<uint160, int>& address : addresses) {
+        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+        if (!GetAddressUnspent(address.first, address.second, unspentOutputs))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+        for (const std::pair<CAddressUnspentKey, CAddressUnspentValue>& output : unspentOutputs)
+            nBalance += output.second.satoshis;
+
+        // received totals need the full history, the balance only the unspent outputs
+        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+        if (!GetAddressIndex(address.first, address.second, addressIndex))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+        for (const std::pair<CAddressIndexKey, CAmount>& entry : addressIndex) {
+            if (entry.second > 0)
+                nReceived += entry.second;
+        }
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("balance", nBalance));
+    result.push_back(Pair("received", nReceived));
+    return result;
+}
+
+UniValue getaddressutxos(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressutxos \"address\"|{\"addresses\":[...]}\n"
+            "\nReturns all unspent outputs for an address or addresses (requires -addressindex).\n"
+            "\nArguments:\n" +
+            strAddressesHelp +
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"address\": \"addr\",  (string) The address base58check encoded\n"
+            "    \"txid\": \"hash\",     (string) The output txid\n"
+            "    \"outputIndex\": n,   (numeric) The output index\n"
+            "    \"script\": \"hex\",    (string) The script hex encoded\n"
+            "    \"satoshis\": n,      (numeric) The number of satoshis of the output\n"
+            "    \"height\": n         (numeric) The block height\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressutxos", "'{\"addresses\": [\"VGwS4Qys3gQMNGBsPqf6DPYr3bSDZMGvzS\"]}'") + HelpExampleRpc("getaddressutxos", "\"VGwS4Qys3gQMNGBsPqf6DPYr3bSDZMGvzS\""));
+
+    CheckAddressIndexSynced();
+    std::vector<std::pair<uint160, int> > addresses;
+    GetAddressesFromParams(params, addresses);
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    for (const std::pair<uint160, int>& address : addresses) {
+        if (!GetAddressUnspent(address.first, address.second, unspentOutputs))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    }
+
+    std::sort(unspentOutputs.begin(), unspentOutputs.end(),
+        [](const std::pair<CAddressUnspentKey, CAddressUnspentValue>& a, const std::pair<CAddressUnspentKey, CAddressUnspentValue>& b) {
+            return a.second.blockHeight < b.second.blockHeight;
+        });
+
+    UniValue result(UniValue::VARR);
+    for (const std::pair<CAddressUnspentKey, CAddressUnspentValue>& output : unspentOutputs) {
+        UniValue utxo(UniValue::VOBJ);
+        utxo.push_back(Pair("address", GetAddressString(output.first.hashBytes, output.first.type)));
+        utxo.push_back(Pair("txid", output.first.txhash.GetHex()));
+        utxo.push_back(Pair("outputIndex", (int)output.first.index));
+        utxo.push_back(Pair("script", HexStr(output.second.script.begin(), output.second.script.end())));
+        utxo.push_back(Pair("satoshis", output.second.satoshis));
+        utxo.push_back(Pair("height", output.second.blockHeight));
+        result.push_back(utxo);
+    }
+    return result;
+}
+
+UniValue getspentinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1 || !params[0].isObject())
+        throw runtime_error(
+            "getspentinfo {\"txid\": \"hash\", \"index\": n}\n"
+            "\nReturns the txid and index where an output is spent (requires -spentindex).\n"
+            "\nArguments:\n"
+            "1. {\n"
+            "     \"txid\": \"hash\",  (string) The hex string of the txid\n"
+            "     \"index\": n       (numeric) The output index\n"
+            "   }\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"txid\": \"hash\",   (string) The transaction id of the spending input\n"
+            "  \"index\": n,       (numeric) The spending input index\n"
+            "  \"height\": n       (numeric) The height of the block containing the spending transaction\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getspentinfo", "'{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}'") +
+            HelpExampleRpc("getspentinfo", "{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}"));
+
+    if (!fSpentIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Spent index not enabled");
+    CheckAddressIndexSynced();
+
+    const UniValue& txidValue = find_value(params[0].get_obj(), "txid");
+    const UniValue& indexValue = find_value(params[0].get_obj(), "index");
+    if (!txidValue.isStr() || !indexValue.isNum())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid txid or index");
+
+    CSpentIndexKey key(ParseHashV(txidValue, "txid"), indexValue.get_int());
+    CSpentIndexValue value;
+    if (!GetSpentIndex(key, value))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unable to get spent info");
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("txid", value.txid.GetHex()));
+    obj.push_back(Pair("index", (int)value.inputIndex));
+    obj.push_back(Pair("height", value.blockHeight));
+    return obj;
+}
+
 UniValue setmocktime(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 1)
@@ -43,10 +43,10 @@ const size_t POST_READ_SIZE = 256 * 1024;
  * and to be compatible with other JSON-RPC implementations.
  */
 
-string HTTPPost(const string& strMsg, const map<string, string>& mapRequestHeaders)
+string HTTPPost(const string& strMsg, const map<string, string>& mapRequestHeaders, const string& strURI)
 {
     ostringstream s;
-    s << "POST / HTTP/1.1\r\n"
+    s << "POST " << strURI << " HTTP/1.1\r\n"
       << "User-Agent: valuto-json-rpc/" << FormatFullVersion() << "\r\n"
       << "Host: 127.0.0.1\r\n"
       << "Content-Type: application/json\r\n"
@@ -71,14 +71,20 @@ static const char* httpStatusDescription(int nStatus)
     switch (nStatus) {
     case HTTP_OK:
         return "OK";
+    case HTTP_NOT_MODIFIED:
+        return "Not Modified";
     case HTTP_BAD_REQUEST:
         return "Bad Request";
     case HTTP_FORBIDDEN:
         return "Forbidden";
     case HTTP_NOT_FOUND:
         return "Not Found";
+    case HTTP_REQUEST_HEADER_FIELDS_TOO_LARGE:
+        return "Request Header Fields Too Large";
     case HTTP_INTERNAL_SERVER_ERROR:
         return "Internal Server Error";
+    case HTTP_SERVICE_UNAVAILABLE:
+        return "Service Unavailable";
     default:
         return "";
     }
@@ -109,7 +115,7 @@ string HTTPError(int nStatus, bool keepalive, bool headersOnly)
         headersOnly, "text/plain");
 }
 
-string HTTPReplyHeader(int nStatus, bool keepalive, size_t contentLength, const char* contentType)
+string HTTPReplyHeader(int nStatus, bool keepalive, size_t contentLength, const char* contentType, const string& strHeaders)
 {
     return strprintf(
         "HTTP/1.1 %d %s\r\n"
@@ -117,6 +123,7 @@ string HTTPReplyHeader(int nStatus, bool keepalive, size_t contentLength, const
         "Connection: %s\r\n"
         "Content-Length: %u\r\n"
         "Content-Type: %s\r\n"
+        "%s"
         "Server: valuto-json-rpc/%s\r\n"
         "\r\n",
         nStatus,
@@ -125,6 +132,25 @@ string HTTPReplyHeader(int nStatus, bool keepalive, size_t contentLength, const
         keepalive ? "keep-alive" : "close",
         contentLength,
         contentType,
+        strHeaders,
+        FormatFullVersion());
+}
+
+string HTTPReplyHeaderChunked(int nStatus, bool keepalive, const char* contentType)
+{
+    return strprintf(
+        "HTTP/1.1 %d %s\r\n"
+        "Date: %s\r\n"
+        "Connection: %s\r\n"
+        "Transfer-Encoding: chunked\r\n"
+        "Content-Type: %s\r\n"
+        "Server: valuto-json-rpc/%s\r\n"
+        "\r\n",
+        nStatus,
+        httpStatusDescription(nStatus),
+        rfc1123Time(),
+        keepalive ? "keep-alive" : "close",
+        contentType,
         FormatFullVersion());
 }
 
@@ -211,6 +237,39 @@ int ReadHTTPHeaders(std::basic_istream<char>& stream, map<string, string>& mapHe
 }
 
 
+/** Read a message body sent in chunks, each led by its size in hex, up to the empty last one. */
+static bool ReadHTTPChunks(std::basic_istream<char>& stream, string& strMessageRet, size_t max_size)
+{
+    while (true) {
+        string str;
+        std::getline(stream, str);
+        if (!stream)
+            return false;
+        // anything after the size (chunk extensions) is ignored
+        const char* psz = str.c_str();
+        char* pend;
+        unsigned long nChunk = strtoul(psz, &pend, 16);
+        if (pend == psz)
+            return false;
+        if (nChunk == 0) {
+            // skip the trailer, up to the empty line
+            do {
+                std::getline(stream, str);
+            } while (stream && !str.empty() && str != "\r");
+            return (bool)stream;
+        }
+        if (nChunk > max_size - strMessageRet.size())
+            return false;
+        size_t ptr = strMessageRet.size();
+        strMessageRet.resize(ptr + nChunk);
+        stream.read(&strMessageRet[ptr], nChunk);
+        // the line break closing the chunk
+        std::getline(stream, str);
+        if (!stream) // Connection lost while reading
+            return false;
+    }
+}
+
 int ReadHTTPMessage(std::basic_istream<char>& stream, map<string, string>& mapHeadersRet, string& strMessageRet, int nProto, size_t max_size)
 {
     mapHeadersRet.clear();
@@ -222,7 +281,10 @@ int ReadHTTPMessage(std::basic_istream<char>& stream, map<string, string>& mapHe
         return HTTP_INTERNAL_SERVER_ERROR;
 
     // Read message
-    if (nLen > 0) {
+    if (mapHeadersRet["transfer-encoding"] == "chunked") {
+        if (!ReadHTTPChunks(stream, strMessageRet, max_size))
+            return HTTP_INTERNAL_SERVER_ERROR;
+    } else if (nLen > 0) {
         vector<char> vch;
         size_t ptr = 0;
         while (ptr < (size_t)nLen) {
@@ -20,11 +20,13 @@
 //! HTTP status codes
 enum HTTPStatusCode {
     HTTP_OK                    = 200,
+    HTTP_NOT_MODIFIED          = 304,
     HTTP_BAD_REQUEST           = 400,
     HTTP_UNAUTHORIZED          = 401,
     HTTP_FORBIDDEN             = 403,
     HTTP_NOT_FOUND             = 404,
     HTTP_BAD_METHOD            = 405,
+    HTTP_REQUEST_HEADER_FIELDS_TOO_LARGE = 431,
     HTTP_INTERNAL_SERVER_ERROR = 500,
     HTTP_SERVICE_UNAVAILABLE   = 503,
 };
@@ -75,6 +77,7 @@ enum RPCErrorCode {
     RPC_WALLET_WRONG_ENC_STATE          = -15, //! Command given in wrong wallet encryption state (encrypting an encrypted wallet etc.)
     RPC_WALLET_ENCRYPTION_FAILED        = -16, //! Failed to encrypt the wallet
     RPC_WALLET_ALREADY_UNLOCKED         = -17, //! Wallet is already unlocked
+    RPC_WALLET_NOT_FOUND                = -18, //! Invalid wallet specified
 };
 
 /**
@@ -145,9 +148,12 @@ private:
     boost::asio::ssl::stream<typename Protocol::socket>& stream;
 };
 
-std::string HTTPPost(const std::string& strMsg, const std::map<std::string, std::string>& mapRequestHeaders);
+std::string HTTPPost(const std::string& strMsg, const std::map<std::string, std::string>& mapRequestHeaders, const std::string& strURI = "/");
 std::string HTTPError(int nStatus, bool keepalive, bool headerOnly = false);
-std::string HTTPReplyHeader(int nStatus, bool keepalive, size_t contentLength, const char* contentType = "application/json");
+//! strHeaders, if given, are more header lines, each ending with \r\n
+std::string HTTPReplyHeader(int nStatus, bool keepalive, size_t contentLength, const char* contentType = "application/json", const std::string& strHeaders = "");
+//! Header of a reply whose body follows in chunks, each led by its size
+std::string HTTPReplyHeaderChunked(int nStatus, bool keepalive, const char* contentType = "application/json");
 std::string HTTPReply(int nStatus, const std::string& strMsg, bool keepalive, bool headerOnly = false, const char* contentType = "application/json");
 bool ReadHTTPRequestLine(std::basic_istream<char>& stream, int& proto, std::string& http_method, std::string& http_uri);
 int ReadHTTPStatus(std::basic_istream<char>& stream, int& proto);
@@ -13,6 +13,7 @@
 #include "main.h"
 #include "net.h"
 #include "primitives/transaction.h"
+#include "rpc/jsonwriter.h"
 #include "rpc/server.h"
 #include "script/script.h"
 #include "script/sign.h"
@@ -21,6 +22,7 @@
 #include "uint256.h"
 #include "utilmoneystr.h"
 #ifdef ENABLE_WALLET
+#include "wallet/rpcwallet.h"
 #include "wallet/wallet.h"
 #endif
 
@@ -156,8 +158,6 @@ UniValue getrawtransaction(const UniValue& params, bool fHelp)
             + HelpExampleCli("getrawtransaction", "\"mytxid\" true \"myblockhash\"")
         );
 
-    LOCK(cs_main);
-
     bool in_active_chain = true;
     uint256 hash = ParseHashV(params[0], "parameter 1");
     CBlockIndex* blockindex = nullptr;
@@ -169,6 +169,7 @@ UniValue getrawtransaction(const UniValue& params, bool fHelp)
 
     if (!params[2].isNull()) {
         uint256 blockhash = ParseHashV(params[2], "parameter 3");
+        LOCK(cs_main);
         BlockMap::iterator it = mapBlockIndex.find(blockhash);
         if (it == mapBlockIndex.end()) {
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block hash not found");
@@ -188,7 +189,7 @@ UniValue getrawtransaction(const UniValue& params, bool fHelp)
             errmsg = "No such transaction found in the provided block";
         } else {
             errmsg = fTxIndex
-              ? "No such mempool or blockchain transaction"
+              ? (fHavePruned ? "No such mempool or available blockchain transaction (its block may have been pruned)" : "No such mempool or blockchain transaction")
               : "No such mempool transaction. Use -txindex to enable blockchain transaction queries";
         }
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, errmsg + ". Use gettransaction for wallet transactions.");
@@ -200,13 +201,15 @@ UniValue getrawtransaction(const UniValue& params, bool fHelp)
 
     UniValue result(UniValue::VOBJ);
     if (blockindex) result.push_back(Pair("in_active_chain", in_active_chain));
+    LOCK(cs_main);
     TxToJSON(tx, hash_block, result);
     return result;
 }
 
 #ifdef ENABLE_WALLET
-UniValue listunspent(const UniValue& params, bool fHelp)
+void listunspent_stream(const UniValue& params, bool fHelp, CJSONWriter& writer)
 {
+    CWallet* const pwallet = GetWalletForRPC();
     if (fHelp || params.size() > 4)
         throw runtime_error(
             "listunspent ( minconf maxconf  [\"address\",...] )\n"
@@ -274,52 +277,81 @@ UniValue listunspent(const UniValue& params, bool fHelp)
             nWatchonlyConfig = 1;
     }
 
-    UniValue results(UniValue::VARR);
-    vector<COutput> vecOutputs;
-    assert(pwalletMain != NULL);
-    LOCK2(cs_main, pwalletMain->cs_wallet);
-    pwalletMain->AvailableCoins(vecOutputs, false, NULL, false);
-    BOOST_FOREACH (const COutput& out, vecOutputs) {
-        if (out.nDepth < nMinDepth || out.nDepth > nMaxDepth)
-            continue;
-
-        if (setAddress.size()) {
-            CTxDestination address;
-            if (!ExtractDestination(out.tx->vout[out.i].scriptPubKey, address))
-                continue;
-
-            if (!setAddress.count(address))
+    assert(pwallet != NULL);
+    // The outputs are listed under cs_main and cs_wallet, then their rows are collected a batch
+    // at a time under the locks and written once they are released.
+    std::vector<std::pair<COutPoint, std::pair<int, bool> > > vOutputs;
+    {
+        vector<COutput> vecOutputs;
+        LOCK2(cs_main, pwallet->cs_wallet);
+        pwallet->AvailableCoins(vecOutputs, false, NULL, false);
+        vOutputs.reserve(vecOutputs.size());
+        BOOST_FOREACH (const COutput& out, vecOutputs) {
+            if (out.nDepth < nMinDepth || out.nDepth > nMaxDepth)
                 continue;
+            vOutputs.push_back(std::make_pair(COutPoint(out.tx->GetHash(), out.i), std::make_pair(out.nDepth, out.fSpendable)));
         }
+    }
 
-        CAmount nValue = out.tx->vout[out.i].nValue;
-        const CScript& pk = out.tx->vout[out.i].scriptPubKey;
-        UniValue entry(UniValue::VOBJ);
-        entry.push_back(Pair("txid", out.tx->GetHash().GetHex()));
-        entry.push_back(Pair("vout", out.i));
-        CTxDestination address;
-        if (ExtractDestination(out.tx->vout[out.i].scriptPubKey, address)) {
-            entry.push_back(Pair("address", CBitcoinAddress(address).ToString()));
-            if (pwalletMain->mapAddressBook.count(address))
-                entry.push_back(Pair("account", pwalletMain->mapAddressBook[address].name));
-        }
-        entry.push_back(Pair("scriptPubKey", HexStr(pk.begin(), pk.end())));
-        if (pk.IsPayToScriptHash()) {
-            CTxDestination address;
-            if (ExtractDestination(pk, address)) {
-                const CScriptID& hash = boost::get<CScriptID>(address);
-                CScript redeemScript;
-                if (pwalletMain->GetCScript(hash, redeemScript))
-                    entry.push_back(Pair("redeemScript", HexStr(redeemScript.begin(), redeemScript.end())));
+    std::vector<UniValue> vRows;
+    writer.BeginArray();
+    for (size_t nStart = 0; nStart < vOutputs.size(); nStart += RPC_STREAM_BATCH_ROWS) {
+        {
+            LOCK2(cs_main, pwallet->cs_wallet);
+            size_t nEnd = std::min(vOutputs.size(), nStart + RPC_STREAM_BATCH_ROWS);
+            for (size_t i = nStart; i < nEnd; i++) {
+                const COutPoint& outpoint = vOutputs[i].first;
+                std::map<uint256, CWalletTx>::const_iterator it = pwallet->mapWallet.find(outpoint.hash);
+                if (it == pwallet->mapWallet.end())
+                    continue;
+                const CTxOut& txout = it->second.vout[outpoint.n];
+
+                if (setAddress.size()) {
+                    CTxDestination address;
+                    if (!ExtractDestination(txout.scriptPubKey, address))
+                        continue;
+
+                    if (!setAddress.count(address))
+                        continue;
+                }
+
+                CAmount nValue = txout.nValue;
+                const CScript& pk = txout.scriptPubKey;
+                UniValue entry(UniValue::VOBJ);
+                entry.push_back(Pair("txid", outpoint.hash.GetHex()));
+                entry.push_back(Pair("vout", (int)outpoint.n));
+                CTxDestination address;
+                if (ExtractDestination(pk, address)) {
+                    entry.push_back(Pair("address", CBitcoinAddress(address).ToString()));
+                    if (pwallet->mapAddressBook.count(address))
+                        entry.push_back(Pair("account", pwallet->mapAddressBook[address].name));
+                }
+                entry.push_back(Pair("scriptPubKey", HexStr(pk.begin(), pk.end())));
+                if (pk.IsPayToScriptHash()) {
+                    CTxDestination address;
+                    if (ExtractDestination(pk, address)) {
+                        const CScriptID& hash = boost::get<CScriptID>(address);
+                        CScript redeemScript;
+                        if (pwallet->GetCScript(hash, redeemScript))
+                            entry.push_back(Pair("redeemScript", HexStr(redeemScript.begin(), redeemScript.end())));
+                    }
+                }
+                entry.push_back(Pair("amount", ValueFromAmount(nValue)));
+                entry.push_back(Pair("confirmations", vOutputs[i].second.first));
+                entry.push_back(Pair("spendable", vOutputs[i].second.second));
+                vRows.push_back(entry);
             }
         }
-        entry.push_back(Pair("amount", ValueFromAmount(nValue)));
-        entry.push_back(Pair("confirmations", out.nDepth));
-        entry.push_back(Pair("spendable", out.fSpendable));
-        results.push_back(entry);
+        for (const UniValue& row : vRows)
+            writer.Value(row);
+        vRows.clear();
     }
+    writer.EndArray();
+}
 
-    return results;
+UniValue listunspent(const UniValue& params, bool fHelp)
+{
+    return RPCStreamToValue(&listunspent_stream, params, fHelp);
 }
 #endif
 
@@ -545,6 +577,9 @@ static void TxInErrorToJSON(const CTxIn& txin, UniValue& vErrorsRet, const std::
 
 UniValue signrawtransaction(const UniValue& params, bool fHelp)
 {
+#ifdef ENABLE_WALLET
+    CWallet* const pwallet = GetWalletForRPC();
+#endif
     if (fHelp || params.size() < 1 || params.size() > 4)
         throw runtime_error(
             "signrawtransaction \"hexstring\" ( [{\"txid\":\"id\",\"vout\":n,\"scriptPubKey\":\"hex\",\"redeemScript\":\"hex\"},...] [\"privatekey1\",...] sighashtype )\n"
@@ -602,7 +637,7 @@ UniValue signrawtransaction(const UniValue& params, bool fHelp)
             HelpExampleCli("signrawtransaction", "\"myhex\"") + HelpExampleRpc("signrawtransaction", "\"myhex\""));
 
 #ifdef ENABLE_WALLET
-    LOCK2(cs_main, pwalletMain ? &pwalletMain->cs_wallet : NULL);
+    LOCK2(cs_main, pwallet ? &pwallet->cs_wallet : NULL);
 #else
     LOCK(cs_main);
 #endif
@@ -676,7 +711,7 @@ UniValue signrawtransaction(const UniValue& params, bool fHelp)
         }
     }
 #ifdef ENABLE_WALLET
-    else if (pwalletMain)
+    else if (pwallet)
         EnsureWalletIsUnlocked();
 #endif
 
@@ -730,7 +765,7 @@ UniValue signrawtransaction(const UniValue& params, bool fHelp)
     }
 
 #ifdef ENABLE_WALLET
-    const CKeyStore& keystore = ((fGivenKeys || !pwalletMain) ? tempKeystore : *pwalletMain);
+    const CKeyStore& keystore = ((fGivenKeys || !pwallet) ? tempKeystore : *pwallet);
 #else
     const CKeyStore& keystore = tempKeystore;
 #endif
@@ -11,9 +11,11 @@
 #include "base58.h"
 #include "init.h"
 #include "main.h"
+#include "rpc/jsonwriter.h"
 #include "ui_interface.h"
 #include "util.h"
 #ifdef ENABLE_WALLET
+#include "wallet/rpcwallet.h"
 #include "wallet/wallet.h"
 #endif
 
@@ -21,6 +23,7 @@
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
 #include <boost/bind.hpp>
+#include <boost/enable_shared_from_this.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/foreach.hpp>
 #include <boost/iostreams/concepts.hpp>
@@ -28,6 +31,8 @@
 #include <boost/shared_ptr.hpp>
 #include <boost/thread.hpp>
 
+#include <deque>
+
 #include <univalue.h>
 
 using namespace boost;
@@ -45,11 +50,17 @@ static CCriticalSection cs_rpcWarmup;
 static asio::io_service* rpc_io_service = NULL;
 static map<string, boost::shared_ptr<deadline_timer> > deadlineTimers;
 static ssl::context* rpc_ssl_context = NULL;
+static boost::thread_group* rpc_io_group = NULL;
 static boost::thread_group* rpc_worker_group = NULL;
 static boost::asio::io_service::work* rpc_dummy_work = NULL;
 static std::vector<CSubNet> rpc_allow_subnets; //!< List of subnets to allow RPC connections from
 static std::vector<boost::shared_ptr<ip::tcp::acceptor> > rpc_acceptors;
 
+//! Threads running the I/O of the RPC connections and the RPC timers
+static const int RPC_IO_THREADS = 2;
+//! Replies that grow past this are sent in chunks while the rest is written
+static const size_t RPC_REPLY_CHUNK_SIZE = 256 * 1024;
+
 void RPCTypeCheck(const UniValue& params,
                   const list<UniValue::VType>& typesExpected,
                   bool fAllowNull)
@@ -273,15 +284,16 @@ static const CRPCCommand vRPCCommands[] =
         {"blockchain", "getblockchaininfo", &getblockchaininfo, true, false, false},
         {"blockchain", "getbestblockhash", &getbestblockhash, true, false, false},
         {"blockchain", "getblockcount", &getblockcount, true, false, false},
-        {"blockchain", "getblock", &getblock, true, false, false},
+        {"blockchain", "getblock", &getblock, true, true, false},
         {"blockchain", "getblockhash", &getblockhash, true, false, false},
-        {"blockchain", "getblockheader", &getblockheader, false, false, false},
+        {"blockchain", "getblockheader", &getblockheader, true, true, false},
         {"blockchain", "getchaintips", &getchaintips, true, false, false},
         {"blockchain", "getdifficulty", &getdifficulty, true, false, false},
         {"blockchain", "getmempoolinfo", &getmempoolinfo, true, true, false},
         {"blockchain", "getrawmempool", &getrawmempool, true, false, false},
-        {"blockchain", "gettxout", &gettxout, true, false, false},
+        {"blockchain", "gettxout", &gettxout, true, true, false},
         {"blockchain", "gettxoutsetinfo", &gettxoutsetinfo, true, false, false},
+        {"blockchain", "dumptxoutset", &dumptxoutset, true, true, false},
         {"blockchain", "verifychain", &verifychain, true, false, false},
         {"blockchain", "invalidateblock", &invalidateblock, true, true, false},
         {"blockchain", "reconsiderblock", &reconsiderblock, true, true, false},
@@ -305,7 +317,7 @@ static const CRPCCommand vRPCCommands[] =
         {"rawtransactions", "createrawtransaction", &createrawtransaction, true, false, false},
         {"rawtransactions", "decoderawtransaction", &decoderawtransaction, true, false, false},
         {"rawtransactions", "decodescript", &decodescript, true, false, false},
-        {"rawtransactions", "getrawtransaction", &getrawtransaction, true, false, false},
+        {"rawtransactions", "getrawtransaction", &getrawtransaction, true, true, false},
         {"rawtransactions", "sendrawtransaction", &sendrawtransaction, false, false, false},
         {"rawtransactions", "signrawtransaction", &signrawtransaction, false, false, false}, /* uses wallet if enabled */
 
@@ -321,6 +333,13 @@ static const CRPCCommand vRPCCommands[] =
         {"hidden", "reconsiderblock", &reconsiderblock, true, true, false},
         {"hidden", "setmocktime", &setmocktime, true, false, false},
 
+        /* Address index */
+        {"addressindex", "getaddresstxids", &getaddresstxids, false, false, false},
+        {"addressindex", "getaddressdeltas", &getaddressdeltas, false, false, false},
+        {"addressindex", "getaddressbalance", &getaddressbalance, false, false, false},
+        {"addressindex", "getaddressutxos", &getaddressutxos, false, false, false},
+        {"addressindex", "getspentinfo", &getspentinfo, false, false, false},
+
         /* VALUTO features */
         {"valuto", "listmasternodes", &listmasternodes, true, true, false},
         {"valuto", "getmasternodecount", &getmasternodecount, true, true, false},
@@ -340,13 +359,14 @@ static const CRPCCommand vRPCCommands[] =
 #ifdef ENABLE_WALLET
 
         /* Wallet */
+        {"wallet", "abortrescan", &abortrescan, true, true, true},
         {"wallet", "addmultisigaddress", &addmultisigaddress, true, false, true},
         {"wallet", "autocombinerewards", &autocombinerewards, false, false, true},
         {"wallet", "backupwallet", &backupwallet, true, false, true},
         {"wallet", "dumpprivkey", &dumpprivkey, true, false, true},
         {"wallet", "dumpwallet", &dumpwallet, true, false, true},
         {"wallet", "bip38encrypt", &bip38encrypt, true, false, true},
-        {"wallet", "bip38decrypt", &bip38decrypt, true, false, true},
+        {"wallet", "bip38decrypt", &bip38decrypt, true, true, true},
         {"wallet", "encryptwallet", &encryptwallet, true, false, true},
         {"wallet", "getaccountaddress", &getaccountaddress, true, false, true},
         {"wallet", "getaccount", &getaccount, true, false, true},
@@ -356,18 +376,20 @@ static const CRPCCommand vRPCCommands[] =
         {"wallet", "getrawchangeaddress", &getrawchangeaddress, true, false, true},
         {"wallet", "getreceivedbyaccount", &getreceivedbyaccount, false, false, true},
         {"wallet", "getreceivedbyaddress", &getreceivedbyaddress, false, false, true},
+        {"wallet", "getrescaninfo", &getrescaninfo, true, true, true},
         {"wallet", "getstakingstatus", &getstakingstatus, false, false, true},
         {"wallet", "getstakesplitthreshold", &getstakesplitthreshold, false, false, true},
         {"wallet", "gettransaction", &gettransaction, false, false, true},
         {"wallet", "getunconfirmedbalance", &getunconfirmedbalance, false, false, true},
         {"wallet", "getwalletinfo", &getwalletinfo, false, false, true},
-        {"wallet", "importprivkey", &importprivkey, true, false, true},
-        {"wallet", "importwallet", &importwallet, true, false, true},
-        {"wallet", "importaddress", &importaddress, true, false, true},
+        {"wallet", "importprivkey", &importprivkey, true, true, true},
+        {"wallet", "importwallet", &importwallet, true, true, true},
+        {"wallet", "importaddress", &importaddress, true, true, true},
         {"wallet", "keypoolrefill", &keypoolrefill, true, false, true},
         {"wallet", "listaccounts", &listaccounts, false, false, true},
         {"wallet", "listaddressgroupings", &listaddressgroupings, false, false, true},
         {"wallet", "listlockunspent", &listlockunspent, false, false, true},
+        {"wallet", "listwallets", &listwallets, true, true, true},
         {"wallet", "listreceivedbyaccount", &listreceivedbyaccount, false, false, true},
         {"wallet", "listreceivedbyaddress", &listreceivedbyaddress, false, false, true},
         {"wallet", "listsinceblock", &listsinceblock, false, false, true},
@@ -390,6 +412,17 @@ static const CRPCCommand vRPCCommands[] =
 #endif // ENABLE_WALLET
 };
 
+static const CRPCStreamCommand vRPCStreamCommands[] =
+    {
+        {"getblock", &getblock_stream},
+        {"getrawmempool", &getrawmempool_stream},
+        {"listmasternodes", &listmasternodes_stream},
+#ifdef ENABLE_WALLET
+        {"listtransactions", &listtransactions_stream},
+        {"listunspent", &listunspent_stream},
+#endif // ENABLE_WALLET
+};
+
 CRPCTable::CRPCTable()
 {
     unsigned int vcidx;
@@ -399,6 +432,15 @@ CRPCTable::CRPCTable()
         pcmd = &vRPCCommands[vcidx];
         mapCommands[pcmd->name] = pcmd;
     }
+    for (vcidx = 0; vcidx < (sizeof(vRPCStreamCommands) / sizeof(vRPCStreamCommands[0])); vcidx++)
+        mapStreamActors[vRPCStreamCommands[vcidx].name] = vRPCStreamCommands[vcidx].actor;
+}
+
+UniValue RPCStreamToValue(rpcstreamfn_type actor, const UniValue& params, bool fHelp)
+{
+    CJSONValueWriter writer;
+    actor(params, fHelp, writer);
+    return writer.GetValue();
 }
 
 const CRPCCommand* CRPCTable::operator[](string name) const
@@ -460,22 +502,110 @@ bool ClientAllowed(const boost::asio::ip::address& address)
     return false;
 }
 
+/**
+ * The requests read off the RPC connections wait here for a worker thread.
+ * At most nMaxDepth of them wait at once: a client sending more than the
+ * workers keep up with gets a 503 for the extra requests at once, instead of
+ * every client waiting longer and longer.
+ */
+class CRPCWorkQueue
+{
+private:
+    boost::mutex cs;
+    boost::condition_variable cond;
+    std::deque<boost::function<void()> > queue;
+    const size_t nMaxDepth;
+    bool fRunning;
+
+public:
+    explicit CRPCWorkQueue(size_t nMaxDepthIn) : nMaxDepth(nMaxDepthIn), fRunning(true) {}
+
+    //! Queue a request for the workers, false if the queue is full or shutting down
+    bool Enqueue(const boost::function<void()>& func)
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (!fRunning || queue.size() >= nMaxDepth)
+            return false;
+        queue.push_back(func);
+        cond.notify_one();
+        return true;
+    }
+
+    //! Handle queued requests until Interrupt is called
+    void Run()
+    {
+        RenameThread("valuto-rpcworker");
+        while (true) {
+            boost::function<void()> func;
+            {
+                boost::unique_lock<boost::mutex> lock(cs);
+                while (fRunning && queue.empty())
+                    cond.wait(lock);
+                if (!fRunning)
+                    return;
+                func = queue.front();
+                queue.pop_front();
+            }
+            try {
+                func();
+            } catch (std::exception& e) {
+                PrintExceptionContinue(&e, "valuto-rpcworker");
+            }
+        }
+    }
+
+    //! Make the workers return once done with the request they are on
+    void Interrupt()
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        fRunning = false;
+        cond.notify_all();
+    }
+};
+
+static CRPCWorkQueue* rpc_work_queue = NULL;
+static int rpc_server_timeout = DEFAULT_RPC_SERVER_TIMEOUT;
+//! Maximum size of the request line and headers of an HTTP request
+static const size_t MAX_HEADERS_SIZE = 8192;
+//! Maximum number of chunks of a streamed reply waiting to be sent on a connection
+static const size_t MAX_QUEUED_CHUNKS = 16;
+
+static bool ServiceRequest(AcceptedConnection* conn, int nProto, const string& strURI, string& strRequest, map<string, string>& mapHeaders, bool fRun);
+
+/**
+ * An RPC client connection. Its requests are read and its replies written
+ * asynchronously on the I/O threads, so that a connection kept alive between
+ * requests holds no thread; each request is handled on a worker thread. The
+ * requests a client pipelines are handled in turn: the next one is parsed
+ * from what already arrived once the reply to the last one is on its way.
+ */
 template <typename Protocol>
-class AcceptedConnectionImpl : public AcceptedConnection
+class AcceptedConnectionImpl : public AcceptedConnection,
+                               public boost::enable_shared_from_this<AcceptedConnectionImpl<Protocol> >
 {
 public:
     AcceptedConnectionImpl(
         asio::io_service& io_service,
         ssl::context& context,
-        bool fUseSSL) : sslStream(io_service, context),
-                        _d(sslStream, fUseSSL),
-                        _stream(_d)
+        bool fUseSSLIn) : sslStream(io_service, context),
+                          strand(io_service),
+                          timer(io_service),
+                          buf(MAX_HEADERS_SIZE),
+                          fUseSSL(fUseSSLIn),
+                          fWriting(false),
+                          nChunksQueued(0),
+                          fWriteFailed(false),
+                          fReplyDone(false),
+                          fKeepAlive(false),
+                          nProto(0),
+                          nContentLength(0),
+                          fRun(false)
     {
     }
 
     virtual std::iostream& stream()
     {
-        return _stream;
+        return replyStream;
     }
 
     virtual std::string peer_address_to_string() const
@@ -485,25 +615,298 @@ public:
 
     virtual void close()
     {
-        _stream.close();
+        boost::system::error_code ec;
+        timer.cancel(ec);
+        sslStream.lowest_layer().shutdown(Protocol::socket::shutdown_both, ec);
+        sslStream.lowest_layer().close(ec);
+    }
+
+    virtual void send_partial(const std::string& strData)
+    {
+        {
+            // Wait for the client to take some of the chunks already queued, so that a
+            // slow reader doesn't make the whole reply pile up here. A client that takes
+            // none for -rpcservertimeout is dropped. The I/O threads may stop before
+            // sending them at shutdown, so don't wait for them then.
+            boost::unique_lock<boost::mutex> lock(csChunks);
+            boost::posix_time::ptime deadline = boost::posix_time::microsec_clock::universal_time() + boost::posix_time::seconds(rpc_server_timeout);
+            while (nChunksQueued >= MAX_QUEUED_CHUNKS && !fWriteFailed && !ShutdownRequested()) {
+                boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+                if (now >= deadline) {
+                    LogPrint("rpc", "Closing the RPC connection from %s, its client stopped reading the reply\n", peer_address_to_string());
+                    fWriteFailed = true;
+                    strand.post(boost::bind(&AcceptedConnectionImpl::close, this->shared_from_this()));
+                    break;
+                }
+                condChunks.timed_wait(lock, std::min(deadline, now + boost::posix_time::milliseconds(100)));
+            }
+            if (fWriteFailed || ShutdownRequested())
+                return;
+            nChunksQueued++;
+        }
+        boost::shared_ptr<std::string> pData(new std::string(strData));
+        strand.post(boost::bind(&AcceptedConnectionImpl::QueueWrite, this->shared_from_this(), pData, false, false));
+    }
+
+    //! Start reading the requests of the client, after the SSL handshake if SSL is used
+    void Start();
+    //! Send strReply, then read the next request if fKeepAlive or else close the connection
+    void SendReply(const std::string& strReply, bool fKeepAliveIn)
+    {
+        QueueWrite(boost::shared_ptr<std::string>(new std::string(strReply)), true, fKeepAliveIn);
     }
 
     typename Protocol::endpoint peer;
     asio::ssl::stream<typename Protocol::socket> sslStream;
 
 private:
-    SSLIOStreamDevice<Protocol> _d;
-    iostreams::stream<SSLIOStreamDevice<Protocol> > _stream;
+    asio::io_service::strand strand;
+    deadline_timer timer;
+    //! What was read ahead of the request being parsed; holds up to MAX_HEADERS_SIZE, the body goes to strRequest
+    asio::streambuf buf;
+    std::stringstream replyStream;
+    const bool fUseSSL;
+
+    //! What is waiting to be sent: a reply, or the parts of one sent while it is written
+    std::deque<boost::shared_ptr<std::string> > queueWrites;
+    bool fWriting;
+    //! Chunks passed to send_partial and not sent yet; the worker streaming them waits at MAX_QUEUED_CHUNKS
+    boost::mutex csChunks;
+    boost::condition_variable condChunks;
+    size_t nChunksQueued;
+    bool fWriteFailed;
+    //! Whether the whole reply is queued, and whether to read the next request once it is sent
+    bool fReplyDone;
+    bool fKeepAlive;
+
+    //! The request being read or handled
+    std::string strMethod, strURI, strRequest;
+    std::map<std::string, std::string> mapHeaders;
+    int nProto;
+    size_t nContentLength;
+    bool fRun;
+
+    void SetTimeout();
+    void ReadRequest();
+    void HandleTimeout(const boost::system::error_code& error);
+    void HandleHandshake(const boost::system::error_code& error);
+    void HandleHeaders(const boost::system::error_code& error);
+    void HandleBody(const boost::system::error_code& error);
+    void QueueWrite(boost::shared_ptr<std::string> pData, bool fLast, bool fKeepAliveIn);
+    void WriteNext();
+    void HandleWrite(const boost::system::error_code& error);
+    void ChunkSent(bool fFailed);
+    void Process();
 };
 
-void ServiceConnection(AcceptedConnection* conn);
+template <typename Protocol>
+void AcceptedConnectionImpl<Protocol>::Start()
+{
+    SetTimeout();
+    if (fUseSSL)
+        sslStream.async_handshake(ssl::stream_base::server,
+            strand.wrap(boost::bind(&AcceptedConnectionImpl::HandleHandshake, this->shared_from_this(), asio::placeholders::error)));
+    else
+        strand.post(boost::bind(&AcceptedConnectionImpl::ReadRequest, this->shared_from_this()));
+}
+
+template <typename Protocol>
+void AcceptedConnectionImpl<Protocol>::SetTimeout()
+{
+    timer.expires_from_now(posix_time::seconds(rpc_server_timeout));
+    timer.async_wait(strand.wrap(boost::bind(&AcceptedConnectionImpl::HandleTimeout, this->shared_from_this(), asio::placeholders::error)));
+}
+
+template <typename Protocol>
+void AcceptedConnectionImpl<Protocol>::HandleTimeout(const boost::system::error_code& error)
+{
+    // the timer may have been set again after it went off
+    if (error != asio::error::operation_aborted && timer.expires_at() <= deadline_timer::traits_type::now())
+        close();
+}
+
+template <typename Protocol>
+void AcceptedConnectionImpl<Protocol>::HandleHandshake(const boost::system::error_code& error)
+{
+    if (error) {
+        close();
+        return;
+    }
+    ReadRequest();
+}
+
+template <typename Protocol>
+void AcceptedConnectionImpl<Protocol>::ReadRequest()
+{
+    SetTimeout();
+    if (fUseSSL)
+        asio::async_read_until(sslStream, buf, "\r\n\r\n",
+            strand.wrap(boost::bind(&AcceptedConnectionImpl::HandleHeaders, this->shared_from_this(), asio::placeholders::error)));
+    else
+        asio::async_read_until(sslStream.next_layer(), buf, "\r\n\r\n",
+            strand.wrap(boost::bind(&AcceptedConnectionImpl::HandleHeaders, this->shared_from_this(), asio::placeholders::error)));
+}
+
+template <typename Protocol>
+void AcceptedConnectionImpl<Protocol>::HandleHeaders(const boost::system::error_code& error)
+{
+    // the headers don't fit in buf
+    if (error == asio::error::not_found) {
+        SendReply(HTTPError(HTTP_REQUEST_HEADER_FIELDS_TOO_LARGE, false), false);
+        return;
+    }
+    // the client went away, or the connection timed out
+    if (error) {
+        close();
+        return;
+    }
+
+    std::istream streamHeaders(&buf);
+    if (!ReadHTTPRequestLine(streamHeaders, nProto, strMethod, strURI)) {
+        close();
+        return;
+    }
+    mapHeaders.clear();
+    int nLen = ReadHTTPHeaders(streamHeaders, mapHeaders);
+    if (nLen < 0 || (size_t)nLen > MAX_SIZE) {
+        SendReply(HTTPError(HTTP_BAD_REQUEST, false), false);
+        return;
+    }
+    nContentLength = nLen;
+
+    std::string& strConnection = mapHeaders["connection"];
+    if (strConnection != "close" && strConnection != "keep-alive")
+        strConnection = nProto >= 1 ? "keep-alive" : "close";
+    // HTTP Keep-Alive is false; close connection after the reply
+    fRun = strConnection != "close" && GetBoolArg("-rpckeepalive", true);
+
+    // the body is what already came with the headers, then the rest read straight into strRequest
+    size_t nBuffered = std::min(buf.size(), nContentLength);
+    asio::streambuf::const_buffers_type data = buf.data();
+    strRequest.assign(asio::buffers_begin(data), asio::buffers_begin(data) + nBuffered);
+    buf.consume(nBuffered);
+    if (nBuffered == nContentLength) {
+        HandleBody(boost::system::error_code());
+        return;
+    }
+    strRequest.resize(nContentLength);
+    if (fUseSSL)
+        asio::async_read(sslStream, asio::buffer(&strRequest[nBuffered], nContentLength - nBuffered),
+            strand.wrap(boost::bind(&AcceptedConnectionImpl::HandleBody, this->shared_from_this(), asio::placeholders::error)));
+    else
+        asio::async_read(sslStream.next_layer(), asio::buffer(&strRequest[nBuffered], nContentLength - nBuffered),
+            strand.wrap(boost::bind(&AcceptedConnectionImpl::HandleBody, this->shared_from_this(), asio::placeholders::error)));
+}
+
+template <typename Protocol>
+void AcceptedConnectionImpl<Protocol>::HandleBody(const boost::system::error_code& error)
+{
+    if (error) {
+        close();
+        return;
+    }
+
+    boost::system::error_code ec;
+    timer.cancel(ec);
+
+    if (!rpc_work_queue->Enqueue(boost::bind(&AcceptedConnectionImpl::Process, this->shared_from_this()))) {
+        LogPrintf("WARNING: request rejected because the RPC work queue is full, it can be made deeper with -rpcworkqueue\n");
+        SendReply(HTTPError(HTTP_SERVICE_UNAVAILABLE, false), false);
+    }
+}
+
+template <typename Protocol>
+void AcceptedConnectionImpl<Protocol>::Process()
+{
+    bool fKeepAliveReply = ServiceRequest(this, nProto, strURI, strRequest, mapHeaders, fRun) && fRun && !ShutdownRequested();
+    boost::shared_ptr<std::string> pReply(new std::string(replyStream.str()));
+    replyStream.str("");
+    replyStream.clear();
+    strand.post(boost::bind(&AcceptedConnectionImpl::QueueWrite, this->shared_from_this(), pReply, true, fKeepAliveReply));
+}
+
+template <typename Protocol>
+void AcceptedConnectionImpl<Protocol>::QueueWrite(boost::shared_ptr<std::string> pData, bool fLast, bool fKeepAliveIn)
+{
+    queueWrites.push_back(pData);
+    if (fLast) {
+        fReplyDone = true;
+        fKeepAlive = fKeepAliveIn;
+    }
+    if (!fWriting)
+        WriteNext();
+}
+
+template <typename Protocol>
+void AcceptedConnectionImpl<Protocol>::WriteNext()
+{
+    fWriting = true;
+    // a client that doesn't take what is written within the timeout is dropped
+    SetTimeout();
+    const std::string& strData = *queueWrites.front();
+    if (fUseSSL)
+        asio::async_write(sslStream, asio::buffer(strData),
+            strand.wrap(boost::bind(&AcceptedConnectionImpl::HandleWrite, this->shared_from_this(), asio::placeholders::error)));
+    else
+        asio::async_write(sslStream.next_layer(), asio::buffer(strData),
+            strand.wrap(boost::bind(&AcceptedConnectionImpl::HandleWrite, this->shared_from_this(), asio::placeholders::error)));
+}
+
+template <typename Protocol>
+void AcceptedConnectionImpl<Protocol>::HandleWrite(const boost::system::error_code& error)
+{
+    // Everything queued ahead of the last part of a reply is a chunk from send_partial.
+    bool fChunk = !(fReplyDone && queueWrites.size() == 1);
+    queueWrites.pop_front();
+    if (error) {
+        // what is still queued can't be sent either
+        ChunkSent(true);
+        queueWrites.clear();
+        fWriting = false;
+        fReplyDone = false;
+        close();
+        return;
+    }
+    if (fChunk)
+        ChunkSent(false);
+    if (!queueWrites.empty()) {
+        WriteNext();
+        return;
+    }
+    fWriting = false;
+    if (!fReplyDone) {
+        // waiting for the worker to write more of the reply, not for the client
+        boost::system::error_code ec;
+        timer.cancel(ec);
+        return;
+    }
+    fReplyDone = false;
+    if (fKeepAlive)
+        ReadRequest();
+    else
+        close();
+}
+
+template <typename Protocol>
+void AcceptedConnectionImpl<Protocol>::ChunkSent(bool fFailed)
+{
+    boost::unique_lock<boost::mutex> lock(csChunks);
+    if (fFailed) {
+        // nothing more gets sent, the worker stops streaming
+        fWriteFailed = true;
+        nChunksQueued = 0;
+    } else if (nChunksQueued > 0) {
+        nChunksQueued--;
+    }
+    condChunks.notify_all();
+}
 
 //! Forward declaration required for RPCListen
 template <typename Protocol>
 static void RPCAcceptHandler(boost::shared_ptr< basic_socket_acceptor<Protocol> > acceptor,
     ssl::context& context,
     bool fUseSSL,
-    boost::shared_ptr<AcceptedConnection> conn,
+    boost::shared_ptr<AcceptedConnectionImpl<Protocol> > conn,
     const boost::system::error_code& error);
 
 /**
@@ -536,30 +939,28 @@ template <typename Protocol>
 static void RPCAcceptHandler(boost::shared_ptr< basic_socket_acceptor<Protocol> > acceptor,
     ssl::context& context,
     const bool fUseSSL,
-    boost::shared_ptr<AcceptedConnection> conn,
+    boost::shared_ptr<AcceptedConnectionImpl<Protocol> > conn,
     const boost::system::error_code& error)
 {
     // Immediately start accepting new connections, except when we're cancelled or our socket is closed.
     if (error != asio::error::operation_aborted && acceptor->is_open())
         RPCListen(acceptor, context, fUseSSL);
 
-    AcceptedConnectionImpl<ip::tcp>* tcp_conn = dynamic_cast<AcceptedConnectionImpl<ip::tcp>*>(conn.get());
-
     if (error) {
         // TODO: Actually handle errors
         LogPrintf("%s: Error: %s\n", __func__, error.message());
     }
     // Restrict callers by IP.  It is important to
-    // do this before starting client thread, to filter out
+    // do this before reading any request, to filter out
     // certain DoS and misbehaving clients.
-    else if (tcp_conn && !ClientAllowed(tcp_conn->peer.address())) {
+    else if (!ClientAllowed(conn->peer.address())) {
         // Only send a 403 if we're not using SSL to prevent a DoS during the SSL handshake.
         if (!fUseSSL)
-            conn->stream() << HTTPError(HTTP_FORBIDDEN, false) << std::flush;
-        conn->close();
+            conn->SendReply(HTTPError(HTTP_FORBIDDEN, false), false);
+        else
+            conn->close();
     } else {
-        ServiceConnection(conn.get());
-        conn->close();
+        conn->Start();
     }
 }
 
@@ -622,6 +1023,10 @@ void StartRPCThreads()
     assert(rpc_io_service == NULL);
     rpc_io_service = new asio::io_service();
     rpc_ssl_context = new ssl::context(ssl::context::sslv23);
+    int nWorkQueue = std::max((int)GetArg("-rpcworkqueue", DEFAULT_RPC_WORKQUEUE), 1);
+    LogPrint("rpc", "RPC work queue depth %d\n", nWorkQueue);
+    rpc_work_queue = new CRPCWorkQueue(nWorkQueue);
+    rpc_server_timeout = std::max((int)GetArg("-rpcservertimeout", DEFAULT_RPC_SERVER_TIMEOUT), 1);
 
     const bool fUseSSL = GetBoolArg("-rpcssl", false);
 
@@ -719,9 +1124,15 @@ void StartRPCThreads()
         return;
     }
 
+    // the I/O threads only read requests and write replies, the workers handle the requests
+    int nWorkers = std::max((int)GetArg("-rpcthreads", DEFAULT_RPC_THREADS), 1);
+    LogPrintf("RPC server: %d worker threads\n", nWorkers);
     rpc_worker_group = new boost::thread_group();
-    for (int i = 0; i < GetArg("-rpcthreads", 4); i++)
-        rpc_worker_group->create_thread(boost::bind(&asio::io_service::run, rpc_io_service));
+    for (int i = 0; i < nWorkers; i++)
+        rpc_worker_group->create_thread(boost::bind(&CRPCWorkQueue::Run, rpc_work_queue));
+    rpc_io_group = new boost::thread_group();
+    for (int i = 0; i < RPC_IO_THREADS; i++)
+        rpc_io_group->create_thread(boost::bind(&asio::io_service::run, rpc_io_service));
     fRPCRunning = true;
 }
 
@@ -732,8 +1143,8 @@ void StartDummyRPCThread()
         /* Create dummy "work" to keep the thread from exiting when no timeouts active,
          * see http://www.boost.org/doc/libs/1_51_0/doc/html/boost_asio/reference/io_service.html#boost_asio.reference.io_service.stopping_the_io_service_from_running_out_of_work */
         rpc_dummy_work = new asio::io_service::work(*rpc_io_service);
-        rpc_worker_group = new boost::thread_group();
-        rpc_worker_group->create_thread(boost::bind(&asio::io_service::run, rpc_io_service));
+        rpc_io_group = new boost::thread_group();
+        rpc_io_group->create_thread(boost::bind(&asio::io_service::run, rpc_io_service));
         fRPCRunning = true;
     }
 }
@@ -761,14 +1172,23 @@ void StopRPCThreads()
     }
     deadlineTimers.clear();
 
-    rpc_io_service->stop();
+    // Let the workers finish the requests they are on before the connections go
+    if (rpc_work_queue != NULL)
+        rpc_work_queue->Interrupt();
     cvBlockChange.notify_all();
     if (rpc_worker_group != NULL)
         rpc_worker_group->join_all();
-    delete rpc_dummy_work;
-    rpc_dummy_work = NULL;
+    rpc_io_service->stop();
+    if (rpc_io_group != NULL)
+        rpc_io_group->join_all();
     delete rpc_worker_group;
     rpc_worker_group = NULL;
+    delete rpc_work_queue;
+    rpc_work_queue = NULL;
+    delete rpc_dummy_work;
+    rpc_dummy_work = NULL;
+    delete rpc_io_group;
+    rpc_io_group = NULL;
     delete rpc_ssl_context;
     rpc_ssl_context = NULL;
     delete rpc_io_service;
@@ -861,7 +1281,7 @@ void JSONRequest::parse(const UniValue& valRequest)
 }
 
 
-static UniValue JSONRPCExecOne(const UniValue& req)
+static UniValue JSONRPCExecOne(const UniValue& req, const string& strWallet)
 {
     UniValue rpc_result(UniValue::VOBJ);
 
@@ -869,7 +1289,7 @@ static UniValue JSONRPCExecOne(const UniValue& req)
     try {
         jreq.parse(req);
 
-        UniValue result = tableRPC.execute(jreq.strMethod, jreq.params);
+        UniValue result = tableRPC.execute(jreq.strMethod, jreq.params, strWallet);
         rpc_result = JSONRPCReplyObj(result, NullUniValue, jreq.id);
     } catch (const UniValue& objError) {
         rpc_result = JSONRPCReplyObj(NullUniValue, objError, jreq.id);
@@ -881,17 +1301,33 @@ static UniValue JSONRPCExecOne(const UniValue& req)
     return rpc_result;
 }
 
-static string JSONRPCExecBatch(const UniValue& vReq)
+static string JSONRPCExecBatch(const UniValue& vReq, const string& strWallet)
 {
     UniValue ret(UniValue::VARR);
     for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+        ret.push_back(JSONRPCExecOne(vReq[reqIdx], strWallet));
 
     return ret.write() + "\n";
 }
 
+/** Send a chunk of a reply that is still being written, after the reply header for the first one. */
+static void SendReplyChunk(AcceptedConnection* conn, bool& fChunked, bool fRun, const std::string& strChunk)
+{
+    std::string strData;
+    if (!fChunked) {
+        strData = HTTPReplyHeaderChunked(HTTP_OK, fRun);
+        fChunked = true;
+    }
+    strData += strprintf("%x\r\n", strChunk.size());
+    strData += strChunk;
+    strData += "\r\n";
+    conn->send_partial(strData);
+}
+
 static bool HTTPReq_JSONRPC(AcceptedConnection* conn,
+    int nProto,
     string& strRequest,
+    const string& strWallet,
     map<string, string>& mapHeaders,
     bool fRun)
 {
@@ -913,6 +1349,8 @@ static bool HTTPReq_JSONRPC(AcceptedConnection* conn,
     }
 
     JSONRequest jreq;
+    // once part of the reply is sent, a failure can only be told by closing the connection
+    bool fChunked = false;
     try {
         // Parse request
         UniValue valRequest;
@@ -932,72 +1370,100 @@ static bool HTTPReq_JSONRPC(AcceptedConnection* conn,
         if (valRequest.isObject()) {
             jreq.parse(valRequest);
 
-            UniValue result = tableRPC.execute(jreq.strMethod, jreq.params);
+            // The reply is written as the result is produced. Once it outgrows a chunk,
+            // HTTP/1.1 clients get it in chunks while the rest is written.
+            CJSONStreamWriter writer;
+            if (nProto >= 1)
+                writer.SetSink(RPC_REPLY_CHUNK_SIZE, boost::bind(&SendReplyChunk, conn, boost::ref(fChunked), fRun, _1));
+            writer.BeginObject();
+            writer.Key("result");
+            tableRPC.execute(jreq.strMethod, jreq.params, strWallet, &writer);
+            writer.KeyValue("error", NullUniValue);
+            writer.KeyValue("id", jreq.id);
+            writer.EndObject();
 
             // Send reply
-            strReply = JSONRPCReply(result, NullUniValue, jreq.id);
+            string& strBody = writer.GetBuffer();
+            strBody += "\n";
+            if (fChunked)
+                conn->stream() << strprintf("%x\r\n", strBody.size()) << strBody << "\r\n0\r\n\r\n" << std::flush;
+            else
+                conn->stream() << HTTPReplyHeader(HTTP_OK, fRun, strBody.size()) << strBody << std::flush;
+            return true;
 
         // array of requests
         } else if (valRequest.isArray())
-            strReply = JSONRPCExecBatch(valRequest.get_array());
+            strReply = JSONRPCExecBatch(valRequest.get_array(), strWallet);
         else
             throw JSONRPCError(RPC_PARSE_ERROR, "Top-level object parse error");
 
         conn->stream() << HTTPReplyHeader(HTTP_OK, fRun, strReply.size()) << strReply << std::flush;
     } catch (const UniValue& objError) {
-        ErrorReply(conn->stream(), objError, jreq.id);
+        if (fChunked)
+            LogPrintf("ThreadRPCServer method=%s failed after part of its reply was sent\n", SanitizeString(jreq.strMethod));
+        else
+            ErrorReply(conn->stream(), objError, jreq.id);
         return false;
     } catch (std::exception& e) {
-        ErrorReply(conn->stream(), JSONRPCError(RPC_PARSE_ERROR, e.what()), jreq.id);
+        if (fChunked)
+            LogPrintf("ThreadRPCServer method=%s failed after part of its reply was sent: %s\n", SanitizeString(jreq.strMethod), e.what());
+        else
+            ErrorReply(conn->stream(), JSONRPCError(RPC_PARSE_ERROR, e.what()), jreq.id);
         return false;
     }
     return true;
 }
 
-void ServiceConnection(AcceptedConnection* conn)
+/**
+ * Handle one request read off conn, writing the reply to conn->stream().
+ * Returns false if the connection is to be closed after the reply.
+ */
+static bool ServiceRequest(AcceptedConnection* conn, int nProto, const string& strURI, string& strRequest, map<string, string>& mapHeaders, bool fRun)
 {
-    bool fRun = true;
-    while (fRun && !ShutdownRequested()) {
-        int nProto = 0;
-        map<string, string> mapHeaders;
-        string strRequest, strMethod, strURI;
-
-        // Read HTTP request line
-        if (!ReadHTTPRequestLine(conn->stream(), nProto, strMethod, strURI))
-            break;
-
-        // Read HTTP message headers and body
-        ReadHTTPMessage(conn->stream(), mapHeaders, strRequest, nProto, MAX_SIZE);
-
-        // HTTP Keep-Alive is false; close connection immediately
-        if ((mapHeaders["connection"] == "close") || (!GetBoolArg("-rpckeepalive", true)))
-            fRun = false;
-
-        // Process via JSON-RPC API
-        if (strURI == "/") {
-            if (!HTTPReq_JSONRPC(conn, strRequest, mapHeaders, fRun))
-                break;
+    // Process via JSON-RPC API, for the default wallet or the one named in the URI
+    if (strURI == "/" || strURI.substr(0, 8) == "/wallet/")
+        return HTTPReq_JSONRPC(conn, nProto, strRequest, strURI.size() > 8 ? strURI.substr(8) : "", mapHeaders, fRun);
+
+    // Process via HTTP REST API
+    if (strURI.substr(0, 6) == "/rest/" && GetBoolArg("-rest", false)) {
+        string strRESTURI = strURI;
+        return HTTPReq_REST(conn, strRESTURI, mapHeaders, fRun);
+    }
 
-            // Process via HTTP REST API
-        } else if (strURI.substr(0, 6) == "/rest/" && GetBoolArg("-rest", false)) {
-            if (!HTTPReq_REST(conn, strURI, mapHeaders, fRun))
-                break;
+    conn->stream() << HTTPError(HTTP_NOT_FOUND, false) << std::flush;
+    return false;
+}
 
-        } else {
-            conn->stream() << HTTPError(HTTP_NOT_FOUND, false) << std::flush;
-            break;
-        }
+//! Run the call, with its streaming actor if it has one and the result is written out
+static UniValue RunActor(const CRPCCommand* pcmd, rpcstreamfn_type streamActor, const UniValue& params, CJSONWriter* pwriter)
+{
+    if (streamActor) {
+        streamActor(params, false, *pwriter);
+        return NullUniValue;
     }
+    return pcmd->actor(params, false);
 }
 
-UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params) const
+UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params, const std::string &strWallet, CJSONWriter* pwriter) const
 {
     // Find method
     const CRPCCommand* pcmd = tableRPC[strMethod];
     if (!pcmd)
         throw JSONRPCError(RPC_METHOD_NOT_FOUND, "Method not found");
+    rpcstreamfn_type streamActor = NULL;
+    if (pwriter) {
+        std::map<std::string, rpcstreamfn_type>::const_iterator it = mapStreamActors.find(strMethod);
+        if (it != mapStreamActors.end())
+            streamActor = it->second;
+    }
 #ifdef ENABLE_WALLET
-    if (pcmd->reqWallet && !pwalletMain)
+    CWallet* pwallet = pwalletMain;
+    if (!strWallet.empty()) {
+        pwallet = FindWallet(strWallet);
+        if (!pwallet)
+            throw JSONRPCError(RPC_WALLET_NOT_FOUND, "Requested wallet does not exist or is not loaded");
+    }
+    if (pcmd->reqWallet && !pwallet)
         throw JSONRPCError(RPC_METHOD_NOT_FOUND, "Method not found (disabled)");
 #endif
 
@@ -1011,37 +1477,60 @@ UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params
         // Execute
         UniValue result;
         {
-            if (pcmd->threadSafe)
-                result = pcmd->actor(params, false);
 #ifdef ENABLE_WALLET
-            else if (!pwalletMain) {
+            // the wallet calls made by the method go to the wallet the request is for
+            CWalletRPCScope walletScope(pwallet);
+            // the wallet writes of one call reach the disk together
+            CDBBatch walletBatch(pcmd->reqWallet && pwallet);
+#endif
+            // a streaming actor takes its locks for each batch of rows, and writes them with none held
+            if (pcmd->threadSafe || streamActor)
+                result = RunActor(pcmd, streamActor, params, pwriter);
+#ifdef ENABLE_WALLET
+            else if (!pwallet) {
                 LOCK(cs_main);
-                result = pcmd->actor(params, false);
+                result = RunActor(pcmd, streamActor, params, pwriter);
             } else {
+                // A wallet call locks the wallet it is for. Calls to different wallets still run
+                // one at a time, as each one holds cs_main. A call that is not a wallet call may
+                // use the default wallet, as the masternode calls do, so that one is locked too.
+                CWallet* pwalletDefault = pcmd->reqWallet ? pwallet : pwalletMain;
                 while (true) {
                     TRY_LOCK(cs_main, lockMain);
                     if (!lockMain) {
                         MilliSleep(50);
                         continue;
                     }
-                    while (true) {
-                        TRY_LOCK(pwalletMain->cs_wallet, lockWallet);
-                        if (!lockMain) {
-                            MilliSleep(50);
-                            continue;
-                        }
-                        result = pcmd->actor(params, false);
-                        break;
+                    TRY_LOCK(pwallet->cs_wallet, lockWallet);
+                    if (!lockWallet) {
+                        MilliSleep(50);
+                        continue;
+                    }
+                    TRY_LOCK(pwalletDefault->cs_wallet, lockDefault);
+                    if (!lockDefault) {
+                        MilliSleep(50);
+                        continue;
                     }
+                    result = RunActor(pcmd, streamActor, params, pwriter);
                     break;
                 }
             }
 #else  // ENABLE_WALLET
             else {
                 LOCK(cs_main);
-                result = pcmd->actor(params, false);
+                result = RunActor(pcmd, streamActor, params, pwriter);
             }
 #endif // !ENABLE_WALLET
+#ifdef ENABLE_WALLET
+            // the result may hand out new keys or name a transaction already relayed, so their records go to disk first
+            if (!walletBatch.Commit())
+                throw JSONRPCError(RPC_DATABASE_ERROR, "Error: the wallet changes of the call could not be written to disk");
+#endif
+        }
+        // the other calls return their result, which is written out without holding their locks
+        if (pwriter && !streamActor) {
+            pwriter->Value(result);
+            return NullUniValue;
         }
         return result;
     } catch (std::exception& e) {
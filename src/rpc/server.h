@@ -23,14 +23,28 @@
 
 
 class CBlockIndex;
+class CJSONWriter;
 class CNetAddr;
 
+//! Default number of threads handling RPC requests
+static const int DEFAULT_RPC_THREADS = 4;
+//! Default number of RPC requests that may wait for a thread before more are turned away
+static const int DEFAULT_RPC_WORKQUEUE = 16;
+//! Default number of seconds an RPC connection may stay idle
+static const int DEFAULT_RPC_SERVER_TIMEOUT = 30;
+//! Number of rows a streamed RPC result collects under its locks before they are written out
+static const unsigned int RPC_STREAM_BATCH_ROWS = 1000;
+
+/** An RPC client connection, as the request handlers see it. */
 class AcceptedConnection
 {
 public:
     virtual ~AcceptedConnection() {}
 
+    //! Where the reply to the current request goes; it is sent once the handler returns
     virtual std::iostream& stream() = 0;
+    //! Send part of the reply to the current request right away, ahead of what is left in stream()
+    virtual void send_partial(const std::string& strData) = 0;
     virtual std::string peer_address_to_string() const = 0;
     virtual void close() = 0;
 };
@@ -84,6 +98,8 @@ void RPCRunLater(const std::string& name, boost::function<void(void)> func, int6
 extern CNetAddr BoostAsioToCNetAddr(boost::asio::ip::address address);
 
 typedef UniValue(*rpcfn_type)(const UniValue& params, bool fHelp);
+//! A call that writes its result as it produces it rather than returning it
+typedef void (*rpcstreamfn_type)(const UniValue& params, bool fHelp, CJSONWriter& writer);
 
 class CRPCCommand
 {
@@ -96,6 +112,18 @@ public:
     bool reqWallet;
 };
 
+/**
+ * The streaming actor of a call with a large result, used when the result is written out.
+ * It is run without the locks the call otherwise gets, and takes them itself for each
+ * batch of RPC_STREAM_BATCH_ROWS rows, so that none is held while the client reads.
+ */
+class CRPCStreamCommand
+{
+public:
+    std::string name;
+    rpcstreamfn_type actor;
+};
+
 /**
  * VALUTO RPC command dispatcher.
  */
@@ -103,6 +131,7 @@ class CRPCTable
 {
 private:
     std::map<std::string, const CRPCCommand*> mapCommands;
+    std::map<std::string, rpcstreamfn_type> mapStreamActors;
 
 public:
     CRPCTable();
@@ -113,10 +142,13 @@ public:
      * Execute a method.
      * @param method   Method to execute
      * @param params   UniValue Array of arguments (JSON objects)
-     * @returns Result of the call.
+     * @param wallet   File of the loaded wallet the call is for, empty for the default wallet
+     * @param pwriter  If given, the result is written to it instead of returned; calls with a
+     *                 streaming actor write it as they go, without building it in memory first
+     * @returns Result of the call, or null when it was written to pwriter.
      * @throws an exception (UniValue) when an error happens.
      */
-    UniValue execute(const std::string &method, const UniValue &params) const;
+    UniValue execute(const std::string &method, const UniValue &params, const std::string &wallet = "", CJSONWriter* pwriter = NULL) const;
 
     /**
     * Returns a list of registered commands
@@ -127,6 +159,9 @@ public:
 
 extern const CRPCTable tableRPC;
 
+//! Run a streaming actor for the result as a UniValue, which is what its plain actor returns
+UniValue RPCStreamToValue(rpcstreamfn_type actor, const UniValue& params, bool fHelp);
+
 /**
  * Utilities: convert hex-encoded Values
  * (throws error if not hex).
@@ -141,7 +176,6 @@ extern bool ParseBool(const UniValue& o, std::string strKey);
 extern void InitRPCMining();
 extern void ShutdownRPCMining();
 
-extern int64_t nWalletUnlockTime;
 extern CAmount AmountFromValue(const UniValue& value);
 extern UniValue ValueFromAmount(const CAmount& amount);
 extern double GetDifficulty(const CBlockIndex* blockindex = NULL);
@@ -200,6 +234,7 @@ extern UniValue addmultisigaddress(const UniValue& params, bool fHelp);
 extern UniValue listreceivedbyaddress(const UniValue& params, bool fHelp);
 extern UniValue listreceivedbyaccount(const UniValue& params, bool fHelp);
 extern UniValue listtransactions(const UniValue& params, bool fHelp);
+extern void listtransactions_stream(const UniValue& params, bool fHelp, CJSONWriter& writer);
 extern UniValue listaddressgroupings(const UniValue& params, bool fHelp);
 extern UniValue listaccounts(const UniValue& params, bool fHelp);
 extern UniValue listsinceblock(const UniValue& params, bool fHelp);
@@ -211,6 +246,9 @@ extern UniValue walletpassphrasechange(const UniValue& params, bool fHelp);
 extern UniValue walletlock(const UniValue& params, bool fHelp);
 extern UniValue encryptwallet(const UniValue& params, bool fHelp);
 extern UniValue getwalletinfo(const UniValue& params, bool fHelp);
+extern UniValue getrescaninfo(const UniValue& params, bool fHelp);
+extern UniValue abortrescan(const UniValue& params, bool fHelp);
+extern UniValue listwallets(const UniValue& params, bool fHelp);
 extern UniValue getblockchaininfo(const UniValue& params, bool fHelp);
 extern UniValue getnetworkinfo(const UniValue& params, bool fHelp);
 extern UniValue reservebalance(const UniValue& params, bool fHelp);
@@ -221,6 +259,7 @@ extern UniValue autocombinerewards(const UniValue& params, bool fHelp);
 
 extern UniValue getrawtransaction(const UniValue& params, bool fHelp); // in rcprawtransaction.cpp
 extern UniValue listunspent(const UniValue& params, bool fHelp);
+extern void listunspent_stream(const UniValue& params, bool fHelp, CJSONWriter& writer);
 extern UniValue lockunspent(const UniValue& params, bool fHelp);
 extern UniValue listlockunspent(const UniValue& params, bool fHelp);
 extern UniValue createrawtransaction(const UniValue& params, bool fHelp);
@@ -235,11 +274,14 @@ extern UniValue getdifficulty(const UniValue& params, bool fHelp);
 extern UniValue settxfee(const UniValue& params, bool fHelp);
 extern UniValue getmempoolinfo(const UniValue& params, bool fHelp);
 extern UniValue getrawmempool(const UniValue& params, bool fHelp);
+extern void getrawmempool_stream(const UniValue& params, bool fHelp, CJSONWriter& writer);
 extern UniValue getblockhash(const UniValue& params, bool fHelp);
 extern UniValue getblock(const UniValue& params, bool fHelp);
+extern void getblock_stream(const UniValue& params, bool fHelp, CJSONWriter& writer);
 extern UniValue getblockheader(const UniValue& params, bool fHelp);
 extern UniValue getfeeinfo(const UniValue& params, bool fHelp);
 extern UniValue gettxoutsetinfo(const UniValue& params, bool fHelp);
+extern UniValue dumptxoutset(const UniValue& params, bool fHelp);
 extern UniValue gettxout(const UniValue& params, bool fHelp);
 extern UniValue verifychain(const UniValue& params, bool fHelp);
 extern UniValue getchaintips(const UniValue& params, bool fHelp);
@@ -251,6 +293,7 @@ extern UniValue obfuscation(const UniValue& params, bool fHelp); // in rpcmaster
 extern UniValue getpoolinfo(const UniValue& params, bool fHelp);
 extern UniValue masternode(const UniValue& params, bool fHelp);
 extern UniValue listmasternodes(const UniValue& params, bool fHelp);
+extern void listmasternodes_stream(const UniValue& params, bool fHelp, CJSONWriter& writer);
 extern UniValue getmasternodecount(const UniValue& params, bool fHelp);
 extern UniValue masternodeconnect(const UniValue& params, bool fHelp);
 extern UniValue masternodecurrent(const UniValue& params, bool fHelp);
@@ -270,6 +313,11 @@ extern UniValue validateaddress(const UniValue& params, bool fHelp);
 extern UniValue createmultisig(const UniValue& params, bool fHelp);
 extern UniValue verifymessage(const UniValue& params, bool fHelp);
 extern UniValue setmocktime(const UniValue& params, bool fHelp);
+extern UniValue getaddresstxids(const UniValue& params, bool fHelp);
+extern UniValue getaddressdeltas(const UniValue& params, bool fHelp);
+extern UniValue getaddressbalance(const UniValue& params, bool fHelp);
+extern UniValue getaddressutxos(const UniValue& params, bool fHelp);
+extern UniValue getspentinfo(const UniValue& params, bool fHelp);
 extern UniValue getstakingstatus(const UniValue& params, bool fHelp);
 
 // in rest.cpp
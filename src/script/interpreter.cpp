@@ -6,12 +6,14 @@
 #include "interpreter.h"
 
 #include "primitives/transaction.h"
+#include "crypto/common.h"
 #include "crypto/ripemd160.h"
 #include "crypto/sha1.h"
 #include "crypto/sha256.h"
 #include "eccryptoverify.h"
 #include "pubkey.h"
 #include "script/script.h"
+#include "streams.h"
 #include "uint256.h"
 
 using namespace std;
@@ -936,6 +938,29 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
 
 namespace {
 
+/** Serialize the passed scriptCode, skipping OP_CODESEPARATORs */
+template<typename S>
+void SerializeScriptCode(S &s, const CScript& scriptCode) {
+    CScript::const_iterator it = scriptCode.begin();
+    CScript::const_iterator itBegin = it;
+    opcodetype opcode;
+    unsigned int nCodeSeparators = 0;
+    while (scriptCode.GetOp(it, opcode)) {
+        if (opcode == OP_CODESEPARATOR)
+            nCodeSeparators++;
+    }
+    ::WriteCompactSize(s, scriptCode.size() - nCodeSeparators);
+    it = itBegin;
+    while (scriptCode.GetOp(it, opcode)) {
+        if (opcode == OP_CODESEPARATOR) {
+            s.write((char*)&itBegin[0], it-itBegin-1);
+            itBegin = it;
+        }
+    }
+    if (itBegin != scriptCode.end())
+        s.write((char*)&itBegin[0], it-itBegin);
+}
+
 /**
  * Wrapper that serializes like CTransaction, but with the modifications
  *  required for the signature hash done in-place
@@ -959,24 +984,7 @@ public:
     /** Serialize the passed scriptCode, skipping OP_CODESEPARATORs */
     template<typename S>
     void SerializeScriptCode(S &s, int nType, int nVersion) const {
-        CScript::const_iterator it = scriptCode.begin();
-        CScript::const_iterator itBegin = it;
-        opcodetype opcode;
-        unsigned int nCodeSeparators = 0;
-        while (scriptCode.GetOp(it, opcode)) {
-            if (opcode == OP_CODESEPARATOR)
-                nCodeSeparators++;
-        }
-        ::WriteCompactSize(s, scriptCode.size() - nCodeSeparators);
-        it = itBegin;
-        while (scriptCode.GetOp(it, opcode)) {
-            if (opcode == OP_CODESEPARATOR) {
-                s.write((char*)&itBegin[0], it-itBegin-1);
-                itBegin = it;
-            }
-        }
-        if (itBegin != scriptCode.end())
-            s.write((char*)&itBegin[0], it-itBegin);
+        ::SerializeScriptCode(s, scriptCode);
     }
 
     /** Serialize an input of txTo */
@@ -1031,9 +1039,81 @@ public:
     }
 };
 
+/** Stream that writes into a SHA-256 state, for hashing from a midstate. */
+class CSHA256Writer
+{
+private:
+    CSHA256& sha;
+
+public:
+    CSHA256Writer(CSHA256& shaIn) : sha(shaIn) {}
+
+    CSHA256Writer& write(const char* pch, size_t size)
+    {
+        sha.Write((const unsigned char*)pch, size);
+        return *this;
+    }
+};
+
+//! Size of a serialized prevout
+const unsigned int BLANK_PREVOUT_SIZE = 32 + 4;
+//! Size of a blanked input: prevout, an empty script and nSequence
+const unsigned int BLANK_INPUT_SIZE = BLANK_PREVOUT_SIZE + 1 + 4;
+
 } // anon namespace
 
-uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType)
+PrecomputedTransactionData::PrecomputedTransactionData(const CTransaction& txTo) : nInputsBegin(0)
+{
+    // A single input gains nothing from the cache.
+    if (txTo.vin.size() < 2)
+        return;
+
+    // With nIn past the last input, every input script is blanked.
+    const CScript scriptEmpty;
+    CDataStream ss(SER_GETHASH, 0);
+    ss << CTransactionSignatureSerializer(txTo, scriptEmpty, txTo.vin.size(), SIGHASH_ALL);
+    vchBlank.assign(ss.begin(), ss.end());
+    nInputsBegin = sizeof(txTo.nVersion) + GetSizeOfCompactSize(txTo.vin.size());
+    assert(vchBlank.size() >= nInputsBegin + BLANK_INPUT_SIZE * txTo.vin.size());
+
+    CSHA256 sha;
+    sha.Write(&vchBlank[0], nInputsBegin);
+    vMidstate.reserve(txTo.vin.size());
+    for (unsigned int i = 0; i < txTo.vin.size(); i++) {
+        vMidstate.push_back(sha);
+        sha.Write(&vchBlank[nInputsBegin + BLANK_INPUT_SIZE * i], BLANK_INPUT_SIZE);
+    }
+}
+
+bool PrecomputedTransactionData::Covers(int nHashType) const
+{
+    return !vMidstate.empty() && !(nHashType & SIGHASH_ANYONECANPAY) &&
+           (nHashType & 0x1f) != SIGHASH_SINGLE && (nHashType & 0x1f) != SIGHASH_NONE;
+}
+
+uint256 PrecomputedTransactionData::SignatureHash(const CScript& scriptCode, unsigned int nIn, int nHashType) const
+{
+    assert(Covers(nHashType) && nIn < vMidstate.size());
+
+    // The blanked input nIn, with its empty script replaced by the script code.
+    const unsigned int nPos = nInputsBegin + BLANK_INPUT_SIZE * nIn + BLANK_PREVOUT_SIZE;
+    CSHA256 sha(vMidstate[nIn]);
+    sha.Write(&vchBlank[nPos - BLANK_PREVOUT_SIZE], BLANK_PREVOUT_SIZE);
+    CSHA256Writer writer(sha);
+    SerializeScriptCode(writer, scriptCode);
+    sha.Write(&vchBlank[nPos + 1], vchBlank.size() - nPos - 1);
+    unsigned char vchHashType[4];
+    WriteLE32(vchHashType, nHashType);
+    sha.Write(vchHashType, sizeof(vchHashType));
+
+    uint256 result;
+    unsigned char buf[CSHA256::OUTPUT_SIZE];
+    sha.Finalize(buf);
+    CSHA256().Write(buf, sizeof(buf)).Finalize((unsigned char*)&result);
+    return result;
+}
+
+uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType, const PrecomputedTransactionData* cache)
 {
     if (nIn >= txTo.vin.size()) {
         //  nIn out of range
@@ -1048,6 +1128,9 @@ uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsig
         }
     }
 
+    if (cache && cache->Covers(nHashType))
+        return cache->SignatureHash(scriptCode, nIn, nHashType);
+
     // Wrapper to serialize only the necessary parts of the transaction being signed
     CTransactionSignatureSerializer txTmp(txTo, scriptCode, nIn, nHashType);
 
@@ -1075,7 +1158,7 @@ bool TransactionSignatureChecker::CheckSig(const vector<unsigned char>& vchSigIn
     int nHashType = vchSig.back();
     vchSig.pop_back();
 
-    uint256 sighash = SignatureHash(scriptCode, *txTo, nIn, nHashType);
+    uint256 sighash = SignatureHash(scriptCode, *txTo, nIn, nHashType, txdata);
 
     if (!VerifySignature(vchSig, pubkey, sighash))
         return false;
@@ -7,6 +7,7 @@
 #define BITCOIN_SCRIPT_INTERPRETER_H
 
 #include "script_error.h"
+#include "crypto/sha256.h"
 #include "../primitives/transaction.h"
 
 #include <vector>
@@ -72,7 +73,38 @@ enum
 
 };
 
-uint256 SignatureHash(const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType);
+/**
+ * The part of the signature hash computation that all inputs of a
+ * transaction share, built once per transaction.
+ *
+ * For SIGHASH_ALL the hashed data of every input is the same serialization
+ * of the transaction with all input scripts blanked, except for the script
+ * code of the signed input. That serialization is kept here, with the
+ * SHA-256 state at the start of each input, so a signature hash only hashes
+ * the signed input's script code and the data after it instead of
+ * serializing the whole transaction again.
+ */
+class PrecomputedTransactionData
+{
+private:
+    //! txTo serialized for SIGHASH_ALL with every input script blanked
+    std::vector<unsigned char> vchBlank;
+    //! offset of the first input in vchBlank
+    unsigned int nInputsBegin;
+    //! the hash state just before each input
+    std::vector<CSHA256> vMidstate;
+
+public:
+    explicit PrecomputedTransactionData(const CTransaction& txTo);
+
+    /** Whether the signature hash of this hash type is computed from the cache. */
+    bool Covers(int nHashType) const;
+
+    /** The signature hash of input nIn; only valid if Covers(nHashType). */
+    uint256 SignatureHash(const CScript& scriptCode, unsigned int nIn, int nHashType) const;
+};
+
+uint256 SignatureHash(const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType, const PrecomputedTransactionData* cache = NULL);
 
 class BaseSignatureChecker
 {
@@ -90,12 +122,13 @@ class TransactionSignatureChecker : public BaseSignatureChecker
 private:
     const CTransaction* txTo;
     unsigned int nIn;
+    const PrecomputedTransactionData* txdata;
 
 protected:
     virtual bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 
 public:
-    TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn) : txTo(txToIn), nIn(nInIn) {}
+    TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const PrecomputedTransactionData* txdataIn = NULL) : txTo(txToIn), nIn(nInIn), txdata(txdataIn) {}
     bool CheckSig(const std::vector<unsigned char>& scriptSig, const std::vector<unsigned char>& vchPubKey, const CScript& scriptCode) const;
 };
 
@@ -105,7 +138,7 @@ private:
     const CTransaction txTo;
 
 public:
-    MutableTransactionSignatureChecker(const CMutableTransaction* txToIn, unsigned int nInIn) : TransactionSignatureChecker(&txTo, nInIn), txTo(*txToIn) {}
+    MutableTransactionSignatureChecker(const CMutableTransaction* txToIn, unsigned int nInIn, const PrecomputedTransactionData* txdataIn = NULL) : TransactionSignatureChecker(&txTo, nInIn, txdataIn), txTo(*txToIn) {}
 };
 
 bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* error = NULL);
@@ -9,6 +9,7 @@
 #include <assert.h>
 #include <climits>
 #include <limits>
+#include "../prevector.h"
 #include "../pubkey.h"
 #include <stdexcept>
 #include <stdint.h>
@@ -342,8 +343,14 @@ private:
     int64_t m_value;
 };
 
+/**
+ * Storage of a script: pay-to-pubkey-hash, pay-to-script-hash and the
+ * compressed pay-to-pubkey outputs of coinstakes fit inline.
+ */
+typedef prevector<36, unsigned char> CScriptBase;
+
 /** Serialized script, used inside transaction inputs and outputs */
-class CScript : public std::vector<unsigned char>
+class CScript : public CScriptBase
 {
 protected:
     CScript& push_int64(int64_t n)
@@ -364,9 +371,22 @@ protected:
     }
 public:
     CScript() { }
-    CScript(const CScript& b) : std::vector<unsigned char>(b.begin(), b.end()) { }
-    CScript(const_iterator pbegin, const_iterator pend) : std::vector<unsigned char>(pbegin, pend) { }
-    CScript(const unsigned char* pbegin, const unsigned char* pend) : std::vector<unsigned char>(pbegin, pend) { }
+    CScript(const CScript& b) : CScriptBase(b) { }
+    CScript(CScript&& b) noexcept : CScriptBase(std::move(b)) { }
+    CScript(const_iterator pbegin, const_iterator pend) : CScriptBase(pbegin, pend) { }
+    CScript(std::vector<unsigned char>::const_iterator pbegin, std::vector<unsigned char>::const_iterator pend) : CScriptBase(pbegin, pend) { }
+
+    CScript& operator=(const CScript& b)
+    {
+        CScriptBase::operator=(b);
+        return *this;
+    }
+
+    CScript& operator=(CScript&& b) noexcept
+    {
+        CScriptBase::operator=(std::move(b));
+        return *this;
+    }
 
     CScript& operator+=(const CScript& b)
     {
@@ -605,9 +625,26 @@ public:
     std::string ToString() const;
     void clear()
     {
-        // The default std::vector::clear() does not release memory.
-        std::vector<unsigned char>().swap(*this);
+        // The default clear() does not release memory.
+        CScriptBase().swap(*this);
     }
 };
 
+inline unsigned int GetSerializeSize(const CScript& v, int nType, int nVersion)
+{
+    return GetSerializeSize((const CScriptBase&)v, nType, nVersion);
+}
+
+template <typename Stream>
+void Serialize(Stream& os, const CScript& v, int nType, int nVersion)
+{
+    Serialize(os, (const CScriptBase&)v, nType, nVersion);
+}
+
+template <typename Stream>
+void Unserialize(Stream& is, CScript& v, int nType, int nVersion)
+{
+    Unserialize(is, (CScriptBase&)v, nType, nVersion);
+}
+
 #endif // BITCOIN_SCRIPT_SCRIPT_H
@@ -10,6 +10,8 @@
 #include "uint256.h"
 #include "util.h"
 
+#include <map>
+
 #include <boost/thread.hpp>
 #include <boost/tuple/tuple_comparison.hpp>
 
@@ -22,9 +24,11 @@ namespace {
  */
 class CSignatureCache
 {
-private:
+public:
      //! sigdata_type is (signature hash, signature, public key):
     typedef boost::tuple<uint256, std::vector<unsigned char>, CPubKey> sigdata_type;
+
+private:
     std::set< sigdata_type> setValid;
     boost::shared_mutex cs_sigcache;
 
@@ -41,42 +45,63 @@ public:
         return false;
     }
 
+    /** Mark the entries of vKeys that are in the cache. */
+    void GetMany(const std::vector<sigdata_type>& vKeys, std::vector<bool>& vFound)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+
+        vFound.resize(vKeys.size());
+        for (unsigned int i = 0; i < vKeys.size(); i++)
+            vFound[i] = setValid.count(vKeys[i]) > 0;
+    }
+
     void Set(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
+    {
+        SetMany(std::vector<sigdata_type>(1, sigdata_type(hash, vchSig, pubKey)));
+    }
+
+    void SetMany(const std::vector<sigdata_type>& vKeys)
     {
         // DoS prevention: limit cache size to less than 10MB
         // (~200 bytes per cache entry times 50,000 entries)
         // Since there are a maximum of 20,000 signature operations per block
         // 50,000 is a reasonable default.
         int64_t nMaxCacheSize = GetArg("-maxsigcachesize", 50000);
-        if (nMaxCacheSize <= 0) return;
+        if (nMaxCacheSize <= 0 || vKeys.empty()) return;
 
         boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
 
-        while (static_cast<int64_t>(setValid.size()) > nMaxCacheSize)
-        {
-            // Evict a random entry. Random because that helps
-            // foil would-be DoS attackers who might try to pre-generate
-            // and re-use a set of valid signatures just-slightly-greater
-            // than our cache size.
-            uint256 randomHash = GetRandHash();
-            std::vector<unsigned char> unused;
-            std::set<sigdata_type>::iterator it =
-                setValid.lower_bound(sigdata_type(randomHash, unused, unused));
-            if (it == setValid.end())
-                it = setValid.begin();
-            setValid.erase(*it);
+        for (const sigdata_type& k : vKeys) {
+            while (static_cast<int64_t>(setValid.size()) > nMaxCacheSize)
+            {
+                // Evict a random entry. Random because that helps
+                // foil would-be DoS attackers who might try to pre-generate
+                // and re-use a set of valid signatures just-slightly-greater
+                // than our cache size.
+                uint256 randomHash = GetRandHash();
+                std::vector<unsigned char> unused;
+                std::set<sigdata_type>::iterator it =
+                    setValid.lower_bound(sigdata_type(randomHash, unused, unused));
+                if (it == setValid.end())
+                    it = setValid.begin();
+                setValid.erase(*it);
+            }
+            setValid.insert(k);
         }
-
-        sigdata_type k(hash, vchSig, pubKey);
-        setValid.insert(k);
     }
 };
 
+CSignatureCache& GetSignatureCache()
+{
+    static CSignatureCache signatureCache;
+    return signatureCache;
+}
+
 }
 
 bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
-    static CSignatureCache signatureCache;
+    CSignatureCache& signatureCache = GetSignatureCache();
 
     if (signatureCache.Get(sighash, vchSig, pubkey))
         return true;
@@ -88,3 +113,63 @@ bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsig
         signatureCache.Set(sighash, vchSig, pubkey);
     return true;
 }
+
+void CSignatureBatch::Add(const CPubKey& pubkey, const uint256& sighash, const std::vector<unsigned char>& vchSig, bool fStore)
+{
+    vEntries.push_back(Entry());
+    Entry& entry = vEntries.back();
+    entry.pubkey = pubkey;
+    entry.sighash = sighash;
+    entry.vchSig = vchSig;
+    entry.fStore = fStore;
+}
+
+bool CSignatureBatch::Verify()
+{
+    if (vEntries.empty())
+        return true;
+
+    CSignatureCache& signatureCache = GetSignatureCache();
+    std::vector<CSignatureCache::sigdata_type> vKeys;
+    vKeys.reserve(vEntries.size());
+    for (const Entry& entry : vEntries)
+        vKeys.push_back(CSignatureCache::sigdata_type(entry.sighash, entry.vchSig, entry.pubkey));
+    std::vector<bool> vCached;
+    signatureCache.GetMany(vKeys, vCached);
+
+    // A compressed key that signs several inputs is decompressed once
+    // instead of being decompressed again by every verification.
+    std::map<CPubKey, int> mapUses;
+    for (unsigned int i = 0; i < vEntries.size(); i++)
+        if (!vCached[i] && vEntries[i].pubkey.IsCompressed())
+            mapUses[vEntries[i].pubkey]++;
+    std::map<CPubKey, CPubKey> mapDecompressed;
+    for (const std::pair<const CPubKey, int>& use : mapUses) {
+        if (use.second < 2)
+            continue;
+        CPubKey pubkey = use.first;
+        if (pubkey.Decompress())
+            mapDecompressed[use.first] = pubkey;
+    }
+
+    std::vector<CSignatureCache::sigdata_type> vStore;
+    for (unsigned int i = 0; i < vEntries.size(); i++) {
+        if (vCached[i])
+            continue;
+        const Entry& entry = vEntries[i];
+        std::map<CPubKey, CPubKey>::const_iterator it = mapDecompressed.find(entry.pubkey);
+        const CPubKey& pubkey = it != mapDecompressed.end() ? it->second : entry.pubkey;
+        if (!pubkey.Verify(entry.sighash, entry.vchSig))
+            return false;
+        if (entry.fStore)
+            vStore.push_back(vKeys[i]);
+    }
+    signatureCache.SetMany(vStore);
+    return true;
+}
+
+bool BatchingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
+{
+    batch.Add(pubkey, sighash, vchSig, store);
+    return true;
+}
@@ -6,19 +6,66 @@
 #ifndef BITCOIN_SCRIPT_SIGCACHE_H
 #define BITCOIN_SCRIPT_SIGCACHE_H
 
+#include "pubkey.h"
 #include "script/interpreter.h"
+#include "uint256.h"
 
 #include <vector>
 
-class CPubKey;
-
 class CachingTransactionSignatureChecker : public TransactionSignatureChecker
 {
 private:
     bool store;
 
 public:
-    CachingTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, bool storeIn=true) : TransactionSignatureChecker(txToIn, nInIn), store(storeIn) {}
+    CachingTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, bool storeIn=true, const PrecomputedTransactionData* txdataIn = NULL) : TransactionSignatureChecker(txToIn, nInIn, txdataIn), store(storeIn) {}
+
+    bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
+};
+
+/**
+ * A set of (pubkey, sighash, signature) triples that are verified together.
+ *
+ * Verify() looks all of them up in the signature cache under a single lock,
+ * parses every distinct public key once, and stores the new valid ones back
+ * under a single lock. The signatures themselves are still checked one by
+ * one: ECDSA has no batch equation without the full R point.
+ */
+class CSignatureBatch
+{
+private:
+    struct Entry {
+        CPubKey pubkey;
+        uint256 sighash;
+        std::vector<unsigned char> vchSig;
+        bool fStore;
+    };
+    std::vector<Entry> vEntries;
+
+public:
+    void Add(const CPubKey& pubkey, const uint256& sighash, const std::vector<unsigned char>& vchSig, bool fStore);
+
+    /** Whether all signatures added so far are valid. */
+    bool Verify();
+
+    size_t size() const { return vEntries.size(); }
+    void clear() { vEntries.clear(); }
+};
+
+/**
+ * Signature checker that queues every signature into a CSignatureBatch and
+ * reports it as valid. Only sound for scripts whose result is the result of
+ * their last and only signature check, and only if the batch is verified
+ * afterwards.
+ */
+class BatchingTransactionSignatureChecker : public TransactionSignatureChecker
+{
+private:
+    CSignatureBatch& batch;
+    bool store;
+
+public:
+    BatchingTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, CSignatureBatch& batchIn, bool storeIn = true, const PrecomputedTransactionData* txdataIn = NULL) : TransactionSignatureChecker(txToIn, nInIn, txdataIn), batch(batchIn), store(storeIn) {}
 
     bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 };
@@ -18,8 +18,13 @@ class CTransaction;
 struct CMutableTransaction;
 
 bool Sign1(const CKeyID& address, const CKeyStore& keystore, uint256 hash, int nHashType, CScript& scriptSigRet);
-bool SignSignature(const CKeyStore& keystore, const CScript& fromPubKey, CMutableTransaction& txTo, unsigned int nIn, int nHashType=SIGHASH_ALL);
-bool SignSignature(const CKeyStore& keystore, const CTransaction& txFrom, CMutableTransaction& txTo, unsigned int nIn, int nHashType=SIGHASH_ALL);
+/**
+ * Sign input nIn of txTo. When signing several inputs, txdata can be built
+ * once from txTo (before any of them is signed, since the signature hashes
+ * don't cover the input scripts) and passed to every call.
+ */
+bool SignSignature(const CKeyStore& keystore, const CScript& fromPubKey, CMutableTransaction& txTo, unsigned int nIn, int nHashType=SIGHASH_ALL, const PrecomputedTransactionData* txdata=NULL);
+bool SignSignature(const CKeyStore& keystore, const CTransaction& txFrom, CMutableTransaction& txTo, unsigned int nIn, int nHashType=SIGHASH_ALL, const PrecomputedTransactionData* txdata=NULL);
 
 /**
  * Given two sets of signatures for scriptPubKey, possibly with OP_0 placeholders,
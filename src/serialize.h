@@ -20,6 +20,8 @@
 #include <utility>
 #include <vector>
 
+#include "prevector.h"
+
 class CScript;
 
 static const unsigned int MAX_SIZE = 0x02000000;
@@ -446,6 +448,12 @@ public:
         pbegin = (char*)v.data();
         pend = (char*)(v.data() + v.size());
     }
+    template <unsigned int N, typename T, typename S, typename D>
+    explicit CFlatData(prevector<N, T, S, D>& v)
+    {
+        pbegin = (char*)v.data();
+        pend = (char*)(v.data() + v.size());
+    }
     char* begin() { return pbegin; }
     const char* begin() const { return pbegin; }
     char* end() { return pend; }
@@ -597,7 +605,17 @@ template <typename Stream, typename T, typename A>
 inline void Unserialize(Stream& is, std::vector<T, A>& v, int nType, int nVersion);
 
 /**
- * others derived from vector
+ * prevector
+ */
+template <unsigned int N, typename T>
+unsigned int GetSerializeSize(const prevector<N, T>& v, int nType, int nVersion);
+template <typename Stream, unsigned int N, typename T>
+void Serialize(Stream& os, const prevector<N, T>& v, int nType, int nVersion);
+template <typename Stream, unsigned int N, typename T>
+void Unserialize(Stream& is, prevector<N, T>& v, int nType, int nVersion);
+
+/**
+ * others derived from vector or prevector, defined with the class
  */
 extern inline unsigned int GetSerializeSize(const CScript& v, int nType, int nVersion);
 template <typename Stream>
@@ -776,26 +794,39 @@ inline void Unserialize(Stream& is, std::vector<T, A>& v, int nType, int nVersio
 
 
 /**
- * others derived from vector
+ * prevector, which only holds trivially copyable types: read and written as raw bytes
  */
-inline unsigned int GetSerializeSize(const CScript& v, int nType, int nVersion)
+template <unsigned int N, typename T>
+unsigned int GetSerializeSize(const prevector<N, T>& v, int nType, int nVersion)
 {
-    return GetSerializeSize((const std::vector<unsigned char>&)v, nType, nVersion);
+    return (GetSizeOfCompactSize(v.size()) + v.size() * sizeof(T));
 }
 
-template <typename Stream>
-void Serialize(Stream& os, const CScript& v, int nType, int nVersion)
+template <typename Stream, unsigned int N, typename T>
+void Serialize(Stream& os, const prevector<N, T>& v, int nType, int nVersion)
 {
-    Serialize(os, (const std::vector<unsigned char>&)v, nType, nVersion);
+    WriteCompactSize(os, v.size());
+    if (!v.empty())
+        os.write((char*)&v[0], v.size() * sizeof(T));
 }
 
-template <typename Stream>
-void Unserialize(Stream& is, CScript& v, int nType, int nVersion)
+template <typename Stream, unsigned int N, typename T>
+void Unserialize(Stream& is, prevector<N, T>& v, int nType, int nVersion)
 {
-    Unserialize(is, (std::vector<unsigned char>&)v, nType, nVersion);
+    // Limit size per read so bogus size value won't cause out of memory
+    v.clear();
+    unsigned int nSize = ReadCompactSize(is);
+    unsigned int i = 0;
+    while (i < nSize) {
+        unsigned int blk = std::min(nSize - i, (unsigned int)(1 + 4999999 / sizeof(T)));
+        v.resize(i + blk);
+        is.read((char*)&v[i], blk * sizeof(T));
+        i += blk;
+    }
 }
 
 
+
 /**
  * pair
  */
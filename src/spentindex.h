@@ -0,0 +1,86 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Copyright (c) 2017-2020 The VALUTO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SPENTINDEX_H
+#define BITCOIN_SPENTINDEX_H
+
+#include "amount.h"
+#include "serialize.h"
+#include "uint256.h"
+
+/** An output that has been spent: ('p', key) -> value */
+struct CSpentIndexKey {
+    uint256 txid;
+    unsigned int outputIndex;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(txid);
+        READWRITE(outputIndex);
+    }
+
+    CSpentIndexKey(const uint256& t, unsigned int i) : txid(t), outputIndex(i) {}
+
+    CSpentIndexKey()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        txid.SetNull();
+        outputIndex = 0;
+    }
+};
+
+/** The input spending an output, with the amount and address of the spent output */
+struct CSpentIndexValue {
+    uint256 txid;
+    unsigned int inputIndex;
+    int blockHeight;
+    CAmount satoshis;
+    unsigned char addressType;
+    uint160 addressHash;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(txid);
+        READWRITE(inputIndex);
+        READWRITE(blockHeight);
+        READWRITE(satoshis);
+        READWRITE(addressType);
+        READWRITE(addressHash);
+    }
+
+    CSpentIndexValue(const uint256& t, unsigned int i, int h, CAmount s, unsigned char type, const uint160& a) : txid(t), inputIndex(i), blockHeight(h), satoshis(s), addressType(type), addressHash(a) {}
+
+    CSpentIndexValue()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        txid.SetNull();
+        inputIndex = 0;
+        blockHeight = 0;
+        satoshis = 0;
+        addressType = 0;
+        addressHash.SetNull();
+    }
+
+    bool IsNull() const
+    {
+        return txid.IsNull();
+    }
+};
+
+#endif // BITCOIN_SPENTINDEX_H
@@ -13,6 +13,7 @@
 #include "sync.h"
 #include "sporkdb.h"
 #include "util.h"
+#include "validationinterface.h"
 #include <boost/lexical_cast.hpp>
 
 using namespace std;
@@ -94,6 +95,7 @@ void ProcessSpork(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
         mapSporks[hash] = spork;
         mapSporksActive[spork.nSporkID] = spork;
         sporkManager.Relay(spork);
+        GetMainSignals().NotifySporkUpdate(spork);
 
         // PIVX: add to spork database.
         pSporkDB->WriteSpork(spork.nSporkID, spork);
@@ -223,6 +225,7 @@ bool CSporkManager::UpdateSpork(int nSporkID, int64_t nValue)
         Relay(msg);
         mapSporks[msg.GetHash()] = msg;
         mapSporksActive[nSporkID] = msg;
+        GetMainSignals().NotifySporkUpdate(msg);
         return true;
     }
 
@@ -78,7 +78,7 @@ public:
     int64_t nValue;
     int64_t nTimeSigned;
 
-    uint256 GetHash()
+    uint256 GetHash() const
     {
         uint256 n = HashKeccak256(BEGIN(nSporkID), END(nTimeSigned));
         return n;
@@ -0,0 +1,106 @@
+// Copyright (c) 2017-2020 The VALUTO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "addressindex.h"
+
+#include "clientversion.h"
+#include "coins.h"
+#include "main.h"
+#include "random.h"
+#include "streams.h"
+
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(addressindex_tests)
+
+BOOST_AUTO_TEST_CASE(addressindex_key_order)
+{
+    // LevelDB compares keys bytewise: heights must sort numerically within an address
+    uint160 hashBytes = uint160(GetRandHash().GetLow64());
+    CDataStream ss1(SER_DISK, CLIENT_VERSION);
+    CDataStream ss2(SER_DISK, CLIENT_VERSION);
+    ss1 << CAddressIndexKey(ADDRESS_TYPE_PUBKEYHASH, hashBytes, 255, 7, GetRandHash(), 0, false);
+    ss2 << CAddressIndexKey(ADDRESS_TYPE_PUBKEYHASH, hashBytes, 256, 0, GetRandHash(), 0, false);
+    BOOST_CHECK(ss1.str() < ss2.str());
+    BOOST_CHECK_EQUAL(ss1.size(), CAddressIndexKey().GetSerializeSize(SER_DISK, CLIENT_VERSION));
+
+    // the seek key is a prefix of every key of the address at or above its height
+    CDataStream ssSeek(SER_DISK, CLIENT_VERSION);
+    ssSeek << CAddressIndexIteratorKey(ADDRESS_TYPE_PUBKEYHASH, hashBytes, 256);
+    BOOST_CHECK(ss2.str().compare(0, ssSeek.size(), ssSeek.str()) == 0);
+    BOOST_CHECK(ss1.str() < ssSeek.str());
+
+    CAddressIndexKey key;
+    ss2 >> key;
+    BOOST_CHECK_EQUAL(key.blockHeight, 256);
+    BOOST_CHECK(key.hashBytes == hashBytes);
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_connect_disconnect)
+{
+    fAddressIndex = true;
+    fSpentIndex = true;
+
+    CKeyID keyFrom = CKeyID(uint160(GetRandHash().GetLow64()));
+    CScriptID scriptTo = CScriptID(uint160(GetRandHash().GetLow64()));
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = 50;
+    coinbase.vout[0].scriptPubKey = GetScriptForDestination(keyFrom);
+
+    // two outputs of one transaction are spent, only the last one carries its height in the undo data
+    uint256 hashPrev = GetRandHash();
+    CMutableTransaction spend;
+    spend.vin.resize(2);
+    spend.vin[0].prevout = COutPoint(hashPrev, 3);
+    spend.vin[1].prevout = COutPoint(hashPrev, 1);
+    spend.vout.resize(2);
+    spend.vout[0].nValue = 30;
+    spend.vout[0].scriptPubKey = GetScriptForDestination(scriptTo);
+    spend.vout[1].nValue = 9;
+    spend.vout[1].scriptPubKey = CScript() << OP_RETURN;
+
+    CBlock block;
+    block.vtx.push_back(coinbase);
+    block.vtx.push_back(spend);
+    CBlockUndo blockundo;
+    blockundo.vtxundo.resize(1);
+    blockundo.vtxundo[0].vprevout.push_back(CTxInUndo(CTxOut(40, GetScriptForDestination(keyFrom))));
+    blockundo.vtxundo[0].vprevout.push_back(CTxInUndo(CTxOut(2, GetScriptForDestination(keyFrom)), false, false, 10, 1));
+
+    CAddressIndexUpdate connect;
+    ConnectAddressIndexes(block, blockundo, 100, connect);
+    // coinbase output, spent inputs and P2SH output; the OP_RETURN output has no address
+    BOOST_CHECK_EQUAL(connect.vAddressIndex.size(), 4U);
+    BOOST_CHECK_EQUAL(connect.vAddressUnspent.size(), 2U);
+    BOOST_CHECK_EQUAL(connect.vAddressUnspentErase.size(), 2U);
+    BOOST_CHECK_EQUAL(connect.vSpentIndex.size(), 2U);
+    BOOST_CHECK_EQUAL(connect.vAddressIndex[1].second, -40);
+    BOOST_CHECK(connect.vAddressIndex[1].first.spending);
+    BOOST_CHECK(connect.vSpentIndex[0].second.txid == spend.GetHash());
+    BOOST_CHECK(connect.vSpentIndex[0].second.addressHash == keyFrom);
+
+    // no chainstate is needed, the undo data has the height of both spent outputs
+    CAddressIndexUpdate disconnect;
+    DisconnectAddressIndexes(block, blockundo, 100, NULL, disconnect);
+    // everything connect put is erased again, and the spent outputs become unspent at their own height
+    BOOST_CHECK_EQUAL(disconnect.vAddressIndexErase.size(), connect.vAddressIndex.size());
+    BOOST_CHECK_EQUAL(disconnect.vAddressUnspentErase.size(), connect.vAddressUnspent.size());
+    BOOST_CHECK_EQUAL(disconnect.vSpentIndexErase.size(), connect.vSpentIndex.size());
+    BOOST_CHECK_EQUAL(disconnect.vAddressUnspent.size(), 2U);
+    BOOST_CHECK_EQUAL(disconnect.vAddressUnspent[0].second.blockHeight, 10);
+    BOOST_CHECK_EQUAL(disconnect.vAddressUnspent[0].second.satoshis, 40);
+    BOOST_CHECK_EQUAL(disconnect.vAddressUnspent[1].second.blockHeight, 10);
+    BOOST_CHECK_EQUAL(disconnect.vAddressUnspent[1].second.satoshis, 2);
+
+    fAddressIndex = DEFAULT_ADDRESSINDEX;
+    fSpentIndex = DEFAULT_SPENTINDEX;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
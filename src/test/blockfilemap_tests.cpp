@@ -0,0 +1,72 @@
+// Copyright (c) 2017-2020 The VALUTO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilemap.h"
+
+#include "chainparams.h"
+#include "clientversion.h"
+#include "main.h"
+#include "streams.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+
+static CDiskBlockPos AppendBlock(const CDiskBlockPos& posFile, const CBlock& block)
+{
+    CAutoFile fileout(OpenBlockFile(posFile), SER_DISK, CLIENT_VERSION);
+    BOOST_REQUIRE(!fileout.IsNull());
+    fseek(fileout.Get(), 0, SEEK_END);
+    fileout << FLATDATA(Params().MessageStart()) << (unsigned int)::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+    CDiskBlockPos pos(posFile.nFile, ftell(fileout.Get()));
+    fileout << block;
+    return pos;
+}
+
+BOOST_AUTO_TEST_SUITE(blockfilemap_tests)
+
+BOOST_AUTO_TEST_CASE(blockfilemap_read)
+{
+    CDiskBlockPos posFile(9000, 0);
+    boost::filesystem::path path = GetBlockPosFilename(posFile, "blk");
+    boost::filesystem::remove(path);
+
+    vector<CBlock> vBlocks(20);
+    vector<CDiskBlockPos> vPos;
+    for (unsigned int i = 0; i < vBlocks.size(); i++) {
+        vBlocks[i].nVersion = 1;
+        vBlocks[i].nNonce = i;
+        vBlocks[i].nTime = 1500000000 + i;
+        vPos.push_back(AppendBlock(posFile, vBlocks[i]));
+    }
+
+    CBlockFileMap map(2);
+    CBlock block;
+    for (unsigned int i = 0; i < vBlocks.size(); i++) {
+        BOOST_CHECK(map.ReadBlock(block, vPos[i], false));
+        BOOST_CHECK(block.GetHash() == vBlocks[i].GetHash());
+    }
+
+    // a block appended after the file was mapped is found by mapping the file again
+    CBlock blockNew;
+    blockNew.nVersion = 1;
+    blockNew.nNonce = 4242;
+    CDiskBlockPos posNew = AppendBlock(posFile, blockNew);
+    BOOST_CHECK(map.ReadBlock(block, posNew, false));
+    BOOST_CHECK(block.GetHash() == blockNew.GetHash());
+
+    // once finalized the file is mapped whole, positions past the end are refused
+    BOOST_CHECK(map.ReadBlock(block, vPos[3], true));
+    BOOST_CHECK(block.GetHash() == vBlocks[3].GetHash());
+    BOOST_CHECK(!map.ReadBlock(block, CDiskBlockPos(posFile.nFile, posNew.nPos + 1000000), true));
+    BOOST_CHECK(!map.ReadBlock(block, CDiskBlockPos(posFile.nFile, 4), true));
+
+    // files that don't exist can't be mapped
+    map.Forget(posFile.nFile);
+    boost::filesystem::remove(path);
+    BOOST_CHECK(!map.ReadBlock(block, vPos[0], true));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
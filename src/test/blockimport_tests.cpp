@@ -0,0 +1,71 @@
+// Copyright (c) 2017-2020 The VALUTO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockimport.h"
+
+#include "chainparams.h"
+#include "clientversion.h"
+#include "streams.h"
+#include "util.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(blockimport_tests)
+
+BOOST_AUTO_TEST_CASE(blockimport_pipeline_order)
+{
+    boost::filesystem::path path = GetDataDir() / "blockimport_test.dat";
+    vector<uint256> vHashes;
+    vector<unsigned int> vPos;
+
+    {
+        CAutoFile fileout(fopen(path.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+        BOOST_REQUIRE(!fileout.IsNull());
+        // more blocks than the queue holds, so the reader has to wait for the consumer
+        for (unsigned int i = 0; i < IMPORT_QUEUE_SIZE * 2 + 17; i++) {
+            if (i % 5 == 0) {
+                // garbage between blocks is skipped by the header scan
+                unsigned char junk[3] = {0x00, Params().MessageStart()[0], 0x42};
+                fileout << FLATDATA(junk);
+            }
+            CBlock block;
+            block.nVersion = 1;
+            block.nNonce = i;
+            block.nTime = 1500000000 + i;
+            fileout << FLATDATA(Params().MessageStart()) << (unsigned int)::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+            vPos.push_back(ftell(fileout.Get()));
+            fileout << block;
+            vHashes.push_back(block.GetHash());
+        }
+    }
+
+    CDiskBlockPos posFile(3, 0);
+    CBlockImportPipeline pipeline(fopen(path.string().c_str(), "rb"), &posFile, 3);
+    CBlock block;
+    CDiskBlockPos pos;
+    unsigned int n = 0;
+    while (pipeline.Next(block, pos)) {
+        BOOST_REQUIRE(n < vHashes.size());
+        BOOST_CHECK(block.GetHash() == vHashes[n]);
+        BOOST_CHECK_EQUAL(pos.nFile, 3);
+        BOOST_CHECK_EQUAL(pos.nPos, vPos[n]);
+        // a block without transactions fails the context-free checks and is passed on unmarked
+        BOOST_CHECK(!block.fChecked);
+        pipeline.AddConnected(1);
+        n++;
+    }
+    BOOST_CHECK_EQUAL(n, vHashes.size());
+    BOOST_CHECK(pipeline.GetError().empty());
+
+    CImportStats stats = pipeline.GetStats();
+    BOOST_CHECK_EQUAL(stats.nRead, vHashes.size());
+    BOOST_CHECK_EQUAL(stats.nChecked, vHashes.size());
+    BOOST_CHECK_EQUAL(stats.nConnected, vHashes.size());
+    boost::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,103 @@
+// Copyright (c) 2017-2020 The VALUTO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "checkqueue.h"
+
+#include <atomic>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+namespace
+{
+std::atomic<int> nChecked;
+
+struct FakeCheck {
+    bool fOk;
+
+    FakeCheck(bool fOkIn = true) : fOk(fOkIn) {}
+
+    bool operator()()
+    {
+        nChecked++;
+        return fOk;
+    }
+
+    void swap(FakeCheck& check)
+    {
+        std::swap(fOk, check.fOk);
+    }
+};
+
+void Worker(CCheckQueue<FakeCheck>* pqueue)
+{
+    pqueue->Thread();
+}
+} // anon namespace
+
+BOOST_AUTO_TEST_SUITE(checkqueue_tests)
+
+BOOST_AUTO_TEST_CASE(checkqueue_work_stealing)
+{
+    CCheckQueue<FakeCheck> queue(16, 8);
+    boost::thread_group threads;
+    for (int i = 0; i < 7; i++)
+        threads.create_thread(boost::bind(&Worker, &queue));
+
+    for (int nRound = 0; nRound < 100; nRound++) {
+        nChecked = 0;
+        int nTotal = 0;
+        {
+            CCheckQueueControl<FakeCheck> control(&queue);
+            // batches of every size, the way blocks add one transaction at a time
+            for (int i = 0; i < 200; i++) {
+                std::vector<FakeCheck> vChecks(i % 7);
+                nTotal += vChecks.size();
+                control.Add(vChecks);
+            }
+            BOOST_CHECK(control.Wait());
+        }
+        BOOST_CHECK_EQUAL(nChecked, nTotal);
+    }
+
+    // a failed check fails the whole wait, and the queue is usable afterwards
+    for (int nRound = 0; nRound < 20; nRound++) {
+        CCheckQueueControl<FakeCheck> control(&queue);
+        for (int i = 0; i < 100; i++) {
+            std::vector<FakeCheck> vChecks(5);
+            if (i == nRound)
+                vChecks[2].fOk = false;
+            control.Add(vChecks);
+        }
+        BOOST_CHECK(!control.Wait());
+    }
+    BOOST_CHECK(queue.IsIdle());
+    {
+        CCheckQueueControl<FakeCheck> control(&queue);
+        std::vector<FakeCheck> vChecks(10);
+        control.Add(vChecks);
+        BOOST_CHECK(control.Wait());
+    }
+
+    threads.interrupt_all();
+    threads.join_all();
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_master_only)
+{
+    // without worker threads, the master does all checks in Wait()
+    CCheckQueue<FakeCheck> queue(16, 1);
+    nChecked = 0;
+    CCheckQueueControl<FakeCheck> control(&queue);
+    for (int i = 0; i < 50; i++) {
+        std::vector<FakeCheck> vChecks(3);
+        control.Add(vChecks);
+    }
+    BOOST_CHECK(control.Wait());
+    BOOST_CHECK_EQUAL(nChecked, 150);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -3,8 +3,11 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "coins.h"
+#include "main.h"
 #include "random.h"
+#include "script/script.h"
 #include "uint256.h"
+#include "undo.h"
 
 #include <vector>
 #include <map>
@@ -175,4 +178,106 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     BOOST_CHECK(missed_an_entry);
 }
 
+// Spending every output of a coinstake, its empty marker included, and disconnecting the spend must give
+// back the same coins, coinstake flag included.
+BOOST_AUTO_TEST_CASE(coins_undo_coinstake)
+{
+    CCoinsView base;
+    CCoinsViewCache view(&base);
+
+    CMutableTransaction txStake;
+    txStake.vin.resize(1);
+    txStake.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    txStake.vout.resize(3);
+    txStake.vout[0].SetEmpty();
+    txStake.vout[1].nValue = 50 * COIN;
+    txStake.vout[1].scriptPubKey = CScript() << OP_TRUE;
+    txStake.vout[2].nValue = 50 * COIN;
+    txStake.vout[2].scriptPubKey = CScript() << OP_TRUE;
+    const CTransaction stake(txStake);
+    BOOST_CHECK(stake.IsCoinStake());
+    view.ModifyCoins(stake.GetHash())->FromTx(stake, 100);
+    const CCoins coinsStake = *view.AccessCoins(stake.GetHash());
+
+    CMutableTransaction txSpend;
+    txSpend.vin.resize(3);
+    for (unsigned int i = 0; i < txSpend.vin.size(); i++)
+        txSpend.vin[i].prevout = COutPoint(stake.GetHash(), i);
+    txSpend.vout.resize(1);
+    txSpend.vout[0].nValue = 100 * COIN;
+    txSpend.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    const CTransaction spend(txSpend);
+
+    CValidationState state;
+    CTxUndo txundo;
+    UpdateCoins(spend, state, view, txundo, 200);
+    BOOST_CHECK(!view.HaveCoins(stake.GetHash()));
+    BOOST_CHECK_EQUAL(txundo.vprevout.size(), 3U);
+    BOOST_CHECK(txundo.vprevout[2].fCoinStake);
+
+    // inputs come back in reverse order, as in DisconnectBlock
+    for (unsigned int j = spend.vin.size(); j-- > 0;)
+        BOOST_CHECK(ApplyTxInUndo(txundo.vprevout[j], view, spend.vin[j].prevout));
+
+    const CCoins* coins = view.AccessCoins(stake.GetHash());
+    BOOST_REQUIRE(coins);
+    BOOST_CHECK(coins->IsCoinStake());
+    BOOST_CHECK(*coins == coinsStake);
+
+    // restoring an output that is already there is reported
+    BOOST_CHECK(!ApplyTxInUndo(txundo.vprevout[0], view, spend.vin[0].prevout));
+}
+
+// A reorg that disconnects the spend of a coinstake, then connects a branch that spends it again,
+// must still hold the restored coins to the coinstake maturity.
+BOOST_AUTO_TEST_CASE(coins_reorg_coinstake_maturity)
+{
+    CCoinsView base;
+    CCoinsViewCache view(&base);
+    const int nStakeHeight = 100;
+    const int nMaturity = Params().COINBASE_MATURITY();
+
+    CMutableTransaction txStake;
+    txStake.vin.resize(1);
+    txStake.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    txStake.vout.resize(2);
+    txStake.vout[0].SetEmpty();
+    txStake.vout[1].nValue = 50 * COIN;
+    txStake.vout[1].scriptPubKey = CScript() << OP_TRUE;
+    const CTransaction stake(txStake);
+    view.ModifyCoins(stake.GetHash())->FromTx(stake, nStakeHeight);
+
+    // the first branch spends it once it has matured
+    CMutableTransaction txSpend;
+    txSpend.vin.resize(2);
+    for (unsigned int i = 0; i < txSpend.vin.size(); i++)
+        txSpend.vin[i].prevout = COutPoint(stake.GetHash(), i);
+    txSpend.vout.resize(1);
+    txSpend.vout[0].nValue = 50 * COIN;
+    txSpend.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    const CTransaction spend(txSpend);
+    CValidationState state;
+    CTxUndo txundo;
+    UpdateCoins(spend, state, view, txundo, nStakeHeight + nMaturity);
+    BOOST_CHECK(!view.HaveCoins(stake.GetHash()));
+
+    // the reorg disconnects that block
+    for (unsigned int j = spend.vin.size(); j-- > 0;)
+        BOOST_CHECK(ApplyTxInUndo(txundo.vprevout[j], view, spend.vin[j].prevout));
+
+    // the other branch spends it one block too early, then on time
+    CBlockIndex indexTip;
+    indexTip.nHeight = nStakeHeight + nMaturity - 2;
+    const uint256 hashTip = GetRandHash();
+    LOCK(cs_main);
+    indexTip.phashBlock = &mapBlockIndex.insert(std::make_pair(hashTip, &indexTip)).first->first;
+    view.SetBestBlock(hashTip);
+    BOOST_CHECK(!CheckInputs(spend, state, view, false, 0, false));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-txns-premature-spend-of-coinbase");
+    indexTip.nHeight++;
+    CValidationState stateMature;
+    BOOST_CHECK(CheckInputs(spend, stateMature, view, false, 0, false));
+    mapBlockIndex.erase(hashTip);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
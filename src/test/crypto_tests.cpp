@@ -2,6 +2,9 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "crypto/common.h"
+#include "crypto/keccak256.h"
+#include "crypto/muhash.h"
 #include "crypto/rfc6979_hmac_sha256.h"
 #include "crypto/ripemd160.h"
 #include "crypto/sha1.h"
@@ -9,6 +12,7 @@
 #include "crypto/sha512.h"
 #include "crypto/hmac_sha256.h"
 #include "crypto/hmac_sha512.h"
+#include "hash.h"
 #include "random.h"
 #include "utilstrencodings.h"
 
@@ -282,4 +286,123 @@ BOOST_AUTO_TEST_CASE(rfc6979_hmac_sha256)
             ("7597887cbd76321f32e30440679a22cf7f8d9d2eac390e581fea091ce202ba94"));
 }
 
+BOOST_AUTO_TEST_CASE(sha256d64)
+{
+    // the batched hash matches CHash256 for every split of the input over the 8-, 4- and 1-way paths
+    for (int i = 0; i <= 32; ++i) {
+        unsigned char in[64 * 32];
+        unsigned char out1[32 * 32], out2[32 * 32];
+        for (int j = 0; j < 64 * i; ++j) {
+            in[j] = insecure_rand();
+        }
+        for (int j = 0; j < i; ++j) {
+            CHash256().Write(in + 64 * j, 64).Finalize(out1 + 32 * j);
+        }
+        SHA256D64(out2, in, i);
+        BOOST_CHECK(memcmp(out1, out2, 32 * i) == 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(keccak_header)
+{
+    // the header hash and every lane count of the nonce scan match the generic sph_keccak256
+    unsigned char header[KECCAK_HEADER_SIZE];
+    for (unsigned int i = 0; i < sizeof(header); ++i) {
+        header[i] = insecure_rand();
+    }
+    uint256 hash;
+    KeccakHeader(hash.begin(), header);
+    BOOST_CHECK(hash == HashKeccak256(header, header + sizeof(header)));
+
+    CKeccakHeaderMidstate midstate(header);
+    for (int i = 0; i <= 20; ++i) {
+        // the nonces wrap around
+        uint32_t nNonce = 0xfffffff8 + insecure_rand() % 8;
+        unsigned char out[32 * 20];
+        midstate.Hash(out, nNonce, i);
+        for (int j = 0; j < i; ++j) {
+            WriteLE32(header + 76, nNonce + j);
+            BOOST_CHECK(memcmp(out + 32 * j, HashKeccak256(header, header + sizeof(header)).begin(), 32) == 0);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(muhash_set)
+{
+    std::vector<uint256> elements(4);
+    for (unsigned int i = 0; i < elements.size(); ++i)
+        elements[i] = GetRandHash();
+
+    // the order of insertion doesn't matter
+    MuHash3072 a, b;
+    for (unsigned int i = 0; i < elements.size(); ++i) {
+        a.Insert(elements[i].begin(), 32);
+        b.Insert(elements[elements.size() - 1 - i].begin(), 32);
+    }
+    uint256 hashA, hashB;
+    a.Finalize(hashA.begin());
+    b.Finalize(hashB.begin());
+    BOOST_CHECK(hashA == hashB);
+
+    // removing an element undoes inserting it, before or after finalizing
+    MuHash3072 c;
+    c.Insert(elements[0].begin(), 32).Insert(elements[1].begin(), 32);
+    uint256 hashC;
+    c.Finalize(hashC.begin());
+    BOOST_CHECK(hashC != hashA);
+    c.Insert(elements[2].begin(), 32).Remove(elements[1].begin(), 32);
+    c.Insert(elements[1].begin(), 32).Insert(elements[3].begin(), 32);
+    c.Finalize(hashC.begin());
+    BOOST_CHECK(hashC == hashA);
+
+    // and so does dividing by a set
+    MuHash3072 d = a, e;
+    e.Insert(elements[3].begin(), 32);
+    d /= e;
+    MuHash3072 f;
+    f.Insert(elements[0].begin(), 32).Insert(elements[1].begin(), 32).Insert(elements[2].begin(), 32);
+    uint256 hashD, hashF;
+    d.Finalize(hashD.begin());
+    f.Finalize(hashF.begin());
+    BOOST_CHECK(hashD == hashF);
+    d *= e;
+    d.Finalize(hashD.begin());
+    BOOST_CHECK(hashD == hashA);
+
+    // an element inserted and removed leaves the empty set
+    MuHash3072 empty, g;
+    uint256 hashEmpty, hashG;
+    empty.Finalize(hashEmpty.begin());
+    g.Insert(elements[0].begin(), 32).Remove(elements[0].begin(), 32).Finalize(hashG.begin());
+    BOOST_CHECK(hashG == hashEmpty);
+}
+
+BOOST_AUTO_TEST_CASE(muhash_num3072)
+{
+    // x * x^-1 == 1, for a value just below the prime too
+    unsigned char data[Num3072::BYTE_SIZE];
+    for (unsigned int i = 0; i < sizeof(data); ++i)
+        data[i] = insecure_rand();
+    Num3072 x(data);
+    Num3072 y = x.GetInverse();
+    y.Multiply(x);
+    BOOST_CHECK(y.IsOne());
+
+    memset(data, 0xff, sizeof(data));
+    WriteLE32(data, 0xffffffff - 1103717);
+    Num3072 pminus1(data);
+    // (p - 1)^2 == 1
+    Num3072 z = pminus1;
+    z.Multiply(pminus1);
+    BOOST_CHECK(z.IsOne());
+    BOOST_CHECK(!pminus1.IsOne());
+
+    // a value of at least the prime is reduced
+    WriteLE32(data, 0xffffffff - 1103716);
+    Num3072 p(data);
+    unsigned char zero[Num3072::BYTE_SIZE] = {0};
+    p.ToBytes(data);
+    BOOST_CHECK(memcmp(data, zero, sizeof(zero)) == 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,108 @@
+// Copyright (c) 2017-2020 The VALUTO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "rpc/jsonwriter.h"
+
+#include "tinyformat.h"
+#include "utilstrencodings.h"
+
+#include <string>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(jsonwriter_tests)
+
+static const unsigned char vchData[] = {0x00, 0x01, 0x7f, 0x80, 0xab, 0xff};
+
+/** A document with every kind of token, nested containers, empty ones and keys that need escaping. */
+static void WriteDocument(CJSONWriter& writer)
+{
+    writer.BeginObject();
+    writer.KeyValue("hash", "00ff");
+    writer.KeyValue("height", 12345);
+    writer.KeyValue("difficulty", 1.5);
+    writer.KeyValue("quote\"d\n", true);
+    writer.Key("tx");
+    writer.BeginArray();
+    for (int i = 0; i < 20; i++) {
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("n", i));
+        entry.push_back(Pair("value", strprintf("entry %d", i)));
+        writer.Value(entry);
+    }
+    writer.BeginArray();
+    writer.EndArray();
+    writer.BeginObject();
+    writer.EndObject();
+    writer.EndArray();
+    writer.Key("hex");
+    writer.HexValue(vchData, vchData + sizeof(vchData));
+    writer.KeyValue("none", NullUniValue);
+    writer.EndObject();
+}
+
+static void AppendChunk(std::vector<std::string>& vChunks, const std::string& strChunk)
+{
+    vChunks.push_back(strChunk);
+}
+
+BOOST_AUTO_TEST_CASE(jsonwriter_stream_matches_value)
+{
+    CJSONValueWriter valueWriter;
+    WriteDocument(valueWriter);
+    const UniValue& value = valueWriter.GetValue();
+    BOOST_CHECK(value.isObject());
+    BOOST_CHECK_EQUAL(find_value(value, "height").get_int(), 12345);
+    BOOST_CHECK_EQUAL(find_value(value, "tx").size(), 22U);
+    BOOST_CHECK_EQUAL(find_value(value, "hex").get_str(), HexStr(vchData, vchData + sizeof(vchData)));
+
+    CJSONStreamWriter streamWriter;
+    WriteDocument(streamWriter);
+    BOOST_CHECK_EQUAL(streamWriter.GetBuffer(), value.write());
+
+    // what is written reads back as the same document
+    UniValue valueRead;
+    BOOST_CHECK(valueRead.read(streamWriter.GetBuffer()));
+    BOOST_CHECK_EQUAL(valueRead.write(), value.write());
+}
+
+BOOST_AUTO_TEST_CASE(jsonwriter_stream_chunks)
+{
+    CJSONValueWriter valueWriter;
+    WriteDocument(valueWriter);
+    const std::string strExpected = valueWriter.GetValue().write();
+
+    const size_t nChunkSize = 16;
+    std::vector<std::string> vChunks;
+    CJSONStreamWriter streamWriter;
+    streamWriter.SetSink(nChunkSize, boost::bind(&AppendChunk, boost::ref(vChunks), _1));
+    WriteDocument(streamWriter);
+
+    // the text is handed over in chunks of at least nChunkSize, the rest stays in the buffer
+    BOOST_CHECK(vChunks.size() > 1);
+    std::string strWritten;
+    for (const std::string& strChunk : vChunks) {
+        BOOST_CHECK(strChunk.size() >= nChunkSize);
+        strWritten += strChunk;
+    }
+    BOOST_CHECK(streamWriter.GetBuffer().size() < strExpected.size());
+    strWritten += streamWriter.GetBuffer();
+    BOOST_CHECK_EQUAL(strWritten, strExpected);
+}
+
+BOOST_AUTO_TEST_CASE(jsonwriter_scalar)
+{
+    // a document can be a single value, as most RPC results are
+    CJSONStreamWriter streamWriter;
+    streamWriter.Value("abc");
+    BOOST_CHECK_EQUAL(streamWriter.GetBuffer(), "\"abc\"");
+
+    CJSONValueWriter valueWriter;
+    valueWriter.HexValue(vchData, vchData + sizeof(vchData));
+    BOOST_CHECK_EQUAL(valueWriter.GetValue().get_str(), "00017f80abff");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -187,4 +187,53 @@ BOOST_AUTO_TEST_CASE(key_test1)
     BOOST_CHECK(detsigc == ParseHex("1f4f304f1b05599f88bc517819f6d43c69503baea5f253c55ea2d791394f7ce0de4f23c0d4c1f4d7a89bf130fed755201d22581911a8a44cf594014794231d325a"));
 }
 
+BOOST_AUTO_TEST_CASE(key_lax_der)
+{
+    // Signatures that OpenSSL accepted but strict DER doesn't still verify
+    CBitcoinSecret bsecret1;
+    BOOST_CHECK(bsecret1.SetString(strSecret1));
+    CKey key1 = bsecret1.GetKey();
+    CPubKey pubkey1 = key1.GetPubKey();
+    uint256 hashMsg = Hash(strSecret1.begin(), strSecret1.end());
+
+    vector<unsigned char> sig;
+    BOOST_CHECK(key1.Sign(hashMsg, sig));
+    BOOST_CHECK(pubkey1.Verify(hashMsg, sig));
+    size_t rlen = sig[3];
+
+    // long form sequence length
+    vector<unsigned char> sigLong(sig);
+    sigLong[1] = 0x81;
+    sigLong.insert(sigLong.begin() + 2, sig[1]);
+    BOOST_CHECK(pubkey1.Verify(hashMsg, sigLong));
+
+    // R padded with a superfluous zero byte, in a long form length
+    vector<unsigned char> sigPadded(sig);
+    sigPadded[3] = 0x81;
+    sigPadded.insert(sigPadded.begin() + 4, rlen + 1);
+    sigPadded.insert(sigPadded.begin() + 5, 0x00);
+    sigPadded[1] += 2;
+    BOOST_CHECK(pubkey1.Verify(hashMsg, sigPadded));
+
+    // trailing garbage, with a hashtype byte as in scripts
+    vector<unsigned char> sigTrailing(sig);
+    sigTrailing.push_back(0x01);
+    BOOST_CHECK(pubkey1.Verify(hashMsg, sigTrailing));
+
+    // not a sequence, or truncated
+    vector<unsigned char> sigBad(sig);
+    sigBad[0] = 0x31;
+    BOOST_CHECK(!pubkey1.Verify(hashMsg, sigBad));
+    vector<unsigned char> sigShort(sig.begin(), sig.begin() + 4 + rlen);
+    BOOST_CHECK(!pubkey1.Verify(hashMsg, sigShort));
+    BOOST_CHECK(!pubkey1.Verify(hashMsg, vector<unsigned char>()));
+
+    // R longer than 32 bytes once leading zeroes are dropped
+    vector<unsigned char> sigOverflow(sig);
+    sigOverflow[3] = rlen + 1;
+    sigOverflow.insert(sigOverflow.begin() + 4, 0x01);
+    sigOverflow[1] += 1;
+    BOOST_CHECK(!pubkey1.Verify(hashMsg, sigOverflow));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,263 @@
+// Copyright (c) 2017-2020 The VALUTO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "prevector.h"
+
+#include "random.h"
+#include "script/script.h"
+#include "serialize.h"
+#include "streams.h"
+#include "version.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(prevector_tests)
+
+/** Runs the same operations on a prevector and a std::vector and compares the two after each. */
+template <unsigned int N, typename T>
+class prevector_tester
+{
+    typedef std::vector<T> realtype;
+    typedef prevector<N, T> pretype;
+    realtype real_vector;
+    pretype pre_vector;
+
+    void test()
+    {
+        const pretype& const_pre_vector = pre_vector;
+        BOOST_CHECK_EQUAL(real_vector.size(), pre_vector.size());
+        BOOST_CHECK_EQUAL(real_vector.empty(), pre_vector.empty());
+        for (unsigned int i = 0; i < real_vector.size(); i++) {
+            BOOST_CHECK(real_vector[i] == pre_vector[i]);
+            BOOST_CHECK(real_vector[i] == const_pre_vector[i]);
+        }
+        BOOST_CHECK(realtype(pre_vector.begin(), pre_vector.end()) == real_vector);
+        BOOST_CHECK(pretype(real_vector.begin(), real_vector.end()) == pre_vector);
+        size_t pos = 0;
+        for (typename pretype::const_reverse_iterator it = const_pre_vector.rbegin(); it != const_pre_vector.rend(); ++it)
+            BOOST_CHECK(*it == real_vector[real_vector.size() - 1 - pos++]);
+        BOOST_CHECK(pretype(pre_vector) == pre_vector);
+
+        CDataStream ss1(SER_DISK, 0);
+        CDataStream ss2(SER_DISK, 0);
+        ss1 << real_vector;
+        ss2 << pre_vector;
+        BOOST_CHECK_EQUAL(ss1.size(), ss2.size());
+        for (unsigned int i = 0; i < ss1.size(); i++)
+            BOOST_CHECK_EQUAL(ss1[i], ss2[i]);
+        pretype pre_read;
+        ss2 >> pre_read;
+        BOOST_CHECK(pre_read == pre_vector);
+    }
+
+public:
+    void resize(size_t s)
+    {
+        real_vector.resize(s);
+        BOOST_CHECK_EQUAL(real_vector.size(), s);
+        pre_vector.resize(s);
+        BOOST_CHECK_EQUAL(pre_vector.size(), s);
+        test();
+    }
+
+    void reserve(size_t s)
+    {
+        real_vector.reserve(s);
+        BOOST_CHECK(real_vector.capacity() >= s);
+        pre_vector.reserve(s);
+        BOOST_CHECK(pre_vector.capacity() >= s);
+        test();
+    }
+
+    void insert(size_t position, const T& value)
+    {
+        real_vector.insert(real_vector.begin() + position, value);
+        pre_vector.insert(pre_vector.begin() + position, value);
+        test();
+    }
+
+    void insert(size_t position, size_t count, const T& value)
+    {
+        real_vector.insert(real_vector.begin() + position, count, value);
+        pre_vector.insert(pre_vector.begin() + position, count, value);
+        test();
+    }
+
+    template <typename I>
+    void insert_range(size_t position, I first, I last)
+    {
+        real_vector.insert(real_vector.begin() + position, first, last);
+        pre_vector.insert(pre_vector.begin() + position, first, last);
+        test();
+    }
+
+    void erase(size_t position)
+    {
+        real_vector.erase(real_vector.begin() + position);
+        pre_vector.erase(pre_vector.begin() + position);
+        test();
+    }
+
+    void erase(size_t first, size_t last)
+    {
+        real_vector.erase(real_vector.begin() + first, real_vector.begin() + last);
+        pre_vector.erase(pre_vector.begin() + first, pre_vector.begin() + last);
+        test();
+    }
+
+    void update(size_t pos, const T& value)
+    {
+        real_vector[pos] = value;
+        pre_vector[pos] = value;
+        test();
+    }
+
+    void push_back(const T& value)
+    {
+        real_vector.push_back(value);
+        pre_vector.push_back(value);
+        test();
+    }
+
+    void pop_back()
+    {
+        real_vector.pop_back();
+        pre_vector.pop_back();
+        test();
+    }
+
+    void clear()
+    {
+        real_vector.clear();
+        pre_vector.clear();
+        test();
+    }
+
+    void assign(size_t n, const T& value)
+    {
+        real_vector.assign(n, value);
+        pre_vector.assign(n, value);
+        test();
+    }
+
+    void shrink_to_fit()
+    {
+        pre_vector.shrink_to_fit();
+        test();
+    }
+
+    void swap()
+    {
+        realtype real_other;
+        pretype pre_other;
+        real_vector.swap(real_other);
+        pre_vector.swap(pre_other);
+        test();
+        real_vector.swap(real_other);
+        pre_vector.swap(pre_other);
+        test();
+    }
+
+    void move()
+    {
+        pretype pre_other(std::move(pre_vector));
+        BOOST_CHECK(pre_vector.empty());
+        pre_vector = std::move(pre_other);
+        test();
+    }
+
+    size_t size() const
+    {
+        return real_vector.size();
+    }
+};
+
+BOOST_AUTO_TEST_CASE(prevector_random_operations)
+{
+    for (int j = 0; j < 64; j++) {
+        prevector_tester<8, int> test;
+        for (int i = 0; i < 2048; i++) {
+            int r = GetRandInt(1 << 30);
+            if ((r % 4) == 0)
+                test.insert(GetRandInt(test.size() + 1), GetRandInt(1 << 30));
+            if (test.size() > 0 && ((r >> 2) % 4) == 1)
+                test.erase(GetRandInt(test.size()));
+            if (((r >> 4) % 8) == 2) {
+                int new_size = std::max<int>(0, std::min<int>(30, test.size() + (GetRandInt(5)) - 2));
+                test.resize(new_size);
+            }
+            if (((r >> 7) % 8) == 3)
+                test.insert(GetRandInt(test.size() + 1), 1 + GetRandInt(2), GetRandInt(1 << 30));
+            if (((r >> 10) % 8) == 4) {
+                int del = std::min<int>(test.size(), 1 + GetRandInt(2));
+                int beg = GetRandInt(test.size() + 1 - del);
+                test.erase(beg, beg + del);
+            }
+            if (((r >> 13) % 16) == 5)
+                test.push_back(GetRandInt(1 << 30));
+            if (test.size() > 0 && ((r >> 17) % 16) == 6)
+                test.pop_back();
+            if (((r >> 21) % 32) == 7) {
+                int values[4];
+                int num = 1 + GetRandInt(4);
+                for (int k = 0; k < num; k++)
+                    values[k] = GetRandInt(1 << 30);
+                test.insert_range(GetRandInt(test.size() + 1), values, values + num);
+            }
+            if (((r >> 26) % 32) == 8) {
+                int del = std::min<int>(test.size(), 1 + GetRandInt(4));
+                int beg = GetRandInt(test.size() + 1 - del);
+                test.erase(beg, beg + del);
+            }
+            r = GetRandInt(1 << 30);
+            if (r % 32 == 9)
+                test.reserve(GetRandInt(32));
+            if ((r >> 5) % 64 == 10)
+                test.shrink_to_fit();
+            if (test.size() > 0 && (r >> 11) % 16 == 11)
+                test.update(GetRandInt(test.size()), GetRandInt(1 << 30));
+            if ((r >> 15) % 256 == 12)
+                test.clear();
+            if ((r >> 23) % 256 == 13)
+                test.assign(GetRandInt(32), GetRandInt(1 << 30));
+            if ((r >> 27) % 8 == 6)
+                test.swap();
+            if ((r >> 27) % 8 == 7)
+                test.move();
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(prevector_script)
+{
+    // a script that fits inline and one that doesn't serialize the way they did as vectors
+    std::vector<unsigned char> vchKey(33, 0x02);
+    std::vector<unsigned char> vchSig(72, 0x30);
+    CScript scriptShort = CScript() << vchKey << OP_CHECKSIG;
+    CScript scriptLong = CScript() << vchSig << vchKey;
+    BOOST_CHECK_EQUAL(scriptShort.size(), 35U);
+    BOOST_CHECK_EQUAL(scriptShort.allocated_memory(), 0U);
+    BOOST_CHECK(scriptLong.allocated_memory() >= scriptLong.size());
+
+    for (const CScript& script : {scriptShort, scriptLong}) {
+        CDataStream ss1(SER_NETWORK, PROTOCOL_VERSION);
+        CDataStream ss2(SER_NETWORK, PROTOCOL_VERSION);
+        ss1 << std::vector<unsigned char>(script.begin(), script.end());
+        ss2 << script;
+        BOOST_CHECK(std::vector<char>(ss1.begin(), ss1.end()) == std::vector<char>(ss2.begin(), ss2.end()));
+        CScript scriptRead;
+        ss2 >> scriptRead;
+        BOOST_CHECK(scriptRead == script);
+
+        // moving a script leaves the source empty and takes its heap buffer over
+        CScript scriptCopy(script);
+        CScript scriptMoved(std::move(scriptCopy));
+        BOOST_CHECK(scriptMoved == script);
+        BOOST_CHECK(scriptCopy.empty());
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,93 @@
+// Copyright (c) 2017-2020 The VALUTO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "script/sigcache.h"
+
+#include "key.h"
+#include "pubkey.h"
+#include "random.h"
+#include "uint256.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(sigcache_tests)
+
+BOOST_AUTO_TEST_CASE(pubkey_verify_short_signatures)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+    uint256 hash = GetRandHash();
+
+    std::vector<unsigned char> vchSig;
+    BOOST_CHECK(!pubkey.Verify(hash, vchSig));
+    vchSig.push_back(0x30);
+    BOOST_CHECK(!pubkey.Verify(hash, vchSig));
+
+    BOOST_CHECK(key.Sign(hash, vchSig));
+    BOOST_CHECK(pubkey.Verify(hash, vchSig));
+    vchSig.resize(7);
+    BOOST_CHECK(!pubkey.Verify(hash, vchSig));
+}
+
+BOOST_AUTO_TEST_CASE(pubkey_decompress)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+    CPubKey pubkeyU = pubkey;
+    BOOST_CHECK(pubkeyU.Decompress());
+    BOOST_CHECK(!pubkeyU.IsCompressed());
+    BOOST_CHECK(pubkeyU.IsFullyValid());
+    BOOST_CHECK(pubkeyU.GetID() != pubkey.GetID());
+
+    uint256 hash = GetRandHash();
+    std::vector<unsigned char> vchSig;
+    BOOST_CHECK(key.Sign(hash, vchSig));
+    BOOST_CHECK(pubkeyU.Verify(hash, vchSig));
+}
+
+BOOST_AUTO_TEST_CASE(signature_batch)
+{
+    std::vector<CKey> keys(3);
+    for (unsigned int i = 0; i < keys.size(); i++)
+        keys[i].MakeNewKey(i != 2);
+
+    CSignatureBatch batch;
+    BOOST_CHECK(batch.Verify());
+
+    // several signatures per key, so the shared decompression is used
+    std::vector<uint256> hashes;
+    std::vector<std::vector<unsigned char> > sigs;
+    for (int i = 0; i < 12; i++) {
+        const CKey& key = keys[i % keys.size()];
+        uint256 hash = GetRandHash();
+        std::vector<unsigned char> vchSig;
+        BOOST_CHECK(key.Sign(hash, vchSig));
+        batch.Add(key.GetPubKey(), hash, vchSig, i % 2 == 0);
+        hashes.push_back(hash);
+        sigs.push_back(vchSig);
+    }
+    BOOST_CHECK_EQUAL(batch.size(), 12U);
+    BOOST_CHECK(batch.Verify());
+    // again, now partly from the cache
+    BOOST_CHECK(batch.Verify());
+
+    // a signature over the wrong hash fails the whole batch
+    batch.Add(keys[0].GetPubKey(), GetRandHash(), sigs[0], true);
+    BOOST_CHECK(!batch.Verify());
+
+    // and so does a signature by the wrong key
+    batch.clear();
+    batch.Add(keys[1].GetPubKey(), hashes[0], sigs[0], false);
+    BOOST_CHECK(!batch.Verify());
+
+    batch.clear();
+    batch.Add(keys[0].GetPubKey(), hashes[0], std::vector<unsigned char>(), false);
+    BOOST_CHECK(!batch.Verify());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,8 @@
 
 #define BOOST_TEST_MODULE VALUTO Test Suite
 
+#include "crypto/keccak256.h"
+#include "crypto/sha256.h"
 #include "main.h"
 #include "random.h"
 #include "txdb.h"
@@ -31,6 +33,8 @@ struct TestingSetup {
 
     TestingSetup() {
         SetupEnvironment();
+        SHA256AutoDetect();
+        KeccakHeaderAutoDetect();
         fPrintToDebugLog = false; // don't want to write to debug.log file
         fCheckBlockIndex = true;
         SelectParams(CBaseChainParams::UNITTEST);
@@ -0,0 +1,117 @@
+// Copyright (c) 2017-2020 The VALUTO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txposindex.h"
+
+#include "random.h"
+#include "util.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+
+static bool HasPos(const vector<CDiskTxPos>& vPos, const CDiskTxPos& pos)
+{
+    for (const CDiskTxPos& p : vPos)
+        if (p.nFile == pos.nFile && p.nPos == pos.nPos && p.nTxOffset == pos.nTxOffset)
+            return true;
+    return false;
+}
+
+BOOST_AUTO_TEST_SUITE(txposindex_tests)
+
+BOOST_AUTO_TEST_CASE(txposindex_add_lookup_reopen)
+{
+    boost::filesystem::path path = GetDataDir() / "txpos_test.dat";
+    vector<pair<uint256, CDiskTxPos> > vEntries;
+    // with a table of 256 slots, enough entries to make it grow several times
+    for (unsigned int i = 0; i < 4000; i++)
+        vEntries.push_back(make_pair(GetRandHash(), CDiskTxPos(CDiskBlockPos(i % 7, i), 81 + i)));
+
+    uint256 hashBlock = GetRandHash();
+    CBlockIndex index;
+    index.phashBlock = &hashBlock;
+
+    {
+        CTxPosIndex txpos(path, 16, 256);
+        BOOST_CHECK(txpos.Open(true));
+        // one block at a time, flushing in between like the builder thread does
+        for (unsigned int i = 0; i < vEntries.size(); i += 500) {
+            vector<pair<uint256, CDiskTxPos> > vBlock(vEntries.begin() + i, vEntries.begin() + min(i + 500, (unsigned int)vEntries.size()));
+            BOOST_CHECK(txpos.AddBlock(vBlock, &index));
+            txpos.Flush();
+        }
+        // adding the same positions again is a no-op
+        BOOST_CHECK(txpos.AddBlock(vEntries, &index));
+        BOOST_CHECK_EQUAL(txpos.GetCount(), vEntries.size());
+
+        vector<CDiskTxPos> vPos;
+        for (unsigned int i = 0; i < vEntries.size(); i++) {
+            BOOST_CHECK(txpos.Lookup(vEntries[i].first, vPos));
+            BOOST_CHECK(HasPos(vPos, vEntries[i].second));
+        }
+        BOOST_CHECK(!txpos.Lookup(GetRandHash(), vPos));
+
+        // not synced yet: the best block only moves when set explicitly
+        BOOST_CHECK(txpos.GetBestBlock() == uint256(0));
+        txpos.SetBestBlock(hashBlock);
+    }
+
+    CTxPosIndex txpos(path, 16, 256);
+    BOOST_CHECK(txpos.Open(false));
+    BOOST_CHECK_EQUAL(txpos.GetCount(), vEntries.size());
+    BOOST_CHECK(txpos.GetBestBlock() == hashBlock);
+
+    vector<CDiskTxPos> vPos;
+    BOOST_CHECK(txpos.Lookup(vEntries[42].first, vPos));
+    BOOST_CHECK(HasPos(vPos, vEntries[42].second));
+    txpos.CacheVerified(vEntries[42].first, vEntries[42].second);
+    BOOST_CHECK(txpos.Lookup(vEntries[42].first, vPos));
+    BOOST_CHECK_EQUAL(vPos.size(), 1U);
+
+    // a wipe starts from an empty table
+    BOOST_CHECK(txpos.Open(true));
+    BOOST_CHECK_EQUAL(txpos.GetCount(), 0U);
+    BOOST_CHECK(!txpos.Lookup(vEntries[42].first, vPos));
+    boost::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(txposindex_disconnect_forgets_verified)
+{
+    boost::filesystem::path path = GetDataDir() / "txpos_disconnect_test.dat";
+    CMutableTransaction tx;
+    tx.nLockTime = 1;
+    CBlock block;
+    block.vtx.push_back(tx);
+    const uint256 txid = block.vtx[0].GetHash();
+    const CDiskTxPos posOld(CDiskBlockPos(1, 100), 81);
+    const CDiskTxPos posNew(CDiskBlockPos(2, 200), 81);
+
+    uint256 hashOld = GetRandHash(), hashNew = GetRandHash();
+    CBlockIndex indexOld, indexNew;
+    indexOld.phashBlock = &hashOld;
+    indexNew.phashBlock = &hashNew;
+
+    CTxPosIndex txpos(path, 16);
+    BOOST_CHECK(txpos.Open(true));
+    BOOST_CHECK(txpos.AddBlock(vector<pair<uint256, CDiskTxPos> >(1, make_pair(txid, posOld)), &indexOld));
+    txpos.CacheVerified(txid, posOld);
+
+    // after a reorg the transaction is mined again in another block
+    BOOST_CHECK(txpos.AddBlock(vector<pair<uint256, CDiskTxPos> >(1, make_pair(txid, posNew)), &indexNew));
+    vector<CDiskTxPos> vPos;
+    BOOST_CHECK(txpos.Lookup(txid, vPos));
+    BOOST_CHECK_EQUAL(vPos.size(), 1U);
+
+    // disconnecting the old block drops the cached position, so both candidates are verified again
+    txpos.DisconnectBlock(block, &indexOld);
+    BOOST_CHECK(txpos.Lookup(txid, vPos));
+    BOOST_CHECK_EQUAL(vPos.size(), 2U);
+    BOOST_CHECK(HasPos(vPos, posOld));
+    BOOST_CHECK(HasPos(vPos, posNew));
+    boost::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
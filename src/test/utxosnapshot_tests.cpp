@@ -0,0 +1,328 @@
+// Copyright (c) 2017-2020 The VALUTO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "utxosnapshot.h"
+
+#include "chainparams.h"
+#include "checkpoints.h"
+#include "coins.h"
+#include "main.h"
+#include "random.h"
+#include "script/script.h"
+#include "txdb.h"
+#include "util.h"
+
+#include <map>
+#include <stdio.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(utxosnapshot_tests)
+
+static uint256 ReadSnapshot(const boost::filesystem::path& path, CSnapshotMetadata& metadata, uint256& txid, CCoins& coins)
+{
+    CAutoFile filein(fopen(path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+    BOOST_REQUIRE(!filein.IsNull());
+    CSnapshotReader reader(filein);
+    uint256 txidEnd;
+    uint64_t nCoins;
+    reader >> metadata >> txid >> coins >> txidEnd >> nCoins;
+    BOOST_CHECK(txidEnd == 0);
+    BOOST_CHECK_EQUAL(nCoins, 1U);
+    return reader.GetHash();
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_hash)
+{
+    boost::filesystem::path path = GetDataDir() / "utxosnapshot_test.dat";
+
+    CSnapshotMetadata metadata(GetRandHash(), 1234);
+    uint256 txid = GetRandHash();
+    CCoins coins;
+    coins.nVersion = 1;
+    coins.nHeight = 1000;
+    coins.fCoinBase = false;
+    coins.vout.resize(2);
+    coins.vout[1].nValue = 5 * COIN;
+    coins.vout[1].scriptPubKey = CScript() << OP_TRUE;
+
+    uint256 hashWritten;
+    {
+        CAutoFile fileout(fopen(path.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+        BOOST_REQUIRE(!fileout.IsNull());
+        CSnapshotWriter writer(fileout);
+        writer << metadata << txid << coins << uint256(0) << (uint64_t)1;
+        hashWritten = writer.GetHash();
+    }
+
+    // reading it back gives the same objects and the same hash
+    CSnapshotMetadata metadataRead;
+    uint256 txidRead;
+    CCoins coinsRead;
+    BOOST_CHECK(ReadSnapshot(path, metadataRead, txidRead, coinsRead) == hashWritten);
+    BOOST_CHECK(metadataRead.hashBlock == metadata.hashBlock);
+    BOOST_CHECK_EQUAL(metadataRead.nHeight, 1234);
+    BOOST_CHECK(txidRead == txid);
+    BOOST_CHECK(coinsRead == coins);
+
+    // the hash covers every byte: flip one in the txid
+    FILE* file = fopen(path.string().c_str(), "r+b");
+    BOOST_REQUIRE(file);
+    fseek(file, 40, SEEK_SET);
+    int c = fgetc(file);
+    fseek(file, 40, SEEK_SET);
+    fputc(c ^ 1, file);
+    fclose(file);
+    BOOST_CHECK(ReadSnapshot(path, metadataRead, txidRead, coinsRead) != hashWritten);
+    BOOST_CHECK(txidRead != txid);
+
+    boost::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_txid_order)
+{
+    // the chainstate database orders txids by their raw bytes, not as numbers
+    uint256 a = 1;
+    uint256 b = uint256(1) << 248;
+    BOOST_CHECK(a < b);
+    BOOST_CHECK(CSnapshotTxidCompare()(b, a));
+    BOOST_CHECK(!CSnapshotTxidCompare()(a, b));
+    BOOST_CHECK(!CSnapshotTxidCompare()(a, a));
+}
+
+/**
+ * A block on top of the genesis block, only in the block index and the
+ * chainstate, where two transactions have unspent outputs. The active chain
+ * ends at the genesis block again afterwards.
+ */
+struct SnapshotChain {
+    CBlock block;
+    CBlockIndex* pindex;
+    std::map<uint256, CCoins> mapCoins;
+
+    SnapshotChain()
+    {
+        LOCK(cs_main);
+        CBlockIndex* pindexGenesis = chainActive.Genesis();
+        block.nVersion = 1;
+        block.hashPrevBlock = pindexGenesis->GetBlockHash();
+        block.hashMerkleRoot = GetRandHash();
+        block.nTime = pindexGenesis->nTime + 60;
+        block.nBits = pindexGenesis->nBits;
+        block.nNonce = 0;
+
+        pindex = new CBlockIndex(block);
+        pindex->phashBlock = &mapBlockIndex.insert(std::make_pair(block.GetHash(), pindex)).first->first;
+        pindex->pprev = pindexGenesis;
+        pindex->nHeight = 1;
+        pindex->nTx = 1;
+        pindex->nChainTx = pindexGenesis->nChainTx + 1;
+        pindex->nStatus = BLOCK_VALID_SCRIPTS;
+        pindex->BuildSkip();
+        BOOST_CHECK(pblocktree->WriteBlockIndex(CDiskBlockIndex(pindexGenesis, GetBlockIndexExtra(pindexGenesis))));
+        BOOST_CHECK(pblocktree->WriteBlockIndex(CDiskBlockIndex(pindex, CBlockIndexExtra())));
+
+        for (unsigned int i = 0; i < 2; i++) {
+            CCoins& coins = mapCoins[GetRandHash()];
+            coins.nVersion = 1;
+            coins.nHeight = 1;
+            coins.vout.resize(i + 1);
+            coins.vout[i].nValue = (i + 1) * COIN;
+            coins.vout[i].scriptPubKey = CScript() << OP_TRUE;
+        }
+        for (const std::pair<const uint256, CCoins>& item : mapCoins)
+            *pcoinsTip->ModifyCoins(item.first) = item.second;
+        pcoinsTip->SetBestBlock(block.GetHash());
+        chainActive.SetTip(pindex);
+    }
+
+    ~SnapshotChain()
+    {
+        LOCK(cs_main);
+        for (const std::pair<const uint256, CCoins>& item : mapCoins)
+            pcoinsTip->ModifyCoins(item.first)->Clear();
+        pcoinsTip->SetBestBlock(pindex->pprev->GetBlockHash());
+        chainActive.SetTip(pindex->pprev);
+        FlushStateToDisk();
+        ReleaseBlockIndexExtra(pindex);
+        mapBlockIndex.erase(block.GetHash());
+        delete pindex;
+    }
+};
+
+/** Empty databases for a new node to load a snapshot into, with the checks the fake block can't pass turned off. */
+struct SnapshotDatabases {
+    CBlockTreeDB* pblocktreeSaved;
+    CCoinsViewCache* pcoinsTipSaved;
+    bool fCheckpointsSaved;
+    CBlockTreeDB blocktree;
+    CCoinsViewDB coinsdb;
+    CCoinsViewCache coinsTip;
+
+    SnapshotDatabases() : pblocktreeSaved(pblocktree), pcoinsTipSaved(pcoinsTip), fCheckpointsSaved(Checkpoints::fEnabled), blocktree(1 << 20, true), coinsdb(1 << 20, true), coinsTip(&coinsdb)
+    {
+        pblocktree = &blocktree;
+        pcoinsTip = &coinsTip;
+        Checkpoints::fEnabled = false;
+        ModifiableParams()->setSkipProofOfWorkCheck(true);
+    }
+
+    ~SnapshotDatabases()
+    {
+        pblocktree = pblocktreeSaved;
+        pcoinsTip = pcoinsTipSaved;
+        Checkpoints::fEnabled = fCheckpointsSaved;
+        ModifiableParams()->setSkipProofOfWorkCheck(false);
+        mapArgs.erase("-assumeutxo");
+    }
+};
+
+static uint256 DumpSnapshot(const SnapshotChain& chain, const boost::filesystem::path& path)
+{
+    CSnapshotMetadata metadata;
+    uint64_t nCoins = 0;
+    uint256 hashSnapshot;
+    std::string strError;
+    BOOST_CHECK(DumpUTXOSnapshot(path, 1, metadata, nCoins, hashSnapshot, strError));
+    BOOST_CHECK(metadata.hashBlock == chain.block.GetHash());
+    BOOST_CHECK_EQUAL(metadata.nHeight, 1);
+    BOOST_CHECK_EQUAL(nCoins, chain.mapCoins.size());
+    return hashSnapshot;
+}
+
+/** Whether nothing of a snapshot was written to the databases. */
+static bool IsNothingLoaded(const SnapshotChain& chain)
+{
+    CDiskBlockIndex diskindex;
+    CSnapshotMetadata metadata;
+    uint256 hashCoins;
+    return pcoinsTip->GetBestBlock() == 0 && !pcoinsTip->HaveCoins(chain.mapCoins.begin()->first) &&
+           !pblocktree->ReadBlockIndex(chain.block.GetHash(), diskindex) && !pblocktree->ReadSnapshotBase(metadata, hashCoins);
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_dump_load)
+{
+    boost::filesystem::path path = GetDataDir() / "utxosnapshot_dump.dat";
+    SnapshotChain chain;
+    CSnapshotMetadata metadata;
+    uint64_t nCoins;
+    uint256 hashSnapshot;
+    std::string strError;
+
+    // neither the genesis block nor above the tip
+    BOOST_CHECK(!DumpUTXOSnapshot(path, 0, metadata, nCoins, hashSnapshot, strError));
+    BOOST_CHECK(!DumpUTXOSnapshot(path, 2, metadata, nCoins, hashSnapshot, strError));
+    BOOST_CHECK(!boost::filesystem::exists(path));
+
+    hashSnapshot = DumpSnapshot(chain, path);
+    BOOST_CHECK(hashSnapshot != 0);
+
+    // a new node trusting the hash gets the same block index and coins
+    {
+        SnapshotDatabases databases;
+        mapArgs["-assumeutxo"] = hashSnapshot.GetHex();
+        BOOST_CHECK(LoadUTXOSnapshot(path, strError));
+        BOOST_CHECK(pcoinsTip->GetBestBlock() == chain.block.GetHash());
+        for (const std::pair<const uint256, CCoins>& item : chain.mapCoins) {
+            CCoins coins;
+            BOOST_CHECK(pcoinsTip->GetCoins(item.first, coins));
+            BOOST_CHECK(coins == item.second);
+        }
+        CDiskBlockIndex diskindex;
+        BOOST_CHECK(pblocktree->ReadBlockIndex(chain.block.GetHash(), diskindex));
+        BOOST_CHECK_EQUAL(diskindex.nHeight, 1);
+        BOOST_CHECK(diskindex.hashPrev == Params().HashGenesisBlock());
+        uint256 hashCoins;
+        BOOST_CHECK(pblocktree->ReadSnapshotBase(metadata, hashCoins));
+        BOOST_CHECK(metadata.hashBlock == chain.block.GetHash());
+
+        // the blocks below the snapshot are not stored, so there is no transaction index
+        bool fTxIndex = true;
+        BOOST_CHECK(pblocktree->ReadFlag("txindex", fTxIndex));
+        BOOST_CHECK(!fTxIndex);
+
+        // a chainstate that isn't empty is left as it is
+        BOOST_CHECK(LoadUTXOSnapshot(path, strError));
+    }
+
+    boost::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_load_hash_mismatch)
+{
+    boost::filesystem::path path = GetDataDir() / "utxosnapshot_mismatch.dat";
+    SnapshotChain chain;
+    uint256 hashSnapshot = DumpSnapshot(chain, path);
+    std::string strError;
+
+    SnapshotDatabases databases;
+    // a snapshot nobody vouches for isn't loaded
+    BOOST_CHECK(!LoadUTXOSnapshot(path, strError));
+    BOOST_CHECK(strError.find(hashSnapshot.ToString()) != std::string::npos);
+    mapArgs["-assumeutxo"] = GetRandHash().GetHex();
+    BOOST_CHECK(!LoadUTXOSnapshot(path, strError));
+    BOOST_CHECK(IsNothingLoaded(chain));
+
+    // nor is a trusted one once a byte of its coins changed
+    mapArgs["-assumeutxo"] = hashSnapshot.GetHex();
+    FILE* file = fopen(path.string().c_str(), "r+b");
+    BOOST_REQUIRE(file);
+    fseek(file, -41, SEEK_END);
+    int c = fgetc(file);
+    fseek(file, -41, SEEK_END);
+    fputc(c ^ 1, file);
+    fclose(file);
+    BOOST_CHECK(!LoadUTXOSnapshot(path, strError));
+    BOOST_CHECK(IsNothingLoaded(chain));
+
+    boost::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_load_truncated)
+{
+    boost::filesystem::path path = GetDataDir() / "utxosnapshot_truncated.dat";
+    SnapshotChain chain;
+    uint256 hashSnapshot = DumpSnapshot(chain, path);
+    std::string strError;
+
+    SnapshotDatabases databases;
+    mapArgs["-assumeutxo"] = hashSnapshot.GetHex();
+    // without the count of transactions at the end, then in the middle of the coins
+    boost::filesystem::resize_file(path, boost::filesystem::file_size(path) - 8);
+    BOOST_CHECK(!LoadUTXOSnapshot(path, strError));
+    BOOST_CHECK(strError.find("truncated") != std::string::npos);
+    BOOST_CHECK(IsNothingLoaded(chain));
+    boost::filesystem::resize_file(path, boost::filesystem::file_size(path) - 40);
+    BOOST_CHECK(!LoadUTXOSnapshot(path, strError));
+    BOOST_CHECK(strError.find("truncated") != std::string::npos);
+    BOOST_CHECK(IsNothingLoaded(chain));
+
+    boost::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_connect_historical_block)
+{
+    SnapshotChain chain;
+    CCoinsView viewDummy;
+    CCoinsViewCache view(&viewDummy);
+    std::string strError;
+    LOCK(cs_main);
+
+    // the genesis block starts the background chainstate
+    BOOST_CHECK(ConnectHistoricalBlock(Params().GenesisBlock(), chainActive.Genesis(), view, strError));
+    BOOST_CHECK(view.GetBestBlock() == Params().HashGenesisBlock());
+
+    // a block that isn't the one in the index is refused
+    BOOST_CHECK(!ConnectHistoricalBlock(Params().GenesisBlock(), chain.pindex, view, strError));
+    BOOST_CHECK(strError.find("unexpected block") != std::string::npos);
+
+    // and so is the indexed block, which has no transactions, without touching the chainstate
+    strError.clear();
+    BOOST_CHECK(!ConnectHistoricalBlock(chain.block, chain.pindex, view, strError));
+    BOOST_CHECK(!strError.empty());
+    BOOST_CHECK(view.GetBestBlock() == Params().HashGenesisBlock());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,128 @@
+// Copyright (c) 2017-2020 The VALUTO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "utxostats.h"
+
+#include "coins.h"
+#include "primitives/transaction.h"
+#include "random.h"
+#include "script/script.h"
+#include "undo.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(utxostats_tests)
+
+static CMutableTransaction CreateTransaction(const std::vector<COutPoint>& vPrevout, unsigned int nOutputs)
+{
+    CMutableTransaction tx;
+    for (const COutPoint& prevout : vPrevout)
+        tx.vin.push_back(CTxIn(prevout));
+    tx.vout.resize(nOutputs);
+    for (unsigned int i = 0; i < nOutputs; i++) {
+        tx.vout[i].nValue = (i + 1) * COIN;
+        tx.vout[i].scriptPubKey = CScript() << OP_TRUE;
+    }
+    return tx;
+}
+
+/** What a scan of the chainstate would count. */
+static void CheckScan(CUTXOStats& stats, const CCoinsViewCache& view, const std::vector<CTransaction>& vtx)
+{
+    CUTXOStats statsScan;
+    for (const CTransaction& tx : vtx) {
+        const CCoins* coins = view.AccessCoins(tx.GetHash());
+        if (coins)
+            statsScan.AddCoins(tx.GetHash(), *coins);
+    }
+    BOOST_CHECK_EQUAL(stats.nTransactions, statsScan.nTransactions);
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, statsScan.nTransactionOutputs);
+    BOOST_CHECK_EQUAL(stats.nTotalAmount, statsScan.nTotalAmount);
+    BOOST_CHECK(stats.GetHash() == statsScan.GetHash());
+}
+
+BOOST_AUTO_TEST_CASE(utxostats_connect_disconnect)
+{
+    CCoinsView viewDummy;
+    CCoinsViewCache view(&viewDummy);
+    CUTXOStats stats;
+
+    // an earlier transaction with three outputs
+    CTransaction tx0 = CreateTransaction(std::vector<COutPoint>(1, COutPoint(GetRandHash(), 0)), 3);
+    view.ModifyCoins(tx0.GetHash())->FromTx(tx0, 1);
+    stats.AddCoins(tx0.GetHash(), CCoins(tx0, 1));
+    uint256 hashBefore = stats.GetHash();
+    CUTXOStats statsBefore = stats;
+
+    // a block whose first transaction spends two of them and adds an unspendable output,
+    // and whose second one spends an output of the first and the last one of tx0
+    std::vector<COutPoint> vPrevout1;
+    vPrevout1.push_back(COutPoint(tx0.GetHash(), 0));
+    vPrevout1.push_back(COutPoint(tx0.GetHash(), 2));
+    CMutableTransaction mtx1 = CreateTransaction(vPrevout1, 2);
+    mtx1.vout.push_back(CTxOut(0, CScript() << OP_RETURN));
+    CTransaction tx1 = mtx1;
+    std::vector<COutPoint> vPrevout2;
+    vPrevout2.push_back(COutPoint(tx1.GetHash(), 1));
+    vPrevout2.push_back(COutPoint(tx0.GetHash(), 1));
+    CTransaction tx2 = CreateTransaction(vPrevout2, 1);
+    std::vector<CTransaction> vtx;
+    vtx.push_back(tx1);
+    vtx.push_back(tx2);
+
+    // connect it the way ConnectBlock does
+    std::vector<CTxUndo> vtxundo(vtx.size());
+    for (unsigned int i = 0; i < vtx.size(); i++) {
+        const CTransaction& tx = vtx[i];
+        stats.SpendInputs(tx, view);
+        stats.AddCoins(tx.GetHash(), CCoins(tx, 2));
+        for (const CTxIn& txin : tx.vin) {
+            vtxundo[i].vprevout.push_back(CTxInUndo());
+            BOOST_CHECK(view.ModifyCoins(txin.prevout.hash)->Spend(txin.prevout, vtxundo[i].vprevout.back()));
+        }
+        view.ModifyCoins(tx.GetHash())->FromTx(tx, 2);
+    }
+    std::vector<CTransaction> vtxAll(vtx);
+    vtxAll.push_back(tx0);
+    // tx0 is spent, tx1 has one output left and tx2 one
+    BOOST_CHECK_EQUAL(stats.nTransactions, 2U);
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, 2U);
+    BOOST_CHECK_EQUAL(stats.nTotalAmount, 2 * COIN);
+    CheckScan(stats, view, vtxAll);
+
+    // and disconnect it the way DisconnectBlock does
+    for (int i = vtx.size() - 1; i >= 0; i--) {
+        const CTransaction& tx = vtx[i];
+        {
+            CCoinsModifier outs = view.ModifyCoins(tx.GetHash());
+            stats.RemoveCoins(tx.GetHash(), *outs);
+            outs->Clear();
+        }
+        for (unsigned int j = tx.vin.size(); j-- > 0;) {
+            const COutPoint& out = tx.vin[j].prevout;
+            const CTxInUndo& undo = vtxundo[i].vprevout[j];
+            CCoinsModifier coins = view.ModifyCoins(out.hash);
+            if (undo.nHeight != 0) {
+                coins->Clear();
+                coins->fCoinBase = undo.fCoinBase;
+                coins->fCoinStake = undo.fCoinStake;
+                coins->nHeight = undo.nHeight;
+                coins->nVersion = undo.nVersion;
+            }
+            if (coins->vout.size() < out.n + 1)
+                coins->vout.resize(out.n + 1);
+            coins->vout[out.n] = undo.txout;
+            stats.RestoreOutput(out, undo, *coins);
+        }
+    }
+    BOOST_CHECK_EQUAL(stats.nTransactions, statsBefore.nTransactions);
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, statsBefore.nTransactionOutputs);
+    BOOST_CHECK_EQUAL(stats.nTotalAmount, statsBefore.nTotalAmount);
+    BOOST_CHECK(stats.GetHash() == hashBefore);
+    CheckScan(stats, view, vtxAll);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
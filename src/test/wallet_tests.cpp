@@ -4,13 +4,22 @@
 
 #include "wallet.h"
 
+#include "coinselection.h"
+#include "init.h"
+#include "key.h"
+#include "rpc/server.h"
+#include "script/standard.h"
+#include "walletdb.h"
+
 #include <set>
 #include <stdint.h>
 #include <utility>
 #include <vector>
 
+#include <boost/bind.hpp>
 #include <boost/foreach.hpp>
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
 
 // how many times to run all the tests to have a chance to catch errors that only show up with particular random shuffles
 #define RUN_TESTS 100
@@ -305,4 +314,362 @@ BOOST_AUTO_TEST_CASE(coin_selection_tests)
     empty_wallet();
 }
 
+static bool select_bnb(const CAmount& nTargetValue, const CAmount& nCostOfChange, CoinSet& setCoinsRet, CAmount& nValueRet)
+{
+    const CCoinPool pool = wallet.MakeCoinPool(vCoins);
+    vector<const CInputCoin*> vPoolCoins;
+    BOOST_FOREACH(const CInputCoin& coin, pool.GetCoins())
+        vPoolCoins.push_back(&coin);
+    return SelectCoinsBnB(vPoolCoins, nTargetValue, nCostOfChange, setCoinsRet, nValueRet);
+}
+
+BOOST_AUTO_TEST_CASE(coin_selection_bnb)
+{
+    CoinSet setCoinsRet;
+    CAmount nValueRet;
+
+    LOCK(wallet.cs_wallet);
+
+    empty_wallet();
+    add_coin(1 * CENT);
+    add_coin(2 * CENT);
+    add_coin(3 * CENT);
+    add_coin(4 * CENT);
+
+    // an exact match is found and nothing more is taken
+    BOOST_CHECK(select_bnb(5 * CENT, 0, setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 5 * CENT);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 2U);
+    BOOST_CHECK(select_bnb(10 * CENT, 0, setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 4U);
+
+    // more than the coins are worth, or no subset within the window
+    BOOST_CHECK(!select_bnb(11 * CENT, 1 * CENT, setCoinsRet, nValueRet));
+    BOOST_CHECK(setCoinsRet.empty());
+    empty_wallet();
+    add_coin(4 * CENT);
+    add_coin(6 * CENT);
+    BOOST_CHECK(!select_bnb(5 * CENT, 0.5 * CENT, setCoinsRet, nValueRet));
+
+    // overshooting by no more than the cost of change is changeless, and the smallest overshoot wins
+    BOOST_CHECK(select_bnb(5 * CENT, 1 * CENT, setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 6 * CENT);
+    add_coin(5.5 * CENT);
+    BOOST_CHECK(select_bnb(5 * CENT, 1 * CENT, setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 5.5 * CENT);
+
+    // coins worth more than the window are never picked
+    empty_wallet();
+    add_coin(100 * CENT);
+    add_coin(2 * CENT);
+    add_coin(3 * CENT);
+    BOOST_CHECK(select_bnb(5 * CENT, 1 * CENT, setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 5 * CENT);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 2U);
+
+    // a large pool of identical coins is searched within the bound
+    empty_wallet();
+    for (int i = 0; i < 2000; i++)
+        add_coin(1 * CENT);
+    BOOST_CHECK(select_bnb(250 * CENT, 0, setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 250U);
+    BOOST_CHECK(!select_bnb(2500 * CENT, 0, setCoinsRet, nValueRet));
+
+    // the knapsack still makes the target on it
+    BOOST_CHECK(wallet.SelectCoinsMinConf(1999.5 * CENT, 1, 1, vCoins, setCoinsRet, nValueRet));
+    BOOST_CHECK(nValueRet >= 1999.5 * CENT);
+    empty_wallet();
+}
+
+BOOST_AUTO_TEST_CASE(wallet_utxo_balances)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    {
+        LOCK(pwalletMain->cs_wallet);
+        BOOST_CHECK(pwalletMain->AddKeyPubKey(key, key.GetPubKey()));
+    }
+    const CAmount nBalance = pwalletMain->GetBalance();
+    const CAmount nUnconfirmed = pwalletMain->GetUnconfirmedBalance();
+
+    // a payment to us from someone else, in the mempool: unconfirmed
+    CMutableTransaction mtxPayment;
+    mtxPayment.vin.resize(1);
+    mtxPayment.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    mtxPayment.vout.push_back(CTxOut(10 * COIN, GetScriptForDestination(key.GetPubKey().GetID())));
+    CTransaction txPayment(mtxPayment);
+    mempool.addUnchecked(txPayment.GetHash(), CTxMemPoolEntry(txPayment, 0, GetTime(), 0, 1));
+    pwalletMain->SyncTransaction(txPayment, NULL);
+    BOOST_CHECK_EQUAL(pwalletMain->GetBalance(), nBalance);
+    BOOST_CHECK_EQUAL(pwalletMain->GetUnconfirmedBalance(), nUnconfirmed + 10 * COIN);
+
+    // spending it with change back to us: the change is trusted, the payment is spent
+    CMutableTransaction mtxSpend;
+    mtxSpend.vin.push_back(CTxIn(txPayment.GetHash(), 0));
+    mtxSpend.vout.push_back(CTxOut(6 * COIN, CScript() << OP_TRUE));
+    mtxSpend.vout.push_back(CTxOut(4 * COIN, GetScriptForDestination(key.GetPubKey().GetID())));
+    CTransaction txSpend(mtxSpend);
+    mempool.addUnchecked(txSpend.GetHash(), CTxMemPoolEntry(txSpend, 0, GetTime(), 0, 1));
+    pwalletMain->SyncTransaction(txSpend, NULL);
+    BOOST_CHECK_EQUAL(pwalletMain->GetBalance(), nBalance + 4 * COIN);
+    BOOST_CHECK_EQUAL(pwalletMain->GetUnconfirmedBalance(), nUnconfirmed);
+
+    vector<COutput> vAvailable;
+    pwalletMain->AvailableCoins(vAvailable, true);
+    COutPoint outChange(txSpend.GetHash(), 1);
+    bool fFound = false;
+    BOOST_FOREACH (const COutput& out, vAvailable) {
+        BOOST_CHECK(out.tx->GetHash() != txPayment.GetHash());
+        if (COutPoint(out.tx->GetHash(), out.i) == outChange)
+            fFound = true;
+    }
+    BOOST_CHECK(fFound);
+
+    // a locked coin is no longer available
+    {
+        LOCK(pwalletMain->cs_wallet);
+        pwalletMain->LockCoin(outChange);
+    }
+    pwalletMain->AvailableCoins(vAvailable, true);
+    BOOST_FOREACH (const COutput& out, vAvailable)
+        BOOST_CHECK(COutPoint(out.tx->GetHash(), out.i) != outChange);
+
+    {
+        LOCK(pwalletMain->cs_wallet);
+        pwalletMain->UnlockCoin(outChange);
+    }
+    // only the transaction of the coin is worked out again, the totals stay right
+    BOOST_CHECK_EQUAL(pwalletMain->GetBalance(), nBalance + 4 * COIN);
+    BOOST_CHECK_EQUAL(pwalletMain->GetUnconfirmedBalance(), nUnconfirmed);
+
+    // out of the mempool and the chain, neither counts any more
+    std::list<CTransaction> removed;
+    mempool.remove(txPayment, removed, true);
+    BOOST_CHECK_EQUAL(pwalletMain->GetBalance(), nBalance);
+    BOOST_CHECK_EQUAL(pwalletMain->GetUnconfirmedBalance(), nUnconfirmed);
+}
+
+BOOST_AUTO_TEST_CASE(wallet_undo_add_to_wallet)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    {
+        LOCK(pwalletMain->cs_wallet);
+        BOOST_CHECK(pwalletMain->AddKeyPubKey(key, key.GetPubKey()));
+    }
+    const CAmount nUnconfirmed = pwalletMain->GetUnconfirmedBalance();
+
+    CMutableTransaction mtxPayment;
+    mtxPayment.vin.resize(1);
+    mtxPayment.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    mtxPayment.vout.push_back(CTxOut(10 * COIN, GetScriptForDestination(key.GetPubKey().GetID())));
+    CTransaction txPayment(mtxPayment);
+    mempool.addUnchecked(txPayment.GetHash(), CTxMemPoolEntry(txPayment, 0, GetTime(), 0, 1));
+    pwalletMain->SyncTransaction(txPayment, NULL);
+
+    // a spend of it that is added to the wallet, then taken back as if its write had failed
+    CMutableTransaction mtxSpend;
+    mtxSpend.vin.push_back(CTxIn(txPayment.GetHash(), 0));
+    mtxSpend.vout.push_back(CTxOut(10 * COIN, CScript() << OP_TRUE));
+    CTransaction txSpend(mtxSpend);
+    mempool.addUnchecked(txSpend.GetHash(), CTxMemPoolEntry(txSpend, 0, GetTime(), 0, 1));
+    {
+        LOCK2(cs_main, pwalletMain->cs_wallet);
+        BOOST_CHECK(pwalletMain->AddToWallet(CWalletTx(pwalletMain, txSpend)));
+        BOOST_CHECK(pwalletMain->IsSpent(txPayment.GetHash(), 0));
+
+        pwalletMain->UndoAddToWallet(txSpend.GetHash());
+        BOOST_CHECK(!pwalletMain->mapWallet.count(txSpend.GetHash()));
+        BOOST_CHECK(!pwalletMain->IsSpent(txPayment.GetHash(), 0));
+        BOOST_FOREACH (const CWallet::TxItems::value_type& item, pwalletMain->wtxOrdered)
+            BOOST_CHECK(!item.second.first || item.second.first->GetHash() != txSpend.GetHash());
+    }
+    BOOST_CHECK_EQUAL(pwalletMain->GetUnconfirmedBalance(), nUnconfirmed + 10 * COIN);
+
+    std::list<CTransaction> removed;
+    mempool.remove(txPayment, removed, true);
+}
+
+BOOST_AUTO_TEST_CASE(wallet_scan_filter)
+{
+    CWallet keystore;
+    CKey key, keyScript, keyOther;
+    key.MakeNewKey(true);
+    keyScript.MakeNewKey(false);
+    keyOther.MakeNewKey(true);
+    CScript scriptRedeem = GetScriptForDestination(keyScript.GetPubKey().GetID());
+    CScript scriptWatch = CScript() << OP_RETURN << ToByteVector(keyOther.GetPubKey());
+    {
+        LOCK(keystore.cs_wallet);
+        BOOST_CHECK(keystore.AddKeyPubKey(key, key.GetPubKey()));
+        BOOST_CHECK(keystore.AddCScript(scriptRedeem));
+        BOOST_CHECK(keystore.AddWatchOnly(scriptWatch));
+    }
+    CWalletScanFilter filter = keystore.GetScanFilter();
+
+    // everything IsMine would look at
+    BOOST_CHECK(filter.IsRelevant(GetScriptForDestination(key.GetPubKey().GetID())));
+    BOOST_CHECK(filter.IsRelevant(CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG));
+    BOOST_CHECK(filter.IsRelevant(GetScriptForDestination(CScriptID(scriptRedeem))));
+    BOOST_CHECK(filter.IsRelevant(scriptWatch));
+    std::vector<CPubKey> vKeys;
+    vKeys.push_back(keyOther.GetPubKey());
+    vKeys.push_back(key.GetPubKey());
+    BOOST_CHECK(filter.IsRelevant(GetScriptForMultisig(1, vKeys)));
+
+    // and not what can't be ours
+    BOOST_CHECK(!filter.IsRelevant(GetScriptForDestination(keyOther.GetPubKey().GetID())));
+    BOOST_CHECK(!filter.IsRelevant(CScript() << ToByteVector(keyOther.GetPubKey()) << OP_CHECKSIG));
+    BOOST_CHECK(!filter.IsRelevant(CScript() << OP_RETURN << ToByteVector(key.GetPubKey().GetID())));
+
+    CMutableTransaction tx;
+    tx.vout.push_back(CTxOut(COIN, GetScriptForDestination(keyOther.GetPubKey().GetID())));
+    BOOST_CHECK(!filter.IsRelevant(CTransaction(tx)));
+    tx.vout.push_back(CTxOut(COIN, GetScriptForDestination(key.GetPubKey().GetID())));
+    BOOST_CHECK(filter.IsRelevant(CTransaction(tx)));
+}
+
+BOOST_AUTO_TEST_CASE(wallet_db_batch)
+{
+    const std::string& strFile = pwalletMain->strWalletFile;
+    CKey key;
+    key.MakeNewKey(true);
+    const int64_t nPool = 1000000;
+    CKeyPool keypool;
+    {
+        CDBBatch batch;
+        CWalletDB walletdb(strFile);
+        BOOST_CHECK(walletdb.WritePool(nPool, CKeyPool(key.GetPubKey())));
+        BOOST_CHECK(walletdb.WritePool(nPool + 1, CKeyPool(key.GetPubKey())));
+        BOOST_CHECK(walletdb.ErasePool(nPool + 1));
+
+        // the writes wait in memory and reads see them already
+        BOOST_CHECK_EQUAL(CDB::CountPending(strFile), 2U);
+        BOOST_CHECK(walletdb.ReadPool(nPool, keypool));
+        BOOST_CHECK(keypool.vchPubKey == key.GetPubKey());
+        BOOST_CHECK(!walletdb.ReadPool(nPool + 1, keypool));
+    }
+
+    // and are on disk once the batch is over
+    BOOST_CHECK_EQUAL(CDB::CountPending(strFile), 0U);
+    CWalletDB walletdb(strFile);
+    keypool = CKeyPool();
+    BOOST_CHECK(walletdb.ReadPool(nPool, keypool));
+    BOOST_CHECK(keypool.vchPubKey == key.GetPubKey());
+    BOOST_CHECK(!walletdb.ReadPool(nPool + 1, keypool));
+    BOOST_CHECK(walletdb.ErasePool(nPool));
+
+    // outside a batch the wallet writes through
+    BOOST_CHECK_EQUAL(CDB::CountPending(strFile), 0U);
+    BOOST_CHECK(!walletdb.ReadPool(nPool, keypool));
+}
+
+static void WritePoolOnThread(const std::string& strFile, int64_t nPool, const CPubKey& pubkey, bool& fWritten)
+{
+    CWalletDB walletdb(strFile);
+    fWritten = walletdb.WritePool(nPool, CKeyPool(pubkey));
+}
+
+BOOST_AUTO_TEST_CASE(wallet_db_batch_per_thread)
+{
+    const std::string& strFile = pwalletMain->strWalletFile;
+    CKey key;
+    key.MakeNewKey(true);
+    const int64_t nPool = 1000002;
+    CKeyPool keypool;
+    {
+        CDBBatch batch;
+        CWalletDB walletdb(strFile);
+        BOOST_CHECK(walletdb.WritePool(nPool, CKeyPool(key.GetPubKey())));
+
+        // a batch open on this thread doesn't hold back the writes of another
+        bool fWritten = false;
+        boost::thread thread(boost::bind(&WritePoolOnThread, strFile, nPool + 1, key.GetPubKey(), boost::ref(fWritten)));
+        thread.join();
+        BOOST_CHECK(fWritten);
+        BOOST_CHECK_EQUAL(CDB::CountPending(strFile), 1U);
+        BOOST_CHECK(walletdb.ReadPool(nPool + 1, keypool));
+
+        // committing puts this thread's writes on disk with the batch still open
+        BOOST_CHECK(batch.Commit());
+        BOOST_CHECK_EQUAL(CDB::CountPending(strFile), 0U);
+        BOOST_CHECK(walletdb.ReadPool(nPool, keypool));
+    }
+
+    CWalletDB walletdb(strFile);
+    BOOST_CHECK(walletdb.ErasePool(nPool));
+    BOOST_CHECK(walletdb.ErasePool(nPool + 1));
+}
+
+BOOST_AUTO_TEST_CASE(wallet_multiwallet_rpc)
+{
+    bool fFirstRun;
+    CWallet* pwalletOther = new CWallet("wallet_other.dat");
+    pwalletOther->LoadWallet(fFirstRun);
+    vpwallets.push_back(pwalletMain);
+    vpwallets.push_back(pwalletOther);
+    BOOST_CHECK(FindWallet("wallet.dat") == pwalletMain);
+    BOOST_CHECK(FindWallet("wallet_other.dat") == pwalletOther);
+    BOOST_CHECK(FindWallet("wallet_missing.dat") == NULL);
+
+    UniValue params(UniValue::VARR);
+    UniValue wallets = tableRPC.execute("listwallets", params);
+    BOOST_CHECK_EQUAL(wallets.size(), 2U);
+    BOOST_CHECK_EQUAL(wallets[1].get_str(), "wallet_other.dat");
+
+    // a call sent to a wallet works on that wallet alone
+    CBitcoinAddress address(tableRPC.execute("getnewaddress", params, "wallet_other.dat").get_str());
+    BOOST_CHECK(address.IsValid());
+    BOOST_CHECK(IsMine(*pwalletOther, address.Get()));
+    BOOST_CHECK(!IsMine(*pwalletMain, address.Get()));
+
+    address.SetString(tableRPC.execute("getnewaddress", params).get_str());
+    BOOST_CHECK(IsMine(*pwalletMain, address.Get()));
+    BOOST_CHECK(!IsMine(*pwalletOther, address.Get()));
+
+    bool fNotFound = false;
+    try {
+        tableRPC.execute("getnewaddress", params, "wallet_missing.dat");
+    } catch (const UniValue& objError) {
+        fNotFound = find_value(objError, "code").get_int() == RPC_WALLET_NOT_FOUND;
+    }
+    BOOST_CHECK(fNotFound);
+
+    vpwallets.clear();
+    delete pwalletOther;
+}
+
+BOOST_AUTO_TEST_CASE(wallet_keypool_topup)
+{
+    bool fFirstRun;
+    CWallet wallet("wallet_keypool.dat");
+    wallet.LoadWallet(fFirstRun);
+
+    // several batches, the last one cut short
+    const unsigned int nTarget = 2 * KEYPOOL_BATCH_KEYS + KEYPOOL_BATCH_KEYS / 2;
+    BOOST_CHECK(wallet.TopUpKeyPool(nTarget));
+    LOCK(wallet.cs_wallet);
+    BOOST_CHECK_EQUAL(wallet.GetKeyPoolSize(), nTarget + 1);
+
+    CWalletDB walletdb(wallet.strWalletFile);
+    std::set<CKeyID> setKeys;
+    BOOST_FOREACH (int64_t nIndex, wallet.setKeyPool) {
+        CKeyPool keypool;
+        BOOST_CHECK(walletdb.ReadPool(nIndex, keypool));
+        BOOST_CHECK(wallet.HaveKey(keypool.vchPubKey.GetID()));
+        setKeys.insert(keypool.vchPubKey.GetID());
+    }
+    BOOST_CHECK_EQUAL(setKeys.size(), nTarget + 1);
+
+    // a full pool is left alone
+    BOOST_CHECK(wallet.TopUpKeyPool(nTarget));
+    BOOST_CHECK_EQUAL(wallet.GetKeyPoolSize(), nTarget + 1);
+
+    // handing out a key without the keypool thread refills the pool right away
+    CPubKey pubkey;
+    BOOST_CHECK(wallet.GetKeyFromPool(pubkey));
+    BOOST_CHECK(setKeys.count(pubkey.GetID()));
+    BOOST_CHECK_EQUAL(wallet.GetKeyPoolSize(), DEFAULT_KEYPOOL_SIZE);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
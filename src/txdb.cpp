@@ -10,6 +10,8 @@
 #include "main.h"
 #include "pow.h"
 #include "uint256.h"
+#include "utxosnapshot.h"
+#include "utxostats.h"
 
 #include <stdint.h>
 
@@ -30,7 +32,7 @@ void static BatchWriteHashBestChain(CLevelDBBatch& batch, const uint256& hash)
     batch.Write('B', hash);
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe)
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe, const std::string& strName) : db(GetDataDir() / strName, nCacheSize, fMemory, fWipe)
 {
 }
 
@@ -77,11 +79,54 @@ CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevel
 {
 }
 
+bool CBlockTreeDB::ReadBlockIndex(const uint256& hash, CDiskBlockIndex& blockindex)
+{
+    return Read(make_pair('b', hash), blockindex);
+}
+
 bool CBlockTreeDB::WriteBlockIndex(const CDiskBlockIndex& blockindex)
 {
     return Write(make_pair('b', blockindex.GetBlockHash()), blockindex);
 }
 
+bool CBlockTreeDB::WriteBlockIndexBatch(const std::vector<std::pair<uint256, CDiskBlockIndex> >& vIndex)
+{
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<uint256, CDiskBlockIndex> >::const_iterator it = vIndex.begin(); it != vIndex.end(); it++)
+        batch.Write(make_pair('b', it->first), it->second);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadSnapshotBase(CSnapshotMetadata& metadata, uint256& hashCoins)
+{
+    std::pair<CSnapshotMetadata, uint256> base;
+    if (!Read('S', base))
+        return false;
+    metadata = base.first;
+    hashCoins = base.second;
+    return true;
+}
+
+bool CBlockTreeDB::WriteSnapshotBase(const CSnapshotMetadata& metadata, const uint256& hashCoins)
+{
+    return Write('S', make_pair(metadata, hashCoins), true);
+}
+
+bool CBlockTreeDB::EraseSnapshotBase()
+{
+    return Erase('S', true);
+}
+
+bool CBlockTreeDB::ReadUTXOStats(CUTXOStats& stats)
+{
+    return Read('U', stats);
+}
+
+bool CBlockTreeDB::WriteUTXOStats(const CUTXOStats& stats)
+{
+    return Write('U', stats);
+}
+
 bool CBlockTreeDB::WriteBlockFileInfo(int nFile, const CBlockFileInfo& info)
 {
     return Write(make_pair('f', nFile), info);
@@ -116,6 +161,67 @@ bool CBlockTreeDB::ReadLastBlockFile(int& nFile)
     return Read('l', nFile);
 }
 
+void ApplyStats(CCoinsStats& stats, CHashWriter& ss, const uint256& txid, const CCoins& coins)
+{
+    ss << txid;
+    ss << VARINT(coins.nVersion);
+    ss << (coins.fCoinBase ? 'c' : 'n');
+    ss << VARINT(coins.nHeight);
+    stats.nTransactions++;
+    for (unsigned int i = 0; i < coins.vout.size(); i++) {
+        const CTxOut& out = coins.vout[i];
+        if (!out.IsNull()) {
+            stats.nTransactionOutputs++;
+            ss << VARINT(i + 1);
+            ss << out;
+            stats.nTotalAmount += out.nValue;
+        }
+    }
+    ss << VARINT(0);
+}
+
+bool CCoinsViewDB::ForEachCoins(const boost::function<bool(const uint256&, const CCoins&)>& fn) const
+{
+    boost::scoped_ptr<CCoinsViewCursor> pcursor(Cursor());
+    return pcursor->ForEach(fn);
+}
+
+CCoinsViewCursor* CCoinsViewDB::Cursor() const
+{
+    return new CCoinsViewDBCursor(const_cast<CLevelDBWrapper*>(&db)->NewIterator());
+}
+
+bool CCoinsViewDBCursor::ForEach(const boost::function<bool(const uint256&, const CCoins&)>& fn)
+{
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << 'c';
+    pcursor->Seek(ssKeySet.str());
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            ssKey >> chType;
+            if (chType != 'c')
+                break;
+            uint256 txid;
+            ssKey >> txid;
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CCoins coins;
+            ssValue >> coins;
+            if (!fn(txid, coins))
+                return true;
+            pcursor->Next();
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+    return true;
+}
+
 bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
 {
     /* It seems that there are no "const iterators" for LevelDB.  Since we
@@ -127,7 +233,6 @@ bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
     CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
     stats.hashBlock = GetBestBlock();
     ss << stats.hashBlock;
-    CAmount nTotalAmount = 0;
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         try {
@@ -142,22 +247,8 @@ bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
                 ssValue >> coins;
                 uint256 txhash;
                 ssKey >> txhash;
-                ss << txhash;
-                ss << VARINT(coins.nVersion);
-                ss << (coins.fCoinBase ? 'c' : 'n');
-                ss << VARINT(coins.nHeight);
-                stats.nTransactions++;
-                for (unsigned int i = 0; i < coins.vout.size(); i++) {
-                    const CTxOut& out = coins.vout[i];
-                    if (!out.IsNull()) {
-                        stats.nTransactionOutputs++;
-                        ss << VARINT(i + 1);
-                        ss << out;
-                        nTotalAmount += out.nValue;
-                    }
-                }
+                ApplyStats(stats, ss, txhash, coins);
                 stats.nSerializedSize += 32 + slValue.size();
-                ss << VARINT(0);
             }
             pcursor->Next();
         } catch (std::exception& e) {
@@ -166,7 +257,6 @@ bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
     }
     stats.nHeight = mapBlockIndex.find(GetBestBlock())->second->nHeight;
     stats.hashSerialized = ss.GetHash();
-    stats.nTotalAmount = nTotalAmount;
     return true;
 }
 
@@ -207,6 +297,46 @@ bool CBlockTreeDB::ReadInt(const std::string& name, int& nValue)
     return Read(std::make_pair('I', name), nValue);
 }
 
+namespace
+{
+//! Block index records read from the cursor before they are decoded on all cores.
+const size_t BLOCK_INDEX_LOAD_BATCH = 65536;
+
+/**
+ * Decode the block index records [nBegin, nEnd). The key hash is trusted for
+ * entries that were accepted into the tree: their proof of work was checked then
+ * and LevelDB verifies the checksum of every record it reads. The others, and all
+ * of them with -checkblockindex, are hashed again.
+ */
+bool DecodeBlockIndexRecords(const std::vector<std::pair<uint256, std::string> >& vRecords, std::vector<CDiskBlockIndex>& vDiskIndex, size_t nBegin, size_t nEnd, std::string& strError)
+{
+    const int nLastPoWBlock = Params().LAST_POW_BLOCK();
+    for (size_t i = nBegin; i < nEnd; i++) {
+        CDiskBlockIndex& diskindex = vDiskIndex[i];
+        try {
+            CDataStream ssValue(vRecords[i].second.data(), vRecords[i].second.data() + vRecords[i].second.size(), SER_DISK, CLIENT_VERSION);
+            ssValue >> diskindex;
+        } catch (std::exception& e) {
+            strError = strprintf("Deserialize or I/O error - %s", e.what());
+            return false;
+        }
+
+        if (fCheckBlockIndex || !diskindex.IsValid(BLOCK_VALID_TREE)) {
+            uint256 hash = diskindex.GetBlockHash();
+            if (hash != vRecords[i].first) {
+                strError = strprintf("block index entry %s hashes to %s", vRecords[i].first.ToString(), hash.ToString());
+                return false;
+            }
+            if (diskindex.nHeight <= nLastPoWBlock && !CheckProofOfWork(hash, diskindex.nBits)) {
+                strError = strprintf("CheckProofOfWork failed: %s", diskindex.ToString());
+                return false;
+            }
+        }
+    }
+    return true;
+}
+} // namespace
+
 bool CBlockTreeDB::LoadBlockIndexGuts()
 {
     boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
@@ -215,61 +345,221 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
     ssKeySet << make_pair('b', uint256(0));
     pcursor->Seek(ssKeySet.str());
 
-    // Load mapBlockIndex
+    const unsigned int nThreads = std::max(1u, boost::thread::hardware_concurrency());
+    std::vector<std::pair<uint256, std::string> > vRecords;
+    std::vector<CDiskBlockIndex> vDiskIndex;
+    std::vector<std::string> vErrors(nThreads);
+
+    // Load mapBlockIndex. The cursor is walked on this thread, a batch of records
+    // at a time, and each batch is decoded and checked in parallel.
+    bool fDone = false;
+    while (!fDone) {
+        boost::this_thread::interruption_point();
+        vRecords.clear();
+        try {
+            while (vRecords.size() < BLOCK_INDEX_LOAD_BATCH) {
+                if (!pcursor->Valid()) {
+                    fDone = true;
+                    break;
+                }
+                leveldb::Slice slKey = pcursor->key();
+                CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+                char chType;
+                ssKey >> chType;
+                if (chType != 'b') {
+                    fDone = true;
+                    break;
+                }
+                uint256 hash;
+                ssKey >> hash;
+                leveldb::Slice slValue = pcursor->value();
+                vRecords.push_back(make_pair(hash, slValue.ToString()));
+                pcursor->Next();
+            }
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+
+        vDiskIndex.assign(vRecords.size(), CDiskBlockIndex());
+        size_t nPerThread = (vRecords.size() + nThreads - 1) / nThreads;
+        boost::thread_group threadGroup;
+        for (unsigned int t = 1; t < nThreads && t * nPerThread < vRecords.size(); t++) {
+            size_t nBegin = t * nPerThread;
+            size_t nEnd = std::min(nBegin + nPerThread, vRecords.size());
+            threadGroup.create_thread([&vRecords, &vDiskIndex, &vErrors, nBegin, nEnd, t]() {
+                DecodeBlockIndexRecords(vRecords, vDiskIndex, nBegin, nEnd, vErrors[t]);
+            });
+        }
+        DecodeBlockIndexRecords(vRecords, vDiskIndex, 0, std::min(nPerThread, vRecords.size()), vErrors[0]);
+        threadGroup.join_all();
+        for (const std::string& strError : vErrors) {
+            if (!strError.empty())
+                return error("LoadBlockIndex() : %s", strError);
+        }
+
+        for (size_t i = 0; i < vRecords.size(); i++) {
+            const CDiskBlockIndex& diskindex = vDiskIndex[i];
+
+            // Construct block index object
+            CBlockIndex* pindexNew = InsertBlockIndex(vRecords[i].first);
+            pindexNew->pprev = InsertBlockIndex(diskindex.hashPrev);
+            pindexNew->nHeight = diskindex.nHeight;
+            pindexNew->nFile = diskindex.nFile;
+            pindexNew->nDataPos = diskindex.nDataPos;
+            pindexNew->nUndoPos = diskindex.nUndoPos;
+            pindexNew->nVersion = diskindex.nVersion;
+            pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+            pindexNew->nTime = diskindex.nTime;
+            pindexNew->nBits = diskindex.nBits;
+            pindexNew->nNonce = diskindex.nNonce;
+            pindexNew->nStatus = diskindex.nStatus;
+            pindexNew->nTx = diskindex.nTx;
+
+            //Proof Of Stake
+            pindexNew->nFlags = diskindex.nFlags;
+            pindexNew->nStakeModifier = diskindex.nStakeModifier;
+
+            // ppcoin: build setStakeSeen
+            if (pindexNew->IsProofOfStake())
+                setStakeSeen.insert(make_pair(diskindex.prevoutStake, diskindex.nStakeTime));
+        }
+    }
+
+    return true;
+}
+
+bool CBlockTreeDB::WriteAddressIndexUpdate(const CAddressIndexUpdate& update, const uint256& hashBest)
+{
+    // Puts go first: an output created and spent by the same block ends up erased
+    // both when connecting and when disconnecting it.
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it = update.vAddressIndex.begin(); it != update.vAddressIndex.end(); it++)
+        batch.Write(make_pair('a', it->first), it->second);
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it = update.vAddressUnspent.begin(); it != update.vAddressUnspent.end(); it++)
+        batch.Write(make_pair('u', it->first), it->second);
+    for (std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >::const_iterator it = update.vSpentIndex.begin(); it != update.vSpentIndex.end(); it++)
+        batch.Write(make_pair('p', it->first), it->second);
+    for (std::vector<CAddressIndexKey>::const_iterator it = update.vAddressIndexErase.begin(); it != update.vAddressIndexErase.end(); it++)
+        batch.Erase(make_pair('a', *it));
+    for (std::vector<CAddressUnspentKey>::const_iterator it = update.vAddressUnspentErase.begin(); it != update.vAddressUnspentErase.end(); it++)
+        batch.Erase(make_pair('u', *it));
+    for (std::vector<CSpentIndexKey>::const_iterator it = update.vSpentIndexErase.begin(); it != update.vSpentIndexErase.end(); it++)
+        batch.Erase(make_pair('p', *it));
+    batch.Write('A', hashBest);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadAddressIndexBestBlock(uint256& hashBest)
+{
+    if (!Read('A', hashBest))
+        hashBest = uint256(0);
+    return true;
+}
+
+bool CBlockTreeDB::WipeAddressIndexes()
+{
+    const char prefixes[] = {'a', 'u', 'p'};
+    for (char chPrefix : prefixes) {
+        boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+        CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+        ssKeySet << chPrefix;
+        pcursor->Seek(ssKeySet.str());
+
+        CLevelDBBatch batch;
+        size_t nErased = 0;
+        while (pcursor->Valid()) {
+            boost::this_thread::interruption_point();
+            leveldb::Slice slKey = pcursor->key();
+            if (slKey.size() == 0 || slKey[0] != chPrefix)
+                break;
+            batch.EraseRaw(slKey);
+            if (++nErased % 100000 == 0) {
+                if (!WriteBatch(batch))
+                    return false;
+                batch.Clear();
+            }
+            pcursor->Next();
+        }
+        if (!WriteBatch(batch))
+            return false;
+    }
+    return Erase('A');
+}
+
+bool CBlockTreeDB::ReadAddressIndex(const uint160& addressHash, unsigned char type, std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex, int start, int end)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    if (start > 0)
+        ssKeySet << make_pair('a', CAddressIndexIteratorKey(type, addressHash, start));
+    else
+        ssKeySet << make_pair('a', CAddressIndexIteratorKey(type, addressHash));
+    pcursor->Seek(ssKeySet.str());
+
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         try {
             leveldb::Slice slKey = pcursor->key();
             CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
             char chType;
+            CAddressIndexKey key;
             ssKey >> chType;
-            if (chType == 'b') {
-                leveldb::Slice slValue = pcursor->value();
-                CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
-                CDiskBlockIndex diskindex;
-                ssValue >> diskindex;
-
-                // Construct block index object
-                CBlockIndex* pindexNew = InsertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev = InsertBlockIndex(diskindex.hashPrev);
-                pindexNew->pnext = InsertBlockIndex(diskindex.hashNext);
-                pindexNew->nHeight = diskindex.nHeight;
-                pindexNew->nFile = diskindex.nFile;
-                pindexNew->nDataPos = diskindex.nDataPos;
-                pindexNew->nUndoPos = diskindex.nUndoPos;
-                pindexNew->nVersion = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime = diskindex.nTime;
-                pindexNew->nBits = diskindex.nBits;
-                pindexNew->nNonce = diskindex.nNonce;
-                pindexNew->nStatus = diskindex.nStatus;
-                pindexNew->nTx = diskindex.nTx;
-
-                //Proof Of Stake
-                pindexNew->nMint = diskindex.nMint;
-                pindexNew->nMoneySupply = diskindex.nMoneySupply;
-                pindexNew->nFlags = diskindex.nFlags;
-                pindexNew->nStakeModifier = diskindex.nStakeModifier;
-                pindexNew->prevoutStake = diskindex.prevoutStake;
-                pindexNew->nStakeTime = diskindex.nStakeTime;
-                pindexNew->hashProofOfStake = diskindex.hashProofOfStake;
-
-                if (pindexNew->nHeight <= Params().LAST_POW_BLOCK()) {
-                    if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits))
-                        return error("LoadBlockIndex() : CheckProofOfWork failed: %s", pindexNew->ToString());
-                }
-                // ppcoin: build setStakeSeen
-                if (pindexNew->IsProofOfStake())
-                    setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
-
-                pcursor->Next();
-            } else {
-                break; // if shutdown requested or finished loading block index
-            }
+            if (chType != 'a')
+                break;
+            ssKey >> key;
+            if (key.type != type || key.hashBytes != addressHash)
+                break;
+            if (end > 0 && key.blockHeight > end)
+                break;
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CAmount nValue;
+            ssValue >> nValue;
+            addressIndex.push_back(make_pair(key, nValue));
+            pcursor->Next();
         } catch (std::exception& e) {
             return error("%s : Deserialize or I/O error - %s", __func__, e.what());
         }
     }
+    return true;
+}
+
+bool CBlockTreeDB::ReadAddressUnspentIndex(const uint160& addressHash, unsigned char type, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& unspentOutputs)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
 
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << make_pair('u', CAddressUnspentIteratorKey(type, addressHash));
+    pcursor->Seek(ssKeySet.str());
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            CAddressUnspentKey key;
+            ssKey >> chType;
+            if (chType != 'u')
+                break;
+            ssKey >> key;
+            if (key.type != type || key.hashBytes != addressHash)
+                break;
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CAddressUnspentValue value;
+            ssValue >> value;
+            unspentOutputs.push_back(make_pair(key, value));
+            pcursor->Next();
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
     return true;
 }
+
+bool CBlockTreeDB::ReadSpentIndex(const CSpentIndexKey& key, CSpentIndexValue& value)
+{
+    return Read(make_pair('p', key), value);
+}
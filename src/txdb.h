@@ -8,15 +8,22 @@
 #ifndef BITCOIN_TXDB_H
 #define BITCOIN_TXDB_H
 
+#include "addressindex.h"
 #include "leveldbwrapper.h"
 #include "main.h"
+#include "spentindex.h"
 
 #include <map>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include <boost/scoped_ptr.hpp>
+
 class CCoins;
+class CHashWriter;
+class CSnapshotMetadata;
+class CUTXOStats;
 class uint256;
 
 //! -dbcache default (MiB)
@@ -33,15 +40,32 @@ protected:
     CLevelDBWrapper db;
 
 public:
-    CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, const std::string& strName = "chainstate");
 
     bool GetCoins(const uint256& txid, CCoins& coins) const;
     bool HaveCoins(const uint256& txid) const;
     uint256 GetBestBlock() const;
     bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
     bool GetStats(CCoinsStats& stats) const;
+    bool ForEachCoins(const boost::function<bool(const uint256&, const CCoins&)>& fn) const;
+    CCoinsViewCursor* Cursor() const;
+};
+
+/** Iterates over a snapshot of the coin database, taken by LevelDB when the iterator was made. */
+class CCoinsViewDBCursor : public CCoinsViewCursor
+{
+private:
+    boost::scoped_ptr<leveldb::Iterator> pcursor;
+
+public:
+    explicit CCoinsViewDBCursor(leveldb::Iterator* pcursorIn) : pcursor(pcursorIn) {}
+
+    bool ForEach(const boost::function<bool(const uint256&, const CCoins&)>& fn);
 };
 
+/** Add a transaction's unspent outputs to the gettxoutsetinfo statistics and their running hash. */
+void ApplyStats(CCoinsStats& stats, CHashWriter& ss, const uint256& txid, const CCoins& coins);
+
 /** Access to the block database (blocks/index/) */
 class CBlockTreeDB : public CLevelDBWrapper
 {
@@ -53,7 +77,9 @@ private:
     void operator=(const CBlockTreeDB&);
 
 public:
+    bool ReadBlockIndex(const uint256& hash, CDiskBlockIndex& blockindex);
     bool WriteBlockIndex(const CDiskBlockIndex& blockindex);
+    bool WriteBlockIndexBatch(const std::vector<std::pair<uint256, CDiskBlockIndex> >& vIndex);
     bool ReadBlockFileInfo(int nFile, CBlockFileInfo& fileinfo);
     bool WriteBlockFileInfo(int nFile, const CBlockFileInfo& fileinfo);
     bool ReadLastBlockFile(int& nFile);
@@ -67,6 +93,23 @@ public:
     bool WriteInt(const std::string& name, int nValue);
     bool ReadInt(const std::string& name, int& nValue);
     bool LoadBlockIndexGuts();
+
+    //! block a UTXO snapshot was loaded at, until the history below it is validated (-loadsnapshot)
+    bool ReadSnapshotBase(CSnapshotMetadata& metadata, uint256& hashCoins);
+    bool WriteSnapshotBase(const CSnapshotMetadata& metadata, const uint256& hashCoins);
+    bool EraseSnapshotBase();
+
+    //! the running UTXO set statistics, as of the chainstate flush they were written with
+    bool ReadUTXOStats(CUTXOStats& stats);
+    bool WriteUTXOStats(const CUTXOStats& stats);
+
+    //! address and spent indexes (-addressindex / -spentindex)
+    bool WriteAddressIndexUpdate(const CAddressIndexUpdate& update, const uint256& hashBest);
+    bool ReadAddressIndexBestBlock(uint256& hashBest);
+    bool WipeAddressIndexes();
+    bool ReadAddressIndex(const uint160& addressHash, unsigned char type, std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex, int start = 0, int end = 0);
+    bool ReadAddressUnspentIndex(const uint160& addressHash, unsigned char type, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& unspentOutputs);
+    bool ReadSpentIndex(const CSpentIndexKey& key, CSpentIndexValue& value);
 };
 
 #endif // BITCOIN_TXDB_H
@@ -0,0 +1,405 @@
+// Copyright (c) 2017-2020 The VALUTO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txposindex.h"
+
+#include "chain.h"
+#include "clientversion.h"
+#include "crypto/common.h"
+#include "main.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <string.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+
+using namespace std;
+
+CTxPosIndex* pTxPosIndex = NULL;
+
+namespace
+{
+/** On-disk layout: 64 byte header followed by nCapacity fixed-size slots. */
+const uint32_t TXPOS_MAGIC = 0x70787476; // "vtxp"
+const uint32_t TXPOS_VERSION = 1;
+const size_t TXPOS_HEADER_SIZE = 64;
+const size_t TXPOS_SLOT_SIZE = 20; // key (8) + nFile (4) + nPos (4) + nTxOffset (4)
+
+const size_t OFFSET_MAGIC = 0;
+const size_t OFFSET_VERSION = 4;
+const size_t OFFSET_CAPACITY = 8;
+const size_t OFFSET_COUNT = 16;
+const size_t OFFSET_BESTBLOCK = 24;
+
+uint64_t TxPosKey(const uint256& txid)
+{
+    // 0 marks an empty slot
+    uint64_t nKey = txid.GetLow64();
+    return nKey ? nKey : 1;
+}
+
+uint64_t FileSize(uint64_t nCapacity)
+{
+    return TXPOS_HEADER_SIZE + nCapacity * TXPOS_SLOT_SIZE;
+}
+
+void ReadSlot(const unsigned char* pslot, uint64_t& nKey, CDiskTxPos& pos)
+{
+    nKey = ReadLE64(pslot);
+    pos.nFile = ReadLE32(pslot + 8);
+    pos.nPos = ReadLE32(pslot + 12);
+    pos.nTxOffset = ReadLE32(pslot + 16);
+}
+
+void WriteSlot(unsigned char* pslot, uint64_t nKey, const CDiskTxPos& pos)
+{
+    WriteLE32(pslot + 8, pos.nFile);
+    WriteLE32(pslot + 12, pos.nPos);
+    WriteLE32(pslot + 16, pos.nTxOffset);
+    // the key goes last so a half-written slot is never seen as occupied
+    WriteLE64(pslot, nKey);
+}
+
+bool SamePos(const CDiskTxPos& a, const CDiskTxPos& b)
+{
+    return a.nFile == b.nFile && a.nPos == b.nPos && a.nTxOffset == b.nTxOffset;
+}
+} // anon namespace
+
+CTxPosIndex::CTxPosIndex(const boost::filesystem::path& path, size_t nCacheEntries, uint64_t nInitialCapacityIn) : pathIndex(path),
+                                                                                                                   nInitialCapacity(nInitialCapacityIn),
+                                                                                                                   pbegin(NULL),
+                                                                                                                   nCapacity(0),
+                                                                                                                   nCount(0),
+                                                                                                                   nMaxCacheSize(nCacheEntries),
+                                                                                                                   fSynced(false)
+{
+}
+
+CTxPosIndex::~CTxPosIndex()
+{
+    LOCK(cs);
+    Unmap();
+}
+
+bool CTxPosIndex::Map(const boost::filesystem::path& path)
+{
+    try {
+        pmapping.reset(new boost::interprocess::file_mapping(path.string().c_str(), boost::interprocess::read_write));
+        pregion.reset(new boost::interprocess::mapped_region(*pmapping, boost::interprocess::read_write));
+    } catch (const boost::interprocess::interprocess_exception& e) {
+        pregion.reset();
+        pmapping.reset();
+        return error("%s : unable to map %s - %s", __func__, path.string(), e.what());
+    }
+    pbegin = static_cast<unsigned char*>(pregion->get_address());
+    return true;
+}
+
+void CTxPosIndex::Unmap()
+{
+    if (pregion)
+        pregion->flush(0, 0, false);
+    pregion.reset();
+    pmapping.reset();
+    pbegin = NULL;
+}
+
+void CTxPosIndex::WriteHeader()
+{
+    WriteLE32(pbegin + OFFSET_MAGIC, TXPOS_MAGIC);
+    WriteLE32(pbegin + OFFSET_VERSION, TXPOS_VERSION);
+    WriteLE64(pbegin + OFFSET_CAPACITY, nCapacity);
+    WriteLE64(pbegin + OFFSET_COUNT, nCount);
+}
+
+bool CTxPosIndex::Open(bool fWipe)
+{
+    LOCK(cs);
+    Unmap();
+    listCache.clear();
+    mapCache.clear();
+    fSynced = false;
+
+    try {
+        if (fWipe && boost::filesystem::exists(pathIndex))
+            boost::filesystem::remove(pathIndex);
+
+        if (boost::filesystem::exists(pathIndex) && boost::filesystem::file_size(pathIndex) >= TXPOS_HEADER_SIZE) {
+            if (!Map(pathIndex))
+                return false;
+            nCapacity = ReadLE64(pbegin + OFFSET_CAPACITY);
+            nCount = ReadLE64(pbegin + OFFSET_COUNT);
+            if (ReadLE32(pbegin + OFFSET_MAGIC) == TXPOS_MAGIC && ReadLE32(pbegin + OFFSET_VERSION) == TXPOS_VERSION &&
+                nCapacity > 0 && pregion->get_size() >= FileSize(nCapacity)) {
+                LogPrintf("Opened tx position index with %u entries (capacity %u)\n", nCount, nCapacity);
+                return true;
+            }
+            LogPrintf("%s : tx position index is corrupt or outdated, rebuilding\n", __func__);
+            Unmap();
+            boost::filesystem::remove(pathIndex);
+        }
+
+        // Create an empty table; the file is sparse until slots are written.
+        FILE* file = fopen(pathIndex.string().c_str(), "wb");
+        if (!file)
+            return error("%s : unable to create %s", __func__, pathIndex.string());
+        fclose(file);
+        boost::filesystem::resize_file(pathIndex, FileSize(nInitialCapacity));
+    } catch (const boost::filesystem::filesystem_error& e) {
+        return error("%s : %s", __func__, e.what());
+    }
+
+    if (!Map(pathIndex))
+        return false;
+    memset(pbegin, 0, TXPOS_HEADER_SIZE);
+    nCapacity = nInitialCapacity;
+    nCount = 0;
+    WriteHeader();
+    return true;
+}
+
+void CTxPosIndex::Flush()
+{
+    LOCK(cs);
+    if (pregion)
+        pregion->flush(0, 0, false);
+}
+
+void CTxPosIndex::InsertSlot(unsigned char* pbase, uint64_t nCap, uint64_t nKey, const CDiskTxPos& pos, bool fCheckDuplicate)
+{
+    uint64_t nSlot = nKey % nCap;
+    while (true) {
+        unsigned char* pslot = pbase + TXPOS_HEADER_SIZE + nSlot * TXPOS_SLOT_SIZE;
+        uint64_t nSlotKey;
+        CDiskTxPos slotPos;
+        ReadSlot(pslot, nSlotKey, slotPos);
+        if (nSlotKey == 0) {
+            WriteSlot(pslot, nKey, pos);
+            nCount++;
+            return;
+        }
+        if (fCheckDuplicate && nSlotKey == nKey && SamePos(slotPos, pos))
+            return;
+        if (++nSlot == nCap)
+            nSlot = 0;
+    }
+}
+
+bool CTxPosIndex::Resize(uint64_t nNewCapacity)
+{
+    boost::filesystem::path pathNew = pathIndex;
+    pathNew += ".new";
+
+    try {
+        FILE* file = fopen(pathNew.string().c_str(), "wb");
+        if (!file)
+            return error("%s : unable to create %s", __func__, pathNew.string());
+        fclose(file);
+        boost::filesystem::resize_file(pathNew, FileSize(nNewCapacity));
+
+        boost::interprocess::file_mapping mappingNew(pathNew.string().c_str(), boost::interprocess::read_write);
+        boost::interprocess::mapped_region regionNew(mappingNew, boost::interprocess::read_write);
+        unsigned char* pbeginNew = static_cast<unsigned char*>(regionNew.get_address());
+
+        memcpy(pbeginNew, pbegin, TXPOS_HEADER_SIZE);
+        uint64_t nOldCount = nCount;
+        nCount = 0;
+        for (uint64_t nSlot = 0; nSlot < nCapacity; nSlot++) {
+            uint64_t nKey;
+            CDiskTxPos pos;
+            ReadSlot(pbegin + TXPOS_HEADER_SIZE + nSlot * TXPOS_SLOT_SIZE, nKey, pos);
+            if (nKey != 0)
+                InsertSlot(pbeginNew, nNewCapacity, nKey, pos, false);
+        }
+        assert(nCount == nOldCount);
+        WriteLE64(pbeginNew + OFFSET_CAPACITY, nNewCapacity);
+        WriteLE64(pbeginNew + OFFSET_COUNT, nCount);
+        regionNew.flush(0, 0, false);
+    } catch (const std::exception& e) {
+        return error("%s : %s", __func__, e.what());
+    }
+
+    Unmap();
+    if (!RenameOver(pathNew, pathIndex))
+        return error("%s : unable to rename %s", __func__, pathNew.string());
+    if (!Map(pathIndex))
+        return false;
+    nCapacity = nNewCapacity;
+    LogPrint("coindb", "%s : grew tx position index to %u slots\n", __func__, nCapacity);
+    return true;
+}
+
+bool CTxPosIndex::AddBlock(const std::vector<std::pair<uint256, CDiskTxPos> >& vPos, const CBlockIndex* pindex)
+{
+    LOCK(cs);
+    if (!pbegin)
+        return false;
+
+    // keep the load factor below 70%
+    uint64_t nNewCapacity = nCapacity;
+    while ((nCount + vPos.size()) * 10 > nNewCapacity * 7)
+        nNewCapacity *= 2;
+    if (nNewCapacity != nCapacity && !Resize(nNewCapacity))
+        return false;
+
+    for (std::vector<std::pair<uint256, CDiskTxPos> >::const_iterator it = vPos.begin(); it != vPos.end(); ++it)
+        InsertSlot(pbegin, nCapacity, TxPosKey(it->first), it->second, true);
+    WriteLE64(pbegin + OFFSET_COUNT, nCount);
+
+    if (fSynced)
+        memcpy(pbegin + OFFSET_BESTBLOCK, pindex->GetBlockHash().begin(), 32);
+    return true;
+}
+
+void CTxPosIndex::DisconnectBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    LOCK(cs);
+    // a verified position is only good while its block is in the active chain
+    for (const CTransaction& tx : block.vtx) {
+        CacheMap::iterator itCache = mapCache.find(tx.GetHash());
+        if (itCache != mapCache.end()) {
+            listCache.erase(itCache->second);
+            mapCache.erase(itCache);
+        }
+    }
+    if (pbegin && fSynced && pindex->pprev)
+        memcpy(pbegin + OFFSET_BESTBLOCK, pindex->pprev->GetBlockHash().begin(), 32);
+}
+
+bool CTxPosIndex::Lookup(const uint256& txid, std::vector<CDiskTxPos>& vPos) const
+{
+    LOCK(cs);
+    vPos.clear();
+
+    CacheMap::iterator itCache = mapCache.find(txid);
+    if (itCache != mapCache.end()) {
+        listCache.splice(listCache.begin(), listCache, itCache->second);
+        vPos.push_back(itCache->second->second);
+        return true;
+    }
+
+    if (!pbegin)
+        return false;
+
+    uint64_t nKey = TxPosKey(txid);
+    uint64_t nSlot = nKey % nCapacity;
+    while (true) {
+        uint64_t nSlotKey;
+        CDiskTxPos pos;
+        ReadSlot(pbegin + TXPOS_HEADER_SIZE + nSlot * TXPOS_SLOT_SIZE, nSlotKey, pos);
+        if (nSlotKey == 0)
+            break;
+        if (nSlotKey == nKey)
+            vPos.push_back(pos);
+        if (++nSlot == nCapacity)
+            nSlot = 0;
+    }
+    return !vPos.empty();
+}
+
+void CTxPosIndex::CacheVerified(const uint256& txid, const CDiskTxPos& pos) const
+{
+    LOCK(cs);
+    if (nMaxCacheSize == 0 || mapCache.count(txid))
+        return;
+    listCache.push_front(std::make_pair(txid, pos));
+    mapCache[txid] = listCache.begin();
+    if (listCache.size() > nMaxCacheSize) {
+        mapCache.erase(listCache.back().first);
+        listCache.pop_back();
+    }
+}
+
+uint256 CTxPosIndex::GetBestBlock() const
+{
+    LOCK(cs);
+    uint256 hashBlock;
+    if (pbegin)
+        memcpy(hashBlock.begin(), pbegin + OFFSET_BESTBLOCK, 32);
+    return hashBlock;
+}
+
+void CTxPosIndex::SetBestBlock(const uint256& hashBlock)
+{
+    LOCK(cs);
+    if (pbegin)
+        memcpy(pbegin + OFFSET_BESTBLOCK, hashBlock.begin(), 32);
+}
+
+bool CTxPosIndex::IsSynced() const
+{
+    LOCK(cs);
+    return fSynced;
+}
+
+void CTxPosIndex::SetSynced(bool fSyncedIn)
+{
+    LOCK(cs);
+    fSynced = fSyncedIn;
+}
+
+uint64_t CTxPosIndex::GetCount() const
+{
+    LOCK(cs);
+    return nCount;
+}
+
+void ThreadTxPosIndexBuild()
+{
+    if (!pTxPosIndex)
+        return;
+
+    int64_t nStart = GetTimeMillis();
+    int nBlocks = 0;
+    LogPrintf("Building tx position index in the background...\n");
+
+    while (true) {
+        boost::this_thread::interruption_point();
+
+        CBlockIndex* pindex = NULL;
+        {
+            LOCK(cs_main);
+            const CBlockIndex* pindexFork = NULL;
+            BlockMap::iterator mi = mapBlockIndex.find(pTxPosIndex->GetBestBlock());
+            if (mi != mapBlockIndex.end())
+                pindexFork = chainActive.FindFork(mi->second);
+            pindex = pindexFork ? chainActive.Next(pindexFork) : chainActive.Genesis();
+            if (!pindex) {
+                // Caught up with the tip: from now on ConnectBlock advances the best block.
+                pTxPosIndex->SetSynced(true);
+                break;
+            }
+        }
+
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex)) {
+            LogPrintf("%s : failed to read block %s, stopping\n", __func__, pindex->GetBlockHash().ToString());
+            return;
+        }
+
+        std::vector<std::pair<uint256, CDiskTxPos> > vPos;
+        vPos.reserve(block.vtx.size());
+        CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
+        for (const CTransaction& tx : block.vtx) {
+            vPos.push_back(std::make_pair(tx.GetHash(), pos));
+            pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
+        }
+        if (!pTxPosIndex->AddBlock(vPos, pindex)) {
+            LogPrintf("%s : failed to write tx position index, stopping\n", __func__);
+            return;
+        }
+        pTxPosIndex->SetBestBlock(pindex->GetBlockHash());
+
+        if (++nBlocks % 10000 == 0) {
+            pTxPosIndex->Flush();
+            LogPrintf("Tx position index: height %d (%u entries)\n", pindex->nHeight, pTxPosIndex->GetCount());
+        }
+    }
+
+    pTxPosIndex->Flush();
+    LogPrintf("Tx position index synced: %d blocks, %u entries in %dms\n", nBlocks, pTxPosIndex->GetCount(), GetTimeMillis() - nStart);
+}
@@ -0,0 +1,104 @@
+// Copyright (c) 2017-2020 The VALUTO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXPOSINDEX_H
+#define BITCOIN_TXPOSINDEX_H
+
+#include "main.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <list>
+#include <utility>
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/unordered_map.hpp>
+
+class CBlockIndex;
+
+/** -txposindex default */
+static const bool DEFAULT_TXPOSINDEX = false;
+/** -txposcache default (number of hot entries kept in memory) */
+static const unsigned int DEFAULT_TXPOSCACHE = 8192;
+/** Number of slots of a new index file; the table doubles whenever it gets 70% full */
+static const uint64_t TXPOS_INITIAL_CAPACITY = 1 << 20;
+
+/**
+ * Compact, memory-mapped txid -> (file, block offset, tx offset) index stored in
+ * blocks/txpos.dat.
+ *
+ * The file is an open-addressing hash table keyed by the low 64 bits of the txid.
+ * Prefix collisions are allowed and resolved by the caller, which reads the
+ * candidate transaction and compares its hash. A small LRU of fully verified
+ * positions keeps hot lookups (stake inputs, explorer traffic) off the table.
+ *
+ * The index can be enabled on a node that is already synced: the builder thread
+ * walks chainActive from the last indexed block while ConnectBlock keeps adding
+ * new blocks, so no reindex is needed.
+ */
+class CTxPosIndex
+{
+private:
+    mutable CCriticalSection cs;
+
+    boost::filesystem::path pathIndex;
+    const uint64_t nInitialCapacity;
+    boost::scoped_ptr<boost::interprocess::file_mapping> pmapping;
+    boost::scoped_ptr<boost::interprocess::mapped_region> pregion;
+    unsigned char* pbegin;
+    uint64_t nCapacity;
+    uint64_t nCount;
+
+    //! hot-entry LRU of verified positions
+    typedef std::list<std::pair<uint256, CDiskTxPos> > CacheList;
+    typedef boost::unordered_map<uint256, CacheList::iterator, BlockHasher> CacheMap;
+    mutable CacheList listCache;
+    mutable CacheMap mapCache;
+    size_t nMaxCacheSize;
+
+    bool fSynced;
+
+    bool Map(const boost::filesystem::path& path);
+    void Unmap();
+    bool Resize(uint64_t nNewCapacity);
+    void InsertSlot(unsigned char* pbase, uint64_t nCap, uint64_t nKey, const CDiskTxPos& pos, bool fCheckDuplicate);
+    void WriteHeader();
+
+public:
+    CTxPosIndex(const boost::filesystem::path& path, size_t nCacheEntries, uint64_t nInitialCapacityIn = TXPOS_INITIAL_CAPACITY);
+    ~CTxPosIndex();
+
+    /** Open (or create) the index file. With fWipe the previous contents are discarded. */
+    bool Open(bool fWipe = false);
+    /** Flush dirty pages of the mapping to disk. */
+    void Flush();
+
+    /** Add the positions of all transactions of a connected block and advance the best block when synced. */
+    bool AddBlock(const std::vector<std::pair<uint256, CDiskTxPos> >& vPos, const CBlockIndex* pindex);
+    /** Move the best block back after a disconnect and forget the verified positions of its transactions. Entries are kept, lookups verify them. */
+    void DisconnectBlock(const CBlock& block, const CBlockIndex* pindex);
+
+    /** Return every stored position whose key matches txid (at least one unless not found). */
+    bool Lookup(const uint256& txid, std::vector<CDiskTxPos>& vPos) const;
+    /** Remember a position that was verified against the block data. */
+    void CacheVerified(const uint256& txid, const CDiskTxPos& pos) const;
+
+    uint256 GetBestBlock() const;
+    void SetBestBlock(const uint256& hashBlock);
+    bool IsSynced() const;
+    void SetSynced(bool fSyncedIn);
+    uint64_t GetCount() const;
+};
+
+/** Global variable that points to the tx position index (NULL when -txposindex is off) */
+extern CTxPosIndex* pTxPosIndex;
+
+/** Background builder: index blocks of chainActive that are not covered yet */
+void ThreadTxPosIndexBuild();
+
+#endif // BITCOIN_TXPOSINDEX_H
@@ -0,0 +1,597 @@
+// Copyright (c) 2017-2020 The VALUTO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "utxosnapshot.h"
+
+#include "chainparams.h"
+#include "checkpoints.h"
+#include "clientversion.h"
+#include "kernel.h"
+#include "main.h"
+#include "pow.h"
+#include "txdb.h"
+#include "ui_interface.h"
+#include "util.h"
+
+#include <map>
+#include <set>
+
+#include <boost/filesystem.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+
+namespace
+{
+//! block index entries and transactions written to the databases at once while loading
+const size_t SNAPSHOT_INDEX_BATCH = 50000;
+const size_t SNAPSHOT_COINS_BATCH = 100000;
+
+//! how far ahead of the block being connected the validation downloads
+const int SNAPSHOT_DOWNLOAD_WINDOW = 256;
+const unsigned int MAX_SNAPSHOT_BLOCKS_IN_TRANSIT_PER_PEER = 8;
+//! seconds before a requested block is asked for again, maybe from another peer
+const int64_t SNAPSHOT_BLOCK_TIMEOUT = 60;
+
+//! LevelDB cache of the background chainstate, and when its coins cache is flushed
+const size_t SNAPSHOT_VALIDATION_DB_CACHE = (size_t)32 << 20;
+const unsigned int SNAPSHOT_VALIDATION_MAX_CACHE_COINS = 500000;
+const int SNAPSHOT_VALIDATION_FLUSH_INTERVAL = 5000;
+
+struct CSnapshotRequest {
+    int nHeight;
+    NodeId nodeid;
+    int64_t nTime;
+};
+
+struct CSnapshotBlock {
+    CBlock block;
+    NodeId nodeid;
+};
+
+//! Blocks for the snapshot validation. Lock order: cs_main, then csSnapshotDownload.
+boost::mutex csSnapshotDownload;
+boost::condition_variable condSnapshotBlock;
+bool fSnapshotDownload = false;
+//! the height the validation connects next, and the snapshot block
+int nSnapshotNextHeight = 0;
+int nSnapshotBaseHeight = -1;
+std::map<uint256, CSnapshotRequest> mapSnapshotRequested;
+std::map<int, CSnapshotBlock> mapSnapshotReceived;
+//! heights whose block on disk failed validation, downloaded instead
+std::set<int> setSnapshotDiskRejected;
+
+void StopSnapshotDownload()
+{
+    boost::unique_lock<boost::mutex> lock(csSnapshotDownload);
+    fSnapshotDownload = false;
+    mapSnapshotRequested.clear();
+    mapSnapshotReceived.clear();
+    setSnapshotDiskRejected.clear();
+}
+
+bool InvalidSnapshot(const std::string& strReason, std::string& strError)
+{
+    strError = strprintf(_("Invalid UTXO snapshot: %s"), strReason);
+    return false;
+}
+
+/**
+ * Read the snapshot at path. The first pass only checks it and computes its
+ * hash; with fWrite the second pass also fills the databases and returns the
+ * gettxoutsetinfo hash of its coins.
+ */
+bool ReadUTXOSnapshot(const boost::filesystem::path& path, bool fWrite, CSnapshotMetadata& metadata, uint256& hashSnapshot, uint256& hashCoins, std::string& strError)
+{
+    CAutoFile filein(fopen(path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull()) {
+        strError = strprintf(_("Cannot open UTXO snapshot %s"), path.string());
+        return false;
+    }
+    CSnapshotReader reader(filein);
+
+    try {
+        MessageStartChars pchMessageStart;
+        int nVersion;
+        reader >> FLATDATA(pchMessageStart) >> nVersion >> metadata;
+        if (memcmp(pchMessageStart, Params().MessageStart(), MESSAGE_START_SIZE) != 0)
+            return InvalidSnapshot(_("it is for another network"), strError);
+        if (nVersion != SNAPSHOT_VERSION)
+            return InvalidSnapshot(strprintf(_("unknown version %d"), nVersion), strError);
+        if (metadata.nHeight < 1)
+            return InvalidSnapshot(_("bad height"), strError);
+
+        // The block index up to the snapshot block: a chain of headers from the genesis block
+        std::vector<std::pair<uint256, CDiskBlockIndex> > vIndex;
+        uint256 hashPrev = 0;
+        for (int nHeight = 0; nHeight <= metadata.nHeight; nHeight++) {
+            CDiskBlockIndex diskindex;
+            reader >> diskindex;
+            uint256 hash = diskindex.GetBlockHash();
+            if (diskindex.nHeight != nHeight || diskindex.hashPrev != hashPrev || diskindex.nTx == 0)
+                return InvalidSnapshot(strprintf(_("broken block index at height %d"), nHeight), strError);
+            if (nHeight == 0 ? hash != Params().HashGenesisBlock() : !Checkpoints::CheckBlock(nHeight, hash))
+                return InvalidSnapshot(strprintf(_("block %d does not match the checkpoints"), nHeight), strError);
+            if (nHeight > 0 && nHeight <= Params().LAST_POW_BLOCK() && !CheckProofOfWork(hash, diskindex.nBits))
+                return InvalidSnapshot(strprintf(_("bad proof of work at height %d"), nHeight), strError);
+            hashPrev = hash;
+
+            if (!fWrite)
+                continue;
+            // The blocks aren't stored; until the background validation has seen them, they count as valid
+            diskindex.nStatus = BLOCK_VALID_SCRIPTS;
+            diskindex.nFile = 0;
+            diskindex.nDataPos = 0;
+            diskindex.nUndoPos = 0;
+            vIndex.push_back(std::make_pair(hash, diskindex));
+            if (vIndex.size() >= SNAPSHOT_INDEX_BATCH || nHeight == metadata.nHeight) {
+                if (!pblocktree->WriteBlockIndexBatch(vIndex)) {
+                    strError = _("Failed to write the block index of the UTXO snapshot");
+                    return false;
+                }
+                vIndex.clear();
+            }
+        }
+        if (hashPrev != metadata.hashBlock)
+            return InvalidSnapshot(_("its block index ends at another block"), strError);
+
+        // The coins, hashed the way gettxoutsetinfo does for the background validation to compare with
+        CCoinsStats stats;
+        CHashWriter ssCoins(SER_GETHASH, PROTOCOL_VERSION);
+        ssCoins << metadata.hashBlock;
+        CCoinsMap mapCoins;
+        uint64_t nCoins = 0;
+        uint256 txidLast = 0;
+        while (true) {
+            uint256 txid;
+            reader >> txid;
+            if (txid == 0)
+                break;
+            CCoins coins;
+            reader >> coins;
+            if ((nCoins > 0 && !CSnapshotTxidCompare()(txidLast, txid)) || coins.IsPruned())
+                return InvalidSnapshot(strprintf(_("bad transaction %s"), txid.ToString()), strError);
+            txidLast = txid;
+            nCoins++;
+
+            if (!fWrite)
+                continue;
+            ApplyStats(stats, ssCoins, txid, coins);
+            CCoinsCacheEntry& entry = mapCoins[txid];
+            entry.coins.swap(coins);
+            entry.flags = CCoinsCacheEntry::DIRTY;
+            if (mapCoins.size() >= SNAPSHOT_COINS_BATCH) {
+                if (!pcoinsTip->BatchWrite(mapCoins, uint256(0)) || !pcoinsTip->Flush()) {
+                    strError = _("Failed to write the coins of the UTXO snapshot");
+                    return false;
+                }
+                mapCoins.clear();
+            }
+        }
+        uint64_t nCoinsWritten;
+        reader >> nCoinsWritten;
+        if (nCoinsWritten != nCoins)
+            return InvalidSnapshot(_("it is truncated"), strError);
+        hashSnapshot = reader.GetHash();
+        if (!fWrite)
+            return true;
+        hashCoins = ssCoins.GetHash();
+
+        // The snapshot block becomes the best block last, which marks the chainstate as loaded.
+        // The blocks below it are never stored, so there is no transaction index for them.
+        if (!pcoinsTip->BatchWrite(mapCoins, uint256(0)) ||
+            !pblocktree->WriteFlag("prunedblockfiles", true) ||
+            !pblocktree->WriteFlag("txindex", false) ||
+            !pblocktree->WriteSnapshotBase(metadata, hashCoins)) {
+            strError = _("Failed to write the coins of the UTXO snapshot");
+            return false;
+        }
+        pcoinsTip->SetBestBlock(metadata.hashBlock);
+        if (!pcoinsTip->Flush()) {
+            strError = _("Failed to write the coins of the UTXO snapshot");
+            return false;
+        }
+        LogPrintf("Loaded UTXO snapshot at height %d: %u transactions with unspent outputs\n", metadata.nHeight, nCoins);
+    } catch (const std::exception& e) {
+        return InvalidSnapshot(strprintf(_("it is truncated or corrupt (%s)"), e.what()), strError);
+    }
+    return true;
+}
+
+bool InvalidHistoricalBlock(const CBlockIndex* pindex, const std::string& strReason, std::string& strError)
+{
+    strError = strprintf("block %s at height %d is invalid: %s", pindex->GetBlockHash().ToString(), pindex->nHeight, strReason);
+    return false;
+}
+} // namespace
+
+bool ConnectHistoricalBlock(const CBlock& block, CBlockIndex* pindex, CCoinsViewCache& view, std::string& strError)
+{
+    AssertLockHeld(cs_main);
+    CValidationState state;
+    CBlockIndex* pindexPrev = pindex->pprev;
+
+    if (block.GetHash() != pindex->GetBlockHash())
+        return InvalidHistoricalBlock(pindex, "unexpected block", strError);
+    if (pindexPrev) {
+        if (!CheckBlockContextFree(block, state) || !ContextualCheckBlock(block, state, pindexPrev))
+            return InvalidHistoricalBlock(pindex, state.GetRejectReason(), strError);
+        if (!block.CheckBlockSignature())
+            return InvalidHistoricalBlock(pindex, "bad-blocksignature", strError);
+        if (block.GetBlockTime() <= pindexPrev->GetMedianTimePast())
+            return InvalidHistoricalBlock(pindex, "time-too-old", strError);
+        if (block.nVersion < 2)
+            return InvalidHistoricalBlock(pindex, "bad-version", strError);
+        if (block.nBits != GetNextWorkRequired(pindexPrev, block.nTime, &block))
+            return InvalidHistoricalBlock(pindex, "bad-diffbits", strError);
+
+        if (block.IsProofOfStake() != pindex->IsProofOfStake())
+            return InvalidHistoricalBlock(pindex, "bad-index-flags", strError);
+        if (((pindex->nFlags & CBlockIndex::BLOCK_STAKE_ENTROPY) != 0) != (pindex->GetStakeEntropyBit() != 0))
+            return InvalidHistoricalBlock(pindex, "bad-index-entropybit", strError);
+        uint64_t nStakeModifier = 0;
+        bool fGeneratedStakeModifier = false;
+        ComputeNextStakeModifier(pindexPrev, nStakeModifier, fGeneratedStakeModifier);
+        if (nStakeModifier != pindex->nStakeModifier || fGeneratedStakeModifier != pindex->GeneratedStakeModifier())
+            return InvalidHistoricalBlock(pindex, "bad-index-stakemodifier", strError);
+
+        if (block.IsProofOfStake()) {
+            uint256 hashProofOfStake;
+            if (!CheckProofOfStake(block, hashProofOfStake, &view))
+                return InvalidHistoricalBlock(pindex, "bad-proofofstake", strError);
+            const uint256& hashProofOfStakeIndex = GetBlockIndexExtra(pindex).hashProofOfStake;
+            if (hashProofOfStakeIndex != 0 && hashProofOfStakeIndex != hashProofOfStake)
+                return InvalidHistoricalBlock(pindex, "bad-index-proofofstake", strError);
+        }
+    }
+
+    // a block that fails halfway leaves the background chainstate as it was
+    CCoinsViewCache viewBlock(&view);
+    if (!ConnectBlock(block, state, pindex, viewBlock, true, true))
+        return InvalidHistoricalBlock(pindex, state.GetRejectReason(), strError);
+    viewBlock.SetBestBlock(pindex->GetBlockHash());
+    viewBlock.Flush();
+    if (pindexPrev)
+        ReleaseBlockIndexExtra(pindexPrev);
+    return true;
+}
+
+namespace
+{
+/** Connect the blocks below the snapshot; true once they end at its UTXO set. */
+bool ValidateSnapshotHistory(const CSnapshotMetadata& metadata, const uint256& hashCoins)
+{
+    CCoinsViewDB viewDB(SNAPSHOT_VALIDATION_DB_CACHE, false, false, "chainstate_background");
+    CCoinsViewCache view(&viewDB);
+
+    int nHeight = -1;
+    {
+        LOCK(cs_main);
+        BlockMap::iterator mi = mapBlockIndex.find(view.GetBestBlock());
+        if (mi != mapBlockIndex.end()) {
+            if (!chainActive.Contains(mi->second))
+                return error("%s : the background chainstate is not on the active chain", __func__);
+            nHeight = mi->second->nHeight;
+        }
+    }
+    {
+        boost::unique_lock<boost::mutex> lock(csSnapshotDownload);
+        fSnapshotDownload = true;
+        nSnapshotNextHeight = nHeight + 1;
+        nSnapshotBaseHeight = metadata.nHeight;
+    }
+    LogPrintf("Validating the blocks below the UTXO snapshot at height %d, from height %d\n", metadata.nHeight, nHeight + 1);
+
+    // a block is connected to view under cs_main as a whole, so an interruption finds it consistent
+    try {
+        while (nHeight < metadata.nHeight) {
+            boost::this_thread::interruption_point();
+
+            CBlock block;
+            CBlockIndex* pindex;
+            bool fHaveBlock = false;
+            bool fOnDisk = false;
+            {
+                LOCK(cs_main);
+                pindex = chainActive[nHeight + 1];
+                bool fDiskRejected;
+                {
+                    boost::unique_lock<boost::mutex> lock(csSnapshotDownload);
+                    fDiskRejected = setSnapshotDiskRejected.count(pindex->nHeight) > 0;
+                }
+                if (pindex->nHeight == 0) {
+                    block = Params().GenesisBlock();
+                    fHaveBlock = true;
+                } else if (pindex->nStatus & BLOCK_HAVE_DATA && !fDiskRejected) {
+                    fHaveBlock = fOnDisk = ReadBlockFromDisk(block, pindex);
+                }
+            }
+            NodeId nodeid = -1;
+            if (!fHaveBlock) {
+                boost::unique_lock<boost::mutex> lock(csSnapshotDownload);
+                std::map<int, CSnapshotBlock>::iterator it;
+                while ((it = mapSnapshotReceived.find(pindex->nHeight)) == mapSnapshotReceived.end())
+                    condSnapshotBlock.wait(lock);
+                block = it->second.block;
+                nodeid = it->second.nodeid;
+                mapSnapshotReceived.erase(it);
+            }
+
+            bool fConnected;
+            {
+                LOCK(cs_main);
+                std::string strError;
+                fConnected = ConnectHistoricalBlock(block, pindex, view, strError);
+                if (!fConnected) {
+                    // Only the hash of the block was checked on receipt, and a peer can send a
+                    // mutated block with the right hash (duplicated transactions, another block
+                    // signature). Drop it and ask for the block again, from the network.
+                    LogPrintf("Snapshot validation: %s (peer=%d)\n", strError, nodeid);
+                    if (nodeid >= 0)
+                        Misbehaving(nodeid, 100);
+                    boost::unique_lock<boost::mutex> lock(csSnapshotDownload);
+                    if (fOnDisk)
+                        setSnapshotDiskRejected.insert(pindex->nHeight);
+                }
+            }
+            if (!fConnected)
+                continue;
+            nHeight++;
+            {
+                boost::unique_lock<boost::mutex> lock(csSnapshotDownload);
+                nSnapshotNextHeight = nHeight + 1;
+            }
+
+            if (nHeight % SNAPSHOT_VALIDATION_FLUSH_INTERVAL == 0 || view.GetCacheSize() > SNAPSHOT_VALIDATION_MAX_CACHE_COINS) {
+                if (!view.Flush())
+                    return AbortNode("Failed to write to the background chainstate");
+                LogPrintf("Snapshot validation: height=%d of %d\n", nHeight, metadata.nHeight);
+            }
+        }
+    } catch (const boost::thread_interrupted&) {
+        view.Flush();
+        StopSnapshotDownload();
+        throw;
+    }
+    StopSnapshotDownload();
+    if (!view.Flush())
+        return AbortNode("Failed to write to the background chainstate");
+
+    CCoinsStats stats;
+    {
+        LOCK(cs_main);
+        if (!viewDB.GetStats(stats))
+            return AbortNode("Failed to read the background chainstate");
+    }
+    if (stats.hashSerialized != hashCoins)
+        return AbortNode(strprintf("The UTXO set at height %d built from the blocks (%s) differs from the snapshot (%s)", metadata.nHeight, stats.hashSerialized.ToString(), hashCoins.ToString()),
+            _("The blocks below the UTXO snapshot don't lead to it, the snapshot must not be trusted. See debug.log for details."));
+    return true;
+}
+} // namespace
+
+bool DumpUTXOSnapshot(const boost::filesystem::path& path, int nHeight, CSnapshotMetadata& metadata, uint64_t& nCoins, uint256& hashSnapshot, std::string& strError)
+{
+    // Only rolling back and taking the cursor need cs_main, writing the coins doesn't
+    std::vector<uint256> vBlockHash;
+    std::map<uint256, CCoins, CSnapshotTxidCompare> mapTouched;
+    boost::scoped_ptr<CCoinsViewCursor> pcursor;
+    {
+        LOCK(cs_main);
+        CBlockIndex* pindexSnapshot = chainActive[nHeight];
+        if (!pindexSnapshot || nHeight < 1) {
+            strError = "Block height out of range";
+            return false;
+        }
+        FlushStateToDisk();
+
+        // Roll a view of the chainstate back to the snapshot block, and keep what that touched
+        CCoinsViewCache view(pcoinsTip);
+        std::set<uint256, CSnapshotTxidCompare> setTouched;
+        for (CBlockIndex* pindex = chainActive.Tip(); pindex != pindexSnapshot; pindex = pindex->pprev) {
+            CBlock block;
+            if (!ReadBlockFromDisk(block, pindex)) {
+                strError = strprintf("Block %d is not on disk", pindex->nHeight);
+                return false;
+            }
+            CValidationState state;
+            bool fClean = true;
+            if (!DisconnectBlock(block, state, pindex, view, &fClean) || !fClean) {
+                strError = strprintf("Failed to roll back block %d", pindex->nHeight);
+                return false;
+            }
+            for (const CTransaction& tx : block.vtx) {
+                setTouched.insert(tx.GetHash());
+                if (!tx.IsCoinBase())
+                    for (const CTxIn& txin : tx.vin)
+                        setTouched.insert(txin.prevout.hash);
+            }
+        }
+        for (const uint256& txid : setTouched) {
+            const CCoins* coins = view.AccessCoins(txid);
+            mapTouched[txid] = coins ? *coins : CCoins();
+        }
+
+        vBlockHash.reserve(nHeight + 1);
+        for (int nIndexHeight = 0; nIndexHeight <= nHeight; nIndexHeight++)
+            vBlockHash.push_back(chainActive[nIndexHeight]->GetBlockHash());
+        metadata = CSnapshotMetadata(pindexSnapshot->GetBlockHash(), nHeight);
+
+        // The database as it was just flushed, whatever blocks are connected meanwhile
+        pcursor.reset(pcoinsTip->Cursor());
+        if (!pcursor) {
+            strError = "Failed to read the chainstate";
+            return false;
+        }
+    }
+
+    boost::filesystem::path pathTmp = path.string() + ".incomplete";
+    CAutoFile fileout(fopen(pathTmp.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull()) {
+        strError = strprintf("Cannot open %s", pathTmp.string());
+        return false;
+    }
+    CSnapshotWriter writer(fileout);
+    nCoins = 0;
+
+    try {
+        writer << FLATDATA(Params().MessageStart()) << SNAPSHOT_VERSION << metadata;
+        for (int nIndexHeight = 0; nIndexHeight <= nHeight; nIndexHeight++) {
+            CDiskBlockIndex diskindex;
+            if (!pblocktree->ReadBlockIndex(vBlockHash[nIndexHeight], diskindex)) {
+                strError = strprintf("Failed to read the block index at height %d", nIndexHeight);
+                return false;
+            }
+            writer << diskindex;
+        }
+
+        // The database cursor and the rolled back transactions, merged in database order
+        std::map<uint256, CCoins, CSnapshotTxidCompare>::const_iterator itTouched = mapTouched.begin();
+        auto writeTouched = [&]() {
+            if (!itTouched->second.IsPruned()) {
+                writer << itTouched->first << itTouched->second;
+                nCoins++;
+            }
+            itTouched++;
+        };
+        bool fCursor = pcursor->ForEach([&](const uint256& txid, const CCoins& coins) {
+            while (itTouched != mapTouched.end() && CSnapshotTxidCompare()(itTouched->first, txid))
+                writeTouched();
+            if (itTouched != mapTouched.end() && itTouched->first == txid) {
+                writeTouched();
+            } else {
+                writer << txid << coins;
+                nCoins++;
+            }
+            return true;
+        });
+        if (!fCursor) {
+            strError = "Failed to read the chainstate";
+            return false;
+        }
+        while (itTouched != mapTouched.end())
+            writeTouched();
+        writer << uint256(0) << nCoins;
+    } catch (const std::exception& e) {
+        strError = strprintf("Failed to write %s: %s", pathTmp.string(), e.what());
+        return false;
+    }
+    hashSnapshot = writer.GetHash();
+
+    FileCommit(fileout.Get());
+    fileout.fclose();
+    if (!RenameOver(pathTmp, path)) {
+        strError = strprintf("Failed to rename %s", pathTmp.string());
+        return false;
+    }
+    LogPrintf("Wrote UTXO snapshot at height %d to %s: %u transactions, hash %s\n", nHeight, path.string(), nCoins, hashSnapshot.ToString());
+    return true;
+}
+
+bool LoadUTXOSnapshot(const boost::filesystem::path& path, std::string& strError)
+{
+    if (pcoinsTip->GetBestBlock() != uint256(0)) {
+        LogPrintf("%s : the chainstate isn't empty, -loadsnapshot=%s ignored\n", __func__, path.string());
+        return true;
+    }
+
+    // First make sure the whole snapshot is the one we trust, then load it
+    CSnapshotMetadata metadata;
+    uint256 hashSnapshot, hashCoins;
+    if (!ReadUTXOSnapshot(path, false, metadata, hashSnapshot, hashCoins, strError))
+        return false;
+
+    const CChainParams::AssumeUtxoMap& mapAssumeUtxo = Params().AssumeUtxo();
+    CChainParams::AssumeUtxoMap::const_iterator it = mapAssumeUtxo.find(metadata.nHeight);
+    bool fTrusted = it != mapAssumeUtxo.end() && it->second.first == metadata.hashBlock && it->second.second == hashSnapshot;
+    if (mapArgs.count("-assumeutxo") && uint256S(GetArg("-assumeutxo", "")) == hashSnapshot)
+        fTrusted = true;
+    if (!fTrusted) {
+        strError = strprintf(_("The UTXO snapshot at height %d has the unknown hash %s. Only load snapshots from a source you trust, with -assumeutxo=<hash>."), metadata.nHeight, hashSnapshot.ToString());
+        return false;
+    }
+
+    LogPrintf("Loading UTXO snapshot %s at height %d (%s)...\n", hashSnapshot.ToString(), metadata.nHeight, metadata.hashBlock.ToString());
+    uint256 hashSnapshotLoaded;
+    if (!ReadUTXOSnapshot(path, true, metadata, hashSnapshotLoaded, hashCoins, strError))
+        return false;
+    if (hashSnapshotLoaded != hashSnapshot) {
+        strError = _("The UTXO snapshot changed while it was loaded");
+        return false;
+    }
+    return true;
+}
+
+bool IsSnapshotValidationPending()
+{
+    CSnapshotMetadata metadata;
+    uint256 hashCoins;
+    return pblocktree->ReadSnapshotBase(metadata, hashCoins);
+}
+
+void ThreadSnapshotValidation()
+{
+    CSnapshotMetadata metadata;
+    uint256 hashCoins;
+    if (!pblocktree->ReadSnapshotBase(metadata, hashCoins))
+        return;
+
+    int64_t nStart = GetTimeMillis();
+    if (!ValidateSnapshotHistory(metadata, hashCoins))
+        return;
+
+    pblocktree->EraseSnapshotBase();
+    LogPrintf("The blocks below the UTXO snapshot at height %d are valid (%ds)\n", metadata.nHeight, (GetTimeMillis() - nStart) / 1000);
+    try {
+        boost::filesystem::remove_all(GetDataDir() / "chainstate_background");
+    } catch (const boost::filesystem::filesystem_error& e) {
+        LogPrintf("%s : %s\n", __func__, e.what());
+    }
+}
+
+void GetSnapshotBlocksToDownload(NodeId nodeid, std::vector<CInv>& vGetData)
+{
+    AssertLockHeld(cs_main);
+    boost::unique_lock<boost::mutex> lock(csSnapshotDownload);
+    if (!fSnapshotDownload)
+        return;
+
+    int64_t nNow = GetTime();
+    unsigned int nInFlight = 0;
+    for (const std::pair<const uint256, CSnapshotRequest>& item : mapSnapshotRequested)
+        if (item.second.nodeid == nodeid && item.second.nTime > nNow - SNAPSHOT_BLOCK_TIMEOUT)
+            nInFlight++;
+
+    int nEnd = std::min(nSnapshotNextHeight + SNAPSHOT_DOWNLOAD_WINDOW, nSnapshotBaseHeight + 1);
+    for (int nHeight = std::max(nSnapshotNextHeight, 1); nHeight < nEnd && nInFlight < MAX_SNAPSHOT_BLOCKS_IN_TRANSIT_PER_PEER; nHeight++) {
+        const CBlockIndex* pindex = chainActive[nHeight];
+        if (!pindex || (pindex->nStatus & BLOCK_HAVE_DATA && !setSnapshotDiskRejected.count(nHeight)) || mapSnapshotReceived.count(nHeight))
+            continue;
+        std::map<uint256, CSnapshotRequest>::iterator it = mapSnapshotRequested.find(pindex->GetBlockHash());
+        if (it != mapSnapshotRequested.end() && it->second.nTime > nNow - SNAPSHOT_BLOCK_TIMEOUT)
+            continue;
+
+        CSnapshotRequest& request = mapSnapshotRequested[pindex->GetBlockHash()];
+        request.nHeight = nHeight;
+        request.nodeid = nodeid;
+        request.nTime = nNow;
+        vGetData.push_back(CInv(MSG_BLOCK, pindex->GetBlockHash()));
+        nInFlight++;
+    }
+}
+
+bool ProcessSnapshotBlock(NodeId nodeid, const CBlock& block)
+{
+    boost::unique_lock<boost::mutex> lock(csSnapshotDownload);
+    std::map<uint256, CSnapshotRequest>::iterator it = mapSnapshotRequested.find(block.GetHash());
+    if (it == mapSnapshotRequested.end())
+        return false;
+
+    LogPrint("net", "received block %d for the snapshot validation peer=%d\n", it->second.nHeight, nodeid);
+    CSnapshotBlock& received = mapSnapshotReceived[it->second.nHeight];
+    received.block = block;
+    received.nodeid = nodeid;
+    mapSnapshotRequested.erase(it);
+    condSnapshotBlock.notify_all();
+    return true;
+}
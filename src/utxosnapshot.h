@@ -0,0 +1,161 @@
+// Copyright (c) 2017-2020 The VALUTO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_UTXOSNAPSHOT_H
+#define BITCOIN_UTXOSNAPSHOT_H
+
+#include "clientversion.h"
+#include "hash.h"
+#include "net.h"
+#include "serialize.h"
+#include "streams.h"
+#include "uint256.h"
+
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+
+class CBlock;
+class CBlockIndex;
+class CCoinsViewCache;
+class CInv;
+
+/**
+ * A UTXO snapshot lets a new node start at a recent block instead of the
+ * genesis block. The file holds, after the network magic and a version:
+ *
+ * - the metadata: hash and height of the block the snapshot was taken at;
+ * - the block index entries of the chain up to that block, in height order;
+ * - every transaction with unspent outputs at that block, as (txid, CCoins)
+ *   in the order of the chainstate database, ended by a null txid;
+ * - the number of those transactions.
+ *
+ * The double-SHA256 of all of it is the snapshot hash. A node only loads a
+ * snapshot whose hash the chain parameters or -assumeutxo vouch for, and then
+ * validates the blocks below it in the background.
+ */
+static const int SNAPSHOT_VERSION = 1;
+
+/** The block a UTXO snapshot was taken at. */
+class CSnapshotMetadata
+{
+public:
+    uint256 hashBlock;
+    int nHeight;
+
+    CSnapshotMetadata()
+    {
+        SetNull();
+    }
+
+    CSnapshotMetadata(const uint256& hashBlockIn, int nHeightIn) : hashBlock(hashBlockIn), nHeight(nHeightIn) {}
+
+    void SetNull()
+    {
+        hashBlock = 0;
+        nHeight = -1;
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(hashBlock);
+        READWRITE(nHeight);
+    }
+};
+
+/** Serializes to a snapshot file and hashes what it wrote. */
+class CSnapshotWriter
+{
+private:
+    CAutoFile& file;
+    CHashWriter hasher;
+
+public:
+    explicit CSnapshotWriter(CAutoFile& fileIn) : file(fileIn), hasher(SER_DISK, CLIENT_VERSION) {}
+
+    template <typename T>
+    CSnapshotWriter& operator<<(const T& obj)
+    {
+        file << obj;
+        hasher << obj;
+        return *this;
+    }
+
+    //! the snapshot hash; invalidates the writer
+    uint256 GetHash() { return hasher.GetHash(); }
+};
+
+/** Deserializes from a snapshot file and hashes what it read. */
+class CSnapshotReader
+{
+private:
+    CAutoFile& file;
+    CHashWriter hasher;
+
+public:
+    explicit CSnapshotReader(CAutoFile& fileIn) : file(fileIn), hasher(SER_DISK, CLIENT_VERSION) {}
+
+    template <typename T>
+    CSnapshotReader& operator>>(T& obj)
+    {
+        file >> obj;
+        hasher << obj;
+        return *this;
+    }
+
+    //! the snapshot hash; invalidates the reader
+    uint256 GetHash() { return hasher.GetHash(); }
+};
+
+/** Order of the chainstate database: txids compared as raw bytes. */
+struct CSnapshotTxidCompare {
+    bool operator()(const uint256& a, const uint256& b) const
+    {
+        return memcmp(a.begin(), b.begin(), a.size()) < 0;
+    }
+};
+
+/**
+ * Write the UTXO set as of block nHeight of the active chain to path. The
+ * chainstate is rolled back in memory to get there, which needs the block and
+ * undo files above nHeight. cs_main is only held until the chainstate is
+ * flushed and a cursor over it taken; the coins are written without it.
+ */
+bool DumpUTXOSnapshot(const boost::filesystem::path& path, int nHeight, CSnapshotMetadata& metadata, uint64_t& nCoins, uint256& hashSnapshot, std::string& strError);
+
+/**
+ * Check a block below a loaded snapshot and connect it to view, the background
+ * chainstate: what AcceptBlock and ConnectBlock check, minus what depends on the
+ * active tip, plus whether the block index fields that came with the snapshot
+ * match the block. Requires cs_main.
+ */
+bool ConnectHistoricalBlock(const CBlock& block, CBlockIndex* pindex, CCoinsViewCache& view, std::string& strError);
+
+/** Fill empty block tree and chainstate databases from the snapshot at path (-loadsnapshot). */
+bool LoadUTXOSnapshot(const boost::filesystem::path& path, std::string& strError);
+
+/** Whether the blocks below a loaded UTXO snapshot are still to be validated. */
+bool IsSnapshotValidationPending();
+
+/**
+ * Validate the blocks below a loaded UTXO snapshot in a chainstate of their
+ * own (chainstate_background/), then check that it ends at the snapshot's
+ * UTXO set. The blocks are downloaded for this and not stored. A block that
+ * fails its checks is requested again and the peer that sent it punished;
+ * only a UTXO set that doesn't match the snapshot stops the node.
+ */
+void ThreadSnapshotValidation();
+
+/** Add requests for blocks the snapshot validation waits for to vGetData (SendMessages). Requires cs_main. */
+void GetSnapshotBlocksToDownload(NodeId nodeid, std::vector<CInv>& vGetData);
+
+/** Hand a block requested by GetSnapshotBlocksToDownload to the snapshot validation. False if it wasn't requested. */
+bool ProcessSnapshotBlock(NodeId nodeid, const CBlock& block);
+
+#endif // BITCOIN_UTXOSNAPSHOT_H
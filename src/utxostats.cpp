@@ -0,0 +1,147 @@
+// Copyright (c) 2017-2020 The VALUTO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "utxostats.h"
+
+#include "clientversion.h"
+#include "coins.h"
+#include "main.h"
+#include "streams.h"
+#include "txdb.h"
+#include "undo.h"
+#include "util.h"
+
+#include <map>
+
+#include <boost/bind.hpp>
+
+CUTXOStats utxostatsTip;
+
+namespace
+{
+/** The bytes an unspent output is hashed as. */
+void SerializeOutput(CDataStream& ss, const COutPoint& out, int nHeight, bool fCoinBase, bool fCoinStake, const CTxOut& txout)
+{
+    ss.clear();
+    ss << out << nHeight << fCoinBase << fCoinStake << txout;
+}
+
+bool AddCoinsToStats(CUTXOStats* pstats, const uint256& txid, const CCoins& coins)
+{
+    pstats->AddCoins(txid, coins);
+    return true;
+}
+} // namespace
+
+void CUTXOStats::AddCoins(const uint256& txid, const CCoins& coins)
+{
+    if (coins.IsPruned())
+        return;
+    nTransactions++;
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    for (unsigned int i = 0; i < coins.vout.size(); i++) {
+        const CTxOut& txout = coins.vout[i];
+        if (txout.IsNull())
+            continue;
+        SerializeOutput(ss, COutPoint(txid, i), coins.nHeight, coins.fCoinBase, coins.fCoinStake, txout);
+        muhash.Insert((const unsigned char*)&ss[0], ss.size());
+        nTransactionOutputs++;
+        nTotalAmount += txout.nValue;
+    }
+}
+
+void CUTXOStats::RemoveCoins(const uint256& txid, const CCoins& coins)
+{
+    if (coins.IsPruned())
+        return;
+    nTransactions--;
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    for (unsigned int i = 0; i < coins.vout.size(); i++) {
+        const CTxOut& txout = coins.vout[i];
+        if (txout.IsNull())
+            continue;
+        SerializeOutput(ss, COutPoint(txid, i), coins.nHeight, coins.fCoinBase, coins.fCoinStake, txout);
+        muhash.Remove((const unsigned char*)&ss[0], ss.size());
+        nTransactionOutputs--;
+        nTotalAmount -= txout.nValue;
+    }
+}
+
+void CUTXOStats::SpendInputs(const CTransaction& tx, const CCoinsViewCache& view)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    std::map<uint256, unsigned int> mapSpent;
+    for (const CTxIn& txin : tx.vin) {
+        const COutPoint& out = txin.prevout;
+        const CCoins* coins = view.AccessCoins(out.hash);
+        assert(coins && coins->IsAvailable(out.n));
+        const CTxOut& txout = coins->vout[out.n];
+        SerializeOutput(ss, out, coins->nHeight, coins->fCoinBase, coins->fCoinStake, txout);
+        muhash.Remove((const unsigned char*)&ss[0], ss.size());
+        nTransactionOutputs--;
+        nTotalAmount -= txout.nValue;
+        mapSpent[out.hash]++;
+    }
+    // a transaction goes once tx spends all of its outputs that are left
+    for (std::map<uint256, unsigned int>::const_iterator it = mapSpent.begin(); it != mapSpent.end(); it++) {
+        const CCoins* coins = view.AccessCoins(it->first);
+        unsigned int nUnspent = 0;
+        for (const CTxOut& txout : coins->vout)
+            if (!txout.IsNull())
+                nUnspent++;
+        if (nUnspent == it->second)
+            nTransactions--;
+    }
+}
+
+void CUTXOStats::RestoreOutput(const COutPoint& out, const CTxInUndo& undo, const CCoins& coins)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    SerializeOutput(ss, out, coins.nHeight, coins.fCoinBase, coins.fCoinStake, undo.txout);
+    muhash.Insert((const unsigned char*)&ss[0], ss.size());
+    if (undo.nHeight != 0)
+        nTransactions++;
+    nTransactionOutputs++;
+    nTotalAmount += undo.txout.nValue;
+}
+
+uint256 CUTXOStats::GetHash()
+{
+    uint256 hash;
+    muhash.Finalize(hash.begin());
+    return hash;
+}
+
+void LoadUTXOStats()
+{
+    LOCK(cs_main);
+    utxostatsTip.SetNull();
+    CUTXOStats stats;
+    if (pblocktree->ReadUTXOStats(stats) && stats.hashBlock == pcoinsTip->GetBestBlock()) {
+        utxostatsTip = stats;
+        LogPrintf("Loaded UTXO set statistics at %s\n", stats.hashBlock.ToString());
+    }
+}
+
+bool GetUTXOStats(CUTXOStats& stats, uint256& hashMuHash)
+{
+    AssertLockHeld(cs_main);
+    uint256 hashBest = pcoinsTip->GetBestBlock();
+    if (hashBest == 0)
+        return false;
+    if (utxostatsTip.hashBlock != hashBest) {
+        // not kept up to date yet: count the database once
+        int64_t nStart = GetTimeMillis();
+        FlushStateToDisk();
+        CUTXOStats statsNew;
+        if (!pcoinsTip->ForEachCoins(boost::bind(AddCoinsToStats, &statsNew, _1, _2)))
+            return false;
+        statsNew.hashBlock = hashBest;
+        utxostatsTip = statsNew;
+        LogPrintf("Computed UTXO set statistics at %s in %dms\n", hashBest.ToString(), GetTimeMillis() - nStart);
+    }
+    hashMuHash = utxostatsTip.GetHash();
+    stats = utxostatsTip;
+    return true;
+}
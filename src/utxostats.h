@@ -0,0 +1,98 @@
+// Copyright (c) 2017-2020 The VALUTO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_UTXOSTATS_H
+#define BITCOIN_UTXOSTATS_H
+
+#include "amount.h"
+#include "crypto/muhash.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <stdint.h>
+
+class CCoins;
+class CCoinsViewCache;
+class COutPoint;
+class CTransaction;
+class CTxInUndo;
+
+/**
+ * Statistics of the UTXO set that are kept up to date block by block, so
+ * gettxoutsetinfo needn't scan the chainstate: the counts, the total amount
+ * and a MuHash3072 of every unspent output, as its outpoint, height, coinbase
+ * and coinstake flags and the output itself. The hash doesn't depend on the
+ * order the outputs were added in, so it is the same on every node at the
+ * same block.
+ */
+class CUTXOStats
+{
+public:
+    //! the block the statistics are for; null if they aren't known
+    uint256 hashBlock;
+    //! transactions with unspent outputs, as in the chainstate
+    uint64_t nTransactions;
+    uint64_t nTransactionOutputs;
+    CAmount nTotalAmount;
+    MuHash3072 muhash;
+
+    CUTXOStats()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        hashBlock = 0;
+        nTransactions = 0;
+        nTransactionOutputs = 0;
+        nTotalAmount = 0;
+        muhash = MuHash3072();
+    }
+
+    bool IsNull() const { return hashBlock == 0; }
+
+    //! add or remove all unspent outputs of a transaction
+    void AddCoins(const uint256& txid, const CCoins& coins);
+    void RemoveCoins(const uint256& txid, const CCoins& coins);
+
+    //! remove the outputs tx spends, before UpdateCoins spends them in view
+    void SpendInputs(const CTransaction& tx, const CCoinsViewCache& view);
+    //! add back an output that DisconnectBlock just restored into coins
+    void RestoreOutput(const COutPoint& out, const CTxInUndo& undo, const CCoins& coins);
+
+    //! the hash of the unspent outputs; folds the removals in
+    uint256 GetHash();
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(hashBlock);
+        READWRITE(nTransactions);
+        READWRITE(nTransactionOutputs);
+        READWRITE(nTotalAmount);
+        READWRITE(muhash);
+    }
+};
+
+/**
+ * The statistics at the tip (cs_main). ConnectBlock and DisconnectBlock keep
+ * them up to date from the genesis block on, or from the first GetUTXOStats,
+ * and FlushStateToDisk writes them to the block tree with the chainstate.
+ */
+extern CUTXOStats utxostatsTip;
+
+/** Pick up the statistics written with the chainstate, if they are for its best block. */
+void LoadUTXOStats();
+
+/**
+ * The statistics of the chainstate and their hash. The first call after an
+ * upgrade scans the chainstate for them; from then on they are kept up to date.
+ * Requires cs_main.
+ */
+bool GetUTXOStats(CUTXOStats& stats, uint256& hashMuHash);
+
+#endif // BITCOIN_UTXOSTATS_H
@@ -5,8 +5,18 @@
 
 #include "validationinterface.h"
 
+#include "primitives/block.h"
+
 static CMainSignals g_signals;
 
+void CValidationInterface::BlockConnected(const CBlock &block, const std::list<CTransaction> &txConflicted)
+{
+    for (const CTransaction& tx : txConflicted)
+        SyncTransaction(tx, NULL);
+    for (const CTransaction& tx : block.vtx)
+        SyncTransaction(tx, &block);
+}
+
 CMainSignals& GetMainSignals()
 {
     return g_signals;
@@ -15,7 +25,11 @@ CMainSignals& GetMainSignals()
 void RegisterValidationInterface(CValidationInterface* pwalletIn) {
     g_signals.UpdatedBlockTip.connect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1));
     g_signals.SyncTransaction.connect(boost::bind(&CValidationInterface::SyncTransaction, pwalletIn, _1, _2));
+    g_signals.BlockConnected.connect(boost::bind(&CValidationInterface::BlockConnected, pwalletIn, _1, _2));
     g_signals.NotifyTransactionLock.connect(boost::bind(&CValidationInterface::NotifyTransactionLock, pwalletIn, _1));
+    g_signals.RemovedFromMempool.connect(boost::bind(&CValidationInterface::RemovedFromMempool, pwalletIn, _1));
+    g_signals.NotifyMasternodeWinner.connect(boost::bind(&CValidationInterface::NotifyMasternodeWinner, pwalletIn, _1));
+    g_signals.NotifySporkUpdate.connect(boost::bind(&CValidationInterface::NotifySporkUpdate, pwalletIn, _1));
     g_signals.UpdatedTransaction.connect(boost::bind(&CValidationInterface::UpdatedTransaction, pwalletIn, _1));
     g_signals.SetBestChain.connect(boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
     g_signals.Inventory.connect(boost::bind(&CValidationInterface::Inventory, pwalletIn, _1));
@@ -33,7 +47,11 @@ void UnregisterValidationInterface(CValidationInterface* pwalletIn) {
     g_signals.Inventory.disconnect(boost::bind(&CValidationInterface::Inventory, pwalletIn, _1));
     g_signals.SetBestChain.disconnect(boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
     g_signals.UpdatedTransaction.disconnect(boost::bind(&CValidationInterface::UpdatedTransaction, pwalletIn, _1));
+    g_signals.NotifySporkUpdate.disconnect(boost::bind(&CValidationInterface::NotifySporkUpdate, pwalletIn, _1));
+    g_signals.NotifyMasternodeWinner.disconnect(boost::bind(&CValidationInterface::NotifyMasternodeWinner, pwalletIn, _1));
+    g_signals.RemovedFromMempool.disconnect(boost::bind(&CValidationInterface::RemovedFromMempool, pwalletIn, _1));
     g_signals.NotifyTransactionLock.disconnect(boost::bind(&CValidationInterface::NotifyTransactionLock, pwalletIn, _1));
+    g_signals.BlockConnected.disconnect(boost::bind(&CValidationInterface::BlockConnected, pwalletIn, _1, _2));
     g_signals.SyncTransaction.disconnect(boost::bind(&CValidationInterface::SyncTransaction, pwalletIn, _1, _2));
     g_signals.UpdatedBlockTip.disconnect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1));
 }
@@ -46,7 +64,11 @@ void UnregisterAllValidationInterfaces() {
     g_signals.Inventory.disconnect_all_slots();
     g_signals.SetBestChain.disconnect_all_slots();
     g_signals.UpdatedTransaction.disconnect_all_slots();
+    g_signals.NotifySporkUpdate.disconnect_all_slots();
+    g_signals.NotifyMasternodeWinner.disconnect_all_slots();
+    g_signals.RemovedFromMempool.disconnect_all_slots();
     g_signals.NotifyTransactionLock.disconnect_all_slots();
+    g_signals.BlockConnected.disconnect_all_slots();
     g_signals.SyncTransaction.disconnect_all_slots();
     g_signals.UpdatedBlockTip.disconnect_all_slots();
 }
@@ -6,13 +6,17 @@
 #ifndef BITCOIN_VALIDATIONINTERFACE_H
 #define BITCOIN_VALIDATIONINTERFACE_H
 
+#include <list>
+
 #include <boost/signals2/signal.hpp>
 #include <boost/shared_ptr.hpp>
 
 class CBlock;
 struct CBlockLocator;
 class CBlockIndex;
+class CMasternodePaymentWinner;
 class CReserveScript;
+class CSporkMessage;
 class CTransaction;
 class CValidationInterface;
 class CValidationState;
@@ -33,7 +37,12 @@ class CValidationInterface {
 protected:
     virtual void UpdatedBlockTip(const CBlockIndex *pindex) {}
     virtual void SyncTransaction(const CTransaction &tx, const CBlock *pblock) {}
+    /** The transactions a newly connected block conflicted out of the mempool, then its own; by default each goes to SyncTransaction. */
+    virtual void BlockConnected(const CBlock &block, const std::list<CTransaction> &txConflicted);
     virtual void NotifyTransactionLock(const CTransaction &tx) {}
+    virtual void RemovedFromMempool(const CTransaction &tx) {}
+    virtual void NotifyMasternodeWinner(const CMasternodePaymentWinner &winner) {}
+    virtual void NotifySporkUpdate(const CSporkMessage &spork) {}
     virtual void SetBestChain(const CBlockLocator &locator) {}
     virtual bool UpdatedTransaction(const uint256 &hash) { return false;}
     virtual void Inventory(const uint256 &hash) {}
@@ -52,8 +61,16 @@ struct CMainSignals {
     boost::signals2::signal<void (const CBlockIndex *)> UpdatedBlockTip;
     /** Notifies listeners of updated transaction data (transaction, and optionally the block it is found in. */
     boost::signals2::signal<void (const CTransaction &, const CBlock *)> SyncTransaction;
+    /** Notifies listeners of the transactions of a newly connected block, and of those it conflicted out of the mempool. */
+    boost::signals2::signal<void (const CBlock &, const std::list<CTransaction> &)> BlockConnected;
     /** Notifies listeners of an updated transaction lock without new data. */
     boost::signals2::signal<void (const CTransaction &)> NotifyTransactionLock;
+    /** Notifies listeners of a transaction leaving the memory pool, whether mined, conflicted or evicted. */
+    boost::signals2::signal<void (const CTransaction &)> RemovedFromMempool;
+    /** Notifies listeners of a new masternode payment winner vote. */
+    boost::signals2::signal<void (const CMasternodePaymentWinner &)> NotifyMasternodeWinner;
+    /** Notifies listeners of a spork taking a new value. */
+    boost::signals2::signal<void (const CSporkMessage &)> NotifySporkUpdate;
     /** Notifies listeners of an updated transaction without new data (for now: a coinbase potentially becoming visible). */
     boost::signals2::signal<bool (const uint256 &)> UpdatedTransaction;
     /** Notifies listeners of a new active block chain. */
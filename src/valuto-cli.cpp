@@ -38,6 +38,7 @@ std::string HelpMessageCli()
     strUsage += HelpMessageOpt("-rpcwait", _("Wait for RPC server to start"));
     strUsage += HelpMessageOpt("-rpcuser=<user>", _("Username for JSON-RPC connections"));
     strUsage += HelpMessageOpt("-rpcpassword=<pw>", _("Password for JSON-RPC connections"));
+    strUsage += HelpMessageOpt("-rpcwallet=<file>", _("Send wallet RPC calls to the wallet kept in <file>, when the node has loaded several"));
 
     strUsage += HelpMessageGroup(_("SSL options: (see the Bitcoin Wiki for SSL setup instructions)"));
     strUsage += HelpMessageOpt("-rpcssl", _("Use OpenSSL (https) for JSON-RPC connections"));
@@ -128,7 +129,10 @@ UniValue CallRPC(const string& strMethod, const UniValue& params)
 
     // Send request
     string strRequest = JSONRPCRequest(strMethod, params, 1);
-    string strPost = HTTPPost(strRequest, mapRequestHeaders);
+    string strURI = "/";
+    if (mapArgs.count("-rpcwallet"))
+        strURI = "/wallet/" + mapArgs["-rpcwallet"];
+    string strPost = HTTPPost(strRequest, mapRequestHeaders, strURI);
     stream << strPost << std::flush;
 
     // Receive HTTP reply status
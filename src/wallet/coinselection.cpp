@@ -0,0 +1,237 @@
+// Copyright (c) 2017-2020 The VALUTO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coinselection.h"
+
+#include "random.h"
+#include "util.h"
+#include "utilmoneystr.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace
+{
+/** Orders coins, or pointers to them, largest value first, and compares them with plain values. */
+struct CompareValueDescending {
+    bool operator()(const CInputCoin& coin, CAmount nValue) const { return coin.nValue > nValue; }
+    bool operator()(CAmount nValue, const CInputCoin& coin) const { return nValue > coin.nValue; }
+    bool operator()(const CInputCoin& a, const CInputCoin& b) const { return a.nValue > b.nValue; }
+    bool operator()(const CInputCoin* coin, CAmount nValue) const { return coin->nValue > nValue; }
+};
+
+typedef std::vector<const CInputCoin*>::const_iterator CoinIter;
+
+//! Shuffling the pool only has to break ties, which the fast generator does as well as the pool one
+int InsecureRandInt(int nMax)
+{
+    return insecure_rand() % nMax;
+}
+
+//! The first of the coins worth less than nValue
+CoinIter FirstLowerThan(const std::vector<const CInputCoin*>& vCoins, CAmount nValue)
+{
+    return std::lower_bound(vCoins.begin(), vCoins.end(), nValue - 1, CompareValueDescending());
+}
+
+void ApproximateBestSubset(CoinIter itBegin, CoinIter itEnd, const CAmount& nTotalLower, const CAmount& nTargetValue, std::vector<char>& vfBest, CAmount& nBest, int iterations)
+{
+    const size_t nCoins = itEnd - itBegin;
+    std::vector<char> vfIncluded;
+
+    vfBest.assign(nCoins, true);
+    nBest = nTotalLower;
+
+    seed_insecure_rand();
+
+    for (int nRep = 0; nRep < iterations && nBest != nTargetValue; nRep++) {
+        vfIncluded.assign(nCoins, false);
+        CAmount nTotal = 0;
+        bool fReachedTarget = false;
+        for (int nPass = 0; nPass < 2 && !fReachedTarget; nPass++) {
+            for (unsigned int i = 0; i < nCoins; i++) {
+                //The solver here uses a randomized algorithm,
+                //the randomness serves no real security purpose but is just
+                //needed to prevent degenerate behavior and it is important
+                //that the rng is fast. We do not use a constant random sequence,
+                //because there may be some privacy improvement by making
+                //the selection random.
+                if (nPass == 0 ? insecure_rand() & 1 : !vfIncluded[i]) {
+                    nTotal += itBegin[i]->nValue;
+                    vfIncluded[i] = true;
+                    if (nTotal >= nTargetValue) {
+                        fReachedTarget = true;
+                        if (nTotal < nBest) {
+                            nBest = nTotal;
+                            vfBest = vfIncluded;
+                        }
+                        nTotal -= itBegin[i]->nValue;
+                        vfIncluded[i] = false;
+                    }
+                }
+            }
+        }
+    }
+}
+} // namespace
+
+CCoinPool::CCoinPool(std::vector<CInputCoin>& vCoinsIn)
+{
+    vCoins.swap(vCoinsIn);
+
+    // equal values stay in random order, so selections don't always pick the same of them
+    seed_insecure_rand();
+    std::random_shuffle(vCoins.begin(), vCoins.end(), InsecureRandInt);
+    std::stable_sort(vCoins.begin(), vCoins.end(), CompareValueDescending());
+
+    for (size_t i = 0; i < vCoins.size(); i++) {
+        if (!boost::get<CNoDestination>(&vCoins[i].dest))
+            mapDestinations[vCoins[i].dest].push_back(i);
+    }
+}
+
+std::pair<CCoinPool::const_iterator, CCoinPool::const_iterator> CCoinPool::GetValueRange(CAmount nValue) const
+{
+    return std::equal_range(vCoins.begin(), vCoins.end(), nValue, CompareValueDescending());
+}
+
+bool SelectCoinsBnB(const std::vector<const CInputCoin*>& vCoins, const CAmount& nTargetValue, const CAmount& nCostOfChange, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet)
+{
+    setCoinsRet.clear();
+    nValueRet = 0;
+
+    // a coin worth more than the whole window can't be part of a changeless selection
+    const CoinIter itBegin = FirstLowerThan(vCoins, nTargetValue + nCostOfChange + 1);
+    const size_t nCoins = vCoins.end() - itBegin;
+
+    CAmount nAvailable = 0;
+    for (CoinIter it = itBegin; it != vCoins.end(); ++it)
+        nAvailable += (*it)->nValue;
+    if (nAvailable < nTargetValue)
+        return false;
+
+    // vfSelection holds the include/leave out choice for the coins decided so far;
+    // nAvailable is what the coins not decided yet are worth
+    std::vector<bool> vfSelection, vfBest;
+    vfSelection.reserve(nCoins);
+    CAmount nValue = 0;
+    CAmount nBestWaste = std::numeric_limits<CAmount>::max();
+
+    for (unsigned int nTries = 0; nTries < BNB_MAX_TRIES; nTries++) {
+        bool fBacktrack = false;
+        if (nValue + nAvailable < nTargetValue || nValue > nTargetValue + nCostOfChange) {
+            // this branch can no longer make the target, or overshot the window
+            fBacktrack = true;
+        } else if (nValue >= nTargetValue) {
+            if (nValue - nTargetValue < nBestWaste) {
+                vfBest = vfSelection;
+                nBestWaste = nValue - nTargetValue;
+                if (nBestWaste == 0)
+                    break;
+            }
+            // adding more coins only adds to the waste
+            fBacktrack = true;
+        }
+
+        if (fBacktrack) {
+            // go back to the last coin included and leave it out instead
+            while (!vfSelection.empty() && !vfSelection.back()) {
+                vfSelection.pop_back();
+                nAvailable += itBegin[vfSelection.size()]->nValue;
+            }
+            if (vfSelection.empty())
+                break;
+            vfSelection.back() = false;
+            nValue -= itBegin[vfSelection.size() - 1]->nValue;
+        } else {
+            const CAmount nCoinValue = itBegin[vfSelection.size()]->nValue;
+            nAvailable -= nCoinValue;
+            // including this coin after leaving out one worth the same only repeats that branch
+            if (!vfSelection.empty() && !vfSelection.back() && nCoinValue == itBegin[vfSelection.size() - 1]->nValue) {
+                vfSelection.push_back(false);
+            } else {
+                vfSelection.push_back(true);
+                nValue += nCoinValue;
+            }
+        }
+    }
+
+    if (vfBest.empty())
+        return false;
+
+    for (unsigned int i = 0; i < vfBest.size(); i++) {
+        if (vfBest[i]) {
+            setCoinsRet.insert(itBegin[i]->GetOutput());
+            nValueRet += itBegin[i]->nValue;
+        }
+    }
+    return true;
+}
+
+bool SelectCoinsKnapsack(const std::vector<const CInputCoin*>& vCoins, const CAmount& nTargetValue, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet)
+{
+    setCoinsRet.clear();
+    nValueRet = 0;
+
+    // the coins worth at least nTargetValue + CENT come first, the smallest of them last
+    const CoinIter itLower = FirstLowerThan(vCoins, nTargetValue + CENT);
+    const CInputCoin* coinLowestLarger = itLower == vCoins.begin() ? NULL : *(itLower - 1);
+
+    const CoinIter itExact = FirstLowerThan(vCoins, nTargetValue + 1);
+    if (itExact != vCoins.end() && (*itExact)->nValue == nTargetValue) {
+        setCoinsRet.insert((*itExact)->GetOutput());
+        nValueRet += nTargetValue;
+        return true;
+    }
+
+    CAmount nTotalLower = 0;
+    for (CoinIter it = itLower; it != vCoins.end(); ++it)
+        nTotalLower += (*it)->nValue;
+
+    if (nTotalLower == nTargetValue) {
+        for (CoinIter it = itLower; it != vCoins.end(); ++it) {
+            setCoinsRet.insert((*it)->GetOutput());
+            nValueRet += (*it)->nValue;
+        }
+        return true;
+    }
+
+    if (nTotalLower < nTargetValue) {
+        if (coinLowestLarger == NULL) // there is no input larger than nTargetValue
+            return false;
+        setCoinsRet.insert(coinLowestLarger->GetOutput());
+        nValueRet += coinLowestLarger->nValue;
+        return true;
+    }
+
+    // Solve subset sum by stochastic approximation
+    const size_t nCoins = vCoins.end() - itLower;
+    int iterations = KNAPSACK_ITERATIONS;
+    if (nCoins * KNAPSACK_ITERATIONS > KNAPSACK_MAX_STEPS)
+        iterations = std::max<int>(1, KNAPSACK_MAX_STEPS / nCoins);
+    std::vector<char> vfBest;
+    CAmount nBest;
+
+    ApproximateBestSubset(itLower, vCoins.end(), nTotalLower, nTargetValue, vfBest, nBest, iterations);
+    if (nBest != nTargetValue && nTotalLower >= nTargetValue + CENT)
+        ApproximateBestSubset(itLower, vCoins.end(), nTotalLower, nTargetValue + CENT, vfBest, nBest, iterations);
+
+    // If we have a bigger coin and (either the stochastic approximation didn't find a good solution,
+    //                                   or the next bigger coin is closer), return the bigger coin
+    if (coinLowestLarger &&
+        ((nBest != nTargetValue && nBest < nTargetValue + CENT) || coinLowestLarger->nValue <= nBest)) {
+        setCoinsRet.insert(coinLowestLarger->GetOutput());
+        nValueRet += coinLowestLarger->nValue;
+    } else {
+        for (unsigned int i = 0; i < nCoins; i++) {
+            if (vfBest[i]) {
+                setCoinsRet.insert(itLower[i]->GetOutput());
+                nValueRet += itLower[i]->nValue;
+            }
+        }
+        LogPrint("selectcoins", "SelectCoinsKnapsack: best subset of %u coins - total %s\n", setCoinsRet.size(), FormatMoney(nBest));
+    }
+
+    return true;
+}
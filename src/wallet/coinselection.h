@@ -0,0 +1,94 @@
+// Copyright (c) 2017-2020 The VALUTO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_WALLET_COINSELECTION_H
+#define BITCOIN_WALLET_COINSELECTION_H
+
+#include "amount.h"
+#include "script/standard.h"
+
+#include <map>
+#include <set>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+class CWalletTx;
+
+//! Most branches the branch-and-bound search walks before giving up on a changeless selection
+static const unsigned int BNB_MAX_TRIES = 100000;
+//! Most coin visits the knapsack solver spends on its random passes, whatever the pool size
+static const uint64_t KNAPSACK_MAX_STEPS = 2000000;
+//! Random passes of the knapsack solver on small pools
+static const int KNAPSACK_ITERATIONS = 1000;
+
+/** A spendable wallet output with what coin selection looks at copied out of its transaction. */
+class CInputCoin
+{
+public:
+    const CWalletTx* tx;
+    unsigned int i;
+    CAmount nValue;
+    int nDepth;
+    bool fSpendable;
+    bool fFromMe;
+    bool fDenominated;
+    //! only set when the pool is indexed by destination
+    CTxDestination dest;
+
+    CInputCoin(const CWalletTx* txIn, unsigned int iIn, CAmount nValueIn, int nDepthIn, bool fSpendableIn, bool fFromMeIn, bool fDenominatedIn)
+        : tx(txIn), i(iIn), nValue(nValueIn), nDepth(nDepthIn), fSpendable(fSpendableIn), fFromMe(fFromMeIn), fDenominated(fDenominatedIn) {}
+
+    std::pair<const CWalletTx*, unsigned int> GetOutput() const { return std::make_pair(tx, i); }
+};
+
+/**
+ * The outputs a wallet can spend, bucketed once so that every selection made
+ * for a transaction does not walk the wallet again. The coins are sorted by
+ * value, largest first, with equal values in random order; the coins of one
+ * value (an obfuscation denomination) are a range of that order, and the
+ * coins paying to each destination are indexed when asked for.
+ */
+class CCoinPool
+{
+private:
+    std::vector<CInputCoin> vCoins;
+    std::map<CTxDestination, std::vector<size_t> > mapDestinations;
+
+public:
+    typedef std::vector<CInputCoin>::const_iterator const_iterator;
+
+    CCoinPool() {}
+    explicit CCoinPool(std::vector<CInputCoin>& vCoinsIn);
+
+    const std::vector<CInputCoin>& GetCoins() const { return vCoins; }
+    bool empty() const { return vCoins.empty(); }
+    size_t size() const { return vCoins.size(); }
+
+    //! The coins worth exactly nValue
+    std::pair<const_iterator, const_iterator> GetValueRange(CAmount nValue) const;
+    //! The positions of the coins paying to each destination, empty unless the coins came with one
+    const std::map<CTxDestination, std::vector<size_t> >& GetDestinations() const { return mapDestinations; }
+};
+
+/**
+ * Look for a set of coins worth between nTargetValue and nTargetValue +
+ * nCostOfChange, so that the transaction needs no change output. vCoins must
+ * be sorted by value, largest first. The search is depth first, trying to
+ * include each coin before leaving it out, and stops after BNB_MAX_TRIES
+ * branches; the selection that overshoots the least wins.
+ */
+bool SelectCoinsBnB(const std::vector<const CInputCoin*>& vCoins, const CAmount& nTargetValue, const CAmount& nCostOfChange, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet);
+
+/**
+ * The knapsack solver the wallet has always used: an exact match, else the
+ * smallest coin worth at least nTargetValue + CENT, else a random subset of
+ * the smaller coins that makes the target with at least a cent of change.
+ * vCoins must be sorted by value, largest first. The random passes over the
+ * smaller coins are cut down on large pools so that they stay within
+ * KNAPSACK_MAX_STEPS coin visits.
+ */
+bool SelectCoinsKnapsack(const std::vector<const CInputCoin*>& vCoins, const CAmount& nTargetValue, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet);
+
+#endif // BITCOIN_WALLET_COINSELECTION_H
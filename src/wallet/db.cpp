@@ -29,6 +29,32 @@ using namespace boost;
 
 unsigned int nWalletDBUpdated;
 
+namespace
+{
+/** The writes held back by the batches open on one thread. */
+struct CThreadBatch {
+    int nDepth;
+    unsigned int nWrites;
+    std::map<std::string, CDBBatch::PendingWriteMap> mapWrites;
+
+    CThreadBatch() : nDepth(0), nWrites(0) {}
+};
+
+boost::thread_specific_ptr<CThreadBatch> pthreadBatch;
+
+//! The batch state of this thread, or NULL if it never opened a batch
+CThreadBatch* GetThreadBatch()
+{
+    return pthreadBatch.get();
+}
+
+bool IsBatchOpen()
+{
+    CThreadBatch* pbatch = GetThreadBatch();
+    return pbatch && pbatch->nDepth > 0;
+}
+} // namespace
+
 
 //
 // CDB
@@ -281,6 +307,10 @@ void CDB::Flush()
     if (activeTxn)
         return;
 
+    // an open batch checkpoints once, when it commits
+    if (IsBatchOpen())
+        return;
+
     // Flush database activity from memory pool to disk log
     unsigned int nMinutes = 0;
     if (fReadOnly)
@@ -306,6 +336,148 @@ void CDB::Close()
     }
 }
 
+bool CDB::WritePending(const CDataStream& ssKey, const CDataStream* pssValue, bool fOverwrite, bool& fRet)
+{
+    if (!IsBatchOpen() || activeTxn)
+        return false;
+    CThreadBatch& batch = *GetThreadBatch();
+
+    CSerializeData vchKey(ssKey.begin(), ssKey.end());
+    CDBBatch::PendingWriteMap& mapWrites = batch.mapWrites[strFile];
+    if (!fOverwrite) {
+        CDBBatch::PendingWriteMap::const_iterator it = mapWrites.find(vchKey);
+        bool fExists;
+        if (it != mapWrites.end()) {
+            fExists = !it->second.fErase;
+        } else {
+            Dbt datKey((void*)vchKey.data(), vchKey.size());
+            fExists = (pdb->exists(NULL, &datKey, 0) == 0);
+        }
+        if (fExists) {
+            fRet = false;
+            return true;
+        }
+    }
+
+    CDBBatch::CPendingWrite& write = mapWrites[vchKey];
+    write.fErase = (pssValue == NULL);
+    if (pssValue)
+        write.vchValue.assign(pssValue->begin(), pssValue->end());
+    else
+        write.vchValue.clear();
+    fRet = true;
+
+    if (++batch.nWrites >= DB_BATCH_MAX_WRITES)
+        fRet = CommitPending();
+    return true;
+}
+
+int CDB::ReadPending(const CDataStream& ssKey, CDataStream* pssValue)
+{
+    CThreadBatch* pbatch = GetThreadBatch();
+    if (!pbatch || pbatch->mapWrites.empty())
+        return -1;
+    map<string, CDBBatch::PendingWriteMap>::const_iterator mi = pbatch->mapWrites.find(strFile);
+    if (mi == pbatch->mapWrites.end())
+        return -1;
+    CDBBatch::PendingWriteMap::const_iterator it = mi->second.find(CSerializeData(ssKey.begin(), ssKey.end()));
+    if (it == mi->second.end())
+        return -1;
+    if (it->second.fErase)
+        return 0;
+    if (pssValue) {
+        pssValue->clear();
+        pssValue->write(it->second.vchValue.data(), it->second.vchValue.size());
+    }
+    return 1;
+}
+
+unsigned int CDB::CountPending(const std::string& strFile)
+{
+    CThreadBatch* pbatch = GetThreadBatch();
+    if (!pbatch)
+        return 0;
+    map<string, CDBBatch::PendingWriteMap>::const_iterator mi = pbatch->mapWrites.find(strFile);
+    return mi == pbatch->mapWrites.end() ? 0 : mi->second.size();
+}
+
+bool CDB::CommitPending()
+{
+    CThreadBatch* pbatch = GetThreadBatch();
+    if (!pbatch || pbatch->mapWrites.empty())
+        return true;
+
+    map<string, CDBBatch::PendingWriteMap> mapWrites;
+    mapWrites.swap(pbatch->mapWrites);
+    pbatch->nWrites = 0;
+
+    bool fSuccess = true;
+    for (map<string, CDBBatch::PendingWriteMap>::iterator mi = mapWrites.begin(); mi != mapWrites.end(); ++mi) {
+        int64_t nStart = GetTimeMillis();
+        bool fCommitted = false;
+        try {
+            CDB db(mi->first, "r+");
+            DbTxn* ptxn = db.pdb ? bitdb.TxnBegin() : NULL;
+            if (ptxn) {
+                fCommitted = true;
+                for (CDBBatch::PendingWriteMap::iterator it = mi->second.begin(); it != mi->second.end() && fCommitted; ++it) {
+                    Dbt datKey((void*)it->first.data(), it->first.size());
+                    int ret;
+                    if (it->second.fErase) {
+                        ret = db.pdb->del(ptxn, &datKey, 0);
+                        if (ret == DB_NOTFOUND)
+                            ret = 0;
+                    } else {
+                        Dbt datValue((void*)it->second.vchValue.data(), it->second.vchValue.size());
+                        ret = db.pdb->put(ptxn, &datKey, &datValue, 0);
+                    }
+                    fCommitted = (ret == 0);
+                }
+
+                if (fCommitted)
+                    fCommitted = (ptxn->commit(0) == 0);
+                else
+                    ptxn->abort();
+            }
+        } catch (const std::exception& e) {
+            LogPrintf("CDB::CommitPending : %s\n", e.what());
+        }
+
+        if (!fCommitted) {
+            LogPrintf("CDB::CommitPending : Failed to commit %u writes to %s\n", mi->second.size(), mi->first);
+            fSuccess = false;
+        }
+        LogPrint("db", "CDB::CommitPending : %u writes to %s in %dms\n", mi->second.size(), mi->first, GetTimeMillis() - nStart);
+    }
+
+    // closing the files above only checkpoints once no batch is open any more
+    if (pbatch->nDepth > 0)
+        bitdb.dbenv.txn_checkpoint(0, 0, 0);
+    return fSuccess;
+}
+
+CDBBatch::CDBBatch(bool fActiveIn) : fActive(fActiveIn)
+{
+    if (!fActive)
+        return;
+    if (!pthreadBatch.get())
+        pthreadBatch.reset(new CThreadBatch());
+    ++pthreadBatch->nDepth;
+}
+
+bool CDBBatch::Commit()
+{
+    return !fActive || CDB::CommitPending();
+}
+
+CDBBatch::~CDBBatch()
+{
+    if (!fActive)
+        return;
+    if (--pthreadBatch->nDepth == 0 && !CDB::CommitPending())
+        LogPrintf("CDBBatch : Failed to commit the wallet writes of the batch\n");
+}
+
 void CDBEnv::CloseDb(const string& strFile)
 {
     {
@@ -331,6 +503,7 @@ bool CDBEnv::RemoveDb(const string& strFile)
 
 bool CDB::Rewrite(const string& strFile, const char* pszSkip)
 {
+    CommitPending();
     while (true) {
         {
             LOCK(bitdb.cs_db);
@@ -420,6 +593,7 @@ void CDBEnv::Flush(bool fShutdown)
     LogPrint("db", "CDBEnv::Flush : Flush(%s)%s\n", fShutdown ? "true" : "false", fDbEnvInit ? "" : " database not started");
     if (!fDbEnvInit)
         return;
+    CDB::CommitPending();
     {
         LOCK(cs_db);
         map<string, int>::iterator mi = mapFileUseCount.begin();
@@ -27,7 +27,11 @@ struct CBlockLocator;
 
 extern unsigned int nWalletDBUpdated;
 
-void ThreadFlushWalletDB(const std::string& strWalletFile);
+//! Most writes an open batch holds back before they are committed anyway
+static const unsigned int DB_BATCH_MAX_WRITES = 1000;
+
+/** Flushes the wallet files to disk whenever the wallets have gone quiet for a while. */
+void ThreadFlushWalletDB(const std::vector<std::string>& vWalletFiles);
 
 
 class CDBEnv
@@ -109,11 +113,21 @@ public:
     void Flush();
     void Close();
 
+    //! Commit the writes held back by the batches open on this thread now; false if any failed
+    static bool CommitPending();
+    //! The writes to strFile the batches open on this thread hold back
+    static unsigned int CountPending(const std::string& strFile);
+
 private:
     CDB(const CDB&);
     void operator=(const CDB&);
 
 protected:
+    //! Hold a write (or an erase, with no value) back if a batch is open; fRet is the result of the write
+    bool WritePending(const CDataStream& ssKey, const CDataStream* pssValue, bool fOverwrite, bool& fRet);
+    //! Look for a write held back for the key: 1 if written (the value goes to pssValue), 0 if erased, -1 if none
+    int ReadPending(const CDataStream& ssKey, CDataStream* pssValue);
+
     template <typename K, typename T>
     bool Read(const K& key, T& value)
     {
@@ -124,6 +138,20 @@ protected:
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
+
+        // A write held back by an open batch is newer than the database
+        CDataStream ssPending(SER_DISK, CLIENT_VERSION);
+        int nPending = ReadPending(ssKey, &ssPending);
+        if (nPending >= 0) {
+            if (nPending == 0)
+                return false;
+            try {
+                ssPending >> value;
+            } catch (const std::exception&) {
+                return false;
+            }
+            return true;
+        }
         Dbt datKey(&ssKey[0], ssKey.size());
 
         // Read
@@ -166,6 +194,10 @@ protected:
         CDataStream ssValue(SER_DISK, CLIENT_VERSION);
         ssValue.reserve(10000);
         ssValue << value;
+
+        bool fRet;
+        if (WritePending(ssKey, &ssValue, fOverwrite, fRet))
+            return fRet;
         Dbt datValue(&ssValue[0], ssValue.size());
 
         // Write
@@ -189,6 +221,10 @@ protected:
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
+
+        bool fRet;
+        if (WritePending(ssKey, NULL, true, fRet))
+            return fRet;
         Dbt datKey(&ssKey[0], ssKey.size());
 
         // Erase
@@ -209,6 +245,10 @@ protected:
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
+
+        int nPending = ReadPending(ssKey, NULL);
+        if (nPending >= 0)
+            return nPending == 1;
         Dbt datKey(&ssKey[0], ssKey.size());
 
         // Exists
@@ -223,6 +263,8 @@ protected:
     {
         if (!pdb)
             return NULL;
+        // a cursor only sees what is in the database
+        CommitPending();
         Dbc* pcursor = NULL;
         int ret = pdb->cursor(NULL, &pcursor, 0);
         if (ret != 0)
@@ -272,6 +314,8 @@ public:
     {
         if (!pdb || activeTxn)
             return false;
+        // writes held back from before the transaction must not land after it
+        CommitPending();
         DbTxn* ptxn = bitdb.TxnBegin();
         if (!ptxn)
             return false;
@@ -311,4 +355,40 @@ public:
     bool static Rewrite(const std::string& strFile, const char* pszSkip = NULL);
 };
 
+
+/**
+ * RAII scope that groups the wallet database writes of one thread: while one
+ * is open, writes through CDB on this thread are held back in memory and the
+ * thread's reads see them, and when the outermost one closes they are
+ * committed in a single transaction with a single checkpoint, instead of a
+ * transaction and a checkpoint per record. Batches open on other threads
+ * don't hold back this thread's writes. Open one around work that writes
+ * many records, such as connecting a block, committing a transaction or
+ * running an RPC command, and call CDB::CommitPending before anything relies
+ * on the writes being on disk. A batch that grows past DB_BATCH_MAX_WRITES
+ * is committed early.
+ */
+class CDBBatch
+{
+private:
+    bool fActive;
+
+    CDBBatch(const CDBBatch&);
+    void operator=(const CDBBatch&);
+
+public:
+    struct CPendingWrite {
+        bool fErase;
+        CSerializeData vchValue;
+    };
+    typedef std::map<CSerializeData, CPendingWrite> PendingWriteMap;
+
+    explicit CDBBatch(bool fActiveIn = true);
+    //! A failure to commit when the outermost batch closes can only be logged; call Commit first where it matters
+    ~CDBBatch();
+
+    //! Commit the writes held back on this thread now; false if any failed. An inactive batch has nothing to commit.
+    bool Commit();
+};
+
 #endif // BITCOIN_DB_H
@@ -12,7 +12,9 @@
 #include "init.h"
 #include "net.h"
 #include "netbase.h"
+#include "rpc/jsonwriter.h"
 #include "rpc/server.h"
+#include "rpcwallet.h"
 #include "timedata.h"
 #include "util.h"
 #include "utilmoneystr.h"
@@ -22,6 +24,7 @@
 #include <stdint.h>
 
 #include <boost/assign/list_of.hpp>
+#include <boost/thread/tss.hpp>
 
 #include <univalue.h>
 
@@ -29,17 +32,39 @@ using namespace std;
 using namespace boost;
 using namespace boost::assign;
 
-int64_t nWalletUnlockTime;
 static CCriticalSection cs_nWalletUnlockTime;
 
+//! The scope only lends the wallet to the thread, the thread never owns it
+static void KeepWallet(CWallet* pwallet) {}
+
+static boost::thread_specific_ptr<CWallet> pwalletRPC(KeepWallet);
+
+CWallet* GetWalletForRPC()
+{
+    CWallet* pwallet = pwalletRPC.get();
+    return pwallet ? pwallet : pwalletMain;
+}
+
+CWalletRPCScope::CWalletRPCScope(CWallet* pwallet) : pwalletPrev(pwalletRPC.get())
+{
+    pwalletRPC.reset(pwallet);
+}
+
+CWalletRPCScope::~CWalletRPCScope()
+{
+    pwalletRPC.reset(pwalletPrev);
+}
+
 std::string HelpRequiringPassphrase()
 {
-    return pwalletMain && pwalletMain->IsCrypted() ? "\nRequires wallet passphrase to be set with walletpassphrase call." : "";
+    CWallet* const pwallet = GetWalletForRPC();
+    return pwallet && pwallet->IsCrypted() ? "\nRequires wallet passphrase to be set with walletpassphrase call." : "";
 }
 
 void EnsureWalletIsUnlocked()
 {
-    if (pwalletMain->IsLocked() || pwalletMain->fWalletUnlockAnonymizeOnly)
+    CWallet* const pwallet = GetWalletForRPC();
+    if (pwallet->IsLocked() || pwallet->fWalletUnlockAnonymizeOnly)
         throw JSONRPCError(RPC_WALLET_UNLOCK_NEEDED, "Error: Please enter the wallet passphrase with walletpassphrase first.");
 }
 
@@ -78,6 +103,7 @@ string AccountFromValue(const UniValue& value)
 
 UniValue getnewaddress(const UniValue& params, bool fHelp)
 {
+    CWallet* const pwallet = GetWalletForRPC();
     if (fHelp || params.size() > 1)
         throw runtime_error(
             "getnewaddress ( \"account\" )\n"
@@ -96,16 +122,15 @@ UniValue getnewaddress(const UniValue& params, bool fHelp)
     if (params.size() > 0)
         strAccount = AccountFromValue(params[0]);
 
-    if (!pwalletMain->IsLocked())
-        pwalletMain->TopUpKeyPool();
+    pwallet->RefillKeyPool();
 
     // Generate a new key that is added to wallet
     CPubKey newKey;
-    if (!pwalletMain->GetKeyFromPool(newKey))
+    if (!pwallet->GetKeyFromPool(newKey))
         throw JSONRPCError(RPC_WALLET_KEYPOOL_RAN_OUT, "Error: Keypool ran out, please call keypoolrefill first");
     CKeyID keyID = newKey.GetID();
 
-    pwalletMain->SetAddressBook(keyID, strAccount, "receive");
+    pwallet->SetAddressBook(keyID, strAccount, "receive");
 
     return CBitcoinAddress(keyID).ToString();
 }
@@ -113,7 +138,8 @@ UniValue getnewaddress(const UniValue& params, bool fHelp)
 
 CBitcoinAddress GetAccountAddress(string strAccount, bool bForceNew = false)
 {
-    CWalletDB walletdb(pwalletMain->strWalletFile);
+    CWallet* const pwallet = GetWalletForRPC();
+    CWalletDB walletdb(pwallet->strWalletFile);
 
     CAccount account;
     walletdb.ReadAccount(strAccount, account);
@@ -123,8 +149,8 @@ CBitcoinAddress GetAccountAddress(string strAccount, bool bForceNew = false)
     // Check if the current key has been used
     if (account.vchPubKey.IsValid()) {
         CScript scriptPubKey = GetScriptForDestination(account.vchPubKey.GetID());
-        for (map<uint256, CWalletTx>::iterator it = pwalletMain->mapWallet.begin();
-             it != pwalletMain->mapWallet.end() && account.vchPubKey.IsValid();
+        for (map<uint256, CWalletTx>::iterator it = pwallet->mapWallet.begin();
+             it != pwallet->mapWallet.end() && account.vchPubKey.IsValid();
              ++it) {
             const CWalletTx& wtx = (*it).second;
             BOOST_FOREACH (const CTxOut& txout, wtx.vout)
@@ -135,10 +161,10 @@ CBitcoinAddress GetAccountAddress(string strAccount, bool bForceNew = false)
 
     // Generate a new key
     if (!account.vchPubKey.IsValid() || bForceNew || bKeyUsed) {
-        if (!pwalletMain->GetKeyFromPool(account.vchPubKey))
+        if (!pwallet->GetKeyFromPool(account.vchPubKey))
             throw JSONRPCError(RPC_WALLET_KEYPOOL_RAN_OUT, "Error: Keypool ran out, please call keypoolrefill first");
 
-        pwalletMain->SetAddressBook(account.vchPubKey.GetID(), strAccount, "receive");
+        pwallet->SetAddressBook(account.vchPubKey.GetID(), strAccount, "receive");
         walletdb.WriteAccount(strAccount, account);
     }
 
@@ -171,6 +197,7 @@ UniValue getaccountaddress(const UniValue& params, bool fHelp)
 
 UniValue getrawchangeaddress(const UniValue& params, bool fHelp)
 {
+    CWallet* const pwallet = GetWalletForRPC();
     if (fHelp || params.size() > 1)
         throw runtime_error(
             "getrawchangeaddress\n"
@@ -181,10 +208,9 @@ UniValue getrawchangeaddress(const UniValue& params, bool fHelp)
             "\nExamples:\n" +
             HelpExampleCli("getrawchangeaddress", "") + HelpExampleRpc("getrawchangeaddress", ""));
 
-    if (!pwalletMain->IsLocked())
-        pwalletMain->TopUpKeyPool();
+    pwallet->RefillKeyPool();
 
-    CReserveKey reservekey(pwalletMain);
+    CReserveKey reservekey(pwallet);
     CPubKey vchPubKey;
     if (!reservekey.GetReservedKey(vchPubKey))
         throw JSONRPCError(RPC_WALLET_KEYPOOL_RAN_OUT, "Error: Keypool ran out, please call keypoolrefill first");
@@ -199,6 +225,7 @@ UniValue getrawchangeaddress(const UniValue& params, bool fHelp)
 
 UniValue setaccount(const UniValue& params, bool fHelp)
 {
+    CWallet* const pwallet = GetWalletForRPC();
     if (fHelp || params.size() < 1 || params.size() > 2)
         throw runtime_error(
             "setaccount \"valutoaddress\" \"account\"\n"
@@ -219,14 +246,14 @@ UniValue setaccount(const UniValue& params, bool fHelp)
         strAccount = AccountFromValue(params[1]);
 
     // Only add the account if the address is yours.
-    if (IsMine(*pwalletMain, address.Get())) {
+    if (IsMine(*pwallet, address.Get())) {
         // Detect when changing the account of an address that is the 'unused current key' of another account:
-        if (pwalletMain->mapAddressBook.count(address.Get())) {
-            string strOldAccount = pwalletMain->mapAddressBook[address.Get()].name;
+        if (pwallet->mapAddressBook.count(address.Get())) {
+            string strOldAccount = pwallet->mapAddressBook[address.Get()].name;
             if (address == GetAccountAddress(strOldAccount))
                 GetAccountAddress(strOldAccount, true);
         }
-        pwalletMain->SetAddressBook(address.Get(), strAccount, "receive");
+        pwallet->SetAddressBook(address.Get(), strAccount, "receive");
     } else
         throw JSONRPCError(RPC_MISC_ERROR, "setaccount can only be used with own address");
 
@@ -236,6 +263,7 @@ UniValue setaccount(const UniValue& params, bool fHelp)
 
 UniValue getaccount(const UniValue& params, bool fHelp)
 {
+    CWallet* const pwallet = GetWalletForRPC();
     if (fHelp || params.size() != 1)
         throw runtime_error(
             "getaccount \"valutoaddress\"\n"
@@ -252,8 +280,8 @@ UniValue getaccount(const UniValue& params, bool fHelp)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid VALUTO address");
 
     string strAccount;
-    map<CTxDestination, CAddressBookData>::iterator mi = pwalletMain->mapAddressBook.find(address.Get());
-    if (mi != pwalletMain->mapAddressBook.end() && !(*mi).second.name.empty())
+    map<CTxDestination, CAddressBookData>::iterator mi = pwallet->mapAddressBook.find(address.Get());
+    if (mi != pwallet->mapAddressBook.end() && !(*mi).second.name.empty())
         strAccount = (*mi).second.name;
     return strAccount;
 }
@@ -261,6 +289,7 @@ UniValue getaccount(const UniValue& params, bool fHelp)
 
 UniValue getaddressesbyaccount(const UniValue& params, bool fHelp)
 {
+    CWallet* const pwallet = GetWalletForRPC();
     if (fHelp || params.size() != 1)
         throw runtime_error(
             "getaddressesbyaccount \"account\"\n"
@@ -279,7 +308,7 @@ UniValue getaddressesbyaccount(const UniValue& params, bool fHelp)
 
     // Find all addresses that have the given account
     UniValue ret(UniValue::VARR);
-    BOOST_FOREACH (const PAIRTYPE(CBitcoinAddress, CAddressBookData) & item, pwalletMain->mapAddressBook) {
+    BOOST_FOREACH (const PAIRTYPE(CBitcoinAddress, CAddressBookData) & item, pwallet->mapAddressBook) {
         const CBitcoinAddress& address = item.first;
         const string& strName = item.second.name;
         if (strName == strAccount)
@@ -290,15 +319,16 @@ UniValue getaddressesbyaccount(const UniValue& params, bool fHelp)
 
 void SendMoney(const CTxDestination& address, CAmount nValue, CWalletTx& wtxNew, bool fUseIX = false)
 {
+    CWallet* const pwallet = GetWalletForRPC();
     // Check amount
     if (nValue <= 0)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid amount");
 
-    if (nValue > pwalletMain->GetBalance())
+    if (nValue > pwallet->GetBalance())
         throw JSONRPCError(RPC_WALLET_INSUFFICIENT_FUNDS, "Insufficient funds");
 
     string strError;
-    if (pwalletMain->IsLocked()) {
+    if (pwallet->IsLocked()) {
         strError = "Error: Wallet locked, unable to create transaction!";
         LogPrintf("SendMoney() : %s", strError);
         throw JSONRPCError(RPC_WALLET_ERROR, strError);
@@ -308,15 +338,15 @@ void SendMoney(const CTxDestination& address, CAmount nValue, CWalletTx& wtxNew,
     CScript scriptPubKey = GetScriptForDestination(address);
 
     // Create and send the transaction
-    CReserveKey reservekey(pwalletMain);
+    CReserveKey reservekey(pwallet);
     CAmount nFeeRequired;
-    if (!pwalletMain->CreateTransaction(scriptPubKey, nValue, wtxNew, reservekey, nFeeRequired, strError, NULL, ALL_COINS, fUseIX, (CAmount)0)) {
-        if (nValue + nFeeRequired > pwalletMain->GetBalance())
+    if (!pwallet->CreateTransaction(scriptPubKey, nValue, wtxNew, reservekey, nFeeRequired, strError, NULL, ALL_COINS, fUseIX, (CAmount)0)) {
+        if (nValue + nFeeRequired > pwallet->GetBalance())
             strError = strprintf("Error: This transaction requires a transaction fee of at least %s because of its amount, complexity, or use of recently received funds!", FormatMoney(nFeeRequired));
         LogPrintf("SendMoney() : %s\n", strError);
         throw JSONRPCError(RPC_WALLET_ERROR, strError);
     }
-    if (!pwalletMain->CommitTransaction(wtxNew, reservekey, (!fUseIX ? "tx" : "ix")))
+    if (!pwallet->CommitTransaction(wtxNew, reservekey, (!fUseIX ? "tx" : "ix")))
         throw JSONRPCError(RPC_WALLET_ERROR, "Error: The transaction was rejected! This might happen if some of the coins in your wallet were already spent, such as if you used a copy of wallet.dat and coins were spent in the copy but not marked as spent here.");
 }
 
@@ -404,6 +434,7 @@ UniValue sendtoaddressix(const UniValue& params, bool fHelp)
 
 UniValue listaddressgroupings(const UniValue& params, bool fHelp)
 {
+    CWallet* const pwallet = GetWalletForRPC();
     if (fHelp)
         throw runtime_error(
             "listaddressgroupings\n"
@@ -426,17 +457,17 @@ UniValue listaddressgroupings(const UniValue& params, bool fHelp)
             HelpExampleCli("listaddressgroupings", "") + HelpExampleRpc("listaddressgroupings", ""));
 
     UniValue jsonGroupings(UniValue::VARR);
-    map<CTxDestination, CAmount> balances = pwalletMain->GetAddressBalances();
-    BOOST_FOREACH (set<CTxDestination> grouping, pwalletMain->GetAddressGroupings()) {
+    map<CTxDestination, CAmount> balances = pwallet->GetAddressBalances();
+    BOOST_FOREACH (set<CTxDestination> grouping, pwallet->GetAddressGroupings()) {
         UniValue jsonGrouping(UniValue::VARR);
         BOOST_FOREACH (CTxDestination address, grouping) {
             UniValue addressInfo(UniValue::VARR);
             addressInfo.push_back(CBitcoinAddress(address).ToString());
             addressInfo.push_back(ValueFromAmount(balances[address]));
             {
-                LOCK(pwalletMain->cs_wallet);
-                if (pwalletMain->mapAddressBook.find(CBitcoinAddress(address).Get()) != pwalletMain->mapAddressBook.end())
-                    addressInfo.push_back(pwalletMain->mapAddressBook.find(CBitcoinAddress(address).Get())->second.name);
+                LOCK(pwallet->cs_wallet);
+                if (pwallet->mapAddressBook.find(CBitcoinAddress(address).Get()) != pwallet->mapAddressBook.end())
+                    addressInfo.push_back(pwallet->mapAddressBook.find(CBitcoinAddress(address).Get())->second.name);
             }
             jsonGrouping.push_back(addressInfo);
         }
@@ -447,6 +478,7 @@ UniValue listaddressgroupings(const UniValue& params, bool fHelp)
 
 UniValue signmessage(const UniValue& params, bool fHelp)
 {
+    CWallet* const pwallet = GetWalletForRPC();
     if (fHelp || params.size() != 2)
         throw runtime_error(
             "signmessage \"valutoaddress\" \"message\"\n"
@@ -478,7 +510,7 @@ UniValue signmessage(const UniValue& params, bool fHelp)
         throw JSONRPCError(RPC_TYPE_ERROR, "Address does not refer to key");
 
     CKey key;
-    if (!pwalletMain->GetKey(keyID, key))
+    if (!pwallet->GetKey(keyID, key))
         throw JSONRPCError(RPC_WALLET_ERROR, "Private key not available");
 
     CHashWriter ss(SER_GETHASH, 0);
@@ -494,6 +526,7 @@ UniValue signmessage(const UniValue& params, bool fHelp)
 
 UniValue getreceivedbyaddress(const UniValue& params, bool fHelp)
 {
+    CWallet* const pwallet = GetWalletForRPC();
     if (fHelp || params.size() < 1 || params.size() > 2)
         throw runtime_error(
             "getreceivedbyaddress \"valutoaddress\" ( minconf )\n"
@@ -515,7 +548,7 @@ UniValue getreceivedbyaddress(const UniValue& params, bool fHelp)
     if (!address.IsValid())
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid VALUTO address");
     CScript scriptPubKey = GetScriptForDestination(address.Get());
-    if (!IsMine(*pwalletMain, scriptPubKey))
+    if (!IsMine(*pwallet, scriptPubKey))
         return (double)0.0;
 
     // Minimum confirmations
@@ -525,7 +558,7 @@ UniValue getreceivedbyaddress(const UniValue& params, bool fHelp)
 
     // Tally
     CAmount nAmount = 0;
-    for (map<uint256, CWalletTx>::iterator it = pwalletMain->mapWallet.begin(); it != pwalletMain->mapWallet.end(); ++it) {
+    for (map<uint256, CWalletTx>::iterator it = pwallet->mapWallet.begin(); it != pwallet->mapWallet.end(); ++it) {
         const CWalletTx& wtx = (*it).second;
         if (wtx.IsCoinBase() || !IsFinalTx(wtx))
             continue;
@@ -542,6 +575,7 @@ UniValue getreceivedbyaddress(const UniValue& params, bool fHelp)
 
 UniValue getreceivedbyaccount(const UniValue& params, bool fHelp)
 {
+    CWallet* const pwallet = GetWalletForRPC();
     if (fHelp || params.size() < 1 || params.size() > 2)
         throw runtime_error(
             "getreceivedbyaccount \"account\" ( minconf )\n"
@@ -565,18 +599,18 @@ UniValue getreceivedbyaccount(const UniValue& params, bool fHelp)
 
     // Get the set of pub keys assigned to account
     string strAccount = AccountFromValue(params[0]);
-    set<CTxDestination> setAddress = pwalletMain->GetAccountAddresses(strAccount);
+    set<CTxDestination> setAddress = pwallet->GetAccountAddresses(strAccount);
 
     // Tally
     CAmount nAmount = 0;
-    for (map<uint256, CWalletTx>::iterator it = pwalletMain->mapWallet.begin(); it != pwalletMain->mapWallet.end(); ++it) {
+    for (map<uint256, CWalletTx>::iterator it = pwallet->mapWallet.begin(); it != pwallet->mapWallet.end(); ++it) {
         const CWalletTx& wtx = (*it).second;
         if (wtx.IsCoinBase() || !IsFinalTx(wtx))
             continue;
 
         BOOST_FOREACH (const CTxOut& txout, wtx.vout) {
             CTxDestination address;
-            if (ExtractDestination(txout.scriptPubKey, address) && IsMine(*pwalletMain, address) && setAddress.count(address))
+            if (ExtractDestination(txout.scriptPubKey, address) && IsMine(*pwallet, address) && setAddress.count(address))
                 if (wtx.GetDepthInMainChain() >= nMinDepth)
                     nAmount += txout.nValue;
         }
@@ -588,10 +622,11 @@ UniValue getreceivedbyaccount(const UniValue& params, bool fHelp)
 
 CAmount GetAccountBalance(CWalletDB& walletdb, const string& strAccount, int nMinDepth, const isminefilter& filter)
 {
+    CWallet* const pwallet = GetWalletForRPC();
     CAmount nBalance = 0;
 
     // Tally wallet transactions
-    for (map<uint256, CWalletTx>::iterator it = pwalletMain->mapWallet.begin(); it != pwalletMain->mapWallet.end(); ++it) {
+    for (map<uint256, CWalletTx>::iterator it = pwallet->mapWallet.begin(); it != pwallet->mapWallet.end(); ++it) {
         const CWalletTx& wtx = (*it).second;
         if (!IsFinalTx(wtx) || wtx.GetBlocksToMaturity() > 0 || wtx.GetDepthInMainChain() < 0)
             continue;
@@ -612,13 +647,15 @@ CAmount GetAccountBalance(CWalletDB& walletdb, const string& strAccount, int nMi
 
 CAmount GetAccountBalance(const string& strAccount, int nMinDepth, const isminefilter& filter)
 {
-    CWalletDB walletdb(pwalletMain->strWalletFile);
+    CWallet* const pwallet = GetWalletForRPC();
+    CWalletDB walletdb(pwallet->strWalletFile);
     return GetAccountBalance(walletdb, strAccount, nMinDepth, filter);
 }
 
 
 UniValue getbalance(const UniValue& params, bool fHelp)
 {
+    CWallet* const pwallet = GetWalletForRPC();
     if (fHelp || params.size() > 3)
         throw runtime_error(
             "getbalance ( \"account\" minconf includeWatchonly )\n"
@@ -641,7 +678,7 @@ UniValue getbalance(const UniValue& params, bool fHelp)
             "\nAs a json rpc call\n" + HelpExampleRpc("getbalance", "\"tabby\", 6"));
 
     if (params.size() == 0)
-        return ValueFromAmount(pwalletMain->GetBalance());
+        return ValueFromAmount(pwallet->GetBalance());
 
     int nMinDepth = 1;
     if (params.size() > 1)
@@ -656,7 +693,7 @@ UniValue getbalance(const UniValue& params, bool fHelp)
         // (GetBalance() sums up all unspent TxOuts)
         // getbalance and "getbalance * 1 true" should return the same number
         CAmount nBalance = 0;
-        for (map<uint256, CWalletTx>::iterator it = pwalletMain->mapWallet.begin(); it != pwalletMain->mapWallet.end(); ++it) {
+        for (map<uint256, CWalletTx>::iterator it = pwallet->mapWallet.begin(); it != pwallet->mapWallet.end(); ++it) {
             const CWalletTx& wtx = (*it).second;
             if (!IsFinalTx(wtx) || wtx.GetBlocksToMaturity() > 0 || wtx.GetDepthInMainChain() < 0)
                 continue;
@@ -686,16 +723,18 @@ UniValue getbalance(const UniValue& params, bool fHelp)
 
 UniValue getunconfirmedbalance(const UniValue &params, bool fHelp)
 {
+    CWallet* const pwallet = GetWalletForRPC();
     if (fHelp || params.size() > 0)
         throw runtime_error(
             "getunconfirmedbalance\n"
             "Returns the server's total unconfirmed balance\n");
-    return ValueFromAmount(pwalletMain->GetUnconfirmedBalance());
+    return ValueFromAmount(pwallet->GetUnconfirmedBalance());
 }
 
 
 UniValue movecmd(const UniValue& params, bool fHelp)
 {
+    CWallet* const pwallet = GetWalletForRPC();
     if (fHelp || params.size() < 3 || params.size() > 5)
         throw runtime_error(
             "move \"fromaccount\" \"toaccount\" amount ( minconf \"comment\" )\n"
@@ -723,7 +762,7 @@ UniValue movecmd(const UniValue& params, bool fHelp)
     if (params.size() > 4)
         strComment = params[4].get_str();
 
-    CWalletDB walletdb(pwalletMain->strWalletFile);
+    CWalletDB walletdb(pwallet->strWalletFile);
     if (!walletdb.TxnBegin())
         throw JSONRPCError(RPC_DATABASE_ERROR, "database error");
 
@@ -731,7 +770,7 @@ UniValue movecmd(const UniValue& params, bool fHelp)
 
     // Debit
     CAccountingEntry debit;
-    debit.nOrderPos = pwalletMain->IncOrderPosNext(&walletdb);
+    debit.nOrderPos = pwallet->IncOrderPosNext(&walletdb);
     debit.strAccount = strFrom;
     debit.nCreditDebit = -nAmount;
     debit.nTime = nNow;
@@ -741,7 +780,7 @@ UniValue movecmd(const UniValue& params, bool fHelp)
 
     // Credit
     CAccountingEntry credit;
-    credit.nOrderPos = pwalletMain->IncOrderPosNext(&walletdb);
+    credit.nOrderPos = pwallet->IncOrderPosNext(&walletdb);
     credit.strAccount = strTo;
     credit.nCreditDebit = nAmount;
     credit.nTime = nNow;
@@ -813,6 +852,7 @@ UniValue sendfrom(const UniValue& params, bool fHelp)
 
 UniValue sendmany(const UniValue& params, bool fHelp)
 {
+    CWallet* const pwallet = GetWalletForRPC();
     if (fHelp || params.size() < 2 || params.size() > 4)
         throw runtime_error(
             "sendmany \"fromaccount\" {\"address\":amount,...} ( minconf \"comment\" )\n"
@@ -876,13 +916,13 @@ UniValue sendmany(const UniValue& params, bool fHelp)
         throw JSONRPCError(RPC_WALLET_INSUFFICIENT_FUNDS, "Account has insufficient funds");
 
     // Send
-    CReserveKey keyChange(pwalletMain);
+    CReserveKey keyChange(pwallet);
     CAmount nFeeRequired = 0;
     string strFailReason;
-    bool fCreated = pwalletMain->CreateTransaction(vecSend, wtx, keyChange, nFeeRequired, strFailReason);
+    bool fCreated = pwallet->CreateTransaction(vecSend, wtx, keyChange, nFeeRequired, strFailReason);
     if (!fCreated)
         throw JSONRPCError(RPC_WALLET_INSUFFICIENT_FUNDS, strFailReason);
-    if (!pwalletMain->CommitTransaction(wtx, keyChange))
+    if (!pwallet->CommitTransaction(wtx, keyChange))
         throw JSONRPCError(RPC_WALLET_ERROR, "Transaction commit failed");
 
     return wtx.GetHash().GetHex();
@@ -893,6 +933,7 @@ extern CScript _createmultisig_redeemScript(const UniValue& params);
 
 UniValue addmultisigaddress(const UniValue& params, bool fHelp)
 {
+    CWallet* const pwallet = GetWalletForRPC();
     if (fHelp || params.size() < 2 || params.size() > 3) {
         string msg = "addmultisigaddress nrequired [\"key\",...] ( \"account\" )\n"
                      "\nAdd a nrequired-to-sign multisignature address to the wallet.\n"
@@ -925,9 +966,9 @@ UniValue addmultisigaddress(const UniValue& params, bool fHelp)
     // Construct using pay-to-script-hash:
     CScript inner = _createmultisig_redeemScript(params);
     CScriptID innerID(inner);
-    pwalletMain->AddCScript(inner);
+    pwallet->AddCScript(inner);
 
-    pwalletMain->SetAddressBook(innerID, strAccount, "send");
+    pwallet->SetAddressBook(innerID, strAccount, "send");
     return CBitcoinAddress(innerID).ToString();
 }
 
@@ -949,6 +990,7 @@ struct tallyitem {
 
 UniValue ListReceived(const UniValue& params, bool fByAccounts)
 {
+    CWallet* const pwallet = GetWalletForRPC();
     // Minimum confirmations
     int nMinDepth = 1;
     if (params.size() > 0)
@@ -966,7 +1008,7 @@ UniValue ListReceived(const UniValue& params, bool fByAccounts)
 
     // Tally
     map<CBitcoinAddress, tallyitem> mapTally;
-    for (map<uint256, CWalletTx>::iterator it = pwalletMain->mapWallet.begin(); it != pwalletMain->mapWallet.end(); ++it) {
+    for (map<uint256, CWalletTx>::iterator it = pwallet->mapWallet.begin(); it != pwallet->mapWallet.end(); ++it) {
         const CWalletTx& wtx = (*it).second;
 
         if (wtx.IsCoinBase() || !IsFinalTx(wtx))
@@ -982,7 +1024,7 @@ UniValue ListReceived(const UniValue& params, bool fByAccounts)
             if (!ExtractDestination(txout.scriptPubKey, address))
                 continue;
 
-            isminefilter mine = IsMine(*pwalletMain, address);
+            isminefilter mine = IsMine(*pwallet, address);
             if (!(mine & filter))
                 continue;
 
@@ -999,7 +1041,7 @@ UniValue ListReceived(const UniValue& params, bool fByAccounts)
     // Reply
     UniValue ret(UniValue::VARR);
     map<string, tallyitem> mapAccountTally;
-    BOOST_FOREACH (const PAIRTYPE(CBitcoinAddress, CAddressBookData) & item, pwalletMain->mapAddressBook) {
+    BOOST_FOREACH (const PAIRTYPE(CBitcoinAddress, CAddressBookData) & item, pwallet->mapAddressBook) {
         const CBitcoinAddress& address = item.first;
         const string& strAccount = item.second.name;
         map<CBitcoinAddress, tallyitem>::iterator it = mapTally.find(address);
@@ -1130,6 +1172,7 @@ static void MaybePushAddress(UniValue & entry, const CTxDestination &dest)
 
 void ListTransactions(const CWalletTx& wtx, const string& strAccount, int nMinDepth, bool fLong, UniValue& ret, const isminefilter& filter)
 {
+    CWallet* const pwallet = GetWalletForRPC();
     CAmount nFee;
     string strSentAccount;
     list<COutputEntry> listReceived;
@@ -1144,7 +1187,7 @@ void ListTransactions(const CWalletTx& wtx, const string& strAccount, int nMinDe
     if ((!listSent.empty() || nFee != 0) && (fAllAccounts || strAccount == strSentAccount)) {
         BOOST_FOREACH (const COutputEntry& s, listSent) {
             UniValue entry(UniValue::VOBJ);
-            if (involvesWatchonly || (::IsMine(*pwalletMain, s.destination) & ISMINE_WATCH_ONLY))
+            if (involvesWatchonly || (::IsMine(*pwallet, s.destination) & ISMINE_WATCH_ONLY))
                 entry.push_back(Pair("involvesWatchonly", true));
             entry.push_back(Pair("account", strSentAccount));
             MaybePushAddress(entry, s.destination);
@@ -1163,11 +1206,11 @@ void ListTransactions(const CWalletTx& wtx, const string& strAccount, int nMinDe
     if (listReceived.size() > 0 && wtx.GetDepthInMainChain() >= nMinDepth) {
         BOOST_FOREACH (const COutputEntry& r, listReceived) {
             string account;
-            if (pwalletMain->mapAddressBook.count(r.destination))
-                account = pwalletMain->mapAddressBook[r.destination].name;
+            if (pwallet->mapAddressBook.count(r.destination))
+                account = pwallet->mapAddressBook[r.destination].name;
             if (fAllAccounts || (account == strAccount)) {
                 UniValue entry(UniValue::VOBJ);
-                if (involvesWatchonly || (::IsMine(*pwalletMain, r.destination) & ISMINE_WATCH_ONLY))
+                if (involvesWatchonly || (::IsMine(*pwallet, r.destination) & ISMINE_WATCH_ONLY))
                     entry.push_back(Pair("involvesWatchonly", true));
                 entry.push_back(Pair("account", account));
                 MaybePushAddress(entry, r.destination);
@@ -1191,6 +1234,35 @@ void ListTransactions(const CWalletTx& wtx, const string& strAccount, int nMinDe
     }
 }
 
+/** The number of entries ListTransactions gives for wtx, counted without building them */
+static int CountListTransactions(const CWalletTx& wtx, const string& strAccount, int nMinDepth, const isminefilter& filter)
+{
+    CWallet* const pwallet = GetWalletForRPC();
+    CAmount nFee;
+    string strSentAccount;
+    list<COutputEntry> listReceived;
+    list<COutputEntry> listSent;
+
+    wtx.GetAmounts(listReceived, listSent, nFee, strSentAccount, filter);
+
+    bool fAllAccounts = (strAccount == string("*"));
+    int nEntries = 0;
+    if ((!listSent.empty() || nFee != 0) && (fAllAccounts || strAccount == strSentAccount))
+        nEntries += listSent.size();
+    if (listReceived.size() > 0 && wtx.GetDepthInMainChain() >= nMinDepth) {
+        BOOST_FOREACH (const COutputEntry& r, listReceived) {
+            if (fAllAccounts) {
+                nEntries++;
+                continue;
+            }
+            std::map<CTxDestination, CAddressBookData>::const_iterator mi = pwallet->mapAddressBook.find(r.destination);
+            if ((mi != pwallet->mapAddressBook.end() ? mi->second.name : string()) == strAccount)
+                nEntries++;
+        }
+    }
+    return nEntries;
+}
+
 void AcentryToJSON(const CAccountingEntry& acentry, const string& strAccount, UniValue& ret)
 {
     bool fAllAccounts = (strAccount == string("*"));
@@ -1207,8 +1279,9 @@ void AcentryToJSON(const CAccountingEntry& acentry, const string& strAccount, Un
     }
 }
 
-UniValue listtransactions(const UniValue& params, bool fHelp)
+void listtransactions_stream(const UniValue& params, bool fHelp, CJSONWriter& writer)
 {
+    CWallet* const pwallet = GetWalletForRPC();
     if (fHelp || params.size() > 4)
         throw runtime_error(
             "listtransactions ( \"account\" count from includeWatchonly)\n"
@@ -1281,50 +1354,74 @@ UniValue listtransactions(const UniValue& params, bool fHelp)
     if (nFrom < 0)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative from");
 
-    UniValue ret(UniValue::VARR);
-
+    // The items are walked newest to oldest, which gives the entries in the reverse of the order
+    // they are returned in. The first pass only counts the entries of each item, without
+    // building them, so that the second can build them oldest first, a batch of items at a
+    // time under cs_main and cs_wallet, and write each batch once the locks are released.
     std::list<CAccountingEntry> acentries;
-    CWallet::TxItems txOrdered = pwalletMain->OrderedTxItems(acentries, strAccount);
-
-    // iterate backwards until we have nCount items to return:
-    for (CWallet::TxItems::reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend(); ++it) {
-        CWalletTx* const pwtx = (*it).second.first;
-        if (pwtx != 0)
-            ListTransactions(*pwtx, strAccount, 0, true, ret, filter);
-        CAccountingEntry* const pacentry = (*it).second.second;
-        if (pacentry != 0)
-            AcentryToJSON(*pacentry, strAccount, ret);
-
-        if ((int)ret.size() >= (nCount + nFrom)) break;
+    std::vector<std::pair<CWallet::TxPair, int> > vItems;
+    std::vector<uint256> vItemTx;
+    int nEntries = 0;
+    {
+        LOCK2(cs_main, pwallet->cs_wallet);
+        CWallet::TxItems txOrdered = pwallet->OrderedTxItems(acentries, strAccount);
+        for (CWallet::TxItems::reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend() && nEntries < nCount + nFrom; ++it) {
+            int nItemEntries = 0;
+            CWalletTx* const pwtx = (*it).second.first;
+            if (pwtx != 0)
+                nItemEntries += CountListTransactions(*pwtx, strAccount, 0, filter);
+            CAccountingEntry* const pacentry = (*it).second.second;
+            if (pacentry != 0 && (strAccount == "*" || pacentry->strAccount == strAccount))
+                nItemEntries++;
+            if (nItemEntries == 0)
+                continue;
+            vItems.push_back(std::make_pair((*it).second, nItemEntries));
+            vItemTx.push_back(pwtx != 0 ? pwtx->GetHash() : uint256(0));
+            nEntries += nItemEntries;
+        }
     }
-    // ret is newest to oldest
-
-    if (nFrom > (int)ret.size())
-        nFrom = ret.size();
-    if ((nFrom + nCount) > (int)ret.size())
-        nCount = ret.size() - nFrom;
-
-    vector<UniValue> arrTmp = ret.getValues();
 
-    vector<UniValue>::iterator first = arrTmp.begin();
-    std::advance(first, nFrom);
-    vector<UniValue>::iterator last = arrTmp.begin();
-    std::advance(last, nFrom+nCount);
-
-    if (last != arrTmp.end()) arrTmp.erase(last, arrTmp.end());
-    if (first != arrTmp.begin()) arrTmp.erase(arrTmp.begin(), first);
-
-    std::reverse(arrTmp.begin(), arrTmp.end()); // Return oldest to newest
-
-    ret.clear();
-    ret.setArray();
-    ret.push_backV(arrTmp);
+    // the entries are numbered newest first; once the entries of vItems[i] are taken off, nEntries is the number of its first one
+    std::vector<UniValue> vRows;
+    writer.BeginArray();
+    for (int i = (int)vItems.size() - 1; i >= 0;) {
+        {
+            LOCK2(cs_main, pwallet->cs_wallet);
+            for (int nEnd = std::max(i + 1 - (int)RPC_STREAM_BATCH_ROWS, 0); i >= nEnd; i--) {
+                nEntries -= vItems[i].second;
+                if (nEntries >= nFrom + nCount || nEntries + vItems[i].second <= nFrom)
+                    continue;
+                UniValue entries(UniValue::VARR);
+                if (vItems[i].first.first != 0) {
+                    // the locks were released since the first pass
+                    std::map<uint256, CWalletTx>::const_iterator mi = pwallet->mapWallet.find(vItemTx[i]);
+                    if (mi != pwallet->mapWallet.end())
+                        ListTransactions(mi->second, strAccount, 0, true, entries, filter);
+                }
+                if (vItems[i].first.second != 0)
+                    AcentryToJSON(*vItems[i].first.second, strAccount, entries);
+                const std::vector<UniValue>& vEntries = entries.getValues();
+                for (int j = std::min((int)vEntries.size(), vItems[i].second) - 1; j >= 0; j--) {
+                    if (nEntries + j >= nFrom && nEntries + j < nFrom + nCount)
+                        vRows.push_back(vEntries[j]);
+                }
+            }
+        }
+        for (const UniValue& row : vRows)
+            writer.Value(row);
+        vRows.clear();
+    }
+    writer.EndArray();
+}
 
-    return ret;
+UniValue listtransactions(const UniValue& params, bool fHelp)
+{
+    return RPCStreamToValue(&listtransactions_stream, params, fHelp);
 }
 
 UniValue listaccounts(const UniValue& params, bool fHelp)
 {
+    CWallet* const pwallet = GetWalletForRPC();
     if (fHelp || params.size() > 2)
         throw runtime_error(
             "listaccounts ( minconf includeWatchonly)\n"
@@ -1353,12 +1450,12 @@ UniValue listaccounts(const UniValue& params, bool fHelp)
             includeWatchonly = includeWatchonly | ISMINE_WATCH_ONLY;
 
     map<string, CAmount> mapAccountBalances;
-    BOOST_FOREACH (const PAIRTYPE(CTxDestination, CAddressBookData) & entry, pwalletMain->mapAddressBook) {
-        if (IsMine(*pwalletMain, entry.first) & includeWatchonly) // This address belongs to me
+    BOOST_FOREACH (const PAIRTYPE(CTxDestination, CAddressBookData) & entry, pwallet->mapAddressBook) {
+        if (IsMine(*pwallet, entry.first) & includeWatchonly) // This address belongs to me
             mapAccountBalances[entry.second.name] = 0;
     }
 
-    for (map<uint256, CWalletTx>::iterator it = pwalletMain->mapWallet.begin(); it != pwalletMain->mapWallet.end(); ++it) {
+    for (map<uint256, CWalletTx>::iterator it = pwallet->mapWallet.begin(); it != pwallet->mapWallet.end(); ++it) {
         const CWalletTx& wtx = (*it).second;
         CAmount nFee;
         string strSentAccount;
@@ -1373,15 +1470,15 @@ UniValue listaccounts(const UniValue& params, bool fHelp)
             mapAccountBalances[strSentAccount] -= s.amount;
         if (nDepth >= nMinDepth) {
             BOOST_FOREACH (const COutputEntry& r, listReceived)
-                if (pwalletMain->mapAddressBook.count(r.destination))
-                    mapAccountBalances[pwalletMain->mapAddressBook[r.destination].name] += r.amount;
+                if (pwallet->mapAddressBook.count(r.destination))
+                    mapAccountBalances[pwallet->mapAddressBook[r.destination].name] += r.amount;
                 else
                     mapAccountBalances[""] += r.amount;
         }
     }
 
     list<CAccountingEntry> acentries;
-    CWalletDB(pwalletMain->strWalletFile).ListAccountCreditDebit("*", acentries);
+    CWalletDB(pwallet->strWalletFile).ListAccountCreditDebit("*", acentries);
     BOOST_FOREACH (const CAccountingEntry& entry, acentries)
         mapAccountBalances[entry.strAccount] += entry.nCreditDebit;
 
@@ -1394,6 +1491,7 @@ UniValue listaccounts(const UniValue& params, bool fHelp)
 
 UniValue listsinceblock(const UniValue& params, bool fHelp)
 {
+    CWallet* const pwallet = GetWalletForRPC();
     if (fHelp)
         throw runtime_error(
             "listsinceblock ( \"blockhash\" target-confirmations includeWatchonly)\n"
@@ -1456,7 +1554,7 @@ UniValue listsinceblock(const UniValue& params, bool fHelp)
 
     UniValue transactions(UniValue::VARR);
 
-    for (map<uint256, CWalletTx>::iterator it = pwalletMain->mapWallet.begin(); it != pwalletMain->mapWallet.end(); it++) {
+    for (map<uint256, CWalletTx>::iterator it = pwallet->mapWallet.begin(); it != pwallet->mapWallet.end(); it++) {
         CWalletTx tx = (*it).second;
 
         if (depth == -1 || tx.GetDepthInMainChain(false) < depth)
@@ -1475,6 +1573,7 @@ UniValue listsinceblock(const UniValue& params, bool fHelp)
 
 UniValue gettransaction(const UniValue& params, bool fHelp)
 {
+    CWallet* const pwallet = GetWalletForRPC();
     if (fHelp || params.size() < 1 || params.size() > 2)
         throw runtime_error(
             "gettransaction \"txid\" ( includeWatchonly )\n"
@@ -1518,9 +1617,9 @@ UniValue gettransaction(const UniValue& params, bool fHelp)
             filter = filter | ISMINE_WATCH_ONLY;
 
     UniValue entry(UniValue::VOBJ);
-    if (!pwalletMain->mapWallet.count(hash))
+    if (!pwallet->mapWallet.count(hash))
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid or non-wallet transaction id");
-    const CWalletTx& wtx = pwalletMain->mapWallet[hash];
+    const CWalletTx& wtx = pwallet->mapWallet[hash];
 
     CAmount nCredit = wtx.GetCredit(filter);
     CAmount nDebit = wtx.GetDebit(filter);
@@ -1546,6 +1645,7 @@ UniValue gettransaction(const UniValue& params, bool fHelp)
 
 UniValue backupwallet(const UniValue& params, bool fHelp)
 {
+    CWallet* const pwallet = GetWalletForRPC();
     if (fHelp || params.size() != 1)
         throw runtime_error(
             "backupwallet \"destination\"\n"
@@ -1556,7 +1656,7 @@ UniValue backupwallet(const UniValue& params, bool fHelp)
             HelpExampleCli("backupwallet", "\"backup.dat\"") + HelpExampleRpc("backupwallet", "\"backup.dat\""));
 
     string strDest = params[0].get_str();
-    if (!BackupWallet(*pwalletMain, strDest))
+    if (!BackupWallet(*pwallet, strDest))
         throw JSONRPCError(RPC_WALLET_ERROR, "Error: Wallet backup failed!");
 
     return NullUniValue;
@@ -1565,6 +1665,7 @@ UniValue backupwallet(const UniValue& params, bool fHelp)
 
 UniValue keypoolrefill(const UniValue& params, bool fHelp)
 {
+    CWallet* const pwallet = GetWalletForRPC();
     if (fHelp || params.size() > 1)
         throw runtime_error(
             "keypoolrefill ( newsize )\n"
@@ -1584,9 +1685,9 @@ UniValue keypoolrefill(const UniValue& params, bool fHelp)
     }
 
     EnsureWalletIsUnlocked();
-    pwalletMain->TopUpKeyPool(kpSize);
+    pwallet->TopUpKeyPool(kpSize);
 
-    if (pwalletMain->GetKeyPoolSize() < kpSize)
+    if (pwallet->GetKeyPoolSize() < kpSize)
         throw JSONRPCError(RPC_WALLET_ERROR, "Error refreshing keypool.");
 
     return NullUniValue;
@@ -1596,14 +1697,15 @@ UniValue keypoolrefill(const UniValue& params, bool fHelp)
 static void LockWallet(CWallet* pWallet)
 {
     LOCK(cs_nWalletUnlockTime);
-    nWalletUnlockTime = 0;
+    pWallet->nRelockTime = 0;
     pWallet->fWalletUnlockAnonymizeOnly = false;
     pWallet->Lock();
 }
 
 UniValue walletpassphrase(const UniValue& params, bool fHelp)
 {
-    if (pwalletMain->IsCrypted() && (fHelp || params.size() < 2 || params.size() > 3))
+    CWallet* const pwallet = GetWalletForRPC();
+    if (pwallet->IsCrypted() && (fHelp || params.size() < 2 || params.size() > 3))
         throw runtime_error(
             "walletpassphrase \"passphrase\" timeout ( anonymizeonly )\n"
             "\nStores the wallet decryption key in memory for 'timeout' seconds.\n"
@@ -1624,7 +1726,7 @@ UniValue walletpassphrase(const UniValue& params, bool fHelp)
 
     if (fHelp)
         return true;
-    if (!pwalletMain->IsCrypted())
+    if (!pwallet->IsCrypted())
         throw JSONRPCError(RPC_WALLET_WRONG_ENC_STATE, "Error: running with an unencrypted wallet, but walletpassphrase was called.");
 
     // Note that the walletpassphrase is stored in params[0] which is not mlock()ed
@@ -1638,21 +1740,21 @@ UniValue walletpassphrase(const UniValue& params, bool fHelp)
     if (params.size() == 3)
         anonymizeOnly = params[2].get_bool();
 
-    if (!pwalletMain->IsLocked() && pwalletMain->fWalletUnlockAnonymizeOnly && anonymizeOnly)
+    if (!pwallet->IsLocked() && pwallet->fWalletUnlockAnonymizeOnly && anonymizeOnly)
         throw JSONRPCError(RPC_WALLET_ALREADY_UNLOCKED, "Error: Wallet is already unlocked.");
 
-    if (!pwalletMain->Unlock(strWalletPass, anonymizeOnly))
+    if (!pwallet->Unlock(strWalletPass, anonymizeOnly))
         throw JSONRPCError(RPC_WALLET_PASSPHRASE_INCORRECT, "Error: The wallet passphrase entered was incorrect.");
 
-    pwalletMain->TopUpKeyPool();
+    pwallet->RefillKeyPool();
 
     int64_t nSleepTime = params[1].get_int64();
     LOCK(cs_nWalletUnlockTime);
-    nWalletUnlockTime = GetTime() + nSleepTime;
+    pwallet->nRelockTime = GetTime() + nSleepTime;
 
     if (nSleepTime > 0) {
-        nWalletUnlockTime = GetTime () + nSleepTime;
-        RPCRunLater ("lockwallet", boost::bind (LockWallet, pwalletMain), nSleepTime);
+        pwallet->nRelockTime = GetTime () + nSleepTime;
+        RPCRunLater ("lockwallet(" + pwallet->strWalletFile + ")", boost::bind (LockWallet, pwallet), nSleepTime);
     }
 
     return NullUniValue;
@@ -1661,7 +1763,8 @@ UniValue walletpassphrase(const UniValue& params, bool fHelp)
 
 UniValue walletpassphrasechange(const UniValue& params, bool fHelp)
 {
-    if (pwalletMain->IsCrypted() && (fHelp || params.size() != 2))
+    CWallet* const pwallet = GetWalletForRPC();
+    if (pwallet->IsCrypted() && (fHelp || params.size() != 2))
         throw runtime_error(
             "walletpassphrasechange \"oldpassphrase\" \"newpassphrase\"\n"
             "\nChanges the wallet passphrase from 'oldpassphrase' to 'newpassphrase'.\n"
@@ -1673,7 +1776,7 @@ UniValue walletpassphrasechange(const UniValue& params, bool fHelp)
 
     if (fHelp)
         return true;
-    if (!pwalletMain->IsCrypted())
+    if (!pwallet->IsCrypted())
         throw JSONRPCError(RPC_WALLET_WRONG_ENC_STATE, "Error: running with an unencrypted wallet, but walletpassphrasechange was called.");
 
     // TODO: get rid of these .c_str() calls by implementing SecureString::operator=(std::string)
@@ -1691,7 +1794,7 @@ UniValue walletpassphrasechange(const UniValue& params, bool fHelp)
             "walletpassphrasechange <oldpassphrase> <newpassphrase>\n"
             "Changes the wallet passphrase from <oldpassphrase> to <newpassphrase>.");
 
-    if (!pwalletMain->ChangeWalletPassphrase(strOldWalletPass, strNewWalletPass))
+    if (!pwallet->ChangeWalletPassphrase(strOldWalletPass, strNewWalletPass))
         throw JSONRPCError(RPC_WALLET_PASSPHRASE_INCORRECT, "Error: The wallet passphrase entered was incorrect.");
 
     return NullUniValue;
@@ -1700,7 +1803,8 @@ UniValue walletpassphrasechange(const UniValue& params, bool fHelp)
 
 UniValue walletlock(const UniValue& params, bool fHelp)
 {
-    if (pwalletMain->IsCrypted() && (fHelp || params.size() != 0))
+    CWallet* const pwallet = GetWalletForRPC();
+    if (pwallet->IsCrypted() && (fHelp || params.size() != 0))
         throw runtime_error(
             "walletlock\n"
             "\nRemoves the wallet encryption key from memory, locking the wallet.\n"
@@ -1715,13 +1819,13 @@ UniValue walletlock(const UniValue& params, bool fHelp)
 
     if (fHelp)
         return true;
-    if (!pwalletMain->IsCrypted())
+    if (!pwallet->IsCrypted())
         throw JSONRPCError(RPC_WALLET_WRONG_ENC_STATE, "Error: running with an unencrypted wallet, but walletlock was called.");
 
     {
         LOCK(cs_nWalletUnlockTime);
-        pwalletMain->Lock();
-        nWalletUnlockTime = 0;
+        pwallet->Lock();
+        pwallet->nRelockTime = 0;
     }
 
     return NullUniValue;
@@ -1730,7 +1834,8 @@ UniValue walletlock(const UniValue& params, bool fHelp)
 
 UniValue encryptwallet(const UniValue& params, bool fHelp)
 {
-    if (!pwalletMain->IsCrypted() && (fHelp || params.size() != 1))
+    CWallet* const pwallet = GetWalletForRPC();
+    if (!pwallet->IsCrypted() && (fHelp || params.size() != 1))
         throw runtime_error(
             "encryptwallet \"passphrase\"\n"
             "\nEncrypts the wallet with 'passphrase'. This is for first time encryption.\n"
@@ -1751,7 +1856,7 @@ UniValue encryptwallet(const UniValue& params, bool fHelp)
 
     if (fHelp)
         return true;
-    if (pwalletMain->IsCrypted())
+    if (pwallet->IsCrypted())
         throw JSONRPCError(RPC_WALLET_WRONG_ENC_STATE, "Error: running with an encrypted wallet, but encryptwallet was called.");
 
     // TODO: get rid of this .c_str() by implementing SecureString::operator=(std::string)
@@ -1765,7 +1870,7 @@ UniValue encryptwallet(const UniValue& params, bool fHelp)
             "encryptwallet <passphrase>\n"
             "Encrypts the wallet with <passphrase>.");
 
-    if (!pwalletMain->EncryptWallet(strWalletPass))
+    if (!pwallet->EncryptWallet(strWalletPass))
         throw JSONRPCError(RPC_WALLET_ENCRYPTION_FAILED, "Error: Failed to encrypt the wallet.");
 
     // BDB seems to have a bad habit of writing old data into
@@ -1777,6 +1882,7 @@ UniValue encryptwallet(const UniValue& params, bool fHelp)
 
 UniValue lockunspent(const UniValue& params, bool fHelp)
 {
+    CWallet* const pwallet = GetWalletForRPC();
     if (fHelp || params.size() < 1 || params.size() > 2)
         throw runtime_error(
             "lockunspent unlock [{\"txid\":\"txid\",\"vout\":n},...]\n"
@@ -1817,7 +1923,7 @@ UniValue lockunspent(const UniValue& params, bool fHelp)
 
     if (params.size() == 1) {
         if (fUnlock)
-            pwalletMain->UnlockAllCoins();
+            pwallet->UnlockAllCoins();
         return true;
     }
 
@@ -1841,9 +1947,9 @@ UniValue lockunspent(const UniValue& params, bool fHelp)
         COutPoint outpt(uint256(txid), nOutput);
 
         if (fUnlock)
-            pwalletMain->UnlockCoin(outpt);
+            pwallet->UnlockCoin(outpt);
         else
-            pwalletMain->LockCoin(outpt);
+            pwallet->LockCoin(outpt);
     }
 
     return true;
@@ -1851,6 +1957,7 @@ UniValue lockunspent(const UniValue& params, bool fHelp)
 
 UniValue listlockunspent(const UniValue& params, bool fHelp)
 {
+    CWallet* const pwallet = GetWalletForRPC();
     if (fHelp || params.size() > 0)
         throw runtime_error(
             "listlockunspent\n"
@@ -1873,7 +1980,7 @@ UniValue listlockunspent(const UniValue& params, bool fHelp)
             "\nAs a json rpc call\n" + HelpExampleRpc("listlockunspent", ""));
 
     vector<COutPoint> vOutpts;
-    pwalletMain->ListLockedCoins(vOutpts);
+    pwallet->ListLockedCoins(vOutpts);
 
     UniValue ret(UniValue::VARR);
 
@@ -1912,6 +2019,7 @@ UniValue settxfee(const UniValue& params, bool fHelp)
 
 UniValue getwalletinfo(const UniValue& params, bool fHelp)
 {
+    CWallet* const pwallet = GetWalletForRPC();
     if (fHelp || params.size() != 0)
         throw runtime_error(
             "getwalletinfo\n"
@@ -1929,16 +2037,90 @@ UniValue getwalletinfo(const UniValue& params, bool fHelp)
             HelpExampleCli("getwalletinfo", "") + HelpExampleRpc("getwalletinfo", ""));
 
     UniValue obj(UniValue::VOBJ);
-    obj.push_back(Pair("walletversion", pwalletMain->GetVersion()));
-    obj.push_back(Pair("balance", ValueFromAmount(pwalletMain->GetBalance())));
-    obj.push_back(Pair("txcount", (int)pwalletMain->mapWallet.size()));
-    obj.push_back(Pair("keypoololdest", pwalletMain->GetOldestKeyPoolTime()));
-    obj.push_back(Pair("keypoolsize", (int)pwalletMain->GetKeyPoolSize()));
-    if (pwalletMain->IsCrypted())
-        obj.push_back(Pair("unlocked_until", nWalletUnlockTime));
+    obj.push_back(Pair("walletversion", pwallet->GetVersion()));
+    obj.push_back(Pair("balance", ValueFromAmount(pwallet->GetBalance())));
+    obj.push_back(Pair("txcount", (int)pwallet->mapWallet.size()));
+    obj.push_back(Pair("keypoololdest", pwallet->GetOldestKeyPoolTime()));
+    obj.push_back(Pair("keypoolsize", (int)pwallet->GetKeyPoolSize()));
+    if (pwallet->IsCrypted())
+        obj.push_back(Pair("unlocked_until", pwallet->nRelockTime));
     return obj;
 }
 
+UniValue getrescaninfo(const UniValue& params, bool fHelp)
+{
+    CWallet* const pwallet = GetWalletForRPC();
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getrescaninfo\n"
+            "Returns the progress of a running rescan of the block chain for wallet transactions.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"scanning\": true|false,     (boolean) whether a rescan is running\n"
+            "  \"startheight\": n,           (numeric) the height the rescan started at\n"
+            "  \"height\": n,                (numeric) the last height scanned\n"
+            "  \"stopheight\": n,            (numeric) the height of the tip when the rescan started\n"
+            "  \"progress\": x.xxx,          (numeric) the part of the blocks scanned so far, 0 to 1\n"
+            "  \"duration\": n               (numeric) the seconds the rescan has been running for\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getrescaninfo", "") + HelpExampleRpc("getrescaninfo", ""));
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("scanning", pwallet->fScanningWallet.load()));
+    if (pwallet->fScanningWallet) {
+        int nStart = pwallet->nScanStartHeight;
+        int nHeight = pwallet->nScanHeight;
+        int nStop = pwallet->nScanStopHeight;
+        obj.push_back(Pair("startheight", nStart));
+        obj.push_back(Pair("height", nHeight));
+        obj.push_back(Pair("stopheight", nStop));
+        obj.push_back(Pair("progress", nStop > nStart ? (double)(nHeight - nStart) / (nStop - nStart) : 1.0));
+        obj.push_back(Pair("duration", GetTime() - pwallet->nScanStartTime));
+    }
+    return obj;
+}
+
+UniValue abortrescan(const UniValue& params, bool fHelp)
+{
+    CWallet* const pwallet = GetWalletForRPC();
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "abortrescan\n"
+            "Stops a running rescan of the block chain for wallet transactions, as started by importprivkey,\n"
+            "importaddress or importwallet. The rescan is resumed where it stopped at the next start.\n"
+            "\nResult:\n"
+            "true|false    (boolean) whether a rescan was running\n"
+            "\nExamples:\n" +
+            HelpExampleCli("abortrescan", "") + HelpExampleRpc("abortrescan", ""));
+
+    if (!pwallet->fScanningWallet)
+        return false;
+    pwallet->fAbortRescan = true;
+    return true;
+}
+
+UniValue listwallets(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "listwallets\n"
+            "Returns the wallets this node has loaded. Wallet RPC calls sent to /wallet/<file>\n"
+            "work on the wallet kept in <file>, the others on the first of them.\n"
+            "\nResult:\n"
+            "[                         (json array of string)\n"
+            "  \"walletfile\"           (string) the file of a loaded wallet\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n" +
+            HelpExampleCli("listwallets", "") + HelpExampleRpc("listwallets", ""));
+
+    UniValue ret(UniValue::VARR);
+    BOOST_FOREACH (const CWallet* pwallet, vpwallets)
+        ret.push_back(pwallet->strWalletFile);
+    return ret;
+}
+
 // ppcoin: reserve balance from being staked for network protection
 UniValue reservebalance(const UniValue& params, bool fHelp)
 {
@@ -1985,6 +2167,7 @@ UniValue reservebalance(const UniValue& params, bool fHelp)
 // presstab HyperStake
 UniValue setstakesplitthreshold(const UniValue& params, bool fHelp)
 {
+    CWallet* const pwallet = GetWalletForRPC();
     if (fHelp || params.size() != 1)
         throw runtime_error(
             "setstakesplitthreshold value\n"
@@ -2001,19 +2184,19 @@ UniValue setstakesplitthreshold(const UniValue& params, bool fHelp)
             HelpExampleCli("setstakesplitthreshold", "5000") + HelpExampleRpc("setstakesplitthreshold", "5000"));
 
     uint64_t nStakeSplitThreshold = params[0].get_int();
-    if (pwalletMain->IsLocked())
+    if (pwallet->IsLocked())
         throw JSONRPCError(RPC_WALLET_UNLOCK_NEEDED, "Error: Unlock wallet to use this feature");
     if (nStakeSplitThreshold > 999999)
         throw runtime_error("Value out of range, max allowed is 999999");
 
-    CWalletDB walletdb(pwalletMain->strWalletFile);
-    LOCK(pwalletMain->cs_wallet);
+    CWalletDB walletdb(pwallet->strWalletFile);
+    LOCK(pwallet->cs_wallet);
     {
-        bool fFileBacked = pwalletMain->fFileBacked;
+        bool fFileBacked = pwallet->fFileBacked;
 
         UniValue result(UniValue::VOBJ);
-        pwalletMain->nStakeSplitThreshold = nStakeSplitThreshold;
-        result.push_back(Pair("threshold", int(pwalletMain->nStakeSplitThreshold)));
+        pwallet->nStakeSplitThreshold = nStakeSplitThreshold;
+        result.push_back(Pair("threshold", int(pwallet->nStakeSplitThreshold)));
         if (fFileBacked) {
             walletdb.WriteStakeSplitThreshold(nStakeSplitThreshold);
             result.push_back(Pair("saved", "true"));
@@ -2027,6 +2210,7 @@ UniValue setstakesplitthreshold(const UniValue& params, bool fHelp)
 // presstab HyperStake
 UniValue getstakesplitthreshold(const UniValue& params, bool fHelp)
 {
+    CWallet* const pwallet = GetWalletForRPC();
     if (fHelp || params.size() != 0)
         throw runtime_error(
             "getstakesplitthreshold\n"
@@ -2036,11 +2220,12 @@ UniValue getstakesplitthreshold(const UniValue& params, bool fHelp)
             "\nExamples:\n" +
             HelpExampleCli("getstakesplitthreshold", "") + HelpExampleRpc("getstakesplitthreshold", ""));
 
-    return int(pwalletMain->nStakeSplitThreshold);
+    return int(pwallet->nStakeSplitThreshold);
 }
 
 UniValue autocombinerewards(const UniValue& params, bool fHelp)
 {
+    CWallet* const pwallet = GetWalletForRPC();
     bool fEnable;
     if (params.size() >= 1)
         fEnable = params[0].get_bool();
@@ -2057,14 +2242,14 @@ UniValue autocombinerewards(const UniValue& params, bool fHelp)
             "\nExamples:\n" +
             HelpExampleCli("autocombinerewards", "true 500") + HelpExampleRpc("autocombinerewards", "true 500"));
 
-    CWalletDB walletdb(pwalletMain->strWalletFile);
+    CWalletDB walletdb(pwallet->strWalletFile);
     CAmount nThreshold = 0;
 
     if (fEnable)
         nThreshold = params[1].get_int();
 
-    pwalletMain->fCombineDust = fEnable;
-    pwalletMain->nAutoCombineThreshold = nThreshold;
+    pwallet->fCombineDust = fEnable;
+    pwallet->nAutoCombineThreshold = nThreshold;
 
     if (!walletdb.WriteAutoCombineSettings(fEnable, nThreshold))
         throw runtime_error("Changed settings in wallet but failed to save to database\n");
@@ -2074,16 +2259,17 @@ UniValue autocombinerewards(const UniValue& params, bool fHelp)
 
 UniValue printMultiSend()
 {
+    CWallet* const pwallet = GetWalletForRPC();
     UniValue ret(UniValue::VARR);
     UniValue act(UniValue::VOBJ);
-    act.push_back(Pair("MultiSendStake Activated?", pwalletMain->fMultiSendStake));
-    act.push_back(Pair("MultiSendMasternode Activated?", pwalletMain->fMultiSendMasternodeReward));
+    act.push_back(Pair("MultiSendStake Activated?", pwallet->fMultiSendStake));
+    act.push_back(Pair("MultiSendMasternode Activated?", pwallet->fMultiSendMasternodeReward));
     ret.push_back(act);
 
-    if (pwalletMain->vDisabledAddresses.size() >= 1) {
+    if (pwallet->vDisabledAddresses.size() >= 1) {
         UniValue disAdd(UniValue::VOBJ);
-        for (unsigned int i = 0; i < pwalletMain->vDisabledAddresses.size(); i++) {
-            disAdd.push_back(Pair("Disabled From Sending", pwalletMain->vDisabledAddresses[i]));
+        for (unsigned int i = 0; i < pwallet->vDisabledAddresses.size(); i++) {
+            disAdd.push_back(Pair("Disabled From Sending", pwallet->vDisabledAddresses[i]));
         }
         ret.push_back(disAdd);
     }
@@ -2091,9 +2277,9 @@ UniValue printMultiSend()
     ret.push_back("MultiSend Addresses to Send To:");
 
     UniValue vMS(UniValue::VOBJ);
-    for (unsigned int i = 0; i < pwalletMain->vMultiSend.size(); i++) {
-        vMS.push_back(Pair("Address " + boost::lexical_cast<std::string>(i), pwalletMain->vMultiSend[i].first));
-        vMS.push_back(Pair("Percent", pwalletMain->vMultiSend[i].second));
+    for (unsigned int i = 0; i < pwallet->vMultiSend.size(); i++) {
+        vMS.push_back(Pair("Address " + boost::lexical_cast<std::string>(i), pwallet->vMultiSend[i].first));
+        vMS.push_back(Pair("Percent", pwallet->vMultiSend[i].second));
     }
 
     ret.push_back(vMS);
@@ -2102,8 +2288,9 @@ UniValue printMultiSend()
 
 UniValue printAddresses()
 {
+    CWallet* const pwallet = GetWalletForRPC();
     std::vector<COutput> vCoins;
-    pwalletMain->AvailableCoins(vCoins);
+    pwallet->AvailableCoins(vCoins);
     std::map<std::string, double> mapAddresses;
     BOOST_FOREACH (const COutput& out, vCoins) {
         CTxDestination utxoAddress;
@@ -2131,15 +2318,17 @@ UniValue printAddresses()
 
 unsigned int sumMultiSend()
 {
+    CWallet* const pwallet = GetWalletForRPC();
     unsigned int sum = 0;
-    for (unsigned int i = 0; i < pwalletMain->vMultiSend.size(); i++)
-        sum += pwalletMain->vMultiSend[i].second;
+    for (unsigned int i = 0; i < pwallet->vMultiSend.size(); i++)
+        sum += pwallet->vMultiSend[i].second;
     return sum;
 }
 
 UniValue multisend(const UniValue& params, bool fHelp)
 {
-    CWalletDB walletdb(pwalletMain->strWalletFile);
+    CWallet* const pwallet = GetWalletForRPC();
+    CWalletDB walletdb(pwallet->strWalletFile);
     bool fFileBacked;
     //MultiSend Commands
     if (params.size() == 1) {
@@ -2150,16 +2339,16 @@ UniValue multisend(const UniValue& params, bool fHelp)
         } else if (strCommand == "printaddress" || strCommand == "printaddresses") {
             return printAddresses();
         } else if (strCommand == "clear") {
-            LOCK(pwalletMain->cs_wallet);
+            LOCK(pwallet->cs_wallet);
             {
                 bool erased = false;
-                if (pwalletMain->fFileBacked) {
-                    if (walletdb.EraseMultiSend(pwalletMain->vMultiSend))
+                if (pwallet->fFileBacked) {
+                    if (walletdb.EraseMultiSend(pwallet->vMultiSend))
                         erased = true;
                 }
 
-                pwalletMain->vMultiSend.clear();
-                pwalletMain->setMultiSendDisabled();
+                pwallet->vMultiSend.clear();
+                pwallet->setMultiSendDisabled();
 
                 UniValue obj(UniValue::VOBJ);
                 obj.push_back(Pair("Erased from database", erased));
@@ -2168,12 +2357,12 @@ UniValue multisend(const UniValue& params, bool fHelp)
                 return obj;
             }
         } else if (strCommand == "enablestake" || strCommand == "activatestake") {
-            if (pwalletMain->vMultiSend.size() < 1)
+            if (pwallet->vMultiSend.size() < 1)
                 throw JSONRPCError(RPC_INVALID_REQUEST, "Unable to activate MultiSend, check MultiSend vector");
 
-            if (CBitcoinAddress(pwalletMain->vMultiSend[0].first).IsValid()) {
-                pwalletMain->fMultiSendStake = true;
-                if (!walletdb.WriteMSettings(true, pwalletMain->fMultiSendMasternodeReward, pwalletMain->nLastMultiSendHeight)) {
+            if (CBitcoinAddress(pwallet->vMultiSend[0].first).IsValid()) {
+                pwallet->fMultiSendStake = true;
+                if (!walletdb.WriteMSettings(true, pwallet->fMultiSendMasternodeReward, pwallet->nLastMultiSendHeight)) {
                     UniValue obj(UniValue::VOBJ);
                     obj.push_back(Pair("error", "MultiSend activated but writing settings to DB failed"));
                     UniValue arr(UniValue::VARR);
@@ -2186,13 +2375,13 @@ UniValue multisend(const UniValue& params, bool fHelp)
 
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unable to activate MultiSend, check MultiSend vector");
         } else if (strCommand == "enablemasternode" || strCommand == "activatemasternode") {
-            if (pwalletMain->vMultiSend.size() < 1)
+            if (pwallet->vMultiSend.size() < 1)
                 throw JSONRPCError(RPC_INVALID_REQUEST, "Unable to activate MultiSend, check MultiSend vector");
 
-            if (CBitcoinAddress(pwalletMain->vMultiSend[0].first).IsValid()) {
-                pwalletMain->fMultiSendMasternodeReward = true;
+            if (CBitcoinAddress(pwallet->vMultiSend[0].first).IsValid()) {
+                pwallet->fMultiSendMasternodeReward = true;
 
-                if (!walletdb.WriteMSettings(pwalletMain->fMultiSendStake, true, pwalletMain->nLastMultiSendHeight)) {
+                if (!walletdb.WriteMSettings(pwallet->fMultiSendStake, true, pwallet->nLastMultiSendHeight)) {
                     UniValue obj(UniValue::VOBJ);
                     obj.push_back(Pair("error", "MultiSend activated but writing settings to DB failed"));
                     UniValue arr(UniValue::VARR);
@@ -2205,27 +2394,27 @@ UniValue multisend(const UniValue& params, bool fHelp)
 
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unable to activate MultiSend, check MultiSend vector");
         } else if (strCommand == "disable" || strCommand == "deactivate") {
-            pwalletMain->setMultiSendDisabled();
-            if (!walletdb.WriteMSettings(false, false, pwalletMain->nLastMultiSendHeight))
+            pwallet->setMultiSendDisabled();
+            if (!walletdb.WriteMSettings(false, false, pwallet->nLastMultiSendHeight))
                 throw JSONRPCError(RPC_DATABASE_ERROR, "MultiSend deactivated but writing settings to DB failed");
 
             return printMultiSend();
         } else if (strCommand == "enableall") {
-            if (!walletdb.EraseMSDisabledAddresses(pwalletMain->vDisabledAddresses))
+            if (!walletdb.EraseMSDisabledAddresses(pwallet->vDisabledAddresses))
                 return "failed to clear old vector from walletDB";
             else {
-                pwalletMain->vDisabledAddresses.clear();
+                pwallet->vDisabledAddresses.clear();
                 return printMultiSend();
             }
         }
     }
     if (params.size() == 2 && params[0].get_str() == "delete") {
         int del = boost::lexical_cast<int>(params[1].get_str());
-        if (!walletdb.EraseMultiSend(pwalletMain->vMultiSend))
+        if (!walletdb.EraseMultiSend(pwallet->vMultiSend))
             throw JSONRPCError(RPC_DATABASE_ERROR, "failed to delete old MultiSend vector from database");
 
-        pwalletMain->vMultiSend.erase(pwalletMain->vMultiSend.begin() + del);
-        if (!walletdb.WriteMultiSend(pwalletMain->vMultiSend))
+        pwallet->vMultiSend.erase(pwallet->vMultiSend.begin() + del);
+        if (!walletdb.WriteMultiSend(pwallet->vMultiSend))
             throw JSONRPCError(RPC_DATABASE_ERROR, "walletdb WriteMultiSend failed!");
 
         return printMultiSend();
@@ -2235,11 +2424,11 @@ UniValue multisend(const UniValue& params, bool fHelp)
         if (!CBitcoinAddress(disAddress).IsValid())
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "address you want to disable is not valid");
         else {
-            pwalletMain->vDisabledAddresses.push_back(disAddress);
-            if (!walletdb.EraseMSDisabledAddresses(pwalletMain->vDisabledAddresses))
+            pwallet->vDisabledAddresses.push_back(disAddress);
+            if (!walletdb.EraseMSDisabledAddresses(pwallet->vDisabledAddresses))
                 throw JSONRPCError(RPC_DATABASE_ERROR, "disabled address from sending, but failed to clear old vector from walletDB");
 
-            if (!walletdb.WriteMSDisabledAddresses(pwalletMain->vDisabledAddresses))
+            if (!walletdb.WriteMSDisabledAddresses(pwallet->vDisabledAddresses))
                 throw JSONRPCError(RPC_DATABASE_ERROR, "disabled address from sending, but failed to store it to walletDB");
             else
                 return printMultiSend();
@@ -2278,13 +2467,13 @@ UniValue multisend(const UniValue& params, bool fHelp)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid VALUTO address");
     if (boost::lexical_cast<int>(params[1].get_str()) < 0)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid parameter, expected valid percentage");
-    if (pwalletMain->IsLocked())
+    if (pwallet->IsLocked())
         throw JSONRPCError(RPC_WALLET_UNLOCK_NEEDED, "Error: Please enter the wallet passphrase with walletpassphrase first.");
     unsigned int nPercent = boost::lexical_cast<unsigned int>(params[1].get_str());
 
-    LOCK(pwalletMain->cs_wallet);
+    LOCK(pwallet->cs_wallet);
     {
-        fFileBacked = pwalletMain->fFileBacked;
+        fFileBacked = pwallet->fFileBacked;
         //Error if 0 is entered
         if (nPercent == 0) {
             throw JSONRPCError(RPC_INVALID_PARAMETER, "Sending 0% of stake is not valid");
@@ -2294,20 +2483,20 @@ UniValue multisend(const UniValue& params, bool fHelp)
         if (nPercent + sumMultiSend() > 100)
             throw JSONRPCError(RPC_INVALID_PARAMETER, "Failed to add to MultiSend vector, the sum of your MultiSend is greater than 100%");
 
-        for (unsigned int i = 0; i < pwalletMain->vMultiSend.size(); i++) {
-            if (pwalletMain->vMultiSend[i].first == strAddress)
+        for (unsigned int i = 0; i < pwallet->vMultiSend.size(); i++) {
+            if (pwallet->vMultiSend[i].first == strAddress)
                 throw JSONRPCError(RPC_INVALID_PARAMETER, "Failed to add to MultiSend vector, cannot use the same address twice");
         }
 
         if (fFileBacked)
-            walletdb.EraseMultiSend(pwalletMain->vMultiSend);
+            walletdb.EraseMultiSend(pwallet->vMultiSend);
 
         std::pair<std::string, int> newMultiSend;
         newMultiSend.first = strAddress;
         newMultiSend.second = nPercent;
-        pwalletMain->vMultiSend.push_back(newMultiSend);
+        pwallet->vMultiSend.push_back(newMultiSend);
         if (fFileBacked) {
-            if (!walletdb.WriteMultiSend(pwalletMain->vMultiSend))
+            if (!walletdb.WriteMultiSend(pwallet->vMultiSend))
                 throw JSONRPCError(RPC_DATABASE_ERROR, "walletdb WriteMultiSend failed!");
         }
     }
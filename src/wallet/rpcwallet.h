@@ -0,0 +1,33 @@
+// Copyright (c) 2017-2020 The VALUTO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_WALLET_RPCWALLET_H
+#define BITCOIN_WALLET_RPCWALLET_H
+
+class CWallet;
+
+/**
+ * The wallet the RPC call running on this thread works on: the one its
+ * request was sent to, or pwalletMain when it named none.
+ */
+CWallet* GetWalletForRPC();
+
+/**
+ * Sends the wallet RPC calls made on this thread to pwallet for as long as
+ * it is in scope.
+ */
+class CWalletRPCScope
+{
+private:
+    CWallet* pwalletPrev;
+
+    CWalletRPCScope(const CWalletRPCScope&);
+    CWalletRPCScope& operator=(const CWalletRPCScope&);
+
+public:
+    explicit CWalletRPCScope(CWallet* pwallet);
+    ~CWalletRPCScope();
+};
+
+#endif // BITCOIN_WALLET_RPCWALLET_H
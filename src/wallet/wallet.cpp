@@ -11,6 +11,8 @@
 #include "base58.h"
 #include "checkpoints.h"
 #include "coincontrol.h"
+#include "coinselection.h"
+#include "init.h"
 #include "kernel.h"
 #include "net.h"
 #include "primitives/transaction.h"
@@ -42,6 +44,8 @@ bool bdisableSystemnotifications = true; // Those bubbles can be annoying and sl
 bool fSendFreeTransactions = false;
 bool fPayAtLeastCustomFee = true;
 
+std::vector<CWallet*> vpwallets;
+
 /**
  * Fees smaller than this (in duffs) are considered zero fee (for transaction creation)
  * We are ~100 times smaller then bitcoin now (2015-06-23), set minTxFee 10 times higher
@@ -56,14 +60,6 @@ int64_t nStartupTime = GetAdjustedTime();
  * @{
  */
 
-struct CompareValueOnly {
-    bool operator()(const pair<CAmount, pair<const CWalletTx*, unsigned int> >& t1,
-        const pair<CAmount, pair<const CWalletTx*, unsigned int> >& t2) const
-    {
-        return t1.first < t2.first;
-    }
-};
-
 std::string COutput::ToString() const
 {
     return strprintf("COutput(%s, %d, %d) [%s]", tx->GetHash().ToString(), i, nDepth, FormatMoney(tx->vout[i].nValue));
@@ -78,22 +74,44 @@ const CWalletTx* CWallet::GetWalletTx(const uint256& hash) const
     return &(it->second);
 }
 
+namespace
+{
+/** Make nKeys new keys and their public keys; this is the costly part of growing the key pool and needs no lock. */
+void MakeNewKeys(unsigned int nKeys, bool fCompressed, std::vector<std::pair<CKey, CPubKey> >& vKeysRet)
+{
+    RandAddSeedPerfmon();
+    vKeysRet.resize(nKeys);
+    for (unsigned int i = 0; i < nKeys; i++) {
+        vKeysRet[i].first.MakeNewKey(fCompressed);
+        vKeysRet[i].second = vKeysRet[i].first.GetPubKey();
+        assert(vKeysRet[i].first.VerifyPubKey(vKeysRet[i].second));
+    }
+}
+
+boost::mutex csKeyPoolThread;
+boost::condition_variable condKeyPoolThread;
+bool fKeyPoolTopUpRequested = false;
+std::atomic<bool> fKeyPoolThreadRunning(false);
+} // namespace
+
 CPubKey CWallet::GenerateNewKey()
 {
     AssertLockHeld(cs_wallet);                                 // mapKeyMetadata
     bool fCompressed = CanSupportFeature(FEATURE_COMPRPUBKEY); // default to compressed public keys if we want 0.6.0 wallets
 
-    RandAddSeedPerfmon();
-    CKey secret;
-    secret.MakeNewKey(fCompressed);
+    std::vector<std::pair<CKey, CPubKey> > vKeys;
+    MakeNewKeys(1, fCompressed, vKeys);
+    return AddNewKey(vKeys[0].first, vKeys[0].second);
+}
+
+CPubKey CWallet::AddNewKey(const CKey& secret, const CPubKey& pubkey)
+{
+    AssertLockHeld(cs_wallet); // mapKeyMetadata
 
     // Compressed public keys were introduced in version 0.6.0
-    if (fCompressed)
+    if (secret.IsCompressed())
         SetMinVersion(FEATURE_COMPRPUBKEY);
 
-    CPubKey pubkey = secret.GetPubKey();
-    assert(secret.VerifyPubKey(pubkey));
-
     // Create new metadata
     int64_t nCreationTime = GetTime();
     mapKeyMetadata[pubkey.GetID()] = CKeyMetadata(nCreationTime);
@@ -101,7 +119,7 @@ CPubKey CWallet::GenerateNewKey()
         nTimeFirstKey = nCreationTime;
 
     if (!AddKeyPubKey(secret, pubkey))
-        throw std::runtime_error("CWallet::GenerateNewKey() : AddKey failed");
+        throw std::runtime_error("CWallet::AddNewKey() : AddKey failed");
     return pubkey;
 }
 
@@ -165,7 +183,7 @@ bool CWallet::AddCScript(const CScript& redeemScript)
         return false;
     if (!fFileBacked)
         return true;
-    return CWalletDB(strWalletFile).WriteCScript(Hash160(redeemScript), redeemScript);
+    return CWalletDB(strWalletFile).WriteCScript(Hash160(redeemScript.begin(), redeemScript.end()), redeemScript);
 }
 
 bool CWallet::LoadCScript(const CScript& redeemScript)
@@ -437,6 +455,57 @@ bool CWallet::IsSpent(const uint256& hash, unsigned int n) const
     return false;
 }
 
+/**
+ * Outpoint is spent in the main chain if a wallet transaction
+ * with at least one confirmation spends it:
+ */
+bool CWallet::IsSpentInMainChain(const COutPoint& outpoint) const
+{
+    pair<TxSpends::const_iterator, TxSpends::const_iterator> range;
+    range = mapTxSpends.equal_range(outpoint);
+    for (TxSpends::const_iterator it = range.first; it != range.second; ++it) {
+        std::map<uint256, CWalletTx>::const_iterator mit = mapWallet.find(it->second);
+        if (mit != mapWallet.end() && mit->second.GetDepthInMainChain(false) > 0)
+            return true;
+    }
+    return false;
+}
+
+void CWallet::AddToWalletUTXO(const CWalletTx& wtx)
+{
+    const uint256 hash = wtx.GetHash();
+    for (unsigned int i = 0; i < wtx.vout.size(); i++) {
+        if (IsMine(wtx.vout[i]) != ISMINE_NO)
+            setWalletUTXO.insert(COutPoint(hash, i));
+    }
+}
+
+/**
+ * The wallet transactions with an output in setWalletUTXO, in hash order.
+ * Outputs that are spent in the main chain, or whose transaction has left
+ * the wallet, are dropped from the set on the way.
+ */
+std::vector<const CWalletTx*> CWallet::GetUnspentWalletTxs() const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+    std::vector<const CWalletTx*> vpwtx;
+    std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.end();
+    std::set<COutPoint>::iterator it = setWalletUTXO.begin();
+    while (it != setWalletUTXO.end()) {
+        if (mi == mapWallet.end() || mi->first != it->hash)
+            mi = mapWallet.find(it->hash);
+        if (mi == mapWallet.end() || it->n >= mi->second.vout.size() || IsSpentInMainChain(*it)) {
+            setWalletUTXO.erase(it++);
+            continue;
+        }
+        if (vpwtx.empty() || vpwtx.back() != &mi->second)
+            vpwtx.push_back(&mi->second);
+        ++it;
+    }
+    return vpwtx;
+}
+
 void CWallet::AddToSpends(const COutPoint& outpoint, const uint256& wtxid)
 {
     mapTxSpends.insert(make_pair(outpoint, wtxid));
@@ -646,8 +715,12 @@ void CWallet::MarkDirty()
 {
     {
         LOCK(cs_wallet);
-        BOOST_FOREACH (PAIRTYPE(const uint256, CWalletTx) & item, mapWallet)
+        BOOST_FOREACH (PAIRTYPE(const uint256, CWalletTx) & item, mapWallet) {
             item.second.MarkDirty();
+            // a new key or script can make outputs of old transactions ours
+            AddToWalletUTXO(item.second);
+        }
+        fBalancesDirty = true;
     }
 }
 
@@ -705,6 +778,8 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
 
         // Break debit/credit balance caches:
         wtx.MarkDirty();
+        AddToWalletUTXO(wtx);
+        MarkBalancesDirty(wtx);
 
         // Notify UI of new or updated transaction
         NotifyTransactionChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
@@ -742,6 +817,13 @@ bool CWallet::AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pbl
     return false;
 }
 
+void CWallet::BlockConnected(const CBlock& block, const std::list<CTransaction>& txConflicted)
+{
+    // what the wallet writes for this block goes to disk in one go
+    CDBBatch batch(fFileBacked);
+    CValidationInterface::BlockConnected(block, txConflicted);
+}
+
 void CWallet::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
 {
     LOCK2(cs_main, cs_wallet);
@@ -750,11 +832,50 @@ void CWallet::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
 
     // If a transaction changes 'conflicted' state, that changes the balance
     // available of the outputs it spends. So force those to be
-    // recomputed, also:
+    // recomputed, also. A disconnected spend makes them unspent again, so
+    // they go back into setWalletUTXO until they are found spent again:
     BOOST_FOREACH (const CTxIn& txin, tx.vin) {
-        if (mapWallet.count(txin.prevout.hash))
-            mapWallet[txin.prevout.hash].MarkDirty();
+        std::map<uint256, CWalletTx>::iterator mi = mapWallet.find(txin.prevout.hash);
+        if (mi != mapWallet.end()) {
+            mi->second.MarkDirty();
+            if (txin.prevout.n < mi->second.vout.size() && IsMine(mi->second.vout[txin.prevout.n]) != ISMINE_NO)
+                setWalletUTXO.insert(txin.prevout);
+        }
+    }
+}
+
+void CWallet::UndoAddToWallet(const uint256& hash)
+{
+    LOCK(cs_wallet);
+    std::map<uint256, CWalletTx>::iterator mi = mapWallet.find(hash);
+    if (mi == mapWallet.end())
+        return;
+    CWalletTx& wtx = mi->second;
+
+    std::pair<TxItems::iterator, TxItems::iterator> rangeOrdered = wtxOrdered.equal_range(wtx.nOrderPos);
+    for (TxItems::iterator it = rangeOrdered.first; it != rangeOrdered.second; ++it) {
+        if (it->second.first == &wtx) {
+            wtxOrdered.erase(it);
+            break;
+        }
     }
+    if (!wtx.IsCoinBase()) {
+        BOOST_FOREACH (const CTxIn& txin, wtx.vin) {
+            std::pair<TxSpends::iterator, TxSpends::iterator> range = mapTxSpends.equal_range(txin.prevout);
+            for (TxSpends::iterator it = range.first; it != range.second; ++it) {
+                if (it->second == hash) {
+                    mapTxSpends.erase(it);
+                    break;
+                }
+            }
+            std::map<uint256, CWalletTx>::iterator mip = mapWallet.find(txin.prevout.hash);
+            if (mip != mapWallet.end())
+                mip->second.MarkDirty();
+        }
+    }
+    MarkBalancesDirty(wtx);
+    mapWallet.erase(mi);
+    NotifyTransactionChanged(this, hash, CT_DELETED);
 }
 
 void CWallet::EraseFromWallet(const uint256& hash)
@@ -763,8 +884,18 @@ void CWallet::EraseFromWallet(const uint256& hash)
         return;
     {
         LOCK(cs_wallet);
-        if (mapWallet.erase(hash))
+        std::map<uint256, CWalletTx>::iterator mi = mapWallet.find(hash);
+        if (mi != mapWallet.end()) {
+            // the outputs it spent are unspent again; its own are dropped from setWalletUTXO when next walked
+            BOOST_FOREACH (const CTxIn& txin, mi->second.vin) {
+                const CWalletTx* prev = GetWalletTx(txin.prevout.hash);
+                if (prev && txin.prevout.n < prev->vout.size() && IsMine(prev->vout[txin.prevout.n]) != ISMINE_NO)
+                    setWalletUTXO.insert(txin.prevout);
+            }
+            MarkBalancesDirty(mi->second);
+            mapWallet.erase(mi);
             CWalletDB(strWalletFile).EraseTx(hash);
+        }
     }
     return;
 }
@@ -1070,17 +1201,135 @@ bool CWalletTx::WriteToDisk()
     return CWalletDB(pwallet->strWalletFile).WriteTx(GetHash(), *this);
 }
 
+bool CWalletScanFilter::IsRelevant(const CScript& scriptPubKey) const
+{
+    if (setScripts.count(scriptPubKey))
+        return true;
+
+    vector<valtype> vSolutions;
+    txnouttype whichType;
+    if (!Solver(scriptPubKey, whichType, vSolutions))
+        return false;
+    BOOST_FOREACH (const valtype& vch, vSolutions) {
+        // key and script hashes, and the keys of pay-to-pubkey and multisig outputs
+        if (vch.size() == 20 && setIDs.count(uint160(vch)))
+            return true;
+        if ((vch.size() == 33 || vch.size() == 65) && setIDs.count(CPubKey(vch).GetID()))
+            return true;
+    }
+    return false;
+}
+
+bool CWalletScanFilter::IsRelevant(const CTransaction& tx) const
+{
+    BOOST_FOREACH (const CTxOut& txout, tx.vout) {
+        if (IsRelevant(txout.scriptPubKey))
+            return true;
+    }
+    return false;
+}
+
+CWalletScanFilter CWallet::GetScanFilter() const
+{
+    CWalletScanFilter filter;
+    std::set<CKeyID> setKeys;
+    GetKeys(setKeys);
+    filter.setIDs.insert(setKeys.begin(), setKeys.end());
+    {
+        LOCK(cs_KeyStore);
+        BOOST_FOREACH (const PAIRTYPE(CScriptID, CScript) & script, mapScripts)
+            filter.setIDs.insert(script.first);
+        filter.setScripts.insert(setWatchOnly.begin(), setWatchOnly.end());
+        filter.setScripts.insert(setMultiSig.begin(), setMultiSig.end());
+    }
+    return filter;
+}
+
+namespace
+{
+/** A block of a rescan, and which of its transactions have an output the scan filter matches. */
+struct CRescanBlock {
+    CBlockIndex* pindex;
+    bool fRead;
+    CBlock block;
+    std::vector<bool> vMatch;
+
+    CRescanBlock(CBlockIndex* pindexIn) : pindex(pindexIn), fRead(false) {}
+};
+
+/**
+ * Reads and matches a batch of rescanned blocks on its own threads, while
+ * the thread that started it adds the previous batch to the wallet. The
+ * threads are joined when it goes away.
+ */
+class CRescanReader
+{
+private:
+    std::vector<CRescanBlock>& vBatch;
+    const CWalletScanFilter& filter;
+    std::atomic<size_t> nNext;
+    boost::thread_group threadGroup;
+
+    void Read()
+    {
+        for (size_t i = nNext++; i < vBatch.size(); i = nNext++) {
+            CRescanBlock& item = vBatch[i];
+            item.fRead = ReadBlockFromDisk(item.block, item.pindex);
+            item.vMatch.resize(item.block.vtx.size());
+            for (unsigned int j = 0; j < item.block.vtx.size(); j++)
+                item.vMatch[j] = filter.IsRelevant(item.block.vtx[j]);
+        }
+    }
+
+public:
+    CRescanReader(std::vector<CRescanBlock>& vBatchIn, const CWalletScanFilter& filterIn, unsigned int nThreads) : vBatch(vBatchIn), filter(filterIn), nNext(0)
+    {
+        for (unsigned int t = 0; t < nThreads; t++)
+            threadGroup.create_thread(boost::bind(&CRescanReader::Read, this));
+    }
+
+    ~CRescanReader()
+    {
+        threadGroup.join_all();
+    }
+};
+
+/** The next RESCAN_BATCH_BLOCKS blocks of the active chain, from pindex on. */
+void GetRescanBatch(std::vector<CRescanBlock>& vBatch, CBlockIndex* pindex)
+{
+    vBatch.clear();
+    for (; pindex && vBatch.size() < RESCAN_BATCH_BLOCKS; pindex = chainActive.Next(pindex))
+        vBatch.push_back(CRescanBlock(pindex));
+}
+} // namespace
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
  * exist in the wallet will be updated.
+ *
+ * Blocks are read and matched against the wallet's scan filter a batch
+ * ahead, on all cores. Only the transactions the filter matches, that
+ * are already in the wallet or that spend one of its transactions are
+ * passed to AddToWalletIfInvolvingMe, in chain order. cs_main and
+ * cs_wallet are only held while a batch is added, so blocks and wallet
+ * calls go on while the next one is read; a batch the active chain no
+ * longer contains is read again from the fork. The position is saved
+ * every minute, so a rescan cut short by shutdown or abortrescan is
+ * resumed at the next start.
  */
 int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
 {
     int ret = 0;
     int64_t nNow = GetTime();
+    const unsigned int nThreads = std::max(1u, boost::thread::hardware_concurrency());
 
     CBlockIndex* pindex = pindexStart;
+    CWalletScanFilter filter;
+    double dProgressStart;
+    double dProgressTip;
+    std::vector<CRescanBlock> vBatch;
+    std::vector<CRescanBlock> vNext;
     {
         LOCK2(cs_main, cs_wallet);
 
@@ -1089,25 +1338,92 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
         while (pindex && nTimeFirstKey && (pindex->GetBlockTime() < (nTimeFirstKey - 7200)))
             pindex = chainActive.Next(pindex);
 
+        filter = GetScanFilter();
+        fAbortRescan = false;
+        fScanningWallet = true;
+        nScanStartTime = GetTime();
+        nScanStartHeight = pindex ? pindex->nHeight : chainActive.Height();
+        nScanHeight = nScanStartHeight.load();
+        nScanStopHeight = chainActive.Height();
+
         ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
-        double dProgressStart = Checkpoints::GuessVerificationProgress(pindex, false);
-        double dProgressTip = Checkpoints::GuessVerificationProgress(chainActive.Tip(), false);
-        while (pindex) {
-            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
-                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
-
-            CBlock block;
-            ReadBlockFromDisk(block, pindex);
-            BOOST_FOREACH (CTransaction& tx, block.vtx) {
-                if (AddToWalletIfInvolvingMe(tx, &block, fUpdate))
+        dProgressStart = Checkpoints::GuessVerificationProgress(pindex, false);
+        dProgressTip = Checkpoints::GuessVerificationProgress(chainActive.Tip(), false);
+    }
+
+    // vNext is read ahead while vBatch is added, unless the next batch starts at pindexBatch
+    bool fAborted = false;
+    bool fStartBatch = true;
+    CBlockIndex* pindexBatch = pindex;
+    while (!fAborted) {
+        // only the block index entries of the batches are taken under cs_main, their blocks are read without it
+        bool fReadBatch = fStartBatch;
+        {
+            LOCK(cs_main);
+            if (fStartBatch) {
+                GetRescanBatch(vBatch, pindexBatch);
+                fStartBatch = false;
+            } else {
+                vBatch.swap(vNext);
+            }
+            if (vBatch.empty())
+                break;
+            GetRescanBatch(vNext, chainActive.Next(vBatch.back().pindex));
+        }
+        CRescanReader reader(vNext, filter, nThreads);
+        if (fReadBatch) {
+            // the first batch, or the one after a reorg, wasn't read ahead
+            CRescanReader readerBatch(vBatch, filter, nThreads);
+        }
+
+        LOCK2(cs_main, cs_wallet);
+        if (!chainActive.Contains(vBatch.back().pindex)) {
+            // the chain was reorganized while the locks were released, and the wallet
+            // was given the blocks it connected; go on from the fork on the new chain
+            const CBlockIndex* pindexFork = chainActive.FindFork(vBatch.front().pindex);
+            pindexBatch = pindexFork == vBatch.front().pindex ? vBatch.front().pindex : chainActive.Next(pindexFork);
+            fStartBatch = true;
+            continue;
+        }
+        CDBBatch batch(fFileBacked);
+
+        BOOST_FOREACH (const CRescanBlock& item, vBatch) {
+            if (fAbortRescan || ShutdownRequested()) {
+                LogPrintf("Rescan interrupted at block %d, it will be resumed at the next start\n", item.pindex->nHeight);
+                if (fFileBacked)
+                    CWalletDB(strWalletFile).WriteRescanBlock(chainActive.GetLocator(item.pindex));
+                fAborted = true;
+                break;
+            }
+            if (item.pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
+                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(item.pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
+
+            if (!item.fRead)
+                LogPrintf("%s : can't read block %s at height %d\n", __func__, item.pindex->GetBlockHash().ToString(), item.pindex->nHeight);
+            for (unsigned int i = 0; i < item.block.vtx.size(); i++) {
+                const CTransaction& tx = item.block.vtx[i];
+                bool fRelevant = item.vMatch[i] || mapWallet.count(tx.GetHash());
+                for (unsigned int j = 0; j < tx.vin.size() && !fRelevant; j++)
+                    fRelevant = mapWallet.count(tx.vin[j].prevout.hash);
+                if (fRelevant && AddToWalletIfInvolvingMe(tx, &item.block, fUpdate))
                     ret++;
             }
-            pindex = chainActive.Next(pindex);
+            nScanHeight = item.pindex->nHeight;
+
             if (GetTime() >= nNow + 60) {
                 nNow = GetTime();
-                LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(pindex));
+                LogPrintf("Still rescanning. At block %d. Progress=%f\n", item.pindex->nHeight, Checkpoints::GuessVerificationProgress(item.pindex));
+                if (fFileBacked)
+                    CWalletDB(strWalletFile).WriteRescanBlock(chainActive.GetLocator(item.pindex));
             }
         }
+    }
+
+    {
+        LOCK(cs_wallet);
+        if (!fAborted && fFileBacked)
+            CWalletDB(strWalletFile).EraseRescanBlock();
+        fScanningWallet = false;
         ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
     }
     return ret;
@@ -1214,57 +1530,154 @@ void CWallet::ResendWalletTransactions()
  * @{
  */
 
-CAmount CWallet::GetBalance() const
+bool CWallet::CWalletBalances::IsNull() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableCredit();
-        }
-    }
+    return nBalance == 0 && nUnconfirmed == 0 && nImmature == 0 && nWatchOnly == 0 && nUnconfirmedWatchOnly == 0 &&
+           nImmatureWatchOnly == 0 && nAnonymizable == 0 && nAnonymized == 0 && nDenominated == 0 && nUnconfirmedDenominated == 0;
+}
 
-    return nTotal;
+void CWallet::CWalletBalances::Add(const CWalletBalances& other, int nSign)
+{
+    nBalance += nSign * other.nBalance;
+    nUnconfirmed += nSign * other.nUnconfirmed;
+    nImmature += nSign * other.nImmature;
+    nWatchOnly += nSign * other.nWatchOnly;
+    nUnconfirmedWatchOnly += nSign * other.nUnconfirmedWatchOnly;
+    nImmatureWatchOnly += nSign * other.nImmatureWatchOnly;
+    nAnonymizable += nSign * other.nAnonymizable;
+    nAnonymized += nSign * other.nAnonymized;
+    nDenominated += nSign * other.nDenominated;
+    nUnconfirmedDenominated += nSign * other.nUnconfirmedDenominated;
 }
 
-CAmount CWallet::GetAnonymizableBalance() const
+//! Have the share of hash in the balances worked out again on the next read
+void CWallet::MarkBalancesDirty(const uint256& hash) const
 {
-    if(fLiteMode)
-        return 0;
+    AssertLockHeld(cs_wallet);
+    setBalancesPending.insert(hash);
+}
 
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for(const auto& entry : mapWallet) {
+//! Have the shares of tx and of the transactions it spends from worked out again on the next read
+void CWallet::MarkBalancesDirty(const CTransaction& tx) const
+{
+    MarkBalancesDirty(tx.GetHash());
+    BOOST_FOREACH (const CTxIn& txin, tx.vin)
+        MarkBalancesDirty(txin.prevout.hash);
+}
 
-            const auto& coin = entry.second;
+/**
+ * What wtx counts for in each balance category. fVolatile is set if that can
+ * change without wtx or a spend of it being synced: while it is unconfirmed,
+ * immature, or has an output spent by a transaction that is not in a block.
+ */
+CWallet::CWalletBalances CWallet::GetTxBalances(const CWalletTx& wtx, bool& fVolatile) const
+{
+    CWalletBalances balances = CWalletBalances();
+    const bool fTrusted = wtx.IsTrusted();
+    if (fTrusted) {
+        balances.nBalance = wtx.GetAvailableCredit();
+        balances.nWatchOnly = wtx.GetAvailableWatchOnlyCredit();
+    } else if (!IsFinalTx(wtx) || wtx.GetDepthInMainChain() == 0) {
+        balances.nUnconfirmed = wtx.GetAvailableCredit();
+        balances.nUnconfirmedWatchOnly = wtx.GetAvailableWatchOnlyCredit();
+    }
+    balances.nImmature = wtx.GetImmatureCredit();
+    balances.nImmatureWatchOnly = wtx.GetImmatureWatchOnlyCredit();
+    if (!fLiteMode) {
+        if (fTrusted) {
+            balances.nAnonymizable = wtx.GetAnonymizableCredit();
+            balances.nAnonymized = wtx.GetAnonymizedCredit();
+        }
+        balances.nDenominated = wtx.GetDenominatedCredit(false);
+        balances.nUnconfirmedDenominated = wtx.GetDenominatedCredit(true);
+    }
+
+    fVolatile = wtx.GetDepthInMainChain(false) < 1 || wtx.GetBlocksToMaturity() > 0;
+    const uint256 hash = wtx.GetHash();
+    for (unsigned int i = 0; i < wtx.vout.size() && !fVolatile; i++) {
+        std::pair<TxSpends::const_iterator, TxSpends::const_iterator> range = mapTxSpends.equal_range(COutPoint(hash, i));
+        for (TxSpends::const_iterator it = range.first; it != range.second && !fVolatile; ++it) {
+            std::map<uint256, CWalletTx>::const_iterator mit = mapWallet.find(it->second);
+            if (mit != mapWallet.end() && mit->second.GetDepthInMainChain(false) < 1)
+                fVolatile = true;
+        }
+    }
+    return balances;
+}
 
-            if(coin.IsTrusted())
-                nTotal += coin.GetAnonymizableCredit();
+/**
+ * The balances of every category. The totals are kept from one call to the
+ * next: only the shares of the transactions marked since, and of the volatile
+ * ones once the tip or the mempool has moved, are taken out and added again.
+ * All of them are worked out again after loading, adding keys or changing the
+ * obfuscation rounds.
+ */
+const CWallet::CWalletBalances& CWallet::GetBalances() const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+    if (fBalancesDirty || nObfuscationRoundsBalances != nObfuscationRounds) {
+        cachedBalances = CWalletBalances();
+        mapTxBalances.clear();
+        setBalancesVolatile.clear();
+        setBalancesPending.clear();
+        BOOST_FOREACH (const CWalletTx* pcoin, GetUnspentWalletTxs())
+            setBalancesPending.insert(pcoin->GetHash());
+        nObfuscationRoundsBalances = nObfuscationRounds;
+        fBalancesDirty = false;
+    }
+    const unsigned int nMempoolUpdated = mempool.GetTransactionsUpdated();
+    if (pindexBalances != chainActive.Tip() || nMempoolUpdatedBalances != nMempoolUpdated) {
+        setBalancesPending.insert(setBalancesVolatile.begin(), setBalancesVolatile.end());
+        pindexBalances = chainActive.Tip();
+        nMempoolUpdatedBalances = nMempoolUpdated;
+    }
+
+    BOOST_FOREACH (const uint256& hash, setBalancesPending) {
+        std::map<uint256, CWalletBalances>::iterator it = mapTxBalances.find(hash);
+        if (it != mapTxBalances.end()) {
+            cachedBalances.Add(it->second, -1);
+            mapTxBalances.erase(it);
+        }
+        setBalancesVolatile.erase(hash);
+
+        const CWalletTx* pcoin = GetWalletTx(hash);
+        if (!pcoin)
+            continue;
+        bool fVolatile;
+        const CWalletBalances balances = GetTxBalances(*pcoin, fVolatile);
+        if (!balances.IsNull()) {
+            cachedBalances.Add(balances, 1);
+            mapTxBalances.insert(std::make_pair(hash, balances));
         }
+        if (fVolatile)
+            setBalancesVolatile.insert(hash);
     }
+    setBalancesPending.clear();
+    return cachedBalances;
+}
 
-    return nTotal;
+CAmount CWallet::GetBalance() const
+{
+    LOCK2(cs_main, cs_wallet);
+    return GetBalances().nBalance;
 }
 
-CAmount CWallet::GetAnonymizedBalance() const
+CAmount CWallet::GetAnonymizableBalance() const
 {
-    if (fLiteMode) return 0;
+    if (fLiteMode)
+        return 0;
 
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
+    LOCK2(cs_main, cs_wallet);
+    return GetBalances().nAnonymizable;
+}
 
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAnonymizedCredit();
-        }
-    }
+CAmount CWallet::GetAnonymizedBalance() const
+{
+    if (fLiteMode) return 0;
 
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetBalances().nAnonymized;
 }
 
 // Note: calculated including unconfirmed,
@@ -1278,10 +1691,8 @@ double CWallet::GetAverageAnonymizedRounds() const
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-
-            uint256 hash = (*it).first;
+        BOOST_FOREACH (const CWalletTx* pcoin, GetUnspentWalletTxs()) {
+            uint256 hash = pcoin->GetHash();
 
             for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
                 CTxIn vin = CTxIn(hash, i);
@@ -1310,10 +1721,8 @@ CAmount CWallet::GetNormalizedAnonymizedBalance() const
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-
-            uint256 hash = (*it).first;
+        BOOST_FOREACH (const CWalletTx* pcoin, GetUnspentWalletTxs()) {
+            uint256 hash = pcoin->GetHash();
 
             for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
                 CTxIn vin = CTxIn(hash, i);
@@ -1334,88 +1743,38 @@ CAmount CWallet::GetDenominatedBalance(bool unconfirmed) const
 {
     if (fLiteMode) return 0;
 
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-
-            nTotal += pcoin->GetDenominatedCredit(unconfirmed);
-        }
-    }
-
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return unconfirmed ? GetBalances().nUnconfirmedDenominated : GetBalances().nDenominated;
 }
 
 CAmount CWallet::GetUnconfirmedBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (!IsFinalTx(*pcoin) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
-                nTotal += pcoin->GetAvailableCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetBalances().nUnconfirmed;
 }
 
 CAmount CWallet::GetImmatureBalance() const
 {
-    LOCK(cs_main);
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            nTotal += pcoin->GetImmatureCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetBalances().nImmature;
 }
 
 CAmount CWallet::GetWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetBalances().nWatchOnly;
 }
 
 CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (!IsFinalTx(*pcoin) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetBalances().nUnconfirmedWatchOnly;
 }
 
 CAmount CWallet::GetImmatureWatchOnlyBalance() const
 {
-    LOCK(cs_main);
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            nTotal += pcoin->GetImmatureWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetBalances().nImmatureWatchOnly;
 }
 
 /**
@@ -1427,9 +1786,8 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const uint256& wtxid = it->first;
-            const CWalletTx* pcoin = &(*it).second;
+        BOOST_FOREACH (const CWalletTx* pcoin, GetUnspentWalletTxs()) {
+            const uint256& wtxid = pcoin->GetHash();
 
             if (!CheckFinalTx(*pcoin))
                 continue;
@@ -1473,11 +1831,11 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
                 if (mine == ISMINE_NO)
                     continue;
 
-                if (IsLockedCoin((*it).first, i) && nCoinType != ONLY_DEPOSIT)
+                if (IsLockedCoin(wtxid, i) && nCoinType != ONLY_DEPOSIT)
                     continue;
                 if (pcoin->vout[i].nValue <= 0 && !fIncludeZeroValue)
                     continue;
-                if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected((*it).first, i))
+                if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected(wtxid, i))
                     continue;
 
                 bool fIsSpendable = false;
@@ -1511,61 +1869,33 @@ map<CBitcoinAddress, vector<COutput> > CWallet::AvailableCoinsByAddress(bool fCo
     return mapCoins;
 }
 
-static void ApproximateBestSubset(vector<pair<CAmount, pair<const CWalletTx*, unsigned int> > > vValue, const CAmount& nTotalLower, const CAmount& nTargetValue, vector<char>& vfBest, CAmount& nBest, int iterations = 1000)
-{
-    vector<char> vfIncluded;
-
-    vfBest.assign(vValue.size(), true);
-    nBest = nTotalLower;
-
-    seed_insecure_rand();
-
-    for (int nRep = 0; nRep < iterations && nBest != nTargetValue; nRep++) {
-        vfIncluded.assign(vValue.size(), false);
-        CAmount nTotal = 0;
-        bool fReachedTarget = false;
-        for (int nPass = 0; nPass < 2 && !fReachedTarget; nPass++) {
-            for (unsigned int i = 0; i < vValue.size(); i++) {
-                //The solver here uses a randomized algorithm,
-                //the randomness serves no real security purpose but is just
-                //needed to prevent degenerate behavior and it is important
-                //that the rng is fast. We do not use a constant random sequence,
-                //because there may be some privacy improvement by making
-                //the selection random.
-                if (nPass == 0 ? insecure_rand() & 1 : !vfIncluded[i]) {
-                    nTotal += vValue[i].first;
-                    vfIncluded[i] = true;
-                    if (nTotal >= nTargetValue) {
-                        fReachedTarget = true;
-                        if (nTotal < nBest) {
-                            nBest = nTotal;
-                            vfBest = vfIncluded;
-                        }
-                        nTotal -= vValue[i].first;
-                        vfIncluded[i] = false;
-                    }
-                }
-            }
-        }
+CCoinPool CWallet::MakeCoinPool(const vector<COutput>& vCoins, bool fIndexDestinations) const
+{
+    vector<CInputCoin> vInputCoins;
+    vInputCoins.reserve(vCoins.size());
+    BOOST_FOREACH (const COutput& out, vCoins) {
+        const CTxOut& txout = out.tx->vout[out.i];
+        vInputCoins.push_back(CInputCoin(out.tx, out.i, txout.nValue, out.nDepth, out.fSpendable, out.tx->IsFromMe(ISMINE_ALL), IsDenominatedAmount(txout.nValue)));
+        if (fIndexDestinations)
+            ExtractDestination(txout.scriptPubKey, vInputCoins.back().dest);
     }
+    return CCoinPool(vInputCoins);
 }
 
-
-// TODO: find appropriate place for this sort function
-// move denoms down
-bool less_then_denom(const COutput& out1, const COutput& out2)
+/** The spendable coins of the pool with enough confirmations, largest first. */
+static void GetSelectableCoins(const CCoinPool& pool, int nConfMine, int nConfTheirs, bool fIncludeDenominated, vector<const CInputCoin*>& vCoinsRet)
 {
-    const CWalletTx* pcoin1 = out1.tx;
-    const CWalletTx* pcoin2 = out2.tx;
-
-    bool found1 = false;
-    bool found2 = false;
-    BOOST_FOREACH (CAmount d, obfuScationDenominations) // loop through predefined denoms
-    {
-        if (pcoin1->vout[out1.i].nValue == d) found1 = true;
-        if (pcoin2->vout[out2.i].nValue == d) found2 = true;
+    vCoinsRet.clear();
+    vCoinsRet.reserve(pool.size());
+    BOOST_FOREACH (const CInputCoin& coin, pool.GetCoins()) {
+        if (!coin.fSpendable)
+            continue;
+        if (coin.nDepth < (coin.fFromMe ? nConfMine : nConfTheirs))
+            continue;
+        if (!fIncludeDenominated && coin.fDenominated)
+            continue;
+        vCoinsRet.push_back(&coin);
     }
-    return (!found1 && found2);
 }
 
 bool CWallet::SelectStakeCoins(std::set<std::pair<const CWalletTx*, unsigned int> >& setCoins, CAmount nTargetAmount) const
@@ -1616,135 +1946,47 @@ bool CWallet::MintableCoins()
     return false;
 }
 
-bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, vector<COutput> vCoins, set<pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet) const
+bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, const vector<COutput>& vCoins, set<pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet) const
+{
+    return SelectCoinsMinConf(nTargetValue, nConfMine, nConfTheirs, MakeCoinPool(vCoins), setCoinsRet, nValueRet);
+}
+
+bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, const CCoinPool& pool, set<pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet) const
 {
     setCoinsRet.clear();
     nValueRet = 0;
 
-    // List of values less than target
-    pair<CAmount, pair<const CWalletTx*, unsigned int> > coinLowestLarger;
-    coinLowestLarger.first = std::numeric_limits<CAmount>::max();
-    coinLowestLarger.second.first = NULL;
-    vector<pair<CAmount, pair<const CWalletTx*, unsigned int> > > vValue;
-    CAmount nTotalLower = 0;
-
-    random_shuffle(vCoins.begin(), vCoins.end(), GetRandInt);
-
-    // move denoms down on the list
-    sort(vCoins.begin(), vCoins.end(), less_then_denom);
-
     // try to find nondenom first to prevent unneeded spending of mixed coins
+    vector<const CInputCoin*> vCoins;
     for (unsigned int tryDenom = 0; tryDenom < 2; tryDenom++) {
         if (fDebug) LogPrint("selectcoins", "tryDenom: %d\n", tryDenom);
-        vValue.clear();
-        nTotalLower = 0;
-        BOOST_FOREACH (const COutput& output, vCoins) {
-            if (!output.fSpendable)
-                continue;
-
-            const CWalletTx* pcoin = output.tx;
-
-            //            if (fDebug) LogPrint("selectcoins", "value %s confirms %d\n", FormatMoney(pcoin->vout[output.i].nValue), output.nDepth);
-            if (output.nDepth < (pcoin->IsFromMe(ISMINE_ALL) ? nConfMine : nConfTheirs))
-                continue;
-
-            int i = output.i;
-            CAmount n = pcoin->vout[i].nValue;
-            if (tryDenom == 0 && IsDenominatedAmount(n)) continue; // we don't want denom values on first run
-
-            pair<CAmount, pair<const CWalletTx*, unsigned int> > coin = make_pair(n, make_pair(pcoin, i));
-
-            if (n == nTargetValue) {
-                setCoinsRet.insert(coin.second);
-                nValueRet += coin.first;
-                return true;
-            } else if (n < nTargetValue + CENT) {
-                vValue.push_back(coin);
-                nTotalLower += n;
-            } else if (n < coinLowestLarger.first) {
-                coinLowestLarger = coin;
-            }
-        }
-
-        if (nTotalLower == nTargetValue) {
-            for (unsigned int i = 0; i < vValue.size(); ++i) {
-                setCoinsRet.insert(vValue[i].second);
-                nValueRet += vValue[i].first;
-            }
-            return true;
-        }
-
-        if (nTotalLower < nTargetValue) {
-            if (coinLowestLarger.second.first == NULL) // there is no input larger than nTargetValue
-            {
-                if (tryDenom == 0)
-                    // we didn't look at denom yet, let's do it
-                    continue;
-                else
-                    // we looked at everything possible and didn't find anything, no luck
-                    return false;
-            }
-            setCoinsRet.insert(coinLowestLarger.second);
-            nValueRet += coinLowestLarger.first;
+        GetSelectableCoins(pool, nConfMine, nConfTheirs, tryDenom == 1, vCoins);
+        if (SelectCoinsKnapsack(vCoins, nTargetValue, setCoinsRet, nValueRet))
             return true;
-        }
-
-        // nTotalLower > nTargetValue
-        break;
-    }
-
-    // Solve subset sum by stochastic approximation
-    sort(vValue.rbegin(), vValue.rend(), CompareValueOnly());
-    vector<char> vfBest;
-    CAmount nBest;
-
-    ApproximateBestSubset(vValue, nTotalLower, nTargetValue, vfBest, nBest, 1000);
-    if (nBest != nTargetValue && nTotalLower >= nTargetValue + CENT)
-        ApproximateBestSubset(vValue, nTotalLower, nTargetValue + CENT, vfBest, nBest, 1000);
-
-    // If we have a bigger coin and (either the stochastic approximation didn't find a good solution,
-    //                                   or the next bigger coin is closer), return the bigger coin
-    if (coinLowestLarger.second.first &&
-        ((nBest != nTargetValue && nBest < nTargetValue + CENT) || coinLowestLarger.first <= nBest)) {
-        setCoinsRet.insert(coinLowestLarger.second);
-        nValueRet += coinLowestLarger.first;
-    } else {
-        string s = "CWallet::SelectCoinsMinConf best subset: ";
-        for (unsigned int i = 0; i < vValue.size(); i++) {
-            if (vfBest[i]) {
-                setCoinsRet.insert(vValue[i].second);
-                nValueRet += vValue[i].first;
-                s += FormatMoney(vValue[i].first) + " ";
-            }
-        }
-        LogPrintf("%s - total %s\n", s, FormatMoney(nBest));
     }
 
-    return true;
+    return false;
 }
 
-bool CWallet::SelectCoins(const CAmount& nTargetValue, set<pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet, const CCoinControl* coinControl, AvailableCoinsType coin_type, bool useIX) const
+bool CWallet::SelectCoins(const CCoinPool& pool, const CAmount& nTargetValue, const CAmount& nCostOfChange, set<pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet, const CCoinControl* coinControl, AvailableCoinsType coin_type) const
 {
     // Note: this function should never be used for "always free" tx types like dstx
 
-    vector<COutput> vCoins;
-    AvailableCoins(vCoins, true, coinControl, false, coin_type, useIX);
-
     // coin control -> return all selected outputs (we want all selected to go into the transaction for sure)
     if (coinControl && coinControl->HasSelected()) {
-        BOOST_FOREACH (const COutput& out, vCoins) {
-            if (!out.fSpendable)
+        BOOST_FOREACH (const CInputCoin& coin, pool.GetCoins()) {
+            if (!coin.fSpendable)
                 continue;
 
             if (coin_type == ONLY_DENOMINATED) {
-                CTxIn vin = CTxIn(out.tx->GetHash(), out.i);
+                CTxIn vin = CTxIn(coin.tx->GetHash(), coin.i);
                 int rounds = GetInputObfuscationRounds(vin);
                 // make sure it's actually anonymized
                 if (rounds < nObfuscationRounds) continue;
             }
 
-            nValueRet += out.tx->vout[out.i].nValue;
-            setCoinsRet.insert(make_pair(out.tx, out.i));
+            nValueRet += coin.nValue;
+            setCoinsRet.insert(coin.GetOutput());
         }
         return (nValueRet >= nTargetValue);
     }
@@ -1753,34 +1995,35 @@ bool CWallet::SelectCoins(const CAmount& nTargetValue, set<pair<const CWalletTx*
     if (coin_type == ONLY_DENOMINATED) {
         // Make outputs by looping through denominations, from large to small
         BOOST_FOREACH (CAmount v, obfuScationDenominations) {
-            BOOST_FOREACH (const COutput& out, vCoins) {
-                if (out.tx->vout[out.i].nValue == v                                               //make sure it's the denom we're looking for
-                    && nValueRet + out.tx->vout[out.i].nValue < nTargetValue + (0.1 * COIN) + 100 //round the amount up to .1 VALUTO over
-                    ) {
-                    CTxIn vin = CTxIn(out.tx->GetHash(), out.i);
+            pair<CCoinPool::const_iterator, CCoinPool::const_iterator> range = pool.GetValueRange(v);
+            for (CCoinPool::const_iterator it = range.first; it != range.second; ++it) {
+                if (nValueRet + it->nValue < nTargetValue + (0.1 * COIN) + 100) { //round the amount up to .1 VALUTO over
+                    CTxIn vin = CTxIn(it->tx->GetHash(), it->i);
                     int rounds = GetInputObfuscationRounds(vin);
                     // make sure it's actually anonymized
                     if (rounds < nObfuscationRounds) continue;
-                    nValueRet += out.tx->vout[out.i].nValue;
-                    setCoinsRet.insert(make_pair(out.tx, out.i));
+                    nValueRet += it->nValue;
+                    setCoinsRet.insert(it->GetOutput());
                 }
             }
         }
         return (nValueRet >= nTargetValue);
     }
 
-    return (SelectCoinsMinConf(nTargetValue, 1, 6, vCoins, setCoinsRet, nValueRet) ||
-            SelectCoinsMinConf(nTargetValue, 1, 1, vCoins, setCoinsRet, nValueRet) ||
-            (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue, 0, 1, vCoins, setCoinsRet, nValueRet)));
-}
-
-struct CompareByPriority {
-    bool operator()(const COutput& t1,
-        const COutput& t2) const
-    {
-        return t1.Priority() > t2.Priority();
+    // at each confirmation level, first look for coins that need no change output, then fall back to the knapsack
+    const int vConfs[3][2] = {{1, 6}, {1, 1}, {0, 1}};
+    vector<const CInputCoin*> vCoins;
+    for (unsigned int n = 0; n < 3; n++) {
+        if (n == 2 && !bSpendZeroConfChange)
+            break;
+        GetSelectableCoins(pool, vConfs[n][0], vConfs[n][1], false, vCoins);
+        if (SelectCoinsBnB(vCoins, nTargetValue, nCostOfChange, setCoinsRet, nValueRet))
+            return true;
+        if (SelectCoinsMinConf(nTargetValue, vConfs[n][0], vConfs[n][1], pool, setCoinsRet, nValueRet))
+            return true;
     }
-};
+    return false;
+}
 
 bool CWallet::SelectCoinsByDenominations(int nDenom, CAmount nValueMin, CAmount nValueMax, std::vector<CTxIn>& vCoinsRet, std::vector<COutput>& vCoinsRet2, CAmount& nValueRet, int nObfuscationRoundsMin, int nObfuscationRoundsMax)
 {
@@ -1788,8 +2031,21 @@ bool CWallet::SelectCoinsByDenominations(int nDenom, CAmount nValueMin, CAmount
     nValueRet = 0;
 
     vCoinsRet2.clear();
+    vector<COutput> vAvailable;
+    AvailableCoins(vAvailable, true, NULL, false, ONLY_DENOMINATED);
+
+    // only the denominations asked for can be accepted, so don't count the rounds of the others
+    const CAmount vDenomValues[] = {(10000 * COIN) + 10000000, (1000 * COIN) + 1000000, (100 * COIN) + 100000, (10 * COIN) + 10000, (1 * COIN) + 1000, (COIN / 10) + 100};
     vector<COutput> vCoins;
-    AvailableCoins(vCoins, true, NULL, ONLY_DENOMINATED);
+    vCoins.reserve(vAvailable.size());
+    BOOST_FOREACH (const COutput& out, vAvailable) {
+        for (int nBit = 0; nBit < 6; nBit++) {
+            if ((nDenom & (1 << nBit)) && out.tx->vout[out.i].nValue == vDenomValues[nBit]) {
+                vCoins.push_back(out);
+                break;
+            }
+        }
+    }
 
     std::random_shuffle(vCoins.rbegin(), vCoins.rend());
 
@@ -1836,7 +2092,7 @@ bool CWallet::SelectCoinsByDenominations(int nDenom, CAmount nValueMin, CAmount
                     //random reduce the max amount we'll submit for anonymity
                     nValueMax -= (rand() % (nValueMax / 5));
                     //on average use 50% of the inputs or less
-                    int r = (rand() % (int)vCoins.size());
+                    int r = (rand() % (int)vAvailable.size());
                     if ((int)vCoinsRet.size() > r) return true;
                 }
                 //Denomination criterion has been met, we can take any matching denominations
@@ -1895,14 +2151,20 @@ bool CWallet::SelectCoinsDark(CAmount nValueMin, CAmount nValueMax, std::vector<
     nValueRet = 0;
 
     vector<COutput> vCoins;
-    AvailableCoins(vCoins, true, coinControl, nObfuscationRoundsMin < 0 ? ONLY_NONDENOMINATED_NOTDEPOSITIFMN : ONLY_DENOMINATED);
+    AvailableCoins(vCoins, true, coinControl, false, nObfuscationRoundsMin < 0 ? ONLY_NONDENOMINATED_NOTDEPOSITIFMN : ONLY_DENOMINATED);
 
     set<pair<const CWalletTx*, unsigned int> > setCoinsRet2;
 
     //order the array so largest nondenom are first, then denominations, then very small inputs.
-    sort(vCoins.rbegin(), vCoins.rend(), CompareByPriority());
-
-    for(const COutput& out : vCoins) {
+    //the priorities are worked out once rather than on every comparison of the sort
+    vector<pair<int, size_t> > vOrder;
+    vOrder.reserve(vCoins.size());
+    for (size_t n = 0; n < vCoins.size(); n++)
+        vOrder.push_back(make_pair(vCoins[n].Priority(), n));
+    sort(vOrder.begin(), vOrder.end());
+
+    for (const PAIRTYPE(int, size_t) & item : vOrder) {
+        const COutput& out = vCoins[item.second];
         //do not allow inputs less than 1 CENT
         if (out.tx->vout[out.i].nValue < CENT) continue;
         //do not allow collaterals to be selected
@@ -2099,6 +2361,15 @@ bool CWallet::CreateTransaction(const vector<pair<CScript, CAmount> >& vecSend,
     {
         LOCK2(cs_main, cs_wallet);
         {
+            // the coins are gathered once; every pass of the fee loop below selects from the same pool
+            vector<COutput> vAvailable;
+            AvailableCoins(vAvailable, true, coinControl, false, coin_type, useIX);
+            const CCoinPool pool = MakeCoinPool(vAvailable);
+
+            // change worth less than creating and later spending it costs goes to the fee instead
+            const bool fCoinControlInputs = coinControl && coinControl->HasSelected();
+            const CAmount nCostOfChange = fCoinControlInputs ? 0 : CFeeRate(GetMinimumFee(1000, nTxConfirmTarget, mempool)).GetFee(CHANGE_OUTPUT_SIZE + CHANGE_SPEND_SIZE);
+
             nFeeRet = 0;
             if (nFeePay > 0) nFeeRet = nFeePay;
             while (true) {
@@ -2143,7 +2414,7 @@ bool CWallet::CreateTransaction(const vector<pair<CScript, CAmount> >& vecSend,
                 set<pair<const CWalletTx*, unsigned int> > setCoins;
                 CAmount nValueIn = 0;
 
-                if (!SelectCoins(nTotalValue, setCoins, nValueIn, coinControl, coin_type, useIX)) {
+                if (!SelectCoins(pool, nTotalValue, nCostOfChange, setCoins, nValueIn, coinControl, coin_type)) {
                     if (coin_type == ALL_COINS) {
                         strFailReason = _("Insufficient funds.");
                     } else if (coin_type == ONLY_NOTDEPOSITIFMN) {
@@ -2184,6 +2455,11 @@ bool CWallet::CreateTransaction(const vector<pair<CScript, CAmount> >& vecSend,
                     wtxNew.mapValue["DS"] = "1";
                 }
 
+                if (nChange > 0 && nChange <= nCostOfChange) {
+                    nFeeRet += nChange;
+                    nChange = 0;
+                }
+
                 if (nChange > 0) {
                     // Fill a vout to ourself
                     // TODO: pass in scriptChange instead of reservekey so
@@ -2234,8 +2510,9 @@ bool CWallet::CreateTransaction(const vector<pair<CScript, CAmount> >& vecSend,
 
                 // Sign
                 int nIn = 0;
+                const PrecomputedTransactionData txdata((CTransaction(txNew)));
                 BOOST_FOREACH (const PAIRTYPE(const CWalletTx*, unsigned int) & coin, setCoins)
-                    if (!SignSignature(*this, *coin.first, txNew, nIn++)) {
+                    if (!SignSignature(*this, *coin.first, txNew, nIn++, SIGHASH_ALL, &txdata)) {
                         strFailReason = _("Signing transaction failed");
                         return false;
                     }
@@ -2446,8 +2723,9 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, uint32_t nTime, unsigne
 
     // Sign
     int nIn = 0;
+    const PrecomputedTransactionData txdata((CTransaction(txNew)));
     for(const CWalletTx* pcoin : vwtxPrev) {
-        if (!SignSignature(*this, *pcoin, txNew, nIn++))
+        if (!SignSignature(*this, *pcoin, txNew, nIn++, SIGHASH_ALL, &txdata))
             return error("CreateCoinStake : failed to sign coinstake");
     }
 
@@ -2465,20 +2743,26 @@ bool CWallet::CommitTransaction(CWalletTx& wtxNew, CReserveKey& reservekey, std:
         LOCK2(cs_main, cs_wallet);
         LogPrintf("CommitTransaction:\n%s", wtxNew.ToString());
         {
-            // This is only to keep the database open to defeat the auto-flush for the
-            // duration of this scope.  This is the only place where this optimization
-            // maybe makes sense; please don't do it anywhere else.
-            CWalletDB* pwalletdb = fFileBacked ? new CWalletDB(strWalletFile, "r") : NULL;
+            // The key pool and transaction writes go to disk together when the batch ends
+            CDBBatch batch(fFileBacked);
 
             // Take key pair from key pool so it won't be used again
             reservekey.KeepKey();
 
             // Add tx to wallet, because if it has change it's also ours,
             // otherwise just for transaction history.
-            AddToWallet(wtxNew);
-
-            if (fFileBacked)
-                delete pwalletdb;
+            const bool fNew = !mapWallet.count(wtxNew.GetHash());
+            const bool fAdded = AddToWallet(wtxNew);
+
+            // The key and the transaction must be on disk before the transaction goes out
+            if (!fAdded || !batch.Commit()) {
+                LogPrintf("CommitTransaction() : Error: writing the transaction to the wallet failed\n");
+                // Nothing reached the disk, so the transaction must not stay in memory with its
+                // inputs spent either. The change key is left out of the pool until the next start.
+                if (fNew)
+                    UndoAddToWallet(wtxNew.GetHash());
+                return false;
+            }
         }
 
         // Track how many getdata requests our transaction gets
@@ -2685,6 +2969,14 @@ DBErrors CWallet::LoadWallet(bool& fFirstRunRet)
         return nLoadWalletRet;
     fFirstRunRet = !vchDefaultKey.IsValid();
 
+    {
+        // watch-only scripts are read after the transactions, so only now can we tell which outputs are ours
+        LOCK(cs_wallet);
+        BOOST_FOREACH (PAIRTYPE(const uint256, CWalletTx) & item, mapWallet)
+            AddToWalletUTXO(item.second);
+        fBalancesDirty = true;
+    }
+
     uiInterface.LoadWallet(this);
 
     return DB_LOAD_OK;
@@ -2782,50 +3074,120 @@ bool CWallet::NewKeyPool()
         if (IsLocked())
             return false;
 
-        int64_t nKeys = max(GetArg("-keypool", 1000), (int64_t)0);
-        for (int i = 0; i < nKeys; i++) {
-            int64_t nIndex = i + 1;
-            walletdb.WritePool(nIndex, CKeyPool(GenerateNewKey()));
-            setKeyPool.insert(nIndex);
-        }
-        LogPrintf("CWallet::NewKeyPool wrote %d new keys\n", nKeys);
+        if (!TopUpKeyPool())
+            return false;
+        LogPrintf("CWallet::NewKeyPool wrote %d new keys\n", setKeyPool.size());
     }
     return true;
 }
 
 bool CWallet::TopUpKeyPool(unsigned int kpSize)
 {
+    unsigned int nTargetSize;
+    if (kpSize > 0)
+        nTargetSize = kpSize;
+    else
+        nTargetSize = max(GetArg("-keypool", DEFAULT_KEYPOOL_SIZE), (int64_t)0);
+
+    bool fCompressed;
+    unsigned int nMissing;
     {
         LOCK(cs_wallet);
 
         if (IsLocked())
             return false;
 
-        CWalletDB walletdb(strWalletFile);
+        fCompressed = CanSupportFeature(FEATURE_COMPRPUBKEY);
+        nMissing = nTargetSize + 1 - std::min<unsigned int>(setKeyPool.size(), nTargetSize + 1);
+    }
 
-        // Top up key pool
-        unsigned int nTargetSize;
-        if (kpSize > 0)
-            nTargetSize = kpSize;
-        else
-            nTargetSize = max(GetArg("-keypool", 1000), (int64_t)0);
+    // Top up key pool, making each batch of keys before taking the wallet lock
+    // to encrypt and write them
+    std::vector<std::pair<CKey, CPubKey> > vKeys;
+    while (nMissing > 0) {
+        MakeNewKeys(std::min(nMissing, KEYPOOL_BATCH_KEYS), fCompressed, vKeys);
+
+        LOCK(cs_wallet);
+        if (IsLocked())
+            return false;
 
-        while (setKeyPool.size() < (nTargetSize + 1)) {
-            int64_t nEnd = 1;
-            if (!setKeyPool.empty())
-                nEnd = *(--setKeyPool.end()) + 1;
-            if (!walletdb.WritePool(nEnd, CKeyPool(GenerateNewKey())))
+        // the new indexes only go to setKeyPool once their pool records are on disk
+        CDBBatch batch;
+        CWalletDB walletdb(strWalletFile);
+        std::vector<int64_t> vIndex;
+        int64_t nEnd = setKeyPool.empty() ? 1 : *(--setKeyPool.end()) + 1;
+        for (unsigned int i = 0; i < vKeys.size() && setKeyPool.size() + vIndex.size() < nTargetSize + 1; i++, nEnd++) {
+            if (!walletdb.WritePool(nEnd, CKeyPool(AddNewKey(vKeys[i].first, vKeys[i].second))))
                 throw runtime_error("TopUpKeyPool() : writing generated key failed");
-            setKeyPool.insert(nEnd);
-            LogPrintf("keypool added key %d, size=%u\n", nEnd, setKeyPool.size());
-            double dProgress = 100.f * nEnd / (nTargetSize + 1);
-            std::string strMsg = strprintf(_("Loading wallet... (%3.2f %%)"), dProgress);
-            uiInterface.InitMessage(strMsg);
+            vIndex.push_back(nEnd);
         }
+        if (!batch.Commit())
+            throw runtime_error("TopUpKeyPool() : writing generated keys failed");
+        setKeyPool.insert(vIndex.begin(), vIndex.end());
+        nMissing = nTargetSize + 1 - std::min<unsigned int>(setKeyPool.size(), nTargetSize + 1);
+        LogPrintf("keypool added %u keys, size=%u\n", vIndex.size(), setKeyPool.size());
+        double dProgress = 100.f * setKeyPool.size() / (nTargetSize + 1);
+        std::string strMsg = strprintf(_("Loading wallet... (%3.2f %%)"), dProgress);
+        uiInterface.InitMessage(strMsg);
     }
     return true;
 }
 
+void CWallet::RefillKeyPool()
+{
+    LOCK(cs_wallet);
+    if (IsLocked())
+        return;
+
+    if (!fKeyPoolThreadRunning) {
+        TopUpKeyPool();
+        return;
+    }
+
+    // only the key about to be handed out is made here
+    if (setKeyPool.empty())
+        TopUpKeyPool(1);
+    if (setKeyPool.size() < (unsigned int)max(GetArg("-keypoolmin", DEFAULT_KEYPOOL_MIN), (int64_t)1)) {
+        boost::lock_guard<boost::mutex> lock(csKeyPoolThread);
+        fKeyPoolTopUpRequested = true;
+        condKeyPoolThread.notify_one();
+    }
+}
+
+void ThreadTopUpKeyPools()
+{
+    const unsigned int nMinKeys = max(GetArg("-keypoolmin", DEFAULT_KEYPOOL_MIN), (int64_t)1);
+    fKeyPoolThreadRunning = true;
+    try {
+        while (true) {
+            BOOST_FOREACH (CWallet* pwallet, vpwallets) {
+                bool fLow;
+                {
+                    LOCK(pwallet->cs_wallet);
+                    fLow = !pwallet->IsLocked() && pwallet->GetKeyPoolSize() < nMinKeys;
+                }
+                if (fLow) {
+                    // a failed write is retried on the next round; the other wallets carry on
+                    try {
+                        pwallet->TopUpKeyPool();
+                    } catch (std::exception& e) {
+                        PrintExceptionContinue(&e, "keypool");
+                    }
+                }
+                boost::this_thread::interruption_point();
+            }
+
+            boost::unique_lock<boost::mutex> lock(csKeyPoolThread);
+            condKeyPoolThread.timed_wait(lock, boost::posix_time::seconds(KEYPOOL_THREAD_INTERVAL), [] { return fKeyPoolTopUpRequested; });
+            fKeyPoolTopUpRequested = false;
+        }
+    } catch (...) {
+        // without the thread, RefillKeyPool tops up the whole pool itself again
+        fKeyPoolThreadRunning = false;
+        throw;
+    }
+}
+
 void CWallet::ReserveKeyFromKeyPool(int64_t& nIndex, CKeyPool& keypool)
 {
     nIndex = -1;
@@ -2833,8 +3195,7 @@ void CWallet::ReserveKeyFromKeyPool(int64_t& nIndex, CKeyPool& keypool)
     {
         LOCK(cs_wallet);
 
-        if (!IsLocked())
-            TopUpKeyPool();
+        RefillKeyPool();
 
         // Get the oldest key
         if (setKeyPool.empty())
@@ -3094,6 +3455,8 @@ bool CWallet::UpdatedTransaction(const uint256& hashTx)
         // Only notify UI if this transaction is in this wallet
         map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(hashTx);
         if (mi != mapWallet.end()) {
+            // a completed SwiftX lock changes the depth it counts at
+            MarkBalancesDirty(hashTx);
             NotifyTransactionChanged(this, hashTx, CT_UPDATED);
             return true;
         }
@@ -3105,17 +3468,21 @@ void CWallet::LockCoin(COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.insert(output);
+    MarkBalancesDirty(output.hash);
 }
 
 void CWallet::UnlockCoin(COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.erase(output);
+    MarkBalancesDirty(output.hash);
 }
 
 void CWallet::UnlockAllCoins()
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
+    BOOST_FOREACH (const COutPoint& output, setLockedCoins)
+        MarkBalancesDirty(output.hash);
     setLockedCoins.clear();
 }
 
@@ -3275,28 +3642,30 @@ void CWallet::AutoCombineDust()
         return;
     }
 
-    map<CBitcoinAddress, vector<COutput> > mapCoinsByAddress = AvailableCoinsByAddress(true, 0);
+    vector<COutput> vAvailable;
+    AvailableCoins(vAvailable, true);
+    const CCoinPool pool = MakeCoinPool(vAvailable, true);
 
     //coins are sectioned by address. This combination code only wants to combine inputs that belong to the same address
-    for (map<CBitcoinAddress, vector<COutput> >::iterator it = mapCoinsByAddress.begin(); it != mapCoinsByAddress.end(); it++) {
-        vector<COutput> vCoins, vRewardCoins;
-        vCoins = it->second;
+    for (map<CTxDestination, vector<size_t> >::const_iterator it = pool.GetDestinations().begin(); it != pool.GetDestinations().end(); it++) {
+        vector<const CInputCoin*> vRewardCoins;
 
         //find masternode rewards that need to be combined
         CCoinControl* coinControl = new CCoinControl();
         CAmount nTotalRewardsValue = 0;
-        BOOST_FOREACH (const COutput& out, vCoins) {
+        BOOST_FOREACH (size_t n, it->second) {
+            const CInputCoin& coin = pool.GetCoins()[n];
             //no coins should get this far if they dont have proper maturity, this is double checking
-            if (out.tx->IsCoinStake() && out.tx->GetDepthInMainChain() < COINBASE_MATURITY + 1)
+            if (coin.tx->IsCoinStake() && coin.nDepth < COINBASE_MATURITY + 1)
                 continue;
 
-            if (out.Value() > nAutoCombineThreshold * COIN)
+            if (coin.nValue > nAutoCombineThreshold * COIN)
                 continue;
 
-            COutPoint outpt(out.tx->GetHash(), out.i);
+            COutPoint outpt(coin.tx->GetHash(), coin.i);
             coinControl->Select(outpt);
-            vRewardCoins.push_back(out);
-            nTotalRewardsValue += out.Value();
+            vRewardCoins.push_back(&coin);
+            nTotalRewardsValue += coin.nValue;
         }
 
         //if no inputs found then return
@@ -3308,7 +3677,7 @@ void CWallet::AutoCombineDust()
             continue;
 
         vector<pair<CScript, CAmount> > vecSend;
-        CScript scriptPubKey = GetScriptForDestination(it->first.Get());
+        CScript scriptPubKey = GetScriptForDestination(it->first);
         vecSend.push_back(make_pair(scriptPubKey, nTotalRewardsValue));
 
         // Create the transaction and commit it to the network
@@ -3589,3 +3958,12 @@ bool CMerkleTx::IsTransactionLockTimedOut() const
 
     return false;
 }
+
+CWallet* FindWallet(const std::string& strWalletFile)
+{
+    BOOST_FOREACH (CWallet* pwallet, vpwallets) {
+        if (pwallet->strWalletFile == strWalletFile)
+            return pwallet;
+    }
+    return NULL;
+}
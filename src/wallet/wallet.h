@@ -26,6 +26,7 @@
 #include "masternode.h"
 
 #include <algorithm>
+#include <atomic>
 #include <map>
 #include <set>
 #include <stdexcept>
@@ -55,14 +56,41 @@ static const CAmount DEFAULT_TRANSACTION_MAXFEE = 1 * COIN;
 static const CAmount nHighTransactionMaxFeeWarning = 100 * nHighTransactionFeeWarning;
 //! Largest (in bytes) free transaction we're willing to create
 static const unsigned int MAX_FREE_TRANSACTION_CREATE_SIZE = 1000;
+//! Number of blocks a rescan reads ahead of the block it adds to the wallet
+static const unsigned int RESCAN_BATCH_BLOCKS = 256;
+//! -keypool default
+static const unsigned int DEFAULT_KEYPOOL_SIZE = 1000;
+//! -keypoolmin default: the keypool thread refills a pool that has fewer keys left than this
+static const unsigned int DEFAULT_KEYPOOL_MIN = 100;
+//! Keys made ahead, without the wallet lock, and then added to the pool in one go
+static const unsigned int KEYPOOL_BATCH_KEYS = 100;
+//! Seconds the keypool thread sleeps between looks at the pools when nothing wakes it
+static const unsigned int KEYPOOL_THREAD_INTERVAL = 10;
+//! Size (in bytes) of a pay-to-pubkey-hash change output, and of the input that later spends it
+static const unsigned int CHANGE_OUTPUT_SIZE = 34;
+static const unsigned int CHANGE_SPEND_SIZE = 148;
 
 class CAccountingEntry;
 class CCoinControl;
+class CCoinPool;
 class COutput;
 class CReserveKey;
 class CScript;
+class CWallet;
 class CWalletTx;
 
+//! The wallets loaded with -wallet, in the order given; the first of them is pwalletMain
+extern std::vector<CWallet*> vpwallets;
+
+/** The loaded wallet kept in the file strWalletFile, or NULL. */
+CWallet* FindWallet(const std::string& strWalletFile);
+
+/**
+ * Keeps the key pools of the loaded wallets above -keypoolmin keys, so that
+ * handing out an address doesn't wait on key generation.
+ */
+void ThreadTopUpKeyPools();
+
 /** (client) version numbers for particular wallet features */
 enum WalletFeature {
     FEATURE_BASE = 10500, // the earliest version new wallets supports (only useful for getinfo's clientversion output)
@@ -130,6 +158,23 @@ public:
     StringMap destdata;
 };
 
+/**
+ * The key ids, script ids and scripts a wallet could own. A rescan matches
+ * blocks against it on its own threads, without cs_wallet, and only hands
+ * the transactions it matches to IsMine. It matches every output IsMine
+ * accepts, and some it doesn't.
+ */
+class CWalletScanFilter
+{
+public:
+    std::set<uint160> setIDs;
+    std::set<CScript> setScripts;
+
+    bool IsRelevant(const CScript& scriptPubKey) const;
+    //! Whether any output of tx could be ours
+    bool IsRelevant(const CTransaction& tx) const;
+};
+
 /**
  * A CWallet is an extension of a keystore, which also maintains a set of transactions and balances,
  * and provides the ability to create new transactions.
@@ -137,8 +182,7 @@ public:
 class CWallet : public CCryptoKeyStore, public CValidationInterface
 {
 private:
-    bool SelectCoins(const CAmount& nTargetValue, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet, const CCoinControl* coinControl = NULL, AvailableCoinsType coin_type = ALL_COINS, bool useIX = true) const;
-    //it was public bool SelectCoins(int64_t nTargetValue, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, int64_t& nValueRet, const CCoinControl *coinControl = NULL, AvailableCoinsType coin_type=ALL_COINS, bool useIX = true) const;
+    bool SelectCoins(const CCoinPool& pool, const CAmount& nTargetValue, const CAmount& nCostOfChange, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet, const CCoinControl* coinControl = NULL, AvailableCoinsType coin_type = ALL_COINS) const;
 
     CWalletDB* pwalletdbEncryption;
 
@@ -163,6 +207,53 @@ private:
 
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
 
+    /**
+     * Outputs of wallet transactions that are ours and not known to be spent
+     * by a transaction in the main chain. This is a superset of the spendable
+     * coins, so AvailableCoins and the balances walk it instead of all of
+     * mapWallet. Outputs found spent in the main chain are dropped as it is
+     * walked, and put back by SyncTransaction if their spend is disconnected.
+     */
+    mutable std::set<COutPoint> setWalletUTXO;
+    void AddToWalletUTXO(const CWalletTx& wtx);
+    bool IsSpentInMainChain(const COutPoint& outpoint) const;
+    std::vector<const CWalletTx*> GetUnspentWalletTxs() const;
+
+    //! The balances by category, for one transaction or summed over the wallet
+    struct CWalletBalances {
+        CAmount nBalance;
+        CAmount nUnconfirmed;
+        CAmount nImmature;
+        CAmount nWatchOnly;
+        CAmount nUnconfirmedWatchOnly;
+        CAmount nImmatureWatchOnly;
+        CAmount nAnonymizable;
+        CAmount nAnonymized;
+        CAmount nDenominated;
+        CAmount nUnconfirmedDenominated;
+
+        bool IsNull() const;
+        void Add(const CWalletBalances& other, int nSign);
+    };
+    //! The totals, kept up to date by taking out and adding back what a changed transaction counts for
+    mutable CWalletBalances cachedBalances;
+    //! What each transaction counts for in cachedBalances, if anything
+    mutable std::map<uint256, CWalletBalances> mapTxBalances;
+    //! Transactions whose share of the totals is to be worked out again on the next read
+    mutable std::set<uint256> setBalancesPending;
+    //! Transactions whose share moves with the tip or the mempool: unconfirmed, immature, or spent by an unconfirmed transaction
+    mutable std::set<uint256> setBalancesVolatile;
+    //! The tip, mempool update count and obfuscation rounds the volatile shares were worked out at
+    mutable const CBlockIndex* pindexBalances;
+    mutable unsigned int nMempoolUpdatedBalances;
+    mutable int nObfuscationRoundsBalances;
+    //! Set when the shares of all transactions are to be worked out again, as after loading or adding keys
+    mutable bool fBalancesDirty;
+    void MarkBalancesDirty(const uint256& hash) const;
+    void MarkBalancesDirty(const CTransaction& tx) const;
+    CWalletBalances GetTxBalances(const CWalletTx& wtx, bool& fVolatile) const;
+    const CWalletBalances& GetBalances() const;
+
 public:
     bool MintableCoins();
     bool SelectStakeCoins(std::set<std::pair<const CWalletTx*, unsigned int> >& setCoins, CAmount nTargetAmount) const;
@@ -187,6 +278,8 @@ public:
 
     bool fFileBacked;
     bool fWalletUnlockAnonymizeOnly;
+    //! when walletpassphrase locks the wallet again, 0 if it doesn't
+    int64_t nRelockTime;
     std::string strWalletFile;
 
     std::set<int64_t> setKeyPool;
@@ -215,6 +308,14 @@ public:
     bool fCombineDust;
     CAmount nAutoCombineThreshold;
 
+    //! Progress of a running ScanForWalletTransactions, read by getrescaninfo without cs_wallet
+    std::atomic<bool> fScanningWallet;
+    std::atomic<bool> fAbortRescan;
+    std::atomic<int64_t> nScanStartTime;
+    std::atomic<int> nScanStartHeight;
+    std::atomic<int> nScanHeight;
+    std::atomic<int> nScanStopHeight;
+
     CWallet()
     {
         SetNull();
@@ -245,6 +346,11 @@ public:
         nLastResend = 0;
         nTimeFirstKey = 0;
         fWalletUnlockAnonymizeOnly = false;
+        nRelockTime = 0;
+        pindexBalances = NULL;
+        nMempoolUpdatedBalances = 0;
+        nObfuscationRoundsBalances = 0;
+        fBalancesDirty = true;
 
         // Stake Settings
         nHashDrift = 180;
@@ -264,6 +370,13 @@ public:
         //Auto Combine Dust
         fCombineDust = false;
         nAutoCombineThreshold = 0;
+
+        fScanningWallet = false;
+        fAbortRescan = false;
+        nScanStartTime = 0;
+        nScanStartHeight = 0;
+        nScanHeight = 0;
+        nScanStopHeight = 0;
     }
 
     bool isMultiSendEnabled()
@@ -301,7 +414,10 @@ public:
 
     void AvailableCoins(std::vector<COutput>& vCoins, bool fOnlyConfirmed = true, const CCoinControl* coinControl = NULL, bool fIncludeZeroValue = false, AvailableCoinsType nCoinType = ALL_COINS, bool fUseIX = false) const;
     std::map<CBitcoinAddress, std::vector<COutput> > AvailableCoinsByAddress(bool fConfirmed = true, CAmount maxCoinValue = 0);
-    bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, std::vector<COutput> vCoins, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet) const;
+    //! Bucket the coins AvailableCoins found for selection, indexing them by destination too if asked
+    CCoinPool MakeCoinPool(const std::vector<COutput>& vCoins, bool fIndexDestinations = false) const;
+    bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, const std::vector<COutput>& vCoins, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet) const;
+    bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, const CCoinPool& pool, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet) const;
 
     /// Get 1000DASH output and keys which can be used for the Masternode
     bool GetMasternodeVinAndKeys(CTxIn& txinRet, CPubKey& pubKeyRet, CKey& keyRet, std::string strTxHash = "", std::string strOutputIndex = "");
@@ -320,6 +436,8 @@ public:
     //  keystore implementation
     // Generate a new key
     CPubKey GenerateNewKey();
+    //! Adds a key made by MakeNewKeys to the wallet, with its metadata
+    CPubKey AddNewKey(const CKey& secret, const CPubKey& pubkey);
 
     //! Adds a key to the store, and saves it to disk.
     bool AddKeyPubKey(const CKey& key, const CPubKey& pubkey);
@@ -390,10 +508,14 @@ public:
 
     void MarkDirty();
     bool AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet = false);
+    //! Take a transaction AddToWallet just inserted back out of memory, when its record didn't reach the disk
+    void UndoAddToWallet(const uint256& hash);
     void SyncTransaction(const CTransaction& tx, const CBlock* pblock);
+    void BlockConnected(const CBlock& block, const std::list<CTransaction>& txConflicted);
     bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate);
     void EraseFromWallet(const uint256& hash);
     int ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false);
+    CWalletScanFilter GetScanFilter() const;
     void ReacceptWalletTransactions();
     void ResendWalletTransactions();
     CAmount GetBalance() const;
@@ -432,6 +554,8 @@ public:
 
     bool NewKeyPool();
     bool TopUpKeyPool(unsigned int kpSize = 0);
+    //! Make sure the pool has a key to hand out, and leave the rest of the refill to the keypool thread
+    void RefillKeyPool();
     void ReserveKeyFromKeyPool(int64_t& nIndex, CKeyPool& keypool);
     void KeepKey(int64_t nIndex);
     void ReturnKey(int64_t nIndex);
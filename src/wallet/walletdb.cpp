@@ -153,6 +153,23 @@ bool CWalletDB::ReadBestBlock(CBlockLocator& locator)
     return Read(std::string("bestblock"), locator);
 }
 
+bool CWalletDB::WriteRescanBlock(const CBlockLocator& locator)
+{
+    nWalletDBUpdated++;
+    return Write(std::string("rescanblock"), locator);
+}
+
+bool CWalletDB::ReadRescanBlock(CBlockLocator& locator)
+{
+    return Read(std::string("rescanblock"), locator);
+}
+
+bool CWalletDB::EraseRescanBlock()
+{
+    nWalletDBUpdated++;
+    return Erase(std::string("rescanblock"));
+}
+
 bool CWalletDB::WriteOrderPosNext(int64_t nOrderPosNext)
 {
     nWalletDBUpdated++;
@@ -840,7 +857,7 @@ DBErrors CWalletDB::ZapWalletTx(CWallet* pwallet, vector<CWalletTx>& vWtx)
     return DB_LOAD_OK;
 }
 
-void ThreadFlushWalletDB(const string& strFile)
+void ThreadFlushWalletDB(const std::vector<string>& vWalletFiles)
 {
     // Make this thread recognisable as the wallet flushing thread
     RenameThread("valuto-wallet");
@@ -876,18 +893,20 @@ void ThreadFlushWalletDB(const string& strFile)
 
                 if (nRefCount == 0) {
                     boost::this_thread::interruption_point();
-                    map<string, int>::iterator mi = bitdb.mapFileUseCount.find(strFile);
-                    if (mi != bitdb.mapFileUseCount.end()) {
-                        LogPrint("db", "Flushing wallet.dat\n");
-                        nLastFlushed = nWalletDBUpdated;
+                    nLastFlushed = nWalletDBUpdated;
+                    BOOST_FOREACH (const string& strFile, vWalletFiles) {
+                        map<string, int>::iterator mi = bitdb.mapFileUseCount.find(strFile);
+                        if (mi == bitdb.mapFileUseCount.end())
+                            continue;
+                        LogPrint("db", "Flushing %s\n", strFile);
                         int64_t nStart = GetTimeMillis();
 
-                        // Flush wallet.dat so it's self contained
+                        // Flush the wallet file so it's self contained
                         bitdb.CloseDb(strFile);
                         bitdb.CheckpointLSN(strFile);
 
-                        bitdb.mapFileUseCount.erase(mi++);
-                        LogPrint("db", "Flushed wallet.dat %dms\n", GetTimeMillis() - nStart);
+                        bitdb.mapFileUseCount.erase(mi);
+                        LogPrint("db", "Flushed %s %dms\n", strFile, GetTimeMillis() - nStart);
                     }
                 }
             }
@@ -899,6 +918,7 @@ bool BackupWallet(const CWallet& wallet, const string& strDest)
 {
     if (!wallet.fFileBacked)
         return false;
+    CDB::CommitPending();
     while (true) {
         {
             LOCK(bitdb.cs_db);
@@ -941,14 +961,14 @@ bool BackupWallet(const CWallet& wallet, const string& strDest)
 bool CWalletDB::Recover(CDBEnv& dbenv, std::string filename, bool fOnlyKeys)
 {
     // Recovery procedure:
-    // move wallet.dat to wallet.timestamp.bak
+    // move wallet.dat to wallet.dat.timestamp.bak
     // Call Salvage with fAggressive=true to
     // get as much data as possible.
     // Rewrite salvaged data to wallet.dat
     // Set -rescan so any missing transactions will be
     // found.
     int64_t now = GetTime();
-    std::string newFilename = strprintf("wallet.%d.bak", now);
+    std::string newFilename = strprintf("%s.%d.bak", filename, now);
 
     int result = dbenv.dbenv.dbrename(NULL, filename.c_str(), NULL,
         newFilename.c_str(), DB_AUTO_COMMIT);
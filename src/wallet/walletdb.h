@@ -106,6 +106,11 @@ public:
     bool WriteBestBlock(const CBlockLocator& locator);
     bool ReadBestBlock(CBlockLocator& locator);
 
+    //! The block an unfinished rescan got to, to resume it from
+    bool WriteRescanBlock(const CBlockLocator& locator);
+    bool ReadRescanBlock(CBlockLocator& locator);
+    bool EraseRescanBlock();
+
     bool WriteOrderPosNext(int64_t nOrderPosNext);
 
     // presstab
@@ -3,25 +3,104 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "zmqabstractnotifier.h"
+#include "main.h"
 #include "util.h"
+#include "version.h"
 
 
+CZMQNotification::CZMQNotification(const uint256& hashIn, const CDiskBlockPos& posBlockIn) : type(BLOCK), hash(hashIn), posBlock(posBlockIn)
+{
+}
+
+CZMQNotification::CZMQNotification(Type typeIn, const CTransaction& tx) : type(typeIn), hash(tx.GetHash()), ptx(new CTransaction(tx))
+{
+}
+
+CZMQNotification::CZMQNotification(Type typeIn, const uint256& hashIn, const CZMQPayload& payloadRawIn) : type(typeIn), hash(hashIn), payloadRaw(payloadRawIn)
+{
+}
+
+const CZMQPayload& CZMQNotification::GetHashPayload()
+{
+    if (!payloadHash) {
+        payloadHash.reset(new CDataStream(SER_NETWORK, PROTOCOL_VERSION));
+        payloadHash->resize(32);
+        for (unsigned int i = 0; i < 32; i++)
+            (*payloadHash)[31 - i] = hash.begin()[i];
+    }
+    return payloadHash;
+}
+
+const CZMQPayload& CZMQNotification::GetRawPayload()
+{
+    if (!payloadRaw) {
+        CZMQPayload payload(new CDataStream(SER_NETWORK, PROTOCOL_VERSION));
+        if (ptx) {
+            *payload << *ptx;
+        } else if (type == BLOCK) {
+            // the position was taken when the tip changed, so reading needs no cs_main
+            CBlock block;
+            if (!ReadBlockFromDisk(block, posBlock) || block.GetHash() != hash) {
+                zmqError("Can't read block from disk");
+                return payloadRaw;
+            }
+            *payload << block;
+        }
+        payloadRaw = payload;
+    }
+    return payloadRaw;
+}
+
 CZMQAbstractNotifier::~CZMQAbstractNotifier()
 {
     assert(!psocket);
 }
 
-bool CZMQAbstractNotifier::NotifyBlock(const CBlockIndex * /*CBlockIndex*/)
+bool CZMQAbstractNotifier::Notify(CZMQNotification &notification)
+{
+    switch (notification.GetType()) {
+    case CZMQNotification::BLOCK:
+        return NotifyBlock(notification);
+    case CZMQNotification::TRANSACTION:
+        return NotifyTransaction(notification);
+    case CZMQNotification::TRANSACTION_LOCK:
+        return NotifyTransactionLock(notification);
+    case CZMQNotification::TRANSACTION_REMOVED:
+        return NotifyTransactionRemoved(notification);
+    case CZMQNotification::MASTERNODE_WINNER:
+        return NotifyMasternodeWinner(notification);
+    case CZMQNotification::SPORK:
+        return NotifySpork(notification);
+    }
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifyBlock(CZMQNotification &/*notification*/)
+{
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifyTransaction(CZMQNotification &/*notification*/)
+{
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifyTransactionLock(CZMQNotification &/*notification*/)
+{
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifyTransactionRemoved(CZMQNotification &/*notification*/)
 {
     return true;
 }
 
-bool CZMQAbstractNotifier::NotifyTransaction(const CTransaction &/*transaction*/)
+bool CZMQAbstractNotifier::NotifyMasternodeWinner(CZMQNotification &/*notification*/)
 {
     return true;
 }
 
-bool CZMQAbstractNotifier::NotifyTransactionLock(const CTransaction &/*transaction*/)
+bool CZMQAbstractNotifier::NotifySpork(CZMQNotification &/*notification*/)
 {
     return true;
 }
@@ -7,11 +7,61 @@
 
 #include "zmqconfig.h"
 
-class CBlockIndex;
+#include "chain.h"
+#include "streams.h"
+#include "uint256.h"
+
+#include <boost/shared_ptr.hpp>
+
 class CZMQAbstractNotifier;
 
 typedef CZMQAbstractNotifier* (*CZMQNotifierFactory)();
 
+/** A message body, serialized once and sent as it is by every notifier that publishes it. */
+typedef boost::shared_ptr<CDataStream> CZMQPayload;
+
+/**
+ * An event on its way from the validation callbacks to the notifiers. It
+ * holds what the event is about; its payloads are serialized the first time
+ * a notifier asks for them, on the publishing thread, and shared by every
+ * notifier publishing the same form.
+ */
+class CZMQNotification
+{
+public:
+    enum Type {
+        BLOCK,
+        TRANSACTION,
+        TRANSACTION_LOCK,
+        TRANSACTION_REMOVED,
+        MASTERNODE_WINNER,
+        SPORK,
+    };
+
+    //! A new chain tip, stored at posBlockIn
+    CZMQNotification(const uint256& hashIn, const CDiskBlockPos& posBlockIn);
+    //! A transaction seen, locked or removed from the mempool
+    CZMQNotification(Type typeIn, const CTransaction& tx);
+    //! An event that comes serialized already
+    CZMQNotification(Type typeIn, const uint256& hashIn, const CZMQPayload& payloadRawIn);
+
+    Type GetType() const { return type; }
+    const uint256& GetHash() const { return hash; }
+
+    //! The hash of what the event is about, in the byte order it is shown in
+    const CZMQPayload& GetHashPayload();
+    //! What the event is about as it is relayed on the network; empty if the block can't be read
+    const CZMQPayload& GetRawPayload();
+
+private:
+    Type type;
+    uint256 hash;
+    CDiskBlockPos posBlock;
+    boost::shared_ptr<const CTransaction> ptx;
+    CZMQPayload payloadHash;
+    CZMQPayload payloadRaw;
+};
+
 class CZMQAbstractNotifier
 {
 public:
@@ -32,9 +82,15 @@ public:
     virtual bool Initialize(void *pcontext) = 0;
     virtual void Shutdown() = 0;
 
-    virtual bool NotifyBlock(const CBlockIndex *pindex);
-    virtual bool NotifyTransaction(const CTransaction &transaction);
-    virtual bool NotifyTransactionLock(const CTransaction &transaction);
+    //! Hands the notification to the method for its type; false if this notifier failed
+    bool Notify(CZMQNotification &notification);
+
+    virtual bool NotifyBlock(CZMQNotification &notification);
+    virtual bool NotifyTransaction(CZMQNotification &notification);
+    virtual bool NotifyTransactionLock(CZMQNotification &notification);
+    virtual bool NotifyTransactionRemoved(CZMQNotification &notification);
+    virtual bool NotifyMasternodeWinner(CZMQNotification &notification);
+    virtual bool NotifySpork(CZMQNotification &notification);
 
 protected:
     void *psocket;
@@ -7,15 +7,19 @@
 
 #include "version.h"
 #include "main.h"
+#include "masternode-payments.h"
+#include "spork.h"
 #include "streams.h"
 #include "util.h"
 
+#include <boost/bind.hpp>
+
 void zmqError(const char *str)
 {
     LogPrint("zmq", "zmq: Error: %s, errno=%s\n", str, zmq_strerror(errno));
 }
 
-CZMQNotificationInterface::CZMQNotificationInterface() : pcontext(NULL)
+CZMQNotificationInterface::CZMQNotificationInterface() : pcontext(NULL), fRunning(false)
 {
 }
 
@@ -38,9 +42,12 @@ CZMQNotificationInterface* CZMQNotificationInterface::CreateWithArguments(const
     factories["pubhashblock"] = CZMQAbstractNotifier::Create<CZMQPublishHashBlockNotifier>;
     factories["pubhashtx"] = CZMQAbstractNotifier::Create<CZMQPublishHashTransactionNotifier>;
     factories["pubhashtxlock"] = CZMQAbstractNotifier::Create<CZMQPublishHashTransactionLockNotifier>;
+    factories["pubhashtxremoved"] = CZMQAbstractNotifier::Create<CZMQPublishHashTransactionRemovedNotifier>;
     factories["pubrawblock"] = CZMQAbstractNotifier::Create<CZMQPublishRawBlockNotifier>;
     factories["pubrawtx"] = CZMQAbstractNotifier::Create<CZMQPublishRawTransactionNotifier>;
     factories["pubrawtxlock"] = CZMQAbstractNotifier::Create<CZMQPublishRawTransactionLockNotifier>;
+    factories["pubrawmnwinner"] = CZMQAbstractNotifier::Create<CZMQPublishRawMasternodeWinnerNotifier>;
+    factories["pubrawspork"] = CZMQAbstractNotifier::Create<CZMQPublishRawSporkNotifier>;
 
     for (std::map<std::string, CZMQNotifierFactory>::const_iterator i=factories.begin(); i!=factories.end(); ++i)
     {
@@ -105,6 +112,9 @@ bool CZMQNotificationInterface::Initialize()
         return false;
     }
 
+    fRunning = true;
+    threadPublish = boost::thread(boost::bind(&CZMQNotificationInterface::ThreadPublish, this));
+
     return true;
 }
 
@@ -112,6 +122,16 @@ bool CZMQNotificationInterface::Initialize()
 void CZMQNotificationInterface::Shutdown()
 {
     LogPrint("zmq", "zmq: Shutdown notification interface\n");
+    if (threadPublish.joinable())
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(cs_queue);
+            fRunning = false;
+        }
+        condQueue.notify_all();
+        threadPublish.join();
+    }
+
     if (pcontext)
     {
         for (std::list<CZMQAbstractNotifier*>::iterator i=notifiers.begin(); i!=notifiers.end(); ++i)
@@ -126,53 +146,96 @@ void CZMQNotificationInterface::Shutdown()
     }
 }
 
-void CZMQNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindex)
+void CZMQNotificationInterface::Enqueue(CZMQNotification *pnotification)
 {
-    for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
+    boost::shared_ptr<CZMQNotification> notification(pnotification);
     {
-        CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyBlock(pindex))
-        {
-            i++;
-        }
-        else
-        {
-            notifier->Shutdown();
-            i = notifiers.erase(i);
-        }
+        boost::unique_lock<boost::mutex> lock(cs_queue);
+        while (fRunning && queue.size() >= ZMQ_MAX_QUEUE_DEPTH)
+            condQueue.wait(lock);
+        if (!fRunning)
+            return;
+        queue.push_back(notification);
     }
+    condQueue.notify_all();
 }
 
-void CZMQNotificationInterface::SyncTransaction(const CTransaction &tx, const CBlock *pblock)
+void CZMQNotificationInterface::ThreadPublish()
 {
-    for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
+    RenameThread("valuto-zmqpub");
+
+    while (true)
     {
-        CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyTransaction(tx))
-        {
-            i++;
-        }
-        else
+        boost::shared_ptr<CZMQNotification> notification;
         {
-            notifier->Shutdown();
-            i = notifiers.erase(i);
+            boost::unique_lock<boost::mutex> lock(cs_queue);
+            while (fRunning && queue.empty())
+                condQueue.wait(lock);
+            if (queue.empty())
+                break;
+            notification = queue.front();
+            queue.pop_front();
         }
+        condQueue.notify_all();
+        Publish(*notification);
     }
 }
 
-void CZMQNotificationInterface::NotifyTransactionLock(const CTransaction &tx)
+void CZMQNotificationInterface::Publish(CZMQNotification &notification)
 {
     for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
     {
         CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyTransactionLock(tx))
+        if (notifier->Notify(notification))
         {
             i++;
         }
         else
         {
             notifier->Shutdown();
+            delete notifier;
             i = notifiers.erase(i);
         }
     }
 }
+
+void CZMQNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindex)
+{
+    // the block is read on the publishing thread, from where it is stored now
+    CDiskBlockPos pos;
+    {
+        LOCK(cs_main);
+        pos = pindex->GetBlockPos();
+    }
+    Enqueue(new CZMQNotification(pindex->GetBlockHash(), pos));
+}
+
+void CZMQNotificationInterface::SyncTransaction(const CTransaction &tx, const CBlock *pblock)
+{
+    Enqueue(new CZMQNotification(CZMQNotification::TRANSACTION, tx));
+}
+
+void CZMQNotificationInterface::NotifyTransactionLock(const CTransaction &tx)
+{
+    Enqueue(new CZMQNotification(CZMQNotification::TRANSACTION_LOCK, tx));
+}
+
+void CZMQNotificationInterface::RemovedFromMempool(const CTransaction &tx)
+{
+    Enqueue(new CZMQNotification(CZMQNotification::TRANSACTION_REMOVED, tx));
+}
+
+void CZMQNotificationInterface::NotifyMasternodeWinner(const CMasternodePaymentWinner &winner)
+{
+    // votes and sporks are small, serializing them here is cheaper than copying them
+    CZMQPayload payload(new CDataStream(SER_NETWORK, PROTOCOL_VERSION));
+    *payload << winner;
+    Enqueue(new CZMQNotification(CZMQNotification::MASTERNODE_WINNER, winner.GetHash(), payload));
+}
+
+void CZMQNotificationInterface::NotifySporkUpdate(const CSporkMessage &spork)
+{
+    CZMQPayload payload(new CDataStream(SER_NETWORK, PROTOCOL_VERSION));
+    *payload << spork;
+    Enqueue(new CZMQNotification(CZMQNotification::SPORK, spork.GetHash(), payload));
+}
@@ -6,12 +6,26 @@
 #define BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
 
 #include "validationinterface.h"
+#include <deque>
+#include <list>
 #include <string>
 #include <map>
 
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
 class CBlockIndex;
 class CZMQAbstractNotifier;
+class CZMQNotification;
+
+//! Most notifications waiting for the publishing thread before the validation callbacks wait for it
+static const size_t ZMQ_MAX_QUEUE_DEPTH = 10000;
 
+/**
+ * Publishes validation events through the configured notifiers. The
+ * validation callbacks only queue the events; a thread of its own reads,
+ * serializes and sends them, so that publishing doesn't hold up validation.
+ */
 class CZMQNotificationInterface : public CValidationInterface
 {
 public:
@@ -27,12 +41,28 @@ protected:
     void SyncTransaction(const CTransaction &tx, const CBlock *pblock);
     void UpdatedBlockTip(const CBlockIndex *pindex);
     void NotifyTransactionLock(const CTransaction &tx);
+    void RemovedFromMempool(const CTransaction &tx);
+    void NotifyMasternodeWinner(const CMasternodePaymentWinner &winner);
+    void NotifySporkUpdate(const CSporkMessage &spork);
 
 private:
     CZMQNotificationInterface();
 
+    //! Hands a notification to the publishing thread, waiting while the queue is full
+    void Enqueue(CZMQNotification *pnotification);
+    //! Sends what is queued until Shutdown, then what is left
+    void ThreadPublish();
+    //! Sends one notification through every notifier, dropping the ones that fail
+    void Publish(CZMQNotification &notification);
+
     void *pcontext;
     std::list<CZMQAbstractNotifier*> notifiers;
+
+    boost::mutex cs_queue;
+    boost::condition_variable condQueue;
+    std::deque<boost::shared_ptr<CZMQNotification> > queue;
+    bool fRunning;
+    boost::thread threadPublish;
 };
 
 #endif // BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
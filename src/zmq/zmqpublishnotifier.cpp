@@ -2,9 +2,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
-#include "chainparams.h"
 #include "zmqpublishnotifier.h"
-#include "main.h"
 #include "util.h"
 #include "crypto/common.h"
 
@@ -13,47 +11,72 @@ static std::multimap<std::string, CZMQAbstractPublishNotifier*> mapPublishNotifi
 static const char *MSG_HASHBLOCK  = "hashblock";
 static const char *MSG_HASHTX     = "hashtx";
 static const char *MSG_HASHTXLOCK = "hashtxlock";
+static const char *MSG_HASHTXREMOVED = "hashtxremoved";
 static const char *MSG_RAWBLOCK   = "rawblock";
 static const char *MSG_RAWTX      = "rawtx";
 static const char *MSG_RAWTXLOCK = "rawtxlock";
+static const char *MSG_RAWMNWINNER = "rawmnwinner";
+static const char *MSG_RAWSPORK = "rawspork";
 
-// Internal function to send multipart message
-static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
+// Internal function to send one part of a multipart message, copying it
+static int zmq_send_part(void *sock, const void* data, size_t size, bool fMore)
 {
-    va_list args;
-    va_start(args, size);
+    zmq_msg_t msg;
 
-    while (1)
+    int rc = zmq_msg_init_size(&msg, size);
+    if (rc != 0)
     {
-        zmq_msg_t msg;
+        zmqError("Unable to initialize ZMQ msg");
+        return -1;
+    }
 
-        int rc = zmq_msg_init_size(&msg, size);
-        if (rc != 0)
-        {
-            zmqError("Unable to initialize ZMQ msg");
-            return -1;
-        }
+    void *buf = zmq_msg_data(&msg);
+    memcpy(buf, data, size);
 
-        void *buf = zmq_msg_data(&msg);
-        memcpy(buf, data, size);
+    rc = zmq_msg_send(&msg, sock, fMore ? ZMQ_SNDMORE : 0);
+    if (rc == -1)
+    {
+        zmqError("Unable to send ZMQ msg");
+        zmq_msg_close(&msg);
+        return -1;
+    }
+
+    zmq_msg_close(&msg);
+    return 0;
+}
 
-        data = va_arg(args, const void*);
+// Called by zmq once it is done with a payload, which may be on its I/O thread
+static void zmq_release_payload(void * /*data*/, void *hint)
+{
+    delete static_cast<CZMQPayload*>(hint);
+}
 
-        rc = zmq_msg_send(&msg, sock, data ? ZMQ_SNDMORE : 0);
-        if (rc == -1)
-        {
-            zmqError("Unable to send ZMQ msg");
-            zmq_msg_close(&msg);
-            return -1;
-        }
+// Internal function to send one part of a multipart message without copying
+// it; zmq holds a reference to the payload until the message went out
+static int zmq_send_payload(void *sock, const CZMQPayload &payload, bool fMore)
+{
+    assert(payload && !payload->empty());
 
-        zmq_msg_close(&msg);
+    zmq_msg_t msg;
 
-        if (!data)
-            break;
+    CZMQPayload *phold = new CZMQPayload(payload);
+    int rc = zmq_msg_init_data(&msg, &(*payload->begin()), payload->size(), zmq_release_payload, phold);
+    if (rc != 0)
+    {
+        zmqError("Unable to initialize ZMQ msg");
+        delete phold;
+        return -1;
+    }
 
-        size = va_arg(args, size_t);
+    rc = zmq_msg_send(&msg, sock, fMore ? ZMQ_SNDMORE : 0);
+    if (rc == -1)
+    {
+        zmqError("Unable to send ZMQ msg");
+        zmq_msg_close(&msg);
+        return -1;
     }
+
+    zmq_msg_close(&msg);
     return 0;
 }
 
@@ -126,15 +149,16 @@ void CZMQAbstractPublishNotifier::Shutdown()
     psocket = 0;
 }
 
-bool CZMQAbstractPublishNotifier::SendMessage(const char *command, const void* data, size_t size)
+bool CZMQAbstractPublishNotifier::SendMessage(const char *command, const CZMQPayload &payload)
 {
     assert(psocket);
 
     /* send three parts, command & data & a LE 4byte sequence number */
     unsigned char msgseq[sizeof(uint32_t)];
     WriteLE32(&msgseq[0], nSequence);
-    int rc = zmq_send_multipart(psocket, command, strlen(command), data, size, msgseq, (size_t)sizeof(uint32_t), (void*)0);
-    if (rc == -1)
+    if (zmq_send_part(psocket, command, strlen(command), true) == -1 ||
+        zmq_send_payload(psocket, payload, true) == -1 ||
+        zmq_send_part(psocket, msgseq, sizeof(msgseq), false) == -1)
         return false;
 
     /* increment memory only sequence number after sending */
@@ -143,72 +167,59 @@ bool CZMQAbstractPublishNotifier::SendMessage(const char *command, const void* d
     return true;
 }
 
-bool CZMQPublishHashBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
+bool CZMQPublishHashBlockNotifier::NotifyBlock(CZMQNotification &notification)
 {
-    uint256 hash = pindex->GetBlockHash();
-    LogPrint("zmq", "zmq: Publish hashblock %s\n", hash.GetHex());
-    char data[32];
-    for (unsigned int i = 0; i < 32; i++)
-        data[31 - i] = hash.begin()[i];
-    return SendMessage(MSG_HASHBLOCK, data, 32);
+    LogPrint("zmq", "zmq: Publish hashblock %s\n", notification.GetHash().GetHex());
+    return SendMessage(MSG_HASHBLOCK, notification.GetHashPayload());
 }
 
-bool CZMQPublishHashTransactionNotifier::NotifyTransaction(const CTransaction &transaction)
+bool CZMQPublishHashTransactionNotifier::NotifyTransaction(CZMQNotification &notification)
 {
-    uint256 hash = transaction.GetHash();
-    LogPrint("zmq", "zmq: Publish hashtx %s\n", hash.GetHex());
-    char data[32];
-    for (unsigned int i = 0; i < 32; i++)
-        data[31 - i] = hash.begin()[i];
-    return SendMessage(MSG_HASHTX, data, 32);
+    LogPrint("zmq", "zmq: Publish hashtx %s\n", notification.GetHash().GetHex());
+    return SendMessage(MSG_HASHTX, notification.GetHashPayload());
 }
 
-bool CZMQPublishHashTransactionLockNotifier::NotifyTransactionLock(const CTransaction &transaction)
+bool CZMQPublishHashTransactionLockNotifier::NotifyTransactionLock(CZMQNotification &notification)
 {
-    uint256 hash = transaction.GetHash();
-    LogPrint("zmq", "zmq: Publish hashtxlock %s\n", hash.GetHex());
-    char data[32];
-    for (unsigned int i = 0; i < 32; i++)
-        data[31 - i] = hash.begin()[i];
-    return SendMessage(MSG_HASHTXLOCK, data, 32);
+    LogPrint("zmq", "zmq: Publish hashtxlock %s\n", notification.GetHash().GetHex());
+    return SendMessage(MSG_HASHTXLOCK, notification.GetHashPayload());
 }
 
-bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
+bool CZMQPublishHashTransactionRemovedNotifier::NotifyTransactionRemoved(CZMQNotification &notification)
 {
-    LogPrint("zmq", "zmq: Publish rawblock %s\n", pindex->GetBlockHash().GetHex());
+    LogPrint("zmq", "zmq: Publish hashtxremoved %s\n", notification.GetHash().GetHex());
+    return SendMessage(MSG_HASHTXREMOVED, notification.GetHashPayload());
+}
 
-// XX42    const Consensus::Params& consensusParams = Params().GetConsensus();
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    {
-        LOCK(cs_main);
-        CBlock block;
-// XX42        if(!ReadBlockFromDisk(block, pindex, consensusParams))
-        if(!ReadBlockFromDisk(block, pindex))
-        {
-            zmqError("Can't read block from disk");
-            return false;
-        }
+bool CZMQPublishRawBlockNotifier::NotifyBlock(CZMQNotification &notification)
+{
+    LogPrint("zmq", "zmq: Publish rawblock %s\n", notification.GetHash().GetHex());
+    const CZMQPayload& payload = notification.GetRawPayload();
+    if (!payload)
+        return false;
+    return SendMessage(MSG_RAWBLOCK, payload);
+}
 
-        ss << block;
-    }
+bool CZMQPublishRawTransactionNotifier::NotifyTransaction(CZMQNotification &notification)
+{
+    LogPrint("zmq", "zmq: Publish rawtx %s\n", notification.GetHash().GetHex());
+    return SendMessage(MSG_RAWTX, notification.GetRawPayload());
+}
 
-    return SendMessage(MSG_RAWBLOCK, &(*ss.begin()), ss.size());
+bool CZMQPublishRawTransactionLockNotifier::NotifyTransactionLock(CZMQNotification &notification)
+{
+    LogPrint("zmq", "zmq: Publish rawtxlock %s\n", notification.GetHash().GetHex());
+    return SendMessage(MSG_RAWTXLOCK, notification.GetRawPayload());
 }
 
-bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &transaction)
+bool CZMQPublishRawMasternodeWinnerNotifier::NotifyMasternodeWinner(CZMQNotification &notification)
 {
-    uint256 hash = transaction.GetHash();
-    LogPrint("zmq", "zmq: Publish rawtx %s\n", hash.GetHex());
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    ss << transaction;
-    return SendMessage(MSG_RAWTX, &(*ss.begin()), ss.size());
+    LogPrint("zmq", "zmq: Publish rawmnwinner %s\n", notification.GetHash().GetHex());
+    return SendMessage(MSG_RAWMNWINNER, notification.GetRawPayload());
 }
 
-bool CZMQPublishRawTransactionLockNotifier::NotifyTransactionLock(const CTransaction &transaction)
+bool CZMQPublishRawSporkNotifier::NotifySpork(CZMQNotification &notification)
 {
-    uint256 hash = transaction.GetHash();
-    LogPrint("zmq", "zmq: Publish rawtxlock %s\n", hash.GetHex());
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    ss << transaction;
-    return SendMessage(MSG_RAWTXLOCK, &(*ss.begin()), ss.size());
+    LogPrint("zmq", "zmq: Publish rawspork %s\n", notification.GetHash().GetHex());
+    return SendMessage(MSG_RAWSPORK, notification.GetRawPayload());
 }
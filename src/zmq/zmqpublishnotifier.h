@@ -7,22 +7,21 @@
 
 #include "zmqabstractnotifier.h"
 
-class CBlockIndex;
-
 class CZMQAbstractPublishNotifier : public CZMQAbstractNotifier
 {
 private:
-    uint32_t nSequence; // upcounting per message sequence number
+    uint32_t nSequence; // upcounting per message sequence number of this topic
 
 public:
+    CZMQAbstractPublishNotifier() : nSequence(0) { }
 
     /* send zmq multipart message
        parts:
           * command
-          * data
+          * data, handed to zmq without a copy
           * message sequence number
     */
-    bool SendMessage(const char *command, const void* data, size_t size);
+    bool SendMessage(const char *command, const CZMQPayload &payload);
 
     bool Initialize(void *pcontext);
     void Shutdown();
@@ -31,37 +30,55 @@ public:
 class CZMQPublishHashBlockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyBlock(const CBlockIndex *pindex);
+    bool NotifyBlock(CZMQNotification &notification);
 };
 
 class CZMQPublishHashTransactionNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyTransaction(const CTransaction &transaction);
+    bool NotifyTransaction(CZMQNotification &notification);
 };
 
 class CZMQPublishHashTransactionLockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyTransactionLock(const CTransaction &transaction);
+    bool NotifyTransactionLock(CZMQNotification &notification);
+};
+
+class CZMQPublishHashTransactionRemovedNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyTransactionRemoved(CZMQNotification &notification);
 };
 
 class CZMQPublishRawBlockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyBlock(const CBlockIndex *pindex);
+    bool NotifyBlock(CZMQNotification &notification);
 };
 
 class CZMQPublishRawTransactionNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyTransaction(const CTransaction &transaction);
+    bool NotifyTransaction(CZMQNotification &notification);
 };
 
 class CZMQPublishRawTransactionLockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyTransactionLock(const CTransaction &transaction);
+    bool NotifyTransactionLock(CZMQNotification &notification);
+};
+
+class CZMQPublishRawMasternodeWinnerNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyMasternodeWinner(CZMQNotification &notification);
+};
+
+class CZMQPublishRawSporkNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifySpork(CZMQNotification &notification);
 };
 
 #endif // BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H